@@ -13,6 +13,14 @@ UBSAN:=n
 
 RENDERER:=vulkan
 
+# time Renderer API calls in --benchmark reports
+# with RENDERER:=null this measures CPU overhead only, like cmake's smaaCPUBench
+CALL_STATS:=n
+
+# count heap allocations per frame, shown in the GUI and --benchmark reports
+# --assert-no-allocations then checks that steady-state frames don't allocate
+ALLOCATION_TRACKING:=n
+
 
 INTERNAL_glslang:=y
 LDLIBS_glslang:=
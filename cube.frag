@@ -26,31 +26,59 @@ THE SOFTWARE.
 #include "shaderDefines.h"
 
 readonly restrict layout(std430, set = 1, binding = 1) buffer cubeData {
-    Cube cubes[];
+    CubeData cubes[];
 };
 
 
 layout(location = 0) flat in int instance;
+
+#ifdef VELOCITY
+
 layout(location = 1) in vec3 currPos;
 layout(location = 2) in vec3 prevPos;
 
+#endif  // VELOCITY
+
+
+#ifdef DEPTH_ONLY
+
+
+// the depth prepass has no color attachments
+void main(void)
+{
+}
+
+
+#else  // DEPTH_ONLY
+
 
 layout (location = 0) out vec4 outColor;
+
+#ifdef VELOCITY
+
 layout (location = 1) out vec2 outVelocity;
 
+#endif  // VELOCITY
+
 
 void main(void)
 {
-    Cube cube = cubes[instance];
+    Cube cube = loadCube(instance);
 
     vec4 color = vec4(cube.color, 0.0);
 
     color.w = dot(color.xyz, vec3(0.299, 0.587, 0.114));
     outColor = color;
-    outVelocity = vec2(0.0, 0.0);
+
+#ifdef VELOCITY
 
     // w stored in z
     vec2 curr   = currPos.xy / currPos.z;
     vec2 prev   = prevPos.xy / prevPos.z;
     outVelocity = curr - prev;
+
+#endif  // VELOCITY
 }
+
+
+#endif  // DEPTH_ONLY
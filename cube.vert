@@ -26,43 +26,173 @@ THE SOFTWARE.
 #include "shaderDefines.h"
 
 
+#ifdef CUBE_IMPOSTOR
+
+// two triangles of a camera facing quad
+const vec2 impostorCorners[6] = vec2[6](
+      vec2(-1.0, -1.0), vec2( 1.0, -1.0), vec2(-1.0,  1.0)
+    , vec2(-1.0,  1.0), vec2( 1.0, -1.0), vec2( 1.0,  1.0)
+);
+
+#elif defined(PROCEDURAL_CUBE)
+
+// same triangles as the demo's index buffer
+// corner bit 0 is y, bit 1 is x and bit 2 is z
+const uint cubeCorners[36] = uint[36](
+      1, 3, 5,  5, 3, 7  // top
+    , 0, 2, 1,  1, 2, 3  // front
+    , 7, 6, 5,  5, 6, 4  // back
+    , 0, 1, 4,  4, 1, 5  // left
+    , 2, 6, 3,  3, 6, 7  // right
+    , 2, 0, 6,  6, 0, 4  // bottom
+);
+
+#else  // CUBE_IMPOSTOR
+
 layout(location = ATTR_POS) in vec3 position;
 
+#endif  // CUBE_IMPOSTOR
+
+
+#ifdef SCENE_MESH
+
+// scene file instances are grouped by mesh, one draw per mesh
+layout(push_constant) uniform ScenePushConstants {
+    uint firstInstance;
+};
+
+#endif  // SCENE_MESH
+
 
 readonly restrict layout(std430, set = 1, binding = 1) buffer cubeData {
-    Cube cubes[];
+    CubeData cubes[];
+};
+
+
+#ifdef CUBE_CULLING
+
+// indices of cubes which passed the cull pass
+readonly restrict layout(std430, set = 1, binding = 2) buffer visibleData {
+    uint visibleCubes[];
 };
 
+#endif  // CUBE_CULLING
+
 
 layout(location = 0) flat out int instance;
+
+// the depth prepass and the scene must agree on depth exactly
+invariant gl_Position;
+
+#ifdef VELOCITY
+
 layout(location = 1) out vec3 currPos;
 layout(location = 2) out vec3 prevPos;
 
+#endif  // VELOCITY
 
-void main(void)
+
+#ifdef CUBE_IMPOSTOR
+
+// a view space offset only goes through the projection
+// whose x and y scales are the lengths of the first two rows of viewProj
+vec2 projectionScale(mat4 m)
 {
-    Cube cube = cubes[gl_InstanceIndex];
+    return vec2(length(vec3(m[0][0], m[1][0], m[2][0])), length(vec3(m[0][1], m[1][1], m[2][1])));
+}
 
-    // rotate
-    // this is quaternion multiplication from glm
-    vec3 v = position;
-    vec3 rotationQuat = cube.rotation.xyz;
-    float qw = cube.rotation.w;
+#else  // CUBE_IMPOSTOR
+
+// this is quaternion multiplication from glm
+vec3 rotate(vec4 q, vec3 v)
+{
+    vec3 rotationQuat = q.xyz;
+    float qw = q.w;
     vec3 uv = cross(rotationQuat, v);
     vec3 uuv = cross(rotationQuat, uv);
     uv *= (2.0 * qw);
     uuv *= 2.0;
-    vec3 rotatedPos = v + uv + uuv;
-    vec4 worldPos = vec4(rotatedPos + cube.position, 1.0);
+    return v + uv + uuv;
+}
+
+#endif  // CUBE_IMPOSTOR
+
+
+void main(void)
+{
+#ifdef CUBE_CULLING
+    int cubeIndex = int(visibleCubes[gl_InstanceIndex]);
+#elif defined(SCENE_MESH)
+    int cubeIndex = int(firstInstance) + gl_InstanceIndex;
+#else  // CUBE_CULLING
+    int cubeIndex = gl_InstanceIndex;
+#endif  // CUBE_CULLING
+
+#ifdef CUBE_ANIMATION
+    // the animation pass writes each cube's current pose followed by the previous frame's
+    int dataIndex = 2 * cubeIndex;
+    Cube prevCube = loadCube(dataIndex + 1);
+#else  // CUBE_ANIMATION
+    int dataIndex = cubeIndex;
+#endif  // CUBE_ANIMATION
+
+    Cube cube = loadCube(dataIndex);
+
+#ifdef CUBE_IMPOSTOR
+
+    // turned by the cube's rotation so the edges aren't all parallel
+    vec2 dir    = normalize(cube.rotation.xy + vec2(0.0001, 0.0));
+    vec2 corner = impostorCorners[gl_VertexIndex];
+    corner      = vec2(dir.x * corner.x - dir.y * corner.y, dir.y * corner.x + dir.x * corner.y) * (sqrt(3.0) / 2.0);
+
+    vec4 worldPos = vec4(cube.position, 1.0);
+    gl_Position     = viewProj * worldPos;
+    gl_Position.xy += corner * projectionScale(viewProj);
+
+#ifdef VELOCITY
+#ifdef CUBE_ANIMATION
+    vec4 prevClip   = prevViewProj * vec4(prevCube.position, 1.0);
+#else  // CUBE_ANIMATION
+    vec4 prevClip   = prevViewProj * worldPos;
+#endif  // CUBE_ANIMATION
+    prevClip.xy    += corner * projectionScale(prevViewProj);
+#endif  // VELOCITY
+
+#else  // CUBE_IMPOSTOR
+
+#ifdef PROCEDURAL_CUBE
+    uint corner = cubeCorners[gl_VertexIndex];
+    vec3 v = (vec3((corner >> 1) & 1u, corner & 1u, (corner >> 2) & 1u) * 2.0 - 1.0) * (sqrt(3.0) / 2.0);
+#else  // PROCEDURAL_CUBE
+    vec3 v = position;
+#endif  // PROCEDURAL_CUBE
+    vec4 worldPos = vec4(rotate(cube.rotation, v) + cube.position, 1.0);
 
     gl_Position = viewProj * worldPos;
+
+#ifdef VELOCITY
+#ifdef CUBE_ANIMATION
+    vec4 prevClip = prevViewProj * vec4(rotate(prevCube.rotation, v) + prevCube.position, 1.0);
+#else  // CUBE_ANIMATION
+    vec4 prevClip = prevViewProj * worldPos;
+#endif  // CUBE_ANIMATION
+#endif  // VELOCITY
+
+#endif  // CUBE_IMPOSTOR
+
+#ifdef VELOCITY
+
     currPos     = gl_Position.xyw;
-    prevPos     = (prevViewProj * worldPos).xyw;
+    prevPos     = prevClip.xyw;
     // Positions in projection space are in [-1, 1] range, while texture
     // coordinates are in [0, 1] range. So, we divide by 2 to get velocities in
     // the scale (and flip the y axis):
-    currPos.xy *= vec2(0.5, -0.5);
-    prevPos.xy *= vec2(0.5, -0.5);
+    // with dynamic resolution texture coordinates only cover renderScale
+    currPos.xy *= vec2(0.5, -0.5) * renderScale.xy;
+    prevPos.xy *= vec2(0.5, -0.5) * renderScale.xy;
+
+#endif  // VELOCITY
 
-    instance = gl_InstanceIndex;
+    // the fragment shader reads the color from the same buffer
+    instance = dataIndex;
 }
@@ -0,0 +1,426 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <pcg_random.hpp>
+
+#include "BenchmarkCompare.h"
+#include "utils/Utils.h"
+
+
+static const unsigned int bootstrapResamples = 1000;
+// with hundreds of frames per configuration tiny shifts are significant too
+// changes smaller than this fraction of the baseline median are not reported
+static const float        negligibleChange   = 0.01f;
+static const double       significanceLevel  = 0.01;
+
+
+namespace {
+
+
+// only as much JSON as the benchmark report needs
+struct JsonValue {
+	enum class Type : uint8_t {
+		  Null
+		, Bool
+		, Number
+		, String
+		, Array
+		, Object
+	};
+
+	Type                                              type;
+	bool                                              boolean;
+	double                                            number;
+	std::string                                       string;
+	std::vector<JsonValue>                            array;
+	std::vector<std::pair<std::string, JsonValue> >   object;
+
+
+	JsonValue()
+	: type(Type::Null)
+	, boolean(false)
+	, number(0.0)
+	{
+	}
+
+	const JsonValue *get(const char *key) const {
+		for (const auto &member : object) {
+			if (member.first == key) {
+				return &member.second;
+			}
+		}
+		return nullptr;
+	}
+};
+
+
+class JsonParser {
+	const char  *begin;
+	const char  *it;
+	const char  *end;
+
+
+	[[noreturn]] void fail(const char *what) {
+		throw std::runtime_error(std::string("JSON parse error at offset ") + std::to_string(it - begin) + ": " + what);
+	}
+
+	void skipSpace() {
+		while (it < end && (*it == ' ' || *it == '\t' || *it == '\n' || *it == '\r')) {
+			it++;
+		}
+	}
+
+	void expect(char c) {
+		skipSpace();
+		if (it >= end || *it != c) {
+			fail("unexpected character");
+		}
+		it++;
+	}
+
+	bool consume(const char *literal) {
+		size_t len = strlen(literal);
+		if (size_t(end - it) >= len && memcmp(it, literal, len) == 0) {
+			it += len;
+			return true;
+		}
+		return false;
+	}
+
+	std::string parseString() {
+		expect('"');
+		std::string result;
+		while (true) {
+			if (it >= end) {
+				fail("unterminated string");
+			}
+
+			char c = *it++;
+			if (c == '"') {
+				return result;
+			}
+			if (c != '\\') {
+				result.push_back(c);
+				continue;
+			}
+
+			if (it >= end) {
+				fail("unterminated string");
+			}
+			c = *it++;
+			switch (c) {
+			case 'b':
+				result.push_back('\b');
+				break;
+
+			case 'f':
+				result.push_back('\f');
+				break;
+
+			case 'n':
+				result.push_back('\n');
+				break;
+
+			case 'r':
+				result.push_back('\r');
+				break;
+
+			case 't':
+				result.push_back('\t');
+				break;
+
+			case 'u':
+				// the report doesn't write these, keep the length right at least
+				if (end - it < 4) {
+					fail("truncated escape");
+				}
+				it += 4;
+				result.push_back('?');
+				break;
+
+			default:
+				result.push_back(c);
+				break;
+			}
+		}
+	}
+
+	JsonValue parseValue() {
+		skipSpace();
+		if (it >= end) {
+			fail("unexpected end");
+		}
+
+		JsonValue value;
+		switch (*it) {
+		case '{':
+			it++;
+			value.type = JsonValue::Type::Object;
+			skipSpace();
+			if (it < end && *it == '}') {
+				it++;
+				break;
+			}
+			while (true) {
+				std::string key = parseString();
+				expect(':');
+				value.object.emplace_back(std::move(key), parseValue());
+				skipSpace();
+				if (it < end && *it == ',') {
+					it++;
+					continue;
+				}
+				expect('}');
+				break;
+			}
+			break;
+
+		case '[':
+			it++;
+			value.type = JsonValue::Type::Array;
+			skipSpace();
+			if (it < end && *it == ']') {
+				it++;
+				break;
+			}
+			while (true) {
+				value.array.emplace_back(parseValue());
+				skipSpace();
+				if (it < end && *it == ',') {
+					it++;
+					continue;
+				}
+				expect(']');
+				break;
+			}
+			break;
+
+		case '"':
+			value.type   = JsonValue::Type::String;
+			value.string = parseString();
+			break;
+
+		default:
+			if (consume("null")) {
+				value.type    = JsonValue::Type::Null;
+			} else if (consume("true")) {
+				value.type    = JsonValue::Type::Bool;
+				value.boolean = true;
+			} else if (consume("false")) {
+				value.type    = JsonValue::Type::Bool;
+				value.boolean = false;
+			} else {
+				// the buffer is NUL terminated so strtod stops at the end
+				char *numberEnd = nullptr;
+				value.type   = JsonValue::Type::Number;
+				value.number = strtod(it, &numberEnd);
+				if (numberEnd == it) {
+					fail("unexpected character");
+				}
+				it = numberEnd;
+			}
+			break;
+		}
+
+		return value;
+	}
+
+
+public:
+
+	// last character of the buffer must be NUL
+	JsonParser(const char *begin_, const char *end_)
+	: begin(begin_)
+	, it(begin_)
+	, end(end_)
+	{
+		assert(begin < end);
+		assert(*(end - 1) == '\0');
+		// keep the terminator out of the parsed range
+		end--;
+	}
+
+	JsonValue parse() {
+		JsonValue value = parseValue();
+		skipSpace();
+		if (it != end) {
+			fail("trailing characters");
+		}
+		return value;
+	}
+};
+
+
+}  // namespace
+
+
+static std::vector<float> readSamples(const JsonValue *array) {
+	std::vector<float> samples;
+	if (array && array->type == JsonValue::Type::Array) {
+		samples.reserve(array->array.size());
+		for (const auto &v : array->array) {
+			samples.push_back(float(v.number));
+		}
+	}
+	return samples;
+}
+
+
+std::vector<BaselineResult> loadBenchmarkBaseline(const std::string &filename) {
+	auto contents = readTextFile(filename);
+	JsonValue root = JsonParser(contents.data(), contents.data() + contents.size()).parse();
+
+	std::vector<BaselineResult> results;
+	const JsonValue *configs = root.get("configurations");
+	if (configs && configs->type == JsonValue::Type::Array) {
+		for (const auto &config : configs->array) {
+			const JsonValue *samples = config.get("samples");
+			if (!samples) {
+				continue;
+			}
+
+			BaselineResult r;
+			if (const JsonValue *name = config.get("name")) {
+				r.name = name->string;
+			}
+			if (const JsonValue *device = config.get("device")) {
+				r.device = device->string;
+			}
+			r.cpuFrameTimes = readSamples(samples->get("cpu"));
+			r.gpuFrameTimes = readSamples(samples->get("gpu"));
+			if (const JsonValue *passes = samples->get("passes")) {
+				for (const auto &pass : passes->object) {
+					r.gpuPassTimes.emplace_back(pass.first, readSamples(&pass.second));
+				}
+			}
+			results.emplace_back(std::move(r));
+		}
+	}
+
+	if (results.empty()) {
+		throw std::runtime_error("No per frame samples in benchmark baseline \"" + filename + "\"");
+	}
+
+	return results;
+}
+
+
+static float median(std::vector<float> &values) {
+	assert(!values.empty());
+	size_t mid = values.size() / 2;
+	std::nth_element(values.begin(), values.begin() + mid, values.end());
+	return values[mid];
+}
+
+
+// normal approximation with tie and continuity corrections, fine for tens of samples or more
+static double mannWhitneyPValue(const std::vector<float> &a, const std::vector<float> &b) {
+	std::vector<std::pair<float, bool> > all;
+	all.reserve(a.size() + b.size());
+	for (float v : a) {
+		all.emplace_back(v, true);
+	}
+	for (float v : b) {
+		all.emplace_back(v, false);
+	}
+	std::sort(all.begin(), all.end());
+
+	double n1 = double(a.size());
+	double n2 = double(b.size());
+	double n  = n1 + n2;
+
+	// tied values all get their average rank
+	double rankSumA = 0.0;
+	double tieTerm  = 0.0;
+	size_t i = 0;
+	while (i < all.size()) {
+		size_t j = i + 1;
+		while (j < all.size() && all[j].first == all[i].first) {
+			j++;
+		}
+		double rank = 0.5 * double(i + 1 + j);
+		for (size_t k = i; k < j; k++) {
+			if (all[k].second) {
+				rankSumA += rank;
+			}
+		}
+		double t = double(j - i);
+		tieTerm += t * t * t - t;
+		i = j;
+	}
+
+	double u     = rankSumA - n1 * (n1 + 1.0) / 2.0;
+	double mean  = n1 * n2 / 2.0;
+	double sigma = sqrt(n1 * n2 / 12.0 * ((n + 1.0) - tieTerm / (n * (n - 1.0))));
+	if (sigma <= 0.0) {
+		return 1.0;
+	}
+
+	double z = std::max(fabs(u - mean) - 0.5, 0.0) / sigma;
+	return erfc(z / sqrt(2.0));
+}
+
+
+SampleComparison compareSamples(const std::vector<float> &baseline, const std::vector<float> &current) {
+	SampleComparison result;
+	if (baseline.size() < 2 || current.size() < 2) {
+		return result;
+	}
+
+	std::vector<float> b(baseline);
+	std::vector<float> c(current);
+	result.baselineMedian = median(b);
+	result.median         = median(c);
+	result.delta          = result.median - result.baselineMedian;
+	result.pValue         = mannWhitneyPValue(baseline, current);
+
+	pcg32 rng(12345);
+	std::vector<float> deltas;
+	deltas.reserve(bootstrapResamples);
+	for (unsigned int r = 0; r < bootstrapResamples; r++) {
+		for (auto &v : b) {
+			v = baseline[rng(static_cast<uint32_t>(baseline.size()))];
+		}
+		for (auto &v : c) {
+			v = current[rng(static_cast<uint32_t>(current.size()))];
+		}
+		deltas.push_back(median(c) - median(b));
+	}
+	std::sort(deltas.begin(), deltas.end());
+	result.deltaLow  = deltas[bootstrapResamples * 25 / 1000];
+	result.deltaHigh = deltas[bootstrapResamples * 975 / 1000];
+
+	bool excludesZero = (result.deltaLow > 0.0f || result.deltaHigh < 0.0f);
+	bool negligible   = fabs(result.delta) < negligibleChange * result.baselineMedian;
+	result.significant = excludesZero && !negligible && result.pValue < significanceLevel;
+
+	return result;
+}
@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef BENCHMARKCOMPARE_H
+#define BENCHMARKCOMPARE_H
+
+
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// per frame samples of one configuration from an earlier JSON benchmark report
+struct BaselineResult {
+	std::string         name;
+	std::string         device;
+	// milliseconds in measurement order
+	std::vector<float>  cpuFrameTimes;
+	std::vector<float>  gpuFrameTimes;
+	std::vector<std::pair<std::string, std::vector<float> > >  gpuPassTimes;
+};
+
+
+// throws std::runtime_error if the file can't be read or has no samples
+std::vector<BaselineResult> loadBenchmarkBaseline(const std::string &filename);
+
+
+struct SampleComparison {
+	float   baselineMedian;
+	float   median;
+	// median minus baselineMedian, with its 95% bootstrap confidence interval
+	float   delta;
+	float   deltaLow;
+	float   deltaHigh;
+	// two-sided Mann-Whitney U test
+	double  pValue;
+	// the interval excludes zero, p is below the threshold and the change is not negligible
+	bool    significant;
+
+
+	SampleComparison()
+	: baselineMedian(0.0f)
+	, median(0.0f)
+	, delta(0.0f)
+	, deltaLow(0.0f)
+	, deltaHigh(0.0f)
+	, pValue(1.0)
+	, significant(false)
+	{
+	}
+
+	bool isRegression() const {
+		return significant && delta > 0.0f;
+	}
+};
+
+
+// times, so bigger is worse
+// deterministic, the bootstrap uses a fixed seed
+SampleComparison compareSamples(const std::vector<float> &baseline, const std::vector<float> &current);
+
+
+#endif  // BENCHMARKCOMPARE_H
@@ -0,0 +1,214 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cassert>
+#include <cfloat>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "SceneFile.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+
+SceneFile::SceneFile(const std::string &filename)
+: file(filename)
+, vertices(nullptr)
+, indices(nullptr)
+, meshes(nullptr)
+, materials(nullptr)
+, instances(nullptr)
+, cameraKeys(nullptr)
+, center(0.0f, 0.0f, 0.0f)
+, radius(0.0f)
+, animated(false)
+{
+	if (file.size() < sizeof(header)) {
+		throw std::runtime_error("Scene file \"" + filename + "\" is truncated");
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (memcmp(header.magic, sceneFileMagic, sizeof(sceneFileMagic)) != 0) {
+		throw std::runtime_error("Not a scene file: \"" + filename + "\"");
+	}
+
+	if (header.version != sceneFileVersion) {
+		throw std::runtime_error("Scene file \"" + filename + "\" is version " + std::to_string(header.version) + ", expected " + std::to_string(sceneFileVersion));
+	}
+
+	if (header.numMeshes == 0 || header.numMaterials == 0 || header.numInstances == 0 || header.numCameraKeys == 0) {
+		throw std::runtime_error("Scene file \"" + filename + "\" is empty");
+	}
+
+	// every record is a multiple of 4 bytes and the mapping is page aligned
+	// so the arrays can be used in place
+	uint64_t offset = sizeof(header);
+	auto array = [&] (uint32_t count, size_t size) {
+		uint64_t bytes = uint64_t(count) * size;
+		// buffer sizes are 32-bit
+		if (bytes > UINT32_MAX) {
+			throw std::runtime_error("Scene file \"" + filename + "\" has too big arrays");
+		}
+		if (file.size() - offset < bytes) {
+			throw std::runtime_error("Scene file \"" + filename + "\" is truncated");
+		}
+		const char *ptr = file.data() + offset;
+		offset += bytes;
+		return ptr;
+	};
+
+	vertices   = reinterpret_cast<const SceneVertex *>(array(header.numVertices,     sizeof(SceneVertex)));
+	indices    = reinterpret_cast<const uint32_t *>(array(header.numIndices,         sizeof(uint32_t)));
+	meshes     = reinterpret_cast<const SceneMesh *>(array(header.numMeshes,         sizeof(SceneMesh)));
+	materials  = reinterpret_cast<const SceneMaterial *>(array(header.numMaterials,   sizeof(SceneMaterial)));
+	instances  = reinterpret_cast<const SceneInstance *>(array(header.numInstances,   sizeof(SceneInstance)));
+	cameraKeys = reinterpret_cast<const SceneCameraKey *>(array(header.numCameraKeys, sizeof(SceneCameraKey)));
+
+	// mesh radius around its origin, instances rotate around it
+	std::vector<float> meshRadius(header.numMeshes, 0.0f);
+	for (unsigned int i = 0; i < header.numMeshes; i++) {
+		const auto &mesh = meshes[i];
+		if (mesh.indexCount == 0 || mesh.indexCount % 3 != 0 || mesh.vertexCount == 0
+		 || uint64_t(mesh.firstIndex)  + mesh.indexCount  > header.numIndices
+		 || uint64_t(mesh.firstVertex) + mesh.vertexCount > header.numVertices)
+		{
+			throw std::runtime_error("Scene file \"" + filename + "\" has bad mesh " + std::to_string(i));
+		}
+
+		for (unsigned int j = 0; j < mesh.indexCount; j++) {
+			if (indices[mesh.firstIndex + j] >= mesh.vertexCount) {
+				throw std::runtime_error("Scene file \"" + filename + "\" has bad index in mesh " + std::to_string(i));
+			}
+		}
+
+		float r2 = 0.0f;
+		for (unsigned int j = 0; j < mesh.vertexCount; j++) {
+			const auto &v = vertices[mesh.firstVertex + j];
+			r2 = std::max(r2, v.position[0] * v.position[0] + v.position[1] * v.position[1] + v.position[2] * v.position[2]);
+		}
+		meshRadius[i] = sqrtf(r2);
+	}
+
+	glm::vec3 minPos( FLT_MAX), maxPos(-FLT_MAX);
+	for (unsigned int i = 0; i < header.numInstances; i++) {
+		const auto &inst = instances[i];
+		if (inst.mesh >= header.numMeshes || inst.material >= header.numMaterials) {
+			throw std::runtime_error("Scene file \"" + filename + "\" has bad instance " + std::to_string(i));
+		}
+
+		glm::vec3 p(inst.position[0], inst.position[1], inst.position[2]);
+		minPos = glm::min(minPos, p);
+		maxPos = glm::max(maxPos, p);
+
+		if (inst.angularVelocity[0] != 0.0f || inst.angularVelocity[1] != 0.0f || inst.angularVelocity[2] != 0.0f) {
+			animated = true;
+		}
+	}
+
+	center = (minPos + maxPos) * 0.5f;
+	for (unsigned int i = 0; i < header.numInstances; i++) {
+		const auto &inst = instances[i];
+		glm::vec3 p(inst.position[0], inst.position[1], inst.position[2]);
+		radius = std::max(radius, glm::length(p - center) + meshRadius[inst.mesh]);
+	}
+
+	for (unsigned int i = 1; i < header.numCameraKeys; i++) {
+		if (cameraKeys[i].time < cameraKeys[i - 1].time) {
+			throw std::runtime_error("Scene file \"" + filename + "\" camera keys are not in order");
+		}
+	}
+}
+
+
+void SceneFile::cameraAt(float seconds, glm::vec3 &eye, glm::vec3 &target, float &fovY) const {
+	const SceneCameraKey *first = cameraKeys;
+	const SceneCameraKey *last  = cameraKeys + header.numCameraKeys - 1;
+
+	const SceneCameraKey *a = first, *b = first;
+	float f = 0.0f;
+	float duration = last->time - first->time;
+	if (duration > 0.0f) {
+		float t = first->time + fmodf(std::max(seconds, 0.0f), duration);
+		b = std::upper_bound(first, last, t, [] (float time, const SceneCameraKey &key) { return time < key.time; });
+		assert(b > first);
+		a = b - 1;
+		if (b->time > a->time) {
+			f = (t - a->time) / (b->time - a->time);
+		}
+	}
+
+	auto lerp = [f] (const float *x, const float *y) {
+		return glm::mix(glm::vec3(x[0], x[1], x[2]), glm::vec3(y[0], y[1], y[2]), f);
+	};
+	eye    = lerp(a->eye,    b->eye);
+	target = lerp(a->target, b->target);
+	fovY   = a->fovY + (b->fovY - a->fovY) * f;
+}
+
+
+glm::vec4 SceneFile::rotationAt(unsigned int instance, float seconds) const {
+	const auto &inst = getInstance(instance);
+	glm::quat q(inst.rotation[3], inst.rotation[0], inst.rotation[1], inst.rotation[2]);
+
+	glm::vec3 w(inst.angularVelocity[0], inst.angularVelocity[1], inst.angularVelocity[2]);
+	float speed = glm::length(w);
+	if (speed > 0.0f) {
+		q = glm::angleAxis(speed * seconds, w / speed) * q;
+	}
+
+	return glm::vec4(q.x, q.y, q.z, q.w);
+}
+
+
+void SceneFile::write(const std::string &filename, const std::vector<SceneVertex> &vertices_, const std::vector<uint32_t> &indices_, const std::vector<SceneMesh> &meshes_, const std::vector<SceneMaterial> &materials_, const std::vector<SceneInstance> &instances_, const std::vector<SceneCameraKey> &cameraKeys_) {
+	SceneFileHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, sceneFileMagic, sizeof(sceneFileMagic));
+	h.version       = sceneFileVersion;
+	h.numVertices   = static_cast<uint32_t>(vertices_.size());
+	h.numIndices    = static_cast<uint32_t>(indices_.size());
+	h.numMeshes     = static_cast<uint32_t>(meshes_.size());
+	h.numMaterials  = static_cast<uint32_t>(materials_.size());
+	h.numInstances  = static_cast<uint32_t>(instances_.size());
+	h.numCameraKeys = static_cast<uint32_t>(cameraKeys_.size());
+
+	std::vector<char> contents;
+	auto append = [&contents] (const void *data, size_t size) {
+		const char *ptr = static_cast<const char *>(data);
+		contents.insert(contents.end(), ptr, ptr + size);
+	};
+	append(&h,                 sizeof(h));
+	append(vertices_.data(),   vertices_.size()   * sizeof(SceneVertex));
+	append(indices_.data(),    indices_.size()    * sizeof(uint32_t));
+	append(meshes_.data(),     meshes_.size()     * sizeof(SceneMesh));
+	append(materials_.data(),  materials_.size()  * sizeof(SceneMaterial));
+	append(instances_.data(),  instances_.size()  * sizeof(SceneInstance));
+	append(cameraKeys_.data(), cameraKeys_.size() * sizeof(SceneCameraKey));
+
+	writeFile(filename, contents.data(), contents.size());
+}
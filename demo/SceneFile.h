@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+
+#include <cassert>
+
+#include <string>
+#include <vector>
+
+#include "renderer/Renderer.h"
+#include "utils/Utils.h"
+
+
+// binary scene for benchmarking, used in place from a memory mapped file
+// SceneFileHeader followed by the vertex, index, mesh, material, instance
+// and camera key arrays in that order, little endian with no padding
+static const char     sceneFileMagic[8] = { 'S', 'M', 'A', 'A', 'S', 'C', 'N', '\0' };
+static const uint32_t sceneFileVersion  = 1;
+
+
+struct SceneFileHeader {
+	char      magic[8];
+	uint32_t  version;
+	uint32_t  numVertices;
+	uint32_t  numIndices;
+	uint32_t  numMeshes;
+	uint32_t  numMaterials;
+	uint32_t  numInstances;
+	uint32_t  numCameraKeys;
+	uint32_t  pad;
+};
+
+
+struct SceneVertex {
+	float     position[3];
+};
+
+
+// indices are relative to firstVertex
+struct SceneMesh {
+	uint32_t  firstIndex;
+	uint32_t  indexCount;
+	uint32_t  firstVertex;
+	uint32_t  vertexCount;
+};
+
+
+struct SceneMaterial {
+	// linear RGB
+	float     color[3];
+	float     pad;
+};
+
+
+struct SceneInstance {
+	uint32_t  mesh;
+	uint32_t  material;
+	float     position[3];
+	// quaternion xyzw at time 0
+	float     rotation[4];
+	// axis times radians per second, 0 for static instances
+	float     angularVelocity[3];
+};
+
+
+// camera is linearly interpolated between keys and the path loops
+struct SceneCameraKey {
+	// seconds, not decreasing
+	float     time;
+	float     eye[3];
+	float     target[3];
+	// vertical field of view, radians
+	float     fovY;
+};
+
+
+class SceneFile {
+	MappedFile             file;
+	const SceneVertex     *vertices;
+	const uint32_t        *indices;
+	const SceneMesh       *meshes;
+	const SceneMaterial   *materials;
+	const SceneInstance   *instances;
+	const SceneCameraKey  *cameraKeys;
+	SceneFileHeader        header;
+	// bounding sphere of all instances at any rotation
+	glm::vec3              center;
+	float                  radius;
+	// some instance has angular velocity
+	bool                   animated;
+
+
+public:
+
+	// throws std::runtime_error on bad or truncated contents
+	explicit SceneFile(const std::string &filename);
+
+	SceneFile(const SceneFile &)                = delete;
+	SceneFile(SceneFile &&) noexcept            = default;
+
+	SceneFile &operator=(const SceneFile &)     = delete;
+	SceneFile &operator=(SceneFile &&) noexcept = default;
+
+	~SceneFile() {}
+
+	// arrays point into the mapped file
+	const SceneVertex *getVertices() const {
+		return vertices;
+	}
+
+	unsigned int getNumVertices() const {
+		return header.numVertices;
+	}
+
+	const uint32_t *getIndices() const {
+		return indices;
+	}
+
+	unsigned int getNumIndices() const {
+		return header.numIndices;
+	}
+
+	const SceneMesh &getMesh(unsigned int i) const {
+		assert(i < header.numMeshes);
+		return meshes[i];
+	}
+
+	unsigned int getNumMeshes() const {
+		return header.numMeshes;
+	}
+
+	const SceneMaterial &getMaterial(unsigned int i) const {
+		assert(i < header.numMaterials);
+		return materials[i];
+	}
+
+	const SceneInstance &getInstance(unsigned int i) const {
+		assert(i < header.numInstances);
+		return instances[i];
+	}
+
+	unsigned int getNumInstances() const {
+		return header.numInstances;
+	}
+
+	glm::vec3 getCenter() const {
+		return center;
+	}
+
+	float getRadius() const {
+		return radius;
+	}
+
+	bool isAnimated() const {
+		return animated;
+	}
+
+	// only depends on seconds so the same time always gives the same view
+	void cameraAt(float seconds, glm::vec3 &eye, glm::vec3 &target, float &fovY) const;
+
+	// instance rotation as xyzw
+	glm::vec4 rotationAt(unsigned int instance, float seconds) const;
+
+	// writes a scene in the format the constructor reads
+	static void write(const std::string &filename, const std::vector<SceneVertex> &vertices, const std::vector<uint32_t> &indices, const std::vector<SceneMesh> &meshes, const std::vector<SceneMaterial> &materials, const std::vector<SceneInstance> &instances, const std::vector<SceneCameraKey> &cameraKeys);
+};
+
+
+#endif  // SCENEFILE_H
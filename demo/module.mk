@@ -8,13 +8,20 @@ FILES:= \
 
 
 smaaDemo_MODULES:=imgui renderer utils
-smaaDemo_SRC:=$(foreach f, smaaDemo.cpp, $(dir)/$(f))
+smaaDemo_SRC:=$(foreach f, smaaDemo.cpp BenchmarkCompare.cpp SceneFile.cpp, $(dir)/$(f))
 
 
 PROGRAMS+= \
 	smaaDemo \
 	# empty line
 
+
+ifeq ($(ALLOCATION_TRACKING),y)
+
+CFLAGS+=-DALLOCATION_TRACKING
+
+endif  # ALLOCATION_TRACKING
+
 SRC_$(d):=$(addprefix $(d)/,$(FILES))
 
 
@@ -24,15 +24,25 @@ THE SOFTWARE.
 #include <cassert>
 #include <cfloat>
 #include <cinttypes>
+#include <climits>
+#include <cstdarg>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #include <thread>
 #include <chrono>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <stdexcept>
 #include <vector>
 
@@ -44,6 +54,58 @@ THE SOFTWARE.
 #include <imgui.h>
 #include <imgui_internal.h>
 
+// stb_image allocates its own output, these let stbiDecodeInto give it upload memory instead
+// everything else goes to malloc as usual
+struct StbiTarget {
+	void    *ptr;
+	size_t  size;
+	// handed out and not freed yet
+	bool    taken;
+};
+
+
+static thread_local StbiTarget stbiTarget = { nullptr, 0, false };
+
+
+static void *stbiMalloc(size_t size) {
+	if (stbiTarget.ptr && !stbiTarget.taken && size == stbiTarget.size) {
+		stbiTarget.taken = true;
+		return stbiTarget.ptr;
+	}
+
+	return malloc(size);
+}
+
+
+static void stbiFree(void *p) {
+	if (p && p == stbiTarget.ptr) {
+		stbiTarget.taken = false;
+		return;
+	}
+
+	free(p);
+}
+
+
+static void *stbiRealloc(void *p, size_t size) {
+	if (!p || p != stbiTarget.ptr) {
+		return realloc(p, size);
+	}
+
+	// the target can't grow, move out of it
+	void *moved = malloc(size);
+	if (moved) {
+		memcpy(moved, p, std::min(size, stbiTarget.size));
+		stbiTarget.taken = false;
+	}
+	return moved;
+}
+
+
+#define STBI_MALLOC(size)        stbiMalloc(size)
+#define STBI_REALLOC(p, size)    stbiRealloc(p, size)
+#define STBI_FREE(p)             stbiFree(p)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -51,12 +113,23 @@ THE SOFTWARE.
 
 #include <pcg_random.hpp>
 
+#include <xxhash.h>
+
 #include "renderer/Renderer.h"
+#include "renderer/DrawList.h"
 #include "renderer/RenderGraph.h"
+#include "renderer/TextureFile.h"
+#include "utils/FramePacer.h"
 #include "utils/Hash.h"
+#include "utils/JobSystem.h"
+#include "utils/PowerMonitor.h"
+#include "utils/Profiler.h"
+#include "utils/ThreadPlacement.h"
 #include "utils/Utils.h"
 
 #include "AreaTex.h"
+#include "BenchmarkCompare.h"
+#include "SceneFile.h"
 #include "SearchTex.h"
 
 // AFTER Renderer.h because it sets GLM_FORCE_* macros which affect these
@@ -67,6 +140,8 @@ THE SOFTWARE.
 // mingw fuckery...
 #if defined(__GNUC__) && defined(_WIN32)
 
+#include <mingw.condition_variable.h>
+#include <mingw.mutex.h>
 #include <mingw.thread.h>
 
 #endif  // defined(__GNUC__) && defined(_WIN32)
@@ -100,6 +175,178 @@ const char *smaaDebugModes[3] = { "None", "Edges", "Weights" };
 static const unsigned int inputTextBufferSize = 1024;
 
 
+static const unsigned int defaultBenchmarkWarmupFrames   = 100;
+static const unsigned int defaultBenchmarkMeasuredFrames = 500;
+
+// extra slack for just-in-time pacing, nanoseconds
+static const uint64_t     pacingMargin                   = 1000ULL * 1000ULL;
+
+// frames after a render graph rebuild before a frame should no longer allocate
+static const unsigned int steadyStateFrames              = 8;
+
+// side by side comparison, no AA, FXAA and SMAA left to right
+static const unsigned int numComparisonTiles             = 3;
+
+// smallest SMAA edges and weights resolution relative to render size
+static const float        minSMAAScale                   = 0.25f;
+
+// dynamic resolution limits and how fast it follows GPU time
+static const float        minRenderScale                 = 0.5f;
+static const float        renderScaleSpeed               = 0.1f;
+
+// megabytes of image textures kept resident, --image-memory overrides
+static const unsigned int defaultImageMemoryMB           = 512;
+// shared by all tiled images, storage buffers are only guaranteed to be 128 MB
+static const unsigned int defaultImagePageCacheMB        = 64;
+static const unsigned int maxImagePageCacheMB            = 128;
+// pages copied to the cache per frame, the rest wait for later frames
+static const unsigned int maxImagePageUploads            = 64;
+static const float        minImageZoom                   = 0.25f;
+static const float        maxImageZoom                   = 256.0f;
+// quality sweep reference, minimum samples per pixel in each direction
+static const unsigned int sweepReferenceSamples          = 4;
+// SSIM window size and the step between windows
+static const unsigned int ssimWindow                     = 8;
+static const unsigned int ssimStep                       = 4;
+// leave this much of the renderer's memory budget unused, megabytes
+static const unsigned int memoryBudgetMarginMB           = 64;
+// cube LOD impostor size in pixels when --cube-lod doesn't give one
+static const float        defaultCubeLODPixels           = 4.0f;
+// cube grid size limits, impostors make bigger grids drawable
+static const int          maxCubesPerSide                = 54;
+// also keeps compact cube positions and order within their bits
+static const int          maxLODCubesPerSide             = 160;
+// scene file time per frame while benchmarking without --fixed-timestep, nanoseconds
+static const uint64_t     sceneBenchmarkStep             = 1000000000ULL / 60;
+// on-demand redraw keeps drawing this many frames after input so the GUI settles
+static const unsigned int redrawSettleFrames             = 3;
+// longest wait for events while idle, shader hot reload is checked this often
+static const uint32_t     idleWaitMs                     = 100;
+// frames of SMAA GPU time averaged between --smaa-budget adjustments
+static const unsigned int smaaBudgetFrames               = 16;
+// SMAA quality only goes up if it took less than this fraction of the budget
+static const float        smaaBudgetHeadroom             = 0.7f;
+
+
+struct BenchmarkConfig {
+	bool          antialiasing;
+	AAMethod      method;
+	unsigned int  quality;
+
+
+	BenchmarkConfig()
+	: antialiasing(false)
+	, method(AAMethod::SMAA)
+	, quality(0)
+	{
+	}
+};
+
+
+// measurement name and how it changed
+typedef std::vector<std::pair<std::string, SampleComparison> > BaselineComparisons;
+
+
+struct BenchmarkResult {
+	std::string                                 name;
+	// empty unless benchmarking every device
+	std::string                                 device;
+	unsigned int                                frames;
+
+	// CPU frame time in milliseconds
+	float                                       cpuAverage;
+	float                                       cpuMin;
+	float                                       cpuMedian;
+	float                                       cpu95th;
+	float                                       cpu99th;
+	float                                       cpuMax;
+	float                                       cpuStdDev;
+
+	// average GPU time in milliseconds per render pass
+	std::vector<std::pair<std::string, float> > gpuPassTimes;
+	float                                       gpuTotal;
+
+	// per frame milliseconds in measurement order for comparing against a baseline
+	std::vector<float>                          cpuFrameTimes;
+	std::vector<float>                          gpuFrameTimes;
+	// in gpuPassTimes order
+	std::vector<std::vector<float> >            gpuPassSamples;
+
+	// Renderer::getPerformanceCounters()
+	std::vector<std::string>                    counterNames;
+	// average counter values per render pass in gpuPassTimes order, empty for passes without them
+	std::vector<std::vector<double> >           gpuPassCounters;
+
+	// average from beginFrame to present in milliseconds, 0 if unknown
+	// measured to GPU completion unless latencyDisplayed
+	float                                       latencyAverage;
+	bool                                        latencyDisplayed;
+
+	MemoryStats                                 memory;
+
+	// only with ALLOCATION_TRACKING
+	float                                       allocationsPerFrame;
+	// calls made during the measured frames, unused ones left out
+	std::vector<CallStats>                      calls;
+
+	// sensors sampled during the measured frames
+	PowerReport                                 power;
+
+	// only in a quality sweep, final image against the supersampled reference
+	// 0 if there was no reference
+	std::string                                 image;
+	float                                       psnr;
+	float                                       ssim;
+
+
+	BenchmarkResult()
+	: frames(0)
+	, cpuAverage(0.0f)
+	, cpuMin(0.0f)
+	, cpuMedian(0.0f)
+	, cpu95th(0.0f)
+	, cpu99th(0.0f)
+	, cpuMax(0.0f)
+	, cpuStdDev(0.0f)
+	, gpuTotal(0.0f)
+	, latencyAverage(0.0f)
+	, latencyDisplayed(false)
+	, allocationsPerFrame(0.0f)
+	, psnr(0.0f)
+	, ssim(0.0f)
+	{
+	}
+};
+
+
+#ifdef ALLOCATION_TRACKING
+
+// every operator new in the process, sampled around each frame
+static std::atomic<uint64_t> allocationCount(0);
+
+
+void *operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void *ptr = malloc((size != 0) ? size : 1);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+
+void operator delete(void *ptr, size_t /* size */) noexcept {
+	free(ptr);
+}
+
+#endif  // ALLOCATION_TRACKING
+
+
 const char* GetClipboardText(void* user_data) {
 	char *clipboard = SDL_GetClipboardText();
 	if (clipboard) {
@@ -149,6 +396,18 @@ public:
 	}
 
 
+	// restart the sequence as if newly constructed
+	void seed(uint64_t s) {
+		rng.seed(s);
+	}
+
+
+	// skip ahead as if n numbers had been drawn, in O(log n)
+	void discard(uint64_t n) {
+		rng.discard(n);
+	}
+
+
 	// min inclusive
 	// max exclusive
 	uint32_t range(uint32_t min, uint32_t max) {
@@ -166,6 +425,75 @@ public:
 };
 
 
+// frames of history in the performance overlay graphs
+static const unsigned int perfHistoryLength = 240;
+
+
+// ring buffer of the last perfHistoryLength values of one statistic
+class PerfHistory {
+	std::array<float, perfHistoryLength>  values;
+	// where the next value goes, also the oldest one once full
+	unsigned int                          next;
+	unsigned int                          count;
+
+
+public:
+
+	PerfHistory()
+	: next(0)
+	, count(0)
+	{
+		values.fill(0.0f);
+	}
+
+
+	void push(float v) {
+		values[next] = v;
+		next         = (next + 1) % perfHistoryLength;
+		count        = std::min(count + 1, perfHistoryLength);
+	}
+
+
+	const float *data() const {
+		return values.data();
+	}
+
+
+	unsigned int size() const {
+		return count;
+	}
+
+
+	// index of the oldest value, for ImGui::PlotLines values_offset
+	unsigned int offset() const {
+		return (count == perfHistoryLength) ? next : 0;
+	}
+
+
+	float latest() const {
+		return values[(next + perfHistoryLength - 1) % perfHistoryLength];
+	}
+
+
+	float max() const {
+		return (count == 0) ? 0.0f : *std::max_element(values.begin(), values.begin() + count);
+	}
+
+
+	// p in [0, 1], nearest rank
+	float percentile(float p) const {
+		if (count == 0) {
+			return 0.0f;
+		}
+
+		std::array<float, perfHistoryLength> sorted = values;
+		unsigned int rank = std::min(static_cast<unsigned int>(p * count), count - 1);
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.begin() + count);
+		return sorted[rank];
+	}
+};
+
+
 static const char *const msaaQualityLevels[] =
 { "2x", "4x", "8x", "16x", "32x", "64x" };
 
@@ -204,6 +532,19 @@ static const char *fxaaQualityLevels[] =
 static const unsigned int maxFXAAQuality = sizeof(fxaaQualityLevels) / sizeof(fxaaQualityLevels[0]);
 
 
+// temporal AA history, trades bandwidth for precision
+// R11G11B10F has no alpha so the SMAA reprojection weight can't see velocity differences
+static const char *temporalFormatNames[] =
+{ "RGBA8", "RGBA16F", "R11G11B10F" };
+
+
+static const Format temporalFormats[] =
+{ Format::sRGBA8, Format::RGBA16Float, Format::RG11B10Float };
+
+
+static const unsigned int numTemporalFormats = sizeof(temporalFormatNames) / sizeof(temporalFormatNames[0]);
+
+
 static const char *smaaQualityLevels[] =
 { "CUSTOM", "LOW", "MEDIUM", "HIGH", "ULTRA" };
 
@@ -221,6 +562,18 @@ static const std::array<ShaderDefines::SMAAParameters, maxSMAAQuality> defaultSM
 } };
 
 
+// custom parameters the --smaa-budget controller steps between, cheapest first
+// diagonal steps stay above 1 since the shader loops up to steps - 1
+static const std::array<ShaderDefines::SMAAParameters, 5> budgetSMAAParameters =
+{ {
+	  { 0.15f, 0.1f * 0.15f,  4u,  2u, 25u, 0u, 0u, 0u }
+	, { 0.12f, 0.1f * 0.12f,  8u,  4u, 25u, 0u, 0u, 0u }
+	, { 0.10f, 0.1f * 0.10f, 16u,  8u, 25u, 0u, 0u, 0u }
+	, { 0.08f, 0.1f * 0.08f, 24u, 12u, 25u, 0u, 0u, 0u }
+	, { 0.05f, 0.1f * 0.05f, 32u, 16u, 25u, 0u, 0u, 0u }
+} };
+
+
 enum class SMAAEdgeMethod : uint8_t {
 	  Color
 	, Luma
@@ -228,30 +581,526 @@ enum class SMAAEdgeMethod : uint8_t {
 };
 
 
+// 2x2 box filter in sRGB space, odd sizes repeat the last row and column
+static void downsampleRGBA8(const uint32_t *src, unsigned int width, unsigned int height, uint32_t *dst, unsigned int dstWidth, unsigned int dstHeight) {
+	for (unsigned int y = 0; y < dstHeight; y++) {
+		const uint32_t *row0 = src + size_t(std::min(2 * y,     height - 1)) * width;
+		const uint32_t *row1 = src + size_t(std::min(2 * y + 1, height - 1)) * width;
+		for (unsigned int x = 0; x < dstWidth; x++) {
+			unsigned int x0 = std::min(2 * x,     width - 1);
+			unsigned int x1 = std::min(2 * x + 1, width - 1);
+
+			uint32_t result = 0;
+			for (unsigned int shift = 0; shift < 32; shift += 8) {
+				uint32_t sum = ((row0[x0] >> shift) & 0xFF) + ((row0[x1] >> shift) & 0xFF)
+				             + ((row1[x0] >> shift) & 0xFF) + ((row1[x1] >> shift) & 0xFF);
+				result |= ((sum + 2) / 4) << shift;
+			}
+			dst[size_t(y) * dstWidth + x] = result;
+		}
+	}
+}
+
+
+// an image too big for one texture, split into IMAGE_PAGE_SIZE pages
+// the whole mip chain stays in CPU memory and ImagePageCache copies
+// the pages the view needs to the GPU
+class TiledImage {
+	friend class ImagePageCache;
+
+	struct Level {
+		unsigned int     width, height;
+		unsigned int     pagesX, pagesY;
+		// index of the level's first page in pageTable
+		unsigned int     firstPage;
+		// RGBA8, level 0 is the decoded image
+		const uint32_t   *pixels;
+	};
+
+	// from stbi_load
+	unsigned char                        *decoded;
+	std::vector<std::vector<uint32_t> >  mips;
+	std::vector<Level>                   levels;
+	// cache slot of every page of every level or IMAGE_PAGE_MISSING
+	std::vector<uint32_t>                pageTable;
+	BufferHandle                         pageTableBuffer;
+	// pageTable entries changed since the last upload
+	unsigned int                         dirtyBegin, dirtyEnd;
+
+
+	void setPage(unsigned int page, uint32_t slot) {
+		pageTable[page] = slot;
+		dirtyBegin      = std::min(dirtyBegin, page);
+		dirtyEnd        = std::max(dirtyEnd,   page + 1);
+	}
+
+
+	// edges past the image repeat the last texel
+	void copyPage(unsigned int level, unsigned int pageX, unsigned int pageY, uint32_t *dst) const {
+		const Level &l = levels[level];
+		for (unsigned int y = 0; y < IMAGE_PAGE_SIZE; y++) {
+			unsigned int srcY = std::min(pageY * IMAGE_PAGE_SIZE + y, l.height - 1);
+			const uint32_t *row = l.pixels + size_t(srcY) * l.width;
+			for (unsigned int x = 0; x < IMAGE_PAGE_SIZE; x++) {
+				dst[y * IMAGE_PAGE_SIZE + x] = row[std::min(pageX * IMAGE_PAGE_SIZE + x, l.width - 1)];
+			}
+		}
+	}
+
+
+public:
+
+	// takes ownership of RGBA8 pixels from stbi_load and builds the mip chain
+	// slow for big images so it belongs on the image loading threads
+	TiledImage(unsigned char *pixels, unsigned int width, unsigned int height)
+	: decoded(pixels)
+	, dirtyBegin(0)
+	, dirtyEnd(0)
+	{
+		assert(pixels);
+		assert(width > 0 && height > 0);
+
+		const uint32_t *src = reinterpret_cast<const uint32_t *>(pixels);
+		unsigned int numPages = 0;
+		for (;;) {
+			Level l;
+			l.width     = width;
+			l.height    = height;
+			l.pagesX    = (width  + IMAGE_PAGE_SIZE - 1) / IMAGE_PAGE_SIZE;
+			l.pagesY    = (height + IMAGE_PAGE_SIZE - 1) / IMAGE_PAGE_SIZE;
+			l.firstPage = numPages;
+			l.pixels    = src;
+			levels.push_back(l);
+			numPages   += l.pagesX * l.pagesY;
+
+			if (l.pagesX == 1 && l.pagesY == 1) {
+				break;
+			}
+
+			if (levels.size() == TILED_IMAGE_MAX_LEVELS) {
+				throw std::runtime_error("Image too big for " + std::to_string(TILED_IMAGE_MAX_LEVELS) + " levels of pages");
+			}
+
+			unsigned int mipWidth  = std::max(width  / 2, 1u);
+			unsigned int mipHeight = std::max(height / 2, 1u);
+			std::vector<uint32_t> mip(size_t(mipWidth) * mipHeight);
+			downsampleRGBA8(src, width, height, mip.data(), mipWidth, mipHeight);
+			// moving the vector keeps its storage so src stays valid
+			mips.push_back(std::move(mip));
+			src    = mips.back().data();
+			width  = mipWidth;
+			height = mipHeight;
+		}
+
+		pageTable.resize(numPages, IMAGE_PAGE_MISSING);
+		dirtyBegin = numPages;
+	}
+
+	TiledImage(const TiledImage &)             = delete;
+	TiledImage(TiledImage &&)                  = delete;
+
+	TiledImage &operator=(const TiledImage &)  = delete;
+	TiledImage &operator=(TiledImage &&)       = delete;
+
+	~TiledImage() {
+		assert(!pageTableBuffer);
+		stbi_image_free(decoded);
+	}
+
+	unsigned int getWidth() const {
+		return levels[0].width;
+	}
+
+	unsigned int getHeight() const {
+		return levels[0].height;
+	}
+
+	unsigned int getNumLevels() const {
+		return static_cast<unsigned int>(levels.size());
+	}
+
+	BufferHandle getPageTable() const {
+		return pageTableBuffer;
+	}
+
+	uint64_t getPageTableSize() const {
+		return pageTable.size() * sizeof(uint32_t);
+	}
+
+	void describe(ShaderDefines::TiledImageUBO &ubo) const {
+		for (unsigned int i = 0; i < TILED_IMAGE_MAX_LEVELS; i++) {
+			if (i < levels.size()) {
+				const Level &l = levels[i];
+				ubo.imageLevels[i] = glm::uvec4(l.firstPage, l.pagesX, l.width, l.height);
+			} else {
+				ubo.imageLevels[i] = glm::uvec4(0);
+			}
+		}
+		ubo.numImageLevels = getNumLevels();
+		ubo.pad6           = 0;
+		ubo.pad7           = 0;
+		ubo.pad8           = 0;
+	}
+};
+
+
+// GPU copies of tiled image pages, shared by all tiled images
+// pages the current view doesn't need are replaced least recently used first
+class ImagePageCache {
+	struct Slot {
+		// null when free
+		TiledImage    *image;
+		unsigned int  page;
+		uint64_t      lastUsed;
+	};
+
+	std::vector<Slot>      slots;
+	BufferHandle           buffer;
+	// one page on its way to updateBuffer
+	std::vector<uint32_t>  pageData;
+	uint64_t               frame;
+	unsigned int           uploadsLeft;
+
+
+	// free or least recently used slot not needed this frame, UINT_MAX if none
+	unsigned int findSlot() const {
+		unsigned int best = UINT_MAX;
+		for (unsigned int i = 0; i < slots.size(); i++) {
+			const Slot &s = slots[i];
+			if (!s.image) {
+				return i;
+			}
+			if (s.lastUsed != frame && (best == UINT_MAX || s.lastUsed < slots[best].lastUsed)) {
+				best = i;
+			}
+		}
+		return best;
+	}
+
+
+public:
+
+	ImagePageCache()
+	: frame(0)
+	, uploadsLeft(0)
+	{
+	}
+
+	ImagePageCache(const ImagePageCache &)            = delete;
+	ImagePageCache(ImagePageCache &&)                 = delete;
+
+	ImagePageCache &operator=(const ImagePageCache &) = delete;
+	ImagePageCache &operator=(ImagePageCache &&)      = delete;
+
+	~ImagePageCache() {
+		assert(!buffer);
+	}
+
+	BufferHandle getBuffer() const {
+		return buffer;
+	}
+
+	void create(Renderer &renderer, unsigned int numSlots) {
+		assert(!buffer);
+		assert(numSlots > 0);
+
+		const unsigned int pageBytes = IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE * sizeof(uint32_t);
+		BufferDesc desc;
+		desc.type(BufferType::Storage)
+		    .size(numSlots * pageBytes)
+		    .usage(BufferUsage::Dynamic)
+		    .name("image page cache");
+		buffer = renderer.createBuffer(desc);
+
+		Slot empty;
+		empty.image    = nullptr;
+		empty.page     = 0;
+		empty.lastUsed = 0;
+		slots.resize(numSlots, empty);
+		pageData.resize(IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE);
+	}
+
+	void destroy(Renderer &renderer) {
+		if (buffer) {
+			renderer.deleteBuffer(buffer);
+			buffer = BufferHandle();
+		}
+		slots.clear();
+	}
+
+	// starts using an image, its pages are all missing
+	void add(Renderer &renderer, TiledImage &image) {
+		assert(!image.pageTableBuffer);
+
+		BufferDesc desc;
+		desc.type(BufferType::Storage)
+		    .size(static_cast<uint32_t>(image.getPageTableSize()))
+		    .usage(BufferUsage::Dynamic)
+		    .contents(image.pageTable.data())
+		    .name("image page table");
+		image.pageTableBuffer = renderer.createBuffer(desc);
+		image.dirtyBegin      = static_cast<unsigned int>(image.pageTable.size());
+		image.dirtyEnd        = 0;
+	}
+
+	// frees the image's slots and page table
+	void remove(Renderer &renderer, TiledImage &image) {
+		for (auto &s : slots) {
+			if (s.image == &image) {
+				image.setPage(s.page, IMAGE_PAGE_MISSING);
+				s.image    = nullptr;
+				s.lastUsed = 0;
+			}
+		}
+
+		if (image.pageTableBuffer) {
+			renderer.deleteBuffer(image.pageTableBuffer);
+			image.pageTableBuffer = BufferHandle();
+		}
+	}
+
+	// pages requested until the next call are kept, at most maxUploads are copied
+	void beginFrame(unsigned int maxUploads) {
+		frame++;
+		uploadsLeft = maxUploads;
+	}
+
+	// pages of level covering texcoords from lo to hi plus a texel for filtering
+	void request(Renderer &renderer, TiledImage &image, unsigned int level, glm::vec2 lo, glm::vec2 hi) {
+		assert(buffer);
+		assert(level < image.levels.size());
+
+		const auto &l = image.levels[level];
+		auto firstPage = [] (float t, unsigned int size) {
+			float texel = std::max(floorf(t * size) - 1.0f, 0.0f);
+			return static_cast<unsigned int>(texel) / IMAGE_PAGE_SIZE;
+		};
+		auto endPage = [] (float t, unsigned int size, unsigned int pages) {
+			float texel = std::min(ceilf(t * size) + 1.0f, float(size));
+			return std::min((static_cast<unsigned int>(texel) + IMAGE_PAGE_SIZE - 1) / IMAGE_PAGE_SIZE, pages);
+		};
+		const unsigned int x0 = firstPage(lo.x, l.width);
+		const unsigned int y0 = firstPage(lo.y, l.height);
+		const unsigned int x1 = std::max(endPage(hi.x, l.width,  l.pagesX), x0 + 1);
+		const unsigned int y1 = std::max(endPage(hi.y, l.height, l.pagesY), y0 + 1);
+
+		const unsigned int pageBytes = IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE * sizeof(uint32_t);
+		for (unsigned int y = y0; y < y1; y++) {
+			for (unsigned int x = x0; x < x1; x++) {
+				unsigned int page = l.firstPage + y * l.pagesX + x;
+				uint32_t slot     = image.pageTable[page];
+				if (slot != IMAGE_PAGE_MISSING) {
+					slots[slot].lastUsed = frame;
+					continue;
+				}
+
+				if (uploadsLeft == 0) {
+					continue;
+				}
+
+				slot = findSlot();
+				if (slot == UINT_MAX) {
+					// everything is on screen, coarser levels have to do
+					uploadsLeft = 0;
+					continue;
+				}
+				uploadsLeft--;
+
+				Slot &s = slots[slot];
+				if (s.image) {
+					s.image->setPage(s.page, IMAGE_PAGE_MISSING);
+				}
+				s.image    = &image;
+				s.page     = page;
+				s.lastUsed = frame;
+
+				image.copyPage(level, x, y, pageData.data());
+				renderer.updateBuffer(buffer, slot * pageBytes, pageBytes, pageData.data());
+				image.setPage(page, slot);
+			}
+		}
+	}
+
+	// uploads the page table entries changed since the last call
+	// evicting pages of other images only matters once they're shown again
+	// since their tables are uploaded then
+	// returns false if nothing changed
+	bool updatePageTable(Renderer &renderer, TiledImage &image) {
+		if (image.dirtyBegin >= image.dirtyEnd) {
+			return false;
+		}
+
+		renderer.updateBuffer(image.pageTableBuffer, image.dirtyBegin * sizeof(uint32_t), (image.dirtyEnd - image.dirtyBegin) * sizeof(uint32_t), &image.pageTable[image.dirtyBegin]);
+		image.dirtyBegin = static_cast<unsigned int>(image.pageTable.size());
+		image.dirtyEnd   = 0;
+
+		return true;
+	}
+};
+
+
 struct Image {
 	std::string    filename;
 	std::string    shortName;
+	// only valid while resident
 	TextureHandle  tex;
+	// instead of tex for images too big for one texture
+	std::unique_ptr<TiledImage>  tiled;
 	unsigned int   width, height;
+	// estimated size of tex in bytes
+	uint64_t       memorySize;
+	// imageUseCounter when this was last the active image or its neighbor
+	uint64_t       lastUsed;
+	// queued for decoding or waiting for upload
+	bool           loading;
+	// don't try to load again
+	bool           failed;
 
 
 	Image()
 	: width(0)
 	, height(0)
+	, memorySize(0)
+	, lastUsed(0)
+	, loading(false)
+	, failed(false)
 	{
 	}
 
 
-	Image(const Image &)             = default;
+	Image(const Image &)             = delete;
 	Image(Image &&) noexcept            = default;
 
-	Image &operator=(const Image &)  = default;
+	Image &operator=(const Image &)  = delete;
 	Image &operator=(Image &&) noexcept = default;
 
 	~Image() {}
 };
 
 
+// pixels decoded by an image loading thread, waiting for upload
+// KTX2 and DDS files are not decoded, their mip chain is uploaded as is
+struct DecodedImage {
+	unsigned int                  index;
+	int                           width, height;
+	unsigned char                 *data;
+	std::unique_ptr<TextureFile>  file;
+	// data split into pages instead
+	std::unique_ptr<TiledImage>   tiled;
+	// decoded straight into it by the loading thread instead
+	// the main thread must delete it on failure
+	TextureHandle                 tex;
+	std::string                   error;
+
+
+	DecodedImage()
+	: index(0)
+	, width(0)
+	, height(0)
+	, data(nullptr)
+	{
+	}
+
+
+	DecodedImage(const DecodedImage &)            = delete;
+	DecodedImage &operator=(const DecodedImage &) = delete;
+
+
+	DecodedImage(DecodedImage &&other) noexcept
+	: index(other.index)
+	, width(other.width)
+	, height(other.height)
+	, data(other.data)
+	, file(std::move(other.file))
+	, tiled(std::move(other.tiled))
+	, tex(other.tex)
+	, error(std::move(other.error))
+	{
+		other.tex    = TextureHandle();
+		other.index  = 0;
+		other.width  = 0;
+		other.height = 0;
+		other.data   = nullptr;
+	}
+
+
+	DecodedImage &operator=(DecodedImage &&other) noexcept {
+		if (this == &other) {
+			return *this;
+		}
+
+		if (data) {
+			stbi_image_free(data);
+		}
+
+		index        = other.index;
+		other.index  = 0;
+
+		width        = other.width;
+		other.width  = 0;
+
+		height       = other.height;
+		other.height = 0;
+
+		data         = other.data;
+		other.data   = nullptr;
+
+		file         = std::move(other.file);
+
+		tiled        = std::move(other.tiled);
+
+		assert(!tex);
+		tex          = other.tex;
+		other.tex    = TextureHandle();
+
+		error        = std::move(other.error);
+
+		return *this;
+	}
+
+
+	~DecodedImage() {
+		assert(!tex);
+		if (data) {
+			stbi_image_free(data);
+			data = nullptr;
+		}
+	}
+};
+
+
+// final image of one sweep configuration, compared to the reference on the sweep thread
+struct SweepJob {
+	// index of its BenchmarkResult
+	unsigned int   result;
+	unsigned int   image;
+	std::string    filename;
+	FrameReadback  readback;
+
+
+	SweepJob()
+	: result(0)
+	, image(0)
+	{
+	}
+};
+
+
+struct SweepQuality {
+	unsigned int  result;
+	float         psnr;
+	float         ssim;
+
+
+	SweepQuality()
+	: result(0)
+	, psnr(0.0f)
+	, ssim(0.0f)
+	{
+	}
+};
+
+
 enum class Rendertargets : uint32_t {
 	  Invalid
 	, MainColor
@@ -260,11 +1109,15 @@ enum class Rendertargets : uint32_t {
 	, VelocityMS
 	, Edges
 	, BlendWeights
+	// second subsample of SMAA S2X
+	, Edges2
+	, BlendWeights2
+	, SMAAStencil
 	, TemporalPrevious
 	, TemporalCurrent
-	, Subsample1
-	, Subsample2
+	, ScaledFinal
 	, FinalRender
+	, GUIOverlay
 };
 
 
@@ -289,21 +1142,30 @@ static const char *to_string(Rendertargets r) {
 	case Rendertargets::BlendWeights:
 		return "BlendWeights";
 
+	case Rendertargets::Edges2:
+		return "Edges2";
+
+	case Rendertargets::BlendWeights2:
+		return "BlendWeights2";
+
+	case Rendertargets::SMAAStencil:
+		return "SMAAStencil";
+
 	case Rendertargets::TemporalPrevious:
 		return "TemporalPrevious";
 
 	case Rendertargets::TemporalCurrent:
 		return "TemporalCurrent";
 
-	case Rendertargets::Subsample1:
-		return "Subsample1";
-
-	case Rendertargets::Subsample2:
-		return "Subsample2";
+	case Rendertargets::ScaledFinal:
+		return "ScaledFinal";
 
 	case Rendertargets::FinalRender:
 		return "FinalRender";
 
+	case Rendertargets::GUIOverlay:
+		return "GUIOverlay";
+
 	case Rendertargets::Invalid:
 		return "Invalid";
 
@@ -316,26 +1178,36 @@ static const char *to_string(Rendertargets r) {
 
 enum class RenderPasses : uint32_t {
 	  Invalid
+	, DepthPrepass
 	, Scene
+	, DepthVelocity
 	, Final
 	, GUI
 	, FXAA
-	, Separate
 	, SMAAEdges
 	, SMAAWeights
 	, SMAABlend
-	, SMAAEdges2
-	, SMAAWeights2
-	, SMAA2XBlend1
-	, SMAA2XBlend2
+	, SMAA2XBlend
+	, SMAAEdgesCompute
+	, SMAAWeightsCompute
+	, SMAABlendCompute
+	, CubeAnimate
+	, CubeCull
+	, Upscale
 };
 
 
 static const char *to_string(RenderPasses r) {
 	switch (r) {
+	case RenderPasses::DepthPrepass:
+		return "DepthPrepass";
+
 	case RenderPasses::Scene:
 		return "Scene";
 
+	case RenderPasses::DepthVelocity:
+		return "DepthVelocity";
+
 	case RenderPasses::Final:
 		return "Final";
 
@@ -345,9 +1217,6 @@ static const char *to_string(RenderPasses r) {
 	case RenderPasses::FXAA:
 		return "FXAA";
 
-	case RenderPasses::Separate:
-		return "Separate";
-
 	case RenderPasses::SMAAEdges:
 		return "SMAAEdges";
 
@@ -357,19 +1226,28 @@ static const char *to_string(RenderPasses r) {
 	case RenderPasses::SMAABlend:
 		return "SMAABlend";
 
-	case RenderPasses::SMAAEdges2:
-		return "SMAAEdges2";
+	case RenderPasses::SMAA2XBlend:
+		return "SMAA2XBlend";
 
-	case RenderPasses::SMAAWeights2:
-		return "SMAAWeights2";
+	case RenderPasses::SMAAEdgesCompute:
+		return "SMAAEdgesCompute";
 
-	case RenderPasses::SMAA2XBlend1:
-		return "SMAA2XBlend1";
+	case RenderPasses::SMAAWeightsCompute:
+		return "SMAAWeightsCompute";
 
-	case RenderPasses::SMAA2XBlend2:
-		return "SMAA2XBlend2";
+	case RenderPasses::SMAABlendCompute:
+		return "SMAABlendCompute";
 
-	case RenderPasses::Invalid:
+	case RenderPasses::CubeAnimate:
+		return "CubeAnimate";
+
+	case RenderPasses::CubeCull:
+		return "CubeCull";
+
+	case RenderPasses::Upscale:
+		return "Upscale";
+
+	case RenderPasses::Invalid:
 		return "Invalid";
 	}
 
@@ -420,10 +1298,72 @@ template <> struct hash<std::pair<Rendertargets, Format> > {
 } // namespace std
 
 
+// the S2X variants when aaMethod is SMAA2X
 struct SMAAPipelines {
 	PipelineHandle                 edgePipeline;
 	PipelineHandle                 blendWeightPipeline;
-	std::array<PipelineHandle, 2>  neighborPipelines;
+	PipelineHandle                 neighborPipeline;
+
+	// compute path
+	PipelineHandle                 tileResetPipeline;
+	PipelineHandle                 edgeComputePipeline;
+	PipelineHandle                 blendWeightComputePipeline;
+	PipelineHandle                 neighborComputePipeline;
+};
+
+
+// inputs of the static post-processing passes which change without a render graph rebuild
+struct StaticPassState {
+	ShaderDefines::SMAAUBO         smaaParams;
+	glm::uvec2                     windowSize;
+	glm::uvec2                     smaaSize;
+	float                          renderScale;
+	// edges, weights, blend and FXAA, created lazily while recording
+	std::array<PipelineHandle, 4>  pipelines;
+
+
+	StaticPassState()
+	: renderScale(0.0f)
+	{
+		memset(&smaaParams, 0, sizeof(smaaParams));
+	}
+
+	bool operator==(const StaticPassState &other) const {
+		return memcmp(&smaaParams, &other.smaaParams, sizeof(smaaParams)) == 0
+		    && windowSize  == other.windowSize
+		    && smaaSize    == other.smaaSize
+		    && renderScale == other.renderScale
+		    && pipelines   == other.pipelines;
+	}
+};
+
+
+// what the image scene pass draws, it's skipped while this stays the same
+struct ImagePassState {
+	unsigned int                   scene;
+	TextureHandle                  tex;
+	glm::vec4                      imageTransform;
+	glm::uvec2                     windowSize;
+	float                          renderScale;
+	// image and tiled image
+	std::array<PipelineHandle, 2>  pipelines;
+
+
+	ImagePassState()
+	: scene(0)
+	, imageTransform(0.0f)
+	, renderScale(0.0f)
+	{
+	}
+
+	bool operator==(const ImagePassState &other) const {
+		return scene          == other.scene
+		    && tex            == other.tex
+		    && imageTransform == other.imageTransform
+		    && windowSize     == other.windowSize
+		    && renderScale    == other.renderScale
+		    && pipelines      == other.pipelines;
+	}
 };
 
 
@@ -448,8 +1388,13 @@ struct Default<RenderPasses> {
 class SMAADemo {
 	using DemoRenderGraph = RenderGraph<Rendertargets, RenderPasses>;
 
+	// first so it outlives the renderer, which runs shader compiles on it
+	JobSystem                                         jobSystem;
 	RendererDesc                                      rendererDesc;
 	glm::uvec2                                        renderSize;
+	// last pass renders straight into the swapchain image
+	// not in a quality sweep, readback needs a rendertarget
+	bool                                              finalInSwapchain;
 	DemoRenderGraph                                   renderGraph;
 
 	// command line things
@@ -458,28 +1403,100 @@ class SMAADemo {
 	bool                                              recreateSwapchain;
 	bool                                              rebuildRG;
 	bool                                              keepGoing;
+	// compile every shader variant into the cache and exit without rendering
+	bool                                              precompileOnly;
+	// print the renderer's devices and exit
+	bool                                              listDevicesOnly;
 
 	// aa things
 	bool                                              antialiasing;
 	AAMethod                                          aaMethod;
+	// every single sample method at once on its own tile of one scene render
+	// aaMethod and temporalAA are kept but unused while comparing
+	bool                                              compareMethods;
 	bool                                              temporalAA;
 	bool                                              temporalAAFirstFrame;
 	unsigned int                                      temporalFrame;
 	bool                                              temporalReproject;
 	float                                             reprojectionWeightScale;
+	// index to temporalFormats
+	unsigned int                                      temporalFormat;
+	// clamp history to the current frame's neighbourhood
+	bool                                              temporalClamp;
+	// velocity from depth and camera motion instead of a second scene output
+	// animated cubes then only get the camera's motion
+	bool                                              depthVelocity;
+	// set when the render graph is built from depthVelocity
+	bool                                              depthVelocityActive;
 	// number of samples in current scene fb
 	// 1 or 2 if SMAA
 	// 2.. if MSAA
 	unsigned int                                      numSamples;
 	unsigned int                                      debugMode;
 	unsigned int                                      fxaaQuality;
+	// FXAA, temporal resolve and GUI in one pass writing the final image
+	bool                                              fusedFXAA;
+	// set when the render graph is built from fusedFXAA
+	bool                                              fxaaTemporalResolve;
+	bool                                              fxaaDrawsGUI;
+	// record SMAA and FXAA passes once and replay them while nothing changes
+	bool                                              staticPostPasses;
+	// set when the render graph is built, its static passes bind staticGlobals as set 0
+	bool                                              staticPassesActive;
+	BufferHandle                                      staticGlobals;
+	StaticPassState                                   staticPassState;
+	// skip the image scene pass and SMAA edges and weights while nothing they use changes
+	bool                                              cachedImagePasses;
+	// set when the render graph is built, the cached passes depend on these versions
+	bool                                              cachedPassesActive;
+	uint64_t                                          imageVersion;
+	uint64_t                                          smaaVersion;
+	ImagePassState                                    imagePassState;
+	StaticPassState                                   smaaPassState;
 	unsigned int                                      msaaQuality;
 	unsigned int                                      maxMSAAQuality;
 
 	unsigned int                                      smaaQuality;
 	SMAAEdgeMethod                                    smaaEdgeMethod;
 	bool                                              smaaPredication;
+	// edges and blend weights in compute shaders, only if supported
+	bool                                              smaaCompute;
+	// with compute, neighborhood blending only draws the tiles with edges over a copy of the input
+	bool                                              smaaTiledBlend;
+	// set when the render graph is built from smaaTiledBlend
+	bool                                              smaaTiledBlendActive;
+	// tiled blending writes the changed pixels back into the scene color which is then presented
+	// instead of copying all of it to the final image
+	bool                                              smaaInPlaceBlend;
+	// set when the render graph is built from smaaInPlaceBlend
+	bool                                              smaaInPlaceBlendActive;
+	// mediump color and edge math in the SMAA and FXAA shaders, only if supported
+	bool                                              halfPrecision;
+	// compute blend weights search edges from a shared memory copy loaded with ballots
+	bool                                              smaaSubgroupSearch;
+	// RG8 when it's renderable, SMAA only uses two channels of the edges
+	Format                                            smaaEdgesFormat;
+	// edges and blend weights run at this fraction of the render size
+	// and the blend pass upsamples the weights
+	float                                             smaaScale;
+	glm::uvec2                                        smaaSize;
+	// rendertargets stay at full size and passes before the upscale
+	// render into a viewport of renderScale times that
+	bool                                              dynamicResolution;
+	float                                             renderScale;
+	// milliseconds, dynamicResolution moves renderScale towards this GPU time
+	float                                             targetGPUTime;
+	// edges pass marks edge pixels in stencil so the weights pass can skip the rest
+	// only if a stencil format is supported
+	bool                                              smaaStencil;
 	ShaderDefines::SMAAParameters                     smaaParameters;
+	// GPU milliseconds the SMAA passes should fit in, 0 leaves smaaParameters alone
+	float                                             smaaBudget;
+	// index into budgetSMAAParameters
+	unsigned int                                      smaaBudgetLevel;
+	// SMAA GPU time and frames since the last adjustment
+	uint64_t                                          smaaBudgetTime;
+	unsigned int                                      smaaBudgetSamples;
 
 	float                                             predicationThreshold;
 	float                                             predicationScale;
@@ -488,11 +1505,95 @@ class SMAADemo {
 	// timing things
 	bool                                              fpsLimitActive;
 	uint32_t                                          fpsLimit;
-	uint64_t                                          sleepFudge;
+	// precise sleeps for the fps limit and just in time pacing
+	FramePacer                                        framePacer;
+	// sleep before starting a frame so it completes just before the next refresh
+	bool                                              justInTimePacing;
+	// render only when input, animation or loading needs a new frame
+	bool                                              onDemandRedraw;
+	// frames on-demand redraw still renders before idling
+	unsigned int                                      redrawFrames;
+	// previous frame's CPU time without waiting in beginFrame, nanoseconds
+	uint64_t                                          lastWorkTime;
+	uint64_t                                          lastFrameWaitTime;
+	uint64_t                                          lastGPUTime;
+	// smoothed, milliseconds
+	float                                             frameTimeMean;
+	float                                             frameTimeVariance;
+	float                                             latencyMean;
+	bool                                              latencyDisplayed;
 	uint64_t                                          tickBase;
 	uint64_t                                          lastTime;
 	uint64_t                                          freqMult;
 	uint64_t                                          freqDiv;
+	// getNanoseconds at the end of each startup phase, logged after the first frame
+	std::vector<std::pair<const char *, uint64_t> >   startupPhases;
+	bool                                              startupDone;
+
+
+	// heap allocation things, only counted with ALLOCATION_TRACKING
+	uint64_t                                          lastFrameAllocations;
+	// smoothed for the GUI
+	float                                             allocationsMean;
+	// frames since the render graph was rebuilt
+	unsigned int                                      steadyFrames;
+	// allocating in a steady-state frame is a bug
+	bool                                              assertNoAllocations;
+
+	// benchmark things
+	// benchmark is active when benchmarkFile is not empty
+	std::string                                       benchmarkFile;
+	// earlier JSON report to compare the results against
+	std::string                                       benchmarkBaselineFile;
+	unsigned int                                      benchmarkWarmupFrames;
+	unsigned int                                      benchmarkMeasuredFrames;
+	std::vector<BenchmarkConfig>                      benchmarkConfigs;
+	unsigned int                                      benchmarkCurrentConfig;
+	unsigned int                                      benchmarkFrame;
+	std::vector<uint64_t>                             benchmarkFrameTimes;
+	// summed nanoseconds per pass over benchmarkGPUSamples frames
+	std::vector<std::pair<std::string, uint64_t> >    benchmarkGPUTimes;
+	unsigned int                                      benchmarkGPUSamples;
+	// per frame GPU times in milliseconds, total and per pass
+	std::vector<float>                                benchmarkGPUFrameTimes;
+	std::vector<std::vector<float> >                  benchmarkGPUPassSamples;
+	// summed performance counters per pass and how many frames had them
+	std::vector<std::vector<double> >                 benchmarkGPUCounters;
+	std::vector<unsigned int>                         benchmarkGPUCounterSamples;
+	uint64_t                                          benchmarkLatencyTotal;
+	unsigned int                                      benchmarkLatencySamples;
+	// rebuild the render graph every frame to include it in CPU times
+	bool                                              benchmarkRebuildGraph;
+	// allocationCount when the measured frames began
+	uint64_t                                          benchmarkAllocations;
+	std::vector<BenchmarkResult>                      benchmarkResults;
+	// run the benchmark once per device, one SMAADemo each
+	// results are passed on to the next one and the last writes the report
+	bool                                              benchmarkAllDevices;
+	std::string                                       benchmarkDevice;
+	bool                                              benchmarkLastDevice;
+	// created when the benchmark starts
+	std::unique_ptr<PowerMonitor>                     powerMonitor;
+
+	// quality sweep runs the benchmark on every image
+	// and compares the final images to a supersampled reference
+	// sweep is active when sweepFile is not empty
+	std::string                                       sweepFile;
+	unsigned int                                      sweepImage;
+	bool                                              sweepReadbackRequested;
+	bool                                              sweepReadbackDone;
+	// sweepMutex protects sweepQueue, sweepQualities and sweepStop
+	std::thread                                       sweepThread;
+	std::mutex                                        sweepMutex;
+	std::condition_variable                           sweepCV;
+	std::deque<SweepJob>                              sweepQueue;
+	std::vector<SweepQuality>                         sweepQualities;
+	bool                                              sweepStop;
+
+	// replay is active when replayFile is not empty
+	std::string                                       replayFile;
+	unsigned int                                      replayFrame;
+	unsigned int                                      replayLoops;
 
 	// scene things
 	// 0 for cubes
@@ -503,40 +1604,156 @@ class SMAADemo {
 	bool                                              rotateCubes;
 	bool                                              visualizeCubeOrder;
 	unsigned int                                      cubeOrderNum;
+	// sort cubes front to back every frame the camera moves
+	bool                                              sortCubes;
+	// camera position in model space at the last sort
+	glm::vec3                                         cubeSortEye;
+	// frustum cull cubes in a compute shader and draw the rest indirectly
+	// only if compute shaders are supported
+	bool                                              cubeCulling;
+	// cubeCulling when the render graph was built
+	bool                                              cubeCullingActive;
+	// spin and bob cubes in a compute pass, the CPU copy is never touched
+	// only with compute shaders and the cube grid
+	bool                                              cubeAnimation;
+	// cubeAnimation when the render graph was built
+	bool                                              cubeAnimationActive;
+	// nanoseconds, previous frame's is kept for velocity
+	uint64_t                                          cubeAnimationTime;
+	uint64_t                                          cubeAnimationPrevTime;
+	// cull pass sends cubes smaller than cubeLODPixels to a separate list
+	// drawn as camera facing quads, only with cubeCulling
+	bool                                              cubeLOD;
+	// cubeLOD when the render graph was built
+	bool                                              cubeLODActive;
+	float                                             cubeLODPixels;
+	// scene pass writes velocity for temporal AA, set when the render graph is built
+	bool                                              sceneVelocity;
+	// generate cube vertices in the vertex shader without vertex or index buffers
+	bool                                              proceduralCubes;
+	// upload the cube grid as CompactCube
+	bool                                              compactCubes;
+	// compactCubes when the render graph was built
+	bool                                              compactCubesActive;
+	// lay down cube depth first so the scene pass only shades visible fragments
+	bool                                              depthPrepass;
+	// depthPrepass when the render graph was built
+	bool                                              depthPrepassActive;
 	float                                             cameraRotation;
 	float                                             cameraDistance;
 	uint64_t                                          rotationTime;
 	unsigned int                                      rotationPeriodSeconds;
+	// animation advances this many nanoseconds every frame instead of the measured time
+	// 0 for real time
+	uint64_t                                          fixedTimestep;
 	RandomGen                                         random;
+	// createCubes restarts random from randomSeed so cubes don't depend on earlier changes
+	bool                                              fixedSeed;
+	uint64_t                                          randomSeed;
 	std::vector<Image>                                images;
+	// only the active image and its neighbors are loaded
+	// others stay resident until they don't fit in the budget, least recently used go first
+	uint64_t                                          imageMemoryBudget;
+	uint64_t                                          residentImageMemory;
+	uint64_t                                          imageUseCounter;
+	// split every image into pages, not just the ones too big for a texture
+	bool                                              tiledImages;
+	unsigned int                                      imagePageCacheMB;
+	ImagePageCache                                    imagePageCache;
+	// image scene view, 1 fits the whole image and the center is in texcoords
+	float                                             imageZoom;
+	glm::vec2                                         imageCenter;
 	std::vector<ShaderDefines::Cube>                  cubes;
+	// GPU copy of cubes, only updated when cubesDirty is set
+	BufferHandle                                      cubeInstances;
+	// bytes, recreated when the number of cubes changes
+	uint32_t                                          cubeInstancesSize;
+	// cubeInstances holds CompactCube instead of Cube
+	bool                                              cubeInstancesCompact;
+	// packed from cubes before upload, kept to avoid reallocating
+	std::vector<ShaderDefines::CompactCube>           compactCubeData;
+	bool                                              cubesDirty;
+	// how many of the cubes are drawn, set by updateCubeScene
+	unsigned int                                      numDrawnCubes;
+
+	// --scene replaces the cube grid, its instances go in cubes grouped by mesh
+	std::unique_ptr<SceneFile>                        sceneFile;
+	std::string                                       exportSceneFile;
+	// nanoseconds, camera path and instance rotations only depend on this
+	uint64_t                                          sceneTime;
+	// sceneFile instance of each cube
+	std::vector<uint32_t>                             sceneInstanceOrder;
+	// first cube of each mesh and the number of cubes at the end
+	std::vector<uint32_t>                             sceneMeshFirstInstance;
+
+	// background image decoding on jobSystem
+	// imageLoadMutex protects decodedImages and imageLoadStop
+	JobCounter                                        imageLoadJobs;
+	std::mutex                                        imageLoadMutex;
+	std::vector<DecodedImage>                         decodedImages;
+	bool                                              imageLoadStop;
+	// only touched by the main thread
+	unsigned int                                      numPendingImages;
 
 	glm::mat4                                         currViewProj;
 	glm::mat4                                         prevViewProj;
+	// prevViewProj * inverse(currViewProj)
+	glm::mat4                                         reprojection;
 	std::array<glm::vec4, 2>                          subsampleIndices;
 
 	Renderer                                          renderer;
 	Format                                            depthFormat;
+	Format                                            stencilFormat;
 
 	std::array<RenderTargetHandle, 2>                 temporalRTs;
 
 	PipelineHandle                                    cubePipeline;
+	PipelineHandle                                    cubeDepthPipeline;
 	PipelineHandle                                    imagePipeline;
+	PipelineHandle                                    tiledImagePipeline;
 	PipelineHandle                                    blitPipeline;
 	PipelineHandle                                    guiPipeline;
-	PipelineHandle                                    separatePipeline;
+	PipelineHandle                                    guiCompositePipeline;
+	PipelineHandle                                    depthVelocityPipeline;
 	std::array<PipelineHandle, 2>                     temporalAAPipelines;
 	PipelineHandle                                    fxaaPipeline;
+	PipelineHandle                                    cubeCullResetPipeline;
+	PipelineHandle                                    cubeCullPipeline;
+	PipelineHandle                                    cubeAnimatePipeline;
+	PipelineHandle                                    cubeImpostorPipeline;
+	PipelineHandle                                    cubeImpostorDepthPipeline;
 
 	BufferHandle                                      cubeVBO;
 	BufferHandle                                      cubeIBO;
+	BufferHandle                                      sceneVBO;
+	BufferHandle                                      sceneIBO;
+	// one DrawIndexedIndirectArgs per scene mesh, there's no firstInstance
+	// so each draw gets its first cube in a push constant instead
+	std::vector<BufferHandle>                         sceneMeshArgs;
+	// scene file meshes, reused every frame
+	DrawList                                          sceneDraws;
+	// written by the cull pass, indices of visible cubes and scene pass draw arguments
+	BufferHandle                                      cubeVisibleBuffer;
+	BufferHandle                                      cubeDrawArgsBuffer;
+	BufferHandle                                      cubeImpostorBuffer;
+	BufferHandle                                      cubeImpostorArgsBuffer;
+	// written by the animation pass, current and previous pose of every cube
+	BufferHandle                                      cubeAnimatedBuffer;
 
 	SamplerHandle                                     linearSampler;
 	SamplerHandle                                     nearestSampler;
 
 	SMAAPipelines                                     smaaPipelines;
+	// list of tiles with edges, written by SMAA edge compute pass
+	BufferHandle                                      smaaTileBuffer;
+	// DrawIndirectArgs the compute edge pass fills for tiled neighborhood blending
+	BufferHandle                                      smaaTileDrawBuffer;
+	// colors of in-place blending, SMAA_BLEND_TILE_UINTS per tile of the list
+	BufferHandle                                      smaaBlendColorBuffer;
 	TextureHandle                                     areaTex;
 	TextureHandle                                     searchTex;
+	// shown while an image is still loading
+	TextureHandle                                     placeholderTex;
 
 	// input
 	bool                                              rightShift, leftShift;
@@ -551,9 +1768,62 @@ class SMAADemo {
 	bool                                              textInputActive;
 	char                                              imageFileName[inputTextBufferSize];
 	char                                              clipboardText[inputTextBufferSize];
+	// smoothed GPU time in milliseconds per render pass, in render graph order
+	std::vector<std::pair<std::string, float> >       gpuPassTimes;
+	// renderer statistics copied in render, only fetched as often as the gui needs them
+	uint64_t                                          guiRefreshInterval;
+	std::vector<GPUTiming>                            guiGPUTimings;
+	MemoryStats                                       guiMemStats;
+	ShaderStats                                       guiShaderStats;
+	// only fetched while their gui sections are open
+	bool                                              guiWantsMemStats;
+	bool                                              guiWantsShaderStats;
+	// all draw lists of a frame, uploaded as one buffer each
+	std::vector<ImDrawVert>                           guiVertices;
+	std::vector<ImDrawIdx>                            guiIndices;
+	// hash of the last frame's draw list vertices and indices
+	uint64_t                                          guiDataHash;
+	// static copy of the draw lists once they stop changing
+	BufferHandle                                      guiVBO;
+	BufferHandle                                      guiIBO;
+	// performance overlay window, histories are updated even when it's closed
+	bool                                              perfOverlay;
+	// toggled with g, the GUI pass is conditional so this doesn't rebuild the graph
+	bool                                              guiVisible;
+	PerfHistory                                       cpuFrameHistory;
+	PerfHistory                                       gpuFrameHistory;
+	PerfHistory                                       frameWaitHistory;
+	// megabytes, only known with Vulkan
+	PerfHistory                                       usedMemoryHistory;
+	PerfHistory                                       ringBufferHistory;
+	// --gui-overlay, GUI is drawn into guiOverlayRT at most this many times a second
+	// and only when it changed, the GUI pass blends it over the final image
+	// 0 draws it every frame
+	float                                             guiOverlayRate;
+	// guiOverlayRate was set when the render graph was built
+	bool                                              guiOverlayActive;
+	RenderTargetHandle                                guiOverlayRT;
+	RenderPassHandle                                  guiOverlayRenderPass;
+	FramebufferHandle                                 guiOverlayFramebuffer;
+	PipelineHandle                                    guiOverlayPipeline;
+	bool                                              guiOverlayValid;
+	// draw data hash and time of the last overlay update
+	uint64_t                                          guiOverlayHash;
+	uint64_t                                          guiOverlayTime;
 
 #endif  // IMGUI_DISABLE
 
+	// --cpu-trace, profiler zones are recorded and written here on exit
+	std::string                                       cpuTraceFile;
+	// start of the newest GPU timer given to the profiler
+	// getGPUTimings doesn't change on frames where nothing completed
+	uint64_t                                          tracedGPUTime;
+
+	// --graph-report, estimated bandwidth of the render graph written here after every build
+	std::string                                       graphReportFile;
+	// frames until the passes of a new build have GPU timings
+	unsigned int                                      graphReportDelay;
+
 
 	SMAADemo(const SMAADemo &) = delete;
 	SMAADemo &operator=(const SMAADemo &) = delete;
@@ -562,52 +1832,226 @@ class SMAADemo {
 
 	void rebuildRenderGraph();
 
+	void clearPipelineHandles();
+
+	StaticPassState currentStaticPassState() const;
+	// invalidates static passes and recreates staticGlobals if their inputs changed
+	void updateStaticPasses();
+	// static passes don't inherit set 0 from the scene pass
+	void bindStaticGlobals();
+
+	ImagePassState currentImagePassState() const;
+	// bumps the versions of cached passes whose inputs changed since the last frame
+	void updateCachedPassVersions();
+
+	void precompileShaders();
+
+	PipelineDesc cubePipelineDesc(bool impostors = false, bool depthOnly = false) const;
+
+	ComputePipelineDesc cubeCullResetPipelineDesc() const;
+
+	ComputePipelineDesc cubeCullPipelineDesc() const;
+
+	ComputePipelineDesc cubeAnimatePipelineDesc() const;
+
+	PipelineDesc imagePipelineDesc(bool tiled = false) const;
+
+	PipelineDesc fxaaPipelineDesc() const;
+
+	ShaderMacros smaaQualityMacros() const;
+
+	template <typename Desc> void smaaSpecConstants(Desc &desc) const;
+
+	ShaderMacros smaaEdgeShaderMacros() const;
+	ShaderDefines::SMAAUBO smaaPushConstants() const;
+
+	PipelineDesc smaaEdgePipelineDesc() const;
+
+	PipelineDesc smaaWeightsPipelineDesc() const;
+
+	ComputePipelineDesc smaaTileResetPipelineDesc() const;
+
+	ComputePipelineDesc smaaEdgeComputePipelineDesc() const;
+
+	ComputePipelineDesc smaaWeightsComputePipelineDesc() const;
+
+	ComputePipelineDesc smaaBlendComputePipelineDesc() const;
+
+	PipelineDesc smaaBlendPipelineDesc() const;
+
+	PipelineDesc blitPipelineDesc() const;
+
+	PipelineDesc temporalAAPipelineDesc() const;
+
 	void renderFXAA(RenderPasses rp, DemoRenderGraph::PassResources &r);
 
-	void renderSeparate(RenderPasses rp, DemoRenderGraph::PassResources &r);
+	// S2X does both subsamples, input is the multisampled MainColor
+	void renderSMAAEdges(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input);
+
+	void renderSMAAWeights(RenderPasses rp, DemoRenderGraph::PassResources &r);
 
-	void renderSMAAEdges(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input, int pass);
+	void addSMAAStencilTarget(unsigned int width, unsigned int height);
 
-	void renderSMAAWeights(RenderPasses rp, DemoRenderGraph::PassResources &r, int pass);
+	void smaaStencilAttachment(DemoRenderGraph::PassDesc &desc, bool edges) const;
 
-	void renderSMAABlend(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input, int pass);
+	// subsample indexes subsampleIndices, one dispatch of each pass per subsample
+	void addSMAAComputePasses(Rendertargets input, unsigned int subsample, unsigned int width, unsigned int height);
+
+	void renderSMAAEdgesCompute(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input);
+
+	void renderSMAAWeightsCompute(RenderPasses rp, DemoRenderGraph::PassResources &r, unsigned int subsample);
+
+	void renderSMAABlendCompute(RenderPasses rp, DemoRenderGraph::PassResources &r);
+
+	void renderSMAABlend(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input);
 
 	void renderSMAADebug(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets rt);
 
 	void renderTemporalAA(RenderPasses rp, DemoRenderGraph::PassResources &r);
 
+	void renderUpscale(RenderPasses rp, DemoRenderGraph::PassResources &r);
+
+	void addComparisonPasses(Rendertargets finalRT);
+
+	// call after bindPipeline, size is the viewport of the whole image
+	void setComparisonScissor(unsigned int tile, glm::uvec2 size);
+
+	// part of a rendertarget of the given size which passes before the upscale cover
+	glm::uvec2 scaledSize(unsigned int width, unsigned int height) const;
+
+	void updateRenderScale();
+
+	// steps smaaParameters through budgetSMAAParameters to keep SMAA GPU time within smaaBudget
+	void updateSMAABudget();
+
 #ifndef IMGUI_DISABLE
 
 	void updateGUI(uint64_t elapsed);
 
+	// smooths the per pass GPU times shown in the GUI
+	void updateGPUPassTimes();
+
+	void updatePerfOverlay(uint64_t elapsed);
+
+	PipelineDesc guiPipelineDesc(bool overlay) const;
+
+	void createGUIOverlay(unsigned int width, unsigned int height);
+
+	void deleteGUIOverlay();
+
+	// draws the GUI into guiOverlayRT if it's due, outside the render graph
+	void renderGUIOverlay();
+
+	// pipeline and set 0 must be bound
+	void drawGUI(const ImDrawData *drawData, uint64_t hash);
+
 	void renderGUI(RenderPasses rp, DemoRenderGraph::PassResources &r);
 
 #endif  // IMGUI_DISABLE
 
+	void updateCubeScene();
+
+	void renderCubeCull(RenderPasses rp, DemoRenderGraph::PassResources &r);
+	void renderCubeAnimate(RenderPasses rp, DemoRenderGraph::PassResources &r);
+
 	void renderCubeScene(RenderPasses rp, DemoRenderGraph::PassResources &r);
 
+	PipelineDesc depthVelocityPipelineDesc() const;
+
+	void renderDepthVelocity(RenderPasses rp, DemoRenderGraph::PassResources &r);
+
 	void renderImageScene(RenderPasses rp, DemoRenderGraph::PassResources &r);
 
 	void loadImage(const std::string &filename);
 
+	void decodeImage(unsigned int index, const std::string &filename, const std::string &name);
+
+	void processDecodedImages();
+
+	void requestImage(unsigned int index);
+
+	void updateImageResidency();
+
+	// true if any pages of the image changed
+	bool updateImagePages();
+
+	ShaderDefines::ImageConstants imageConstants() const;
+
 	uint64_t getNanoseconds() {
 		return (SDL_GetPerformanceCounter() - tickBase) * freqMult / freqDiv;
 	}
 
+	void startupPhase(const char *name) {
+		if (!startupDone) {
+			startupPhases.emplace_back(name, getNanoseconds());
+		}
+	}
+
+	void finishStartup();
+
 	void shuffleCubeRendering();
 
 	void reorderCubeRendering();
 
+	void sortCubesFrontToBack(const glm::vec3 &eye);
+
 	void colorCubes();
 
+	// vertex, index and indirect argument buffers straight from the mapped scene file
+	void createSceneBuffers();
+
+	// cubes from sceneFile instances instead of the grid
+	void createSceneCubes();
+
+	void updateSceneInstances();
+
 	void setAntialiasing(bool enabled);
 
 	void setTemporalAA(bool enabled);
 
+	std::string benchmarkConfigName(const BenchmarkConfig &config) const;
+
+	void applyBenchmarkConfig();
+
+	void benchmarkFrameDone(uint64_t elapsed);
+
+	void writeBenchmarkReport() const;
+
+	void sweepFrameDone();
+
+	void nextSweepImage();
+
+	void sweepThreadFunc();
+
+	void writeSweepReport() const;
+
+	bool benchmarkActive() const {
+		return !benchmarkFile.empty() || !sweepFile.empty();
+	}
+
 	bool isImageScene() const {
 		return activeScene != 0;
 	}
 
+	bool comparing() const {
+		return antialiasing && compareMethods;
+	}
+
+	bool temporalActive() const {
+		return antialiasing && temporalAA && !isImageScene() && !comparing();
+	}
+
+	// the SMAA passes are shared with comparison which is always single sample
+	bool smaa2XActive() const {
+		return aaMethod == +AAMethod::SMAA2X && !comparing();
+	}
+
+	// sampling depth forces it out of attachment layout and may decompress it
+	// so SMAA edges only read it when they actually need it
+	bool smaaEdgesNeedDepth() const {
+		return smaaPredication || smaaEdgeMethod == SMAAEdgeMethod::Depth;
+	}
+
 
 public:
 
@@ -619,6 +2063,12 @@ public:
 
 	void initRender();
 
+	bool shouldReplay() const {
+		return !replayFile.empty();
+	}
+
+	void replayCapture();
+
 	void createCubes();
 
 	void mainLoopIteration();
@@ -629,38 +2079,122 @@ public:
 		return keepGoing;
 	}
 
+	// false if the next frame would look the same as the last one
+	bool redrawNeeded() const;
+
+	bool shouldPrecompileOnly() const {
+		return precompileOnly;
+	}
+
+	bool shouldExportScene() const {
+		return !exportSceneFile.empty();
+	}
+
+	void exportScene();
+
+	bool shouldListDevices() const {
+		return listDevicesOnly;
+	}
+
+	bool shouldBenchmarkAllDevices() const {
+		return benchmarkAllDevices;
+	}
+
+	// must be called before initRender
+	void setBenchmarkDevice(const DeviceInfo &device, bool last, std::vector<BenchmarkResult> &&earlierResults);
+
+	std::vector<BenchmarkResult> takeBenchmarkResults() {
+		return std::move(benchmarkResults);
+	}
+
+	void precompileAllShaders();
+
 	void render();
 };
 
 
 SMAADemo::SMAADemo()
-: recreateSwapchain(false)
+: finalInSwapchain(false)
+, recreateSwapchain(false)
 , rebuildRG(true)
 , keepGoing(true)
+, precompileOnly(false)
+, listDevicesOnly(false)
 
 , antialiasing(true)
 , aaMethod(AAMethod::SMAA)
+, compareMethods(false)
 , temporalAA(false)
 , temporalAAFirstFrame(false)
 , temporalFrame(0)
 , temporalReproject(true)
 , reprojectionWeightScale(30.0f)
+, temporalFormat(0)
+, temporalClamp(false)
+, depthVelocity(false)
+, depthVelocityActive(false)
 , numSamples(1)
 , debugMode(0)
 , fxaaQuality(maxFXAAQuality - 1)
+, fusedFXAA(false)
+, fxaaTemporalResolve(false)
+, fxaaDrawsGUI(false)
+, staticPostPasses(true)
+, staticPassesActive(false)
+, cachedImagePasses(true)
+, cachedPassesActive(false)
+, imageVersion(0)
+, smaaVersion(0)
 , msaaQuality(0)
 , maxMSAAQuality(1)
+, smaaBudget(0.0f)
+, smaaBudgetLevel(2)
+, smaaBudgetTime(0)
+, smaaBudgetSamples(0)
 , predicationThreshold(0.01f)
 , predicationScale(2.0f)
 , predicationStrength(0.4f)
 
 , fpsLimitActive(true)
 , fpsLimit(0)
-, sleepFudge(0)
+, justInTimePacing(false)
+, onDemandRedraw(false)
+, redrawFrames(0)
+, lastWorkTime(0)
+, lastFrameWaitTime(0)
+, lastGPUTime(0)
+, frameTimeMean(0.0f)
+, frameTimeVariance(0.0f)
+, latencyMean(0.0f)
+, latencyDisplayed(false)
 , tickBase(0)
 , lastTime(0)
 , freqMult(0)
 , freqDiv(0)
+, startupDone(false)
+
+, lastFrameAllocations(0)
+, allocationsMean(0.0f)
+, steadyFrames(0)
+, assertNoAllocations(false)
+
+, benchmarkWarmupFrames(defaultBenchmarkWarmupFrames)
+, benchmarkMeasuredFrames(defaultBenchmarkMeasuredFrames)
+, benchmarkCurrentConfig(0)
+, benchmarkFrame(0)
+, benchmarkGPUSamples(0)
+, benchmarkLatencyTotal(0)
+, benchmarkLatencySamples(0)
+, benchmarkRebuildGraph(false)
+, benchmarkAllocations(0)
+, benchmarkAllDevices(false)
+, benchmarkLastDevice(true)
+, sweepImage(0)
+, sweepReadbackRequested(false)
+, sweepReadbackDone(false)
+, sweepStop(false)
+, replayFrame(0)
+, replayLoops(100)
 
 , activeScene(0)
 , cubesPerSide(8)
@@ -668,13 +2202,48 @@ SMAADemo::SMAADemo()
 , rotateCubes(false)
 , visualizeCubeOrder(false)
 , cubeOrderNum(1)
+, sortCubes(false)
+, cubeSortEye(0.0f, 0.0f, 0.0f)
+, cubeCulling(true)
+, cubeCullingActive(false)
+, cubeAnimation(false)
+, cubeAnimationActive(false)
+, cubeAnimationTime(0)
+, cubeAnimationPrevTime(0)
+, cubeLOD(false)
+, cubeLODActive(false)
+, cubeLODPixels(defaultCubeLODPixels)
+, sceneVelocity(false)
+, proceduralCubes(false)
+, compactCubes(false)
+, compactCubesActive(false)
+, depthPrepass(false)
+, depthPrepassActive(false)
 , cameraRotation(0.0f)
 , cameraDistance(25.0f)
 , rotationTime(0)
 , rotationPeriodSeconds(30)
+, fixedTimestep(0)
 , random(1)
+, fixedSeed(false)
+, randomSeed(1)
+, imageMemoryBudget(uint64_t(defaultImageMemoryMB) * 1024 * 1024)
+, residentImageMemory(0)
+, imageUseCounter(0)
+, tiledImages(false)
+, imagePageCacheMB(defaultImagePageCacheMB)
+, imageZoom(1.0f)
+, imageCenter(0.5f, 0.5f)
+, cubeInstancesSize(0)
+, cubeInstancesCompact(false)
+, cubesDirty(true)
+, numDrawnCubes(0)
+, sceneTime(0)
+, imageLoadStop(false)
+, numPendingImages(0)
 
 , depthFormat(Format::Invalid)
+, stencilFormat(Format::Invalid)
 
 , rightShift(false)
 , leftShift(false)
@@ -686,10 +2255,24 @@ SMAADemo::SMAADemo()
 #ifndef IMGUI_DISABLE
 , imGuiContext(nullptr)
 , textInputActive(false)
+, guiRefreshInterval(0)
+, guiWantsMemStats(false)
+, guiWantsShaderStats(false)
+, guiDataHash(0)
+, perfOverlay(false)
+, guiVisible(true)
+, guiOverlayRate(0.0f)
+, guiOverlayActive(false)
+, guiOverlayValid(false)
+, guiOverlayHash(0)
+, guiOverlayTime(0)
 #endif  // IMGUI_DISABLE
+, tracedGPUTime(0)
+, graphReportDelay(0)
 {
 	rendererDesc.swapchain.width  = 1280;
 	rendererDesc.swapchain.height = 720;
+	rendererDesc.jobSystem        = &jobSystem;
 
 	rendererDesc.applicationName           = "SMAA demo";
 	rendererDesc.applicationVersion.major  = 1;
@@ -703,6 +2286,19 @@ SMAADemo::SMAADemo()
 	smaaQuality = maxSMAAQuality - 1;
 	smaaEdgeMethod  = SMAAEdgeMethod::Color;
 	smaaPredication = false;
+	smaaCompute     = false;
+	smaaTiledBlend  = true;
+	smaaTiledBlendActive = false;
+	smaaInPlaceBlend       = false;
+	smaaInPlaceBlendActive = false;
+	halfPrecision   = false;
+	smaaSubgroupSearch = false;
+	smaaEdgesFormat = Format::RGBA8;
+	smaaScale       = 1.0f;
+	dynamicResolution = false;
+	renderScale     = 1.0f;
+	targetGPUTime   = 16.0f;
+	smaaStencil     = true;
 	smaaParameters  = defaultSMAAParameters[smaaQuality];
 
 	uint64_t freq = SDL_GetPerformanceFrequency();
@@ -718,17 +2314,7 @@ SMAADemo::SMAADemo()
 
 	lastTime = getNanoseconds();
 
-	// measure minimum sleep length and use it as fudge factor
-	sleepFudge = 1000ULL * 1000ULL;
-	for (unsigned int i = 0; i < 8; i++) {
-		std::this_thread::sleep_for(std::chrono::nanoseconds(1));
-		uint64_t ticks = getNanoseconds();
-		uint64_t diff  = ticks - lastTime;
-		sleepFudge     = std::min(sleepFudge, diff);
-		lastTime       = ticks;
-	}
-
-	LOG("sleep fudge (nanoseconds): %" PRIu64 "\n", sleepFudge);
+	LOG("frame pacing timer: %s\n", framePacer.getTimerName());
 
 #ifndef IMGUI_DISABLE
 	memset(imageFileName, 0, inputTextBufferSize);
@@ -738,11 +2324,55 @@ SMAADemo::SMAADemo()
 
 
 SMAADemo::~SMAADemo() {
+	// quit in the middle of a sweep
+	if (sweepThread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(sweepMutex);
+			sweepStop = true;
+			sweepQueue.clear();
+		}
+		sweepCV.notify_all();
+		sweepThread.join();
+	}
+
+	if (!cpuTraceFile.empty()) {
+		profilerSetEnabled(false);
+		try {
+			profilerWriteChromeTrace(cpuTraceFile);
+		} catch (std::exception &e) {
+			LOG("Failed to write CPU trace: %s\n", e.what());
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(imageLoadMutex);
+		imageLoadStop = true;
+	}
+	// queued ones return without decoding
+	jobSystem.wait(imageLoadJobs);
+	for (auto &d : decodedImages) {
+		if (d.tex) {
+			renderer.deleteTexture(d.tex);
+			d.tex = TextureHandle();
+		}
+	}
+	decodedImages.clear();
+
 #ifndef IMGUI_DISABLE
 	if (imGuiContext) {
 		ImGui::DestroyContext(imGuiContext);
 		imGuiContext = nullptr;
 	}
+
+	if (guiVBO) {
+		renderer.deleteBuffer(guiVBO);
+		guiVBO = BufferHandle();
+
+		renderer.deleteBuffer(guiIBO);
+		guiIBO = BufferHandle();
+	}
+
+	deleteGUIOverlay();
 #endif  // IMGUI_DISABLE
 
 	if (temporalRTs[0]) {
@@ -751,7 +2381,39 @@ SMAADemo::~SMAADemo() {
 		renderer.deleteRenderTarget(temporalRTs[1]);
 	}
 
-	renderGraph.reset(renderer, SDL_PumpEvents);
+	renderGraph.clear(renderer);
+
+	if (smaaTileBuffer) {
+		renderer.deleteBuffer(smaaTileBuffer);
+		smaaTileBuffer = BufferHandle();
+
+		renderer.deleteBuffer(smaaTileDrawBuffer);
+		smaaTileDrawBuffer = BufferHandle();
+	}
+
+	if (smaaBlendColorBuffer) {
+		renderer.deleteBuffer(smaaBlendColorBuffer);
+		smaaBlendColorBuffer = BufferHandle();
+	}
+
+	if (cubeVisibleBuffer) {
+		renderer.deleteBuffer(cubeVisibleBuffer);
+		cubeVisibleBuffer = BufferHandle();
+
+		renderer.deleteBuffer(cubeDrawArgsBuffer);
+		cubeDrawArgsBuffer = BufferHandle();
+
+		renderer.deleteBuffer(cubeImpostorBuffer);
+		cubeImpostorBuffer = BufferHandle();
+
+		renderer.deleteBuffer(cubeImpostorArgsBuffer);
+		cubeImpostorArgsBuffer = BufferHandle();
+	}
+
+	if (cubeAnimatedBuffer) {
+		renderer.deleteBuffer(cubeAnimatedBuffer);
+		cubeAnimatedBuffer = BufferHandle();
+	}
 
 	if (cubeVBO) {
 		renderer.deleteBuffer(cubeVBO);
@@ -761,6 +2423,25 @@ SMAADemo::~SMAADemo() {
 		cubeIBO = BufferHandle();
 	}
 
+	if (sceneVBO) {
+		renderer.deleteBuffer(sceneVBO);
+		sceneVBO = BufferHandle();
+
+		renderer.deleteBuffer(sceneIBO);
+		sceneIBO = BufferHandle();
+	}
+
+	for (BufferHandle &args : sceneMeshArgs) {
+		renderer.deleteBuffer(args);
+	}
+	sceneMeshArgs.clear();
+
+	if (cubeInstances) {
+		renderer.deleteBuffer(cubeInstances);
+		cubeInstances     = BufferHandle();
+		cubeInstancesSize = 0;
+	}
+
 	if (linearSampler) {
 		renderer.deleteSampler(linearSampler);
 		linearSampler = SamplerHandle();
@@ -776,6 +2457,19 @@ SMAADemo::~SMAADemo() {
 		renderer.deleteTexture(searchTex);
 		searchTex = TextureHandle();
 	}
+
+	if (placeholderTex) {
+		renderer.deleteTexture(placeholderTex);
+		placeholderTex = TextureHandle();
+	}
+
+	for (auto &img : images) {
+		if (img.tiled) {
+			imagePageCache.remove(renderer, *img.tiled);
+			img.tiled.reset();
+		}
+	}
+	imagePageCache.destroy(renderer);
 }
 
 
@@ -840,22 +2534,90 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 		TCLAP::SwitchArg                       tracingSwitch("",      "trace",      "Enable renderer tracing",       cmd, false);
 		TCLAP::SwitchArg                       noCacheSwitch("",      "nocache",    "Don't load shaders from cache", cmd, false);
 		TCLAP::SwitchArg                       noOptSwitch("",        "noopt",      "Don't optimize shaders",        cmd, false);
+		TCLAP::ValueArg<std::string>           shaderOptSwitch("",    "shader-opt", "SPIR-V optimization recipe", false, "performance", "none/performance/size", cmd);
+		TCLAP::MultiArg<std::string>           shaderOptOverrideSwitch("", "shader-opt-override", "SPIR-V optimization recipe for one shader", false, "shader=recipe", cmd);
 		TCLAP::SwitchArg                       validateSwitch("",     "validate",   "Validate shader SPIR-V",        cmd, false);
+		TCLAP::SwitchArg                       precompileSwitch("",   "precompile-shaders", "Compile all shader variants into the cache and exit", cmd, false);
+		TCLAP::SwitchArg                       hotReloadSwitch("",    "hot-reload", "Recompile shaders when their files change", cmd, false);
+		TCLAP::ValueArg<std::string>           shaderCacheSwitch("",  "shader-cache", "Directory of the shader cache", false, "", "directory", cmd);
 		TCLAP::SwitchArg                       fullscreenSwitch("f",  "fullscreen", "Start in fullscreen mode",      cmd, false);
+		TCLAP::SwitchArg                       preTransformSwitch("", "pre-transform", "Flip at present instead of in the compositor when the display is upside down or mirrored", cmd, false);
 		TCLAP::SwitchArg                       noVsyncSwitch("",      "novsync",    "Disable vsync",                 cmd, false);
 		TCLAP::SwitchArg                       noTransferQSwitch("",  "no-transfer-queue", "Disable transfer queue", cmd, false);
+		TCLAP::SwitchArg                       noDirectUploadSwitch("", "no-direct-uploads", "Upload buffers through staging even when device memory is host visible", cmd, false);
+		TCLAP::ValueArg<unsigned int>          defragmentSwitch("",   "defragment", "Buffer memory moved per frame to undo fragmentation, 0 to disable", false, 0, "KB", cmd);
+		TCLAP::SwitchArg                       secondaryCmdBufSwitch("", "secondary-cmdbufs", "Record render passes into secondary command buffers", cmd, false);
+		TCLAP::SwitchArg                       noDynamicRenderingSwitch("", "no-dynamic-rendering", "Use render pass and framebuffer objects even when dynamic rendering is supported", cmd, false);
+		TCLAP::SwitchArg                       asyncComputeSwitch("", "async-compute", "Run SMAA compute passes on an async compute queue", cmd, false);
+		TCLAP::SwitchArg                       submitThreadSwitch("", "submit-thread", "Submit and present frames on a separate thread while the next frame's input and GUI are processed (Vulkan)", cmd, false);
+		TCLAP::SwitchArg                       pipelineStatsSwitch("", "pipeline-stats", "Count shader invocations and primitives of each render pass", cmd, false);
+		TCLAP::SwitchArg                       shaderStatsSwitch("", "shader-stats", "Get register usage and instruction counts of each pipeline from the driver", cmd, false);
+		TCLAP::ValueArg<std::string>           perfCountersSwitch("", "perf-counters", "Comma-separated hardware performance counters to sample in each render pass, Vulkan only", false, "", "names", cmd);
+		TCLAP::ValueArg<std::string>           frameWaitSwitch("",    "frame-wait", "How to wait for the next frame", false, "block", "poll/block", cmd);
+		TCLAP::ValueArg<unsigned int>          frameWaitTimeoutSwitch("", "frame-wait-timeout", "Longest blocking wait for the next frame", false, rendererDesc.frameWaitTimeout, "ms", cmd);
 
 		TCLAP::ValueArg<unsigned int>          windowWidthSwitch("",  "width",      "Window width",  false, rendererDesc.swapchain.width,  "width",  cmd);
 		TCLAP::ValueArg<unsigned int>          windowHeightSwitch("", "height",     "Window height", false, rendererDesc.swapchain.height, "height", cmd);
+		TCLAP::SwitchArg                       offscreenSwitch("",    "offscreen",  "Render without a window at the given width and height", cmd, false);
 
 		TCLAP::ValueArg<unsigned int>          fpsSwitch("",          "fps",        "FPS limit",     false, 0,                             "FPS",    cmd);
+		TCLAP::ValueArg<unsigned int>          framesInFlightSwitch("", "frames-in-flight", "CPU frames ahead of the GPU, 0 for one per swapchain image", false, 0, "frames", cmd);
+		TCLAP::SwitchArg                       paceSwitch("",         "pace",       "Start frames just in time for the next refresh", cmd, false);
+		TCLAP::SwitchArg                       onDemandSwitch("",     "on-demand",  "Only render when something changed, wait for input otherwise", cmd, false);
+		TCLAP::ValueArg<float>                 dynamicResSwitch("",   "dynamic-resolution", "Scale render resolution to hit a GPU frame time", false, 0.0f, "milliseconds", cmd);
+		TCLAP::ValueArg<float>                 smaaBudgetSwitch("",   "smaa-budget", "Adjust SMAA parameters to keep its passes within a GPU time", false, 0.0f, "milliseconds", cmd);
 
 		TCLAP::ValueArg<unsigned int>          rotateSwitch("",       "rotate",     "Rotation period", false, 0,          "seconds", cmd);
+		TCLAP::ValueArg<unsigned int>          imageMemorySwitch("",  "image-memory", "Image textures kept resident", false, defaultImageMemoryMB, "MB", cmd);
+		TCLAP::SwitchArg                       tiledImagesSwitch("",  "tiled-images", "Stream all images in pages, not just ones too big for a texture", cmd, false);
+		TCLAP::ValueArg<unsigned int>          imagePageCacheSwitch("", "image-page-cache", "GPU cache for pages of tiled images", false, defaultImagePageCacheMB, "MB", cmd);
+		TCLAP::ValueArg<unsigned int>          graphCacheSwitch("",   "graph-cache", "Keep rendertargets, renderpasses and pipelines of this many earlier render graph configurations for switching back", false, 0, "configurations", cmd);
 
 		TCLAP::ValueArg<std::string>           aaMethodSwitch("m",    "method",     "AA Method",     false, "SMAA",        "SMAA/FXAA/MSAA", cmd);
 		TCLAP::ValueArg<std::string>           aaQualitySwitch("q",   "quality",    "AA Quality",    false, "",            "", cmd);
 		TCLAP::ValueArg<std::string>           deviceSwitch("",       "device",     "Set Vulkan device filter", false, "", "device name", cmd);
+		TCLAP::ValueArg<int>                   deviceIndexSwitch("",  "device-index", "Use the Vulkan device with this index from --list-devices", false, -1, "index", cmd);
+		TCLAP::SwitchArg                       listDevicesSwitch("",  "list-devices", "List devices and exit", cmd, false);
 		TCLAP::SwitchArg                       temporalAASwitch("t",  "temporal",   "Temporal AA", cmd, false);
+		TCLAP::SwitchArg                       compareSwitch("",      "compare",    "Compare no AA, FXAA and SMAA side by side", cmd, false);
+		TCLAP::ValueArg<std::string>           temporalFormatSwitch("", "temporal-format", "Temporal AA history format", false, temporalFormatNames[0], "RGBA8/RGBA16F/R11G11B10F", cmd);
+		TCLAP::SwitchArg                       temporalClampSwitch("", "temporal-clamp", "Clamp temporal AA history to the current neighbourhood", cmd, false);
+		TCLAP::SwitchArg                       depthVelocitySwitch("", "depth-velocity", "Temporal AA velocity from depth and camera motion instead of a scene output", cmd, false);
+		TCLAP::SwitchArg                       halfPrecisionSwitch("", "half-precision", "Half precision math in SMAA and FXAA shaders", cmd, false);
+		TCLAP::SwitchArg                       fusedFXAASwitch("",    "fused-fxaa", "FXAA, temporal resolve and GUI in one pass writing the final image", cmd, false);
+		TCLAP::SwitchArg                       smaaSubgroupSwitch("", "smaa-subgroup-search", "Load edges for the compute SMAA weight searches into shared memory with subgroup ballots", cmd, false);
+		TCLAP::SwitchArg                       smaaComputeSwitch("",  "smaa-compute", "SMAA edges and weights in compute shaders", cmd, false);
+		TCLAP::SwitchArg                       smaaInPlaceSwitch("",  "smaa-in-place", "With compute SMAA, blend only the pixels with weights into the scene color and present that", cmd, false);
+		TCLAP::ValueArg<float>                 smaaScaleSwitch("",    "smaa-scale", "Resolution of SMAA edges and weights relative to render size", false, 1.0f, "scale", cmd);
+		TCLAP::SwitchArg                       noSMAAStencilSwitch("", "no-smaa-stencil", "Don't use stencil to skip non-edge pixels in SMAA weights pass", cmd, false);
+		TCLAP::SwitchArg                       noCubeCullSwitch("",   "no-cube-culling", "Don't frustum cull cubes in a compute shader", cmd, false);
+		TCLAP::SwitchArg                       animateCubesSwitch("", "animate-cubes", "Spin and move cubes in a compute shader", cmd, false);
+		TCLAP::SwitchArg                       proceduralCubesSwitch("", "procedural-cubes", "Generate cube vertices in the vertex shader", cmd, false);
+		TCLAP::SwitchArg                       compactCubesSwitch("", "compact-cubes", "Quantize cube instances to 16 bytes", cmd, false);
+		TCLAP::SwitchArg                       depthPrepassSwitch("", "depth-prepass", "Render cube depth in a separate pass before the scene", cmd, false);
+		TCLAP::ValueArg<float>                 cubeLODSwitch("",      "cube-lod", "Draw culled cubes smaller than this as camera facing quads", false, 0.0f, "pixels", cmd);
+		TCLAP::SwitchArg                       perfOverlaySwitch("",  "perf-overlay", "Show frame time graphs and per pass GPU times", cmd, false);
+		TCLAP::ValueArg<std::string>           cpuTraceSwitch("",     "cpu-trace",  "Record CPU profiler zones and write them as a Chrome trace on exit", false, "", "file", cmd);
+		TCLAP::ValueArg<std::string>           graphReportSwitch("",  "graph-report", "Write estimated render graph bandwidth per pass with GPU times after every rebuild, JSON if the name ends in .json, GraphViz otherwise", false, "", "file", cmd);
+		TCLAP::ValueArg<float>                 guiOverlaySwitch("",   "gui-overlay", "Redraw the GUI into its own rendertarget at most this many times a second and only when it changed", false, 0.0f, "Hz", cmd);
+		TCLAP::ValueArg<std::string>           sceneSwitch("",        "scene",      "Draw a binary scene file instead of the cube grid", false, "", "file", cmd);
+		TCLAP::ValueArg<float>                 fixedTimestepSwitch("", "fixed-timestep", "Advance animation by this much every frame instead of real time", false, 0.0f, "ms", cmd);
+		TCLAP::ValueArg<unsigned int>          seedSwitch("",         "seed",       "Generate cubes from this seed every time", false, 1, "seed", cmd);
+		TCLAP::ValueArg<std::string>           exportSceneSwitch("",  "export-scene", "Write the cube grid as a scene file with an orbiting camera and exit", false, "", "file", cmd);
+
+		TCLAP::ValueArg<std::string>           benchmarkSwitch("",    "benchmark",  "Run all AA methods and write a report, JSON if the name ends in .json, CSV otherwise", false, "", "file", cmd);
+		TCLAP::ValueArg<unsigned int>          benchWarmupSwitch("",  "benchmark-warmup", "Benchmark warm-up frames per configuration",  false, defaultBenchmarkWarmupFrames,   "frames", cmd);
+		TCLAP::ValueArg<unsigned int>          benchFramesSwitch("",  "benchmark-frames", "Benchmark measured frames per configuration", false, defaultBenchmarkMeasuredFrames, "frames", cmd);
+		TCLAP::SwitchArg                       benchRebuildSwitch("", "benchmark-rebuild-graph", "Rebuild the render graph every benchmark frame", cmd, false);
+		TCLAP::ValueArg<std::string>           benchBaselineSwitch("", "benchmark-baseline", "Compare the results to an earlier JSON benchmark report and flag significant regressions", false, "", "file", cmd);
+		TCLAP::SwitchArg                       benchAllDevicesSwitch("", "benchmark-all-devices", "Run the benchmark on every device in turn and write one report", cmd, false);
+		TCLAP::ValueArg<std::string>           sweepSwitch("",        "quality-sweep", "Benchmark all AA methods on every image and compare them to a supersampled reference, JSON if the name ends in .json, CSV otherwise", false, "", "file", cmd);
+		TCLAP::SwitchArg                       assertNoAllocSwitch("", "assert-no-allocations", "Assert that steady-state frames don't allocate, needs ALLOCATION_TRACKING", cmd, false);
+		TCLAP::ValueArg<std::string>           captureSwitch("",      "capture",    "Record the renderer command stream to a file", false, "", "file", cmd);
+		TCLAP::ValueArg<unsigned int>          captureFramesSwitch("", "capture-frames", "Number of frames to capture", false, rendererDesc.captureFrames, "frames", cmd);
+		TCLAP::ValueArg<std::string>           replaySwitch("",       "replay",     "Replay a captured frame in a loop instead of running the demo", false, "", "file", cmd);
+		TCLAP::ValueArg<unsigned int>          replayFrameSwitch("",  "replay-frame", "Captured frame to replay", false, 0, "frame", cmd);
+		TCLAP::ValueArg<unsigned int>          replayLoopsSwitch("",  "replay-loops", "Number of times to replay the frame", false, replayLoops, "loops", cmd);
 
 		TCLAP::UnlabeledMultiArg<std::string>  imagesArg("images",    "image files", false, "image file", cmd, true, nullptr);
 
@@ -867,14 +2629,80 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 		rendererDesc.skipShaderCache       = noCacheSwitch.getValue();
 		rendererDesc.optimizeShaders       = !noOptSwitch.getValue();
 		rendererDesc.validateShaders       = validateSwitch.getValue();
+		{
+			auto parsed = ShaderOptimization::_from_string_nocase_nothrow(shaderOptSwitch.getValue().c_str());
+			if (!parsed) {
+				LOG("Bad shader optimization \"%s\"\n", shaderOptSwitch.getValue().c_str());
+				fprintf(stderr, "Bad shader optimization \"%s\"\n", shaderOptSwitch.getValue().c_str());
+				exit(1);
+			}
+			rendererDesc.shaderOptimization = *parsed;
+		}
+		for (const auto &o : shaderOptOverrideSwitch.getValue()) {
+			auto eq = o.find('=');
+			auto parsed = ShaderOptimization::_from_string_nocase_nothrow((eq != std::string::npos) ? o.c_str() + eq + 1 : "");
+			if (!parsed) {
+				LOG("Bad shader optimization override \"%s\"\n", o.c_str());
+				fprintf(stderr, "Bad shader optimization override \"%s\"\n", o.c_str());
+				exit(1);
+			}
+			rendererDesc.shaderOptimizationOverrides[o.substr(0, eq)] = *parsed;
+		}
+		rendererDesc.shaderCacheDir        = shaderCacheSwitch.getValue();
+		rendererDesc.shaderHotReload       = hotReloadSwitch.getValue();
+		precompileOnly                     = precompileSwitch.getValue();
 		rendererDesc.transferQueue         = !noTransferQSwitch.getValue();
+		rendererDesc.directUploads         = !noDirectUploadSwitch.getValue();
+		rendererDesc.defragmentBytesPerFrame = defragmentSwitch.getValue() * 1024;
+		rendererDesc.secondaryCommandBuffers = secondaryCmdBufSwitch.getValue();
+		rendererDesc.dynamicRendering      = !noDynamicRenderingSwitch.getValue();
+		rendererDesc.asyncCompute          = asyncComputeSwitch.getValue();
+		rendererDesc.submitThread          = submitThreadSwitch.getValue();
+		rendererDesc.pipelineStatistics    = pipelineStatsSwitch.getValue();
+		rendererDesc.shaderStatistics      = shaderStatsSwitch.getValue();
+		{
+			std::string counters = perfCountersSwitch.getValue();
+			size_t start = 0;
+			while (start < counters.size()) {
+				size_t end = counters.find(',', start);
+				if (end == std::string::npos) {
+					end = counters.size();
+				}
+				if (end > start) {
+					rendererDesc.performanceCounters.push_back(counters.substr(start, end - start));
+				}
+				start = end + 1;
+			}
+		}
+		rendererDesc.frameWaitTimeout      = frameWaitTimeoutSwitch.getValue();
+		rendererDesc.offscreen             = offscreenSwitch.getValue();
+		{
+			auto parsed = FrameWait::_from_string_nocase_nothrow(frameWaitSwitch.getValue().c_str());
+			if (!parsed) {
+				LOG("Bad frame wait \"%s\"\n", frameWaitSwitch.getValue().c_str());
+				fprintf(stderr, "Bad frame wait \"%s\"\n", frameWaitSwitch.getValue().c_str());
+				exit(1);
+			}
+			rendererDesc.frameWait         = *parsed;
+		}
 		rendererDesc.swapchain.fullscreen  = fullscreenSwitch.getValue();
+		rendererDesc.swapchain.preTransform = preTransformSwitch.getValue();
 		rendererDesc.swapchain.width       = windowWidthSwitch.getValue();
 		rendererDesc.swapchain.height      = windowHeightSwitch.getValue();
 		rendererDesc.swapchain.vsync       = noVsyncSwitch.getValue() ? VSync::Off : VSync::On;
+		rendererDesc.swapchain.framesInFlight = framesInFlightSwitch.getValue();
 		rendererDesc.vulkanDeviceFilter    = deviceSwitch.getValue();
+		rendererDesc.vulkanDeviceIndex     = deviceIndexSwitch.getValue();
+		listDevicesOnly                    = listDevicesSwitch.getValue();
 
 		fpsLimit = fpsSwitch.getValue();
+		justInTimePacing = paceSwitch.getValue();
+		onDemandRedraw   = onDemandSwitch.getValue();
+		if (dynamicResSwitch.getValue() > 0.0f) {
+			dynamicResolution = true;
+			targetGPUTime     = dynamicResSwitch.getValue();
+		}
+		smaaBudget       = std::max(0.0f, smaaBudgetSwitch.getValue());
 
 		unsigned int r = rotateSwitch.getValue();
 		if (r != 0) {
@@ -946,9 +2774,111 @@ void SMAADemo::parseCommandLine(int argc, char *argv[]) {
 
 		}
 
-		temporalAA = temporalAASwitch.getValue();
+		temporalAA  = temporalAASwitch.getValue();
+		compareMethods = compareSwitch.getValue();
+		{
+			std::string formatStr = temporalFormatSwitch.getValue();
+			std::transform(formatStr.begin(), formatStr.end(), formatStr.begin(), ::toupper);
+			for (unsigned int i = 0; i < numTemporalFormats; i++) {
+				if (formatStr == temporalFormatNames[i]) {
+					temporalFormat = i;
+					break;
+				}
+			}
+		}
+		temporalClamp = temporalClampSwitch.getValue();
+		depthVelocity = depthVelocitySwitch.getValue();
+		smaaCompute = smaaComputeSwitch.getValue();
+		smaaInPlaceBlend = smaaInPlaceSwitch.getValue();
+		halfPrecision = halfPrecisionSwitch.getValue();
+		fusedFXAA     = fusedFXAASwitch.getValue();
+		smaaSubgroupSearch = smaaSubgroupSwitch.getValue();
+		smaaScale   = std::max(minSMAAScale, std::min(smaaScaleSwitch.getValue(), 1.0f));
+		smaaStencil = !noSMAAStencilSwitch.getValue();
+		cubeCulling = !noCubeCullSwitch.getValue();
+		cubeAnimation = animateCubesSwitch.getValue();
+		proceduralCubes = proceduralCubesSwitch.getValue();
+		compactCubes    = compactCubesSwitch.getValue();
+		depthPrepass    = depthPrepassSwitch.getValue();
+		if (cubeLODSwitch.getValue() > 0.0f) {
+			cubeLOD       = true;
+			cubeLODPixels = cubeLODSwitch.getValue();
+		}
+		if (!sceneSwitch.getValue().empty()) {
+			sceneFile = std::make_unique<SceneFile>(sceneSwitch.getValue());
+			LOG("Scene \"%s\": %u meshes, %u instances\n", sceneSwitch.getValue().c_str(), sceneFile->getNumMeshes(), sceneFile->getNumInstances());
+		}
+		exportSceneFile = exportSceneSwitch.getValue();
+#ifndef IMGUI_DISABLE
+		guiOverlayRate  = std::max(0.0f, guiOverlaySwitch.getValue());
+		perfOverlay     = perfOverlaySwitch.getValue();
+#endif  // IMGUI_DISABLE
+		cpuTraceFile    = cpuTraceSwitch.getValue();
+		graphReportFile = graphReportSwitch.getValue();
+		if (!cpuTraceFile.empty()) {
+#ifdef CPU_PROFILER
+			profilerSetThreadName("main");
+			profilerSetEnabled(true);
+#else  // CPU_PROFILER
+			LOG("--cpu-trace needs CPU_PROFILER, ignored\n");
+			cpuTraceFile.clear();
+#endif  // CPU_PROFILER
+		}
+		if (sceneFile && !exportSceneFile.empty()) {
+			LOG("--export-scene writes the cube grid and can't be used with --scene\n");
+			exportSceneFile.clear();
+		}
 
 		imageFiles    = imagesArg.getValue();
+		imageMemoryBudget = uint64_t(imageMemorySwitch.getValue()) * 1024 * 1024;
+		tiledImages       = tiledImagesSwitch.getValue();
+		imagePageCacheMB  = std::max(1u, std::min(imagePageCacheSwitch.getValue(), maxImagePageCacheMB));
+		renderGraph.setRetainedBuilds(graphCacheSwitch.getValue());
+
+		benchmarkFile           = benchmarkSwitch.getValue();
+		benchmarkWarmupFrames   = benchWarmupSwitch.getValue();
+		benchmarkMeasuredFrames = std::max(1U, benchFramesSwitch.getValue());
+		benchmarkRebuildGraph   = benchRebuildSwitch.getValue();
+		benchmarkAllDevices     = benchAllDevicesSwitch.getValue();
+		benchmarkBaselineFile   = benchBaselineSwitch.getValue();
+		sweepFile               = sweepSwitch.getValue();
+		if (!benchmarkBaselineFile.empty() && !fileExists(benchmarkBaselineFile)) {
+			throw std::runtime_error("Benchmark baseline \"" + benchmarkBaselineFile + "\" not found");
+		}
+		if (!sweepFile.empty() && imageFiles.empty()) {
+			LOG("--quality-sweep needs images\n");
+			sweepFile.clear();
+		}
+		if (benchmarkAllDevices && (benchmarkFile.empty() || !sweepFile.empty())) {
+			LOG("--benchmark-all-devices needs --benchmark and can't be used with --quality-sweep\n");
+			benchmarkAllDevices = false;
+		}
+		if (benchmarkActive()) {
+			// measure the GPU, not the display
+			rendererDesc.swapchain.vsync = VSync::Off;
+			fpsLimitActive               = false;
+		}
+
+		if (fixedTimestepSwitch.getValue() > 0.0f) {
+			fixedTimestep = static_cast<uint64_t>(double(fixedTimestepSwitch.getValue()) * 1000000.0);
+		} else if (benchmarkActive() && sceneFile) {
+			fixedTimestep = sceneBenchmarkStep;
+		}
+		fixedSeed  = seedSwitch.isSet();
+		randomSeed = seedSwitch.getValue();
+
+		assertNoAllocations        = assertNoAllocSwitch.getValue();
+#ifndef ALLOCATION_TRACKING
+		if (assertNoAllocations) {
+			LOG("--assert-no-allocations does nothing without ALLOCATION_TRACKING\n");
+		}
+#endif  // ALLOCATION_TRACKING
+
+		rendererDesc.captureFile   = captureSwitch.getValue();
+		rendererDesc.captureFrames = std::max(1U, captureFramesSwitch.getValue());
+		replayFile                 = replaySwitch.getValue();
+		replayFrame                = replayFrameSwitch.getValue();
+		replayLoops                = std::max(1U, replayLoopsSwitch.getValue());
 
 	} catch (TCLAP::ArgException &e) {
 		LOG("parseCommandLine exception: %s for arg %s\n", e.error().c_str(), e.argId().c_str());
@@ -970,17 +2900,16 @@ struct GlobalDS {
 
 
 const DescriptorLayout GlobalDS::layout[] = {
-	  { DescriptorType::UniformBuffer,  offsetof(GlobalDS, globalUniforms) }
-	, { DescriptorType::Sampler,        offsetof(GlobalDS, linearSampler ) }
-	, { DescriptorType::Sampler,        offsetof(GlobalDS, nearestSampler) }
-	, { DescriptorType::End,            0                                  }
+	  { DescriptorType::UniformBufferDynamic, offsetof(GlobalDS, globalUniforms) }
+	, { DescriptorType::Sampler,              offsetof(GlobalDS, linearSampler ) }
+	, { DescriptorType::Sampler,              offsetof(GlobalDS, nearestSampler) }
+	, { DescriptorType::End,                  0                                  }
 };
 
 DSLayoutHandle GlobalDS::layoutHandle;
 
 
 struct CubeSceneDS {
-	BufferHandle unused;
 	BufferHandle instances;
 
 	static const DescriptorLayout layout[];
@@ -989,148 +2918,525 @@ struct CubeSceneDS {
 
 
 const DescriptorLayout CubeSceneDS::layout[] = {
-	  { DescriptorType::UniformBuffer,  offsetof(CubeSceneDS, unused)    }
-	, { DescriptorType::StorageBuffer,  offsetof(CubeSceneDS, instances) }
-	, { DescriptorType::End,            0                                }
+	  { DescriptorType::Empty,                0                                }
+	, { DescriptorType::StorageBufferDynamic, offsetof(CubeSceneDS, instances) }
+	, { DescriptorType::End,                  0                                }
 };
 
 DSLayoutHandle CubeSceneDS::layoutHandle;
 
 
-struct ColorCombinedDS {
-	BufferHandle unused;
-	CSampler color;
+struct CubeSceneCulledDS {
+	BufferHandle instances;
+	BufferHandle visible;
 
 	static const DescriptorLayout layout[];
 	static DSLayoutHandle layoutHandle;
 };
 
 
-const DescriptorLayout ColorCombinedDS::layout[] = {
-	  { DescriptorType::UniformBuffer,    offsetof(ColorCombinedDS, unused) }
-	, { DescriptorType::CombinedSampler,  offsetof(ColorCombinedDS, color)  }
-	, { DescriptorType::End,              0,                                }
+const DescriptorLayout CubeSceneCulledDS::layout[] = {
+	  { DescriptorType::Empty,                0                                      }
+	, { DescriptorType::StorageBufferDynamic, offsetof(CubeSceneCulledDS, instances) }
+	, { DescriptorType::StorageBuffer,        offsetof(CubeSceneCulledDS, visible)   }
+	, { DescriptorType::End,                  0                                      }
 };
 
-DSLayoutHandle ColorCombinedDS::layoutHandle;
+DSLayoutHandle CubeSceneCulledDS::layoutHandle;
 
 
-struct ColorTexDS {
-	BufferHandle unused;
-	TextureHandle color;
+struct CubeCullDS {
+	BufferHandle cullUBO;
+	BufferHandle instances;
+	BufferHandle visible;
+	BufferHandle drawArgs;
+	BufferHandle impostors;
+	BufferHandle impostorArgs;
 
 	static const DescriptorLayout layout[];
 	static DSLayoutHandle layoutHandle;
 };
 
 
-const DescriptorLayout ColorTexDS::layout[] = {
-	  { DescriptorType::UniformBuffer,  offsetof(ColorTexDS, unused) }
-	, { DescriptorType::Texture,        offsetof(ColorTexDS, color)  }
-	, { DescriptorType::End,            0,                           }
+const DescriptorLayout CubeCullDS::layout[] = {
+	  { DescriptorType::UniformBufferDynamic, offsetof(CubeCullDS, cullUBO)   }
+	, { DescriptorType::StorageBufferDynamic, offsetof(CubeCullDS, instances) }
+	, { DescriptorType::StorageBuffer,        offsetof(CubeCullDS, visible)   }
+	, { DescriptorType::StorageBuffer,        offsetof(CubeCullDS, drawArgs)  }
+	, { DescriptorType::StorageBuffer,        offsetof(CubeCullDS, impostors) }
+	, { DescriptorType::StorageBuffer,        offsetof(CubeCullDS, impostorArgs) }
+	, { DescriptorType::End,                  0                               }
 };
 
-DSLayoutHandle ColorTexDS::layoutHandle;
+DSLayoutHandle CubeCullDS::layoutHandle;
 
 
-struct EdgeDetectionDS {
-	BufferHandle  smaaUBO;
-	CSampler color;
-	CSampler predicationTex;
+struct CubeAnimateDS {
+	BufferHandle animateUBO;
+	BufferHandle instances;
+	BufferHandle animated;
 
 	static const DescriptorLayout layout[];
 	static DSLayoutHandle layoutHandle;
 };
 
 
-const DescriptorLayout EdgeDetectionDS::layout[] = {
-	  { DescriptorType::UniformBuffer,    offsetof(EdgeDetectionDS, smaaUBO)        }
-	, { DescriptorType::CombinedSampler,  offsetof(EdgeDetectionDS, color)          }
-	, { DescriptorType::CombinedSampler,  offsetof(EdgeDetectionDS, predicationTex) }
-	, { DescriptorType::End,              0,                                        }
+const DescriptorLayout CubeAnimateDS::layout[] = {
+	  { DescriptorType::UniformBufferDynamic, offsetof(CubeAnimateDS, animateUBO) }
+	, { DescriptorType::StorageBufferDynamic, offsetof(CubeAnimateDS, instances)  }
+	, { DescriptorType::StorageBuffer,        offsetof(CubeAnimateDS, animated)   }
+	, { DescriptorType::End,                  0                                   }
 };
 
-DSLayoutHandle EdgeDetectionDS::layoutHandle;
+DSLayoutHandle CubeAnimateDS::layoutHandle;
 
 
-struct BlendWeightDS {
-	BufferHandle  smaaUBO;
-	CSampler edgesTex;
-	CSampler areaTex;
-	CSampler searchTex;
+struct ColorCombinedDS {
+	CSampler color;
 
 	static const DescriptorLayout layout[];
 	static DSLayoutHandle layoutHandle;
 };
 
 
-const DescriptorLayout BlendWeightDS::layout[] = {
-	  { DescriptorType::UniformBuffer,    offsetof(BlendWeightDS, smaaUBO)   }
-	, { DescriptorType::CombinedSampler,  offsetof(BlendWeightDS, edgesTex)  }
-	, { DescriptorType::CombinedSampler,  offsetof(BlendWeightDS, areaTex)   }
-	, { DescriptorType::CombinedSampler,  offsetof(BlendWeightDS, searchTex) }
-	, { DescriptorType::End,              0,                                 }
+const DescriptorLayout ColorCombinedDS::layout[] = {
+	  { DescriptorType::Empty,                0                                 }
+	, { DescriptorType::CombinedSampler,      offsetof(ColorCombinedDS, color)  }
+	, { DescriptorType::End,                  0,                                }
 };
 
-DSLayoutHandle BlendWeightDS::layoutHandle;
+DSLayoutHandle ColorCombinedDS::layoutHandle;
 
 
-struct NeighborBlendDS {
-	BufferHandle  smaaUBO;
-	CSampler color;
-	CSampler blendweights;
+struct ColorTexDS {
+	TextureHandle color;
 
 	static const DescriptorLayout layout[];
 	static DSLayoutHandle layoutHandle;
 };
 
 
-const DescriptorLayout NeighborBlendDS::layout[] = {
-	  { DescriptorType::UniformBuffer,    offsetof(NeighborBlendDS, smaaUBO)      }
-	, { DescriptorType::CombinedSampler,  offsetof(NeighborBlendDS, color)        }
-	, { DescriptorType::CombinedSampler,  offsetof(NeighborBlendDS, blendweights) }
-	, { DescriptorType::End,              0                                       }
+const DescriptorLayout ColorTexDS::layout[] = {
+	  { DescriptorType::Empty,                0                            }
+	, { DescriptorType::Texture,              offsetof(ColorTexDS, color)  }
+	, { DescriptorType::End,                  0,                           }
 };
 
-DSLayoutHandle NeighborBlendDS::layoutHandle;
+DSLayoutHandle ColorTexDS::layoutHandle;
 
 
-struct TemporalAADS {
-	BufferHandle  smaaUBO;
-	CSampler currentTex;
-	CSampler previousTex;
-	CSampler velocityTex;
+struct TiledImageDS {
+	BufferHandle tiledUBO;
+	BufferHandle pageTable;
+	BufferHandle pageCache;
 
 	static const DescriptorLayout layout[];
 	static DSLayoutHandle layoutHandle;
 };
 
 
-const DescriptorLayout TemporalAADS::layout[] = {
-	  { DescriptorType::UniformBuffer,    offsetof(TemporalAADS, smaaUBO)     }
-	, { DescriptorType::CombinedSampler,  offsetof(TemporalAADS, currentTex)  }
-	, { DescriptorType::CombinedSampler,  offsetof(TemporalAADS, previousTex) }
-	, { DescriptorType::CombinedSampler,  offsetof(TemporalAADS, velocityTex) }
-	, { DescriptorType::End,              0                                   }
+const DescriptorLayout TiledImageDS::layout[] = {
+	  { DescriptorType::UniformBufferDynamic, offsetof(TiledImageDS, tiledUBO)  }
+	, { DescriptorType::StorageBuffer,        offsetof(TiledImageDS, pageTable) }
+	, { DescriptorType::StorageBuffer,        offsetof(TiledImageDS, pageCache) }
+	, { DescriptorType::End,                  0                                 }
 };
 
-DSLayoutHandle TemporalAADS::layoutHandle;
+DSLayoutHandle TiledImageDS::layoutHandle;
 
 
+// every texture at once, shaders take an index from push constants
+struct TextureTableDS {
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
 
-static const int numDepths = 5;
-static const std::array<Format, numDepths> depths
-  = { { Format::Depth24X8, Format::Depth24S8, Format::Depth32Float, Format::Depth16, Format::Depth16S8 } };
 
+const DescriptorLayout TextureTableDS::layout[] = {
+	  { DescriptorType::TextureTable,         0  }
+	, { DescriptorType::End,                  0, }
+};
 
-void SMAADemo::initRender() {
-	renderer = Renderer::createRenderer(rendererDesc);
-	renderSize = renderer.getDrawableSize();
-	const auto &features = renderer.getFeatures();
-	LOG("Max MSAA samples: %u\n",  features.maxMSAASamples);
-	LOG("sRGB frame buffer: %s\n", features.sRGBFramebuffer ? "yes" : "no");
-	LOG("SSBO support: %s\n",      features.SSBOSupported ? "yes" : "no");
-	maxMSAAQuality = msaaSamplesToQuality(features.maxMSAASamples) + 1;
+DSLayoutHandle TextureTableDS::layoutHandle;
+
+
+struct EdgeDetectionDS {
+	CSampler color;
+	CSampler predicationTex;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout EdgeDetectionDS::layout[] = {
+	  { DescriptorType::Empty,                0                                         }
+	, { DescriptorType::CombinedSampler,      offsetof(EdgeDetectionDS, color)          }
+	, { DescriptorType::CombinedSampler,      offsetof(EdgeDetectionDS, predicationTex) }
+	, { DescriptorType::End,                  0,                                        }
+};
+
+DSLayoutHandle EdgeDetectionDS::layoutHandle;
+
+
+struct BlendWeightDS {
+	CSampler edgesTex;
+	CSampler areaTex;
+	CSampler searchTex;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout BlendWeightDS::layout[] = {
+	  { DescriptorType::Empty,                0                                  }
+	, { DescriptorType::CombinedSampler,      offsetof(BlendWeightDS, edgesTex)  }
+	, { DescriptorType::CombinedSampler,      offsetof(BlendWeightDS, areaTex)   }
+	, { DescriptorType::CombinedSampler,      offsetof(BlendWeightDS, searchTex) }
+	, { DescriptorType::End,                  0,                                 }
+};
+
+DSLayoutHandle BlendWeightDS::layoutHandle;
+
+
+struct SMAA2XBlendWeightDS {
+	CSampler edgesTex;
+	CSampler areaTex;
+	CSampler searchTex;
+	CSampler edgesTex2;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout SMAA2XBlendWeightDS::layout[] = {
+	  { DescriptorType::Empty,                0                                         }
+	, { DescriptorType::CombinedSampler,      offsetof(SMAA2XBlendWeightDS, edgesTex)   }
+	, { DescriptorType::CombinedSampler,      offsetof(SMAA2XBlendWeightDS, areaTex)    }
+	, { DescriptorType::CombinedSampler,      offsetof(SMAA2XBlendWeightDS, searchTex)  }
+	, { DescriptorType::CombinedSampler,      offsetof(SMAA2XBlendWeightDS, edgesTex2)  }
+	, { DescriptorType::End,                  0,                                        }
+};
+
+DSLayoutHandle SMAA2XBlendWeightDS::layoutHandle;
+
+
+struct EdgeDetectionComputeDS {
+	CSampler       color;
+	CSampler       predicationTex;
+	TextureHandle  edgesImage;
+	TextureHandle  blendWeightsImage;
+	BufferHandle   tileList;
+	BufferHandle   tileDraw;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout EdgeDetectionComputeDS::layout[] = {
+	  { DescriptorType::Empty,                0                                                   }
+	, { DescriptorType::CombinedSampler,      offsetof(EdgeDetectionComputeDS, color)             }
+	, { DescriptorType::CombinedSampler,      offsetof(EdgeDetectionComputeDS, predicationTex)    }
+	, { DescriptorType::StorageImage,         offsetof(EdgeDetectionComputeDS, edgesImage)        }
+	, { DescriptorType::StorageImage,         offsetof(EdgeDetectionComputeDS, blendWeightsImage) }
+	, { DescriptorType::StorageBuffer,        offsetof(EdgeDetectionComputeDS, tileList)          }
+	, { DescriptorType::StorageBuffer,        offsetof(EdgeDetectionComputeDS, tileDraw)          }
+	, { DescriptorType::End,                  0,                                                  }
+};
+
+DSLayoutHandle EdgeDetectionComputeDS::layoutHandle;
+
+
+struct BlendWeightComputeDS {
+	CSampler       edgesTex;
+	CSampler       areaTex;
+	CSampler       searchTex;
+	TextureHandle  blendWeightsImage;
+	BufferHandle   tileList;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout BlendWeightComputeDS::layout[] = {
+	  { DescriptorType::Empty,                0                                                 }
+	, { DescriptorType::CombinedSampler,      offsetof(BlendWeightComputeDS, edgesTex)          }
+	, { DescriptorType::CombinedSampler,      offsetof(BlendWeightComputeDS, areaTex)           }
+	, { DescriptorType::CombinedSampler,      offsetof(BlendWeightComputeDS, searchTex)         }
+	, { DescriptorType::StorageImage,         offsetof(BlendWeightComputeDS, blendWeightsImage) }
+	, { DescriptorType::StorageBuffer,        offsetof(BlendWeightComputeDS, tileList)          }
+	, { DescriptorType::End,                  0,                                                }
+};
+
+DSLayoutHandle BlendWeightComputeDS::layoutHandle;
+
+
+struct NeighborBlendDS {
+	CSampler color;
+	CSampler blendweights;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout NeighborBlendDS::layout[] = {
+	  { DescriptorType::Empty,                0                                       }
+	, { DescriptorType::CombinedSampler,      offsetof(NeighborBlendDS, color)        }
+	, { DescriptorType::CombinedSampler,      offsetof(NeighborBlendDS, blendweights) }
+	, { DescriptorType::End,                  0                                       }
+};
+
+DSLayoutHandle NeighborBlendDS::layoutHandle;
+
+
+// color is the multisampled MainColor
+struct SMAA2XNeighborBlendDS {
+	CSampler color;
+	CSampler blendweights;
+	CSampler blendweights2;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout SMAA2XNeighborBlendDS::layout[] = {
+	  { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::CombinedSampler,      offsetof(SMAA2XNeighborBlendDS, color)         }
+	, { DescriptorType::CombinedSampler,      offsetof(SMAA2XNeighborBlendDS, blendweights)  }
+	, { DescriptorType::CombinedSampler,      offsetof(SMAA2XNeighborBlendDS, blendweights2) }
+	, { DescriptorType::End,                  0                                              }
+};
+
+DSLayoutHandle SMAA2XNeighborBlendDS::layoutHandle;
+
+
+struct NeighborBlendTilesDS {
+	CSampler     color;
+	CSampler     blendweights;
+	BufferHandle tileList;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+// same bindings as the compute SMAA passes
+const DescriptorLayout NeighborBlendTilesDS::layout[] = {
+	  { DescriptorType::Empty,                0                                            }
+	, { DescriptorType::CombinedSampler,      offsetof(NeighborBlendTilesDS, color)        }
+	, { DescriptorType::CombinedSampler,      offsetof(NeighborBlendTilesDS, blendweights) }
+	, { DescriptorType::Empty,                0                                            }
+	, { DescriptorType::Empty,                0                                            }
+	, { DescriptorType::StorageBuffer,        offsetof(NeighborBlendTilesDS, tileList)     }
+	, { DescriptorType::End,                  0                                            }
+};
+
+DSLayoutHandle NeighborBlendTilesDS::layoutHandle;
+
+
+struct NeighborBlendComputeDS {
+	CSampler     color;
+	CSampler     blendweights;
+	BufferHandle tileList;
+	BufferHandle blendColors;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout NeighborBlendComputeDS::layout[] = {
+	  { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::CombinedSampler,      offsetof(NeighborBlendComputeDS, color)        }
+	, { DescriptorType::CombinedSampler,      offsetof(NeighborBlendComputeDS, blendweights) }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::StorageBuffer,        offsetof(NeighborBlendComputeDS, tileList)     }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::StorageBuffer,        offsetof(NeighborBlendComputeDS, blendColors)  }
+	, { DescriptorType::End,                  0                                              }
+};
+
+DSLayoutHandle NeighborBlendComputeDS::layoutHandle;
+
+
+// the tile draw which copies NeighborBlendComputeDS results into the scene color
+struct NeighborBlendInPlaceDS {
+	BufferHandle tileList;
+	BufferHandle blendColors;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout NeighborBlendInPlaceDS::layout[] = {
+	  { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::StorageBuffer,        offsetof(NeighborBlendInPlaceDS, tileList)     }
+	, { DescriptorType::Empty,                0                                              }
+	, { DescriptorType::StorageBuffer,        offsetof(NeighborBlendInPlaceDS, blendColors)  }
+	, { DescriptorType::End,                  0                                              }
+};
+
+DSLayoutHandle NeighborBlendInPlaceDS::layoutHandle;
+
+
+struct TemporalAADS {
+	CSampler currentTex;
+	CSampler previousTex;
+	CSampler velocityTex;
+
+	static const DescriptorLayout layout[];
+	static DSLayoutHandle layoutHandle;
+};
+
+
+const DescriptorLayout TemporalAADS::layout[] = {
+	  { DescriptorType::Empty,                0                                   }
+	, { DescriptorType::CombinedSampler,      offsetof(TemporalAADS, currentTex)  }
+	, { DescriptorType::CombinedSampler,      offsetof(TemporalAADS, previousTex) }
+	, { DescriptorType::CombinedSampler,      offsetof(TemporalAADS, velocityTex) }
+	, { DescriptorType::End,                  0                                   }
+};
+
+DSLayoutHandle TemporalAADS::layoutHandle;
+
+
+
+static const int numDepths = 5;
+static const std::array<Format, numDepths> depths
+  = { { Format::Depth24X8, Format::Depth24S8, Format::Depth32Float, Format::Depth16, Format::Depth16S8 } };
+
+
+static const int numStencils = 2;
+static const std::array<Format, numStencils> stencils
+  = { { Format::Depth24S8, Format::Depth16S8 } };
+
+
+void SMAADemo::replayCapture() {
+	// the capture decides what gets rendered, the demo only provides the window
+	rendererDesc.swapchain.vsync = VSync::Off;
+	renderer = Renderer::createRenderer(rendererDesc);
+
+	CaptureReplay replay(replayFile);
+	LOG("Replaying frame %u of %u from \"%s\" %u times\n", replayFrame, replay.numFrames(), replayFile.c_str(), replayLoops);
+	auto times = replay.replay(renderer, replayFrame, replayLoops);
+
+	uint64_t total = 0;
+	for (uint64_t t : times) {
+		total += t;
+	}
+	std::sort(times.begin(), times.end());
+	LOG("Replay frame times: average %.3f ms, median %.3f ms, min %.3f ms, max %.3f ms\n"
+	   , double(total) / times.size() / 1000000.0
+	   , double(times[times.size() / 2]) / 1000000.0
+	   , double(times.front()) / 1000000.0
+	   , double(times.back()) / 1000000.0);
+}
+
+
+void SMAADemo::initRender() {
+	// work which doesn't need the device runs on jobSystem while it's created
+	images.reserve(imageFiles.size());
+	for (const auto &filename : imageFiles) {
+		loadImage(filename);
+	}
+	if (isImageScene()) {
+		requestImage(activeScene - 1);
+	}
+
+#ifndef IMGUI_DISABLE
+	unsigned char *guiPixels = nullptr;
+	int guiWidth = 0, guiHeight = 0;
+	JobCounter guiFontJob;
+	jobSystem.run(&guiFontJob, [&] () {
+		imGuiContext = ImGui::CreateContext();
+		ImGuiIO& io = ImGui::GetIO();
+		io.IniFilename                 = nullptr;
+		io.KeyMap[ImGuiKey_Tab]        = SDL_SCANCODE_TAB;                     // Keyboard mapping. ImGui will use those indices to peek into the io.KeyDown[] array.
+		io.KeyMap[ImGuiKey_LeftArrow]  = SDL_SCANCODE_LEFT;
+		io.KeyMap[ImGuiKey_RightArrow] = SDL_SCANCODE_RIGHT;
+		io.KeyMap[ImGuiKey_UpArrow]    = SDL_SCANCODE_UP;
+		io.KeyMap[ImGuiKey_DownArrow]  = SDL_SCANCODE_DOWN;
+		io.KeyMap[ImGuiKey_PageUp]     = SDL_SCANCODE_PAGEUP;
+		io.KeyMap[ImGuiKey_PageDown]   = SDL_SCANCODE_PAGEDOWN;
+		io.KeyMap[ImGuiKey_Home]       = SDL_SCANCODE_HOME;
+		io.KeyMap[ImGuiKey_End]        = SDL_SCANCODE_END;
+		io.KeyMap[ImGuiKey_Delete]     = SDL_SCANCODE_DELETE;
+		io.KeyMap[ImGuiKey_Backspace]  = SDL_SCANCODE_BACKSPACE;
+		io.KeyMap[ImGuiKey_Enter]      = SDL_SCANCODE_RETURN;
+		io.KeyMap[ImGuiKey_Escape]     = SDL_SCANCODE_ESCAPE;
+		io.KeyMap[ImGuiKey_A]          = SDL_SCANCODE_A;
+		io.KeyMap[ImGuiKey_C]          = SDL_SCANCODE_C;
+		io.KeyMap[ImGuiKey_V]          = SDL_SCANCODE_V;
+		io.KeyMap[ImGuiKey_X]          = SDL_SCANCODE_X;
+		io.KeyMap[ImGuiKey_Y]          = SDL_SCANCODE_Y;
+		io.KeyMap[ImGuiKey_Z]          = SDL_SCANCODE_Z;
+
+		// TODO: clipboard
+		io.SetClipboardTextFn = SetClipboardText;
+		io.GetClipboardTextFn = GetClipboardText;
+		io.ClipboardUserData  = clipboardText;
+
+		// the font is white so only coverage is stored, gui.frag expands it
+		io.Fonts->GetTexDataAsAlpha8(&guiPixels, &guiWidth, &guiHeight);
+	} );
+#endif  // IMGUI_DISABLE
+
+	try {
+		renderer = Renderer::createRenderer(rendererDesc);
+	} catch (...) {
+#ifndef IMGUI_DISABLE
+		// the job writes to locals
+		jobSystem.wait(guiFontJob);
+#endif  // IMGUI_DISABLE
+		throw;
+	}
+	startupPhase("renderer");
+	renderSize = renderer.getDrawableSize();
+	const auto &features = renderer.getFeatures();
+	LOG("Max MSAA samples: %u\n",  features.maxMSAASamples);
+	LOG("sRGB frame buffer: %s\n", features.sRGBFramebuffer ? "yes" : "no");
+	LOG("SSBO support: %s\n",      features.SSBOSupported ? "yes" : "no");
+	LOG("Compute shaders: %s\n",   features.computeShaders ? "yes" : "no");
+	LOG("Texture table: %s\n",     features.textureTable ? "yes" : "no");
+	LOG("Half precision: %s\n",    features.halfPrecision ? "yes" : "no");
+	LOG("Subgroup ballot: %s\n",   features.subgroupBallot ? "yes" : "no");
+	if (smaaCompute && !features.computeShaders) {
+		LOG("Compute shaders not supported, using fragment shader SMAA\n");
+		smaaCompute = false;
+	}
+	if (smaaSubgroupSearch && !features.subgroupBallot) {
+		LOG("Subgroup ballot not supported, using texture SMAA searches\n");
+		smaaSubgroupSearch = false;
+	}
+	if (halfPrecision && !features.halfPrecision) {
+		LOG("Half precision not supported, using full precision shaders\n");
+		halfPrecision = false;
+	}
+	if (renderer.isRenderTargetFormatSupported(Format::RG8)) {
+		smaaEdgesFormat = Format::RG8;
+	}
+	LOG("SMAA edges format: %s\n", smaaEdgesFormat._to_string());
+	if (cubeCulling && !features.computeShaders) {
+		LOG("Compute shaders not supported, not culling cubes\n");
+		cubeCulling = false;
+	}
+	if (cubeAnimation && !features.computeShaders) {
+		LOG("Compute shaders not supported, not animating cubes\n");
+		cubeAnimation = false;
+	}
+	maxMSAAQuality = msaaSamplesToQuality(features.maxMSAASamples) + 1;
 	if (msaaQuality >= maxMSAAQuality) {
 		msaaQuality = maxMSAAQuality - 1;
 	}
@@ -1162,21 +3468,54 @@ void SMAADemo::initRender() {
 	}
 	LOG("Using depth format %s\n", depthFormat._to_string());
 
+	if (smaaStencil) {
+		for (auto stencil : stencils) {
+			if (renderer.isRenderTargetFormatSupported(stencil)) {
+				stencilFormat = stencil;
+				break;
+			}
+		}
+		if (stencilFormat == +Format::Invalid) {
+			LOG("No supported stencil formats, not using stencil in SMAA\n");
+			smaaStencil = false;
+		} else {
+			LOG("Using stencil format %s\n", stencilFormat._to_string());
+		}
+	}
+
 	renderer.registerDescriptorSetLayout<GlobalDS>();
 	renderer.registerDescriptorSetLayout<CubeSceneDS>();
+	renderer.registerDescriptorSetLayout<CubeSceneCulledDS>();
+	renderer.registerDescriptorSetLayout<CubeCullDS>();
+	renderer.registerDescriptorSetLayout<CubeAnimateDS>();
 	renderer.registerDescriptorSetLayout<ColorCombinedDS>();
 	renderer.registerDescriptorSetLayout<ColorTexDS>();
+	renderer.registerDescriptorSetLayout<TiledImageDS>();
 	renderer.registerDescriptorSetLayout<EdgeDetectionDS>();
 	renderer.registerDescriptorSetLayout<BlendWeightDS>();
+	renderer.registerDescriptorSetLayout<EdgeDetectionComputeDS>();
+	renderer.registerDescriptorSetLayout<BlendWeightComputeDS>();
 	renderer.registerDescriptorSetLayout<NeighborBlendDS>();
+	renderer.registerDescriptorSetLayout<NeighborBlendTilesDS>();
+	renderer.registerDescriptorSetLayout<NeighborBlendComputeDS>();
+	renderer.registerDescriptorSetLayout<NeighborBlendInPlaceDS>();
+	renderer.registerDescriptorSetLayout<SMAA2XBlendWeightDS>();
+	renderer.registerDescriptorSetLayout<SMAA2XNeighborBlendDS>();
 	renderer.registerDescriptorSetLayout<TemporalAADS>();
+	if (features.textureTable) {
+		renderer.registerDescriptorSetLayout<TextureTableDS>();
+	}
 
-	linearSampler  = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Linear). magFilter(FilterMode::Linear) .name("linear"));
+	linearSampler  = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Linear). magFilter(FilterMode::Linear).mipFilter(FilterMode::Linear) .name("linear"));
 	nearestSampler = renderer.createSampler(SamplerDesc().minFilter(FilterMode::Nearest).magFilter(FilterMode::Nearest).name("nearest"));
 
 	cubeVBO = renderer.createBuffer(BufferType::Vertex, sizeof(vertices), &vertices[0]);
 	cubeIBO = renderer.createBuffer(BufferType::Index, sizeof(indices), &indices[0]);
 
+	if (sceneFile) {
+		createSceneBuffers();
+	}
+
 #ifdef RENDERER_OPENGL
 
 	const bool flipSMAATextures = true;
@@ -1225,56 +3564,90 @@ void SMAADemo::initRender() {
 		searchTex = renderer.createTexture(texDesc);
 	}
 
-	images.reserve(imageFiles.size());
-	for (const auto &filename : imageFiles) {
-		loadImage(filename);
+	{
+		// opaque mid gray
+		const uint32_t placeholderPixel = 0xFF808080;
+
+		TextureDesc placeholderDesc;
+		placeholderDesc.width(1)
+		               .height(1)
+		               .format(Format::sRGBA8)
+		               .name("image placeholder");
+		placeholderDesc.mipLevelData(0, &placeholderPixel, sizeof(placeholderPixel));
+		placeholderTex = renderer.createTexture(placeholderDesc);
 	}
 
+	LOG("CPU is %s\n", describeCPUTopology().c_str());
+	LOG("Using %u worker threads and %u background threads\n", jobSystem.numThreads(), jobSystem.numBackgroundThreads());
+
 #ifndef IMGUI_DISABLE
-	// imgui setup
-	{
-		imGuiContext = ImGui::CreateContext();
-		ImGuiIO& io = ImGui::GetIO();
-		io.IniFilename                 = nullptr;
-		io.KeyMap[ImGuiKey_Tab]        = SDL_SCANCODE_TAB;                     // Keyboard mapping. ImGui will use those indices to peek into the io.KeyDown[] array.
-		io.KeyMap[ImGuiKey_LeftArrow]  = SDL_SCANCODE_LEFT;
-		io.KeyMap[ImGuiKey_RightArrow] = SDL_SCANCODE_RIGHT;
-		io.KeyMap[ImGuiKey_UpArrow]    = SDL_SCANCODE_UP;
-		io.KeyMap[ImGuiKey_DownArrow]  = SDL_SCANCODE_DOWN;
-		io.KeyMap[ImGuiKey_PageUp]     = SDL_SCANCODE_PAGEUP;
-		io.KeyMap[ImGuiKey_PageDown]   = SDL_SCANCODE_PAGEDOWN;
-		io.KeyMap[ImGuiKey_Home]       = SDL_SCANCODE_HOME;
-		io.KeyMap[ImGuiKey_End]        = SDL_SCANCODE_END;
-		io.KeyMap[ImGuiKey_Delete]     = SDL_SCANCODE_DELETE;
-		io.KeyMap[ImGuiKey_Backspace]  = SDL_SCANCODE_BACKSPACE;
-		io.KeyMap[ImGuiKey_Enter]      = SDL_SCANCODE_RETURN;
-		io.KeyMap[ImGuiKey_Escape]     = SDL_SCANCODE_ESCAPE;
-		io.KeyMap[ImGuiKey_A]          = SDL_SCANCODE_A;
-		io.KeyMap[ImGuiKey_C]          = SDL_SCANCODE_C;
-		io.KeyMap[ImGuiKey_V]          = SDL_SCANCODE_V;
-		io.KeyMap[ImGuiKey_X]          = SDL_SCANCODE_X;
-		io.KeyMap[ImGuiKey_Y]          = SDL_SCANCODE_Y;
-		io.KeyMap[ImGuiKey_Z]          = SDL_SCANCODE_Z;
+	jobSystem.wait(guiFontJob);
+
+	texDesc.width(guiWidth)
+	       .height(guiHeight)
+	       .format(Format::R8)
+	       .name("GUI")
+	       .mipLevelData(0, guiPixels, guiWidth * guiHeight);
+	imguiFontsTex = renderer.createTexture(texDesc);
+	ImGui::GetIO().Fonts->TexID = nullptr;
+#endif  // IMGUI_DISABLE
 
-		// TODO: clipboard
-		io.SetClipboardTextFn = SetClipboardText;
-		io.GetClipboardTextFn = GetClipboardText;
-		io.ClipboardUserData  = clipboardText;
+	startupPhase("resources");
+
+	if (benchmarkActive()) {
+		BenchmarkConfig config;
+		// baseline without AA first
+		benchmarkConfigs.push_back(config);
+
+		config.antialiasing = true;
+		for (AAMethod m : AAMethod::_values()) {
+			config.method = m;
+			switch (m) {
+			case AAMethod::MSAA:
+				if (features.maxMSAASamples > 1) {
+					for (unsigned int q = 0; q < maxMSAAQuality; q++) {
+						config.quality = q;
+						benchmarkConfigs.push_back(config);
+					}
+				}
+				break;
 
-		// Build texture atlas
-		unsigned char *pixels = nullptr;
-		int width = 0, height = 0;
-		io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+			case AAMethod::FXAA:
+				for (unsigned int q = 0; q < maxFXAAQuality; q++) {
+					config.quality = q;
+					benchmarkConfigs.push_back(config);
+				}
+				break;
+
+			case AAMethod::SMAA2X:
+				if (features.maxMSAASamples < 2) {
+					break;
+				}
+				// fallthrough
+			case AAMethod::SMAA:
+				// skip CUSTOM, it's whatever the defaults are
+				for (unsigned int q = 1; q < maxSMAAQuality; q++) {
+					config.quality = q;
+					benchmarkConfigs.push_back(config);
+				}
+				break;
+			}
+		}
+
+		LOG("Benchmarking %u configurations, %u warm-up and %u measured frames each\n", static_cast<unsigned int>(benchmarkConfigs.size()), benchmarkWarmupFrames, benchmarkMeasuredFrames);
+
+		if (!sweepFile.empty()) {
+			LOG("Quality sweep image 1/%u: %s\n", static_cast<unsigned int>(images.size()), images.at(0).shortName.c_str());
+			sweepImage  = 0;
+			activeScene = 1;
+			sweepThread = std::thread(&SMAADemo::sweepThreadFunc, this);
+		}
+
+		powerMonitor.reset(new PowerMonitor());
 
-		texDesc.width(width)
-		       .height(height)
-		       .format(Format::sRGBA8)
-		       .name("GUI")
-		       .mipLevelData(0, pixels, width * height * 4);
-		imguiFontsTex = renderer.createTexture(texDesc);
-		io.Fonts->TexID = nullptr;
+		benchmarkCurrentConfig = 0;
+		applyBenchmarkConfig();
 	}
-#endif  // IMGUI_DISABLE
 }
 
 
@@ -1289,9 +3662,53 @@ void SMAADemo::rebuildRenderGraph() {
 		temporalRTs[1] = RenderTargetHandle();
 	}
 
-	renderGraph.reset(renderer, std::bind(std::mem_fn(&SMAADemo::processInput), this));
+	renderGraph.reset(renderer);
+
+#ifndef IMGUI_DISABLE
+	deleteGUIOverlay();
+#endif  // IMGUI_DISABLE
+
+	// deletion is deferred until the GPU is done with it
+	if (staticGlobals) {
+		renderer.deleteBuffer(staticGlobals);
+		staticGlobals = BufferHandle();
+	}
+
+	if (smaaTileBuffer) {
+		renderer.deleteBuffer(smaaTileBuffer);
+		smaaTileBuffer = BufferHandle();
+
+		renderer.deleteBuffer(smaaTileDrawBuffer);
+		smaaTileDrawBuffer = BufferHandle();
+	}
+
+	if (smaaBlendColorBuffer) {
+		renderer.deleteBuffer(smaaBlendColorBuffer);
+		smaaBlendColorBuffer = BufferHandle();
+	}
+
+	if (cubeVisibleBuffer) {
+		renderer.deleteBuffer(cubeVisibleBuffer);
+		cubeVisibleBuffer = BufferHandle();
+
+		renderer.deleteBuffer(cubeDrawArgsBuffer);
+		cubeDrawArgsBuffer = BufferHandle();
+
+		renderer.deleteBuffer(cubeImpostorBuffer);
+		cubeImpostorBuffer = BufferHandle();
+
+		renderer.deleteBuffer(cubeImpostorArgsBuffer);
+		cubeImpostorArgsBuffer = BufferHandle();
+	}
+
+	if (cubeAnimatedBuffer) {
+		renderer.deleteBuffer(cubeAnimatedBuffer);
+		cubeAnimatedBuffer = BufferHandle();
+	}
 
-	if (antialiasing && aaMethod == +AAMethod::MSAA) {
+	if (comparing()) {
+		numSamples = 1;
+	} else if (antialiasing && aaMethod == +AAMethod::MSAA) {
 		numSamples = msaaQualityToSamples(msaaQuality);
 		assert(numSamples > 1);
 	} else if (antialiasing && aaMethod == +AAMethod::SMAA2X) {
@@ -1309,9 +3726,130 @@ void SMAADemo::rebuildRenderGraph() {
 	LOG("create framebuffers at size %ux%u\n", windowWidth, windowHeight);
 	logFlush();
 
+	smaaSize.x = std::max(1U, static_cast<unsigned int>(float(windowWidth)  * smaaScale + 0.5f));
+	smaaSize.y = std::max(1U, static_cast<unsigned int>(float(windowHeight) * smaaScale + 0.5f));
+	if (smaaSize != renderSize) {
+		LOG("SMAA edges and weights at size %ux%u\n", smaaSize.x, smaaSize.y);
+	}
+
+	// with dynamic resolution everything before the upscale goes to ScaledFinal
+	const Rendertargets finalRT = dynamicResolution ? Rendertargets::ScaledFinal : Rendertargets::FinalRender;
+
+	// MSAA resolves happen at the end of the scene pass
+	const bool temporalScene = temporalActive();
+	depthVelocityActive = depthVelocity && temporalScene;
+	sceneVelocity       = temporalScene && !depthVelocityActive;
+
+	// fused FXAA writes the final image so it can't with dynamic resolution
+	const bool fuseFXAA = fusedFXAA && antialiasing && aaMethod == +AAMethod::FXAA && !dynamicResolution && !comparing();
+	fxaaTemporalResolve = fuseFXAA && temporalScene;
+#ifndef IMGUI_DISABLE
+	// sweep compares the image without GUI
+	guiOverlayActive    = guiOverlayRate > 0.0f && sweepFile.empty();
+	fxaaDrawsGUI        = fuseFXAA && sweepFile.empty() && !guiOverlayActive;
+#endif  // IMGUI_DISABLE
+	// temporal passes change every frame and dynamic resolution changes the viewport
+	// debug views and comparison passes inherit set 0 from passes which would no longer bind it
+	staticPassesActive  = staticPostPasses && renderer.getFeatures().staticRenderPasses && antialiasing
+	                   && !temporalScene && !comparing() && !dynamicResolution && debugMode == 0;
+	// the copy needs the input and output to match and the tiles to be output pixels
+	// temporal SMAA writes velocity to alpha of every pixel
+	smaaTiledBlendActive = smaaTiledBlend && smaaCompute && antialiasing && aaMethod == +AAMethod::SMAA
+	                    && !temporalScene && !comparing() && debugMode == 0 && smaaSize == renderSize;
+	// an MSAA scene pass resolves into the final image which the GUI draws over
+	cachedPassesActive   = cachedImagePasses && isImageScene() && !(numSamples > 1 && aaMethod == +AAMethod::MSAA);
+	finalInSwapchain     = renderer.getFeatures().swapchainRenderTarget && sweepFile.empty();
+	// the swapchain image would still need a copy of the scene color
+	// a cached scene pass can't have its output changed after it
+	// and dynamic resolution upscales from ScaledFinal
+	smaaInPlaceBlendActive = smaaInPlaceBlend && smaaTiledBlendActive && !finalInSwapchain
+	                      && !cachedPassesActive && !dynamicResolution;
+	// what the GUI draws over and presentFrame takes
+	const Rendertargets presentRT = smaaInPlaceBlendActive ? Rendertargets::MainColor : Rendertargets::FinalRender;
+	// SMAA edges and weights, the blend pass writes the final image
+	auto cacheSMAAPass = [&] (DemoRenderGraph::PassDesc &desc) {
+		if (cachedPassesActive) {
+			desc.cachedOn(smaaVersion);
+		}
+	};
+	auto addSceneResolves = [&] (DemoRenderGraph::PassDesc &desc) {
+		if (numSamples == 1) {
+			return;
+		}
+
+		if (sceneVelocity) {
+			desc.resolve(1, Rendertargets::Velocity);
+		}
+
+		if (aaMethod == +AAMethod::MSAA) {
+			desc.resolve(0, temporalScene ? Rendertargets::TemporalCurrent : finalRT);
+		}
+	};
+
+	cubeCullingActive   = false;
+	cubeAnimationActive = false;
+	cubeLODActive       = false;
+	depthPrepassActive  = false;
+	compactCubesActive  = false;
 	if (!isImageScene()) {
 		// cube scene
 
+		// scene file positions can be outside the fixed point range
+		compactCubesActive = compactCubes && !sceneFile;
+
+		// scene file instances come from the file's own animation
+		if (cubeAnimation && !sceneFile) {
+			cubeAnimationActive = true;
+
+			BufferDesc bufDesc;
+			bufDesc.type(BufferType::Storage)
+			       .size(static_cast<uint32_t>(2 * std::max(cubes.size(), size_t(1)) * sizeof(ShaderDefines::Cube)))
+			       .usage(BufferUsage::Dynamic)
+			       .name("animated cubes");
+			cubeAnimatedBuffer = renderer.createBuffer(bufDesc);
+
+			// the cull pass and the scene read the poses it writes
+			DemoRenderGraph::ComputePassDesc desc;
+			desc.name("Cube animation");
+
+			renderGraph.computePass(RenderPasses::CubeAnimate, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderCubeAnimate(rp, r); } );
+		}
+
+		// scene file meshes are drawn one indirect draw per mesh without culling
+		if (cubeCulling && !sceneFile) {
+			cubeCullingActive = true;
+
+			const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+			std::vector<uint32_t> visible(numCubes, 0);
+			cubeVisibleBuffer = renderer.createBuffer(BufferType::Storage, numCubes * sizeof(uint32_t), &visible[0]);
+
+			DrawIndexedIndirectArgs args;
+			args.indexCount    = 3 * 2 * 6;
+			args.instanceCount = 0;
+			args.firstIndex    = 0;
+			args.vertexOffset  = 0;
+			args.firstInstance = 0;
+			cubeDrawArgsBuffer = renderer.createBuffer(BufferType::Indirect, sizeof(DrawIndexedIndirectArgs), &args);
+
+			// the cull pass needs something bound without LOD
+			cubeLODActive = cubeLOD;
+			const unsigned int numImpostors = cubeLODActive ? numCubes : 1;
+			cubeImpostorBuffer = renderer.createBuffer(BufferType::Storage, numImpostors * sizeof(uint32_t), &visible[0]);
+
+			DrawIndirectArgs impostorArgs;
+			impostorArgs.vertexCount   = 6;
+			impostorArgs.instanceCount = 0;
+			impostorArgs.firstVertex   = 0;
+			impostorArgs.firstInstance = 0;
+			cubeImpostorArgsBuffer = renderer.createBuffer(BufferType::Indirect, sizeof(DrawIndirectArgs), &impostorArgs);
+
+			// only writes buffers so it goes before the scene pass
+			DemoRenderGraph::ComputePassDesc desc;
+			desc.name("Cube cull");
+
+			renderGraph.computePass(RenderPasses::CubeCull, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderCubeCull(rp, r); } );
+		}
+
 		{
 			RenderTargetDesc rtDesc;
 			rtDesc.name("main color")
@@ -1323,8 +3861,9 @@ void SMAADemo::rebuildRenderGraph() {
 			renderGraph.renderTarget(Rendertargets::MainColor, rtDesc);
 		}
 
-		// TODO: only create velocity buffer when doing temporal AA
-		{
+		// only temporal AA reads velocity
+		auto velocityRT = Rendertargets::Velocity;
+		if (temporalScene) {
 			RenderTargetDesc rtDesc;
 			rtDesc.name("velocity")
 				  .numSamples(1)
@@ -1332,19 +3871,14 @@ void SMAADemo::rebuildRenderGraph() {
 				  .width(windowWidth)
 				  .height(windowHeight);
 			renderGraph.renderTarget(Rendertargets::Velocity, rtDesc);
-		}
 
-		auto velocityRT = Rendertargets::Velocity;
-		if (numSamples > 1) {
-			RenderTargetDesc rtDesc;
-			rtDesc.name("velocity multisample")
-				  .numSamples(numSamples)
-				  .format(Format::RG16Float)
-				  .width(windowWidth)
-				  .height(windowHeight);
-			renderGraph.renderTarget(Rendertargets::VelocityMS, rtDesc);
+			if (sceneVelocity && numSamples > 1) {
+				rtDesc.name("velocity multisample")
+					  .numSamples(numSamples);
+				renderGraph.renderTarget(Rendertargets::VelocityMS, rtDesc);
 
-			velocityRT = Rendertargets::VelocityMS;
+				velocityRT = Rendertargets::VelocityMS;
+			}
 		}
 
 		{
@@ -1357,15 +3891,39 @@ void SMAADemo::rebuildRenderGraph() {
 			renderGraph.renderTarget(Rendertargets::MainDepth, rtDesc);
 		}
 
+		depthPrepassActive = depthPrepass;
+		if (depthPrepassActive) {
+			DemoRenderGraph::PassDesc prepassDesc;
+			prepassDesc.depthStencil(Rendertargets::MainDepth, PassBegin::Clear)
+			           .clearDepth(1.0f)
+			           .name("Depth prepass")
+			           .numSamples(numSamples);
+
+			renderGraph.renderPass(RenderPasses::DepthPrepass, prepassDesc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderCubeScene(rp, r); } );
+		}
+
 		DemoRenderGraph::PassDesc desc;
 		desc.color(0, Rendertargets::MainColor, PassBegin::Clear)
-		    .color(1, velocityRT,               PassBegin::Clear)
-		    .depthStencil(Rendertargets::MainDepth,  PassBegin::Clear)
+		    .depthStencil(Rendertargets::MainDepth, depthPrepassActive ? PassBegin::Keep : PassBegin::Clear)
 		    .clearDepth(1.0f)
 		    .name("Scene")
 		    .numSamples(numSamples);
+		if (sceneVelocity) {
+			desc.color(1, velocityRT, PassBegin::Clear);
+		}
+		addSceneResolves(desc);
 
 		renderGraph.renderPass(RenderPasses::Scene, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderCubeScene(rp, r); } );
+
+		if (depthVelocityActive) {
+			// the scene pass only writes color, velocity comes from depth
+			DemoRenderGraph::PassDesc velocityDesc;
+			velocityDesc.color(0, Rendertargets::Velocity, PassBegin::DontCare)
+			            .inputRendertarget(Rendertargets::MainDepth)
+			            .name("Velocity from depth");
+
+			renderGraph.renderPass(RenderPasses::DepthVelocity, velocityDesc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderDepthVelocity(rp, r); } );
+		}
 	} else {
 		// image scene
 
@@ -1380,29 +3938,6 @@ void SMAADemo::rebuildRenderGraph() {
 			renderGraph.renderTarget(Rendertargets::MainColor, rtDesc);
 		}
 
-		// TODO: don't use velocity buffer
-		{
-			RenderTargetDesc rtDesc;
-			rtDesc.name("velocity")
-				  .numSamples(1)
-				  .format(Format::RG16Float)
-				  .width(windowWidth)
-				  .height(windowHeight);
-			renderGraph.renderTarget(Rendertargets::Velocity, rtDesc);
-		}
-
-		auto velocityRT = Rendertargets::Velocity;
-		if (numSamples > 1) {
-			RenderTargetDesc rtDesc;
-			rtDesc.name("velocity multisample")
-				  .numSamples(numSamples)
-				  .format(Format::RG16Float)
-				  .width(windowWidth)
-				  .height(windowHeight);
-			renderGraph.renderTarget(Rendertargets::VelocityMS, rtDesc);
-			velocityRT = Rendertargets::VelocityMS;
-		}
-
 		{
 			RenderTargetDesc rtDesc;
 			rtDesc.name("main depth")
@@ -1413,18 +3948,25 @@ void SMAADemo::rebuildRenderGraph() {
 			renderGraph.renderTarget(Rendertargets::MainDepth, rtDesc);
 		}
 
+		// no temporal AA so no velocity
 		DemoRenderGraph::PassDesc desc;
 		desc.color(0, Rendertargets::MainColor, PassBegin::Clear)
-		    .color(1, velocityRT,               PassBegin::Clear)
 		    .depthStencil(Rendertargets::MainDepth,  PassBegin::Clear)
 		    .clearDepth(1.0f)
 		    .name("Scene")
 		    .numSamples(numSamples);
+		addSceneResolves(desc);
+		if (cachedPassesActive) {
+			desc.cachedOn(imageVersion);
+		}
 
 		renderGraph.renderPass(RenderPasses::Scene, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderImageScene(rp, r); } );
 	}
 
-	{
+	if (finalInSwapchain) {
+		// last pass writes straight into the swapchain image
+		renderGraph.externalRenderTarget(Rendertargets::FinalRender, Format::sRGBA8, Layout::Undefined, Layout::Present);
+	} else if (!smaaInPlaceBlendActive) {
 		RenderTargetDesc rtDesc;
 		rtDesc.name("final")
 		      .format(Format::sRGBA8)
@@ -1433,12 +3975,27 @@ void SMAADemo::rebuildRenderGraph() {
 		renderGraph.renderTarget(Rendertargets::FinalRender, rtDesc);
 	}
 
-	if (antialiasing) {
-		if (temporalAA && !isImageScene()) {
+	if (dynamicResolution) {
+		// full size so changing renderScale doesn't need a rebuild
+		RenderTargetDesc rtDesc;
+		rtDesc.name("scaled final")
+		      .format(Format::sRGBA8)
+		      .width(windowWidth)
+		      .height(windowHeight);
+		renderGraph.renderTarget(Rendertargets::ScaledFinal, rtDesc);
+	}
+
+	if (comparing()) {
+		addComparisonPasses(finalRT);
+	} else if (antialiasing) {
+		if (temporalScene) {
 			{
+				// MSAA resolves into it which needs the scene format
+				Format historyFormat = (aaMethod == +AAMethod::MSAA) ? +Format::sRGBA8 : temporalFormats[temporalFormat];
+
 				RenderTargetDesc rtDesc;
 				rtDesc.name("Temporal resolve 1")
-				      .format(Format::sRGBA8)  // TODO: not right?
+				      .format(historyFormat)
 				      .width(windowWidth)
 				      .height(windowHeight);
 				temporalRTs[0] = renderer.createRenderTarget(rtDesc);
@@ -1446,21 +4003,18 @@ void SMAADemo::rebuildRenderGraph() {
 				rtDesc.name("Temporal resolve 2");
 				temporalRTs[1] = renderer.createRenderTarget(rtDesc);
 
-				renderGraph.externalRenderTarget(Rendertargets::TemporalPrevious, Format::sRGBA8, Layout::ShaderRead, Layout::ShaderRead);
-				renderGraph.externalRenderTarget(Rendertargets::TemporalCurrent,  Format::sRGBA8, Layout::Undefined,  Layout::ShaderRead);
-			}
-
-			if (numSamples > 1) {
-				renderGraph.resolveMSAA(Rendertargets::VelocityMS, Rendertargets::Velocity);
+				renderGraph.externalRenderTarget(Rendertargets::TemporalPrevious, historyFormat, Layout::ShaderRead, Layout::ShaderRead);
+				renderGraph.externalRenderTarget(Rendertargets::TemporalCurrent,  historyFormat, Layout::Undefined,  Layout::ShaderRead);
 			}
 
 			switch (aaMethod) {
 			case AAMethod::MSAA: {
-				renderGraph.resolveMSAA(Rendertargets::MainColor, Rendertargets::TemporalCurrent);
+				// resolved by the scene pass
 			} break;
 
 			case AAMethod::FXAA: {
-				{
+				// fused FXAA happens in the resolve pass
+				if (!fxaaTemporalResolve) {
 					DemoRenderGraph::PassDesc desc;
 					desc.color(0, Rendertargets::TemporalCurrent, PassBegin::Clear)
 					    .inputRendertarget(Rendertargets::MainColor)
@@ -1473,40 +4027,53 @@ void SMAADemo::rebuildRenderGraph() {
 			case AAMethod::SMAA: {
 				// edges pass
 				{
+					// the compute edge shader writes a storage image
+					// and rg8 storage images are an optional extended format
 					RenderTargetDesc rtDesc;
 					rtDesc.name("SMAA edges")
-						  .format(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
+						  .format(smaaCompute ? +Format::RGBA8 : smaaEdgesFormat)
+						  .width(smaaSize.x)
+						  .height(smaaSize.y);
 					renderGraph.renderTarget(Rendertargets::Edges, rtDesc);
 				}
 
-				{
-					// TODO: only add MainDepth when using predication
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::Edges, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::MainColor)
-					    .inputRendertarget(Rendertargets::MainDepth)
-						.name("SMAA edges");
+				if (smaaCompute) {
+					// temporal 1x keeps the current frame's subsample in the first slot
+					addSMAAComputePasses(Rendertargets::MainColor, 0, smaaSize.x, smaaSize.y);
+				} else {
+					{
+						DemoRenderGraph::PassDesc desc;
+						desc.color(0, Rendertargets::Edges, PassBegin::Clear)
+						    .inputRendertarget(Rendertargets::MainColor)
+							.name("SMAA edges");
+						if (smaaEdgesNeedDepth()) {
+							desc.inputRendertarget(Rendertargets::MainDepth);
+						}
 
-					renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::MainColor, 0); } );
-				}
+						addSMAAStencilTarget(smaaSize.x, smaaSize.y);
+						smaaStencilAttachment(desc, true);
 
-				// blendweights pass
-				{
-					RenderTargetDesc rtDesc;
-					rtDesc.name("SMAA weights")
-						  .format(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
-					renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
+						renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::MainColor); } );
+					}
 
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Edges)
-						.name("SMAA weights");
+					// blendweights pass
+					{
+						RenderTargetDesc rtDesc;
+						rtDesc.name("SMAA weights")
+							  .format(Format::RGBA8)
+							  .width(smaaSize.x)
+							  .height(smaaSize.y);
+						renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
+
+						DemoRenderGraph::PassDesc desc;
+						desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
+						    .inputRendertarget(Rendertargets::Edges)
+							.name("SMAA weights");
 
-					renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r, 0); } );
+						smaaStencilAttachment(desc, false);
+
+						renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r); } );
+					}
 				}
 
 				// full effect
@@ -1517,124 +4084,91 @@ void SMAADemo::rebuildRenderGraph() {
 					    .inputRendertarget(Rendertargets::BlendWeights)
 						.name("SMAA blend");
 
-					renderGraph.renderPass(RenderPasses::SMAABlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor, 0); } );
+					renderGraph.renderPass(RenderPasses::SMAABlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor); } );
 				}
 			} break;
 
 			case AAMethod::SMAA2X: {
+				// both subsamples at once straight from MainColor, edges and weights have a target for each
 				{
 					RenderTargetDesc rtDesc;
-					rtDesc.format(Format::sRGBA8)
-						  .additionalViewFormat(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
+					rtDesc.format(smaaEdgesFormat)
+						  .width(smaaSize.x)
+						  .height(smaaSize.y);
 
-					rtDesc.name("Subsample separate 1");
-					renderGraph.renderTarget(Rendertargets::Subsample1, rtDesc);
+					rtDesc.name("SMAA edges 1");
+					renderGraph.renderTarget(Rendertargets::Edges, rtDesc);
 
-					rtDesc.name("Subsample separate 2");
-					renderGraph.renderTarget(Rendertargets::Subsample2, rtDesc);
-				}
+					rtDesc.name("SMAA edges 2");
+					renderGraph.renderTarget(Rendertargets::Edges2, rtDesc);
 
-				{
 					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::Subsample1, PassBegin::DontCare)
-					    .color(1, Rendertargets::Subsample2, PassBegin::DontCare)
+					desc.color(0, Rendertargets::Edges,  PassBegin::Clear)
+					    .color(1, Rendertargets::Edges2, PassBegin::Clear)
 					    .inputRendertarget(Rendertargets::MainColor)
-					    .name("Subsample separate");
-
-					renderGraph.renderPass(RenderPasses::Separate, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSeparate(rp, r); } );
-				}
-
-				// TODO: clean up the renderpass mess
-
-				// edges pass
-				{
-					RenderTargetDesc rtDesc;
-					rtDesc.name("SMAA edges")
-						  .format(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
-					renderGraph.renderTarget(Rendertargets::Edges, rtDesc);
-				}
+						.name("SMAA2x edges");
+					if (smaaEdgesNeedDepth()) {
+						desc.inputRendertarget(Rendertargets::MainDepth);
+					}
 
-				{
-					// TODO: only add MainDepth when using predication
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::Edges, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Subsample1)
-					    .inputRendertarget(Rendertargets::MainDepth)
-						.name("SMAA edges");
+					addSMAAStencilTarget(smaaSize.x, smaaSize.y);
+					smaaStencilAttachment(desc, true);
 
-					renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::Subsample1, 0); } );
+					renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::MainColor); } );
 				}
 
-				// blendweights pass
 				{
 					RenderTargetDesc rtDesc;
-					rtDesc.name("SMAA weights")
-						  .format(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
-					renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
-
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Edges)
-						.name("SMAA weights");
-
-					renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r, 0); } );
-				}
-
-				// full effect
-				{
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::TemporalCurrent, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Subsample1)
-					    .inputRendertarget(Rendertargets::BlendWeights)
-						.name("SMAA2x blend 1");
-
-					renderGraph.renderPass(RenderPasses::SMAA2XBlend1, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::Subsample1, 0); } );
-				}
+					rtDesc.format(Format::RGBA8)
+						  .width(smaaSize.x)
+						  .height(smaaSize.y);
 
-				// edges pass
-				{
-					// TODO: only add MainDepth when using predication
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::Edges, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Subsample2)
-					    .inputRendertarget(Rendertargets::MainDepth)
-						.name("SMAA edges");
+					rtDesc.name("SMAA weights 1");
+					renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
 
-					renderGraph.renderPass(RenderPasses::SMAAEdges2, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::Subsample2, 1); } );
-				}
+					rtDesc.name("SMAA weights 2");
+					renderGraph.renderTarget(Rendertargets::BlendWeights2, rtDesc);
 
-				// blendweights pass
-				{
 					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
+					desc.color(0, Rendertargets::BlendWeights,  PassBegin::Clear)
+					    .color(1, Rendertargets::BlendWeights2, PassBegin::Clear)
 					    .inputRendertarget(Rendertargets::Edges)
-						.name("SMAA weights");
+					    .inputRendertarget(Rendertargets::Edges2)
+						.name("SMAA2x weights");
 
-					renderGraph.renderPass(RenderPasses::SMAAWeights2, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r, 1); } );
+					smaaStencilAttachment(desc, false);
+
+					renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r); } );
 				}
 
-				// full effect
+				// blend and resolve
 				{
 					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::TemporalCurrent, PassBegin::Keep)
-					    .inputRendertarget(Rendertargets::Subsample2)
+					desc.color(0, Rendertargets::TemporalCurrent, PassBegin::Clear)
+					    .inputRendertarget(Rendertargets::MainColor)
 					    .inputRendertarget(Rendertargets::BlendWeights)
-						.name("SMAA2x blend 2");
+					    .inputRendertarget(Rendertargets::BlendWeights2)
+						.name("SMAA2x blend");
 
-					renderGraph.renderPass(RenderPasses::SMAA2XBlend2, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::Subsample2, 1); } );
+					renderGraph.renderPass(RenderPasses::SMAA2XBlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor); } );
 				}
 			} break;
 			}
 
-			{
+			if (fxaaTemporalResolve) {
+				// current frame goes to history straight from FXAA without a round trip through memory
+				DemoRenderGraph::PassDesc desc;
+				desc.color(0, finalRT,                         PassBegin::DontCare)
+				    .color(1, Rendertargets::TemporalCurrent,  PassBegin::DontCare)
+				    .inputRendertarget(Rendertargets::MainColor)
+				    .inputRendertarget(Rendertargets::TemporalPrevious)
+				    .inputRendertarget(Rendertargets::Velocity)
+				    .name("FXAA temporal resolve");
+
+				renderGraph.renderPass(RenderPasses::Final, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderFXAA(rp, r); } );
+			} else {
 				DemoRenderGraph::PassDesc desc;
-				desc.color(0, Rendertargets::FinalRender, PassBegin::Clear)
+				desc.color(0, finalRT, PassBegin::Clear)
 					.inputRendertarget(Rendertargets::TemporalPrevious)
 					.inputRendertarget(Rendertargets::TemporalCurrent)
 					.inputRendertarget(Rendertargets::Velocity)
@@ -1646,68 +4180,108 @@ void SMAADemo::rebuildRenderGraph() {
 			// no temporal AA
 			switch (aaMethod) {
 			case AAMethod::MSAA: {
-				renderGraph.resolveMSAA(Rendertargets::MainColor, Rendertargets::FinalRender);
+				// resolved by the scene pass
 			} break;
 
 			case AAMethod::FXAA: {
 				DemoRenderGraph::PassDesc desc;
-				desc.color(0, Rendertargets::FinalRender, PassBegin::Clear)
+				desc.color(0, finalRT, PassBegin::Clear)
 				    .inputRendertarget(Rendertargets::MainColor)
-					.name("FXAA");
+					.name("FXAA")
+					.staticContents(staticPassesActive && !fxaaDrawsGUI);
 
 				renderGraph.renderPass(RenderPasses::FXAA, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderFXAA(rp, r); } );
 			} break;
 
 			case AAMethod::SMAA: {
+				// edge visualization has no blend weights so it stays on the fragment path
+				bool compute = smaaCompute && debugMode != 1;
+
 				// edges pass
 				{
 					RenderTargetDesc rtDesc;
 					rtDesc.name("SMAA edges")
-						  .format(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
+						  .format(compute ? +Format::RGBA8 : smaaEdgesFormat)
+						  .width(smaaSize.x)
+						  .height(smaaSize.y);
 					renderGraph.renderTarget(Rendertargets::Edges, rtDesc);
 				}
 
-				{
-					// TODO: only add MainDepth when using predication
+				if (compute) {
+					addSMAAComputePasses(Rendertargets::MainColor, 0, smaaSize.x, smaaSize.y);
+				} else {
 					DemoRenderGraph::PassDesc desc;
 					desc.color(0, Rendertargets::Edges, PassBegin::Clear)
 					    .inputRendertarget(Rendertargets::MainColor)
-					    .inputRendertarget(Rendertargets::MainDepth)
-						.name("SMAA edges");
+						.name("SMAA edges")
+						.staticContents(staticPassesActive);
+					if (smaaEdgesNeedDepth()) {
+						desc.inputRendertarget(Rendertargets::MainDepth);
+					}
+
+					addSMAAStencilTarget(smaaSize.x, smaaSize.y);
+					smaaStencilAttachment(desc, true);
+					cacheSMAAPass(desc);
 
-					renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::MainColor, 0); } );
+					renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::MainColor); } );
 				}
 
 				switch (debugMode) {
 				case 0:
 					// blendweights pass
-					{
+					if (!compute) {
 						RenderTargetDesc rtDesc;
 						rtDesc.name("SMAA weights")
 							  .format(Format::RGBA8)
-							  .width(windowWidth)
-							  .height(windowHeight);
+							  .width(smaaSize.x)
+							  .height(smaaSize.y);
 						renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
 
 						DemoRenderGraph::PassDesc desc;
 						desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
 						    .inputRendertarget(Rendertargets::Edges)
-							.name("SMAA weights");
+							.name("SMAA weights")
+							.staticContents(staticPassesActive);
 
-						renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r, 0); } );
+						smaaStencilAttachment(desc, false);
+						cacheSMAAPass(desc);
+
+						renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r); } );
 					}
 
 					// full effect
-					{
+					if (smaaInPlaceBlendActive) {
+						// blending reads neighbors which other tiles change
+						// so the results go to a buffer before any of them are written
+						{
+							DemoRenderGraph::ComputePassDesc desc;
+							desc.inputRendertarget(Rendertargets::MainColor)
+							    .inputRendertarget(Rendertargets::BlendWeights)
+							    .name("SMAA blend compute");
+
+							renderGraph.computePass(RenderPasses::SMAABlendCompute, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlendCompute(rp, r); } );
+						}
+
 						DemoRenderGraph::PassDesc desc;
-						desc.color(0, Rendertargets::FinalRender, PassBegin::Clear)
-						    .inputRendertarget(Rendertargets::MainColor)
-						    .inputRendertarget(Rendertargets::BlendWeights)
+						desc.color(0, Rendertargets::MainColor, PassBegin::Keep)
 							.name("SMAA blend");
 
-						renderGraph.renderPass(RenderPasses::SMAABlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor, 0); } );
+						renderGraph.renderPass(RenderPasses::SMAABlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor); } );
+					} else {
+						DemoRenderGraph::PassDesc desc;
+						if (smaaTiledBlendActive) {
+							// tiles without edges stay as copied
+							renderGraph.blit(Rendertargets::MainColor, finalRT);
+							desc.color(0, finalRT, PassBegin::Keep);
+						} else {
+							desc.color(0, finalRT, PassBegin::Clear);
+						}
+						desc.inputRendertarget(Rendertargets::MainColor)
+						    .inputRendertarget(Rendertargets::BlendWeights)
+							.name("SMAA blend")
+							.staticContents(staticPassesActive);
+
+						renderGraph.renderPass(RenderPasses::SMAABlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor); } );
 					}
 
 					break;
@@ -1716,7 +4290,7 @@ void SMAADemo::rebuildRenderGraph() {
 					// visualize edges
 					{
 						DemoRenderGraph::PassDesc desc;
-						desc.color(0, Rendertargets::FinalRender, PassBegin::Clear)
+						desc.color(0, finalRT, PassBegin::Clear)
 						    .inputRendertarget(Rendertargets::Edges)
 							.name("Visualize edges");
 
@@ -1727,12 +4301,12 @@ void SMAADemo::rebuildRenderGraph() {
 
 				case 2:
 					// blendweights pass
-					{
+					if (!compute) {
 						RenderTargetDesc rtDesc;
 						rtDesc.name("SMAA weights")
 							  .format(Format::RGBA8)
-							  .width(windowWidth)
-							  .height(windowHeight);
+							  .width(smaaSize.x)
+							  .height(smaaSize.y);
 						renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
 
 						DemoRenderGraph::PassDesc desc;
@@ -1740,13 +4314,16 @@ void SMAADemo::rebuildRenderGraph() {
 						    .inputRendertarget(Rendertargets::Edges)
 							.name("SMAA weights");
 
-						renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r, 0); } );
+						smaaStencilAttachment(desc, false);
+						cacheSMAAPass(desc);
+
+						renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r); } );
 					}
 
 					// visualize blend weights
 					{
 						DemoRenderGraph::PassDesc desc;
-						desc.color(0, Rendertargets::FinalRender, PassBegin::Clear)
+						desc.color(0, finalRT, PassBegin::Clear)
 						    .inputRendertarget(Rendertargets::BlendWeights)
 							.name("Visualize blend weights");
 
@@ -1758,428 +4335,2180 @@ void SMAADemo::rebuildRenderGraph() {
 			} break;
 
 			case AAMethod::SMAA2X: {
+				// both subsamples at once straight from MainColor, edges and weights have a target for each
 				{
 					RenderTargetDesc rtDesc;
-					rtDesc.format(Format::sRGBA8)
-						  .additionalViewFormat(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
+					rtDesc.format(smaaEdgesFormat)
+						  .width(smaaSize.x)
+						  .height(smaaSize.y);
 
-					rtDesc.name("Subsample separate 1");
-					renderGraph.renderTarget(Rendertargets::Subsample1, rtDesc);
+					rtDesc.name("SMAA edges 1");
+					renderGraph.renderTarget(Rendertargets::Edges, rtDesc);
 
-					rtDesc.name("Subsample separate 2");
-					renderGraph.renderTarget(Rendertargets::Subsample2, rtDesc);
+					rtDesc.name("SMAA edges 2");
+					renderGraph.renderTarget(Rendertargets::Edges2, rtDesc);
 
 					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::Subsample1, PassBegin::DontCare)
-					    .color(1, Rendertargets::Subsample2, PassBegin::DontCare)
+					desc.color(0, Rendertargets::Edges,  PassBegin::Clear)
+					    .color(1, Rendertargets::Edges2, PassBegin::Clear)
 					    .inputRendertarget(Rendertargets::MainColor)
-					    .name("Subsample separate");
-
-					renderGraph.renderPass(RenderPasses::Separate, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSeparate(rp, r); } );
-				}
-
-				// edges pass
-				{
-					RenderTargetDesc rtDesc;
-					rtDesc.name("SMAA edges")
-						  .format(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
-					renderGraph.renderTarget(Rendertargets::Edges, rtDesc);
+						.name("SMAA2x edges")
+						.staticContents(staticPassesActive);
+					if (smaaEdgesNeedDepth()) {
+						desc.inputRendertarget(Rendertargets::MainDepth);
+					}
 
-					// TODO: only add MainDepth when using predication
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::Edges, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Subsample1)
-					    .inputRendertarget(Rendertargets::MainDepth)
-						.name("SMAA edges");
+					addSMAAStencilTarget(smaaSize.x, smaaSize.y);
+					smaaStencilAttachment(desc, true);
+					cacheSMAAPass(desc);
 
-					renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::Subsample1, 0); } );
+					renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::MainColor); } );
 				}
 
-				// blendweights pass
 				{
 					RenderTargetDesc rtDesc;
-					rtDesc.name("SMAA weights")
-						  .format(Format::RGBA8)
-						  .width(windowWidth)
-						  .height(windowHeight);
-					renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
-
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Edges)
-						.name("SMAA weights");
-
-					renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r, 0); } );
-				}
-
-				// final blend pass
-				{
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::FinalRender, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Subsample1)
-					    .inputRendertarget(Rendertargets::BlendWeights)
-						.name("SMAA2x blend 1");
-
-					renderGraph.renderPass(RenderPasses::SMAA2XBlend1, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::Subsample1, 0); } );
-				}
+					rtDesc.format(Format::RGBA8)
+						  .width(smaaSize.x)
+						  .height(smaaSize.y);
 
-				// second pass
-				// edges pass
-				{
-					// TODO: only add MainDepth when using predication
-					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::Edges, PassBegin::Clear)
-					    .inputRendertarget(Rendertargets::Subsample2)
-					    .inputRendertarget(Rendertargets::MainDepth)
-						.name("SMAA edges");
+					rtDesc.name("SMAA weights 1");
+					renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
 
-					renderGraph.renderPass(RenderPasses::SMAAEdges2, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::Subsample2, 1); } );
-				}
+					rtDesc.name("SMAA weights 2");
+					renderGraph.renderTarget(Rendertargets::BlendWeights2, rtDesc);
 
-				// blendweights pass
-				{
 					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
+					desc.color(0, Rendertargets::BlendWeights,  PassBegin::Clear)
+					    .color(1, Rendertargets::BlendWeights2, PassBegin::Clear)
 					    .inputRendertarget(Rendertargets::Edges)
-						.name("SMAA weights");
+					    .inputRendertarget(Rendertargets::Edges2)
+						.name("SMAA2x weights")
+						.staticContents(staticPassesActive);
 
-					renderGraph.renderPass(RenderPasses::SMAAWeights2, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r, 1); } );
+					smaaStencilAttachment(desc, false);
+					cacheSMAAPass(desc);
+
+					renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r); } );
 				}
 
-				// final blend pass
+				// blend and resolve
 				{
 					DemoRenderGraph::PassDesc desc;
-					desc.color(0, Rendertargets::FinalRender, PassBegin::Keep)
-					    .inputRendertarget(Rendertargets::Subsample2)
+					desc.color(0, finalRT, PassBegin::Clear)
+					    .inputRendertarget(Rendertargets::MainColor)
 					    .inputRendertarget(Rendertargets::BlendWeights)
-						.name("SMAA2x blend 2");
+					    .inputRendertarget(Rendertargets::BlendWeights2)
+						.name("SMAA2x blend")
+						.staticContents(staticPassesActive);
 
-					renderGraph.renderPass(RenderPasses::SMAA2XBlend2, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::Subsample2, 1); } );
+					renderGraph.renderPass(RenderPasses::SMAA2XBlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor); } );
 				}
 
 			} break;
 			}
 		}
 	} else {
-		renderGraph.blit(Rendertargets::MainColor, Rendertargets::FinalRender);
+		renderGraph.blit(Rendertargets::MainColor, finalRT);
+	}
+
+	if (dynamicResolution) {
+		DemoRenderGraph::PassDesc desc;
+		desc.color(0, Rendertargets::FinalRender, PassBegin::DontCare)
+		    .inputRendertarget(Rendertargets::ScaledFinal)
+		    .name("Upscale");
+
+		renderGraph.renderPass(RenderPasses::Upscale, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderUpscale(rp, r); } );
+	} else {
+		renderScale = 1.0f;
 	}
 
 #ifndef IMGUI_DISABLE
 
-	{
+	if (guiOverlayActive) {
+		createGUIOverlay(windowWidth, windowHeight);
+		renderGraph.externalRenderTarget(Rendertargets::GUIOverlay, Format::sRGBA8, Layout::ShaderRead, Layout::ShaderRead);
+	}
+
+	if (!fxaaDrawsGUI && sweepFile.empty()) {
 		DemoRenderGraph::PassDesc desc;
-		desc.color(0, Rendertargets::FinalRender, PassBegin::Keep)
-			.name("GUI");
+		desc.color(0, presentRT, PassBegin::Keep)
+			.name("GUI")
+			.enabledIf([this] () { return guiVisible; });
+		if (guiOverlayActive) {
+			desc.inputRendertarget(Rendertargets::GUIOverlay);
+		}
 
 		renderGraph.renderPass(RenderPasses::GUI, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderGUI(rp, r); } );
 	}
 
 #endif  // IMGUI_DISABLE
 
-	renderGraph.presentRenderTarget(Rendertargets::FinalRender);
+	renderGraph.presentRenderTarget(presentRT);
 
 	renderGraph.build(renderer);
 
+	clearPipelineHandles();
+
+	precompileShaders();
+
+	if (!graphReportFile.empty()) {
+		graphReportDelay = rendererDesc.swapchain.numFrames + 1;
+	}
+
+	rebuildRG = false;
+
+	startupPhase("render graph");
+}
+
+
+void SMAADemo::clearPipelineHandles() {
+	// render functions get them from renderGraph again on next use
 	cubePipeline           = PipelineHandle();
+	cubeDepthPipeline      = PipelineHandle();
 	imagePipeline          = PipelineHandle();
+	tiledImagePipeline     = PipelineHandle();
 	blitPipeline           = PipelineHandle();
 	guiPipeline            = PipelineHandle();
-	separatePipeline       = PipelineHandle();
+	guiCompositePipeline   = PipelineHandle();
+	depthVelocityPipeline  = PipelineHandle();
 	temporalAAPipelines[0] = PipelineHandle();
 	temporalAAPipelines[1] = PipelineHandle();
 	fxaaPipeline           = PipelineHandle();
+	cubeCullResetPipeline  = PipelineHandle();
+	cubeCullPipeline       = PipelineHandle();
+	cubeAnimatePipeline    = PipelineHandle();
+	cubeImpostorPipeline   = PipelineHandle();
+	cubeImpostorDepthPipeline = PipelineHandle();
 
 	smaaPipelines.edgePipeline         = PipelineHandle();
 	smaaPipelines.blendWeightPipeline  = PipelineHandle();
-	smaaPipelines.neighborPipelines[0] = PipelineHandle();
-	smaaPipelines.neighborPipelines[1] = PipelineHandle();
+	smaaPipelines.neighborPipeline     = PipelineHandle();
+	smaaPipelines.tileResetPipeline          = PipelineHandle();
+	smaaPipelines.edgeComputePipeline        = PipelineHandle();
+	smaaPipelines.blendWeightComputePipeline = PipelineHandle();
+	smaaPipelines.neighborComputePipeline    = PipelineHandle();
+}
 
-	for (unsigned int i = 0; i < 2; i++) {
-		temporalAAPipelines[i] = PipelineHandle();
-	}
 
-	separatePipeline = PipelineHandle();
+StaticPassState SMAADemo::currentStaticPassState() const {
+	StaticPassState state;
+	state.smaaParams   = smaaPushConstants();
+	state.windowSize   = glm::uvec2(rendererDesc.swapchain.width, rendererDesc.swapchain.height);
+	state.smaaSize     = smaaSize;
+	state.renderScale  = renderScale;
+	state.pipelines[0] = smaaPipelines.edgePipeline;
+	state.pipelines[1] = smaaPipelines.blendWeightPipeline;
+	state.pipelines[2] = smaaPipelines.neighborPipeline;
+	state.pipelines[3] = fxaaPipeline;
 
-	rebuildRG = false;
+	return state;
 }
 
 
-void SMAADemo::loadImage(const std::string &filename) {
-	int width = 0, height = 0;
-	unsigned char *imageData = stbi_load(filename.c_str(), &width, &height, NULL, 4);
-	LOG(" %s : %p  %dx%d\n", filename.c_str(), imageData, width, height);
-	if (!imageData) {
-		LOG("Bad image: %s\n", stbi_failure_reason());
+void SMAADemo::updateStaticPasses() {
+	assert(staticPassesActive);
+
+	if (staticGlobals && currentStaticPassState() == staticPassState) {
 		return;
 	}
 
-	images.push_back(Image());
-	auto &img      = images.back();
-	img.filename   = filename;
-	auto lastSlash = filename.rfind('/');
-	if (lastSlash != std::string::npos) {
-		img.shortName = filename.substr(lastSlash + 1);
-	}
-	else {
-		img.shortName = filename;
+	renderGraph.invalidateStaticPasses(renderer);
+
+	// deletion is deferred until the GPU is done with it
+	if (staticGlobals) {
+		renderer.deleteBuffer(staticGlobals);
 	}
 
-	TextureDesc texDesc;
-	texDesc.width(width)
-	       .height(height)
-	       .name(img.shortName)
-	       .format(Format::sRGBA8);
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+	// post-processing doesn't use the camera
+	ShaderDefines::Globals globals;
+	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.viewProj              = glm::identity<glm::mat4>();
+	globals.prevViewProj          = glm::identity<glm::mat4>();
+	globals.reprojection          = glm::identity<glm::mat4>();
+	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
 
-	texDesc.mipLevelData(0, imageData, width * height * 4);
-	img.width  = width;
-	img.height = height;
-	img.tex    = renderer.createTexture(texDesc);
+	BufferDesc desc;
+	desc.type(BufferType::Uniform)
+	    .size(sizeof(ShaderDefines::Globals))
+	    .contents(&globals)
+	    .name("static pass globals");
+	staticGlobals = renderer.createBuffer(desc);
+}
 
-	stbi_image_free(imageData);
 
-	activeScene = static_cast<unsigned int>(images.size());
+ImagePassState SMAADemo::currentImagePassState() const {
+	ImagePassState state;
+	state.scene          = activeScene;
+	state.imageTransform = imageConstants().imageTransform;
+	state.windowSize     = glm::uvec2(rendererDesc.swapchain.width, rendererDesc.swapchain.height);
+	state.renderScale    = renderScale;
+	state.pipelines[0]   = imagePipeline;
+	state.pipelines[1]   = tiledImagePipeline;
+
+	// null while the placeholder is shown
+	if (activeScene > 0) {
+		state.tex        = images.at(activeScene - 1).tex;
+	}
+
+	return state;
 }
 
 
-void SMAADemo::createCubes() {
-	// cube of cubes, n^3 cubes total
-	const unsigned int numCubes = static_cast<unsigned int>(pow(cubesPerSide, 3));
+void SMAADemo::updateCachedPassVersions() {
+	assert(cachedPassesActive);
 
-	const float cubeDiameter = sqrtf(3.0f);
-	const float cubeDistance = cubeDiameter + 1.0f;
+	if (!(currentImagePassState() == imagePassState)) {
+		imageVersion++;
+	}
 
-	const float bigCubeSide = cubeDistance * cubesPerSide;
+	// the cached SMAA passes use the same things as static ones
+	if (!(currentStaticPassState() == smaaPassState)) {
+		smaaVersion++;
+	}
+}
 
-	cubes.clear();
-	cubes.reserve(numCubes);
 
-	unsigned int order = 0;
-	for (unsigned int x = 0; x < cubesPerSide; x++) {
-		for (unsigned int y = 0; y < cubesPerSide; y++) {
-			for (unsigned int z = 0; z < cubesPerSide; z++) {
-				float qx = random.randFloat();
-				float qy = random.randFloat();
-				float qz = random.randFloat();
-				float qw = random.randFloat();
-				float reciprocLen = 1.0f / sqrtf(qx*qx + qy*qy + qz*qz + qw*qw);
-				qx *= reciprocLen;
-				qy *= reciprocLen;
-				qz *= reciprocLen;
-				qw *= reciprocLen;
+void SMAADemo::bindStaticGlobals() {
+	if (!staticPassesActive) {
+		return;
+	}
 
-				ShaderDefines::Cube cube;
-				cube.position = glm::vec3((x * cubeDistance) - (bigCubeSide / 2.0f)
-				                        , (y * cubeDistance) - (bigCubeSide / 2.0f)
-				                        , (z * cubeDistance) - (bigCubeSide / 2.0f));
+	assert(staticGlobals);
+	GlobalDS globalDS;
+	globalDS.globalUniforms = staticGlobals;
+	globalDS.linearSampler  = linearSampler;
+	globalDS.nearestSampler = nearestSampler;
+	renderer.bindDescriptorSet(0, globalDS);
+}
 
-				cube.order    = order;
-				order++;
 
-				cube.rotation = glm::vec4(qx, qy, qz, qw);
-				cube.color    = glm::vec3(1.0f, 1.0f, 1.0f);
-				cubes.emplace_back(cube);
+void SMAADemo::precompileShaders() {
+	// pipelines are created lazily on first use
+	// start compiling the ones this render graph needs so that doesn't stall the first frame
+	if (isImageScene()) {
+		renderer.precompileShaders(imagePipelineDesc());
+		if (tiledImages) {
+			renderer.precompileShaders(imagePipelineDesc(true));
+		}
+	} else {
+		renderer.precompileShaders(cubePipelineDesc());
+		if (cubeAnimationActive) {
+			renderer.precompileShaders(cubeAnimatePipelineDesc());
+		}
+		if (cubeCullingActive) {
+			renderer.precompileShaders(cubeCullResetPipelineDesc());
+			renderer.precompileShaders(cubeCullPipelineDesc());
+		}
+		if (cubeLODActive) {
+			renderer.precompileShaders(cubePipelineDesc(true));
+		}
+		if (depthVelocityActive) {
+			renderer.precompileShaders(depthVelocityPipelineDesc());
+		}
+		if (depthPrepassActive) {
+			renderer.precompileShaders(cubePipelineDesc(false, true));
+			if (cubeLODActive) {
+				renderer.precompileShaders(cubePipelineDesc(true, true));
 			}
 		}
 	}
 
-	colorCubes();
-}
+	if (!antialiasing) {
+		return;
+	}
 
+	if (comparing()) {
+		renderer.precompileShaders(fxaaPipelineDesc());
+		renderer.precompileShaders(smaaEdgePipelineDesc());
+		renderer.precompileShaders(smaaWeightsPipelineDesc());
+		renderer.precompileShaders(smaaBlendPipelineDesc());
+		return;
+	}
 
-void SMAADemo::shuffleCubeRendering() {
-	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
-	for (unsigned int i = 0; i < numCubes - 1; i++) {
-		unsigned int victim = random.range(i, numCubes);
-		std::swap(cubes[i], cubes[victim]);
+	bool temporal = temporalActive();
+	if (temporal && !fxaaTemporalResolve) {
+		renderer.precompileShaders(temporalAAPipelineDesc());
+		// first frame copies instead of resolving
+		renderer.precompileShaders(blitPipelineDesc());
 	}
-}
 
+	switch (aaMethod) {
+	case AAMethod::MSAA:
+		break;
+
+	case AAMethod::FXAA:
+		renderer.precompileShaders(fxaaPipelineDesc());
+		break;
+
+	case AAMethod::SMAA:
+		if (smaaCompute && (temporal || debugMode != 1)) {
+			renderer.precompileShaders(smaaTileResetPipelineDesc());
+			renderer.precompileShaders(smaaEdgeComputePipelineDesc());
+			renderer.precompileShaders(smaaWeightsComputePipelineDesc());
+			if (smaaInPlaceBlendActive) {
+				renderer.precompileShaders(smaaBlendComputePipelineDesc());
+			}
+		} else {
+			renderer.precompileShaders(smaaEdgePipelineDesc());
+			if (temporal || debugMode != 1) {
+				renderer.precompileShaders(smaaWeightsPipelineDesc());
+			}
+		}
+		if (temporal || debugMode == 0) {
+			renderer.precompileShaders(smaaBlendPipelineDesc());
+		} else {
+			renderer.precompileShaders(blitPipelineDesc());
+		}
+		break;
 
-void SMAADemo::reorderCubeRendering() {
-	auto cubeCompare = [] (const ShaderDefines::Cube &a, const ShaderDefines::Cube &b) {
-		return a.order < b.order;
-	};
-	std::sort(cubes.begin(), cubes.end(), cubeCompare);
+	case AAMethod::SMAA2X:
+		renderer.precompileShaders(smaaEdgePipelineDesc());
+		renderer.precompileShaders(smaaWeightsPipelineDesc());
+		renderer.precompileShaders(smaaBlendPipelineDesc());
+		break;
+	}
 }
 
 
-static float sRGB2linear(float v) {
-    if (v <= 0.04045f) {
-        return v / 12.92f;
-    } else {
-        return powf((v + 0.055f) / 1.055f, 2.4f);
-    }
-}
+void SMAADemo::precompileAllShaders() {
+	// the SPIR-V only depends on shader names and macros
+	// so MSAA sample counts and other pipeline state don't need their own variants
+#ifndef IMGUI_DISABLE
+	// gui drawn by the fused FXAA pass has its own variant
+	const bool oldGUIResolve = fxaaTemporalResolve;
+	for (bool resolve : { false, true }) {
+		fxaaTemporalResolve = resolve;
+		renderer.precompileShaders(guiPipelineDesc(false));
+	}
+	fxaaTemporalResolve = oldGUIResolve;
+	renderer.precompileShaders(guiPipelineDesc(true));
+#endif  // IMGUI_DISABLE
+
+	renderer.precompileShaders(imagePipelineDesc());
+	renderer.precompileShaders(imagePipelineDesc(true));
+	renderer.precompileShaders(blitPipelineDesc());
+
+	// culling and animation both need compute shaders and the cube grid
+	const bool computeCubes  = renderer.getFeatures().computeShaders && !sceneFile;
+	const bool oldCulling    = cubeCullingActive;
+	const bool oldAnimation  = cubeAnimationActive;
+	const bool oldProcedural = proceduralCubes;
+	const bool oldVelocity   = sceneVelocity;
+	const bool oldCompact    = compactCubesActive;
+	// only the instance format which was asked for
+	compactCubesActive = compactCubes && !sceneFile;
+	for (bool culling : { false, true }) {
+		for (bool animation : { false, true }) {
+			if ((culling || animation) && !computeCubes) {
+				continue;
+			}
+			for (bool procedural : { false, true }) {
+				for (bool velocity : { false, true }) {
+					cubeCullingActive   = culling;
+					cubeAnimationActive = animation;
+					proceduralCubes     = procedural;
+					sceneVelocity       = velocity;
+					renderer.precompileShaders(cubePipelineDesc());
+					if (culling && !procedural) {
+						renderer.precompileShaders(cubePipelineDesc(true));
+					}
+					// depth only pipelines don't care about velocity
+					if (!velocity) {
+						renderer.precompileShaders(cubePipelineDesc(false, true));
+						if (culling && !procedural) {
+							renderer.precompileShaders(cubePipelineDesc(true, true));
+						}
+					}
+				}
+			}
+			if (culling) {
+				renderer.precompileShaders(cubeCullPipelineDesc());
+			}
+		}
+	}
+	if (computeCubes) {
+		renderer.precompileShaders(cubeAnimatePipelineDesc());
+	}
+	cubeCullingActive   = oldCulling;
+	cubeAnimationActive = oldAnimation;
+	proceduralCubes     = oldProcedural;
+	sceneVelocity       = oldVelocity;
+	compactCubesActive  = oldCompact;
+
+	if (renderer.getFeatures().computeShaders) {
+		renderer.precompileShaders(cubeCullResetPipelineDesc());
+		renderer.precompileShaders(smaaTileResetPipelineDesc());
+	}
 
+	const bool oldReproject = temporalReproject;
+	const bool oldClamp     = temporalClamp;
+	for (bool reproject : { false, true }) {
+		for (bool clamp : { false, true }) {
+			temporalReproject = reproject;
+			temporalClamp     = clamp;
+			renderer.precompileShaders(temporalAAPipelineDesc());
+		}
+	}
+	temporalReproject = oldReproject;
+	temporalClamp     = oldClamp;
 
-void SMAADemo::colorCubes() {
-	if (colorMode == 0) {
-		for (auto &cube : cubes) {
-			// random RGB
-			cube.color.x = sRGB2linear(random.randFloat());
-			cube.color.y = sRGB2linear(random.randFloat());
-			cube.color.z = sRGB2linear(random.randFloat());
+	const unsigned int oldSamples = numSamples;
+	for (unsigned int samples : { 1, 2 }) {
+		numSamples = samples;
+		renderer.precompileShaders(depthVelocityPipelineDesc());
+	}
+	numSamples = oldSamples;
+
+	const bool oldHalfPrecision = halfPrecision;
+	for (bool half : { false, true }) {
+		if (half && !renderer.getFeatures().halfPrecision) {
+			continue;
 		}
-	} else {
-		for (auto &cube : cubes) {
-			// YCbCr, fixed luma, random chroma, alpha = 1.0
-			// worst case scenario for luma edge detection
-			// TODO: use the same luma as shader
+		halfPrecision = half;
 
-			float y = 0.3f;
-			const float c_red   = 0.299f
-			          , c_green = 0.587f
-			          , c_blue  = 0.114f;
-			float cb = random.randFloat() * 2.0f - 1.0f;
-			float cr = random.randFloat() * 2.0f - 1.0f;
+		if (renderer.getFeatures().computeShaders) {
+			renderer.precompileShaders(smaaBlendComputePipelineDesc());
+		}
 
-			float r = cr * (2 - 2 * c_red) + y;
-			float g = (y - c_blue * cb - c_red * cr) / c_green;
-			float b = cb * (2 - 2 * c_blue) + y;
+		const unsigned int oldFXAAQuality   = fxaaQuality;
+		const bool         oldFXAAResolve   = fxaaTemporalResolve;
+		const bool         oldFXAAReproject = temporalReproject;
+		for (fxaaQuality = 0; fxaaQuality < maxFXAAQuality; fxaaQuality++) {
+			fxaaTemporalResolve = false;
+			renderer.precompileShaders(fxaaPipelineDesc());
+
+			fxaaTemporalResolve = true;
+			for (bool reproject : { false, true }) {
+				temporalReproject = reproject;
+				renderer.precompileShaders(fxaaPipelineDesc());
+			}
+		}
+		fxaaQuality         = oldFXAAQuality;
+		fxaaTemporalResolve = oldFXAAResolve;
+		temporalReproject   = oldFXAAReproject;
+
+		const unsigned int   oldSMAAQuality = smaaQuality;
+		const SMAAEdgeMethod oldEdgeMethod  = smaaEdgeMethod;
+		const bool           oldPredication = smaaPredication;
+		const AAMethod       oldMethod      = aaMethod;
+		for (smaaQuality = 0; smaaQuality < maxSMAAQuality; smaaQuality++) {
+			// S2X shaders do both subsamples at once so they are their own variants
+			for (AAMethod method : { AAMethod::SMAA, AAMethod::SMAA2X }) {
+				aaMethod = method;
+				renderer.precompileShaders(smaaWeightsPipelineDesc());
+				renderer.precompileShaders(smaaBlendPipelineDesc());
+			}
+			aaMethod = AAMethod::SMAA;
+			if (renderer.getFeatures().computeShaders) {
+				renderer.precompileShaders(smaaWeightsComputePipelineDesc());
+				if (renderer.getFeatures().subgroupBallot) {
+					const bool oldSubgroupSearch = smaaSubgroupSearch;
+					smaaSubgroupSearch = !oldSubgroupSearch;
+					renderer.precompileShaders(smaaWeightsComputePipelineDesc());
+					smaaSubgroupSearch = oldSubgroupSearch;
+				}
+			}
 
-			cube.color.x = sRGB2linear(r);
-			cube.color.y = sRGB2linear(g);
-			cube.color.z = sRGB2linear(b);
+			for (SMAAEdgeMethod method : { SMAAEdgeMethod::Color, SMAAEdgeMethod::Luma, SMAAEdgeMethod::Depth }) {
+				for (bool predication : { false, true }) {
+					// depth edges ignore predication
+					if (predication && method == SMAAEdgeMethod::Depth) {
+						continue;
+					}
+					smaaEdgeMethod  = method;
+					smaaPredication = predication;
+					aaMethod        = AAMethod::SMAA2X;
+					renderer.precompileShaders(smaaEdgePipelineDesc());
+					aaMethod        = AAMethod::SMAA;
+					renderer.precompileShaders(smaaEdgePipelineDesc());
+					if (renderer.getFeatures().computeShaders) {
+						renderer.precompileShaders(smaaEdgeComputePipelineDesc());
+					}
+				}
+			}
 		}
+		smaaQuality     = oldSMAAQuality;
+		smaaEdgeMethod  = oldEdgeMethod;
+		smaaPredication = oldPredication;
+		aaMethod        = oldMethod;
 	}
+	halfPrecision = oldHalfPrecision;
+
+	renderer.waitForShaders();
 }
 
 
-void SMAADemo::setAntialiasing(bool enabled) {
-	antialiasing = enabled;
-	rebuildRG    = true;
+void SMAADemo::loadImage(const std::string &filename) {
+	images.push_back(Image());
+	auto &img      = images.back();
+	img.filename   = filename;
+	auto lastSlash = filename.rfind('/');
+	if (lastSlash != std::string::npos) {
+		img.shortName = filename.substr(lastSlash + 1);
+	}
+	else {
+		img.shortName = filename;
+	}
+
+	// placeholder is shown until the texture is ready
+	// updateImageResidency starts loading it
+	activeScene = static_cast<unsigned int>(images.size());
 }
 
 
-void SMAADemo::setTemporalAA(bool enabled) {
-	temporalAA = enabled;
-	rebuildRG = true;
+void SMAADemo::requestImage(unsigned int index) {
+	auto &img = images.at(index);
+	if (img.tex || img.tiled || img.loading || img.failed) {
+		return;
+	}
+
+	img.loading = true;
+	std::string filename = img.filename;
+	std::string name     = img.shortName;
+	jobSystem.runBackground(&imageLoadJobs, [this, index, filename, name] () {
+		decodeImage(index, filename, name);
+	} );
+	numPendingImages++;
 }
 
 
-static void printHelp() {
-	printf(" a                - toggle antialiasing on/off\n");
-	printf(" c                - re-color cubes\n");
-	printf(" d                - cycle through debug visualizations\n");
-	printf(" f                - toggle fullscreen\n");
-	printf(" h                - print help\n");
-	printf(" m                - change antialiasing method\n");
-	printf(" q                - cycle through AA quality levels\n");
-	printf(" t                - toggle temporal antialiasing on/off\n");
-	printf(" v                - toggle vsync\n");
-	printf(" LEFT/RIGHT ARROW - cycle through scenes\n");
-	printf(" SPACE            - toggle cube rotation\n");
-	printf(" ESC              - quit\n");
-}
+void SMAADemo::updateImageResidency() {
+	if (images.empty()) {
+		return;
+	}
 
+	imageUseCounter++;
 
-void SMAADemo::processInput() {
-#ifndef IMGUI_DISABLE
-	ImGuiIO& io = ImGui::GetIO();
-#endif  // IMGUI_DISABLE
+	// active image first so it's decoded before the neighbors
+	if (isImageScene()) {
+		unsigned int numImages = static_cast<unsigned int>(images.size());
+		unsigned int active    = activeScene - 1;
+		for (unsigned int index : { active, (active + 1) % numImages, (active + numImages - 1) % numImages }) {
+			images.at(index).lastUsed = imageUseCounter;
+			requestImage(index);
+		}
+	}
 
-	SDL_Event event;
-	memset(&event, 0, sizeof(SDL_Event));
-	while (SDL_PollEvent(&event)) {
-		int sceneIncrement = 1;
-		switch (event.type) {
-		case SDL_QUIT:
-			keepGoing = false;
-			break;
+	// don't push the renderer over its budget either
+	uint64_t budget = imageMemoryBudget;
+	MemoryStats stats = renderer.getMemStats();
+	if (stats.budgetBytes != 0) {
+		uint64_t margin = uint64_t(memoryBudgetMarginMB) * 1024 * 1024;
+		uint64_t others = (stats.budgetUsageBytes > residentImageMemory) ? (stats.budgetUsageBytes - residentImageMemory) : 0;
+		uint64_t available = (stats.budgetBytes > others + margin) ? (stats.budgetBytes - others - margin) : 0;
+		budget = std::min(budget, available);
+	}
 
-		case SDL_KEYDOWN:
-#ifndef IMGUI_DISABLE
-			io.KeysDown[event.key.keysym.scancode] = true;
-#endif  // IMGUI_DISABLE
+	while (residentImageMemory > budget) {
+		// least recently used resident image which isn't currently wanted
+		Image *lru = nullptr;
+		for (auto &img : images) {
+			if ((img.tex || img.tiled) && img.lastUsed != imageUseCounter && (!lru || img.lastUsed < lru->lastUsed)) {
+				lru = &img;
+			}
+		}
 
-			switch (event.key.keysym.scancode) {
-			case SDL_SCANCODE_LSHIFT:
-				leftShift = true;
-				break;
+		if (!lru) {
+			// the wanted images alone don't fit, keep them anyway
+			break;
+		}
 
-			case SDL_SCANCODE_RSHIFT:
-				rightShift = true;
-				break;
+		LOG_DEBUG("Evicting image %s (%u KB)\n", lru->shortName.c_str(), static_cast<unsigned int>(lru->memorySize / 1024));
+		if (lru->tiled) {
+			imagePageCache.remove(renderer, *lru->tiled);
+			lru->tiled.reset();
+		} else {
+			renderer.deleteTexture(lru->tex);
+			lru->tex = TextureHandle();
+		}
+		assert(residentImageMemory >= lru->memorySize);
+		residentImageMemory -= lru->memorySize;
+		lru->memorySize      = 0;
+	}
+}
 
-			case SDL_SCANCODE_LALT:
-				leftAlt = true;
-				break;
 
-			case SDL_SCANCODE_RALT:
-				rightAlt = true;
-				break;
+bool SMAADemo::updateImagePages() {
+	assert(isImageScene());
+	auto &img = images.at(activeScene - 1);
+	if (!img.tiled) {
+		return false;
+	}
+	TiledImage &tiled = *img.tiled;
 
-			case SDL_SCANCODE_LCTRL:
-				leftCtrl = true;
-				break;
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+	glm::uvec2 viewport = scaledSize(windowWidth, windowHeight);
+
+	// part of the image on screen in texcoords
+	glm::vec2 halfSize(0.5f / imageZoom);
+	glm::vec2 lo = glm::clamp(imageCenter - halfSize, 0.0f, 1.0f);
+	glm::vec2 hi = glm::clamp(imageCenter + halfSize, 0.0f, 1.0f);
+
+	// same level the fragment shader picks from its derivatives
+	float ratio = std::max(float(tiled.getWidth()) / (imageZoom * viewport.x), float(tiled.getHeight()) / (imageZoom * viewport.y));
+	const unsigned int last = tiled.getNumLevels() - 1;
+	unsigned int level = 0;
+	if (ratio > 1.0f) {
+		level = std::min(static_cast<unsigned int>(log2f(ratio)), last);
+	}
 
-			case SDL_SCANCODE_RCTRL:
-				rightCtrl = true;
-				break;
+	// coarsest first so the shader always has something to fall back to
+	// and the next coarser level so zooming out doesn't go blurry
+	imagePageCache.beginFrame(maxImagePageUploads);
+	imagePageCache.request(renderer, tiled, last, lo, hi);
+	if (level + 1 < last) {
+		imagePageCache.request(renderer, tiled, level + 1, lo, hi);
+	}
+	if (level < last) {
+		imagePageCache.request(renderer, tiled, level, lo, hi);
+	}
+	return imagePageCache.updatePageTable(renderer, tiled);
+}
 
-			default:
-				break;
-			}
 
-#ifndef IMGUI_DISABLE
+// decodes to RGBA8 straight into dst when stb allocates its output at exactly the right size
+// otherwise, like for JPEG which asks for a byte more, it's copied there
+// returns the reason on failure
+static const char *stbiDecodeInto(const MappedFile &file, unsigned int width, unsigned int height, void *dst) {
+	const size_t size = size_t(width) * height * 4;
+	stbiTarget.ptr   = dst;
+	stbiTarget.size  = size;
+	stbiTarget.taken = false;
 
-			if (textInputActive) {
-				break;
-			}
+	int w = 0, h = 0;
+	stbi_uc *pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(file.data()), static_cast<int>(file.size()), &w, &h, NULL, 4);
 
-#endif  // IMGUI_DISABLE
+	stbiTarget.ptr   = nullptr;
+	stbiTarget.size  = 0;
+	stbiTarget.taken = false;
 
-			switch (event.key.keysym.scancode) {
-			case SDL_SCANCODE_ESCAPE:
-				keepGoing = false;
-				break;
+	if (!pixels) {
+		return stbi_failure_reason();
+	}
 
-			case SDL_SCANCODE_SPACE:
-				rotateCubes = !rotateCubes;
-				break;
+	bool sizeMatches = (static_cast<unsigned int>(w) == width && static_cast<unsigned int>(h) == height);
+	if (pixels != dst) {
+		if (sizeMatches) {
+			memcpy(dst, pixels, size);
+		}
+		stbi_image_free(pixels);
+	}
 
-			case SDL_SCANCODE_A:
-				setAntialiasing(!antialiasing);
-				break;
+	return sizeMatches ? nullptr : "size differs from the header";
+}
 
-			case SDL_SCANCODE_C:
-				if (rightShift || leftShift) {
-					colorMode = (colorMode + 1) % 2;
-				}
-				colorCubes();
-				break;
 
-			case SDL_SCANCODE_D:
-				if (antialiasing && aaMethod == +AAMethod::SMAA) {
-					if (leftShift || rightShift) {
-						debugMode = (debugMode + 3 - 1) % 3;
-					} else {
-						debugMode = (debugMode + 1) % 3;
+void SMAADemo::decodeImage(unsigned int index, const std::string &filename, const std::string &name) {
+	{
+		std::unique_lock<std::mutex> lock(imageLoadMutex);
+		if (imageLoadStop) {
+			return;
+		}
+	}
+
+	DecodedImage decoded;
+	decoded.index = index;
+	try {
+		if (TextureFile::isTextureFile(filename)) {
+			decoded.file   = std::make_unique<TextureFile>(filename);
+			decoded.width  = decoded.file->getWidth();
+			decoded.height = decoded.file->getHeight();
+		} else {
+			MappedFile file(filename);
+			int channels = 0;
+			// captures need everything on the main thread
+			bool direct = renderer.getFeatures().threadedResourceCreation && rendererDesc.captureFile.empty() && !tiledImages;
+			if (direct && stbi_info_from_memory(reinterpret_cast<const stbi_uc *>(file.data()), static_cast<int>(file.size()), &decoded.width, &decoded.height, &channels)
+			    && decoded.width > 0 && decoded.height > 0 && decoded.width < MAX_TEXTURE_SIZE && decoded.height < MAX_TEXTURE_SIZE) {
+				// no copy of the pixels in between
+				TextureDesc texDesc;
+				texDesc.width(decoded.width)
+				       .height(decoded.height)
+				       .name(name)
+				       .format(Format::sRGBA8)
+				       .generateMips(true);
+
+				const unsigned int width = decoded.width, height = decoded.height;
+				texDesc.mipLevelWriter([&] (unsigned int level, void *dst, unsigned int size) {
+					assert(level == 0);
+					assert(size == width * height * 4);
+					const char *reason = stbiDecodeInto(file, width, height, dst);
+					if (reason) {
+						decoded.error = reason;
+						memset(dst, 0, size);
 					}
-					rebuildRG = true;
-				}
-				break;
+				} );
 
-			case SDL_SCANCODE_H:
-				printHelp();
-				break;
+				decoded.tex = renderer.createTexture(texDesc);
+			} else {
+				decoded.data  = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(file.data()), static_cast<int>(file.size()), &decoded.width, &decoded.height, NULL, 4);
+				if (!decoded.data) {
+					decoded.error = stbi_failure_reason();
+				} else if (tiledImages || decoded.width >= MAX_TEXTURE_SIZE || decoded.height >= MAX_TEXTURE_SIZE) {
+					// the mip chain is built here instead of on the GPU
+					decoded.tiled = std::make_unique<TiledImage>(decoded.data, decoded.width, decoded.height);
+					decoded.data  = nullptr;
+				}
+			}
+		}
+	} catch (std::exception &e) {
+		decoded.error = e.what();
+	}
 
-			case SDL_SCANCODE_M: {
-				int i = aaMethod._to_integral();
+	std::unique_lock<std::mutex> lock(imageLoadMutex);
+	decodedImages.emplace_back(std::move(decoded));
+}
 
-				if (leftShift || rightShift) {
-					i = i - 1 + AAMethod::_size();
-				} else {
-					i = i + 1;
-				}
-				i = i % AAMethod::_size();
-				aaMethod = AAMethod::_from_integral(i);
-				rebuildRG = true;
-				} break;
+
+void SMAADemo::processDecodedImages() {
+	std::vector<DecodedImage> decoded;
+	{
+		std::unique_lock<std::mutex> lock(imageLoadMutex);
+		if (decodedImages.empty()) {
+			return;
+		}
+		std::swap(decoded, decodedImages);
+	}
+
+	for (auto &d : decoded) {
+		assert(numPendingImages > 0);
+		numPendingImages--;
+
+		auto &img = images.at(d.index);
+		assert(img.loading);
+		assert(!img.tex);
+		assert(!img.tiled);
+		img.loading = false;
+		LOG(" %s : %p  %dx%d\n", img.filename.c_str(), d.data, d.width, d.height);
+		if (d.tex && !d.error.empty()) {
+			renderer.deleteTexture(d.tex);
+			d.tex = TextureHandle();
+		}
+		if (d.file && !renderer.isTextureFormatSupported(d.file->getFormat())) {
+			d.error = std::string("Texture format ") + d.file->getFormat()._to_string() + " not supported";
+			d.file.reset();
+		}
+		if (!d.data && !d.file && !d.tiled && !d.tex) {
+			LOG("Bad image: %s\n", d.error.c_str());
+			img.shortName += " (failed)";
+			img.failed = true;
+			continue;
+		}
+
+		if (d.tiled) {
+			if (!imagePageCache.getBuffer()) {
+				unsigned int pageBytes = IMAGE_PAGE_SIZE * IMAGE_PAGE_SIZE * 4;
+				imagePageCache.create(renderer, std::max(imagePageCacheMB * 1024 * 1024 / pageBytes, 1u));
+			}
+
+			LOG(" %u levels of %u pixel pages\n", d.tiled->getNumLevels(), IMAGE_PAGE_SIZE);
+			img.width      = d.width;
+			img.height     = d.height;
+			img.tiled      = std::move(d.tiled);
+			imagePageCache.add(renderer, *img.tiled);
+			// the page cache is shared and the pixels are in CPU memory
+			img.memorySize = img.tiled->getPageTableSize();
+			residentImageMemory += img.memorySize;
+			continue;
+		}
+
+		// plus a third for the mip chain
+		const uint64_t rgbaMemorySize = uint64_t(d.width) * d.height * 4 * 4 / 3;
+		if (d.tex) {
+			img.width      = d.width;
+			img.height     = d.height;
+			img.tex        = d.tex;
+			d.tex          = TextureHandle();
+			img.memorySize = rgbaMemorySize;
+			residentImageMemory += rgbaMemorySize;
+			continue;
+		}
+
+		TextureDesc texDesc;
+		uint64_t memorySize = 0;
+		if (d.file) {
+			d.file->describe(texDesc).name(img.shortName);
+			LOG(" %s with %u mip levels\n", d.file->getFormat()._to_string(), d.file->getNumMips());
+			unsigned int w = d.width, h = d.height;
+			for (unsigned int i = 0; i < d.file->getNumMips(); i++) {
+				memorySize += formatDataSize(d.file->getFormat(), w, h);
+				w = std::max(w / 2, 1u);
+				h = std::max(h / 2, 1u);
+			}
+		} else {
+			texDesc.width(d.width)
+			       .height(d.height)
+			       .name(img.shortName)
+			       .format(Format::sRGBA8)
+			       .generateMips(true);
+
+			texDesc.mipLevelData(0, d.data, d.width * d.height * 4);
+			memorySize = rgbaMemorySize;
+		}
+		img.width      = d.width;
+		img.height     = d.height;
+		img.tex        = renderer.createTexture(texDesc);
+		img.memorySize = memorySize;
+		residentImageMemory += memorySize;
+	}
+}
+
+
+// cubes per jobSystem.parallelFor slice, not worth splitting smaller
+static const unsigned int minCubeSliceSize = 16384;
+
+
+void SMAADemo::createCubes() {
+	if (sceneFile) {
+		createSceneCubes();
+		return;
+	}
+
+	if (fixedSeed) {
+		random.seed(randomSeed);
+	}
+
+	// cube of cubes, n^3 cubes total
+	const unsigned int numCubes = static_cast<unsigned int>(pow(cubesPerSide, 3));
+
+	const float cubeDiameter = sqrtf(3.0f);
+	const float cubeDistance = cubeDiameter + 1.0f;
+
+	const float bigCubeSide = cubeDistance * cubesPerSide;
+
+	cubes.clear();
+	cubes.resize(numCubes);
+
+	// every slice gets its own generator advanced to its first cube
+	// so the result doesn't depend on the number of threads
+	const uint64_t seed = random.randU32();
+	const unsigned int n = cubesPerSide;
+	jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+		RandomGen sliceRandom(seed);
+		sliceRandom.discard(uint64_t(begin) * 4);
+
+		for (unsigned int i = begin; i < end; i++) {
+			const unsigned int x = i / (n * n);
+			const unsigned int y = (i / n) % n;
+			const unsigned int z = i % n;
+
+			glm::vec4 q(sliceRandom.randFloat(), sliceRandom.randFloat(), sliceRandom.randFloat(), sliceRandom.randFloat());
+			q *= 1.0f / sqrtf(glm::dot(q, q));
+
+			ShaderDefines::Cube &cube = cubes[i];
+			cube.position = glm::vec3((x * cubeDistance) - (bigCubeSide / 2.0f)
+			                        , (y * cubeDistance) - (bigCubeSide / 2.0f)
+			                        , (z * cubeDistance) - (bigCubeSide / 2.0f));
+
+			cube.order    = i;
+			cube.rotation = q;
+			cube.color    = glm::vec3(1.0f, 1.0f, 1.0f);
+		}
+	});
+
+	colorCubes();
+}
+
+
+void SMAADemo::shuffleCubeRendering() {
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+
+	// shuffle a permutation instead of moving whole cubes around
+	std::vector<uint32_t> permutation(numCubes);
+	for (unsigned int i = 0; i < numCubes; i++) {
+		permutation[i] = i;
+	}
+	for (unsigned int i = 0; i < numCubes - 1; i++) {
+		unsigned int victim = random.range(i, numCubes);
+		std::swap(permutation[i], permutation[victim]);
+	}
+
+	std::vector<ShaderDefines::Cube> shuffled(numCubes);
+	jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			shuffled[i] = cubes[permutation[i]];
+		}
+	});
+	cubes.swap(shuffled);
+	cubesDirty = true;
+}
+
+
+void SMAADemo::reorderCubeRendering() {
+	// order is a permutation of [0, numCubes) assigned by createCubes
+	// so sorting by it is a single scatter
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	std::vector<ShaderDefines::Cube> sorted(numCubes);
+	jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			const auto &cube = cubes[i];
+			assert(cube.order < numCubes);
+			sorted[cube.order] = cube;
+		}
+	});
+	cubes.swap(sorted);
+	cubesDirty = true;
+}
+
+
+void SMAADemo::sortCubesFrontToBack(const glm::vec3 &eye) {
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+
+	// squared distances are non-negative so their bit patterns
+	// sort the same way as the floats themselves
+	std::vector<uint32_t> keys(numCubes);
+	jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			glm::vec3 d = cubes[i].position - eye;
+			float dist  = glm::dot(d, d);
+			memcpy(&keys[i], &dist, sizeof(uint32_t));
+		}
+	});
+
+	// LSD radix sort of a permutation, 8 bits per pass
+	std::vector<uint32_t> permutation(numCubes);
+	std::vector<uint32_t> temp(numCubes);
+	for (unsigned int i = 0; i < numCubes; i++) {
+		permutation[i] = i;
+	}
+
+	for (unsigned int shift = 0; shift < 32; shift += 8) {
+		std::array<unsigned int, 257> offsets;
+		offsets.fill(0);
+		for (uint32_t p : permutation) {
+			offsets[((keys[p] >> shift) & 0xFF) + 1]++;
+		}
+		for (unsigned int i = 0; i < 256; i++) {
+			offsets[i + 1] += offsets[i];
+		}
+		for (uint32_t p : permutation) {
+			temp[offsets[(keys[p] >> shift) & 0xFF]++] = p;
+		}
+		permutation.swap(temp);
+	}
+
+	std::vector<ShaderDefines::Cube> sorted(numCubes);
+	jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			sorted[i] = cubes[permutation[i]];
+		}
+	});
+	cubes.swap(sorted);
+	cubesDirty = true;
+}
+
+
+static float sRGB2linear(float v) {
+    if (v <= 0.04045f) {
+        return v / 12.92f;
+    } else {
+        return powf((v + 0.055f) / 1.055f, 2.4f);
+    }
+}
+
+
+static float linear2sRGB(float v) {
+    if (v <= 0.0031308f) {
+        return v * 12.92f;
+    } else {
+        return 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+    }
+}
+
+
+static uint32_t packFixed16(float v) {
+	float scaled = glm::clamp(roundf(v * float(COMPACT_CUBE_POSITION_SCALE)), -32768.0f, 32767.0f);
+	return static_cast<uint32_t>(static_cast<int32_t>(scaled)) & 0xFFFFU;
+}
+
+
+// unpacked by unpackCube in shaderDefines.h
+static ShaderDefines::CompactCube packCube(const ShaderDefines::Cube &cube) {
+	ShaderDefines::CompactCube c;
+
+	// q and -q are the same rotation, pick the one with the largest component positive
+	// the others are then at most 1/sqrt(2) in magnitude
+	glm::vec4 q = cube.rotation;
+	unsigned int largest = 0;
+	for (unsigned int i = 1; i < 4; i++) {
+		if (fabsf(q[i]) > fabsf(q[largest])) {
+			largest = i;
+		}
+	}
+	if (q[largest] < 0.0f) {
+		q = -q;
+	}
+
+	c.rotation = largest << 30;
+	unsigned int shift = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		if (i == largest) {
+			continue;
+		}
+		float n = glm::clamp(q[i] * sqrtf(2.0f) * 0.5f + 0.5f, 0.0f, 1.0f);
+		c.rotation |= static_cast<uint32_t>(roundf(n * 1023.0f)) << shift;
+		shift += 10;
+	}
+
+	assert(cube.order < (1U << 24));
+	c.positionXY     = packFixed16(cube.position.x) | (packFixed16(cube.position.y) << 16);
+	c.positionZOrder = packFixed16(cube.position.z) | ((cube.order & 0xFFFFU) << 16);
+
+	c.colorOrder = (cube.order >> 16) << 24;
+	for (unsigned int i = 0; i < 3; i++) {
+		float s = glm::clamp(linear2sRGB(cube.color[i]), 0.0f, 1.0f);
+		c.colorOrder |= static_cast<uint32_t>(roundf(s * 255.0f)) << (8 * i);
+	}
+
+	return c;
+}
+
+
+void SMAADemo::colorCubes() {
+	// scene file colors come from its materials
+	if (sceneFile) {
+		return;
+	}
+
+	// same per-slice generator scheme as createCubes
+	const uint64_t seed = random.randU32();
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	if (colorMode == 0) {
+		jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+			RandomGen sliceRandom(seed);
+			sliceRandom.discard(uint64_t(begin) * 3);
+
+			for (unsigned int i = begin; i < end; i++) {
+				// random RGB
+				auto &cube = cubes[i];
+				cube.color.x = sRGB2linear(sliceRandom.randFloat());
+				cube.color.y = sRGB2linear(sliceRandom.randFloat());
+				cube.color.z = sRGB2linear(sliceRandom.randFloat());
+			}
+		});
+	} else {
+		jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+			RandomGen sliceRandom(seed);
+			sliceRandom.discard(uint64_t(begin) * 2);
+
+			for (unsigned int i = begin; i < end; i++) {
+				// YCbCr, fixed luma, random chroma, alpha = 1.0
+				// worst case scenario for luma edge detection
+				// TODO: use the same luma as shader
+
+				float y = 0.3f;
+				const float c_red   = 0.299f
+				          , c_green = 0.587f
+				          , c_blue  = 0.114f;
+				float cb = sliceRandom.randFloat() * 2.0f - 1.0f;
+				float cr = sliceRandom.randFloat() * 2.0f - 1.0f;
+
+				float r = cr * (2 - 2 * c_red) + y;
+				float g = (y - c_blue * cb - c_red * cr) / c_green;
+				float b = cb * (2 - 2 * c_blue) + y;
+
+				auto &cube = cubes[i];
+				cube.color.x = sRGB2linear(r);
+				cube.color.y = sRGB2linear(g);
+				cube.color.z = sRGB2linear(b);
+			}
+		});
+	}
+	cubesDirty = true;
+}
+
+
+void SMAADemo::createSceneBuffers() {
+	assert(sceneFile);
+	assert(!sceneVBO);
+	assert(sceneMeshArgs.empty());
+
+	// createBuffer copies from the mapping so nothing is read into memory first
+	sceneVBO = renderer.createBuffer(BufferType::Vertex, sceneFile->getNumVertices() * sizeof(SceneVertex), sceneFile->getVertices());
+	sceneIBO = renderer.createBuffer(BufferType::Index,  sceneFile->getNumIndices()  * sizeof(uint32_t),    sceneFile->getIndices());
+
+	const unsigned int numMeshes = sceneFile->getNumMeshes();
+	std::vector<uint32_t> meshInstances(numMeshes, 0);
+	for (unsigned int i = 0; i < sceneFile->getNumInstances(); i++) {
+		meshInstances[sceneFile->getInstance(i).mesh]++;
+	}
+
+	sceneMeshArgs.reserve(numMeshes);
+	for (unsigned int i = 0; i < numMeshes; i++) {
+		const SceneMesh &mesh = sceneFile->getMesh(i);
+
+		DrawIndexedIndirectArgs args;
+		args.indexCount    = mesh.indexCount;
+		args.instanceCount = meshInstances[i];
+		args.firstIndex    = mesh.firstIndex;
+		args.vertexOffset  = static_cast<int32_t>(mesh.firstVertex);
+		args.firstInstance = 0;
+		sceneMeshArgs.push_back(renderer.createBuffer(BufferType::Indirect, sizeof(DrawIndexedIndirectArgs), &args));
+	}
+}
+
+
+void SMAADemo::createSceneCubes() {
+	assert(sceneFile);
+
+	const unsigned int numMeshes    = sceneFile->getNumMeshes();
+	const unsigned int numInstances = sceneFile->getNumInstances();
+
+	// counting sort by mesh so each mesh is a single instanced draw
+	sceneMeshFirstInstance.assign(numMeshes + 1, 0);
+	for (unsigned int i = 0; i < numInstances; i++) {
+		sceneMeshFirstInstance[sceneFile->getInstance(i).mesh + 1]++;
+	}
+	for (unsigned int i = 0; i < numMeshes; i++) {
+		sceneMeshFirstInstance[i + 1] += sceneMeshFirstInstance[i];
+	}
+
+	std::vector<uint32_t> next(sceneMeshFirstInstance.begin(), sceneMeshFirstInstance.end() - 1);
+	sceneInstanceOrder.resize(numInstances);
+	for (unsigned int i = 0; i < numInstances; i++) {
+		sceneInstanceOrder[next[sceneFile->getInstance(i).mesh]++] = i;
+	}
+
+	cubes.clear();
+	cubes.resize(numInstances);
+	jobSystem.parallelFor(numInstances, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			const SceneInstance &inst     = sceneFile->getInstance(sceneInstanceOrder[i]);
+			const SceneMaterial &material = sceneFile->getMaterial(inst.material);
+
+			ShaderDefines::Cube &cube = cubes[i];
+			cube.position = glm::vec3(inst.position[0], inst.position[1], inst.position[2]);
+			cube.order    = i;
+			cube.color    = glm::vec3(material.color[0], material.color[1], material.color[2]);
+			cube.pad1     = 0.0f;
+		}
+	});
+
+	updateSceneInstances();
+	cubesDirty = true;
+}
+
+
+void SMAADemo::updateSceneInstances() {
+	assert(sceneFile);
+	assert(cubes.size() == sceneInstanceOrder.size());
+
+	const float seconds = float(double(sceneTime) / 1000000000.0);
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	jobSystem.parallelFor(numCubes, minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			cubes[i].rotation = sceneFile->rotationAt(sceneInstanceOrder[i], seconds);
+		}
+	});
+	cubesDirty = true;
+}
+
+
+void SMAADemo::exportScene() {
+	assert(!exportSceneFile.empty());
+
+	std::vector<SceneVertex> sceneVertices;
+	for (const Vertex &v : vertices) {
+		sceneVertices.push_back(SceneVertex { { v.x, v.y, v.z } });
+	}
+	std::vector<uint32_t> sceneIndices(std::begin(indices), std::end(indices));
+
+	std::vector<SceneMesh> meshes(1);
+	meshes[0].firstIndex  = 0;
+	meshes[0].indexCount  = static_cast<uint32_t>(sceneIndices.size());
+	meshes[0].firstVertex = 0;
+	meshes[0].vertexCount = static_cast<uint32_t>(sceneVertices.size());
+
+	// one material per cube keeps the colors as they are
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+	std::vector<SceneMaterial>  materials(numCubes);
+	std::vector<SceneInstance>  instances(numCubes);
+	for (unsigned int i = 0; i < numCubes; i++) {
+		const auto &cube = cubes[i];
+
+		materials[i].color[0] = cube.color.x;
+		materials[i].color[1] = cube.color.y;
+		materials[i].color[2] = cube.color.z;
+		materials[i].pad      = 0.0f;
+
+		SceneInstance &inst = instances[i];
+		inst.mesh        = 0;
+		inst.material    = i;
+		inst.position[0] = cube.position.x;
+		inst.position[1] = cube.position.y;
+		inst.position[2] = cube.position.z;
+		inst.rotation[0] = cube.rotation.x;
+		inst.rotation[1] = cube.rotation.y;
+		inst.rotation[2] = cube.rotation.z;
+		inst.rotation[3] = cube.rotation.w;
+		inst.angularVelocity[0] = 0.0f;
+		inst.angularVelocity[1] = 0.0f;
+		inst.angularVelocity[2] = 0.0f;
+	}
+
+	// the same orbit as the cube grid camera, one key per eighth of a turn
+	const unsigned int numKeys = 8;
+	std::vector<SceneCameraKey> cameraKeys(numKeys + 1);
+	for (unsigned int i = 0; i <= numKeys; i++) {
+		float angle = float(M_PI * 2.0 * i / numKeys);
+		SceneCameraKey &key = cameraKeys[i];
+		key.time      = float(rotationPeriodSeconds) * i / numKeys;
+		key.eye[0]    = cameraDistance * cosf(angle);
+		key.eye[1]    = 0.0f;
+		key.eye[2]    = cameraDistance * sinf(angle);
+		key.target[0] = 0.0f;
+		key.target[1] = 0.0f;
+		key.target[2] = 0.0f;
+		key.fovY      = float(65.0f * M_PI * 2.0f / 360.0f);
+	}
+
+	SceneFile::write(exportSceneFile, sceneVertices, sceneIndices, meshes, materials, instances, cameraKeys);
+	LOG("Wrote %u cubes to scene \"%s\"\n", numCubes, exportSceneFile.c_str());
+}
+
+
+void SMAADemo::setAntialiasing(bool enabled) {
+	antialiasing = enabled;
+	rebuildRG    = true;
+}
+
+
+void SMAADemo::setTemporalAA(bool enabled) {
+	temporalAA = enabled;
+	rebuildRG = true;
+}
+
+
+void SMAADemo::setBenchmarkDevice(const DeviceInfo &device, bool last, std::vector<BenchmarkResult> &&earlierResults) {
+	assert(benchmarkAllDevices);
+
+	rendererDesc.vulkanDeviceIndex = static_cast<int>(device.index);
+	benchmarkDevice                = device.name;
+	benchmarkLastDevice            = last;
+	benchmarkResults               = std::move(earlierResults);
+}
+
+
+std::string SMAADemo::benchmarkConfigName(const BenchmarkConfig &config) const {
+	if (!config.antialiasing) {
+		return "None";
+	}
+
+	std::string name(config.method._to_string());
+	name += " ";
+	switch (config.method) {
+	case AAMethod::MSAA:
+		name += msaaQualityLevels[config.quality];
+		break;
+
+	case AAMethod::FXAA:
+		name += fxaaQualityLevels[config.quality];
+		break;
+
+	case AAMethod::SMAA:
+	case AAMethod::SMAA2X:
+		name += smaaQualityLevels[config.quality];
+		break;
+	}
+
+	return name;
+}
+
+
+void SMAADemo::applyBenchmarkConfig() {
+	const auto &config = benchmarkConfigs.at(benchmarkCurrentConfig);
+	LOG("Benchmark %u/%u: %s\n", benchmarkCurrentConfig + 1, static_cast<unsigned int>(benchmarkConfigs.size()), benchmarkConfigName(config).c_str());
+	logFlush();
+
+	setAntialiasing(config.antialiasing);
+	aaMethod = config.method;
+	switch (config.method) {
+	case AAMethod::MSAA:
+		assert(config.quality < maxMSAAQuality);
+		msaaQuality = config.quality;
+		break;
+
+	case AAMethod::FXAA:
+		assert(config.quality < maxFXAAQuality);
+		fxaaQuality  = config.quality;
+		fxaaPipeline = PipelineHandle();
+		break;
+
+	case AAMethod::SMAA:
+	case AAMethod::SMAA2X:
+		assert(config.quality < maxSMAAQuality);
+		smaaQuality    = config.quality;
+		smaaParameters = defaultSMAAParameters[smaaQuality];
+		smaaPipelines.edgePipeline         = PipelineHandle();
+		smaaPipelines.blendWeightPipeline  = PipelineHandle();
+		smaaPipelines.neighborPipeline     = PipelineHandle();
+		smaaPipelines.tileResetPipeline          = PipelineHandle();
+		smaaPipelines.edgeComputePipeline        = PipelineHandle();
+		smaaPipelines.blendWeightComputePipeline = PipelineHandle();
+		break;
+	}
+
+	// every configuration starts from the same camera and rotations
+	sceneTime           = 0;
+	rotationTime        = 0;
+	cameraRotation      = 0.0f;
+	benchmarkFrame      = 0;
+	benchmarkGPUSamples = 0;
+	benchmarkFrameTimes.clear();
+	benchmarkFrameTimes.reserve(benchmarkMeasuredFrames);
+	benchmarkGPUTimes.clear();
+	benchmarkGPUFrameTimes.clear();
+	benchmarkGPUPassSamples.clear();
+	benchmarkGPUCounters.clear();
+	benchmarkGPUCounterSamples.clear();
+	benchmarkLatencyTotal   = 0;
+	benchmarkLatencySamples = 0;
+	sweepReadbackRequested  = false;
+	sweepReadbackDone       = false;
+
+	// again at the end of warm-up, this covers no warm-up at all
+	renderer.resetCallStats();
+#ifdef ALLOCATION_TRACKING
+	benchmarkAllocations    = allocationCount.load(std::memory_order_relaxed);
+#endif  // ALLOCATION_TRACKING
+	if (powerMonitor) {
+		powerMonitor->begin();
+	}
+}
+
+
+void SMAADemo::benchmarkFrameDone(uint64_t elapsed) {
+	assert(benchmarkActive());
+	assert(benchmarkCurrentConfig < benchmarkConfigs.size());
+
+	// don't measure placeholders
+	if (numPendingImages > 0) {
+		return;
+	}
+
+	if (!sweepFile.empty() && images.at(sweepImage).failed) {
+		LOG("Quality sweep skipping %s\n", images.at(sweepImage).shortName.c_str());
+		nextSweepImage();
+		return;
+	}
+
+	benchmarkFrame++;
+	// warm-up also lets GPU timings of the previous configuration drain
+	if (benchmarkFrame <= benchmarkWarmupFrames) {
+		if (benchmarkFrame == benchmarkWarmupFrames) {
+			renderer.resetCallStats();
+#ifdef ALLOCATION_TRACKING
+			benchmarkAllocations = allocationCount.load(std::memory_order_relaxed);
+#endif  // ALLOCATION_TRACKING
+			if (powerMonitor) {
+				powerMonitor->begin();
+			}
+		}
+		return;
+	}
+
+	if (!sweepFile.empty()) {
+		sweepFrameDone();
+	}
+
+	if (benchmarkFrameTimes.size() == benchmarkMeasuredFrames) {
+		// sweep keeps rendering until the readback arrives
+		assert(!sweepReadbackDone);
+		return;
+	}
+
+	benchmarkFrameTimes.push_back(elapsed);
+	if (powerMonitor) {
+		powerMonitor->sample();
+	}
+
+	const auto &timings = renderer.getGPUTimings();
+	if (benchmarkGPUTimes.empty()) {
+		for (const auto &t : timings) {
+			benchmarkGPUTimes.emplace_back(t.name, 0);
+		}
+		benchmarkGPUPassSamples.resize(timings.size());
+		benchmarkGPUCounters.resize(timings.size(), std::vector<double>(renderer.getPerformanceCounters().size(), 0.0));
+		benchmarkGPUCounterSamples.resize(timings.size(), 0);
+	}
+
+	bool passesMatch = (timings.size() == benchmarkGPUTimes.size());
+	for (unsigned int i = 0; passesMatch && i < timings.size(); i++) {
+		passesMatch = (timings[i].name == benchmarkGPUTimes[i].first);
+	}
+	if (passesMatch && !timings.empty()) {
+		uint64_t frameTotal = 0;
+		for (unsigned int i = 0; i < timings.size(); i++) {
+			benchmarkGPUTimes[i].second += timings[i].nanoseconds;
+			benchmarkGPUPassSamples[i].push_back(float(timings[i].nanoseconds) / 1000000.0f);
+			frameTotal += timings[i].nanoseconds;
+
+			const auto &counters = timings[i].counters;
+			if (!counters.empty() && counters.size() == benchmarkGPUCounters[i].size()) {
+				for (unsigned int j = 0; j < counters.size(); j++) {
+					benchmarkGPUCounters[i][j] += counters[j];
+				}
+				benchmarkGPUCounterSamples[i]++;
+			}
+		}
+		benchmarkGPUFrameTimes.push_back(float(frameTotal) / 1000000.0f);
+		benchmarkGPUSamples++;
+	}
+
+	if (benchmarkFrameTimes.size() < benchmarkMeasuredFrames) {
+		return;
+	}
+
+	if (!sweepFile.empty() && !sweepReadbackDone) {
+		return;
+	}
+
+	BenchmarkResult result;
+	result.name   = benchmarkConfigName(benchmarkConfigs.at(benchmarkCurrentConfig));
+	result.frames = static_cast<unsigned int>(benchmarkFrameTimes.size());
+
+	result.cpuFrameTimes.reserve(benchmarkFrameTimes.size());
+	for (uint64_t t : benchmarkFrameTimes) {
+		result.cpuFrameTimes.push_back(float(t) / 1000000.0f);
+	}
+	std::sort(benchmarkFrameTimes.begin(), benchmarkFrameTimes.end());
+	auto percentile = [this] (unsigned int p) {
+		size_t idx = std::min(benchmarkFrameTimes.size() - 1, (benchmarkFrameTimes.size() * p) / 100);
+		return float(benchmarkFrameTimes[idx]) / 1000000.0f;
+	};
+
+	uint64_t cpuTotal = 0;
+	for (uint64_t t : benchmarkFrameTimes) {
+		cpuTotal += t;
+	}
+	result.cpuAverage = float(cpuTotal) / (1000000.0f * result.frames);
+	result.cpuMin     = float(benchmarkFrameTimes.front()) / 1000000.0f;
+	result.cpuMedian  = percentile(50);
+	result.cpu95th    = percentile(95);
+	result.cpu99th    = percentile(99);
+	result.cpuMax     = float(benchmarkFrameTimes.back()) / 1000000.0f;
+
+	double variance = 0.0;
+	for (uint64_t t : benchmarkFrameTimes) {
+		double d = double(t) / 1000000.0 - result.cpuAverage;
+		variance += d * d;
+	}
+	result.cpuStdDev  = float(sqrt(variance / result.frames));
+
+	if (benchmarkLatencySamples > 0) {
+		result.latencyAverage   = float(benchmarkLatencyTotal) / (1000000.0f * benchmarkLatencySamples);
+		result.latencyDisplayed = latencyDisplayed;
+	}
+
+	if (benchmarkGPUSamples > 0) {
+		for (const auto &p : benchmarkGPUTimes) {
+			float ms = float(p.second) / (1000000.0f * benchmarkGPUSamples);
+			result.gpuPassTimes.emplace_back(p.first, ms);
+			result.gpuTotal += ms;
+		}
+
+		result.gpuFrameTimes  = benchmarkGPUFrameTimes;
+		result.gpuPassSamples = benchmarkGPUPassSamples;
+
+		result.counterNames = renderer.getPerformanceCounters();
+		for (unsigned int i = 0; i < benchmarkGPUCounters.size(); i++) {
+			std::vector<double> averages;
+			if (benchmarkGPUCounterSamples[i] > 0) {
+				for (double c : benchmarkGPUCounters[i]) {
+					averages.push_back(c / benchmarkGPUCounterSamples[i]);
+				}
+			}
+			result.gpuPassCounters.emplace_back(std::move(averages));
+		}
+	}
+
+	result.memory = renderer.getMemStats();
+
+	if (powerMonitor) {
+		result.power = powerMonitor->end();
+	}
+
+#ifdef ALLOCATION_TRACKING
+	result.allocationsPerFrame = float(allocationCount.load(std::memory_order_relaxed) - benchmarkAllocations) / result.frames;
+#endif  // ALLOCATION_TRACKING
+	for (auto &c : renderer.getCallStats()) {
+		if (c.count > 0) {
+			result.calls.emplace_back(std::move(c));
+		}
+	}
+
+	LOG("Benchmark %s: CPU average %.3f ms, std dev %.3f ms, 99th percentile %.3f ms, GPU %.3f ms, latency %.3f ms\n", result.name.c_str(), result.cpuAverage, result.cpuStdDev, result.cpu99th, result.gpuTotal, result.latencyAverage);
+#ifdef RENDERER_CALL_STATS
+	LOG("Benchmark %s: %.0f ns per frame\n", result.name.c_str(), double(cpuTotal) / result.frames);
+#endif  // RENDERER_CALL_STATS
+#ifdef ALLOCATION_TRACKING
+	LOG("Benchmark %s: %.2f allocations per frame\n", result.name.c_str(), result.allocationsPerFrame);
+#endif  // ALLOCATION_TRACKING
+	if (result.power.cpuEnergy >= 0.0 || result.power.gpuEnergy >= 0.0) {
+		LOG("Benchmark %s: CPU %.3f mJ GPU %.3f mJ per frame\n", result.name.c_str()
+		   , 1000.0 * result.power.cpuEnergy / result.frames, 1000.0 * result.power.gpuEnergy / result.frames);
+	}
+	if (result.power.throttled) {
+		LOG("Benchmark %s: thermal throttling during measurement, timings are not reliable\n", result.name.c_str());
+	}
+	if (!sweepFile.empty()) {
+		result.image = images.at(sweepImage).shortName;
+	}
+	result.device = benchmarkDevice;
+	benchmarkResults.emplace_back(std::move(result));
+
+	benchmarkCurrentConfig++;
+	if (benchmarkCurrentConfig < benchmarkConfigs.size()) {
+		applyBenchmarkConfig();
+	} else if (!sweepFile.empty()) {
+		nextSweepImage();
+	} else {
+		if (benchmarkLastDevice) {
+			writeBenchmarkReport();
+		}
+		keepGoing = false;
+	}
+}
+
+
+void SMAADemo::sweepFrameDone() {
+	if (!sweepReadbackRequested) {
+		// of the next frame, warm-up is over
+		renderer.requestFrameReadback();
+		sweepReadbackRequested = true;
+		return;
+	}
+
+	if (sweepReadbackDone) {
+		return;
+	}
+
+	SweepJob job;
+	if (!renderer.getFrameReadback(job.readback)) {
+		return;
+	}
+	sweepReadbackDone = true;
+
+	// result of this configuration is added once its measured frames are done
+	job.result   = static_cast<unsigned int>(benchmarkResults.size());
+	job.image    = sweepImage;
+	job.filename = images.at(sweepImage).filename;
+
+	{
+		std::unique_lock<std::mutex> lock(sweepMutex);
+		sweepQueue.emplace_back(std::move(job));
+	}
+	sweepCV.notify_one();
+}
+
+
+void SMAADemo::nextSweepImage() {
+	sweepImage++;
+	if (sweepImage < images.size()) {
+		LOG("Quality sweep image %u/%u: %s\n", sweepImage + 1, static_cast<unsigned int>(images.size()), images.at(sweepImage).shortName.c_str());
+		activeScene            = sweepImage + 1;
+		benchmarkCurrentConfig = 0;
+		applyBenchmarkConfig();
+		return;
+	}
+
+	// let the sweep thread finish what's queued
+	{
+		std::unique_lock<std::mutex> lock(sweepMutex);
+		sweepStop = true;
+	}
+	sweepCV.notify_all();
+	sweepThread.join();
+
+	for (const auto &q : sweepQualities) {
+		auto &r = benchmarkResults.at(q.result);
+		r.psnr  = q.psnr;
+		r.ssim  = q.ssim;
+	}
+
+	if (!benchmarkFile.empty()) {
+		writeBenchmarkReport();
+	}
+	writeSweepReport();
+	keepGoing = false;
+}
+
+
+static void appendFormat(std::string &str, const char *fmt, ...) PRINTF(2, 3);
+
+
+static void appendFormat(std::string &str, const char *fmt, ...) {
+	char buf[1024];
+
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	assert(len >= 0);
+	str.append(buf, std::min(static_cast<size_t>(len), sizeof(buf) - 1));
+}
+
+
+static void appendSamples(std::string &str, const std::vector<float> &samples) {
+	str += "[";
+	for (unsigned int i = 0; i < samples.size(); i++) {
+		appendFormat(str, "%s%.4f", (i == 0) ? "" : ", ", samples[i]);
+	}
+	str += "]";
+}
+
+
+// medians of CPU and GPU frame times and each GPU pass against the same configuration and device
+// empty if the baseline doesn't have it
+static BaselineComparisons compareToBaseline(const BenchmarkResult &r, const std::vector<BaselineResult> &baseline) {
+	BaselineComparisons result;
+
+	auto it = std::find_if(baseline.begin(), baseline.end(), [&r] (const BaselineResult &b) {
+		return b.name == r.name && b.device == r.device;
+	} );
+	if (it == baseline.end()) {
+		return result;
+	}
+
+	result.emplace_back("cpu", compareSamples(it->cpuFrameTimes, r.cpuFrameTimes));
+	result.emplace_back("gpu", compareSamples(it->gpuFrameTimes, r.gpuFrameTimes));
+	for (unsigned int i = 0; i < r.gpuPassSamples.size(); i++) {
+		const std::string &pass = r.gpuPassTimes[i].first;
+		for (const auto &p : it->gpuPassTimes) {
+			if (p.first == pass) {
+				result.emplace_back(pass, compareSamples(p.second, r.gpuPassSamples[i]));
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+
+// joules over the measured frames to millijoules per frame
+static void appendEnergyPerFrame(std::string &str, double joules, unsigned int frames, const char *unknown) {
+	if (joules < 0.0 || frames == 0) {
+		str += unknown;
+	} else {
+		appendFormat(str, "%.4f", 1000.0 * joules / frames);
+	}
+}
+
+
+static bool isJSONFile(const std::string &filename) {
+	return (filename.size() >= 5) && (filename.compare(filename.size() - 5, 5, ".json") == 0);
+}
+
+
+void SMAADemo::writeBenchmarkReport() const {
+	bool json = isJSONFile(benchmarkFile);
+
+	// a bad baseline shouldn't lose the results
+	std::vector<BaselineComparisons> comparisons(benchmarkResults.size());
+	if (!benchmarkBaselineFile.empty()) {
+		try {
+			auto baseline = loadBenchmarkBaseline(benchmarkBaselineFile);
+			unsigned int regressions = 0;
+			for (unsigned int i = 0; i < benchmarkResults.size(); i++) {
+				const auto &r = benchmarkResults[i];
+				comparisons[i] = compareToBaseline(r, baseline);
+				if (comparisons[i].empty()) {
+					LOG("Baseline has no %s on \"%s\"\n", r.name.c_str(), r.device.c_str());
+				}
+				for (const auto &c : comparisons[i]) {
+					LOG("Baseline %s %s: %.3f -> %.3f ms, %+.3f ms (95%% %+.3f .. %+.3f) p %.4f%s\n", r.name.c_str(), c.first.c_str()
+					   , c.second.baselineMedian, c.second.median, c.second.delta, c.second.deltaLow, c.second.deltaHigh, c.second.pValue
+					   , c.second.isRegression() ? " REGRESSION" : (c.second.significant ? " improvement" : ""));
+					if (c.second.isRegression()) {
+						regressions++;
+					}
+				}
+			}
+			LOG("%u significant regressions against \"%s\"\n", regressions, benchmarkBaselineFile.c_str());
+		} catch (std::exception &e) {
+			LOG("Failed to compare to benchmark baseline: %s\n", e.what());
+		}
+	}
+
+	std::string report;
+	if (json) {
+		appendFormat(report, "{\n\t\"width\": %u,\n\t\"height\": %u,\n\t\"temporalAA\": %s,\n", renderSize.x, renderSize.y, temporalAA ? "true" : "false");
+		appendFormat(report, "\t\"warmupFrames\": %u,\n\t\"configurations\": [\n", benchmarkWarmupFrames);
+		for (unsigned int i = 0; i < benchmarkResults.size(); i++) {
+			const auto &r = benchmarkResults[i];
+			appendFormat(report, "\t\t{\n\t\t\t\"name\": \"%s\",\n\t\t\t\"device\": \"%s\",\n\t\t\t\"frames\": %u,\n", r.name.c_str(), r.device.c_str(), r.frames);
+			appendFormat(report, "\t\t\t\"cpuFrameTime\": { \"average\": %.4f, \"min\": %.4f, \"median\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"stddev\": %.4f },\n"
+			            , r.cpuAverage, r.cpuMin, r.cpuMedian, r.cpu95th, r.cpu99th, r.cpuMax, r.cpuStdDev);
+			appendFormat(report, "\t\t\t\"latency\": { \"average\": %.4f, \"source\": \"%s\" },\n", r.latencyAverage, r.latencyDisplayed ? "display" : "gpu");
+			appendFormat(report, "\t\t\t\"gpuTotal\": %.4f,\n\t\t\t\"gpuPasses\": {", r.gpuTotal);
+			for (unsigned int j = 0; j < r.gpuPassTimes.size(); j++) {
+				appendFormat(report, "%s \"%s\": %.4f", (j == 0) ? "" : ",", r.gpuPassTimes[j].first.c_str(), r.gpuPassTimes[j].second);
+			}
+			if (!r.counterNames.empty()) {
+				report += " },\n\t\t\t\"gpuCounters\": {";
+				bool first = true;
+				for (unsigned int j = 0; j < r.gpuPassCounters.size(); j++) {
+					const auto &counters = r.gpuPassCounters[j];
+					if (counters.empty()) {
+						continue;
+					}
+					appendFormat(report, "%s\n\t\t\t\t\"%s\": {", first ? "" : ",", r.gpuPassTimes[j].first.c_str());
+					first = false;
+					for (unsigned int k = 0; k < counters.size(); k++) {
+						appendFormat(report, "%s \"%s\": %.4f", (k == 0) ? "" : ",", r.counterNames[k].c_str(), counters[k]);
+					}
+					report += " }";
+				}
+				report += first ? "" : "\n\t\t\t";
+			}
+			appendFormat(report, " },\n\t\t\t\"memory\": { \"allocationCount\": %u, \"subAllocationCount\": %u, \"usedBytes\": %" PRIu64 ", \"unusedBytes\": %" PRIu64 ", \"unusedRangeCount\": %u"
+			            , r.memory.allocationCount, r.memory.subAllocationCount, r.memory.usedBytes, r.memory.unusedBytes, r.memory.unusedRangeCount);
+			for (unsigned int j = 0; j < MemoryKind::_size_constant; j++) {
+				appendFormat(report, ", \"%s\": %" PRIu64, MemoryKind::_from_index(j)._to_string(), r.memory.kindBytes[j]);
+			}
+			appendFormat(report, " },\n");
+			report += "\t\t\t\"power\": { \"cpuEnergyPerFrame\": ";
+			appendEnergyPerFrame(report, r.power.cpuEnergy, r.frames, "null");
+			report += ", \"gpuEnergyPerFrame\": ";
+			appendEnergyPerFrame(report, r.power.gpuEnergy, r.frames, "null");
+			appendFormat(report, ", \"gpuClockAverage\": %.1f, \"gpuClockMin\": %.1f, \"gpuClockMax\": %.1f, \"gpuTemperatureMax\": %.1f, \"throttled\": %s, \"samples\": %u },\n"
+			            , r.power.gpuClockAverage, r.power.gpuClockMin, r.power.gpuClockMax, r.power.gpuTemperatureMax, r.power.throttled ? "true" : "false", r.power.samples);
+			appendFormat(report, "\t\t\t\"allocationsPerFrame\": %.2f,\n\t\t\t\"calls\": {", r.allocationsPerFrame);
+			for (unsigned int j = 0; j < r.calls.size(); j++) {
+				const auto &c = r.calls[j];
+				appendFormat(report, "%s \"%s\": { \"perFrame\": %.2f, \"nsPerCall\": %.1f }", (j == 0) ? "" : ",", c.name.c_str(), double(c.count) / r.frames, double(c.nanoseconds) / c.count);
+			}
+			report += " },\n\t\t\t\"samples\": { \"cpu\": ";
+			appendSamples(report, r.cpuFrameTimes);
+			report += ", \"gpu\": ";
+			appendSamples(report, r.gpuFrameTimes);
+			report += ", \"passes\": {";
+			for (unsigned int j = 0; j < r.gpuPassSamples.size(); j++) {
+				appendFormat(report, "%s \"%s\": ", (j == 0) ? "" : ",", r.gpuPassTimes[j].first.c_str());
+				appendSamples(report, r.gpuPassSamples[j]);
+			}
+			report += " } }";
+			if (!comparisons[i].empty()) {
+				report += ",\n\t\t\t\"baseline\": {";
+				for (unsigned int j = 0; j < comparisons[i].size(); j++) {
+					const auto &c = comparisons[i][j].second;
+					appendFormat(report, "%s\n\t\t\t\t\"%s\": { \"baselineMedian\": %.4f, \"median\": %.4f, \"delta\": %.4f, \"deltaLow\": %.4f, \"deltaHigh\": %.4f, \"p\": %.6f, \"significant\": %s, \"regression\": %s }"
+					            , (j == 0) ? "" : ",", comparisons[i][j].first.c_str(), c.baselineMedian, c.median, c.delta, c.deltaLow, c.deltaHigh, c.pValue
+					            , c.significant ? "true" : "false", c.isRegression() ? "true" : "false");
+				}
+				report += "\n\t\t\t}";
+			}
+			report += "\n";
+			appendFormat(report, "\t\t}%s\n", (i + 1 < benchmarkResults.size()) ? "," : "");
+		}
+		report += "\t]\n}\n";
+	} else {
+		// times in milliseconds, GPU passes as name=time pairs separated by ;
+		// calls as name=calls per frame:nanoseconds per call pairs separated by ;
+		// energy in millijoules per frame, empty without a sensor
+		report += "config,frames,cpu_avg,cpu_min,cpu_median,cpu_p95,cpu_p99,cpu_max,cpu_stddev,gpu_total,latency_avg,latency_source,allocations,suballocations,used_bytes,unused_bytes,allocations_per_frame,gpu_passes,calls,device,cpu_energy,gpu_energy,gpu_clock_avg,gpu_temperature_max,throttled\n";
+		for (const auto &r : benchmarkResults) {
+			appendFormat(report, "%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%s,%u,%u,%" PRIu64 ",%" PRIu64 ",%.2f,"
+			            , r.name.c_str(), r.frames
+			            , r.cpuAverage, r.cpuMin, r.cpuMedian, r.cpu95th, r.cpu99th, r.cpuMax, r.cpuStdDev
+			            , r.gpuTotal
+			            , r.latencyAverage, r.latencyDisplayed ? "display" : "gpu"
+			            , r.memory.allocationCount, r.memory.subAllocationCount, r.memory.usedBytes, r.memory.unusedBytes
+			            , r.allocationsPerFrame);
+			for (unsigned int j = 0; j < r.gpuPassTimes.size(); j++) {
+				appendFormat(report, "%s%s=%.4f", (j == 0) ? "" : ";", r.gpuPassTimes[j].first.c_str(), r.gpuPassTimes[j].second);
+			}
+			report += ",";
+			for (unsigned int j = 0; j < r.calls.size(); j++) {
+				const auto &c = r.calls[j];
+				appendFormat(report, "%s%s=%.2f:%.1f", (j == 0) ? "" : ";", c.name.c_str(), double(c.count) / r.frames, double(c.nanoseconds) / c.count);
+			}
+			report += ",";
+			report += r.device;
+			report += ",";
+			appendEnergyPerFrame(report, r.power.cpuEnergy, r.frames, "");
+			report += ",";
+			appendEnergyPerFrame(report, r.power.gpuEnergy, r.frames, "");
+			appendFormat(report, ",%.1f,%.1f,%u\n", r.power.gpuClockAverage, r.power.gpuTemperatureMax, r.power.throttled ? 1 : 0);
+		}
+	}
+
+	writeFile(benchmarkFile, report.data(), report.size());
+	LOG("Wrote benchmark report to \"%s\"\n", benchmarkFile.c_str());
+}
+
+
+static float srgbToLinear(float c) {
+	c = c / 255.0f;
+	return (c <= 0.04045f) ? (c / 12.92f) : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+
+static float linearToSRGB(float c) {
+	c = (c <= 0.0031308f) ? (c * 12.92f) : (1.055f * powf(c, 1.0f / 2.4f) - 0.055f);
+	return 255.0f * std::min(std::max(c, 0.0f), 1.0f);
+}
+
+
+// the image stretched over width x height like the image scene does
+// averaged in linear light from at least sweepReferenceSamples^2 bilinear samples per pixel
+// result is sRGB encoded RGB in 0 - 255
+static std::vector<float> makeSweepReference(const std::string &filename, unsigned int width, unsigned int height) {
+	MappedFile file(filename);
+	int srcWidth = 0, srcHeight = 0;
+	unsigned char *data = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(file.data()), static_cast<int>(file.size()), &srcWidth, &srcHeight, NULL, 4);
+	if (!data) {
+		throw std::runtime_error(std::string("Failed to decode \"") + filename + "\": " + stbi_failure_reason());
+	}
+
+	std::array<float, 256> toLinear;
+	for (unsigned int i = 0; i < 256; i++) {
+		toLinear[i] = srgbToLinear(float(i));
+	}
+
+	std::vector<float> linear(size_t(srcWidth) * srcHeight * 3);
+	for (size_t i = 0; i < size_t(srcWidth) * srcHeight; i++) {
+		for (unsigned int c = 0; c < 3; c++) {
+			linear[i * 3 + c] = toLinear[data[i * 4 + c]];
+		}
+	}
+	stbi_image_free(data);
+
+	// enough samples to cover every source texel when downscaling
+	unsigned int n = sweepReferenceSamples;
+	n = std::max(n, (static_cast<unsigned int>(srcWidth)  + width  - 1) / width);
+	n = std::max(n, (static_cast<unsigned int>(srcHeight) + height - 1) / height);
+
+	auto texel = [&] (int x, int y, unsigned int c) {
+		x = std::min(std::max(x, 0), srcWidth  - 1);
+		y = std::min(std::max(y, 0), srcHeight - 1);
+		return linear[(size_t(y) * srcWidth + x) * 3 + c];
+	};
+
+	std::vector<float> reference(size_t(width) * height * 3);
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			std::array<float, 3> sum = { 0.0f, 0.0f, 0.0f };
+			for (unsigned int j = 0; j < n; j++) {
+				float v  = (float(y) + (float(j) + 0.5f) / n) / height * srcHeight - 0.5f;
+				int   y0 = static_cast<int>(floorf(v));
+				float fy = v - float(y0);
+				for (unsigned int i = 0; i < n; i++) {
+					float u  = (float(x) + (float(i) + 0.5f) / n) / width * srcWidth - 0.5f;
+					int   x0 = static_cast<int>(floorf(u));
+					float fx = u - float(x0);
+					for (unsigned int c = 0; c < 3; c++) {
+						float top    = texel(x0, y0,     c) * (1.0f - fx) + texel(x0 + 1, y0,     c) * fx;
+						float bottom = texel(x0, y0 + 1, c) * (1.0f - fx) + texel(x0 + 1, y0 + 1, c) * fx;
+						sum[c] += top * (1.0f - fy) + bottom * fy;
+					}
+				}
+			}
+
+			for (unsigned int c = 0; c < 3; c++) {
+				reference[(size_t(y) * width + x) * 3 + c] = linearToSRGB(sum[c] / float(n * n));
+			}
+		}
+	}
+
+	return reference;
+}
+
+
+// PSNR of RGB in dB, 100 if identical
+// SSIM is the mean over ssimWindow sized windows of luma
+static void compareToReference(const std::vector<float> &reference, const FrameReadback &readback, float &psnr, float &ssim) {
+	const unsigned int width  = readback.width;
+	const unsigned int height = readback.height;
+	assert(reference.size() == size_t(width) * height * 3);
+	assert(readback.pixels.size() == size_t(width) * height * 4);
+
+	std::vector<float> lumaA(size_t(width) * height), lumaB(size_t(width) * height);
+	double squaredError = 0.0;
+	for (size_t i = 0; i < size_t(width) * height; i++) {
+		const float *ref   = &reference[i * 3];
+		const uint8_t *pix = &readback.pixels[i * 4];
+		for (unsigned int c = 0; c < 3; c++) {
+			double d = double(pix[c]) - ref[c];
+			squaredError += d * d;
+		}
+		lumaA[i] = 0.299f * ref[0] + 0.587f * ref[1] + 0.114f * ref[2];
+		lumaB[i] = 0.299f * pix[0] + 0.587f * pix[1] + 0.114f * pix[2];
+	}
+
+	double mse = squaredError / (double(width) * height * 3.0);
+	psnr = (mse > 0.0) ? float(10.0 * log10(255.0 * 255.0 / mse)) : 100.0f;
+
+	const double c1 = (0.01 * 255.0) * (0.01 * 255.0);
+	const double c2 = (0.03 * 255.0) * (0.03 * 255.0);
+	const double windowSize = double(ssimWindow * ssimWindow);
+
+	double ssimSum = 0.0;
+	unsigned int numWindows = 0;
+	for (unsigned int y = 0; y + ssimWindow <= height; y += ssimStep) {
+		for (unsigned int x = 0; x + ssimWindow <= width; x += ssimStep) {
+			double sumA = 0.0, sumB = 0.0, sumAA = 0.0, sumBB = 0.0, sumAB = 0.0;
+			for (unsigned int j = 0; j < ssimWindow; j++) {
+				for (unsigned int i = 0; i < ssimWindow; i++) {
+					size_t idx = size_t(y + j) * width + x + i;
+					double a = lumaA[idx];
+					double b = lumaB[idx];
+					sumA  += a;
+					sumB  += b;
+					sumAA += a * a;
+					sumBB += b * b;
+					sumAB += a * b;
+				}
+			}
+
+			double meanA = sumA / windowSize;
+			double meanB = sumB / windowSize;
+			double varA  = sumAA / windowSize - meanA * meanA;
+			double varB  = sumBB / windowSize - meanB * meanB;
+			double cov   = sumAB / windowSize - meanA * meanB;
+			ssimSum += ((2.0 * meanA * meanB + c1) * (2.0 * cov + c2)) / ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+			numWindows++;
+		}
+	}
+
+	ssim = (numWindows > 0) ? float(ssimSum / numWindows) : 1.0f;
+}
+
+
+void SMAADemo::sweepThreadFunc() {
+	// configurations of one image come in a row so one reference is enough
+	std::vector<float> reference;
+	unsigned int referenceImage  = std::numeric_limits<unsigned int>::max();
+	unsigned int referenceWidth  = 0;
+	unsigned int referenceHeight = 0;
+
+	while (true) {
+		SweepJob job;
+
+		{
+			std::unique_lock<std::mutex> lock(sweepMutex);
+			sweepCV.wait(lock, [this] () { return sweepStop || !sweepQueue.empty(); });
+			// finish the queue before stopping
+			if (sweepQueue.empty()) {
+				return;
+			}
+
+			job = std::move(sweepQueue.front());
+			sweepQueue.pop_front();
+		}
+
+		const auto &readback = job.readback;
+		if (job.image != referenceImage || readback.width != referenceWidth || readback.height != referenceHeight) {
+			referenceImage  = job.image;
+			referenceWidth  = readback.width;
+			referenceHeight = readback.height;
+			reference.clear();
+
+			if (TextureFile::isTextureFile(job.filename)) {
+				LOG("No quality sweep reference for \"%s\", compressed textures are not decoded\n", job.filename.c_str());
+			} else {
+				try {
+					reference = makeSweepReference(job.filename, readback.width, readback.height);
+				} catch (std::exception &e) {
+					LOG("No quality sweep reference: %s\n", e.what());
+				}
+			}
+		}
+
+		if (reference.empty()) {
+			continue;
+		}
+
+		SweepQuality q;
+		q.result = job.result;
+		compareToReference(reference, readback, q.psnr, q.ssim);
+		LOG_DEBUG("Quality sweep result %u: PSNR %.2f dB, SSIM %.4f\n", q.result, q.psnr, q.ssim);
+
+		std::unique_lock<std::mutex> lock(sweepMutex);
+		sweepQualities.push_back(q);
+	}
+}
+
+
+void SMAADemo::writeSweepReport() const {
+	bool json = isJSONFile(sweepFile);
+
+	std::string report;
+	if (json) {
+		appendFormat(report, "{\n\t\"width\": %u,\n\t\"height\": %u,\n\t\"configurations\": [\n", renderSize.x, renderSize.y);
+		for (unsigned int i = 0; i < benchmarkResults.size(); i++) {
+			const auto &r = benchmarkResults[i];
+			appendFormat(report, "\t\t{\n\t\t\t\"image\": \"%s\",\n\t\t\t\"name\": \"%s\",\n", r.image.c_str(), r.name.c_str());
+			appendFormat(report, "\t\t\t\"psnr\": %.4f,\n\t\t\t\"ssim\": %.6f,\n", r.psnr, r.ssim);
+			appendFormat(report, "\t\t\t\"gpuTotal\": %.4f,\n\t\t\t\"gpuPasses\": {", r.gpuTotal);
+			for (unsigned int j = 0; j < r.gpuPassTimes.size(); j++) {
+				appendFormat(report, "%s \"%s\": %.4f", (j == 0) ? "" : ",", r.gpuPassTimes[j].first.c_str(), r.gpuPassTimes[j].second);
+			}
+			report += " }\n";
+			appendFormat(report, "\t\t}%s\n", (i + 1 < benchmarkResults.size()) ? "," : "");
+		}
+		report += "\t]\n}\n";
+	} else {
+		// GPU times in milliseconds, passes as name=time pairs separated by ;
+		report += "image,config,psnr,ssim,gpu_total,gpu_passes\n";
+		for (const auto &r : benchmarkResults) {
+			appendFormat(report, "%s,%s,%.4f,%.6f,%.4f,", r.image.c_str(), r.name.c_str(), r.psnr, r.ssim, r.gpuTotal);
+			for (unsigned int j = 0; j < r.gpuPassTimes.size(); j++) {
+				appendFormat(report, "%s%s=%.4f", (j == 0) ? "" : ";", r.gpuPassTimes[j].first.c_str(), r.gpuPassTimes[j].second);
+			}
+			report += "\n";
+		}
+	}
+
+	writeFile(sweepFile, report.data(), report.size());
+	LOG("Wrote quality sweep report to \"%s\"\n", sweepFile.c_str());
+}
+
+
+static void printHelp() {
+	printf(" a                - toggle antialiasing on/off\n");
+	printf(" c                - re-color cubes\n");
+	printf(" d                - cycle through debug visualizations\n");
+	printf(" f                - toggle fullscreen\n");
+	printf(" g                - toggle GUI\n");
+	printf(" h                - print help\n");
+	printf(" m                - change antialiasing method\n");
+	printf(" q                - cycle through AA quality levels\n");
+	printf(" t                - toggle temporal antialiasing on/off\n");
+	printf(" v                - toggle vsync\n");
+	printf(" z                - reset image zoom and pan\n");
+	printf(" LEFT/RIGHT ARROW - cycle through scenes\n");
+	printf(" SPACE            - toggle cube rotation\n");
+	printf(" MOUSE WHEEL/DRAG - zoom and pan images\n");
+	printf(" ESC              - quit\n");
+}
+
+
+void SMAADemo::processInput() {
+#ifndef IMGUI_DISABLE
+	ImGuiIO& io = ImGui::GetIO();
+	// mouse over a GUI window doesn't move the image
+	const bool imageMouse = isImageScene() && !io.WantCaptureMouse;
+#else  // IMGUI_DISABLE
+	const bool imageMouse = isImageScene();
+#endif  // IMGUI_DISABLE
+	const float windowWidth  = float(rendererDesc.swapchain.width);
+	const float windowHeight = float(rendererDesc.swapchain.height);
+
+	SDL_Event event;
+	memset(&event, 0, sizeof(SDL_Event));
+	while (SDL_PollEvent(&event)) {
+		redrawFrames = redrawSettleFrames;
+
+		int sceneIncrement = 1;
+		switch (event.type) {
+		case SDL_QUIT:
+			keepGoing = false;
+			break;
+
+		case SDL_KEYDOWN:
+#ifndef IMGUI_DISABLE
+			io.KeysDown[event.key.keysym.scancode] = true;
+#endif  // IMGUI_DISABLE
+
+			switch (event.key.keysym.scancode) {
+			case SDL_SCANCODE_LSHIFT:
+				leftShift = true;
+				break;
+
+			case SDL_SCANCODE_RSHIFT:
+				rightShift = true;
+				break;
+
+			case SDL_SCANCODE_LALT:
+				leftAlt = true;
+				break;
+
+			case SDL_SCANCODE_RALT:
+				rightAlt = true;
+				break;
+
+			case SDL_SCANCODE_LCTRL:
+				leftCtrl = true;
+				break;
+
+			case SDL_SCANCODE_RCTRL:
+				rightCtrl = true;
+				break;
+
+			default:
+				break;
+			}
+
+#ifndef IMGUI_DISABLE
+
+			if (textInputActive) {
+				break;
+			}
+
+#endif  // IMGUI_DISABLE
+
+			switch (event.key.keysym.scancode) {
+			case SDL_SCANCODE_ESCAPE:
+				keepGoing = false;
+				break;
+
+			case SDL_SCANCODE_SPACE:
+				rotateCubes = !rotateCubes;
+				break;
+
+			case SDL_SCANCODE_A:
+				setAntialiasing(!antialiasing);
+				break;
+
+			case SDL_SCANCODE_C:
+				if (rightShift || leftShift) {
+					colorMode = (colorMode + 1) % 2;
+				}
+				colorCubes();
+				break;
+
+			case SDL_SCANCODE_D:
+				if (antialiasing && aaMethod == +AAMethod::SMAA) {
+					if (leftShift || rightShift) {
+						debugMode = (debugMode + 3 - 1) % 3;
+					} else {
+						debugMode = (debugMode + 1) % 3;
+					}
+					rebuildRG = true;
+				}
+				break;
+
+#ifndef IMGUI_DISABLE
+			case SDL_SCANCODE_G:
+				guiVisible = !guiVisible;
+				break;
+#endif  // IMGUI_DISABLE
+
+			case SDL_SCANCODE_H:
+				printHelp();
+				break;
+
+			case SDL_SCANCODE_M: {
+				int i = aaMethod._to_integral();
+
+				if (leftShift || rightShift) {
+					i = i - 1 + AAMethod::_size();
+				} else {
+					i = i + 1;
+				}
+				i = i % AAMethod::_size();
+				aaMethod = AAMethod::_from_integral(i);
+				rebuildRG = true;
+				} break;
 
 			case SDL_SCANCODE_Q:
 				switch (aaMethod) {
@@ -2193,737 +6522,2216 @@ void SMAADemo::processInput() {
 					rebuildRG            = true;
 					break;
 
-				case AAMethod::FXAA:
-					if (leftShift || rightShift) {
-						fxaaQuality = fxaaQuality + maxFXAAQuality - 1;
-					} else {
-						fxaaQuality = fxaaQuality + 1;
-					}
-					fxaaQuality  = fxaaQuality % maxFXAAQuality;
-					fxaaPipeline = PipelineHandle();
-					break;
+				case AAMethod::FXAA:
+					if (leftShift || rightShift) {
+						fxaaQuality = fxaaQuality + maxFXAAQuality - 1;
+					} else {
+						fxaaQuality = fxaaQuality + 1;
+					}
+					fxaaQuality  = fxaaQuality % maxFXAAQuality;
+					fxaaPipeline = PipelineHandle();
+					break;
+
+				case AAMethod::SMAA:
+				case AAMethod::SMAA2X:
+					if (leftShift || rightShift) {
+						smaaQuality = smaaQuality + maxSMAAQuality - 1;
+					} else {
+						smaaQuality = smaaQuality + 1;
+					}
+					smaaQuality     = smaaQuality % maxSMAAQuality;
+					smaaParameters  = defaultSMAAParameters[smaaQuality];
+
+					smaaPipelines.edgePipeline         = PipelineHandle();
+					smaaPipelines.blendWeightPipeline  = PipelineHandle();
+					smaaPipelines.neighborPipeline     = PipelineHandle();
+					smaaPipelines.tileResetPipeline          = PipelineHandle();
+					smaaPipelines.edgeComputePipeline        = PipelineHandle();
+					smaaPipelines.blendWeightComputePipeline = PipelineHandle();
+
+					break;
+
+				}
+				break;
+
+			case SDL_SCANCODE_T:
+				setTemporalAA(!temporalAA);
+				break;
+
+			case SDL_SCANCODE_Z:
+				imageZoom   = 1.0f;
+				imageCenter = glm::vec2(0.5f, 0.5f);
+				break;
+
+			case SDL_SCANCODE_V:
+				switch (rendererDesc.swapchain.vsync) {
+				case VSync::On:
+					rendererDesc.swapchain.vsync = VSync::LateSwapTear;
+					break;
+
+				case VSync::LateSwapTear:
+					rendererDesc.swapchain.vsync = VSync::Off;
+					break;
+
+				case VSync::Off:
+					rendererDesc.swapchain.vsync = VSync::On;
+					break;
+				}
+				recreateSwapchain = true;
+				break;
+
+			case SDL_SCANCODE_F:
+				rendererDesc.swapchain.fullscreen = !rendererDesc.swapchain.fullscreen;
+				recreateSwapchain = true;
+				break;
+
+			case SDL_SCANCODE_LEFT:
+				sceneIncrement = -1;
+				// fallthrough
+			case SDL_SCANCODE_RIGHT:
+				{
+					// if old or new scene is cubes we must rebuild RG
+					if (!isImageScene()) {
+						rebuildRG = true;
+					}
+
+					// all images + cubes scene
+					unsigned int numScenes = static_cast<unsigned int>(images.size()) + 1;
+					activeScene = (activeScene + sceneIncrement + numScenes) % numScenes;
+
+					if (!isImageScene()) {
+						rebuildRG = true;
+					}
+				}
+				break;
+
+			default:
+				break;
+			}
+
+			break;
+
+		case SDL_KEYUP:
+#ifndef IMGUI_DISABLE
+			io.KeysDown[event.key.keysym.scancode] = false;
+#endif  // IMGUI_DISABLE
+
+			switch (event.key.keysym.scancode) {
+			case SDL_SCANCODE_LSHIFT:
+				leftShift = false;
+				break;
+
+			case SDL_SCANCODE_RSHIFT:
+				rightShift = false;
+				break;
+
+			case SDL_SCANCODE_LALT:
+				leftAlt = false;
+				break;
+
+			case SDL_SCANCODE_RALT:
+				rightAlt = false;
+				break;
+
+			case SDL_SCANCODE_LCTRL:
+				leftCtrl = false;
+				break;
+
+			case SDL_SCANCODE_RCTRL:
+				rightCtrl = false;
+				break;
+
+			default:
+				break;
+			}
+
+			break;
+
+		case SDL_WINDOWEVENT:
+			switch (event.window.event) {
+			case SDL_WINDOWEVENT_SIZE_CHANGED:
+			case SDL_WINDOWEVENT_RESIZED:
+				rendererDesc.swapchain.width  = event.window.data1;
+				rendererDesc.swapchain.height = event.window.data2;
+				recreateSwapchain = true;
+				LOG("window resize to %ux%u\n", rendererDesc.swapchain.width, rendererDesc.swapchain.height);
+				logFlush();
+				break;
+			default:
+				break;
+			}
+			break;
+
+		case SDL_DROPFILE: {
+				char* droppedFile = event.drop.file;
+				std::string filestring(droppedFile);
+				SDL_free(droppedFile);
+				loadImage(filestring);
+			} break;
+
+		case SDL_MOUSEMOTION:
+#ifndef IMGUI_DISABLE
+			io.MousePos = ImVec2(static_cast<float>(event.motion.x), static_cast<float>(event.motion.y));
+#endif  // IMGUI_DISABLE
+			// drag to pan
+			if (imageMouse && (event.motion.state & SDL_BUTTON_LMASK)) {
+				imageCenter -= glm::vec2(event.motion.xrel / windowWidth, event.motion.yrel / windowHeight) / imageZoom;
+			}
+			break;
+
+		case SDL_MOUSEWHEEL:
+#ifndef IMGUI_DISABLE
+			io.MouseWheel = static_cast<float>(event.wheel.y);
+#endif  // IMGUI_DISABLE
+			// zoom keeping the point under the cursor in place
+			if (imageMouse && event.wheel.y != 0) {
+				int x = 0, y = 0;
+				SDL_GetMouseState(&x, &y);
+				glm::vec2 cursor  = glm::vec2(x / windowWidth, y / windowHeight) - 0.5f;
+				glm::vec2 pointed = imageCenter + cursor / imageZoom;
+				imageZoom   = std::max(minImageZoom, std::min(imageZoom * powf(1.25f, float(event.wheel.y)), maxImageZoom));
+				imageCenter = pointed - cursor / imageZoom;
+			}
+			break;
+
+#ifndef IMGUI_DISABLE
+
+		case SDL_TEXTINPUT:
+			io.AddInputCharactersUTF8(event.text.text);
+			break;
+
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+			if (event.button.button < 6) {
+				// SDL and imgui have left and middle in different order
+				static const uint8_t SDLMouseLookup[5] = { 0, 2, 1, 3, 4 };
+				io.MouseDown[SDLMouseLookup[event.button.button - 1]] = (event.button.state == SDL_PRESSED);
+			}
+			break;
+
+#endif  // IMGUI_DISABLE
+
+		}
+	}
+
+#ifndef IMGUI_DISABLE
+
+	io.KeyShift = leftShift || rightShift;
+	io.KeyAlt   = leftAlt   || rightAlt;
+	io.KeyCtrl  = leftCtrl  || rightCtrl;
+
+#endif  // IMGUI_DISABLE
+}
+
+
+void SMAADemo::finishStartup() {
+	startupPhase("first frame");
+	startupDone = true;
+
+	std::string phases;
+	uint64_t prev = 0;
+	for (const auto &p : startupPhases) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), ", %s %.1f ms", p.first, double(p.second - prev) / 1000000.0);
+		phases += buf;
+		prev = p.second;
+	}
+	LOG("Time to first frame %.1f ms%s\n", double(prev) / 1000000.0, phases.c_str());
+
+	startupPhases.clear();
+	startupPhases.shrink_to_fit();
+}
+
+
+void SMAADemo::mainLoopIteration() {
+	if (!startupDone) {
+		// cubes and anything else between initRender and the main loop
+		startupPhase("scene");
+	}
+
+	// woken by input after idling, the wait isn't frame time
+	bool idled = false;
+	if (onDemandRedraw && !redrawNeeded()) {
+		PROFILE_ZONE("idle");
+		// the event stays queued for processInput
+		if (SDL_WaitEventTimeout(nullptr, idleWaitMs) == 0 && !rendererDesc.shaderHotReload) {
+			return;
+		}
+		idled = true;
+	}
+	if (redrawFrames > 0) {
+		redrawFrames--;
+	}
+
+	uint64_t ticks   = getNanoseconds();
+	uint64_t elapsed = ticks - lastTime;
+
+	if (fpsLimitActive && !idled) {
+		uint64_t nsLimit = 1000000000ULL / fpsLimit;
+		if (elapsed < nsLimit) {
+			// limit reached, throttle
+			framePacer.sleep(nsLimit - elapsed);
+			ticks   = getNanoseconds();
+			elapsed = ticks - lastTime;
+		}
+	}
+
+	uint64_t refreshInterval = renderer.getRefreshInterval();
+	if (justInTimePacing && refreshInterval != 0 && !idled) {
+		// start late enough that the frame is done right before a refresh
+		// if the previous frame didn't fit in a refresh there's nothing to gain
+		uint64_t budget = lastWorkTime + lastGPUTime + pacingMargin;
+		uint64_t toRefresh = renderer.getTimeToNextRefresh();
+		if (toRefresh != 0 && budget < refreshInterval) {
+			if (toRefresh < budget) {
+				toRefresh += refreshInterval;
+			}
+			framePacer.sleep(toRefresh - budget);
+			ticks   = getNanoseconds();
+			elapsed = ticks - lastTime;
+		}
+	}
+
+	lastTime = ticks;
+
+	// not including the sleeps above
+	PROFILE_ZONE("mainLoopIteration");
+
+#ifdef ALLOCATION_TRACKING
+	uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+#endif  // ALLOCATION_TRACKING
+
+	if (!idled) {
+		// exponentially weighted so it follows changes like io.Framerate does
+		float ms = float(elapsed) / 1000000.0f;
+		float d  = ms - frameTimeMean;
+		frameTimeMean     += 0.05f * d;
+		frameTimeVariance  = 0.95f * (frameTimeVariance + 0.05f * d * d);
+	}
+
+	processInput();
+
+#ifndef IMGUI_DISABLE
+
+	{
+		PROFILE_ZONE("updateGUI");
+		updateGUI(elapsed);
+	}
+
+#endif  // IMGUI_DISABLE
+
+	processDecodedImages();
+
+	// after input and gui so scene switches start loading right away
+	updateImageResidency();
+
+	if (!isImageScene() && rotateCubes) {
+		// with a fixed step every run renders the same frames regardless of frame rate
+		const uint64_t step = fixedTimestep ? fixedTimestep : elapsed;
+		if (sceneFile) {
+			sceneTime += step;
+			if (sceneFile->isAnimated()) {
+				updateSceneInstances();
+			}
+		} else {
+			rotationTime += step;
+
+			// TODO: increasing rotation period can make cubes spin backwards
+			const uint64_t rotationPeriod = rotationPeriodSeconds * 1000000000ULL;
+			rotationTime   = rotationTime % rotationPeriod;
+			cameraRotation = float(M_PI * 2.0f * rotationTime) / rotationPeriod;
+		}
+	}
+
+	// independent of rotateCubes so the camera can stay still while cubes move
+	cubeAnimationPrevTime = cubeAnimationTime;
+	if (cubeAnimationActive) {
+		cubeAnimationTime += fixedTimestep ? fixedTimestep : elapsed;
+	}
+
+	if (temporalActive()) {
+		temporalFrame = (temporalFrame + 1) % 2;
+
+		switch (aaMethod) {
+		case AAMethod::MSAA:
+		case AAMethod::FXAA:
+			// not used
+			subsampleIndices[0] = glm::vec4(0.0f);
+			subsampleIndices[1] = glm::vec4(0.0f);
+			break;
+
+		case AAMethod::SMAA: {
+			float v       = float(temporalFrame + 1);
+			subsampleIndices[0] = glm::vec4(v, v, v, 0.0f);
+			subsampleIndices[1] = glm::vec4(0.0f);
+		} break;
+
+		case AAMethod::SMAA2X:
+			if (temporalFrame == 0) {
+				subsampleIndices[0] = glm::vec4(5.0f, 3.0f, 1.0f, 3.0f);
+				subsampleIndices[1] = glm::vec4(4.0f, 6.0f, 2.0f, 3.0f);
+			} else {
+				assert(temporalFrame == 1);
+				subsampleIndices[0] = glm::vec4(3.0f, 5.0f, 1.0f, 4.0f);
+				subsampleIndices[1] = glm::vec4(6.0f, 4.0f, 2.0f, 4.0f);
+			}
+			break;
+
+		}
+	} else {
+		if (smaa2XActive()) {
+			subsampleIndices[0] = glm::vec4(1.0, 1.0, 1.0, 0.0f);
+		} else {
+			subsampleIndices[0] = glm::vec4(0.0f);
+		}
+		subsampleIndices[1] = glm::vec4(2.0f, 2.0f, 2.0f, 0.0f);
+	}
+
+	if (benchmarkRebuildGraph && benchmarkActive()) {
+		rebuildRG = true;
+	}
+
+	render();
+
+	if (!startupDone) {
+		finishStartup();
+	}
+
+	uint64_t workTime = getNanoseconds() - ticks;
+	lastWorkTime      = (workTime > lastFrameWaitTime) ? (workTime - lastFrameWaitTime) : 0;
+
+	if (benchmarkActive()) {
+		benchmarkFrameDone(elapsed);
+	}
+
+#ifdef ALLOCATION_TRACKING
+	lastFrameAllocations  = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+	allocationsMean      += 0.05f * (float(lastFrameAllocations) - allocationsMean);
+
+	if (assertNoAllocations && steadyFrames >= steadyStateFrames && numPendingImages == 0 && lastFrameAllocations != 0) {
+		LOG("Steady-state frame made %" PRIu64 " heap allocations\n", lastFrameAllocations);
+		logFlush();
+		assert(lastFrameAllocations == 0);
+	}
+#endif  // ALLOCATION_TRACKING
+	steadyFrames++;
+}
+
+
+bool SMAADemo::redrawNeeded() const {
+	if (!startupDone || redrawFrames > 0 || rebuildRG || recreateSwapchain) {
+		return true;
+	}
+
+	// benchmarks and sweeps measure every frame
+	if (benchmarkActive()) {
+		return true;
+	}
+
+	// decoded images are picked up by the main loop, there's no event for them
+	if (numPendingImages > 0) {
+		return true;
+	}
+
+	// temporal AA alternates subsamples every frame
+	if (temporalActive()) {
+		return true;
+	}
+
+	if (!isImageScene() && (rotateCubes || cubeAnimationActive)) {
+		return true;
+	}
+
+	return false;
+}
+
+
+void SMAADemo::render() {
+	PROFILE_ZONE("render");
+
+	if (recreateSwapchain) {
+		renderer.setSwapchainDesc(rendererDesc.swapchain);
+
+		renderSize = renderer.getDrawableSize();
+		LOG("drawable size: %ux%u\n", renderSize.x, renderSize.y);
+		logFlush();
+
+		// pump events
+		processInput();
+
+		rebuildRG = true;
+		recreateSwapchain = false;
+	}
+
+	if (rebuildRG) {
+		rebuildRenderGraph();
+		assert(!rebuildRG);
+		steadyFrames = 0;
+
+		if (antialiasing && temporalAA) {
+			temporalAAFirstFrame = true;
+		}
+	}
+
+	if (rendererDesc.shaderHotReload) {
+		// between frames so nothing is still recording with the old pipelines
+		auto reloaded = renderer.takeReloadedShaders();
+		if (!reloaded.empty() && renderGraph.reloadPipelines(renderer, reloaded)) {
+			LOG("Reloaded pipelines using %u changed shaders\n", static_cast<unsigned int>(reloaded.size()));
+			clearPipelineHandles();
+		}
+	}
+
+	// TODO: this should be in RenderGraph
+	uint64_t waitStart = getNanoseconds();
+	bool frameReady    = renderer.beginFrame();
+	lastFrameWaitTime  = getNanoseconds() - waitStart;
+	if (!frameReady) {
+		// check if caused by swapchain out of date, recreate if so
+		if (renderer.isSwapchainDirty() ) {
+			recreateSwapchain = true;
+		}
+
+		// with FrameWait::Block the renderer already slept waiting for it
+
+		return;
+	}
+
+	if (temporalActive()) {
+		assert(temporalRTs[0]);
+		assert(temporalRTs[1]);
+		renderGraph.bindExternalRT(Rendertargets::TemporalPrevious, temporalRTs[1 - temporalFrame]);
+		renderGraph.bindExternalRT(Rendertargets::TemporalCurrent,  temporalRTs[    temporalFrame]);
+	}
+
+	if (finalInSwapchain) {
+		renderGraph.bindExternalRT(Rendertargets::FinalRender, renderer.getSwapchainRenderTarget());
+	}
+
+	lastGPUTime = 0;
+	for (const auto &t : renderer.getGPUTimings()) {
+		lastGPUTime += t.nanoseconds;
+	}
+
+	if (!cpuTraceFile.empty()) {
+		uint64_t newest = tracedGPUTime;
+		for (const auto &t : renderer.getGPUTimings()) {
+			if (t.start > tracedGPUTime) {
+				profilerRecordGPU(t.name, t.start, t.start + t.nanoseconds);
+				newest = std::max(newest, t.start);
+			}
+		}
+		tracedGPUTime = newest;
+	}
+
+	if (graphReportDelay > 0) {
+		graphReportDelay--;
+		if (graphReportDelay == 0) {
+			try {
+				renderGraph.writeReport(graphReportFile, renderer.getGPUTimings(), rendererDesc.swapchain.width, rendererDesc.swapchain.height);
+			} catch (std::exception &e) {
+				LOG("Failed to write render graph report: %s\n", e.what());
+			}
+		}
+	}
+
+#ifndef IMGUI_DISABLE
+	guiRefreshInterval = renderer.getRefreshInterval();
+	guiGPUTimings      = renderer.getGPUTimings();
+	if (guiWantsMemStats) {
+		guiMemStats    = renderer.getMemStats();
+	}
+	if (guiWantsShaderStats) {
+		guiShaderStats = renderer.getShaderStats();
+	}
+#endif  // IMGUI_DISABLE
+
+	if (dynamicResolution) {
+		updateRenderScale();
+	}
+
+	// benchmarks set their own quality
+	if (smaaBudget > 0.0f && !benchmarkActive()) {
+		updateSMAABudget();
+	}
+
+	// only valid until presentFrame
+	for (const auto &t : renderer.getPresentTimings()) {
+		if (t.presentTime <= t.beginTime) {
+			continue;
+		}
+
+		uint64_t latency = t.presentTime - t.beginTime;
+		latencyMean      = 0.95f * latencyMean + 0.05f * (float(latency) / 1000000.0f);
+		latencyDisplayed = t.displayed;
+		if (benchmarkActive() && benchmarkFrame > benchmarkWarmupFrames) {
+			benchmarkLatencyTotal += latency;
+			benchmarkLatencySamples++;
+		}
+	}
+
+	// before the graph, updating buffers can't happen inside a render pass
+	if (isImageScene()) {
+		// new pages show up in the image without changing its pass state
+		if (updateImagePages()) {
+			imageVersion++;
+			// the rest of the pages come in later frames
+			redrawFrames = std::max(redrawFrames, 1U);
+		}
+	} else {
+		updateCubeScene();
+	}
+
+#ifndef IMGUI_DISABLE
+	if (guiOverlayActive && guiVisible) {
+		renderGUIOverlay();
+		renderGraph.bindExternalRT(Rendertargets::GUIOverlay, guiOverlayRT);
+	}
+#endif  // IMGUI_DISABLE
+
+	if (staticPassesActive) {
+		updateStaticPasses();
+	}
+
+	if (cachedPassesActive) {
+		updateCachedPassVersions();
+	}
+
+	renderGraph.render(renderer);
+
+	// after rendering since recording creates the pipelines
+	if (staticPassesActive) {
+		staticPassState = currentStaticPassState();
+	}
+
+	if (cachedPassesActive) {
+		imagePassState = currentImagePassState();
+		smaaPassState  = currentStaticPassState();
+	}
+}
+
+
+PipelineDesc SMAADemo::cubePipelineDesc(bool impostors, bool depthOnly) const {
+	std::string name = "cubes";
+	if (numSamples > 1) {
+		name += " MSAA x" + std::to_string(numSamples);
+	}
+
+	PipelineDesc plDesc;
+	ShaderMacros macros;
+	if (cubeCullingActive) {
+		macros.emplace("CUBE_CULLING", "1");
+		plDesc.descriptorSetLayout<CubeSceneCulledDS>(1);
+		name += " culled";
+	} else {
+		assert(!impostors);
+		plDesc.descriptorSetLayout<CubeSceneDS>(1);
+	}
+
+	if (cubeAnimationActive) {
+		macros.emplace("CUBE_ANIMATION", "1");
+		name += " animated";
+	} else if (compactCubesActive) {
+		// the animation pass unpacks them
+		macros.emplace("COMPACT_CUBES", "1");
+		name += " compact";
+	}
+
+	if (impostors) {
+		// quads are generated in the vertex shader
+		macros.emplace("CUBE_IMPOSTOR", "1");
+		name += " impostors";
+	} else if (sceneFile) {
+		assert(!cubeCullingActive);
+		// first cube of the mesh being drawn
+		macros.emplace("SCENE_MESH", "1");
+		plDesc.vertexAttrib(ATTR_POS, 0, 3, VtxFormat::Float, 0)
+		      .vertexBufferStride(ATTR_POS, sizeof(SceneVertex))
+		      .pushConstants<uint32_t>();
+		name += " scene";
+	} else if (proceduralCubes) {
+		macros.emplace("PROCEDURAL_CUBE", "1");
+		name += " procedural";
+	} else {
+		plDesc.vertexAttrib(ATTR_POS, 0, 3, VtxFormat::Float, 0)
+		      .vertexBufferStride(ATTR_POS, sizeof(Vertex));
+	}
+
+	if (depthOnly) {
+		macros.emplace("DEPTH_ONLY", "1");
+		name += " depth prepass";
+	} else if (sceneVelocity) {
+		macros.emplace("VELOCITY", "1");
+		name += " velocity";
+	}
+
+	// after the prepass depth is final and only the closest fragment passes
+	const bool depthEqual = depthPrepassActive && !depthOnly;
+	if (depthEqual) {
+		name += " depth equal";
+	}
+
+	plDesc.name(name)
+	      .vertexShader("cube")
+	      .fragmentShader("cube")
+	      .shaderMacros(macros)
+	      .numSamples(numSamples)
+	      .descriptorSetLayout<GlobalDS>(0)
+	      .depthWrite(!depthEqual)
+	      .depthTest(true)
+	      .depthFunc(depthEqual ? DepthFunc::Equal : DepthFunc::Less)
+	      .cullFaces(true);
+
+	return plDesc;
+}
+
+
+ComputePipelineDesc SMAADemo::cubeCullResetPipelineDesc() const {
+	// uses the cull pass descriptor set so it can be bound once for both
+	ComputePipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<CubeCullDS>(1)
+	      .computeShader("cubeCullReset")
+	      .name("cube cull reset");
+
+	return plDesc;
+}
+
+
+ComputePipelineDesc SMAADemo::cubeCullPipelineDesc() const {
+	std::string name = "cube cull";
+	ShaderMacros macros;
+	if (cubeAnimationActive) {
+		macros.emplace("CUBE_ANIMATION", "1");
+		name += " animated";
+	} else if (compactCubesActive) {
+		macros.emplace("COMPACT_CUBES", "1");
+		name += " compact";
+	}
+
+	ComputePipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<CubeCullDS>(1)
+	      .computeShader("cubeCull")
+	      .shaderMacros(macros)
+	      .name(name);
+
+	return plDesc;
+}
+
+
+ComputePipelineDesc SMAADemo::cubeAnimatePipelineDesc() const {
+	// output is always uncompressed
+	std::string name = "cube animation";
+	ShaderMacros macros;
+	if (compactCubesActive) {
+		macros.emplace("COMPACT_CUBES", "1");
+		name += " compact";
+	}
+
+	ComputePipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<CubeAnimateDS>(1)
+	      .computeShader("cubeAnimate")
+	      .shaderMacros(macros)
+	      .name(name);
+
+	return plDesc;
+}
+
+
+void SMAADemo::updateCubeScene() {
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+	glm::mat4 viewProj;
+	if (sceneFile) {
+		glm::vec3 eye, target;
+		float fovY;
+		sceneFile->cameraAt(float(double(sceneTime) / 1000000000.0), eye, target, fovY);
+
+		// depth range just covers the scene's bounding sphere
+		float distance  = glm::length(eye - sceneFile->getCenter());
+		float nearPlane = std::max(0.1f, distance - sceneFile->getRadius());
+		float farPlane  = std::max(distance + sceneFile->getRadius(), nearPlane * 2.0f);
+
+		glm::mat4 view  = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 proj  = glm::perspective(fovY, float(windowWidth) / windowHeight, nearPlane, farPlane);
+		viewProj = proj * view;
+	} else {
+		// TODO: better calculation, and check cube size (side is sqrt(3) currently)
+		const float cubeDiameter = sqrtf(3.0f);
+		const float cubeDistance = cubeDiameter + 1.0f;
+
+		float farPlane  = cameraDistance + cubeDistance * float(cubesPerSide + 1);
+		float nearPlane = std::max(0.1f, cameraDistance - cubeDistance * float(cubesPerSide + 1));
+
+		glm::mat4 model  = glm::rotate(glm::mat4(1.0f), cameraRotation, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 view   = glm::lookAt(glm::vec3(cameraDistance, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 proj   = glm::perspective(float(65.0f * M_PI * 2.0f / 360.0f), float(windowWidth) / windowHeight, nearPlane, farPlane);
+		viewProj = proj * view * model;
+
+		if (sortCubes) {
+			glm::vec3 eye = glm::vec3(glm::inverse(model) * glm::vec4(cameraDistance, 0.0f, 0.0f, 1.0f));
+			// cubesDirty means cubes changed, possibly reshuffled
+			if (cubesDirty || eye != cubeSortEye) {
+				sortCubesFrontToBack(eye);
+				cubeSortEye = eye;
+			}
+		}
+	}
+
+	// temporal jitter
+	if (temporalActive()) {
+		glm::vec2 jitter;
+		if (aaMethod == +AAMethod::MSAA || aaMethod == +AAMethod::SMAA2X) {
+			const glm::vec2 jitters[2] = {
+				  {  0.125f,  0.125f }
+				, { -0.125f, -0.125f }
+			};
+			jitter = jitters[temporalFrame];
+		} else {
+			const glm::vec2 jitters[2] = {
+				  { -0.25f,  0.25f }
+				, { 0.25f,  -0.25f }
+			};
+			jitter = jitters[temporalFrame];
+		}
+
+		// pixels of the scaled viewport
+		glm::uvec2 viewport = scaledSize(windowWidth, windowHeight);
+		jitter = jitter * 2.0f * glm::vec2(1.0f / float(viewport.x), 1.0f / float(viewport.y));
+		glm::mat4 jitterMatrix = glm::translate(glm::identity<glm::mat4>(), glm::vec3(jitter, 0.0f));
+		viewProj = jitterMatrix * viewProj;
+	}
+
+	prevViewProj         = currViewProj;
+	currViewProj         = viewProj;
+	reprojection         = prevViewProj * glm::inverse(currViewProj);
+
+	if (cubesDirty || cubeInstancesCompact != compactCubesActive) {
+		const void *data = &cubes[0];
+		uint32_t size    = static_cast<uint32_t>(sizeof(ShaderDefines::Cube) * cubes.size());
+		if (compactCubesActive) {
+			compactCubeData.resize(cubes.size());
+			jobSystem.parallelFor(static_cast<unsigned int>(cubes.size()), minCubeSliceSize, [&] (unsigned int begin, unsigned int end) {
+				for (unsigned int i = begin; i < end; i++) {
+					compactCubeData[i] = packCube(cubes[i]);
+				}
+			});
+			data = &compactCubeData[0];
+			size = static_cast<uint32_t>(sizeof(ShaderDefines::CompactCube) * compactCubeData.size());
+		}
+		cubeInstancesCompact = compactCubesActive;
+
+		// every change touches all cubes, sorting every frame while the camera moves
+		// so update the whole buffer in place unless its size changed
+		if (cubeInstances && cubeInstancesSize == size) {
+			renderer.updateBuffer(cubeInstances, 0, size, data);
+		} else {
+			// deletion is deferred until the GPU is done with the old one
+			if (cubeInstances) {
+				renderer.deleteBuffer(cubeInstances);
+			}
 
-				case AAMethod::SMAA:
-				case AAMethod::SMAA2X:
-					if (leftShift || rightShift) {
-						smaaQuality = smaaQuality + maxSMAAQuality - 1;
-					} else {
-						smaaQuality = smaaQuality + 1;
-					}
-					smaaQuality     = smaaQuality % maxSMAAQuality;
-					smaaParameters  = defaultSMAAParameters[smaaQuality];
+			BufferDesc desc;
+			desc.type(BufferType::Storage)
+			    .size(size)
+			    .usage(BufferUsage::Dynamic)
+			    .contents(data)
+			    .name("cube instances");
+			cubeInstances     = renderer.createBuffer(desc);
+			cubeInstancesSize = size;
+		}
+		cubesDirty = false;
+	}
+	assert(cubeInstances);
 
-					smaaPipelines.edgePipeline         = PipelineHandle();
-					smaaPipelines.blendWeightPipeline  = PipelineHandle();
-					smaaPipelines.neighborPipelines[0] = PipelineHandle();
-					smaaPipelines.neighborPipelines[1] = PipelineHandle();
+	numDrawnCubes = static_cast<unsigned int>(cubes.size());
+	if (visualizeCubeOrder) {
+		cubeOrderNum  = cubeOrderNum % numDrawnCubes;
+		cubeOrderNum++;
+		numDrawnCubes = cubeOrderNum;
+	}
+}
 
-					break;
 
-				}
-				break;
+// normalized planes of the clip volume, inside when dot(plane.xyz, p) + plane.w >= 0
+static std::array<glm::vec4, 6> frustumPlanes(const glm::mat4 &m) {
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	// near plane assumes -w <= z which is also conservative for 0 <= z
+	std::array<glm::vec4, 6> planes = {
+		  row3 + row0
+		, row3 - row0
+		, row3 + row1
+		, row3 - row1
+		, row3 + row2
+		, row3 - row2
+	};
 
-			case SDL_SCANCODE_T:
-				setTemporalAA(!temporalAA);
-				break;
+	for (auto &p : planes) {
+		p /= glm::length(glm::vec3(p));
+	}
 
-			case SDL_SCANCODE_V:
-				switch (rendererDesc.swapchain.vsync) {
-				case VSync::On:
-					rendererDesc.swapchain.vsync = VSync::LateSwapTear;
-					break;
+	return planes;
+}
 
-				case VSync::LateSwapTear:
-					rendererDesc.swapchain.vsync = VSync::Off;
-					break;
 
-				case VSync::Off:
-					rendererDesc.swapchain.vsync = VSync::On;
-					break;
-				}
-				recreateSwapchain = true;
-				break;
+void SMAADemo::renderCubeCull(RenderPasses /* rp */, DemoRenderGraph::PassResources & /* r */) {
+	assert(cubeCullingActive);
+	assert(cubeVisibleBuffer);
+	assert(cubeDrawArgsBuffer);
 
-			case SDL_SCANCODE_F:
-				rendererDesc.swapchain.fullscreen = !rendererDesc.swapchain.fullscreen;
-				recreateSwapchain = true;
-				break;
+	if (!cubeCullResetPipeline) {
+		ComputePipelineDesc plDesc = cubeCullResetPipelineDesc();
+		cubeCullResetPipeline = renderGraph.createComputePipeline(renderer, plDesc);
+	}
 
-			case SDL_SCANCODE_LEFT:
-				sceneIncrement = -1;
-				// fallthrough
-			case SDL_SCANCODE_RIGHT:
-				{
-					// if old or new scene is cubes we must rebuild RG
-					if (!isImageScene()) {
-						rebuildRG = true;
-					}
+	if (!cubeCullPipeline) {
+		ComputePipelineDesc plDesc = cubeCullPipelineDesc();
+		cubeCullPipeline = renderGraph.createComputePipeline(renderer, plDesc);
+	}
 
-					// all images + cubes scene
-					unsigned int numScenes = static_cast<unsigned int>(images.size()) + 1;
-					activeScene = (activeScene + sceneIncrement + numScenes) % numScenes;
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
 
-					if (!isImageScene()) {
-						rebuildRG = true;
-					}
-				}
-				break;
+	ShaderDefines::Globals globals;
+	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.viewProj              = currViewProj;
+	globals.prevViewProj          = prevViewProj;
+	globals.reprojection          = reprojection;
+	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
 
-			default:
-				break;
+	GlobalDS globalDS;
+	globalDS.globalUniforms  = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler   = linearSampler;
+	globalDS.nearestSampler  = nearestSampler;
+
+	ShaderDefines::CubeCullUBO cullUBO;
+	auto planes = frustumPlanes(currViewProj);
+	for (unsigned int i = 0; i < planes.size(); i++) {
+		cullUBO.frustumPlanes[i] = planes[i];
+	}
+	cullUBO.numCubes   = numDrawnCubes;
+	// bounding sphere of a cube with side sqrt(3)
+	cullUBO.cubeRadius = 1.5f;
+	cullUBO.lodDistance = std::numeric_limits<float>::max();
+	if (cubeLODActive) {
+		// depth where a cube is cubeLODPixels high on screen
+		// projection y scale is the length of the second row of viewProj
+		float projScale = glm::length(glm::vec3(currViewProj[0][1], currViewProj[1][1], currViewProj[2][1]));
+		float height    = float(scaledSize(windowWidth, windowHeight).y);
+		cullUBO.lodDistance = sqrtf(3.0f) * projScale * 0.5f * height / std::max(cubeLODPixels, 1.0f);
+	}
+	cullUBO.pad0       = 0.0f;
+
+	CubeCullDS cullDS;
+	cullDS.cullUBO   = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::CubeCullUBO), &cullUBO);
+	cullDS.instances = cubeAnimationActive ? cubeAnimatedBuffer : cubeInstances;
+	cullDS.visible   = cubeVisibleBuffer;
+	cullDS.drawArgs  = cubeDrawArgsBuffer;
+	cullDS.impostors    = cubeImpostorBuffer;
+	cullDS.impostorArgs = cubeImpostorArgsBuffer;
+
+	// previous frame's scene pass might still be drawing from these
+	renderer.computeBarrier();
+	renderer.bindPipeline(cubeCullResetPipeline);
+	renderer.bindDescriptorSet(0, globalDS);
+	renderer.bindDescriptorSet(1, cullDS);
+	renderer.dispatch(1, 1, 1);
+	renderer.computeBarrier();
+
+	renderer.bindPipeline(cubeCullPipeline);
+	renderer.bindDescriptorSet(0, globalDS);
+	renderer.bindDescriptorSet(1, cullDS);
+	renderer.dispatch((numDrawnCubes + CUBE_CULL_GROUP_SIZE - 1) / CUBE_CULL_GROUP_SIZE, 1, 1);
+
+	// the scene pass reads visible cubes in the vertex shader and draws indirectly
+	renderer.computeBarrier();
+}
+
+
+void SMAADemo::renderCubeAnimate(RenderPasses /* rp */, DemoRenderGraph::PassResources & /* r */) {
+	assert(cubeAnimationActive);
+	assert(cubeAnimatedBuffer);
+
+	if (!cubeAnimatePipeline) {
+		ComputePipelineDesc plDesc = cubeAnimatePipelineDesc();
+		cubeAnimatePipeline = renderGraph.createComputePipeline(renderer, plDesc);
+	}
+
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+	// not read by the shader but the layout has it
+	ShaderDefines::Globals globals;
+	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.viewProj              = currViewProj;
+	globals.prevViewProj          = prevViewProj;
+	globals.reprojection          = reprojection;
+	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
+
+	GlobalDS globalDS;
+	globalDS.globalUniforms  = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler   = linearSampler;
+	globalDS.nearestSampler  = nearestSampler;
+
+	// every cube, visualizeCubeOrder only limits what's drawn
+	const unsigned int numCubes = static_cast<unsigned int>(cubes.size());
+
+	ShaderDefines::CubeAnimateUBO animateUBO;
+	animateUBO.numAnimatedCubes  = numCubes;
+	animateUBO.animationTime     = float(double(cubeAnimationTime) / 1000000000.0);
+	animateUBO.prevAnimationTime = float(double(cubeAnimationPrevTime) / 1000000000.0);
+	animateUBO.pad2              = 0.0f;
+
+	CubeAnimateDS animateDS;
+	animateDS.animateUBO = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::CubeAnimateUBO), &animateUBO);
+	animateDS.instances  = cubeInstances;
+	animateDS.animated   = cubeAnimatedBuffer;
+
+	// previous frame's cull and scene passes might still be reading the poses
+	renderer.computeBarrier();
+	renderer.bindPipeline(cubeAnimatePipeline);
+	renderer.bindDescriptorSet(0, globalDS);
+	renderer.bindDescriptorSet(1, animateDS);
+	renderer.dispatch((numCubes + CUBE_ANIMATE_GROUP_SIZE - 1) / CUBE_ANIMATE_GROUP_SIZE, 1, 1);
+
+	// read by the cull pass and the scene vertex shader
+	renderer.computeBarrier();
+}
+
+
+void SMAADemo::renderCubeScene(RenderPasses rp, DemoRenderGraph::PassResources & /* r */) {
+	// the depth prepass draws the same cubes with depth only pipelines
+	const bool depthOnly = (rp == RenderPasses::DepthPrepass);
+	PipelineHandle &pipeline = depthOnly ? cubeDepthPipeline : cubePipeline;
+	if (!pipeline) {
+		PipelineDesc plDesc = cubePipelineDesc(false, depthOnly);
+		pipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
+	assert(pipeline);
+
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+	ShaderDefines::Globals globals;
+	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
+	globals.viewProj              = currViewProj;
+	globals.prevViewProj          = prevViewProj;
+	globals.reprojection          = reprojection;
+
+	glm::uvec2 viewport = scaledSize(windowWidth, windowHeight);
+	renderer.setViewport(0, 0, viewport.x, viewport.y);
+
+	GlobalDS globalDS;
+	globalDS.globalUniforms = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler  = linearSampler;
+	globalDS.nearestSampler = nearestSampler;
+
+	if (sceneFile) {
+		// one draw per mesh, the list binds the shared state once
+		sceneDraws.clear();
+		sceneDraws.bindPipeline(pipeline);
+		sceneDraws.bindDescriptorSet(0, globalDS);
+		sceneDraws.bindVertexBuffer(0, sceneVBO);
+		sceneDraws.bindIndexBuffer(sceneIBO, false);
+
+		CubeSceneDS cubeDS;
+		cubeDS.instances = cubeInstances;
+		sceneDraws.bindDescriptorSet(1, cubeDS);
+
+		for (unsigned int i = 0; i < sceneMeshArgs.size(); i++) {
+			if (sceneMeshFirstInstance[i] == sceneMeshFirstInstance[i + 1]) {
+				continue;
 			}
+			sceneDraws.pushConstants(sceneMeshFirstInstance[i]);
+			sceneDraws.drawIndexedIndirect(sceneMeshArgs[i], 1);
+		}
 
-			break;
+		if (!sceneDraws.empty()) {
+			sceneDraws.execute(renderer);
+		}
+		return;
+	}
 
-		case SDL_KEYUP:
-#ifndef IMGUI_DISABLE
-			io.KeysDown[event.key.keysym.scancode] = false;
-#endif  // IMGUI_DISABLE
+	renderer.bindPipeline(pipeline);
+	renderer.bindDescriptorSet(0, globalDS);
 
-			switch (event.key.keysym.scancode) {
-			case SDL_SCANCODE_LSHIFT:
-				leftShift = false;
-				break;
+	if (!proceduralCubes) {
+		renderer.bindVertexBuffer(0, cubeVBO);
+		renderer.bindIndexBuffer(cubeIBO, false);
+	}
 
-			case SDL_SCANCODE_RSHIFT:
-				rightShift = false;
-				break;
+	// grid cubes only, scene files never animate here
+	BufferHandle instances = cubeAnimationActive ? cubeAnimatedBuffer : cubeInstances;
+	if (cubeCullingActive) {
+		CubeSceneCulledDS cubeDS;
+		cubeDS.instances = instances;
+		cubeDS.visible   = cubeVisibleBuffer;
+		renderer.bindDescriptorSet(1, cubeDS);
+
+		// instance count was written by the cull pass
+		// the first 4 fields of the indexed arguments have the same layout
+		// as non-indexed ones so the procedural path can use the same buffer
+		if (proceduralCubes) {
+			renderer.drawIndirect(cubeDrawArgsBuffer, 1);
+		} else {
+			renderer.drawIndexedIndirect(cubeDrawArgsBuffer, 1);
+		}
+
+		if (cubeLODActive) {
+			PipelineHandle &impostorPipeline = depthOnly ? cubeImpostorDepthPipeline : cubeImpostorPipeline;
+			if (!impostorPipeline) {
+				PipelineDesc plDesc = cubePipelineDesc(true, depthOnly);
+				impostorPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+			}
+			renderer.bindPipeline(impostorPipeline);
+
+			cubeDS.visible   = cubeImpostorBuffer;
+			renderer.bindDescriptorSet(1, cubeDS);
+			renderer.drawIndirect(cubeImpostorArgsBuffer, 1);
+		}
+	} else {
+		CubeSceneDS cubeDS;
+		cubeDS.instances = instances;
+		renderer.bindDescriptorSet(1, cubeDS);
+
+		if (proceduralCubes) {
+			renderer.drawInstanced(3 * 2 * 6, numDrawnCubes);
+		} else {
+			renderer.drawIndexedInstanced(3 * 2 * 6, numDrawnCubes);
+		}
+	}
+}
+
+
+PipelineDesc SMAADemo::depthVelocityPipelineDesc() const {
+	ShaderMacros macros;
+	if (numSamples > 1) {
+		macros.emplace("DEPTH_MS", "1");
+	}
+
+	PipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<ColorTexDS>(1)
+	      .vertexShader("temporal")
+	      .fragmentShader("velocity")
+	      .shaderMacros(macros)
+	      .name("velocity from depth");
+
+	return plDesc;
+}
+
+
+void SMAADemo::renderDepthVelocity(RenderPasses rp, DemoRenderGraph::PassResources &r) {
+	if (!depthVelocityPipeline) {
+		PipelineDesc plDesc = depthVelocityPipelineDesc();
+		depthVelocityPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
+
+	// set 0 is still the scene pass's globals which have the reprojection matrix
+	glm::uvec2 viewport = scaledSize(rendererDesc.swapchain.width, rendererDesc.swapchain.height);
+	renderer.setViewport(0, 0, viewport.x, viewport.y);
+	renderer.bindPipeline(depthVelocityPipeline);
+
+	ColorTexDS depthDS;
+	depthDS.color = r.get(Rendertargets::MainDepth);
+	renderer.bindDescriptorSet(1, depthDS);
+	renderer.draw(0, 3);
+}
+
+
+PipelineDesc SMAADemo::imagePipelineDesc(bool tiled) const {
+	PipelineDesc plDesc;
+	ShaderMacros macros;
+	if (tiled) {
+		macros.emplace("TILED_IMAGE", "1");
+		plDesc.descriptorSetLayout<TiledImageDS>(1);
+	} else if (renderer.getFeatures().textureTable) {
+		macros.emplace("TEXTURE_TABLE", "1");
+		plDesc.descriptorSetLayout<TextureTableDS>(1);
+	} else {
+		plDesc.descriptorSetLayout<ColorTexDS>(1);
+	}
+
+	plDesc.numSamples(numSamples)
+	      .descriptorSetLayout<GlobalDS>(0)
+	      .vertexShader("image")
+	      .fragmentShader("image")
+	      .shaderMacros(macros)
+	      .pushConstants<ShaderDefines::ImageConstants>()
+	      .name(tiled ? "tiled image" : "image");
+
+	return plDesc;
+}
+
+
+ShaderDefines::ImageConstants SMAADemo::imageConstants() const {
+	ShaderDefines::ImageConstants constants;
+	float scale = 1.0f / imageZoom;
+	constants.imageTransform = glm::vec4(scale, scale, imageCenter.x - 0.5f * scale, imageCenter.y - 0.5f * scale);
+	constants.textureIndex   = 0;
+	constants.pad3           = 0;
+	constants.pad4           = 0;
+	constants.pad5           = 0;
+
+	return constants;
+}
+
+
+void SMAADemo::renderImageScene(RenderPasses rp, DemoRenderGraph::PassResources & /* r */) {
+	assert(activeScene > 0);
+	const auto &image = images.at(activeScene - 1);
+
+	PipelineHandle &pipeline = image.tiled ? tiledImagePipeline : imagePipeline;
+	if (!pipeline) {
+		PipelineDesc plDesc = imagePipelineDesc(bool(image.tiled));
+		pipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
+
+	renderer.bindPipeline(pipeline);
+
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+	glm::uvec2 viewport = scaledSize(windowWidth, windowHeight);
+	renderer.setViewport(0, 0, viewport.x, viewport.y);
+
+	ShaderDefines::Globals globals;
+	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
+
+	GlobalDS globalDS;
+	globalDS.globalUniforms  = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler   = linearSampler;
+	globalDS.nearestSampler  = nearestSampler;
+	renderer.bindDescriptorSet(0, globalDS);
+
+	ShaderDefines::ImageConstants constants = imageConstants();
+	if (image.tiled) {
+		ShaderDefines::TiledImageUBO tiledUBO;
+		image.tiled->describe(tiledUBO);
+
+		TiledImageDS tiledDS;
+		tiledDS.tiledUBO  = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::TiledImageUBO), &tiledUBO);
+		tiledDS.pageTable = image.tiled->getPageTable();
+		tiledDS.pageCache = imagePageCache.getBuffer();
+		renderer.bindDescriptorSet(1, tiledDS);
+	} else {
+		TextureHandle tex = image.tex ? image.tex : placeholderTex;
+		if (renderer.getFeatures().textureTable) {
+			TextureTableDS tableDS;
+			renderer.bindDescriptorSet(1, tableDS);
+			constants.textureIndex = renderer.getTextureTableIndex(tex);
+		} else {
+			ColorTexDS colorDS;
+			colorDS.color = tex;
+			renderer.bindDescriptorSet(1, colorDS);
+		}
+	}
+	renderer.pushConstants(constants);
+	renderer.draw(0, 3);
+}
+
+
+PipelineDesc SMAADemo::fxaaPipelineDesc() const {
+	std::string qualityString(fxaaQualityLevels[fxaaQuality]);
+
+	ShaderMacros macros;
+	macros.emplace("FXAA_QUALITY_PRESET", qualityString);
+	if (halfPrecision) {
+		macros.emplace("FXAA_HALF_PRECISION", "1");
+	}
+
+	std::string name = std::string("FXAA ") + qualityString;
+
+	PipelineDesc plDesc;
+	plDesc.depthWrite(false)
+	      .depthTest(false)
+	      .cullFaces(true)
+	      .descriptorSetLayout<GlobalDS>(0)
+	      .vertexShader("fxaa")
+	      .fragmentShader("fxaa");
+
+	if (fxaaTemporalResolve) {
+		macros.emplace("FXAA_TEMPORAL", "1");
+		macros.emplace("SMAA_REPROJECTION", std::to_string(temporalReproject));
+		name += " temporal";
+		if (temporalClamp) {
+			macros.emplace("TEMPORAL_CLAMP", "1");
+			name += " clamp";
+		}
+		plDesc.descriptorSetLayout<TemporalAADS>(1)
+		      .pushConstants<ShaderDefines::SMAAUBO>();
+	} else {
+		plDesc.descriptorSetLayout<ColorCombinedDS>(1);
+	}
+
+	plDesc.shaderMacros(macros)
+	      .name(name)
+	      .scissorTest(comparing());
+
+	return plDesc;
+}
+
+
+void SMAADemo::renderFXAA(RenderPasses rp, DemoRenderGraph::PassResources &r) {
+	if (!fxaaPipeline) {
+		PipelineDesc plDesc = fxaaPipelineDesc();
+		fxaaPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
+	assert(fxaaPipeline);
+
+	renderer.bindPipeline(fxaaPipeline);
+	bindStaticGlobals();
+	if (comparing()) {
+		setComparisonScissor(1, scaledSize(rendererDesc.swapchain.width, rendererDesc.swapchain.height));
+	}
+	if (fxaaTemporalResolve) {
+		renderer.pushConstants(smaaPushConstants());
+
+		TemporalAADS temporalDS;
+		temporalDS.currentTex.tex      = r.get(Rendertargets::MainColor);
+		temporalDS.currentTex.sampler  = linearSampler;
+		if (temporalAAFirstFrame) {
+			// no history yet, blend with the unfiltered scene so it doesn't flicker
+			temporalDS.previousTex.tex     = r.get(Rendertargets::MainColor);
+			temporalAAFirstFrame = false;
+		} else {
+			temporalDS.previousTex.tex     = r.get(Rendertargets::TemporalPrevious);
+		}
+		temporalDS.previousTex.sampler = nearestSampler;
+		temporalDS.velocityTex.tex     = r.get(Rendertargets::Velocity);
+		temporalDS.velocityTex.sampler = nearestSampler;
+		renderer.bindDescriptorSet(1, temporalDS);
+	} else {
+		ColorCombinedDS colorDS;
+		colorDS.color.tex     = r.get(Rendertargets::MainColor);
+		colorDS.color.sampler = linearSampler;
+		renderer.bindDescriptorSet(1, colorDS);
+	}
+	renderer.draw(0, 3);
+
+#ifndef IMGUI_DISABLE
+	if (fxaaDrawsGUI && guiVisible) {
+		// separate from the FXAA draw in captures
+		renderer.pushDebugGroup("GUI");
+		renderGUI(rp, r);
+		renderer.popDebugGroup();
+	}
+#endif  // IMGUI_DISABLE
+}
 
-			case SDL_SCANCODE_LALT:
-				leftAlt = false;
-				break;
 
-			case SDL_SCANCODE_RALT:
-				rightAlt = false;
-				break;
+ShaderDefines::SMAAUBO SMAADemo::smaaPushConstants() const {
+	ShaderDefines::SMAAUBO smaaUBO;
+	smaaUBO.smaaParameters        = smaaParameters;
+	smaaUBO.predicationThreshold  = predicationThreshold;
+	smaaUBO.predicationScale      = predicationScale;
+	smaaUBO.predicationStrength   = predicationStrength;
+	smaaUBO.reprojWeigthScale     = reprojectionWeightScale;
+	smaaUBO.subsampleIndices      = subsampleIndices[0];
+	smaaUBO.subsampleIndices2     = subsampleIndices[1];
 
-			case SDL_SCANCODE_LCTRL:
-				leftCtrl = false;
-				break;
+	return smaaUBO;
+}
 
-			case SDL_SCANCODE_RCTRL:
-				rightCtrl = false;
-				break;
 
-			default:
-				break;
-			}
+// low and medium compile out diagonal and corner detection so they need their own SPIR-V
+// the rest share the custom variant with the parameters as specialization constants
+static bool smaaQualityIsSpecialized(unsigned int quality) {
+	return quality == 0 || quality >= 3;
+}
 
-			break;
 
-		case SDL_WINDOWEVENT:
-			switch (event.window.event) {
-			case SDL_WINDOWEVENT_SIZE_CHANGED:
-			case SDL_WINDOWEVENT_RESIZED:
-				rendererDesc.swapchain.width  = event.window.data1;
-				rendererDesc.swapchain.height = event.window.data2;
-				recreateSwapchain = true;
-				LOG("window resize to %ux%u\n", rendererDesc.swapchain.width, rendererDesc.swapchain.height);
-				logFlush();
-				break;
-			default:
-				break;
-			}
-			break;
+ShaderMacros SMAADemo::smaaQualityMacros() const {
+	ShaderMacros macros;
+	if (smaaQualityIsSpecialized(smaaQuality)) {
+		macros.emplace("SMAA_PRESET_CUSTOM", "1");
+	} else {
+		std::string qualityString(std::string("SMAA_PRESET_") + smaaQualityLevels[smaaQuality]);
+		macros.emplace(qualityString, "1");
+	}
 
-		case SDL_DROPFILE: {
-				char* droppedFile = event.drop.file;
-				std::string filestring(droppedFile);
-				SDL_free(droppedFile);
-				loadImage(filestring);
-			} break;
+	// shared by every SMAA pass so edges, weights and blending switch together
+	if (halfPrecision) {
+		macros.emplace("SMAA_HALF_PRECISION", "1");
+	}
 
-#ifndef IMGUI_DISABLE
+	return macros;
+}
 
-		case SDL_TEXTINPUT:
-			io.AddInputCharactersUTF8(event.text.text);
-			break;
 
-		case SDL_MOUSEMOTION:
-			io.MousePos = ImVec2(static_cast<float>(event.motion.x), static_cast<float>(event.motion.y));
-			break;
+template <typename Desc> void SMAADemo::smaaSpecConstants(Desc &desc) const {
+	if (!smaaQualityIsSpecialized(smaaQuality)) {
+		return;
+	}
 
-		case SDL_MOUSEBUTTONDOWN:
-		case SDL_MOUSEBUTTONUP:
-			if (event.button.button < 6) {
-				// SDL and imgui have left and middle in different order
-				static const uint8_t SDLMouseLookup[5] = { 0, 2, 1, 3, 4 };
-				io.MouseDown[SDLMouseLookup[event.button.button - 1]] = (event.button.state == SDL_PRESSED);
-			}
-			break;
+	const auto &params = (smaaQuality == 0) ? smaaParameters : defaultSMAAParameters[smaaQuality];
+	desc.specConstant(SMAA_SPEC_THRESHOLD,             params.threshold)
+	    .specConstant(SMAA_SPEC_DEPTH_THRESHOLD,       params.depthThreshold)
+	    .specConstant(SMAA_SPEC_MAX_SEARCH_STEPS,      params.maxSearchSteps)
+	    .specConstant(SMAA_SPEC_MAX_SEARCH_STEPS_DIAG, params.maxSearchStepsDiag)
+	    .specConstant(SMAA_SPEC_CORNER_ROUNDING,       params.cornerRounding);
+}
 
-		case SDL_MOUSEWHEEL:
-			io.MouseWheel = static_cast<float>(event.wheel.y);
-			break;
 
-#endif  // IMGUI_DISABLE
+ShaderMacros SMAADemo::smaaEdgeShaderMacros() const {
+	ShaderMacros macros = smaaQualityMacros();
 
-		}
+	if (smaaEdgeMethod != SMAAEdgeMethod::Color) {
+		macros.emplace("EDGEMETHOD", std::to_string(static_cast<uint8_t>(smaaEdgeMethod)));
 	}
 
-#ifndef IMGUI_DISABLE
+	// cube and image shaders already store luma in alpha for FXAA
+	if (smaaEdgeMethod == SMAAEdgeMethod::Luma) {
+		macros.emplace("SMAA_LUMA_IN_ALPHA", "1");
+	}
 
-	io.KeyShift = leftShift || rightShift;
-	io.KeyAlt   = leftAlt   || rightAlt;
-	io.KeyCtrl  = leftCtrl  || rightCtrl;
+	if (smaaPredication && smaaEdgeMethod != SMAAEdgeMethod::Depth) {
+		macros.emplace("SMAA_PREDICATION", "1");
+	}
 
-#endif  // IMGUI_DISABLE
+	return macros;
 }
 
 
-void SMAADemo::mainLoopIteration() {
-	uint64_t ticks   = getNanoseconds();
-	uint64_t elapsed = ticks - lastTime;
+PipelineDesc SMAADemo::smaaEdgePipelineDesc() const {
+	ShaderMacros macros = smaaEdgeShaderMacros();
 
-	if (fpsLimitActive) {
-		uint64_t nsLimit = 1000000000ULL / fpsLimit;
-		while (elapsed + sleepFudge < nsLimit) {
-			// limit reached, throttle
-			uint64_t nsWait = nsLimit - (elapsed + sleepFudge);
-			std::this_thread::sleep_for(std::chrono::nanoseconds(nsWait));
-			ticks   = getNanoseconds();
-			elapsed = ticks - lastTime;
-		}
+	PipelineDesc plDesc;
+	plDesc.depthWrite(false)
+	      .depthTest(false)
+	      .cullFaces(true)
+	      .descriptorSetLayout<GlobalDS>(0)
+	      .pushConstants<ShaderDefines::SMAAUBO>()
+	      .vertexShader("smaaEdge")
+	      .fragmentShader("smaaEdge");
+	smaaSpecConstants(plDesc);
+
+	plDesc.descriptorSetLayout<EdgeDetectionDS>(1);
+	if (smaa2XActive()) {
+		macros.emplace("SMAA_S2X", "1");
+		plDesc.name(std::string("SMAA edges (S2X) ") + std::to_string(smaaQuality));
+	} else {
+		plDesc.name(std::string("SMAA edges ") + std::to_string(smaaQuality));
+	}
+	plDesc.shaderMacros(macros)
+	      .scissorTest(comparing());
+
+	if (smaaStencil) {
+		// non-edge pixels are discarded so only edges get marked
+		plDesc.stencilTest(true)
+		      .stencilFunc(StencilFunc::Always)
+		      .stencilPassOp(StencilOp::Replace)
+		      .stencilRef(1);
 	}
 
-	lastTime = ticks;
+	return plDesc;
+}
 
-	processInput();
 
-#ifndef IMGUI_DISABLE
+void SMAADemo::renderSMAAEdges(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input) {
+	if (!smaaPipelines.edgePipeline) {
+		PipelineDesc plDesc = smaaEdgePipelineDesc();
+		smaaPipelines.edgePipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
 
-	updateGUI(elapsed);
+	glm::uvec2 viewport = scaledSize(smaaSize.x, smaaSize.y);
+	renderer.setViewport(0, 0, viewport.x, viewport.y);
+	renderer.bindPipeline(smaaPipelines.edgePipeline);
+	bindStaticGlobals();
+	if (comparing()) {
+		setComparisonScissor(2, viewport);
+	}
+	renderer.pushConstants(smaaPushConstants());
 
-#endif  // IMGUI_DISABLE
+	CSampler color;
+	if (smaaEdgeMethod == SMAAEdgeMethod::Depth) {
+		color.tex     = r.get(Rendertargets::MainDepth);
+		color.sampler = nearestSampler;
+	} else {
+		color.tex     = r.get(input, Format::RGBA8);
+		// at reduced resolution filter the color instead of skipping pixels
+		color.sampler = (smaaScale < 1.0f) ? linearSampler : nearestSampler;
+	}
+	// the shader only reads it with predication but the set still needs a valid texture
+	CSampler predication = color;
+	if (smaaPredication) {
+		predication.tex     = r.get(Rendertargets::MainDepth);
+		predication.sampler = nearestSampler;
+	}
 
-	if (!isImageScene() && rotateCubes) {
-		rotationTime += elapsed;
+	// S2X reads both subsamples of the same multisampled color so the set is the same
+	assert(!smaa2XActive() || input == Rendertargets::MainColor);
+	EdgeDetectionDS edgeDS;
+	edgeDS.color          = color;
+	edgeDS.predicationTex = predication;
+	renderer.bindDescriptorSet(1, edgeDS);
+	renderer.draw(0, 3);
+}
 
-		// TODO: increasing rotation period can make cubes spin backwards
-		const uint64_t rotationPeriod = rotationPeriodSeconds * 1000000000ULL;
-		rotationTime   = rotationTime % rotationPeriod;
-		cameraRotation = float(M_PI * 2.0f * rotationTime) / rotationPeriod;
-	}
 
-	if (antialiasing && temporalAA && !isImageScene()) {
-		temporalFrame = (temporalFrame + 1) % 2;
+PipelineDesc SMAADemo::smaaWeightsPipelineDesc() const {
+	ShaderMacros macros = smaaQualityMacros();
 
-		switch (aaMethod) {
-		case AAMethod::MSAA:
-		case AAMethod::FXAA:
-			// not used
-			subsampleIndices[0] = glm::vec4(0.0f);
-			subsampleIndices[1] = glm::vec4(0.0f);
-			break;
+	PipelineDesc plDesc;
+	plDesc.depthWrite(false)
+	      .depthTest(false)
+	      .cullFaces(true)
+	      .descriptorSetLayout<GlobalDS>(0)
+	      .pushConstants<ShaderDefines::SMAAUBO>()
+	      .vertexShader("smaaBlendWeight")
+	      .fragmentShader("smaaBlendWeight");
+	smaaSpecConstants(plDesc);
 
-		case AAMethod::SMAA: {
-			float v       = float(temporalFrame + 1);
-			subsampleIndices[0] = glm::vec4(v, v, v, 0.0f);
-			subsampleIndices[1] = glm::vec4(0.0f);
-		} break;
+	if (smaa2XActive()) {
+		macros.emplace("SMAA_S2X", "1");
+		plDesc.descriptorSetLayout<SMAA2XBlendWeightDS>(1)
+		      .name(std::string("SMAA weights (S2X) ") + std::to_string(smaaQuality));
+	} else {
+		plDesc.descriptorSetLayout<BlendWeightDS>(1)
+		      .name(std::string("SMAA weights ") + std::to_string(smaaQuality));
+	}
+	plDesc.shaderMacros(macros)
+	      .scissorTest(comparing());
+
+	if (smaaStencil) {
+		// weights are cleared to zero so skipped pixels are correct
+		plDesc.stencilTest(true)
+		      .stencilFunc(StencilFunc::Equal)
+		      .stencilPassOp(StencilOp::Keep)
+		      .stencilRef(1);
+	}
 
-		case AAMethod::SMAA2X:
-			if (temporalFrame == 0) {
-				subsampleIndices[0] = glm::vec4(5.0f, 3.0f, 1.0f, 3.0f);
-				subsampleIndices[1] = glm::vec4(4.0f, 6.0f, 2.0f, 3.0f);
-			} else {
-				assert(temporalFrame == 1);
-				subsampleIndices[0] = glm::vec4(3.0f, 5.0f, 1.0f, 4.0f);
-				subsampleIndices[1] = glm::vec4(6.0f, 4.0f, 2.0f, 4.0f);
-			}
-			break;
+	return plDesc;
+}
 
-		}
+
+void SMAADemo::renderSMAAWeights(RenderPasses rp, DemoRenderGraph::PassResources &r) {
+	if (!smaaPipelines.blendWeightPipeline) {
+		PipelineDesc plDesc = smaaWeightsPipelineDesc();
+		smaaPipelines.blendWeightPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
+
+	glm::uvec2 viewport = scaledSize(smaaSize.x, smaaSize.y);
+	renderer.setViewport(0, 0, viewport.x, viewport.y);
+	renderer.bindPipeline(smaaPipelines.blendWeightPipeline);
+	bindStaticGlobals();
+	if (comparing()) {
+		setComparisonScissor(2, viewport);
+	}
+	renderer.pushConstants(smaaPushConstants());
+
+	if (smaa2XActive()) {
+		SMAA2XBlendWeightDS blendWeightDS;
+		blendWeightDS.edgesTex.tex       = r.get(Rendertargets::Edges);
+		blendWeightDS.edgesTex.sampler   = linearSampler;
+		blendWeightDS.areaTex.tex        = areaTex;
+		blendWeightDS.areaTex.sampler    = linearSampler;
+		blendWeightDS.searchTex.tex      = searchTex;
+		blendWeightDS.searchTex.sampler  = linearSampler;
+		blendWeightDS.edgesTex2.tex      = r.get(Rendertargets::Edges2);
+		blendWeightDS.edgesTex2.sampler  = linearSampler;
+		renderer.bindDescriptorSet(1, blendWeightDS);
 	} else {
-		if (aaMethod == +AAMethod::SMAA2X) {
-			subsampleIndices[0] = glm::vec4(1.0, 1.0, 1.0, 0.0f);
-		} else {
-			subsampleIndices[0] = glm::vec4(0.0f);
-		}
-		subsampleIndices[1] = glm::vec4(2.0f, 2.0f, 2.0f, 0.0f);
+		BlendWeightDS blendWeightDS;
+		blendWeightDS.edgesTex.tex      = r.get(Rendertargets::Edges);
+		blendWeightDS.edgesTex.sampler  = linearSampler;
+		blendWeightDS.areaTex.tex       = areaTex;
+		blendWeightDS.areaTex.sampler   = linearSampler;
+		blendWeightDS.searchTex.tex     = searchTex;
+		blendWeightDS.searchTex.sampler = linearSampler;
+		renderer.bindDescriptorSet(1, blendWeightDS);
 	}
 
-	render();
+	renderer.draw(0, 3);
 }
 
 
-void SMAADemo::render() {
-	if (recreateSwapchain) {
-		renderer.setSwapchainDesc(rendererDesc.swapchain);
+void SMAADemo::addSMAAStencilTarget(unsigned int width, unsigned int height) {
+	if (!smaaStencil) {
+		return;
+	}
 
-		renderSize = renderer.getDrawableSize();
-		LOG("drawable size: %ux%u\n", renderSize.x, renderSize.y);
-		logFlush();
+	RenderTargetDesc rtDesc;
+	rtDesc.name("SMAA stencil")
+		  .format(stencilFormat)
+		  .width(width)
+		  .height(height);
+	renderGraph.renderTarget(Rendertargets::SMAAStencil, rtDesc);
+}
 
-		// pump events
-		processInput();
 
-		rebuildRG = true;
-		recreateSwapchain = false;
+void SMAADemo::smaaStencilAttachment(DemoRenderGraph::PassDesc &desc, bool edges) const {
+	if (!smaaStencil) {
+		return;
 	}
 
-	if (rebuildRG) {
-		rebuildRenderGraph();
-		assert(!rebuildRG);
+	// depth contents are never used
+	desc.depthStencil(Rendertargets::SMAAStencil, PassBegin::DontCare);
+	if (edges) {
+		desc.stencil(PassBegin::Clear, true, 0);
+	} else {
+		desc.stencil(PassBegin::Keep, false);
+	}
+}
 
-		if (antialiasing && temporalAA) {
-			temporalAAFirstFrame = true;
-		}
+
+void SMAADemo::addSMAAComputePasses(Rendertargets input, unsigned int subsample, unsigned int width, unsigned int height) {
+	assert(smaaCompute);
+	assert(subsample < subsampleIndices.size());
+	assert(!smaaTileBuffer);
+
+	{
+		RenderTargetDesc rtDesc;
+		rtDesc.name("SMAA weights")
+			  .format(Format::RGBA8)
+			  .width(width)
+			  .height(height);
+		renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
 	}
 
-	// TODO: this should be in RenderGraph
-	if (!renderer.beginFrame()) {
-		// check if caused by swapchain out of date, recreate if so
-		if (renderer.isSwapchainDirty() ) {
-			recreateSwapchain = true;
-		}
+	// worst case every tile has edges
+	unsigned int tilesX = (width  + SMAA_COMPUTE_TILE_SIZE - 1) / SMAA_COMPUTE_TILE_SIZE;
+	unsigned int tilesY = (height + SMAA_COMPUTE_TILE_SIZE - 1) / SMAA_COMPUTE_TILE_SIZE;
+	std::vector<uint32_t> tileList(SMAA_TILE_LIST_HEADER + tilesX * tilesY, 0);
+	smaaTileBuffer = renderer.createBuffer(BufferType::Indirect, tileList.size() * sizeof(uint32_t), &tileList[0]);
+
+	DrawIndirectArgs tileDraw;
+	tileDraw.vertexCount   = SMAA_TILE_VERTICES;
+	tileDraw.instanceCount = 0;
+	tileDraw.firstVertex   = 0;
+	tileDraw.firstInstance = 0;
+	smaaTileDrawBuffer = renderer.createBuffer(BufferType::Indirect, sizeof(tileDraw), &tileDraw);
+
+	if (smaaInPlaceBlendActive) {
+		std::vector<uint32_t> blendColors(tilesX * tilesY * SMAA_BLEND_TILE_UINTS, 0);
+		smaaBlendColorBuffer = renderer.createBuffer(BufferType::Storage, blendColors.size() * sizeof(uint32_t), &blendColors[0]);
+	}
 
-		// TODO: yield or sleep to avoid high cpu usage
+	// edges pass
+	// also clears blend weights of tiles without edges so the weights pass can skip them
+	{
+		DemoRenderGraph::ComputePassDesc desc;
+		desc.storageRendertarget(Rendertargets::Edges)
+		    .storageRendertarget(Rendertargets::BlendWeights)
+		    .inputRendertarget(input)
+		    .async(true)
+		    .name("SMAA edges compute");
+		if (smaaEdgesNeedDepth()) {
+			desc.inputRendertarget(Rendertargets::MainDepth);
+		}
 
-		return;
+		renderGraph.computePass(RenderPasses::SMAAEdgesCompute, desc, [this, input] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdgesCompute(rp, r, input); } );
 	}
 
-	if (antialiasing && temporalAA && !isImageScene()) {
-		assert(temporalRTs[0]);
-		assert(temporalRTs[1]);
-		renderGraph.bindExternalRT(Rendertargets::TemporalPrevious, temporalRTs[1 - temporalFrame]);
-		renderGraph.bindExternalRT(Rendertargets::TemporalCurrent,  temporalRTs[    temporalFrame]);
+	// blendweights pass
+	{
+		DemoRenderGraph::ComputePassDesc desc;
+		desc.storageRendertarget(Rendertargets::BlendWeights)
+		    .inputRendertarget(Rendertargets::Edges)
+		    .async(true)
+		    .name("SMAA weights compute");
+
+		renderGraph.computePass(RenderPasses::SMAAWeightsCompute, desc, [this, subsample] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeightsCompute(rp, r, subsample); } );
 	}
+}
 
-	renderGraph.render(renderer);
+
+ComputePipelineDesc SMAADemo::smaaTileResetPipelineDesc() const {
+	// uses the edge pass descriptor set so it can be bound once for both
+	ComputePipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<EdgeDetectionComputeDS>(1)
+	      .computeShader("smaaTileReset")
+	      .name("SMAA tile reset");
+
+	return plDesc;
 }
 
 
-void SMAADemo::renderCubeScene(RenderPasses rp, DemoRenderGraph::PassResources & /* r */) {
-	if (!cubePipeline) {
-		std::string name = "cubes";
-		if (numSamples > 1) {
-			name += " MSAA x" + std::to_string(numSamples);
-		}
+ComputePipelineDesc SMAADemo::smaaEdgeComputePipelineDesc() const {
+	ComputePipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<EdgeDetectionComputeDS>(1)
+	      .pushConstants<ShaderDefines::SMAAUBO>()
+	      .shaderMacros(smaaEdgeShaderMacros())
+	      .computeShader("smaaEdge")
+	      .name(std::string("SMAA edges compute ") + std::to_string(smaaQuality));
+	smaaSpecConstants(plDesc);
+
+	return plDesc;
+}
 
-		PipelineDesc plDesc;
-		plDesc.name(name)
-		      .vertexShader("cube")
-		      .fragmentShader("cube")
-		      .numSamples(numSamples)
-		      .descriptorSetLayout<GlobalDS>(0)
-		      .descriptorSetLayout<CubeSceneDS>(1)
-		      .vertexAttrib(ATTR_POS, 0, 3, VtxFormat::Float, 0)
-		      .vertexBufferStride(ATTR_POS, sizeof(Vertex))
-		      .depthWrite(true)
-		      .depthTest(true)
-		      .cullFaces(true);
 
-		cubePipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+void SMAADemo::renderSMAAEdgesCompute(RenderPasses /* rp */, DemoRenderGraph::PassResources &r, Rendertargets input) {
+	if (!smaaPipelines.tileResetPipeline) {
+		ComputePipelineDesc plDesc = smaaTileResetPipelineDesc();
+		smaaPipelines.tileResetPipeline = renderGraph.createComputePipeline(renderer, plDesc);
 	}
-    assert(cubePipeline);
 
-	renderer.bindPipeline(cubePipeline);
+	if (!smaaPipelines.edgeComputePipeline) {
+		ComputePipelineDesc plDesc = smaaEdgeComputePipelineDesc();
+		smaaPipelines.edgeComputePipeline = renderGraph.createComputePipeline(renderer, plDesc);
+	}
 
 	const unsigned int windowWidth  = rendererDesc.swapchain.width;
 	const unsigned int windowHeight = rendererDesc.swapchain.height;
 
+	// compute has its own bind point so the scene's globals aren't visible here
 	ShaderDefines::Globals globals;
 	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.viewProj              = currViewProj;
+	globals.prevViewProj          = prevViewProj;
+	globals.reprojection          = reprojection;
 	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
 
-	// TODO: better calculation, and check cube size (side is sqrt(3) currently)
-	const float cubeDiameter = sqrtf(3.0f);
-	const float cubeDistance = cubeDiameter + 1.0f;
+	GlobalDS globalDS;
+	globalDS.globalUniforms  = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler   = linearSampler;
+	globalDS.nearestSampler  = nearestSampler;
 
-	float farPlane  = cameraDistance + cubeDistance * float(cubesPerSide + 1);
-	float nearPlane = std::max(0.1f, cameraDistance - cubeDistance * float(cubesPerSide + 1));
+	EdgeDetectionComputeDS edgeDS;
+	if (smaaEdgeMethod == SMAAEdgeMethod::Depth) {
+		edgeDS.color.tex     = r.get(Rendertargets::MainDepth);
+		edgeDS.color.sampler = nearestSampler;
+	} else {
+		edgeDS.color.tex     = r.get(input, Format::RGBA8);
+		edgeDS.color.sampler = (smaaScale < 1.0f) ? linearSampler : nearestSampler;
+	}
+	edgeDS.predicationTex = edgeDS.color;
+	if (smaaPredication) {
+		edgeDS.predicationTex.tex     = r.get(Rendertargets::MainDepth);
+		edgeDS.predicationTex.sampler = nearestSampler;
+	}
+	edgeDS.edgesImage             = r.get(Rendertargets::Edges);
+	edgeDS.blendWeightsImage      = r.get(Rendertargets::BlendWeights);
+	edgeDS.tileList               = smaaTileBuffer;
+	edgeDS.tileDraw               = smaaTileDrawBuffer;
+
+	// previous frame's weights pass might still be reading the tile list
+	renderer.computeBarrier();
+	renderer.bindPipeline(smaaPipelines.tileResetPipeline);
+	renderer.bindDescriptorSet(0, globalDS);
+	renderer.bindDescriptorSet(1, edgeDS);
+	renderer.dispatch(1, 1, 1);
+	renderer.computeBarrier();
 
-	glm::mat4 model  = glm::rotate(glm::mat4(1.0f), cameraRotation, glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 view   = glm::lookAt(glm::vec3(cameraDistance, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 proj   = glm::perspective(float(65.0f * M_PI * 2.0f / 360.0f), float(windowWidth) / windowHeight, nearPlane, farPlane);
-	glm::mat4 viewProj = proj * view * model;
+	renderer.bindPipeline(smaaPipelines.edgeComputePipeline);
+	renderer.pushConstants(smaaPushConstants());
+	renderer.bindDescriptorSet(0, globalDS);
+	renderer.bindDescriptorSet(1, edgeDS);
+	glm::uvec2 edgeSize = scaledSize(smaaSize.x, smaaSize.y);
+	renderer.dispatch((edgeSize.x + SMAA_COMPUTE_TILE_SIZE - 1) / SMAA_COMPUTE_TILE_SIZE
+	                , (edgeSize.y + SMAA_COMPUTE_TILE_SIZE - 1) / SMAA_COMPUTE_TILE_SIZE
+	                , 1);
+}
 
-	// temporal jitter
-	if (antialiasing && temporalAA && !isImageScene()) {
-		glm::vec2 jitter;
-		if (aaMethod == +AAMethod::MSAA || aaMethod == +AAMethod::SMAA2X) {
-			const glm::vec2 jitters[2] = {
-				  {  0.125f,  0.125f }
-				, { -0.125f, -0.125f }
-			};
-			jitter = jitters[temporalFrame];
-		} else {
-			const glm::vec2 jitters[2] = {
-				  { -0.25f,  0.25f }
-				, { 0.25f,  -0.25f }
-			};
-			jitter = jitters[temporalFrame];
-		}
 
-		jitter = jitter * 2.0f * glm::vec2(globals.screenSize.x, globals.screenSize.y);
-		glm::mat4 jitterMatrix = glm::translate(glm::identity<glm::mat4>(), glm::vec3(jitter, 0.0f));
-		viewProj = jitterMatrix * viewProj;
+ComputePipelineDesc SMAADemo::smaaWeightsComputePipelineDesc() const {
+	ShaderMacros macros = smaaQualityMacros();
+	if (smaaSubgroupSearch) {
+		macros.emplace("SMAA_SUBGROUP_SEARCH", "1");
 	}
 
-	prevViewProj         = currViewProj;
-	currViewProj         = viewProj;
-	globals.viewProj     = currViewProj;
-	globals.prevViewProj = prevViewProj;
+	ComputePipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<BlendWeightComputeDS>(1)
+	      .pushConstants<ShaderDefines::SMAAUBO>()
+	      .shaderMacros(macros)
+	      .computeShader("smaaBlendWeight")
+	      .name(std::string("SMAA weights compute ") + std::to_string(smaaQuality) + (smaaSubgroupSearch ? " subgroup" : ""));
+	smaaSpecConstants(plDesc);
+
+	return plDesc;
+}
+
+
+void SMAADemo::renderSMAAWeightsCompute(RenderPasses /* rp */, DemoRenderGraph::PassResources &r, unsigned int subsample) {
+	if (!smaaPipelines.blendWeightComputePipeline) {
+		ComputePipelineDesc plDesc = smaaWeightsComputePipelineDesc();
+		smaaPipelines.blendWeightComputePipeline = renderGraph.createComputePipeline(renderer, plDesc);
+	}
+
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+	ShaderDefines::Globals globals;
+	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.viewProj              = currViewProj;
+	globals.prevViewProj          = prevViewProj;
+	globals.reprojection          = reprojection;
+	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
+
+	GlobalDS globalDS;
+	globalDS.globalUniforms  = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler   = linearSampler;
+	globalDS.nearestSampler  = nearestSampler;
+
+	BlendWeightComputeDS blendWeightDS;
+	blendWeightDS.edgesTex.tex      = r.get(Rendertargets::Edges);
+	blendWeightDS.edgesTex.sampler  = linearSampler;
+	blendWeightDS.areaTex.tex       = areaTex;
+	blendWeightDS.areaTex.sampler   = linearSampler;
+	blendWeightDS.searchTex.tex     = searchTex;
+	blendWeightDS.searchTex.sampler = linearSampler;
+	blendWeightDS.blendWeightsImage = r.get(Rendertargets::BlendWeights);
+	blendWeightDS.tileList          = smaaTileBuffer;
 
-	renderer.setViewport(0, 0, windowWidth, windowHeight);
+	// the shader only reads the first indices, put this subsample's there
+	ShaderDefines::SMAAUBO smaaUBO = smaaPushConstants();
+	smaaUBO.subsampleIndices       = subsampleIndices[subsample];
 
-	GlobalDS globalDS;
-	globalDS.globalUniforms = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
-	globalDS.linearSampler  = linearSampler;
-	globalDS.nearestSampler = nearestSampler;
+	renderer.bindPipeline(smaaPipelines.blendWeightComputePipeline);
+	renderer.pushConstants(smaaUBO);
 	renderer.bindDescriptorSet(0, globalDS);
+	renderer.bindDescriptorSet(1, blendWeightDS);
 
-	renderer.bindVertexBuffer(0, cubeVBO);
-	renderer.bindIndexBuffer(cubeIBO, false);
+	// one workgroup per tile the edge pass found
+	// BlendWeights stays in General so the render graph put a barrier before this
+	renderer.dispatchIndirect(smaaTileBuffer);
+}
 
-	CubeSceneDS cubeDS;
-	// FIXME: remove unused UBO hack
-	uint32_t temp    = 0;
-	cubeDS.unused    = renderer.createEphemeralBuffer(BufferType::Uniform, 4, &temp);
-	cubeDS.instances = renderer.createEphemeralBuffer(BufferType::Storage, static_cast<uint32_t>(sizeof(ShaderDefines::Cube) * cubes.size()), &cubes[0]);
-	renderer.bindDescriptorSet(1, cubeDS);
 
-	unsigned int numCubes = static_cast<unsigned int>(cubes.size());
-	if (visualizeCubeOrder) {
-		cubeOrderNum = cubeOrderNum % numCubes;
-		cubeOrderNum++;
-		numCubes     = cubeOrderNum;
+ComputePipelineDesc SMAADemo::smaaBlendComputePipelineDesc() const {
+	// neighborhood blending doesn't depend on the preset
+	ShaderMacros macros;
+	if (halfPrecision) {
+		macros.emplace("SMAA_HALF_PRECISION", "1");
 	}
 
-	renderer.drawIndexedInstanced(3 * 2 * 6, numCubes);
-}
+	ComputePipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<NeighborBlendComputeDS>(1)
+	      .shaderMacros(macros)
+	      .computeShader("smaaNeighbor")
+	      .name(std::string("SMAA blend compute") + (halfPrecision ? " half" : ""));
 
+	return plDesc;
+}
 
-void SMAADemo::renderImageScene(RenderPasses rp, DemoRenderGraph::PassResources & /* r */) {
-	if (!imagePipeline) {
-		PipelineDesc plDesc;
-		plDesc.numSamples(numSamples)
-		      .descriptorSetLayout<GlobalDS>(0)
-		      .descriptorSetLayout<ColorTexDS>(1)
-		      .vertexShader("image")
-		      .fragmentShader("image")
-		      .name("image");
 
-		imagePipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+void SMAADemo::renderSMAABlendCompute(RenderPasses /* rp */, DemoRenderGraph::PassResources &r) {
+	if (!smaaPipelines.neighborComputePipeline) {
+		ComputePipelineDesc plDesc = smaaBlendComputePipelineDesc();
+		smaaPipelines.neighborComputePipeline = renderGraph.createComputePipeline(renderer, plDesc);
 	}
 
-	renderer.bindPipeline(imagePipeline);
-
-	assert(activeScene > 0);
-	const auto &image = images.at(activeScene - 1);
-
 	const unsigned int windowWidth  = rendererDesc.swapchain.width;
 	const unsigned int windowHeight = rendererDesc.swapchain.height;
 
-	renderer.setViewport(0, 0, windowWidth, windowHeight);
-
 	ShaderDefines::Globals globals;
 	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(renderScale, renderScale, 0.0f, 0.0f);
+	globals.viewProj              = currViewProj;
+	globals.prevViewProj          = prevViewProj;
+	globals.reprojection          = reprojection;
 	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
 
 	GlobalDS globalDS;
 	globalDS.globalUniforms  = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
 	globalDS.linearSampler   = linearSampler;
 	globalDS.nearestSampler  = nearestSampler;
+
+	NeighborBlendComputeDS blendDS;
+	blendDS.color.tex            = r.get(Rendertargets::MainColor);
+	blendDS.color.sampler        = linearSampler;
+	blendDS.blendweights.tex     = r.get(Rendertargets::BlendWeights);
+	blendDS.blendweights.sampler = linearSampler;
+	blendDS.tileList             = smaaTileBuffer;
+	blendDS.blendColors          = smaaBlendColorBuffer;
+
+	renderer.bindPipeline(smaaPipelines.neighborComputePipeline);
 	renderer.bindDescriptorSet(0, globalDS);
+	renderer.bindDescriptorSet(1, blendDS);
+	renderer.dispatchIndirect(smaaTileBuffer);
 
-	assert(activeScene - 1 < images.size());
-	ColorTexDS colorDS;
-	// FIXME: remove unused UBO hack
-	uint32_t temp  = 0;
-	colorDS.unused = renderer.createEphemeralBuffer(BufferType::Uniform, 4, &temp);
-	colorDS.color = image.tex;
-	renderer.bindDescriptorSet(1, colorDS);
-	renderer.draw(0, 3);
+	// the blend pass reads the colors in its fragment shader
+	// last frame's blend pass is done reading them by the time the scene pass writes MainColor again
+	renderer.computeBarrier();
 }
 
 
-void SMAADemo::renderFXAA(RenderPasses rp, DemoRenderGraph::PassResources &r) {
-	if (!fxaaPipeline) {
-		std::string qualityString(fxaaQualityLevels[fxaaQuality]);
-
-		ShaderMacros macros;
-		macros.emplace("FXAA_QUALITY_PRESET", qualityString);
-
-		PipelineDesc plDesc;
-		plDesc.depthWrite(false)
-		      .depthTest(false)
-		      .cullFaces(true)
-		      .descriptorSetLayout<GlobalDS>(0)
-		      .descriptorSetLayout<ColorCombinedDS>(1)
-		      .shaderMacros(macros)
-		      .vertexShader("fxaa")
-		      .fragmentShader("fxaa")
-		      .name(std::string("FXAA ") + qualityString);
+PipelineDesc SMAADemo::smaaBlendPipelineDesc() const {
+	ShaderMacros macros = smaaQualityMacros();
+
+	PipelineDesc plDesc;
+	plDesc.depthWrite(false)
+	      .depthTest(false)
+	      .cullFaces(true)
+	      .descriptorSetLayout<GlobalDS>(0)
+	      .pushConstants<ShaderDefines::SMAAUBO>()
+	      .vertexShader("smaaNeighbor")
+	      .fragmentShader("smaaNeighbor");
+
+	if (smaa2XActive()) {
+		// averages the subsamples in the shader instead of blending a second pass on top
+		macros.emplace("SMAA_S2X", "1");
+		plDesc.descriptorSetLayout<SMAA2XNeighborBlendDS>(1)
+		      .name(std::string("SMAA blend (S2X) ") + std::to_string(smaaQuality));
+	} else if (smaaInPlaceBlendActive) {
+		// copies what the compute blend wrote for pixels with weights
+		macros.emplace("SMAA_TILES",    "1");
+		macros.emplace("SMAA_IN_PLACE", "1");
+		plDesc.descriptorSetLayout<NeighborBlendInPlaceDS>(1)
+		      .cullFaces(false)
+		      .name(std::string("SMAA blend (in place) ") + std::to_string(smaaQuality));
+	} else if (smaaTiledBlendActive) {
+		macros.emplace("SMAA_TILES", "1");
+		plDesc.descriptorSetLayout<NeighborBlendTilesDS>(1)
+		      .cullFaces(false)
+		      .name(std::string("SMAA blend (tiles) ") + std::to_string(smaaQuality));
+	} else {
+		plDesc.descriptorSetLayout<NeighborBlendDS>(1)
+		      .name(std::string("SMAA blend ") + std::to_string(smaaQuality));
+	}
+	plDesc.shaderMacros(macros)
+	      .scissorTest(comparing());
 
-		fxaaPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	return plDesc;
+}
+
+
+void SMAADemo::renderSMAABlend(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input) {
+	if (!smaaPipelines.neighborPipeline) {
+		PipelineDesc plDesc = smaaBlendPipelineDesc();
+		smaaPipelines.neighborPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
+
+	// edges and weights passes might have left a smaller viewport
+	glm::uvec2 viewport = scaledSize(rendererDesc.swapchain.width, rendererDesc.swapchain.height);
+	renderer.setViewport(0, 0, viewport.x, viewport.y);
+
+	// full effect
+	renderer.bindPipeline(smaaPipelines.neighborPipeline);
+	bindStaticGlobals();
+	if (comparing()) {
+		setComparisonScissor(2, viewport);
+	}
+	renderer.pushConstants(smaaPushConstants());
+
+	if (smaa2XActive()) {
+		assert(input == Rendertargets::MainColor);
+
+		// the shader filters the multisampled color itself
+		SMAA2XNeighborBlendDS neighborBlendDS;
+		neighborBlendDS.color.tex             = r.get(input);
+		neighborBlendDS.color.sampler         = nearestSampler;
+		neighborBlendDS.blendweights.tex      = r.get(Rendertargets::BlendWeights);
+		neighborBlendDS.blendweights.sampler  = linearSampler;
+		neighborBlendDS.blendweights2.tex     = r.get(Rendertargets::BlendWeights2);
+		neighborBlendDS.blendweights2.sampler = linearSampler;
+		renderer.bindDescriptorSet(1, neighborBlendDS);
+	} else if (smaaInPlaceBlendActive) {
+		NeighborBlendInPlaceDS neighborBlendDS;
+		neighborBlendDS.tileList    = smaaTileBuffer;
+		neighborBlendDS.blendColors = smaaBlendColorBuffer;
+		renderer.bindDescriptorSet(1, neighborBlendDS);
+
+		renderer.drawIndirect(smaaTileDrawBuffer, 1);
+		return;
+	} else if (smaaTiledBlendActive) {
+		NeighborBlendTilesDS neighborBlendDS;
+		neighborBlendDS.color.tex            = r.get(input);
+		neighborBlendDS.color.sampler        = linearSampler;
+		neighborBlendDS.blendweights.tex     = r.get(Rendertargets::BlendWeights);
+		neighborBlendDS.blendweights.sampler = linearSampler;
+		neighborBlendDS.tileList             = smaaTileBuffer;
+		renderer.bindDescriptorSet(1, neighborBlendDS);
+
+		// one quad per tile the compute edge pass found
+		renderer.drawIndirect(smaaTileDrawBuffer, 1);
+		return;
+	} else {
+		NeighborBlendDS neighborBlendDS;
+		neighborBlendDS.color.tex            = r.get(input);
+		neighborBlendDS.color.sampler        = linearSampler;
+		neighborBlendDS.blendweights.tex     = r.get(Rendertargets::BlendWeights);
+		neighborBlendDS.blendweights.sampler = linearSampler;
+		renderer.bindDescriptorSet(1, neighborBlendDS);
 	}
-	assert(fxaaPipeline);
 
-	renderer.bindPipeline(fxaaPipeline);
-	ColorCombinedDS colorDS;
-	// FIXME: remove unused UBO hack
-	uint32_t temp         = 0;
-	colorDS.unused        = renderer.createEphemeralBuffer(BufferType::Uniform, 4, &temp);
-	colorDS.color.tex     = r.get(Rendertargets::MainColor);
-	colorDS.color.sampler = linearSampler;
-	renderer.bindDescriptorSet(1, colorDS);
 	renderer.draw(0, 3);
 }
 
 
-void SMAADemo::renderSeparate(RenderPasses rp, DemoRenderGraph::PassResources &r) {
-	if (!separatePipeline) {
-		PipelineDesc plDesc;
-		plDesc.descriptorSetLayout<GlobalDS>(0)
-			  .descriptorSetLayout<ColorCombinedDS>(1)  // TODO: does this need its own DS?
-			  .vertexShader("temporal")
-			  .fragmentShader("separate")
-			  .name("subsample separate");
+PipelineDesc SMAADemo::blitPipelineDesc() const {
+	PipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+	      .descriptorSetLayout<ColorTexDS>(1)
+	      .vertexShader("blit")
+	      .fragmentShader("blit")
+	      .name("blit");
+
+	return plDesc;
+}
+
 
-		separatePipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+void SMAADemo::renderSMAADebug(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets rt) {
+	if (!blitPipeline) {
+		PipelineDesc plDesc = blitPipelineDesc();
+		blitPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
 	}
 
-	renderer.bindPipeline(separatePipeline);
-	ColorCombinedDS separateDS;
-	// FIXME: remove unused UBO hack
-	uint32_t temp            = 0;
-	separateDS.unused        = renderer.createEphemeralBuffer(BufferType::Uniform, 4, &temp);
-	separateDS.color.tex     = r.get(Rendertargets::MainColor);
-	separateDS.color.sampler = nearestSampler;
-	renderer.bindDescriptorSet(1, separateDS);
+	glm::uvec2 viewport = scaledSize(rendererDesc.swapchain.width, rendererDesc.swapchain.height);
+	renderer.setViewport(0, 0, viewport.x, viewport.y);
+
+	ColorTexDS blitDS;
+	renderer.bindPipeline(blitPipeline);
+	blitDS.color   = r.get(rt);
+	renderer.bindDescriptorSet(1, blitDS);
+
 	renderer.draw(0, 3);
 }
 
 
-void SMAADemo::renderSMAAEdges(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input, int pass) {
-	if (!smaaPipelines.edgePipeline) {
-		ShaderMacros macros;
-		std::string qualityString(std::string("SMAA_PRESET_") + smaaQualityLevels[smaaQuality]);
-		macros.emplace(qualityString, "1");
+PipelineDesc SMAADemo::temporalAAPipelineDesc() const {
+	ShaderMacros macros;
+	macros.emplace("SMAA_REPROJECTION", std::to_string(temporalReproject));
+	std::string name = "temporal AA";
+	if (temporalClamp) {
+		macros.emplace("TEMPORAL_CLAMP", "1");
+		name += " clamp";
+	}
 
-		if (smaaEdgeMethod != SMAAEdgeMethod::Color) {
-			macros.emplace("EDGEMETHOD", std::to_string(static_cast<uint8_t>(smaaEdgeMethod)));
-		}
+	PipelineDesc plDesc;
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+		  .descriptorSetLayout<TemporalAADS>(1)
+		  .pushConstants<ShaderDefines::SMAAUBO>()
+		  .vertexShader("temporal")
+		  .fragmentShader("temporal")
+		  .shaderMacros(macros)
+		  .name(name);
+
+	return plDesc;
+}
 
-		if (smaaPredication && smaaEdgeMethod != SMAAEdgeMethod::Depth) {
-			macros.emplace("SMAA_PREDICATION", "1");
+
+void SMAADemo::renderTemporalAA(RenderPasses rp, DemoRenderGraph::PassResources &r) {
+	if (temporalAAFirstFrame) {
+		// no history yet, copy the current frame so enabling doesn't flicker
+		// cheaper than the resolve and doesn't need velocity
+		if (!blitPipeline) {
+			PipelineDesc plDesc = blitPipelineDesc();
+			blitPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
 		}
 
-		PipelineDesc plDesc;
-		plDesc.depthWrite(false)
-		      .depthTest(false)
-		      .cullFaces(true)
-		      .descriptorSetLayout<GlobalDS>(0)
-		      .shaderMacros(macros)
-		      .descriptorSetLayout<EdgeDetectionDS>(1)
-		      .vertexShader("smaaEdge")
-		      .fragmentShader("smaaEdge")
-		      .name(std::string("SMAA edges ") + std::to_string(smaaQuality));
-		smaaPipelines.edgePipeline      = renderGraph.createPipeline(renderer, rp, plDesc);
+		renderer.bindPipeline(blitPipeline);
+		ColorTexDS blitDS;
+		blitDS.color = r.get(Rendertargets::TemporalCurrent);
+		renderer.bindDescriptorSet(1, blitDS);
+		renderer.draw(0, 3);
+
+		temporalAAFirstFrame = false;
+		return;
 	}
 
-	renderer.bindPipeline(smaaPipelines.edgePipeline);
+	if (!temporalAAPipelines[temporalReproject]) {
+		PipelineDesc plDesc = temporalAAPipelineDesc();
+		temporalAAPipelines[temporalReproject] = renderGraph.createPipeline(renderer, rp, plDesc);
+	}
 
-	// TODO: this is redundant, clean it up
-	ShaderDefines::SMAAUBO smaaUBO;
-	smaaUBO.smaaParameters        = smaaParameters;
-	smaaUBO.predicationThreshold  = predicationThreshold;
-	smaaUBO.predicationScale      = predicationScale;
-	smaaUBO.predicationStrength   = predicationStrength;
-	smaaUBO.reprojWeigthScale     = reprojectionWeightScale;
-	smaaUBO.subsampleIndices      = subsampleIndices[pass];
+	renderer.bindPipeline(temporalAAPipelines[temporalReproject]);
+	renderer.pushConstants(smaaPushConstants());
 
-	auto smaaUBOBuf = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::SMAAUBO), &smaaUBO);
+	TemporalAADS temporalDS;
+	temporalDS.currentTex.tex      = r.get(Rendertargets::TemporalCurrent);
+	temporalDS.currentTex.sampler  = nearestSampler;
+	temporalDS.previousTex.tex     = r.get(Rendertargets::TemporalPrevious);
+	temporalDS.previousTex.sampler = nearestSampler;
+	temporalDS.velocityTex.tex         = r.get(Rendertargets::Velocity);
+	temporalDS.velocityTex.sampler     = nearestSampler;
 
-	EdgeDetectionDS edgeDS;
-	edgeDS.smaaUBO = smaaUBOBuf;
-	if (smaaEdgeMethod == SMAAEdgeMethod::Depth) {
-		edgeDS.color.tex     = r.get(Rendertargets::MainDepth);
-	} else {
-		edgeDS.color.tex     = r.get(input, Format::RGBA8);
-	}
-	edgeDS.color.sampler = nearestSampler;
-	// TODO: only set when using predication
-	edgeDS.predicationTex.tex     = r.get(Rendertargets::MainDepth);
-	edgeDS.predicationTex.sampler = nearestSampler;
-	renderer.bindDescriptorSet(1, edgeDS);
+	renderer.bindDescriptorSet(1, temporalDS);
 	renderer.draw(0, 3);
 }
 
 
-void SMAADemo::renderSMAAWeights(RenderPasses rp, DemoRenderGraph::PassResources &r, int pass) {
-	if (!smaaPipelines.blendWeightPipeline) {
-		ShaderMacros macros;
-		std::string qualityString(std::string("SMAA_PRESET_") + smaaQualityLevels[smaaQuality]);
-		macros.emplace(qualityString, "1");
-
-		PipelineDesc plDesc;
-		plDesc.depthWrite(false)
-		      .depthTest(false)
-		      .cullFaces(true)
-		      .descriptorSetLayout<GlobalDS>(0)
-		      .descriptorSetLayout<BlendWeightDS>(1)
-		      .shaderMacros(macros)
-		      .vertexShader("smaaBlendWeight")
-		      .fragmentShader("smaaBlendWeight")
-		      .name(std::string("SMAA weights ") + std::to_string(smaaQuality));
-		smaaPipelines.blendWeightPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+void SMAADemo::renderUpscale(RenderPasses rp, DemoRenderGraph::PassResources &r) {
+	if (!blitPipeline) {
+		PipelineDesc plDesc = blitPipelineDesc();
+		blitPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
 	}
 
-	// TODO: this is redundant, clean it up
-	ShaderDefines::SMAAUBO smaaUBO;
-	smaaUBO.smaaParameters        = smaaParameters;
-	smaaUBO.predicationThreshold  = predicationThreshold;
-	smaaUBO.predicationScale      = predicationScale;
-	smaaUBO.predicationStrength   = predicationStrength;
-	smaaUBO.reprojWeigthScale     = reprojectionWeightScale;
-	smaaUBO.subsampleIndices      = subsampleIndices[pass];
-
-	auto smaaUBOBuf = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::SMAAUBO), &smaaUBO);
+	// blit shader samples the scaled part, output covers the whole window
+	renderer.setViewport(0, 0, rendererDesc.swapchain.width, rendererDesc.swapchain.height);
 
-	renderer.bindPipeline(smaaPipelines.blendWeightPipeline);
-	BlendWeightDS blendWeightDS;
-	blendWeightDS.smaaUBO           = smaaUBOBuf;
-	blendWeightDS.edgesTex.tex      = r.get(Rendertargets::Edges);
-	blendWeightDS.edgesTex.sampler  = linearSampler;
-	blendWeightDS.areaTex.tex       = areaTex;
-	blendWeightDS.areaTex.sampler   = linearSampler;
-	blendWeightDS.searchTex.tex     = searchTex;
-	blendWeightDS.searchTex.sampler = linearSampler;
-	renderer.bindDescriptorSet(1, blendWeightDS);
+	ColorTexDS blitDS;
+	renderer.bindPipeline(blitPipeline);
+	blitDS.color   = r.get(Rendertargets::ScaledFinal);
+	renderer.bindDescriptorSet(1, blitDS);
 
 	renderer.draw(0, 3);
 }
 
 
-void SMAADemo::renderSMAABlend(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets input, int pass) {
-	if (!smaaPipelines.neighborPipelines[pass]) {
-		ShaderMacros macros;
-		std::string qualityString(std::string("SMAA_PRESET_") + smaaQualityLevels[smaaQuality]);
-		macros.emplace(qualityString, "1");
+void SMAADemo::addComparisonPasses(Rendertargets finalRT) {
+	// the no AA tile, the others draw over their parts of it
+	renderGraph.blit(Rendertargets::MainColor, finalRT);
 
-		PipelineDesc plDesc;
-		plDesc.depthWrite(false)
-		      .depthTest(false)
-		      .cullFaces(true)
-		      .descriptorSetLayout<GlobalDS>(0)
-		      .descriptorSetLayout<NeighborBlendDS>(1)
-		      .shaderMacros(macros)
-		      .vertexShader("smaaNeighbor")
-		      .fragmentShader("smaaNeighbor");
-
-		if (pass == 0) {
-			plDesc.name(std::string("SMAA blend ") + std::to_string(smaaQuality));
-		} else {
-			assert(pass == 1);
-			plDesc.blending(true)
-			      .sourceBlend(BlendFunc::Constant)
-			      .destinationBlend(BlendFunc::Constant)
-			      .name(std::string("SMAA blend (S2X) ") + std::to_string(smaaQuality));
+	{
+		DemoRenderGraph::PassDesc desc;
+		desc.color(0, finalRT, PassBegin::Keep)
+		    .inputRendertarget(Rendertargets::MainColor)
+		    .name("FXAA");
+
+		renderGraph.renderPass(RenderPasses::FXAA, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderFXAA(rp, r); } );
+	}
+
+	// fragment shader SMAA, compute can't be scissored
+	{
+		RenderTargetDesc rtDesc;
+		rtDesc.name("SMAA edges")
+			  .format(smaaEdgesFormat)
+			  .width(smaaSize.x)
+			  .height(smaaSize.y);
+		renderGraph.renderTarget(Rendertargets::Edges, rtDesc);
+
+		DemoRenderGraph::PassDesc desc;
+		desc.color(0, Rendertargets::Edges, PassBegin::Clear)
+		    .inputRendertarget(Rendertargets::MainColor)
+		    .name("SMAA edges");
+		if (smaaEdgesNeedDepth()) {
+			desc.inputRendertarget(Rendertargets::MainDepth);
 		}
 
-		smaaPipelines.neighborPipelines[pass] = renderGraph.createPipeline(renderer, rp, plDesc);
+		addSMAAStencilTarget(smaaSize.x, smaaSize.y);
+		smaaStencilAttachment(desc, true);
+
+		renderGraph.renderPass(RenderPasses::SMAAEdges, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAEdges(rp, r, Rendertargets::MainColor); } );
 	}
 
-	// TODO: this is redundant, clean it up
-	ShaderDefines::SMAAUBO smaaUBO;
-	smaaUBO.smaaParameters        = smaaParameters;
-	smaaUBO.predicationThreshold  = predicationThreshold;
-	smaaUBO.predicationScale      = predicationScale;
-	smaaUBO.predicationStrength   = predicationStrength;
-	smaaUBO.reprojWeigthScale     = reprojectionWeightScale;
-	smaaUBO.subsampleIndices      = subsampleIndices[pass];
+	{
+		RenderTargetDesc rtDesc;
+		rtDesc.name("SMAA weights")
+			  .format(Format::RGBA8)
+			  .width(smaaSize.x)
+			  .height(smaaSize.y);
+		renderGraph.renderTarget(Rendertargets::BlendWeights, rtDesc);
 
-	auto smaaUBOBuf = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::SMAAUBO), &smaaUBO);
+		DemoRenderGraph::PassDesc desc;
+		desc.color(0, Rendertargets::BlendWeights, PassBegin::Clear)
+		    .inputRendertarget(Rendertargets::Edges)
+		    .name("SMAA weights");
 
-	// full effect
-	renderer.bindPipeline(smaaPipelines.neighborPipelines[pass]);
+		smaaStencilAttachment(desc, false);
 
-	NeighborBlendDS neighborBlendDS;
-	neighborBlendDS.smaaUBO              = smaaUBOBuf;
-	neighborBlendDS.color.tex            = r.get(input);
-	neighborBlendDS.color.sampler        = linearSampler;
-	neighborBlendDS.blendweights.tex     = r.get(Rendertargets::BlendWeights);
-	neighborBlendDS.blendweights.sampler = linearSampler;
-	renderer.bindDescriptorSet(1, neighborBlendDS);
+		renderGraph.renderPass(RenderPasses::SMAAWeights, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAAWeights(rp, r); } );
+	}
 
-	renderer.draw(0, 3);
+	{
+		DemoRenderGraph::PassDesc desc;
+		desc.color(0, finalRT, PassBegin::Keep)
+		    .inputRendertarget(Rendertargets::MainColor)
+		    .inputRendertarget(Rendertargets::BlendWeights)
+		    .name("SMAA blend");
+
+		renderGraph.renderPass(RenderPasses::SMAABlend, desc, [this] (RenderPasses rp, DemoRenderGraph::PassResources &r) { this->renderSMAABlend(rp, r, Rendertargets::MainColor); } );
+	}
 }
 
 
-void SMAADemo::renderSMAADebug(RenderPasses rp, DemoRenderGraph::PassResources &r, Rendertargets rt) {
-	if (!blitPipeline) {
-		PipelineDesc plDesc;
-		plDesc.descriptorSetLayout<GlobalDS>(0)
-		      .descriptorSetLayout<ColorTexDS>(1)
-		      .vertexShader("blit")
-		      .fragmentShader("blit")
-		      .name("blit");
+void SMAADemo::setComparisonScissor(unsigned int tile, glm::uvec2 size) {
+	assert(tile < numComparisonTiles);
 
-		blitPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
-	}
+	// vertical strips so GL and Vulkan agree without flipping y
+	unsigned int left  = size.x * tile       / numComparisonTiles;
+	unsigned int right = size.x * (tile + 1) / numComparisonTiles;
+	renderer.setScissorRect(left, 0, right - left, size.y);
+}
 
-	ColorTexDS blitDS;
-	renderer.bindPipeline(blitPipeline);
-	// FIXME: remove unused UBO hack
-	uint32_t temp  = 0;
-	blitDS.unused  = renderer.createEphemeralBuffer(BufferType::Uniform, 4, &temp);
-	blitDS.color   = r.get(rt);
-	renderer.bindDescriptorSet(1, blitDS);
 
-	renderer.draw(0, 3);
+glm::uvec2 SMAADemo::scaledSize(unsigned int width, unsigned int height) const {
+	return glm::uvec2(std::max(1U, static_cast<unsigned int>(float(width)  * renderScale + 0.5f))
+	                , std::max(1U, static_cast<unsigned int>(float(height) * renderScale + 0.5f)));
 }
 
 
-void SMAADemo::renderTemporalAA(RenderPasses rp, DemoRenderGraph::PassResources &r) {
-	if (!temporalAAPipelines[temporalReproject]) {
-		ShaderMacros macros;
-		macros.emplace("SMAA_REPROJECTION", std::to_string(temporalReproject));
+void SMAADemo::updateRenderScale() {
+	// no GPU timings this frame
+	if (lastGPUTime == 0) {
+		return;
+	}
 
-		PipelineDesc plDesc;
-		plDesc.descriptorSetLayout<GlobalDS>(0)
-			  .descriptorSetLayout<TemporalAADS>(1)
-			  .vertexShader("temporal")
-			  .fragmentShader("temporal")
-			  .shaderMacros(macros)
-			  .name("temporal AA");
+	// GPU time is roughly proportional to pixel count, the square of renderScale
+	float gpuTime = float(lastGPUTime) / 1000000.0f;
+	float wanted  = renderScale * sqrtf(targetGPUTime / gpuTime);
+	wanted        = std::max(minRenderScale, std::min(wanted, 1.0f));
 
-		temporalAAPipelines[temporalReproject] = renderGraph.createPipeline(renderer, rp, plDesc);
+	// move gradually so a single slow frame doesn't cause a visible jump
+	renderScale  += (wanted - renderScale) * renderScaleSpeed;
+}
+
+
+void SMAADemo::updateSMAABudget() {
+	// edges, weights and blending whether fragment or compute
+	uint64_t smaaTime = 0;
+	bool found        = false;
+	for (const auto &t : renderer.getGPUTimings()) {
+		if (t.name.compare(0, 4, "SMAA") == 0) {
+			smaaTime += t.nanoseconds;
+			found     = true;
+		}
+	}
+	if (!found) {
+		return;
 	}
 
-	renderer.bindPipeline(temporalAAPipelines[temporalReproject]);
+	// the parameters are specialization constants of the custom preset
+	// so stepping only creates pipelines, the render graph keeps the ones it has seen
+	if (smaaQuality != 0) {
+		smaaQuality    = 0;
+		smaaParameters = budgetSMAAParameters[smaaBudgetLevel];
+		clearPipelineHandles();
+		smaaBudgetTime    = 0;
+		smaaBudgetSamples = 0;
+		return;
+	}
 
-	ShaderDefines::SMAAUBO smaaUBO;
-	smaaUBO.smaaParameters        = smaaParameters;
-	smaaUBO.predicationThreshold  = predicationThreshold;
-	smaaUBO.predicationScale      = predicationScale;
-	smaaUBO.predicationStrength   = predicationStrength;
-	smaaUBO.reprojWeigthScale     = reprojectionWeightScale;
-	smaaUBO.subsampleIndices      = subsampleIndices[0];
+	smaaBudgetTime += smaaTime;
+	smaaBudgetSamples++;
+	if (smaaBudgetSamples < smaaBudgetFrames) {
+		return;
+	}
 
-	auto smaaUBOBuf = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::SMAAUBO), &smaaUBO);
+	float ms = float(smaaBudgetTime) / (1000000.0f * float(smaaBudgetSamples));
+	smaaBudgetTime    = 0;
+	smaaBudgetSamples = 0;
 
-	TemporalAADS temporalDS;
-	temporalDS.smaaUBO             = smaaUBOBuf;
-	temporalDS.currentTex.tex      = r.get(Rendertargets::TemporalCurrent);
-	temporalDS.currentTex.sampler  = nearestSampler;
-	if (temporalAAFirstFrame) {
-		// to prevent flicker on first frame after enabling
-		// TODO: should just do blit
-		temporalDS.previousTex.tex     = r.get(Rendertargets::TemporalCurrent);
-		temporalDS.previousTex.sampler = nearestSampler;
-		temporalAAFirstFrame = false;
-	} else {
-		temporalDS.previousTex.tex     = r.get(Rendertargets::TemporalPrevious);
-		temporalDS.previousTex.sampler = nearestSampler;
+	unsigned int level = smaaBudgetLevel;
+	if (ms > smaaBudget && level > 0) {
+		level--;
+	} else if (ms < smaaBudget * smaaBudgetHeadroom && level + 1 < budgetSMAAParameters.size()) {
+		level++;
 	}
-	temporalDS.velocityTex.tex         = r.get(Rendertargets::Velocity);
-	temporalDS.velocityTex.sampler     = nearestSampler;
 
-	renderer.bindDescriptorSet(1, temporalDS);
-	renderer.draw(0, 3);
+	// also catches the GUI changing them
+	if (level != smaaBudgetLevel || memcmp(&smaaParameters, &budgetSMAAParameters[level], sizeof(smaaParameters)) != 0) {
+		LOG_DEBUG("SMAA took %f ms of %f, parameter level %u\n", ms, smaaBudget, level);
+		smaaBudgetLevel = level;
+		smaaParameters  = budgetSMAAParameters[level];
+		clearPipelineHandles();
+	}
 }
 
 
@@ -2941,6 +8749,12 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 
 	ImGui::NewFrame();
 
+	// set again below if the section is open
+	guiWantsMemStats = perfOverlay;
+
+	updateGPUPassTimes();
+	updatePerfOverlay(elapsed);
+
 	if (io.WantTextInput != textInputActive) {
 		textInputActive = io.WantTextInput;
 		if (textInputActive) {
@@ -2965,6 +8779,13 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 				assert(temp == antialiasing);
 			}
 
+			if (ImGui::Checkbox("Compare side by side", &compareMethods)) {
+				rebuildRG = true;
+			}
+			if (comparing()) {
+				ImGui::Text("Left to right: no AA, FXAA, SMAA");
+			}
+
 			int aa = aaMethod._to_integral();
 			bool first = true;
 			for (AAMethod a : AAMethod::_values()) {
@@ -2990,7 +8811,10 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 					ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
 					ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
 				}
-				ImGui::Checkbox("Temporal reprojection", &temporalReproject);
+				if (ImGui::Checkbox("Temporal reprojection", &temporalReproject)) {
+					// fused FXAA does the resolve
+					fxaaPipeline = PipelineHandle();
+				}
 				if (!temporalAA) {
 					ImGui::PopItemFlag();
 					ImGui::PopStyleVar();
@@ -3001,6 +8825,25 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 			ImGui::SliderFloat("Reprojection weight scale", &w, 0.0f, 80.0f);
 			reprojectionWeightScale = w;
 
+			if (ImGui::Checkbox("Temporal clamping", &temporalClamp)) {
+				temporalAAPipelines[0] = PipelineHandle();
+				temporalAAPipelines[1] = PipelineHandle();
+				fxaaPipeline           = PipelineHandle();
+			}
+
+			// ignores cube rotation
+			if (ImGui::Checkbox("Velocity from depth", &depthVelocity)) {
+				rebuildRG = true;
+			}
+
+			int tf = temporalFormat;
+			if (ImGui::Combo("Temporal history format", &tf, temporalFormatNames, numTemporalFormats)) {
+				assert(tf >= 0);
+				assert(tf < int(numTemporalFormats));
+				temporalFormat = tf;
+				rebuildRG      = true;
+			}
+
 			ImGui::Separator();
 			int msaaq = msaaQuality;
 			bool msaaChanged = ImGui::Combo("MSAA quality", &msaaq, msaaQualityLevels, maxMSAAQuality);
@@ -3016,6 +8859,11 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 			}
 
 			ImGui::Separator();
+			ImGui::SliderFloat("SMAA GPU budget ms", &smaaBudget, 0.0f, 5.0f, "%.2f");
+			if (smaaBudget > 0.0f) {
+				ImGui::Text("Budget parameter level %u / %u", smaaBudgetLevel + 1, static_cast<unsigned int>(budgetSMAAParameters.size()));
+			}
+
 			int sq = smaaQuality;
 			ImGui::Combo("SMAA quality", &sq, smaaQualityLevels, maxSMAAQuality);
 			assert(sq >= 0);
@@ -3027,11 +8875,15 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 				}
 				smaaPipelines.edgePipeline         = PipelineHandle();
 				smaaPipelines.blendWeightPipeline  = PipelineHandle();
-				smaaPipelines.neighborPipelines[0] = PipelineHandle();
-				smaaPipelines.neighborPipelines[1] = PipelineHandle();
+				smaaPipelines.neighborPipeline     = PipelineHandle();
+				smaaPipelines.tileResetPipeline          = PipelineHandle();
+				smaaPipelines.edgeComputePipeline        = PipelineHandle();
+				smaaPipelines.blendWeightComputePipeline = PipelineHandle();
 			}
 
 			if (ImGui::CollapsingHeader("SMAA custom properties")) {
+				const ShaderDefines::SMAAParameters oldParameters = smaaParameters;
+
 				// parameters can only be changed in custom mode
 				// https://github.com/ocornut/imgui/issues/211
 				if (smaaQuality != 0) {
@@ -3058,9 +8910,17 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 					ImGui::PopItemFlag();
 					ImGui::PopStyleVar();
 				}
+
+				// they're specialization constants so the pipelines must be recreated
+				if (memcmp(&oldParameters, &smaaParameters, sizeof(smaaParameters)) != 0) {
+					clearPipelineHandles();
+				}
 			}
 
-			ImGui::Checkbox("Predicated thresholding", &smaaPredication);
+			// changes whether the edges pass reads depth
+			if (ImGui::Checkbox("Predicated thresholding", &smaaPredication)) {
+				rebuildRG = true;
+			}
 
 			if (!smaaPredication) {
 				ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
@@ -3076,17 +8936,65 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 				predicationStrength  = 0.4f;
 			}
 
-			if (!smaaPredication) {
+			if (!smaaPredication) {
+				ImGui::PopItemFlag();
+				ImGui::PopStyleVar();
+			}
+
+			int em = static_cast<int>(smaaEdgeMethod);
+			ImGui::Text("SMAA edge detection");
+			ImGui::RadioButton("Color", &em, static_cast<int>(SMAAEdgeMethod::Color));
+			ImGui::RadioButton("Luma",  &em, static_cast<int>(SMAAEdgeMethod::Luma));
+			ImGui::RadioButton("Depth", &em, static_cast<int>(SMAAEdgeMethod::Depth));
+			if (em != static_cast<int>(smaaEdgeMethod)) {
+				smaaEdgeMethod = static_cast<SMAAEdgeMethod>(em);
+				rebuildRG      = true;
+			}
+
+			bool computeSupported = renderer.getFeatures().computeShaders;
+			if (!computeSupported) {
+				ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
+				ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
+			}
+
+			if (ImGui::Checkbox("SMAA compute shaders", &smaaCompute)) {
+				rebuildRG = true;
+			}
+
+			if (ImGui::Checkbox("SMAA blend only tiles with edges", &smaaTiledBlend)) {
+				rebuildRG = true;
+			}
+
+			if (ImGui::Checkbox("SMAA blend in place", &smaaInPlaceBlend)) {
+				rebuildRG = true;
+			}
+
+			if (!computeSupported) {
+				ImGui::PopItemFlag();
+				ImGui::PopStyleVar();
+			}
+
+			bool subgroupSupported = smaaCompute && renderer.getFeatures().subgroupBallot;
+			if (!subgroupSupported) {
+				ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
+				ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
+			}
+
+			if (ImGui::Checkbox("SMAA subgroup search", &smaaSubgroupSearch)) {
+				smaaPipelines.blendWeightComputePipeline = PipelineHandle();
+			}
+
+			if (!subgroupSupported) {
 				ImGui::PopItemFlag();
 				ImGui::PopStyleVar();
 			}
 
-			int em = static_cast<int>(smaaEdgeMethod);
-			ImGui::Text("SMAA edge detection");
-			ImGui::RadioButton("Color", &em, static_cast<int>(SMAAEdgeMethod::Color));
-			ImGui::RadioButton("Luma",  &em, static_cast<int>(SMAAEdgeMethod::Luma));
-			ImGui::RadioButton("Depth", &em, static_cast<int>(SMAAEdgeMethod::Depth));
-			smaaEdgeMethod = static_cast<SMAAEdgeMethod>(em);
+			float scale = smaaScale;
+			ImGui::SliderFloat("SMAA resolution", &scale, minSMAAScale, 1.0f);
+			if (scale != smaaScale) {
+				smaaScale = scale;
+				rebuildRG = true;
+			}
 
 			int d = debugMode;
 			ImGui::Combo("SMAA debug", &d, smaaDebugModes, 3);
@@ -3106,6 +9014,34 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 				fxaaPipeline = PipelineHandle();
 				fxaaQuality = fq;
 			}
+
+			if (ImGui::Checkbox("Fused FXAA", &fusedFXAA)) {
+				rebuildRG = true;
+			}
+
+			if (ImGui::Checkbox("Record post-processing once", &staticPostPasses)) {
+				rebuildRG = true;
+			}
+
+			if (ImGui::Checkbox("Skip unchanged image passes", &cachedImagePasses)) {
+				rebuildRG = true;
+			}
+
+			bool halfSupported = renderer.getFeatures().halfPrecision;
+			if (!halfSupported) {
+				ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
+				ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
+			}
+
+			ImGui::Separator();
+			if (ImGui::Checkbox("Half precision shaders", &halfPrecision)) {
+				clearPipelineHandles();
+			}
+
+			if (!halfSupported) {
+				ImGui::PopItemFlag();
+				ImGui::PopStyleVar();
+			}
 		}
 
 		if (ImGui::CollapsingHeader("Scene properties", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -3129,6 +9065,8 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 				activeScene = s;
 			}
 
+			ImGui::LabelText("Image memory (MB)", "%.1f / %.1f", static_cast<float>(residentImageMemory) / (1024.0f * 1024.0f), static_cast<float>(imageMemoryBudget) / (1024.0f * 1024.0f));
+
 			ImGui::InputText("Load image", imageFileName, inputTextBufferSize);
 
 			ImGui::Columns(2);
@@ -3150,51 +9088,101 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 
 			ImGui::Columns(1);
 
-			int m = cubesPerSide;
-			bool changed = ImGui::InputInt("Cubes per side", &m);
-			if (changed && m > 0 && m < 55) {
-				cubesPerSide = m;
-				createCubes();
-			}
+			// scene files bring their own camera, colors and draw order
+			if (sceneFile) {
+				ImGui::Checkbox("Animate scene", &rotateCubes);
+			} else {
+				int m = cubesPerSide;
+				bool changed = ImGui::InputInt("Cubes per side", &m);
+				if (changed && m > 0 && m <= (cubeLOD ? maxLODCubesPerSide : maxCubesPerSide)) {
+					cubesPerSide = m;
+					createCubes();
+					// cull and animation pass buffers are sized by the number of cubes
+					if (cubeCullingActive || cubeAnimationActive) {
+						rebuildRG = true;
+					}
+				}
 
-			float l = cameraDistance;
-			if (ImGui::SliderFloat("Camera distance", &l, 1.0f, 256.0f, "%.1f")) {
-				cameraDistance = l;
-			}
+				float l = cameraDistance;
+				if (ImGui::SliderFloat("Camera distance", &l, 1.0f, 256.0f, "%.1f")) {
+					cameraDistance = l;
+				}
 
-			ImGui::Checkbox("Rotate cubes", &rotateCubes);
-			int p = rotationPeriodSeconds;
-			ImGui::SliderInt("Rotation period (sec)", &p, 1, 60);
-			assert(p >= 1);
-			assert(p <= 60);
-			rotationPeriodSeconds = p;
+				ImGui::Checkbox("Rotate cubes", &rotateCubes);
+				int p = rotationPeriodSeconds;
+				ImGui::SliderInt("Rotation period (sec)", &p, 1, 60);
+				assert(p >= 1);
+				assert(p <= 60);
+				rotationPeriodSeconds = p;
+
+				ImGui::Separator();
+				ImGui::Text("Cube coloring mode");
+				int newColorMode = colorMode;
+				ImGui::RadioButton("RGB",   &newColorMode, 0);
+				ImGui::RadioButton("YCbCr", &newColorMode, 1);
+
+				if (int(colorMode) != newColorMode) {
+					colorMode = newColorMode;
+					colorCubes();
+				}
 
-			ImGui::Separator();
-			ImGui::Text("Cube coloring mode");
-			int newColorMode = colorMode;
-			ImGui::RadioButton("RGB",   &newColorMode, 0);
-			ImGui::RadioButton("YCbCr", &newColorMode, 1);
+				if (ImGui::Button("Re-color cubes")) {
+					colorCubes();
+				}
 
-			if (int(colorMode) != newColorMode) {
-				colorMode = newColorMode;
-				colorCubes();
-			}
+				if (ImGui::Button("Shuffle cube rendering order")) {
+					shuffleCubeRendering();
+					cubeOrderNum = 1;
+				}
 
-			if (ImGui::Button("Re-color cubes")) {
-				colorCubes();
-			}
+				if (ImGui::Button("Reorder cube rendering order")) {
+					reorderCubeRendering();
+					cubeOrderNum = 1;
+				}
 
-			if (ImGui::Button("Shuffle cube rendering order")) {
-				shuffleCubeRendering();
-				cubeOrderNum = 1;
-			}
+				// the cull pass appends visible cubes in whatever order its groups run
+				// so with culling the sorted order is only approximate
+				ImGui::Checkbox("Sort cubes front to back", &sortCubes);
+				ImGui::Checkbox("Visualize cube order", &visualizeCubeOrder);
 
-			if (ImGui::Button("Reorder cube rendering order")) {
-				reorderCubeRendering();
-				cubeOrderNum = 1;
-			}
+				bool cullSupported = renderer.getFeatures().computeShaders;
+				if (!cullSupported) {
+					ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
+					ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f);
+				}
+
+				if (ImGui::Checkbox("Cull cubes in compute shader", &cubeCulling)) {
+					rebuildRG = true;
+				}
+
+				if (ImGui::Checkbox("Animate cubes in compute shader", &cubeAnimation)) {
+					rebuildRG = true;
+				}
+
+				if (ImGui::Checkbox("Draw small cubes as quads", &cubeLOD)) {
+					rebuildRG = true;
+				}
+				ImGui::SliderFloat("Quad size (pixels)", &cubeLODPixels, 1.0f, 32.0f, "%.1f");
+
+				if (!cullSupported) {
+					ImGui::PopItemFlag();
+					ImGui::PopStyleVar();
+				}
+
+				if (ImGui::Checkbox("Procedural cube vertices", &proceduralCubes)) {
+					// pipeline is recreated on rebuild
+					rebuildRG = true;
+				}
 
-			ImGui::Checkbox("Visualize cube order", &visualizeCubeOrder);
+				// cubes are uploaded again in the new format after the rebuild
+				if (ImGui::Checkbox("Compact cube instances", &compactCubes)) {
+					rebuildRG = true;
+				}
+
+				if (ImGui::Checkbox("Depth prepass", &depthPrepass)) {
+					rebuildRG = true;
+				}
+			}
 		}
 
 		if (ImGui::CollapsingHeader("Swapchain properties", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -3217,12 +9205,20 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 
 			int n = rendererDesc.swapchain.numFrames;
 			// TODO: ask Renderer for the limits
-			if (ImGui::SliderInt("frames ahead", &n, 1, 16)) {
+			if (ImGui::SliderInt("swapchain images", &n, 1, 16)) {
 				rendererDesc.swapchain.numFrames = n;
 				recreateSwapchain = true;
 			}
 
+			int inFlight = rendererDesc.swapchain.framesInFlight;
+			if (ImGui::SliderInt("frames in flight (0 = images)", &inFlight, 0, 16)) {
+				rendererDesc.swapchain.framesInFlight = inFlight;
+				recreateSwapchain = true;
+			}
+
 			ImGui::Checkbox("FPS limit", &fpsLimitActive);
+			ImGui::Checkbox("Just-in-time pacing", &justInTimePacing);
+			ImGui::Checkbox("Render on demand", &onDemandRedraw);
 
 			int f   = fpsLimit;
 			bool changed = ImGui::InputInt("Max FPS", &f);
@@ -3230,24 +9226,141 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 				fpsLimit = f;
 			}
 
+			if (ImGui::Checkbox("Dynamic resolution", &dynamicResolution)) {
+				rebuildRG = true;
+			}
+			ImGui::SliderFloat("Target GPU time ms", &targetGPUTime, 1.0f, 50.0f);
+			ImGui::LabelText("Render scale", "%.2f", renderScale);
+
 			ImGui::Separator();
-			// TODO: measure actual GPU time
 			ImGui::LabelText("FPS", "%.1f", io.Framerate);
 			ImGui::LabelText("Frame time ms", "%.1f", 1000.0f / io.Framerate);
+			ImGui::LabelText("Frame time std dev ms", "%.2f", sqrtf(frameTimeVariance));
+			if (latencyMean > 0.0f) {
+				ImGui::LabelText(latencyDisplayed ? "Latency ms" : "Latency to GPU done ms", "%.1f", latencyMean);
+			}
+			if (guiRefreshInterval != 0) {
+				ImGui::LabelText("Refresh interval ms", "%.2f", float(guiRefreshInterval) / 1000000.0f);
+			}
+#ifdef ALLOCATION_TRACKING
+			ImGui::LabelText("Heap allocations per frame", "%.1f", allocationsMean);
+			ImGui::LabelText("Last frame allocations", "%" PRIu64, lastFrameAllocations);
+#endif  // ALLOCATION_TRACKING
+
+			ImGui::Checkbox("Performance overlay", &perfOverlay);
+			if (!cpuTraceFile.empty() && ImGui::Button("Write CPU trace")) {
+				try {
+					profilerWriteChromeTrace(cpuTraceFile);
+				} catch (std::exception &e) {
+					LOG("Failed to write CPU trace: %s\n", e.what());
+				}
+			}
+
+			if (!gpuPassTimes.empty()) {
+				ImGui::Separator();
+
+				float totalGPUTime = 0.0f;
+				for (unsigned int i = 0; i < gpuPassTimes.size(); i++) {
+					const auto &p = gpuPassTimes[i];
+					totalGPUTime += p.second;
+					ImGui::LabelText(p.first.c_str(), "%.3f ms", p.second);
+
+					// latest frame, not smoothed like the times
+					if (i < guiGPUTimings.size() && guiGPUTimings[i].hasStatistics) {
+						const GPUTiming &t = guiGPUTimings[i];
+						if (t.computeInvocations != 0) {
+							ImGui::Text("  CS %" PRIu64, t.computeInvocations);
+						} else {
+							ImGui::Text("  VS %" PRIu64 "  prims %" PRIu64 "  FS %" PRIu64, t.vertexInvocations, t.clippingPrimitives, t.fragmentInvocations);
+						}
+					}
+				}
+				ImGui::LabelText("GPU total", "%.3f ms", totalGPUTime);
+			}
 
 #ifdef RENDERER_VULKAN
 			ImGui::Separator();
 			// VMA memory allocation stats
-			MemoryStats stats = renderer.getMemStats();
+			guiWantsMemStats = true;
+			const MemoryStats &stats = guiMemStats;
 			float usedMegabytes = static_cast<float>(stats.usedBytes) / (1024.0f * 1024.0f);
 			float totalMegabytes = static_cast<float>(stats.usedBytes + stats.unusedBytes) / (1024.0f * 1024.0f);
 			ImGui::LabelText("Allocation count", "%u", stats.allocationCount);
 			ImGui::LabelText("Suballocation count", "%u", stats.subAllocationCount);
 			ImGui::LabelText("Used memory (MB)", "%.2f", usedMegabytes);
 			ImGui::LabelText("Total memory (MB)", "%.2f", totalMegabytes);
+			ImGui::LabelText("Unused ranges", "%u", stats.unusedRangeCount);
+			ImGui::LabelText("Largest unused range (KB)", "%.1f", static_cast<float>(stats.largestUnusedRange) / 1024.0f);
+			for (unsigned int i = 0; i < MemoryKind::_size_constant; i++) {
+				std::string label = std::string(MemoryKind::_from_index(i)._to_string()) + " (MB)";
+				ImGui::LabelText(label.c_str(), "%.2f", static_cast<float>(stats.kindBytes[i]) / (1024.0f * 1024.0f));
+			}
+			ImGui::LabelText("Arena buffers", "%u", stats.arenaBufferCount);
+			ImGui::LabelText("Arena used / total (KB)", "%.1f / %.1f", static_cast<float>(stats.arenaUsedBytes) / 1024.0f, static_cast<float>(stats.arenaUsedBytes + stats.arenaUnusedBytes) / 1024.0f);
+			ImGui::LabelText("Ring page / peak frame (KB)", "%.1f / %.1f", static_cast<float>(stats.ringPageBytes) / 1024.0f, static_cast<float>(stats.ringPeakFrameBytes) / 1024.0f);
+			for (unsigned int i = 0; i < stats.heaps.size(); i++) {
+				const auto &heap = stats.heaps[i];
+				std::string label = "Heap " + std::to_string(i) + (heap.deviceLocal ? " device used / budget / size (MB)" : " host used / budget / size (MB)");
+				ImGui::LabelText(label.c_str(), "%.1f / %.1f / %.1f", static_cast<float>(heap.usedBytes) / (1024.0f * 1024.0f), static_cast<float>(heap.budgetBytes) / (1024.0f * 1024.0f), static_cast<float>(heap.size) / (1024.0f * 1024.0f));
+			}
 #endif
 		}
 
+		guiWantsShaderStats = ImGui::CollapsingHeader("Shader statistics");
+		if (guiWantsShaderStats) {
+			const ShaderStats &stats = guiShaderStats;
+
+			uint64_t compileTotal = 0;
+			for (const auto &v : stats.variants) {
+				compileTotal += v.preprocessTime + v.compileTime + v.optimizeTime;
+			}
+			uint64_t pipelineTotal = 0;
+			for (const auto &p : stats.pipelines) {
+				pipelineTotal += p.shaderTime + p.crossTime + p.driverTime;
+			}
+
+			ImGui::LabelText("SPIR-V cache hits", "%u", stats.cacheHits);
+			ImGui::LabelText("SPIR-V cache misses", "%u", stats.cacheMisses);
+			ImGui::LabelText("Shader compile total", "%.3f ms", float(compileTotal) / 1000000.0f);
+			ImGui::LabelText("Pipeline creation total", "%.3f ms", float(pipelineTotal) / 1000000.0f);
+
+			if (ImGui::TreeNode("Shader variants")) {
+				for (const auto &v : stats.variants) {
+					ImGui::Text("%s %s: %.3f / %.3f / %.3f ms", v.name.c_str(), v.cacheHit ? "(cached)" : ""
+					           , float(v.preprocessTime) / 1000000.0f, float(v.compileTime) / 1000000.0f, float(v.optimizeTime) / 1000000.0f);
+				}
+				ImGui::TreePop();
+			}
+
+			if (ImGui::TreeNode("Pipelines")) {
+				for (unsigned int i = 0; i < stats.pipelines.size(); i++) {
+					const auto &p = stats.pipelines[i];
+					if (p.executables.empty()) {
+						ImGui::Text("%s: %.3f / %.3f / %.3f ms", p.name.c_str()
+						           , float(p.shaderTime) / 1000000.0f, float(p.crossTime) / 1000000.0f, float(p.driverTime) / 1000000.0f);
+						continue;
+					}
+
+					// same pipeline name can be created with different macros
+					ImGui::PushID(i);
+					bool open = ImGui::TreeNode("pipeline", "%s: %.3f / %.3f / %.3f ms", p.name.c_str()
+					                           , float(p.shaderTime) / 1000000.0f, float(p.crossTime) / 1000000.0f, float(p.driverTime) / 1000000.0f);
+					if (open) {
+						ImGui::TextWrapped("%s", p.macros.c_str());
+						for (const auto &e : p.executables) {
+							ImGui::Text("%s", e.name.c_str());
+							for (const auto &stat : e.statistics) {
+								ImGui::Text("  %s: %g", stat.first.c_str(), stat.second);
+							}
+						}
+						ImGui::TreePop();
+					}
+					ImGui::PopID();
+				}
+				ImGui::TreePop();
+			}
+		}
+
 		if (ImGui::Button("Quit")) {
 			keepGoing = false;
 		}
@@ -3270,53 +9383,380 @@ void SMAADemo::updateGUI(uint64_t elapsed) {
 }
 
 
-void SMAADemo::renderGUI(RenderPasses rp, DemoRenderGraph::PassResources & /* r */) {
+void SMAADemo::updateGPUPassTimes() {
+	const auto &timings = guiGPUTimings;
+
+	// if the pass structure changed start over
+	bool passesChanged = (timings.size() != gpuPassTimes.size());
+	for (unsigned int i = 0; !passesChanged && i < timings.size(); i++) {
+		passesChanged = (timings[i].name != gpuPassTimes[i].first);
+	}
+	if (passesChanged) {
+		gpuPassTimes.clear();
+		for (const auto &t : timings) {
+			gpuPassTimes.emplace_back(t.name, float(t.nanoseconds) / 1000000.0f);
+		}
+		return;
+	}
+
+	for (unsigned int i = 0; i < timings.size(); i++) {
+		float ms = float(timings[i].nanoseconds) / 1000000.0f;
+		float &smoothed = gpuPassTimes[i].second;
+		smoothed = 0.95f * smoothed + 0.05f * ms;
+	}
+}
+
+
+void SMAADemo::updatePerfOverlay(uint64_t elapsed) {
+	cpuFrameHistory.push(float(elapsed) / 1000000.0f);
+	gpuFrameHistory.push(float(lastGPUTime) / 1000000.0f);
+	frameWaitHistory.push(float(lastFrameWaitTime) / 1000000.0f);
+#ifdef RENDERER_VULKAN
+	// guiMemStats is from the previous frame, stale for the first one after opening
+	usedMemoryHistory.push(static_cast<float>(guiMemStats.usedBytes) / (1024.0f * 1024.0f));
+	ringBufferHistory.push(static_cast<float>(guiMemStats.kindBytes[MemoryKind::RingBuffer]) / (1024.0f * 1024.0f));
+#endif  // RENDERER_VULKAN
+
+	if (!perfOverlay) {
+		return;
+	}
+
+	ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(420.0f, 0.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Performance", &perfOverlay)) {
+		ImGui::End();
+		return;
+	}
+
+	const float graphHeight = 60.0f;
+	char overlay[64];
+	auto graph = [&] (const char *label, const PerfHistory &h) {
+		snprintf(overlay, sizeof(overlay), "%.2f ms  p50 %.2f  p95 %.2f  p99 %.2f", h.latest(), h.percentile(0.50f), h.percentile(0.95f), h.percentile(0.99f));
+		ImGui::PlotLines(label, h.data(), h.size(), h.offset(), overlay, 0.0f, std::max(h.max(), 1.0f), ImVec2(0.0f, graphHeight));
+	};
+
+	graph("CPU frame", cpuFrameHistory);
+	graph("GPU frame", gpuFrameHistory);
+	graph("Frame wait", frameWaitHistory);
+
+	// smoothed per pass times as one stacked bar, scaled to the slowest recent frame
+	if (!gpuPassTimes.empty()) {
+		ImGui::Separator();
+
+		float total = 0.0f;
+		for (const auto &p : gpuPassTimes) {
+			total += p.second;
+		}
+		const float scale = std::max(gpuFrameHistory.max(), total);
+
+		ImVec2 barPos   = ImGui::GetCursorScreenPos();
+		float barWidth  = ImGui::GetContentRegionAvail().x;
+		float barHeight = ImGui::GetFrameHeight();
+		ImDrawList *drawList = ImGui::GetWindowDrawList();
+		float x = barPos.x;
+		for (unsigned int i = 0; i < gpuPassTimes.size(); i++) {
+			ImU32 color = ImColor::HSV(float(i) / float(gpuPassTimes.size()), 0.6f, 0.8f);
+			float w     = barWidth * gpuPassTimes[i].second / std::max(scale, 0.001f);
+			drawList->AddRectFilled(ImVec2(x, barPos.y), ImVec2(x + w, barPos.y + barHeight), color);
+			x += w;
+		}
+		ImGui::Dummy(ImVec2(barWidth, barHeight));
+
+		for (unsigned int i = 0; i < gpuPassTimes.size(); i++) {
+			ImVec4 color = ImColor::HSV(float(i) / float(gpuPassTimes.size()), 0.6f, 0.8f);
+			ImGui::TextColored(color, "%s: %.3f ms (%.0f%%)", gpuPassTimes[i].first.c_str(), gpuPassTimes[i].second, 100.0f * gpuPassTimes[i].second / std::max(total, 0.001f));
+		}
+	}
+
+#ifdef RENDERER_VULKAN
+	ImGui::Separator();
+	auto memoryGraph = [&] (const char *label, const PerfHistory &h) {
+		snprintf(overlay, sizeof(overlay), "%.2f MB  max %.2f", h.latest(), h.max());
+		ImGui::PlotLines(label, h.data(), h.size(), h.offset(), overlay, 0.0f, std::max(h.max() * 1.1f, 1.0f), ImVec2(0.0f, graphHeight));
+	};
+	memoryGraph("Used memory", usedMemoryHistory);
+	memoryGraph("Ring buffers", ringBufferHistory);
+#endif  // RENDERER_VULKAN
+
+	ImGui::End();
+}
+
+
+// the buffers are concatenations of the lists so hashing their data in order is enough
+static uint64_t guiDrawDataHash(const ImDrawData *drawData) {
+	uint64_t hash = 0;
+	for (int n = 0; n < drawData->CmdListsCount; n++) {
+		const ImDrawList* cmd_list = drawData->CmdLists[n];
+		hash = XXH64(cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), hash);
+		hash = XXH64(cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx),  hash);
+	}
+
+	return hash;
+}
+
+
+PipelineDesc SMAADemo::guiPipelineDesc(bool overlay) const {
+	ShaderMacros macros;
+	PipelineDesc plDesc;
+	if (overlay) {
+		// premultiplied so the overlay's alpha is the coverage the composite needs
+		macros.emplace("GUI_PREMULTIPLIED", "1");
+		plDesc.sourceBlend(BlendFunc::One)
+		      .renderPass(guiOverlayRenderPass)
+		      .name("gui overlay");
+	} else {
+		// in the fused FXAA pass it must also leave the temporal history alone
+		if (fxaaTemporalResolve) {
+			macros.emplace("GUI_HISTORY", "1");
+		}
+		plDesc.sourceBlend(BlendFunc::SrcAlpha)
+		      .name("gui");
+	}
+
+	plDesc.descriptorSetLayout<GlobalDS>(0)
+		  .descriptorSetLayout<ColorTexDS>(1)
+		  .vertexShader("gui")
+		  .fragmentShader("gui")
+		  .shaderMacros(macros)
+		  .blending(true)
+		  .destinationBlend(BlendFunc::OneMinusSrcAlpha)
+		  .scissorTest(true)
+		  .vertexAttrib(ATTR_POS,   0, 2, VtxFormat::Float,  offsetof(ImDrawVert, pos))
+		  .vertexAttrib(ATTR_UV,    0, 2, VtxFormat::Float,  offsetof(ImDrawVert, uv))
+		  .vertexAttrib(ATTR_COLOR, 0, 4, VtxFormat::UNorm8, offsetof(ImDrawVert, col))
+		  .vertexBufferStride(ATTR_POS, sizeof(ImDrawVert));
+
+	return plDesc;
+}
+
+
+void SMAADemo::createGUIOverlay(unsigned int width, unsigned int height) {
+	assert(!guiOverlayRT);
+
+	RenderTargetDesc rtDesc;
+	rtDesc.name("GUI overlay")
+	      .format(Format::sRGBA8)
+	      .width(width)
+	      .height(height);
+	guiOverlayRT = renderer.createRenderTarget(rtDesc);
+
+	RenderPassDesc rpDesc;
+	rpDesc.color(0, Format::sRGBA8, PassBegin::Clear, Layout::Undefined, Layout::ShaderRead)
+	      .name("GUI overlay");
+	guiOverlayRenderPass = renderer.createRenderPass(rpDesc);
+
+	FramebufferDesc fbDesc;
+	fbDesc.renderPass(guiOverlayRenderPass)
+	      .color(0, guiOverlayRT)
+	      .name("GUI overlay");
+	guiOverlayFramebuffer = renderer.createFramebuffer(fbDesc);
+
+	// contents are undefined until drawn
+	guiOverlayValid = false;
+}
+
+
+void SMAADemo::deleteGUIOverlay() {
+	if (!guiOverlayRT) {
+		return;
+	}
+
+	if (guiOverlayPipeline) {
+		renderer.deletePipeline(guiOverlayPipeline);
+		guiOverlayPipeline = PipelineHandle();
+	}
+
+	renderer.deleteFramebuffer(guiOverlayFramebuffer);
+	guiOverlayFramebuffer = FramebufferHandle();
+
+	renderer.deleteRenderPass(guiOverlayRenderPass);
+	guiOverlayRenderPass = RenderPassHandle();
+
+	renderer.deleteRenderTarget(guiOverlayRT);
+}
+
+
+void SMAADemo::renderGUIOverlay() {
+	assert(guiOverlayActive);
+	assert(guiOverlayRT);
+
 	auto drawData = ImGui::GetDrawData();
 	assert(drawData->Valid);
 
-	if (drawData->CmdListsCount > 0) {
-		assert(drawData->CmdLists      != nullptr);
-		assert(drawData->TotalVtxCount >  0);
-		assert(drawData->TotalIdxCount >  0);
+	// the first draw always happens, after that only when it changed and the interval has passed
+	uint64_t hash = guiDrawDataHash(drawData);
+	uint64_t now  = getNanoseconds();
+	if (guiOverlayValid) {
+		if (hash == guiOverlayHash) {
+			return;
+		}
+
+		if (double(now - guiOverlayTime) < 1000000000.0 / guiOverlayRate) {
+			return;
+		}
+	}
+	guiOverlayValid = true;
+	guiOverlayHash  = hash;
+	guiOverlayTime  = now;
+
+	if (!guiOverlayPipeline) {
+		PipelineDesc plDesc = guiPipelineDesc(true);
+		guiOverlayPipeline = renderer.createPipeline(plDesc);
+	}
+
+	const unsigned int windowWidth  = rendererDesc.swapchain.width;
+	const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+	ShaderDefines::Globals globals;
+	globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+	globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+	globals.renderScale           = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+	globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
+	globals.viewProj              = currViewProj;
+	globals.prevViewProj          = prevViewProj;
+	globals.reprojection          = reprojection;
+
+	GlobalDS globalDS;
+	globalDS.globalUniforms = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+	globalDS.linearSampler  = linearSampler;
+	globalDS.nearestSampler = nearestSampler;
 
-        if (!guiPipeline) {
-			PipelineDesc plDesc;
-			plDesc.descriptorSetLayout<GlobalDS>(0)
-				  .descriptorSetLayout<ColorTexDS>(1)
-				  .vertexShader("gui")
-				  .fragmentShader("gui")
-				  .blending(true)
-				  .sourceBlend(BlendFunc::SrcAlpha)
-				  .destinationBlend(BlendFunc::OneMinusSrcAlpha)
-				  .scissorTest(true)
-				  .vertexAttrib(ATTR_POS,   0, 2, VtxFormat::Float,  offsetof(ImDrawVert, pos))
-				  .vertexAttrib(ATTR_UV,    0, 2, VtxFormat::Float,  offsetof(ImDrawVert, uv))
-				  .vertexAttrib(ATTR_COLOR, 0, 4, VtxFormat::UNorm8, offsetof(ImDrawVert, col))
-				  .vertexBufferStride(ATTR_POS, sizeof(ImDrawVert))
-				  .name("gui");
+	renderer.pushDebugGroup("GUI overlay");
+	renderer.beginGPUTimer("GUI overlay");
+	renderer.beginRenderPass(guiOverlayRenderPass, guiOverlayFramebuffer);
+	renderer.setViewport(0, 0, windowWidth, windowHeight);
+	renderer.bindPipeline(guiOverlayPipeline);
+	renderer.bindDescriptorSet(0, globalDS);
+	drawGUI(drawData, hash);
+	renderer.endRenderPass();
+	renderer.endGPUTimer();
+	renderer.popDebugGroup();
+}
+
+
+void SMAADemo::renderGUI(RenderPasses rp, DemoRenderGraph::PassResources &r) {
+	if (guiOverlayActive) {
+		if (!guiCompositePipeline) {
+			PipelineDesc plDesc = blitPipelineDesc();
+			plDesc.blending(true)
+			      .sourceBlend(BlendFunc::One)
+			      .destinationBlend(BlendFunc::OneMinusSrcAlpha)
+			      .name("gui composite");
+			guiCompositePipeline = renderGraph.createPipeline(renderer, rp, plDesc);
+		}
+
+		const unsigned int windowWidth  = rendererDesc.swapchain.width;
+		const unsigned int windowHeight = rendererDesc.swapchain.height;
+
+		// the overlay covers the whole window even with dynamic resolution
+		ShaderDefines::Globals globals;
+		globals.screenSize            = glm::vec4(1.0f / float(windowWidth), 1.0f / float(windowHeight), windowWidth, windowHeight);
+		globals.smaaScreenSize        = glm::vec4(1.0f / float(smaaSize.x), 1.0f / float(smaaSize.y), smaaSize.x, smaaSize.y);
+		globals.renderScale           = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+		globals.guiOrtho              = glm::ortho(0.0f, float(windowWidth), float(windowHeight), 0.0f);
+		globals.viewProj              = currViewProj;
+		globals.prevViewProj          = prevViewProj;
+		globals.reprojection          = reprojection;
+
+		GlobalDS globalDS;
+		globalDS.globalUniforms = renderer.createEphemeralBuffer(BufferType::Uniform, sizeof(ShaderDefines::Globals), &globals);
+		globalDS.linearSampler  = linearSampler;
+		globalDS.nearestSampler = nearestSampler;
+
+		renderer.setViewport(0, 0, windowWidth, windowHeight);
+		renderer.bindPipeline(guiCompositePipeline);
+		renderer.bindDescriptorSet(0, globalDS);
+
+		ColorTexDS colorDS;
+		colorDS.color = r.get(Rendertargets::GUIOverlay);
+		renderer.bindDescriptorSet(1, colorDS);
+		renderer.draw(0, 3);
+		return;
+	}
 
+	auto drawData = ImGui::GetDrawData();
+	assert(drawData->Valid);
+
+	if (drawData->CmdListsCount > 0) {
+		if (!guiPipeline) {
+			PipelineDesc plDesc = guiPipelineDesc(false);
 			guiPipeline = renderGraph.createPipeline(renderer, rp, plDesc);
 		}
 
 		renderer.bindPipeline(guiPipeline);
+	}
+
+	drawGUI(drawData, guiDrawDataHash(drawData));
+}
+
+
+void SMAADemo::drawGUI(const ImDrawData *drawData, uint64_t hash) {
+	if (drawData->CmdListsCount > 0) {
+		assert(drawData->CmdLists      != nullptr);
+		assert(drawData->TotalVtxCount >  0);
+		assert(drawData->TotalIdxCount >  0);
+
 		ColorTexDS colorDS;
-		// FIXME: remove unused UBO hack
-		uint32_t temp = 0;
-		colorDS.unused = renderer.createEphemeralBuffer(BufferType::Uniform, 4, &temp);
 		colorDS.color = imguiFontsTex;
 		renderer.bindDescriptorSet(1, colorDS);
-		// TODO: upload all buffers first, render after
-		// and one buffer each vertex/index
 
+		// upload all lists first, then draw them with offsets
+		auto gatherLists = [&] () {
+			guiVertices.clear();
+			guiIndices.clear();
+			guiVertices.reserve(drawData->TotalVtxCount);
+			guiIndices.reserve(drawData->TotalIdxCount);
+			for (int n = 0; n < drawData->CmdListsCount; n++) {
+				const ImDrawList* cmd_list = drawData->CmdLists[n];
+				guiVertices.insert(guiVertices.end(), cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Data + cmd_list->VtxBuffer.Size);
+				guiIndices.insert(guiIndices.end(),   cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Data + cmd_list->IdxBuffer.Size);
+			}
+			assert(guiVertices.size() == static_cast<size_t>(drawData->TotalVtxCount));
+			assert(guiIndices.size()  == static_cast<size_t>(drawData->TotalIdxCount));
+		};
+
+		// a static gui produces the same vertices every frame
+		if (hash != guiDataHash) {
+			// changing, upload every frame until it settles
+			guiDataHash = hash;
+			if (guiVBO) {
+				renderer.deleteBuffer(guiVBO);
+				guiVBO = BufferHandle();
+
+				renderer.deleteBuffer(guiIBO);
+				guiIBO = BufferHandle();
+			}
+
+			// straight from the draw lists into the ring buffer
+			auto vtxBuf = renderer.allocateEphemeral(BufferType::Vertex, static_cast<uint32_t>(drawData->TotalVtxCount * sizeof(ImDrawVert)));
+			auto idxBuf = renderer.allocateEphemeral(BufferType::Index,  static_cast<uint32_t>(drawData->TotalIdxCount * sizeof(ImDrawIdx)));
+			ImDrawVert *vtxDst = reinterpret_cast<ImDrawVert *>(vtxBuf.contents);
+			ImDrawIdx  *idxDst = reinterpret_cast<ImDrawIdx *>(idxBuf.contents);
+			for (int n = 0; n < drawData->CmdListsCount; n++) {
+				const ImDrawList* cmd_list = drawData->CmdLists[n];
+				streamingCopy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+				streamingCopy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+				vtxDst += cmd_list->VtxBuffer.Size;
+				idxDst += cmd_list->IdxBuffer.Size;
+			}
+			renderer.bindIndexBuffer(idxBuf.buffer, true);
+			renderer.bindVertexBuffer(0, vtxBuf.buffer);
+		} else {
+			// same as last frame, keep a copy until it changes again
+			if (!guiVBO) {
+				gatherLists();
+				guiVBO = renderer.createBuffer(BufferType::Vertex, static_cast<uint32_t>(guiVertices.size() * sizeof(ImDrawVert)), guiVertices.data());
+				guiIBO = renderer.createBuffer(BufferType::Index,  static_cast<uint32_t>(guiIndices.size()  * sizeof(ImDrawIdx)),  guiIndices.data());
+			}
+			renderer.bindIndexBuffer(guiIBO, true);
+			renderer.bindVertexBuffer(0, guiVBO);
+		}
+
+		unsigned int vtx_list_offset = 0;
+		unsigned int idx_buffer_offset = 0;
 		for (int n = 0; n < drawData->CmdListsCount; n++) {
 			const ImDrawList* cmd_list = drawData->CmdLists[n];
 
-			BufferHandle vtxBuf = renderer.createEphemeralBuffer(BufferType::Vertex, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), cmd_list->VtxBuffer.Data);
-			BufferHandle idxBuf = renderer.createEphemeralBuffer(BufferType::Index, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), cmd_list->IdxBuffer.Data);
-			renderer.bindIndexBuffer(idxBuf, true);
-			renderer.bindVertexBuffer(0, vtxBuf);
-
-			unsigned int idx_buffer_offset = 0;
 			for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++) {
 				const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
 				if (pcmd->UserCallback) {
@@ -3328,10 +9768,11 @@ void SMAADemo::renderGUI(RenderPasses rp, DemoRenderGraph::PassResources & /* r
 					assert(pcmd->TextureId == 0);
 					renderer.setScissorRect(static_cast<unsigned int>(pcmd->ClipRect.x), static_cast<unsigned int>(pcmd->ClipRect.y),
 						static_cast<unsigned int>(pcmd->ClipRect.z - pcmd->ClipRect.x), static_cast<unsigned int>(pcmd->ClipRect.w - pcmd->ClipRect.y));
-					renderer.drawIndexedOffset(pcmd->ElemCount, idx_buffer_offset, 0, cmd_list->VtxBuffer.Size);
+					renderer.drawIndexedVertexOffset(pcmd->ElemCount, idx_buffer_offset, vtx_list_offset, 0, cmd_list->VtxBuffer.Size);
 				}
 				idx_buffer_offset += pcmd->ElemCount;
 			}
+			vtx_list_offset += cmd_list->VtxBuffer.Size;
 		}
 #if 0
 		LOG("CmdListsCount: %d\n", drawData->CmdListsCount);
@@ -3349,30 +9790,84 @@ void SMAADemo::renderGUI(RenderPasses rp, DemoRenderGraph::PassResources & /* r
 #endif  // IMGUI_DISABLE
 
 
+static void printDevices() {
+	auto devices = Renderer::listDevices();
+	for (const auto &d : devices) {
+		printf("%u: \"%s\" %s, vendor 0x%04x device 0x%04x, API %u.%u.%u, driver %u.%u.%u, %" PRIu64 " MB local memory\n"
+		      , d.index, d.name.c_str(), d.type.c_str(), d.vendorID, d.deviceID
+		      , d.apiVersion.major, d.apiVersion.minor, d.apiVersion.patch
+		      , d.driverVersion.major, d.driverVersion.minor, d.driverVersion.patch
+		      , d.localMemory / (1024 * 1024));
+	}
+}
+
+
+static void runMainLoop(SMAADemo &demo) {
+	while (demo.shouldKeepGoing()) {
+		try {
+			demo.mainLoopIteration();
+		} catch (std::exception &e) {
+			LOG("caught std::exception: \"%s\"\n", e.what());
+			logFlush();
+			printf("caught std::exception: \"%s\"\n", e.what());
+			break;
+		} catch (...) {
+			LOG("caught unknown exception\n");
+			logFlush();
+			break;
+		}
+	}
+}
+
+
 int main(int argc, char *argv[]) {
 	try {
 		logInit();
 
+		// this thread renders and submits, on Linux threads started after this inherit it
+		placeCurrentThread(CoreClass::Performance);
+
 		auto demo = std::make_unique<SMAADemo>();
 
 		demo->parseCommandLine(argc, argv);
 
-		demo->initRender();
-		demo->createCubes();
-		printHelp();
+		if (demo->shouldListDevices()) {
+			printDevices();
+		} else if (demo->shouldReplay()) {
+			demo->replayCapture();
+		} else if (demo->shouldBenchmarkAllDevices()) {
+			// a fresh demo per device so nothing carries over but the results
+			// shaders compiled for the first device come from the SPIR-V cache after that
+			auto devices = Renderer::listDevices();
+			std::vector<BenchmarkResult> results;
+			for (unsigned int i = 0; i < devices.size(); i++) {
+				LOG("Benchmarking device %u/%u: \"%s\"\n", i + 1, static_cast<unsigned int>(devices.size()), devices[i].name.c_str());
+				if (i != 0) {
+					// the old renderer must be gone before the next one is created
+					demo.reset();
+					demo = std::make_unique<SMAADemo>();
+					demo->parseCommandLine(argc, argv);
+				}
 
-		while (demo->shouldKeepGoing()) {
-			try {
-				demo->mainLoopIteration();
-			} catch (std::exception &e) {
-				LOG("caught std::exception: \"%s\"\n", e.what());
-				logFlush();
-				printf("caught std::exception: \"%s\"\n", e.what());
-				break;
-			} catch (...) {
-				LOG("caught unknown exception\n");
-				logFlush();
-				break;
+				demo->setBenchmarkDevice(devices[i], i + 1 == devices.size(), std::move(results));
+				demo->initRender();
+				demo->createCubes();
+				runMainLoop(*demo);
+				results = demo->takeBenchmarkResults();
+			}
+		} else {
+			demo->initRender();
+			if (demo->shouldPrecompileOnly()) {
+				demo->precompileAllShaders();
+			} else {
+				demo->createCubes();
+				if (demo->shouldExportScene()) {
+					demo->exportScene();
+				} else {
+					printHelp();
+
+					runMainLoop(*demo);
+				}
 			}
 		}
 	} catch (std::exception &e) {
@@ -24,9 +24,12 @@ THE SOFTWARE.
 #version 450 core
 
 #include "shaderDefines.h"
+#include "utils.h"
 
 #define FXAA_PC 1
 #define FXAA_GLSL_130 1
+// textureGather is core in GLSL 4.00, the header only looks for the gpu_shader5 extensions
+#define FXAA_GATHER4_ALPHA 1
 
 
 #include "fxaa3_11.h"
@@ -34,12 +37,56 @@ THE SOFTWARE.
 
 layout(set = 1, binding = 1) uniform sampler2D colorTex;
 
+#ifdef FXAA_TEMPORAL
+
+layout(set = 1, binding = 2) uniform sampler2D previousTex;
+#if SMAA_REPROJECTION
+layout(set = 1, binding = 3) uniform sampler2D velocityTex;
+#endif  // SMAA_REPROJECTION
+
+#endif  // FXAA_TEMPORAL
+
 layout (location = 0) in vec2 texcoord;
 
 layout (location = 0) out vec4 outColor;
 
+#ifdef FXAA_TEMPORAL
+
+// next frame's history
+layout (location = 1) out vec4 outCurrent;
+
+#endif  // FXAA_TEMPORAL
+
 void main(void)
 {
     vec4 zero = vec4(0.0, 0.0, 0.0, 0.0);
-    outColor = FxaaPixelShader(texcoord, zero, colorTex, colorTex, colorTex, screenSize.xy, zero, zero, zero, 0.75, 0.166, 0.0833, 8.0, 0.125, 0.05, zero);
+    vec4 current = FxaaPixelShader(texcoord, zero, colorTex, colorTex, colorTex, screenSize.xy, zero, zero, zero, 0.75, 0.166, 0.0833, 8.0, 0.125, 0.05, zero);
+
+#ifdef FXAA_TEMPORAL
+
+    // SMAAResolvePS but with the current pixel straight from FXAA
+    outCurrent = current;
+
+#if SMAA_REPROJECTION
+    vec2 velocity  = -textureLod(velocityTex, texcoord, 0.0).rg;
+    vec4 previous  = textureLod(previousTex, texcoord + velocity, 0.0);
+    float delta    = abs(current.a * current.a - previous.a * previous.a) / 5.0;
+    float weight   = 0.5 * clamp(1.0 - sqrt(delta) * reprojWeigthScale, 0.0, 1.0);
+#else  // SMAA_REPROJECTION
+    vec4 previous  = textureLod(previousTex, texcoord, 0.0);
+    float weight   = 0.5;
+#endif  // SMAA_REPROJECTION
+
+#if TEMPORAL_CLAMP
+    // against the scene before FXAA, neighbouring FXAA results aren't available here
+    previous.rgb   = clampHistory(colorTex, texcoord, screenSize.xy, current.rgb, previous.rgb);
+#endif  // TEMPORAL_CLAMP
+
+    outColor = mix(current, previous, weight);
+
+#else  // FXAA_TEMPORAL
+
+    outColor = current;
+
+#endif  // FXAA_TEMPORAL
 }
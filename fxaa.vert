@@ -38,6 +38,7 @@ void main(void)
 #ifndef VULKAN_FLIP
     texcoord = flipTexCoord(texcoord);
 #endif  // VULKAN_FLIP
+    texcoord *= renderScale.xy;
 
     gl_Position = vec4(pos, 1.0, 1.0);
 }
@@ -618,10 +618,18 @@ NOTE the other tuning knobs are now in the shader function inputs!
     #define FxaaFloat2 vec2
     #define FxaaFloat3 vec3
     #define FxaaFloat4 vec4
-    #define FxaaHalf float
-    #define FxaaHalf2 vec2
-    #define FxaaHalf3 vec3
-    #define FxaaHalf4 vec4
+    #if (FXAA_HALF_PRECISION == 1)
+        // luma and color math only, positions need full precision
+        #define FxaaHalf mediump float
+        #define FxaaHalf2 mediump vec2
+        #define FxaaHalf3 mediump vec3
+        #define FxaaHalf4 mediump vec4
+    #else
+        #define FxaaHalf float
+        #define FxaaHalf2 vec2
+        #define FxaaHalf3 vec3
+        #define FxaaHalf4 vec4
+    #endif
     #define FxaaInt2 ivec2
     #define FxaaSat(x) clamp(x, 0.0, 1.0)
     #define FxaaTex sampler2D
@@ -882,7 +890,7 @@ FxaaFloat4 FxaaPixelShader(
     posM.y = pos.y;
     #if (FXAA_GATHER4_ALPHA == 1)
         #if (FXAA_DISCARD == 0)
-            FxaaFloat4 rgbyM = FxaaTexTop(tex, posM);
+            FxaaHalf4 rgbyM = FxaaTexTop(tex, posM);
             #if (FXAA_GREEN_AS_LUMA == 0)
                 #define lumaM rgbyM.w
             #else
@@ -890,11 +898,11 @@ FxaaFloat4 FxaaPixelShader(
             #endif
         #endif
         #if (FXAA_GREEN_AS_LUMA == 0)
-            FxaaFloat4 luma4A = FxaaTexAlpha4(tex, posM);
-            FxaaFloat4 luma4B = FxaaTexOffAlpha4(tex, posM, FxaaInt2(-1, -1));
+            FxaaHalf4 luma4A = FxaaTexAlpha4(tex, posM);
+            FxaaHalf4 luma4B = FxaaTexOffAlpha4(tex, posM, FxaaInt2(-1, -1));
         #else
-            FxaaFloat4 luma4A = FxaaTexGreen4(tex, posM);
-            FxaaFloat4 luma4B = FxaaTexOffGreen4(tex, posM, FxaaInt2(-1, -1));
+            FxaaHalf4 luma4A = FxaaTexGreen4(tex, posM);
+            FxaaHalf4 luma4B = FxaaTexOffGreen4(tex, posM, FxaaInt2(-1, -1));
         #endif
         #if (FXAA_DISCARD == 1)
             #define lumaM luma4A.w
@@ -906,29 +914,29 @@ FxaaFloat4 FxaaPixelShader(
         #define lumaN luma4B.z
         #define lumaW luma4B.x
     #else
-        FxaaFloat4 rgbyM = FxaaTexTop(tex, posM);
+        FxaaHalf4 rgbyM = FxaaTexTop(tex, posM);
         #if (FXAA_GREEN_AS_LUMA == 0)
             #define lumaM rgbyM.w
         #else
             #define lumaM rgbyM.y
         #endif
-        FxaaFloat lumaS = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(0, 1), fxaaQualityRcpFrame.xy));
-        FxaaFloat lumaE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1, 0), fxaaQualityRcpFrame.xy));
-        FxaaFloat lumaN = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(0,-1), fxaaQualityRcpFrame.xy));
-        FxaaFloat lumaW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 0), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaS = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(0, 1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1, 0), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaN = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(0,-1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 0), fxaaQualityRcpFrame.xy));
     #endif
 /*--------------------------------------------------------------------------*/
-    FxaaFloat maxSM = max(lumaS, lumaM);
-    FxaaFloat minSM = min(lumaS, lumaM);
-    FxaaFloat maxESM = max(lumaE, maxSM);
-    FxaaFloat minESM = min(lumaE, minSM);
-    FxaaFloat maxWN = max(lumaN, lumaW);
-    FxaaFloat minWN = min(lumaN, lumaW);
-    FxaaFloat rangeMax = max(maxWN, maxESM);
-    FxaaFloat rangeMin = min(minWN, minESM);
-    FxaaFloat rangeMaxScaled = rangeMax * fxaaQualityEdgeThreshold;
-    FxaaFloat range = rangeMax - rangeMin;
-    FxaaFloat rangeMaxClamped = max(fxaaQualityEdgeThresholdMin, rangeMaxScaled);
+    FxaaHalf maxSM = max(lumaS, lumaM);
+    FxaaHalf minSM = min(lumaS, lumaM);
+    FxaaHalf maxESM = max(lumaE, maxSM);
+    FxaaHalf minESM = min(lumaE, minSM);
+    FxaaHalf maxWN = max(lumaN, lumaW);
+    FxaaHalf minWN = min(lumaN, lumaW);
+    FxaaHalf rangeMax = max(maxWN, maxESM);
+    FxaaHalf rangeMin = min(minWN, minESM);
+    FxaaHalf rangeMaxScaled = rangeMax * fxaaQualityEdgeThreshold;
+    FxaaHalf range = rangeMax - rangeMin;
+    FxaaHalf rangeMaxClamped = max(fxaaQualityEdgeThresholdMin, rangeMaxScaled);
     FxaaBool earlyExit = range < rangeMaxClamped;
 /*--------------------------------------------------------------------------*/
     if (earlyExit)
@@ -939,54 +947,54 @@ FxaaFloat4 FxaaPixelShader(
         #endif
 /*--------------------------------------------------------------------------*/
     #if (FXAA_GATHER4_ALPHA == 0)
-        FxaaFloat lumaNW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1,-1), fxaaQualityRcpFrame.xy));
-        FxaaFloat lumaSE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1, 1), fxaaQualityRcpFrame.xy));
-        FxaaFloat lumaNE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1,-1), fxaaQualityRcpFrame.xy));
-        FxaaFloat lumaSW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaNW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1,-1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaSE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1, 1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaNE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1,-1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaSW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 1), fxaaQualityRcpFrame.xy));
     #else
-        FxaaFloat lumaNE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1, -1), fxaaQualityRcpFrame.xy));
-        FxaaFloat lumaSW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaNE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1, -1), fxaaQualityRcpFrame.xy));
+        FxaaHalf lumaSW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 1), fxaaQualityRcpFrame.xy));
     #endif
 /*--------------------------------------------------------------------------*/
-    FxaaFloat lumaNS = lumaN + lumaS;
-    FxaaFloat lumaWE = lumaW + lumaE;
-    FxaaFloat subpixRcpRange = 1.0/range;
-    FxaaFloat subpixNSWE = lumaNS + lumaWE;
-    FxaaFloat edgeHorz1 = (-2.0 * lumaM) + lumaNS;
-    FxaaFloat edgeVert1 = (-2.0 * lumaM) + lumaWE;
-/*--------------------------------------------------------------------------*/
-    FxaaFloat lumaNESE = lumaNE + lumaSE;
-    FxaaFloat lumaNWNE = lumaNW + lumaNE;
-    FxaaFloat edgeHorz2 = (-2.0 * lumaE) + lumaNESE;
-    FxaaFloat edgeVert2 = (-2.0 * lumaN) + lumaNWNE;
-/*--------------------------------------------------------------------------*/
-    FxaaFloat lumaNWSW = lumaNW + lumaSW;
-    FxaaFloat lumaSWSE = lumaSW + lumaSE;
-    FxaaFloat edgeHorz4 = (abs(edgeHorz1) * 2.0) + abs(edgeHorz2);
-    FxaaFloat edgeVert4 = (abs(edgeVert1) * 2.0) + abs(edgeVert2);
-    FxaaFloat edgeHorz3 = (-2.0 * lumaW) + lumaNWSW;
-    FxaaFloat edgeVert3 = (-2.0 * lumaS) + lumaSWSE;
-    FxaaFloat edgeHorz = abs(edgeHorz3) + edgeHorz4;
-    FxaaFloat edgeVert = abs(edgeVert3) + edgeVert4;
-/*--------------------------------------------------------------------------*/
-    FxaaFloat subpixNWSWNESE = lumaNWSW + lumaNESE;
+    FxaaHalf lumaNS = lumaN + lumaS;
+    FxaaHalf lumaWE = lumaW + lumaE;
+    FxaaHalf subpixRcpRange = 1.0/range;
+    FxaaHalf subpixNSWE = lumaNS + lumaWE;
+    FxaaHalf edgeHorz1 = (-2.0 * lumaM) + lumaNS;
+    FxaaHalf edgeVert1 = (-2.0 * lumaM) + lumaWE;
+/*--------------------------------------------------------------------------*/
+    FxaaHalf lumaNESE = lumaNE + lumaSE;
+    FxaaHalf lumaNWNE = lumaNW + lumaNE;
+    FxaaHalf edgeHorz2 = (-2.0 * lumaE) + lumaNESE;
+    FxaaHalf edgeVert2 = (-2.0 * lumaN) + lumaNWNE;
+/*--------------------------------------------------------------------------*/
+    FxaaHalf lumaNWSW = lumaNW + lumaSW;
+    FxaaHalf lumaSWSE = lumaSW + lumaSE;
+    FxaaHalf edgeHorz4 = (abs(edgeHorz1) * 2.0) + abs(edgeHorz2);
+    FxaaHalf edgeVert4 = (abs(edgeVert1) * 2.0) + abs(edgeVert2);
+    FxaaHalf edgeHorz3 = (-2.0 * lumaW) + lumaNWSW;
+    FxaaHalf edgeVert3 = (-2.0 * lumaS) + lumaSWSE;
+    FxaaHalf edgeHorz = abs(edgeHorz3) + edgeHorz4;
+    FxaaHalf edgeVert = abs(edgeVert3) + edgeVert4;
+/*--------------------------------------------------------------------------*/
+    FxaaHalf subpixNWSWNESE = lumaNWSW + lumaNESE;
     FxaaFloat lengthSign = fxaaQualityRcpFrame.x;
     FxaaBool horzSpan = edgeHorz >= edgeVert;
-    FxaaFloat subpixA = subpixNSWE * 2.0 + subpixNWSWNESE;
+    FxaaHalf subpixA = subpixNSWE * 2.0 + subpixNWSWNESE;
 /*--------------------------------------------------------------------------*/
     if (!horzSpan) lumaN = lumaW;
     if (!horzSpan) lumaS = lumaE;
     if (horzSpan) lengthSign = fxaaQualityRcpFrame.y;
-    FxaaFloat subpixB = (subpixA * (1.0/12.0)) - lumaM;
+    FxaaHalf subpixB = (subpixA * (1.0/12.0)) - lumaM;
 /*--------------------------------------------------------------------------*/
-    FxaaFloat gradientN = lumaN - lumaM;
-    FxaaFloat gradientS = lumaS - lumaM;
-    FxaaFloat lumaNN = lumaN + lumaM;
-    FxaaFloat lumaSS = lumaS + lumaM;
+    FxaaHalf gradientN = lumaN - lumaM;
+    FxaaHalf gradientS = lumaS - lumaM;
+    FxaaHalf lumaNN = lumaN + lumaM;
+    FxaaHalf lumaSS = lumaS + lumaM;
     FxaaBool pairN = abs(gradientN) >= abs(gradientS);
-    FxaaFloat gradient = max(abs(gradientN), abs(gradientS));
+    FxaaHalf gradient = max(abs(gradientN), abs(gradientS));
     if (pairN) lengthSign = -lengthSign;
-    FxaaFloat subpixC = FxaaSat(abs(subpixB) * subpixRcpRange);
+    FxaaHalf subpixC = FxaaSat(abs(subpixB) * subpixRcpRange);
 /*--------------------------------------------------------------------------*/
     FxaaFloat2 posB;
     posB.x = posM.x;
@@ -1003,15 +1011,15 @@ FxaaFloat4 FxaaPixelShader(
     FxaaFloat2 posP;
     posP.x = posB.x + offNP.x * FXAA_QUALITY_P0;
     posP.y = posB.y + offNP.y * FXAA_QUALITY_P0;
-    FxaaFloat subpixD = ((-2.0)*subpixC) + 3.0;
+    FxaaHalf subpixD = ((-2.0)*subpixC) + 3.0;
     FxaaFloat lumaEndN = FxaaLuma(FxaaTexTop(tex, posN));
-    FxaaFloat subpixE = subpixC * subpixC;
+    FxaaHalf subpixE = subpixC * subpixC;
     FxaaFloat lumaEndP = FxaaLuma(FxaaTexTop(tex, posP));
 /*--------------------------------------------------------------------------*/
     if (!pairN) lumaNN = lumaSS;
-    FxaaFloat gradientScaled = gradient * 1.0/4.0;
-    FxaaFloat lumaMM = lumaM - lumaNN * 0.5;
-    FxaaFloat subpixF = subpixD * subpixE;
+    FxaaHalf gradientScaled = gradient * 1.0/4.0;
+    FxaaHalf lumaMM = lumaM - lumaNN * 0.5;
+    FxaaHalf subpixF = subpixD * subpixE;
     FxaaBool lumaMLTZero = lumaMM < 0.0;
 /*--------------------------------------------------------------------------*/
     lumaEndN -= lumaNN * 0.5;
@@ -1222,9 +1230,9 @@ FxaaFloat4 FxaaPixelShader(
     FxaaBool directionN = dstN < dstP;
     FxaaFloat dst = min(dstN, dstP);
     FxaaBool goodSpan = directionN ? goodSpanN : goodSpanP;
-    FxaaFloat subpixG = subpixF * subpixF;
+    FxaaHalf subpixG = subpixF * subpixF;
     FxaaFloat pixelOffset = (dst * (-spanLengthRcp)) + 0.5;
-    FxaaFloat subpixH = subpixG * fxaaQualitySubpix;
+    FxaaHalf subpixH = subpixG * fxaaQualitySubpix;
 /*--------------------------------------------------------------------------*/
     FxaaFloat pixelOffsetGood = goodSpan ? pixelOffset : 0.0;
     FxaaFloat pixelOffsetSubpix = max(pixelOffsetGood, subpixH);
@@ -35,8 +35,26 @@ layout (location = 1) in vec2 uv;
 
 layout (location = 0) out vec4 outColor;
 
+#ifdef GUI_HISTORY
+
+// drawn in the fused FXAA pass which also writes temporal history
+// zero alpha makes blending leave it as it is
+layout (location = 1) out vec4 outHistory;
+
+#endif  // GUI_HISTORY
+
 
 void main(void)
 {
-    outColor = color * texture(sampler2D(colorTex, linearSampler), uv);
+    // font atlas is coverage only
+    outColor = color * vec4(1.0, 1.0, 1.0, texture(sampler2D(colorTex, linearSampler), uv).r);
+
+#ifdef GUI_PREMULTIPLIED
+    // drawn into the GUI overlay which is composited later
+    outColor.rgb *= outColor.a;
+#endif  // GUI_PREMULTIPLIED
+
+#ifdef GUI_HISTORY
+    outHistory = vec4(0.0, 0.0, 0.0, 0.0);
+#endif  // GUI_HISTORY
 }
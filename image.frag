@@ -23,19 +23,100 @@ THE SOFTWARE.
 
 #version 450 core
 
+#ifdef TEXTURE_TABLE
+#extension GL_EXT_nonuniform_qualifier : require
+#endif  // TEXTURE_TABLE
+
+#define IMAGE_SCENE 1
+
 #include "shaderDefines.h"
 
+#ifdef TILED_IMAGE
+
+#include "utils.h"
+
+// cache slot of every page of every level
+readonly restrict layout(std430, set = 1, binding = 1) buffer pageTableData {
+    uint pageTable[];
+};
+
+// IMAGE_PAGE_SIZE squared sRGB RGBA8 texels per slot
+readonly restrict layout(std430, set = 1, binding = 2) buffer pageCacheData {
+    uint pageCache[];
+};
+
+#elif defined(TEXTURE_TABLE)
+
+layout(set = 1, binding = 0) uniform texture2D textures[];
+
+#define colorTex textures[textureIndex]
+
+#else  // TILED_IMAGE
+
 layout(set = 1, binding = 1) uniform texture2D colorTex;
 
+#endif  // TILED_IMAGE
+
 layout (location = 0) in vec2 texcoord;
 
 layout (location = 0) out vec4 outColor;
-layout (location = 1) out vec2 outVelocity;
+
+
+#ifdef TILED_IMAGE
+
+// pages which aren't streamed in yet fall back to coarser levels
+// the last level is a single page which is always resident
+vec4 fetchTexel(uint level, ivec2 coord)
+{
+    for (; level < numImageLevels; level++, coord >>= 1) {
+        uvec4 l     = imageLevels[level];
+        uvec2 c     = uvec2(clamp(coord, ivec2(0), ivec2(l.zw) - 1));
+        uvec2 page  = c / IMAGE_PAGE_SIZE;
+        uint  slot  = pageTable[l.x + page.y * l.y + page.x];
+        if (slot != IMAGE_PAGE_MISSING) {
+            uvec2 t     = c % IMAGE_PAGE_SIZE;
+            vec4 color  = unpackUnorm4x8(pageCache[(slot * IMAGE_PAGE_SIZE + t.y) * IMAGE_PAGE_SIZE + t.x]);
+            return vec4(sRGB2linear(color.xyz), color.w);
+        }
+    }
+
+    return vec4(0.0);
+}
+
+
+// bilinear filtering from the finest level which doesn't alias
+vec4 sampleTiled(vec2 uv)
+{
+    vec2 size   = vec2(imageLevels[0].zw);
+    vec2 dx     = dFdx(uv * size);
+    vec2 dy     = dFdy(uv * size);
+    float lod   = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+    uint level  = min(uint(lod), numImageLevels - 1);
+
+    vec2 p      = uv * vec2(imageLevels[level].zw) - 0.5;
+    vec2 f      = fract(p);
+    ivec2 i     = ivec2(floor(p));
+    vec4 top    = mix(fetchTexel(level, i),              fetchTexel(level, i + ivec2(1, 0)), f.x);
+    vec4 bottom = mix(fetchTexel(level, i + ivec2(0, 1)), fetchTexel(level, i + ivec2(1, 1)), f.x);
+    return mix(top, bottom, f.y);
+}
+
+#endif  // TILED_IMAGE
+
 
 void main(void)
 {
+#ifdef TILED_IMAGE
+    vec4 color = sampleTiled(texcoord);
+#else  // TILED_IMAGE
     vec4 color = texture(sampler2D(colorTex, linearSampler), texcoord);
+#endif  // TILED_IMAGE
+
+    // black around the image when zoomed out or panned past its edges
+    if (any(lessThan(texcoord, vec2(0.0))) || any(greaterThan(texcoord, vec2(1.0)))) {
+        color = vec4(0.0);
+    }
+
     color.w = dot(color.xyz, vec3(0.299, 0.587, 0.114));
     outColor = color;
-    outVelocity = vec2(0.0, 0.0);
 }
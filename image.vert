@@ -23,6 +23,8 @@ THE SOFTWARE.
 
 #version 450 core
 
+#define IMAGE_SCENE 1
+
 #include "shaderDefines.h"
 #include "utils.h"
 
@@ -31,5 +33,7 @@ layout (location = 0) out vec2 texcoord;
 void main(void)
 {
     vec2 pos = triangleVertex(gl_VertexIndex, texcoord);
+    // zoom and pan, 0 to 1 is the whole image
+    texcoord = texcoord * imageTransform.xy + imageTransform.zw;
     gl_Position = vec4(pos, 1.0, 1.0);
 }
@@ -1,4 +1,4 @@
-.PHONY: default all bindirs clean cppcheck distclean
+.PHONY: default all bindirs clean cppcheck distclean shadercache
 
 
 .SUFFIXES:
@@ -158,6 +158,14 @@ endif
 clean:
 	rm -f $(TARGETS) $(SPV_GENERATED) $(foreach dir,$(ALLDIRS),$(dir)/*$(OBJSUFFIX))
 
+# compile every shader variant into shadercache/spirv.cache
+# shaders are loaded relative to the source directory
+# ship it and run with --shader-cache to skip compiling on first start
+shadercache: $(EXEPREFIX)smaaDemo$(EXESUFFIX)
+	mkdir -p $@
+	cd $(TOPDIR) && $(CURDIR)/$< --precompile-shaders --shader-cache $(CURDIR)/$@
+
+
 distclean: clean
 	rm -f $(foreach dir,$(ALLDIRS),$(dir)/*.d)
 	-rmdir -p --ignore-fail-on-non-empty $(ALLDIRS)
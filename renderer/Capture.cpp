@@ -0,0 +1,908 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include "Capture.h"
+#include "utils/Utils.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace renderer {
+
+
+CaptureWriter::CaptureWriter(const std::string &filename_, unsigned int frames, const SwapchainDesc &swapchain)
+: filename(filename_)
+, framesLeft(frames)
+, recordStart(0)
+{
+	assert(!filename.empty());
+	assert(frames > 0);
+
+	pod(captureMagic);
+	pod(captureVersion);
+
+	// so the replay starts with the same swapchain even if it's never changed
+	record(CaptureOp::SetSwapchainDesc, swapchain);
+}
+
+
+CaptureWriter::~CaptureWriter() {
+	// renderer went away before the last frame, keep what we have
+	if (!stream.empty()) {
+		try {
+			write();
+		} catch (std::exception &e) {
+			LOG("Failed to write capture \"%s\": %s\n", filename.c_str(), e.what());
+		}
+	}
+}
+
+
+void CaptureWriter::beginRecord(CaptureOp op) {
+	// any call after allocateEphemeral means the caller is done writing
+	// replay doesn't need to know the difference from createEphemeralBuffer
+	if (!pendingEphemeral.empty()) {
+		std::vector<PendingEphemeral> pending;
+		std::swap(pending, pendingEphemeral);
+		for (const auto &p : pending) {
+			record(CaptureOp::CreateEphemeralBuffer, p.type, CaptureBlob(p.contents, p.size), p.handle);
+		}
+	}
+
+	recordStart = stream.size();
+	pod(op._to_integral());
+	uint32_t size = 0;
+	pod(size);
+}
+
+
+void CaptureWriter::endRecord() {
+	size_t payload = stream.size() - recordStart - 1 - sizeof(uint32_t);
+	assert(payload <= UINT32_MAX);
+	uint32_t size = static_cast<uint32_t>(payload);
+	memcpy(&stream[recordStart + 1], &size, sizeof(size));
+}
+
+
+void CaptureWriter::value(const std::string &str) {
+	uint32_t length = static_cast<uint32_t>(str.size());
+	pod(length);
+	stream.insert(stream.end(), str.begin(), str.end());
+}
+
+
+void CaptureWriter::value(const ShaderMacros &macros) {
+	uint32_t count = static_cast<uint32_t>(macros.size());
+	pod(count);
+	for (const auto &m : macros) {
+		value(m.first);
+		value(m.second);
+	}
+}
+
+
+void CaptureWriter::value(const CaptureBlob &b) {
+	blob(b.data, b.size);
+}
+
+
+void CaptureWriter::value(const BufferDesc &desc) {
+	CaptureAccess::bufferDesc(*this, desc);
+}
+
+
+void CaptureWriter::value(const FramebufferDesc &desc) {
+	CaptureAccess::framebufferDesc(*this, desc);
+}
+
+
+void CaptureWriter::value(const PipelineDesc &desc) {
+	CaptureAccess::pipelineDesc(*this, desc);
+}
+
+
+void CaptureWriter::value(const ComputePipelineDesc &desc) {
+	CaptureAccess::computePipelineDesc(*this, desc);
+}
+
+
+void CaptureWriter::value(const RenderPassDesc &desc) {
+	CaptureAccess::renderPassDesc(*this, desc);
+}
+
+
+void CaptureWriter::value(const RenderTargetDesc &desc) {
+	CaptureAccess::renderTargetDesc(*this, desc);
+}
+
+
+void CaptureWriter::value(const SamplerDesc &desc) {
+	CaptureAccess::samplerDesc(*this, desc);
+}
+
+
+void CaptureWriter::value(const TextureDesc &desc) {
+	CaptureAccess::textureDesc(*this, desc);
+}
+
+
+void CaptureWriter::blob(const void *data, uint32_t size) {
+	pod(size);
+	if (size != 0) {
+		assert(data != nullptr);
+		const char *p = reinterpret_cast<const char *>(data);
+		stream.insert(stream.end(), p, p + size);
+	}
+}
+
+
+void CaptureWriter::createDescriptorSetLayout(const DescriptorLayout *layout, DSLayoutHandle handle) {
+	std::vector<DescriptorLayout> descriptors;
+	while (layout->type != +DescriptorType::End) {
+		descriptors.push_back(*layout);
+		layout++;
+	}
+
+	beginRecord(CaptureOp::CreateDescriptorSetLayout);
+	uint32_t count = static_cast<uint32_t>(descriptors.size());
+	pod(count);
+	for (const auto &d : descriptors) {
+		pod(d);
+	}
+	value(handle);
+	endRecord();
+
+	dsLayouts[HandleAccess::raw(handle)] = std::move(descriptors);
+}
+
+
+void CaptureWriter::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data_) {
+	auto it = dsLayouts.find(HandleAccess::raw(layout));
+	assert(it != dsLayouts.end());
+
+	beginRecord(CaptureOp::BindDescriptorSet);
+	value(index);
+	value(layout);
+
+	// only the handles, the rest of the struct is never read
+	const char *data = reinterpret_cast<const char *>(data_);
+	for (const auto &l : it->second) {
+		switch (l.type) {
+		case DescriptorType::End:
+			UNREACHABLE();
+			break;
+
+		case DescriptorType::UniformBuffer:
+		case DescriptorType::StorageBuffer:
+		case DescriptorType::UniformBufferDynamic:
+		case DescriptorType::StorageBufferDynamic:
+			value(*reinterpret_cast<const BufferHandle *>(data + l.offset));
+			break;
+
+		case DescriptorType::Sampler:
+			value(*reinterpret_cast<const SamplerHandle *>(data + l.offset));
+			break;
+
+		case DescriptorType::Texture:
+		case DescriptorType::StorageImage:
+			value(*reinterpret_cast<const TextureHandle *>(data + l.offset));
+			break;
+
+		case DescriptorType::CombinedSampler: {
+			const CSampler &combined = *reinterpret_cast<const CSampler *>(data + l.offset);
+			value(combined.tex);
+			value(combined.sampler);
+		} break;
+
+		case DescriptorType::Empty:
+		case DescriptorType::TextureTable:
+			break;
+		}
+	}
+
+	endRecord();
+}
+
+
+void CaptureWriter::allocateEphemeral(BufferType type, uint32_t size, const void *contents, BufferHandle handle) {
+	PendingEphemeral p;
+	p.type     = type;
+	p.size     = size;
+	p.contents = contents;
+	p.handle   = handle;
+	pendingEphemeral.push_back(p);
+}
+
+
+bool CaptureWriter::presentFrame(RenderTargetHandle image) {
+	record(CaptureOp::PresentFrame, image);
+
+	assert(framesLeft > 0);
+	framesLeft--;
+	if (framesLeft > 0) {
+		return false;
+	}
+
+	write();
+	return true;
+}
+
+
+void CaptureWriter::write() {
+	writeFile(filename, stream.data(), stream.size());
+	LOG("Wrote %u bytes of renderer capture to \"%s\"\n", static_cast<unsigned int>(stream.size()), filename.c_str());
+
+	stream.clear();
+	stream.shrink_to_fit();
+}
+
+
+template <class T> struct CaptureHandleMap {
+	HashMap<uint64_t, Handle<T> >  handles;
+};
+
+
+struct CaptureReader
+: public CaptureHandleMap<Buffer>
+, public CaptureHandleMap<DescriptorSetLayout>
+, public CaptureHandleMap<Framebuffer>
+, public CaptureHandleMap<Pipeline>
+, public CaptureHandleMap<RenderPass>
+, public CaptureHandleMap<RenderTarget>
+, public CaptureHandleMap<Sampler>
+, public CaptureHandleMap<Texture>
+{
+	MappedFile                                         stream;
+	// offset of the BeginFrame record of every complete frame
+	std::vector<size_t>                                frameStarts;
+
+	// payload of the record being executed
+	size_t                                             pos;
+	size_t                                             recordEnd;
+
+	// most recent SetSwapchainDesc, reapplied when the swapchain goes out of date
+	SwapchainDesc                                      swapchain;
+	// keyed by the captured handle
+	HashMap<uint64_t, std::vector<DescriptorLayout> >  dsLayouts;
+	std::vector<char>                                  dsData;
+
+
+	explicit CaptureReader(const std::string &filename);
+
+	CaptureReader(const CaptureReader &)                = delete;
+	CaptureReader(CaptureReader &&) noexcept            = delete;
+
+	CaptureReader &operator=(const CaptureReader &)     = delete;
+	CaptureReader &operator=(CaptureReader &&) noexcept = delete;
+
+	~CaptureReader() {}
+
+	// moves pos to the payload of the record at pos
+	CaptureOp nextRecord();
+
+	void execute(Renderer &r, CaptureOp op);
+
+	void check(size_t size) {
+		if (recordEnd - pos < size) {
+			throw std::runtime_error("Capture record is truncated");
+		}
+	}
+
+	template <typename T> void pod(T &v) {
+		static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be read directly");
+		check(sizeof(T));
+		memcpy(&v, stream.data() + pos, sizeof(T));
+		pos += sizeof(T);
+	}
+
+	template <typename T> void value(T &v) {
+		pod(v);
+	}
+
+	template <class T> Handle<T> lookup(uint64_t raw) {
+		if (raw == 0) {
+			return Handle<T>();
+		}
+
+		auto &handles = static_cast<CaptureHandleMap<T> &>(*this).handles;
+		auto it = handles.find(raw);
+		if (it == handles.end()) {
+			throw std::runtime_error("Capture uses a handle it never created");
+		}
+		return it->second;
+	}
+
+	template <class T> void value(Handle<T> &h) {
+		uint64_t raw = 0;
+		pod(raw);
+		h = lookup<T>(raw);
+	}
+
+	// reads the handle the capture got for a resource the replay just made
+	template <class T> void created(Handle<T> h) {
+		uint64_t raw = 0;
+		pod(raw);
+		if (raw != 0) {
+			static_cast<CaptureHandleMap<T> &>(*this).handles[raw] = h;
+		}
+	}
+
+	template <class T> Handle<T> deleted() {
+		uint64_t raw = 0;
+		pod(raw);
+		Handle<T> h = lookup<T>(raw);
+		static_cast<CaptureHandleMap<T> &>(*this).handles.erase(raw);
+		return h;
+	}
+
+	void value(std::string &str) {
+		uint32_t length = 0;
+		pod(length);
+		check(length);
+		str.assign(stream.data() + pos, length);
+		pos += length;
+	}
+
+	void value(ShaderMacros &macros) {
+		uint32_t count = 0;
+		pod(count);
+		for (unsigned int i = 0; i < count; i++) {
+			std::string k, v;
+			value(k);
+			value(v);
+			macros.emplace(std::move(k), std::move(v));
+		}
+	}
+
+	// points into the stream, valid as long as the reader
+	void blob(const void *&data, unsigned int &size) {
+		uint32_t s = 0;
+		pod(s);
+		check(s);
+		data = (s != 0) ? stream.data() + pos : nullptr;
+		size = s;
+		pos += s;
+	}
+
+	template <typename T> T get() {
+		T v;
+		value(v);
+		return v;
+	}
+};
+
+
+CaptureReader::CaptureReader(const std::string &filename)
+: stream(filename)
+, pos(0)
+, recordEnd(0)
+{
+	uint32_t magic = 0, version = 0;
+	recordEnd = stream.size();
+	pod(magic);
+	pod(version);
+	if (magic != captureMagic) {
+		throw std::runtime_error("\"" + filename + "\" is not a renderer capture");
+	}
+	if (version != captureVersion) {
+		throw std::runtime_error("\"" + filename + "\" is capture version " + std::to_string(version) + ", expected " + std::to_string(captureVersion));
+	}
+
+	// find the frames, a frame without PresentFrame was cut short and can't be replayed
+	size_t frameStart = 0;
+	bool   inFrame    = false;
+	while (pos < stream.size()) {
+		size_t start = pos;
+		CaptureOp op = nextRecord();
+		if (op == +CaptureOp::BeginFrame) {
+			frameStart = start;
+			inFrame    = true;
+		} else if (op == +CaptureOp::PresentFrame && inFrame) {
+			frameStarts.push_back(frameStart);
+			inFrame    = false;
+		}
+		pos = recordEnd;
+	}
+
+	LOG("Capture \"%s\": %u bytes, %u frames\n", filename.c_str(), static_cast<unsigned int>(stream.size()), static_cast<unsigned int>(frameStarts.size()));
+}
+
+
+CaptureOp CaptureReader::nextRecord() {
+	recordEnd = stream.size();
+
+	uint8_t  op   = 0;
+	uint32_t size = 0;
+	pod(op);
+	pod(size);
+	if (!CaptureOp::_is_valid(op)) {
+		throw std::runtime_error("Unknown capture record " + std::to_string(op));
+	}
+	check(size);
+
+	recordEnd = pos + size;
+	return CaptureOp::_from_integral(op);
+}
+
+
+void CaptureReader::execute(Renderer &r, CaptureOp op) {
+	switch (op) {
+	case CaptureOp::CreateBuffer: {
+		BufferDesc desc;
+		CaptureAccess::bufferDesc(*this, desc);
+		created(r.createBuffer(desc));
+	} break;
+
+	case CaptureOp::CreateFramebuffer: {
+		FramebufferDesc desc;
+		CaptureAccess::framebufferDesc(*this, desc);
+		created(r.createFramebuffer(desc));
+	} break;
+
+	case CaptureOp::CreatePipeline: {
+		PipelineDesc desc;
+		CaptureAccess::pipelineDesc(*this, desc);
+		created(r.createPipeline(desc));
+	} break;
+
+	case CaptureOp::CreateComputePipeline: {
+		ComputePipelineDesc desc;
+		CaptureAccess::computePipelineDesc(*this, desc);
+		created(r.createComputePipeline(desc));
+	} break;
+
+	case CaptureOp::CreateRenderPass: {
+		RenderPassDesc desc;
+		CaptureAccess::renderPassDesc(*this, desc);
+		created(r.createRenderPass(desc));
+	} break;
+
+	case CaptureOp::CreateRenderTarget: {
+		RenderTargetDesc desc;
+		CaptureAccess::renderTargetDesc(*this, desc);
+		created(r.createRenderTarget(desc));
+	} break;
+
+	case CaptureOp::CreateSampler: {
+		SamplerDesc desc;
+		CaptureAccess::samplerDesc(*this, desc);
+		created(r.createSampler(desc));
+	} break;
+
+	case CaptureOp::CreateTexture: {
+		TextureDesc desc;
+		CaptureAccess::textureDesc(*this, desc);
+		created(r.createTexture(desc));
+	} break;
+
+	case CaptureOp::CreateDescriptorSetLayout: {
+		std::vector<DescriptorLayout> descriptors(get<uint32_t>());
+		for (auto &d : descriptors) {
+			pod(d);
+		}
+
+		uint64_t raw = 0;
+		pod(raw);
+		dsLayouts[raw] = descriptors;
+
+		DescriptorLayout end;
+		end.type   = DescriptorType::End;
+		end.offset = 0;
+		descriptors.push_back(end);
+		static_cast<CaptureHandleMap<DescriptorSetLayout> &>(*this).handles[raw] = r.createDescriptorSetLayout(descriptors.data());
+	} break;
+
+	case CaptureOp::DeleteBuffer:
+		r.deleteBuffer(deleted<Buffer>());
+		break;
+
+	case CaptureOp::DeleteFramebuffer:
+		r.deleteFramebuffer(deleted<Framebuffer>());
+		break;
+
+	case CaptureOp::DeletePipeline:
+		r.deletePipeline(deleted<Pipeline>());
+		break;
+
+	case CaptureOp::DeleteRenderPass:
+		r.deleteRenderPass(deleted<RenderPass>());
+		break;
+
+	case CaptureOp::DeleteRenderTarget: {
+		auto rt = deleted<RenderTarget>();
+		r.deleteRenderTarget(rt);
+	} break;
+
+	case CaptureOp::DeleteSampler:
+		r.deleteSampler(deleted<Sampler>());
+		break;
+
+	case CaptureOp::DeleteTexture:
+		r.deleteTexture(deleted<Texture>());
+		break;
+
+	case CaptureOp::SetSwapchainDesc:
+		pod(swapchain);
+		// replay measures the frame, not the display
+		swapchain.vsync = VSync::Off;
+		r.setSwapchainDesc(swapchain);
+		break;
+
+	case CaptureOp::CreateEphemeralBuffer: {
+		auto type = get<BufferType>();
+		const void   *data = nullptr;
+		unsigned int  size = 0;
+		blob(data, size);
+		created(r.createEphemeralBuffer(type, size, data));
+	} break;
+
+	case CaptureOp::UpdateBuffer: {
+		auto buffer = get<BufferHandle>();
+		auto offset = get<uint32_t>();
+		const void   *data = nullptr;
+		unsigned int  size = 0;
+		blob(data, size);
+		r.updateBuffer(buffer, offset, size, data);
+	} break;
+
+		case CaptureOp::GetRenderTargetView: {
+		auto rt     = get<RenderTargetHandle>();
+		auto format = get<Format>();
+		created(r.getRenderTargetView(rt, format));
+	} break;
+
+	case CaptureOp::GetSwapchainRenderTarget:
+		if (!r.getFeatures().swapchainRenderTarget) {
+			throw std::runtime_error("Capture renders directly to the swapchain, this renderer can't");
+		}
+		created(r.getSwapchainRenderTarget());
+		break;
+
+	case CaptureOp::BeginFrame:
+		while (!r.beginFrame()) {
+			SDL_PumpEvents();
+			if (r.isSwapchainDirty()) {
+				r.setSwapchainDesc(swapchain);
+			}
+		}
+		break;
+
+	case CaptureOp::PresentFrame:
+		r.presentFrame(get<RenderTargetHandle>());
+		break;
+
+	case CaptureOp::AddDamageRect: {
+		auto x      = get<unsigned int>();
+		auto y      = get<unsigned int>();
+		auto width  = get<unsigned int>();
+		auto height = get<unsigned int>();
+		r.addDamageRect(x, y, width, height);
+	} break;
+
+	case CaptureOp::BeginAsyncCompute:
+		r.beginAsyncCompute();
+		break;
+
+	case CaptureOp::EndAsyncCompute:
+		r.endAsyncCompute();
+		break;
+
+	case CaptureOp::BeginRenderPass: {
+		auto rp = get<RenderPassHandle>();
+		auto fb = get<FramebufferHandle>();
+		r.beginRenderPass(rp, fb);
+	} break;
+
+	case CaptureOp::EndRenderPass:
+		r.endRenderPass();
+		break;
+
+	case CaptureOp::BeginGPUTimer:
+		r.beginGPUTimer(get<std::string>());
+		break;
+
+	case CaptureOp::EndGPUTimer:
+		r.endGPUTimer();
+		break;
+
+	case CaptureOp::PushDebugGroup:
+		r.pushDebugGroup(get<std::string>().c_str());
+		break;
+
+	case CaptureOp::PopDebugGroup:
+		r.popDebugGroup();
+		break;
+
+	case CaptureOp::LayoutTransition: {
+		auto image = get<RenderTargetHandle>();
+		auto src   = get<Layout>();
+		auto dest  = get<Layout>();
+		r.layoutTransition(image, src, dest);
+	} break;
+
+	case CaptureOp::BindPipeline:
+		r.bindPipeline(get<PipelineHandle>());
+		break;
+
+	case CaptureOp::BindIndexBuffer: {
+		auto buffer = get<BufferHandle>();
+		auto bit16  = get<bool>();
+		r.bindIndexBuffer(buffer, bit16);
+	} break;
+
+	case CaptureOp::BindVertexBuffer: {
+		auto binding = get<unsigned int>();
+		auto buffer  = get<BufferHandle>();
+		r.bindVertexBuffer(binding, buffer);
+	} break;
+
+	case CaptureOp::BindDescriptorSet: {
+		auto index = get<unsigned int>();
+		uint64_t raw = 0;
+		pod(raw);
+		auto layout = lookup<DescriptorSetLayout>(raw);
+		const auto &descriptors = dsLayouts.at(raw);
+
+		// rebuild the struct with the replay's handles at the same offsets
+		size_t size = 0;
+		for (const auto &l : descriptors) {
+			size = std::max(size, size_t(l.offset) + sizeof(CSampler));
+		}
+		dsData.assign(size, 0);
+		char *data = dsData.data();
+
+		for (const auto &l : descriptors) {
+			switch (l.type) {
+			case DescriptorType::End:
+				UNREACHABLE();
+				break;
+
+			case DescriptorType::UniformBuffer:
+			case DescriptorType::StorageBuffer:
+			case DescriptorType::UniformBufferDynamic:
+			case DescriptorType::StorageBufferDynamic:
+				*reinterpret_cast<BufferHandle *>(data + l.offset) = get<BufferHandle>();
+				break;
+
+			case DescriptorType::Sampler:
+				*reinterpret_cast<SamplerHandle *>(data + l.offset) = get<SamplerHandle>();
+				break;
+
+			case DescriptorType::Texture:
+			case DescriptorType::StorageImage:
+				*reinterpret_cast<TextureHandle *>(data + l.offset) = get<TextureHandle>();
+				break;
+
+			case DescriptorType::CombinedSampler: {
+				CSampler &combined = *reinterpret_cast<CSampler *>(data + l.offset);
+				combined.tex     = get<TextureHandle>();
+				combined.sampler = get<SamplerHandle>();
+			} break;
+
+			case DescriptorType::Empty:
+			case DescriptorType::TextureTable:
+				break;
+			}
+		}
+
+		r.bindDescriptorSet(index, layout, data);
+	} break;
+
+	case CaptureOp::PushConstants: {
+		const void   *data = nullptr;
+		unsigned int  size = 0;
+		blob(data, size);
+		r.pushConstants(data, size);
+	} break;
+
+	case CaptureOp::SetScissorRect: {
+		auto x      = get<unsigned int>();
+		auto y      = get<unsigned int>();
+		auto width  = get<unsigned int>();
+		auto height = get<unsigned int>();
+		r.setScissorRect(x, y, width, height);
+	} break;
+
+	case CaptureOp::SetViewport: {
+		auto x      = get<unsigned int>();
+		auto y      = get<unsigned int>();
+		auto width  = get<unsigned int>();
+		auto height = get<unsigned int>();
+		r.setViewport(x, y, width, height);
+	} break;
+
+	case CaptureOp::Blit: {
+		auto source = get<RenderTargetHandle>();
+		auto target = get<RenderTargetHandle>();
+		r.blit(source, target);
+	} break;
+
+	case CaptureOp::ResolveMSAA: {
+		auto source = get<RenderTargetHandle>();
+		auto target = get<RenderTargetHandle>();
+		r.resolveMSAA(source, target);
+	} break;
+
+	case CaptureOp::Draw: {
+		auto firstVertex = get<unsigned int>();
+		auto vertexCount = get<unsigned int>();
+		r.draw(firstVertex, vertexCount);
+	} break;
+
+	case CaptureOp::DrawInstanced: {
+		auto vertexCount   = get<unsigned int>();
+		auto instanceCount = get<unsigned int>();
+		r.drawInstanced(vertexCount, instanceCount);
+	} break;
+
+	case CaptureOp::DrawIndexedInstanced: {
+		auto vertexCount   = get<unsigned int>();
+		auto instanceCount = get<unsigned int>();
+		r.drawIndexedInstanced(vertexCount, instanceCount);
+	} break;
+
+	case CaptureOp::DrawIndexedOffset: {
+		auto vertexCount = get<unsigned int>();
+		auto firstIndex  = get<unsigned int>();
+		auto minIndex    = get<unsigned int>();
+		auto maxIndex    = get<unsigned int>();
+		r.drawIndexedOffset(vertexCount, firstIndex, minIndex, maxIndex);
+	} break;
+
+	case CaptureOp::DrawIndexedVertexOffset: {
+		auto vertexCount  = get<unsigned int>();
+		auto firstIndex   = get<unsigned int>();
+		auto vertexOffset = get<unsigned int>();
+		auto minIndex     = get<unsigned int>();
+		auto maxIndex     = get<unsigned int>();
+		r.drawIndexedVertexOffset(vertexCount, firstIndex, vertexOffset, minIndex, maxIndex);
+	} break;
+
+	case CaptureOp::DrawIndirect: {
+		auto buffer    = get<BufferHandle>();
+		auto drawCount = get<unsigned int>();
+		r.drawIndirect(buffer, drawCount);
+	} break;
+
+	case CaptureOp::DrawIndexedIndirect: {
+		auto buffer    = get<BufferHandle>();
+		auto drawCount = get<unsigned int>();
+		r.drawIndexedIndirect(buffer, drawCount);
+	} break;
+
+	case CaptureOp::Dispatch: {
+		auto x = get<unsigned int>();
+		auto y = get<unsigned int>();
+		auto z = get<unsigned int>();
+		r.dispatch(x, y, z);
+	} break;
+
+	case CaptureOp::DispatchIndirect:
+		r.dispatchIndirect(get<BufferHandle>());
+		break;
+
+	case CaptureOp::ComputeBarrier:
+		r.computeBarrier();
+		break;
+
+	case CaptureOp::UpdateTexture: {
+		auto texture = get<TextureHandle>();
+		auto level   = get<unsigned int>();
+		auto x       = get<unsigned int>();
+		auto y       = get<unsigned int>();
+		auto width   = get<unsigned int>();
+		auto height  = get<unsigned int>();
+		const void   *data = nullptr;
+		unsigned int  size = 0;
+		blob(data, size);
+		r.updateTexture(texture, level, x, y, width, height, size, data);
+	} break;
+	}
+
+	if (pos != recordEnd) {
+		throw std::runtime_error(std::string("Capture record ") + op._to_string() + " has the wrong size");
+	}
+}
+
+
+CaptureReplay::CaptureReplay(const std::string &filename)
+: reader(new CaptureReader(filename))
+{
+}
+
+
+CaptureReplay::~CaptureReplay() {
+}
+
+
+unsigned int CaptureReplay::numFrames() const {
+	return static_cast<unsigned int>(reader->frameStarts.size());
+}
+
+
+std::vector<uint64_t> CaptureReplay::replay(Renderer &r, unsigned int frame, unsigned int loops) {
+	auto &rd = *reader;
+	if (frame >= rd.frameStarts.size()) {
+		throw std::runtime_error("Capture has only " + std::to_string(rd.frameStarts.size()) + " frames");
+	}
+
+	// everything before the frame, commands of earlier frames are skipped
+	// but what they created might still be used
+	const size_t frameStart = rd.frameStarts[frame];
+	rd.pos = 2 * sizeof(uint32_t);
+	bool inFrame = false;
+	while (rd.pos < frameStart) {
+		CaptureOp op = rd.nextRecord();
+		if (op == +CaptureOp::BeginFrame) {
+			inFrame = true;
+		}
+		if (!inFrame || isPersistentCaptureOp(op)) {
+			rd.execute(r, op);
+		}
+		if (op == +CaptureOp::PresentFrame) {
+			inFrame = false;
+		}
+		rd.pos = rd.recordEnd;
+	}
+
+	// resources the frame creates are made once, deletes wait until the end
+	std::vector<size_t> deletes;
+	std::vector<uint64_t> times;
+	times.reserve(loops);
+	for (unsigned int i = 0; i < loops; i++) {
+		uint64_t start = RendererBase::now();
+
+		rd.pos = frameStart;
+		while (true) {
+			size_t recordStart = rd.pos;
+			CaptureOp op = rd.nextRecord();
+			if (!isPersistentCaptureOp(op)) {
+				rd.execute(r, op);
+			} else if (i == 0) {
+				if (op._to_integral() >= (+CaptureOp::DeleteBuffer)._to_integral() && op._to_integral() <= (+CaptureOp::DeleteTexture)._to_integral()) {
+					deletes.push_back(recordStart);
+				} else {
+					rd.execute(r, op);
+				}
+			}
+			rd.pos = rd.recordEnd;
+
+			if (op == +CaptureOp::PresentFrame) {
+				break;
+			}
+		}
+
+		times.push_back(RendererBase::now() - start);
+	}
+
+	for (size_t d : deletes) {
+		rd.pos = d;
+		rd.execute(r, rd.nextRecord());
+	}
+
+	return times;
+}
+
+
+}  // namespace renderer
@@ -0,0 +1,346 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+
+#include <type_traits>
+
+#include "RendererInternal.h"
+
+
+namespace renderer {
+
+
+// stream layout: captureMagic, captureVersion, then records
+// record: 1 byte CaptureOp, 4 byte payload size, payload
+// everything in native byte order, handles as their raw 64-bit values
+static const uint32_t captureMagic   = 0x50414353;  // "SCAP"
+static const uint32_t captureVersion = 6;
+
+
+BETTER_ENUM(CaptureOp, uint8_t
+	// persistent resources, see isPersistentCaptureOp
+	, CreateBuffer
+	, CreateFramebuffer
+	, CreatePipeline
+	, CreateComputePipeline
+	, CreateRenderPass
+	, CreateRenderTarget
+	, CreateSampler
+	, CreateTexture
+	, CreateDescriptorSetLayout
+	, DeleteBuffer
+	, DeleteFramebuffer
+	, DeletePipeline
+	, DeleteRenderPass
+	, DeleteRenderTarget
+	, DeleteSampler
+	, DeleteTexture
+	, SetSwapchainDesc
+
+	// only meaningful within the frame they were made in
+	, CreateEphemeralBuffer
+	, UpdateBuffer
+	, GetRenderTargetView
+	, GetSwapchainRenderTarget
+	, BeginFrame
+	, PresentFrame
+	, AddDamageRect
+	, BeginAsyncCompute
+	, EndAsyncCompute
+	, BeginRenderPass
+	, EndRenderPass
+	, BeginGPUTimer
+	, EndGPUTimer
+	, PushDebugGroup
+	, PopDebugGroup
+	, LayoutTransition
+	, BindPipeline
+	, BindIndexBuffer
+	, BindVertexBuffer
+	, BindDescriptorSet
+	, PushConstants
+	, SetScissorRect
+	, SetViewport
+	, Blit
+	, ResolveMSAA
+	, Draw
+	, DrawInstanced
+	, DrawIndexedInstanced
+	, DrawIndexedOffset
+	, DrawIndexedVertexOffset
+	, DrawIndirect
+	, DrawIndexedIndirect
+	, Dispatch
+	, DispatchIndirect
+	, ComputeBarrier
+	// appended so existing values in captures don't change
+	, UpdateTexture
+)
+
+
+static inline bool isPersistentCaptureOp(CaptureOp op) {
+	return op._to_integral() <= (+CaptureOp::SetSwapchainDesc)._to_integral();
+}
+
+
+// memory which is stored by value, like buffer and push constant contents
+struct CaptureBlob {
+	const void  *data;
+	uint32_t    size;
+
+
+	CaptureBlob(const void *data_, uint32_t size_)
+	: data(data_)
+	, size(size_)
+	{
+	}
+};
+
+
+// the private parts of the descs, same field list for writing and reading
+struct CaptureAccess {
+	template <class A, class D>
+	static void bufferDesc(A &a, D &desc) {
+		a.value(desc.type_);
+		a.value(desc.size_);
+		a.value(desc.usage_);
+		// empty when there are no initial contents
+		unsigned int contentsSize = desc.contents_ ? desc.size_ : 0;
+		a.blob(desc.contents_, contentsSize);
+		a.value(desc.name_);
+	}
+
+	template <class A, class D>
+	static void framebufferDesc(A &a, D &desc) {
+		a.value(desc.renderPass_);
+		a.value(desc.depthStencil_);
+		for (auto &rt : desc.colors_) {
+			a.value(rt);
+		}
+		for (auto &rt : desc.resolves_) {
+			a.value(rt);
+		}
+		a.value(desc.name_);
+	}
+
+	template <class A, class D>
+	static void pipelineDesc(A &a, D &desc) {
+		a.value(desc.vertexShaderName);
+		a.value(desc.fragmentShaderName);
+		a.value(desc.renderPass_);
+		a.value(desc.shaderMacros_);
+		a.value(desc.specConstants_);
+		a.value(desc.specConstantMask);
+		a.value(desc.vertexAttribMask);
+		a.value(desc.numSamples_);
+		a.value(desc.depthWrite_);
+		a.value(desc.depthTest_);
+		a.value(desc.depthFunc_);
+		a.value(desc.cullFaces_);
+		a.value(desc.scissorTest_);
+		a.value(desc.blending_);
+		a.value(desc.sourceBlend_);
+		a.value(desc.destinationBlend_);
+		a.value(desc.stencilTest_);
+		a.value(desc.stencilFunc_);
+		a.value(desc.stencilPassOp_);
+		a.value(desc.stencilRef_);
+		a.value(desc.vertexAttribs);
+		a.value(desc.vertexBuffers);
+		for (auto &l : desc.descriptorSetLayouts) {
+			a.value(l);
+		}
+		a.value(desc.pushConstantSize_);
+		a.value(desc.name_);
+	}
+
+	template <class A, class D>
+	static void computePipelineDesc(A &a, D &desc) {
+		a.value(desc.computeShaderName);
+		a.value(desc.shaderMacros_);
+		a.value(desc.specConstants_);
+		a.value(desc.specConstantMask);
+		for (auto &l : desc.descriptorSetLayouts) {
+			a.value(l);
+		}
+		a.value(desc.pushConstantSize_);
+		a.value(desc.name_);
+	}
+
+	template <class A, class D>
+	static void renderPassDesc(A &a, D &desc) {
+		a.value(desc.depthStencilFormat_);
+		a.value(desc.depthStencilPassBegin_);
+		a.value(desc.storeDepth_);
+		a.value(desc.colorRTs_);
+		a.value(desc.numSamples_);
+		a.value(desc.views_);
+		a.value(desc.name_);
+		a.value(desc.clearDepthAttachment);
+		a.value(desc.depthClearValue);
+		a.value(desc.stencilPassBegin_);
+		a.value(desc.storeStencil_);
+		a.value(desc.stencilClearValue);
+	}
+
+	template <class A, class D>
+	static void renderTargetDesc(A &a, D &desc) {
+		a.value(desc.width_);
+		a.value(desc.height_);
+		a.value(desc.numSamples_);
+		a.value(desc.layers_);
+		a.value(desc.format_);
+		a.value(desc.additionalViewFormat_);
+		a.value(desc.storage_);
+		a.value(desc.transient_);
+		a.value(desc.name_);
+	}
+
+	template <class A, class D>
+	static void samplerDesc(A &a, D &desc) {
+		a.value(desc.min);
+		a.value(desc.mag);
+		a.value(desc.mip);
+		a.value(desc.mipmaps);
+		a.value(desc.wrapMode);
+		a.value(desc.name_);
+	}
+
+	template <class A, class D>
+	static void textureDesc(A &a, D &desc) {
+		a.value(desc.width_);
+		a.value(desc.height_);
+		a.value(desc.numMips_);
+		a.value(desc.format_);
+		a.value(desc.generateMips_);
+		for (auto &level : desc.mipData_) {
+			a.blob(level.data, level.size);
+		}
+		a.value(desc.name_);
+	}
+};
+
+
+// allocateEphemeral memory the caller hasn't finished writing yet
+struct PendingEphemeral {
+	BufferType    type;
+	uint32_t      size;
+	const void    *contents;
+	BufferHandle  handle;
+};
+
+
+// owned by RendererBase while capturing, written out after the last captured frame
+class CaptureWriter {
+	std::string                                       filename;
+	unsigned int                                      framesLeft;
+	std::vector<char>                                 stream;
+	// start of the current record, its size is patched in by endRecord
+	size_t                                            recordStart;
+	// keyed by raw DSLayoutHandle, bindDescriptorSet needs them to find the handles
+	HashMap<uint64_t, std::vector<DescriptorLayout> >  dsLayouts;
+	// recorded as CreateEphemeralBuffer when the next record begins
+	std::vector<PendingEphemeral>                     pendingEphemeral;
+
+
+	void beginRecord(CaptureOp op);
+
+	void endRecord();
+
+	template <typename T> void pod(const T &v) {
+		static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable types can be written directly");
+		const char *p = reinterpret_cast<const char *>(&v);
+		stream.insert(stream.end(), p, p + sizeof(T));
+	}
+
+	void args() {
+	}
+
+	template <typename T, typename... Rest> void args(const T &v, const Rest &... rest) {
+		value(v);
+		args(rest...);
+	}
+
+
+public:
+
+	CaptureWriter(const std::string &filename_, unsigned int frames, const SwapchainDesc &swapchain);
+
+	CaptureWriter(const CaptureWriter &)                = delete;
+	CaptureWriter(CaptureWriter &&) noexcept            = delete;
+
+	CaptureWriter &operator=(const CaptureWriter &)     = delete;
+	CaptureWriter &operator=(CaptureWriter &&) noexcept = delete;
+
+	~CaptureWriter();
+
+	template <typename T> void value(const T &v) {
+		pod(v);
+	}
+
+	template <class T> void value(const Handle<T> &h) {
+		uint64_t raw = HandleAccess::raw(h);
+		pod(raw);
+	}
+
+	void value(const std::string &str);
+	void value(const ShaderMacros &macros);
+	void value(const CaptureBlob &b);
+	void value(const BufferDesc &desc);
+	void value(const FramebufferDesc &desc);
+	void value(const PipelineDesc &desc);
+	void value(const ComputePipelineDesc &desc);
+	void value(const RenderPassDesc &desc);
+	void value(const RenderTargetDesc &desc);
+	void value(const SamplerDesc &desc);
+	void value(const TextureDesc &desc);
+
+	void blob(const void *data, uint32_t size);
+
+	template <typename... Args> void record(CaptureOp op, const Args &... rest) {
+		beginRecord(op);
+		args(rest...);
+		endRecord();
+	}
+
+	void createDescriptorSetLayout(const DescriptorLayout *layout, DSLayoutHandle handle);
+
+	// contents must stay valid until the next record
+	void allocateEphemeral(BufferType type, uint32_t size, const void *contents, BufferHandle handle);
+
+	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
+
+	// true when enough frames were captured and the stream was written
+	bool presentFrame(RenderTargetHandle image);
+
+	void write();
+};
+
+
+}  // namespace renderer
+
+
+#endif  // CAPTURE_H
@@ -0,0 +1,228 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cassert>
+#include <cstring>
+
+#include <algorithm>
+
+#include <xxhash.h>
+
+#include "DrawList.h"
+
+
+namespace renderer {
+
+
+// descriptor set structs hold 64-bit buffer handles
+static const uint32_t drawListDataAlign = 8;
+
+
+DrawList::DrawList()
+: stateDirty(true)
+, currentLayer(0)
+, pushOffset(0)
+, pushSize(0)
+{
+}
+
+
+void DrawList::clear() {
+	states.clear();
+	packets.clear();
+	data.clear();
+	pipelines.clear();
+	stateDirty   = true;
+	current      = State();
+	currentLayer = 0;
+	pushOffset   = 0;
+	pushSize     = 0;
+}
+
+
+uint32_t DrawList::storeData(const void *contents, unsigned int size) {
+	uint32_t offset = (static_cast<uint32_t>(data.size()) + drawListDataAlign - 1) & ~(drawListDataAlign - 1);
+	data.resize(offset + size);
+	memcpy(&data[offset], contents, size);
+	return offset;
+}
+
+
+bool DrawList::sameSet(const DSRef &a, const DSRef &b) const {
+	if (a.layout != b.layout || a.size != b.size) {
+		return false;
+	}
+
+	return (a.offset == b.offset) || (memcmp(&data[a.offset], &data[b.offset], a.size) == 0);
+}
+
+
+void DrawList::bindPipeline(PipelineHandle pipeline) {
+	assert(pipeline);
+
+	// few pipelines per list so a linear search is fine
+	auto it = std::find(pipelines.begin(), pipelines.end(), pipeline);
+	if (it == pipelines.end()) {
+		assert(pipelines.size() < 0x10000);
+		it = pipelines.insert(it, pipeline);
+	}
+
+	current.pipeline      = pipeline;
+	current.pipelineOrder = static_cast<uint16_t>(it - pipelines.begin());
+	stateDirty            = true;
+}
+
+
+void DrawList::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *contents, unsigned int size) {
+	assert(index < MAX_DESCRIPTOR_SETS);
+	assert(layout);
+
+	auto &set  = current.sets[index];
+	set.layout = layout;
+	set.size   = size;
+	set.offset = storeData(contents, size);
+	stateDirty = true;
+}
+
+
+void DrawList::pushConstants(const void *contents, unsigned int size) {
+	assert(size > 0);
+
+	pushOffset = storeData(contents, size);
+	pushSize   = size;
+}
+
+
+void DrawList::bindIndexBuffer(BufferHandle buffer, bool bit16) {
+	current.indexBuffer = buffer;
+	current.index16     = bit16;
+	stateDirty          = true;
+}
+
+
+void DrawList::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
+	assert(binding < MAX_VERTEX_BUFFERS);
+
+	current.vertexBuffers[binding] = buffer;
+	stateDirty                     = true;
+}
+
+
+DrawList::Packet &DrawList::addPacket(DrawKind kind) {
+	assert(current.pipeline);
+
+	if (stateDirty) {
+		// draws with equal sets and buffers sort next to each other
+		// the handles are hashed as raw bytes, equal handles have equal bytes
+		uint64_t h = 0;
+		for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+			const auto &set = current.sets[i];
+			if (set.size != 0) {
+				h = XXH64(&data[set.offset], set.size, h + i);
+			}
+		}
+		h = XXH64(&current.indexBuffer,  sizeof(current.indexBuffer),  h);
+		h = XXH64(&current.vertexBuffers, sizeof(current.vertexBuffers), h);
+		current.hash = static_cast<uint32_t>(h ^ (h >> 32));
+
+		states.push_back(current);
+		stateDirty = false;
+	}
+
+	packets.emplace_back();
+	Packet &p = packets.back();
+	p.key        = (uint64_t(currentLayer) << 48) | (uint64_t(current.pipelineOrder) << 32) | current.hash;
+	p.state      = static_cast<uint32_t>(states.size() - 1);
+	p.kind       = kind;
+	p.pushOffset = pushOffset;
+	p.pushSize   = pushSize;
+	memset(p.args, 0, sizeof(p.args));
+
+	pushSize     = 0;
+
+	return p;
+}
+
+
+void DrawList::draw(unsigned int firstVertex, unsigned int vertexCount) {
+	Packet &p = addPacket(DrawKind::Draw);
+	p.args[0] = firstVertex;
+	p.args[1] = vertexCount;
+}
+
+
+void DrawList::drawInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+	Packet &p = addPacket(DrawKind::DrawInstanced);
+	p.args[0] = vertexCount;
+	p.args[1] = instanceCount;
+}
+
+
+void DrawList::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+	Packet &p = addPacket(DrawKind::DrawIndexedInstanced);
+	p.args[0] = vertexCount;
+	p.args[1] = instanceCount;
+}
+
+
+void DrawList::drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int minIndex, unsigned int maxIndex) {
+	Packet &p = addPacket(DrawKind::DrawIndexedOffset);
+	p.args[0] = vertexCount;
+	p.args[1] = firstIndex;
+	p.args[2] = minIndex;
+	p.args[3] = maxIndex;
+}
+
+
+void DrawList::drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex) {
+	Packet &p = addPacket(DrawKind::DrawIndexedVertexOffset);
+	p.args[0] = vertexCount;
+	p.args[1] = firstIndex;
+	p.args[2] = vertexOffset;
+	p.args[3] = minIndex;
+	p.args[4] = maxIndex;
+}
+
+
+void DrawList::drawIndirect(BufferHandle buffer, unsigned int drawCount) {
+	Packet &p = addPacket(DrawKind::DrawIndirect);
+	p.indirectBuffer = buffer;
+	p.args[0]        = drawCount;
+}
+
+
+void DrawList::drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount) {
+	Packet &p = addPacket(DrawKind::DrawIndexedIndirect);
+	p.indirectBuffer = buffer;
+	p.args[0]        = drawCount;
+}
+
+
+void DrawList::execute(Renderer &renderer) {
+	std::stable_sort(packets.begin(), packets.end(), [] (const Packet &a, const Packet &b) { return a.key < b.key; });
+
+	renderer.executeDrawList(*this);
+}
+
+
+}  // namespace renderer
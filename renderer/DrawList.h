@@ -0,0 +1,263 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+
+#include <cassert>
+
+#include <vector>
+
+#include "Renderer.h"
+
+
+namespace renderer {
+
+
+// draws recorded by a pass callback and submitted sorted by state
+// so draws sharing a pipeline, descriptor sets and buffers don't rebind them
+// bind calls only change the state later draws are recorded with
+// sorting is stable, draws whose order matters (blending) go in separate layers
+class DrawList {
+	enum class DrawKind : uint8_t {
+		  Draw
+		, DrawInstanced
+		, DrawIndexedInstanced
+		, DrawIndexedOffset
+		, DrawIndexedVertexOffset
+		, DrawIndirect
+		, DrawIndexedIndirect
+	};
+
+	// descriptor set contents are copied into data
+	struct DSRef {
+		DSLayoutHandle  layout;
+		uint32_t        offset;
+		uint32_t        size;
+
+		DSRef()
+		: offset(0)
+		, size(0)
+		{
+		}
+	};
+
+	// bound state shared by consecutive draws, a new one is started by any bind call
+	struct State {
+		PipelineHandle                                pipeline;
+		std::array<DSRef, MAX_DESCRIPTOR_SETS>        sets;
+		BufferHandle                                  indexBuffer;
+		bool                                          index16;
+		std::array<BufferHandle, MAX_VERTEX_BUFFERS>  vertexBuffers;
+		// of pipeline in pipelines, sorts before the sets
+		uint16_t                                      pipelineOrder;
+		// of sets and buffers
+		uint32_t                                      hash;
+
+		State()
+		: index16(false)
+		, pipelineOrder(0)
+		, hash(0)
+		{
+		}
+	};
+
+	struct Packet {
+		// layer, pipeline order, state hash from the top
+		uint64_t      key;
+		uint32_t      state;
+		DrawKind      kind;
+		uint32_t      pushOffset;
+		uint32_t      pushSize;
+		BufferHandle  indirectBuffer;
+		uint32_t      args[5];
+	};
+
+	std::vector<State>           states;
+	std::vector<Packet>          packets;
+	std::vector<char>            data;
+	// distinct pipelines in the order they were first bound
+	std::vector<PipelineHandle>  pipelines;
+	// state changed since the last draw, states.back() is not its current version
+	bool                         stateDirty;
+	State                        current;
+	uint16_t                     currentLayer;
+	uint32_t                     pushOffset;
+	uint32_t                     pushSize;
+
+
+	uint32_t storeData(const void *contents, unsigned int size);
+	bool sameSet(const DSRef &a, const DSRef &b) const;
+	Packet &addPacket(DrawKind kind);
+
+
+public:
+
+	DrawList();
+
+	DrawList(const DrawList &)                = delete;
+	DrawList(DrawList &&) noexcept            = default;
+
+	DrawList &operator=(const DrawList &)     = delete;
+	DrawList &operator=(DrawList &&) noexcept = default;
+
+	~DrawList() {}
+
+	// keeps the memory for reuse
+	void clear();
+
+	bool empty() const {
+		return packets.empty();
+	}
+
+	unsigned int size() const {
+		return static_cast<unsigned int>(packets.size());
+	}
+
+	// draws in a higher layer are submitted after every draw of a lower one
+	void layer(uint16_t l) {
+		currentLayer = l;
+	}
+
+	void bindPipeline(PipelineHandle pipeline);
+	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *contents, unsigned int size);
+	template <typename T> void bindDescriptorSet(unsigned int index, const T &contents) {
+		bindDescriptorSet(index, T::layoutHandle, &contents, sizeof(T));
+	}
+
+	// applies to the next draw only
+	void pushConstants(const void *contents, unsigned int size);
+	template <typename T> void pushConstants(const T &contents) {
+		pushConstants(&contents, sizeof(T));
+	}
+
+	void bindIndexBuffer(BufferHandle buffer, bool bit16);
+	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
+
+	void draw(unsigned int firstVertex, unsigned int vertexCount);
+	void drawInstanced(unsigned int vertexCount, unsigned int instanceCount);
+	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
+	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndirect(BufferHandle buffer, unsigned int drawCount);
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount);
+
+	// sorts and submits everything with Renderer::executeDrawList, must be inside a render pass
+	// pipeline and bindings are left in an unspecified state afterwards
+	void execute(Renderer &renderer);
+
+	// submits sorted draws [begin, end) to anything with Renderer's bind and draw functions
+	// assumes nothing is bound, so each chunk of a split list can go in its own command buffer
+	template <typename R> void replay(R &recorder, unsigned int begin, unsigned int end) const {
+		assert(begin <= end);
+		assert(end <= packets.size());
+
+		// what the renderer has bound, changing the pipeline binds everything again
+		// because the backends don't all keep bindings across pipelines
+		PipelineHandle                                boundPipeline;
+		std::array<DSRef, MAX_DESCRIPTOR_SETS>        boundSets;
+		BufferHandle                                  boundIndexBuffer;
+		bool                                          boundIndex16 = false;
+		std::array<BufferHandle, MAX_VERTEX_BUFFERS>  boundVertexBuffers;
+		uint32_t                                      lastState = ~0U;
+
+		for (unsigned int n = begin; n < end; n++) {
+			const Packet &p = packets[n];
+			if (p.state != lastState) {
+				lastState = p.state;
+				const State &s = states[p.state];
+
+				if (s.pipeline != boundPipeline) {
+					recorder.bindPipeline(s.pipeline);
+					boundPipeline = s.pipeline;
+
+					boundSets.fill(DSRef());
+					boundIndexBuffer = BufferHandle();
+					boundVertexBuffers.fill(BufferHandle());
+				}
+
+				for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+					const auto &set = s.sets[i];
+					if (set.layout && !sameSet(boundSets[i], set)) {
+						recorder.bindDescriptorSet(i, set.layout, &data[set.offset]);
+						boundSets[i] = set;
+					}
+				}
+
+				if (s.indexBuffer && (s.indexBuffer != boundIndexBuffer || s.index16 != boundIndex16)) {
+					recorder.bindIndexBuffer(s.indexBuffer, s.index16);
+					boundIndexBuffer = s.indexBuffer;
+					boundIndex16     = s.index16;
+				}
+
+				for (unsigned int i = 0; i < MAX_VERTEX_BUFFERS; i++) {
+					if (s.vertexBuffers[i] && s.vertexBuffers[i] != boundVertexBuffers[i]) {
+						recorder.bindVertexBuffer(i, s.vertexBuffers[i]);
+						boundVertexBuffers[i] = s.vertexBuffers[i];
+					}
+				}
+			}
+
+			if (p.pushSize != 0) {
+				recorder.pushConstants(&data[p.pushOffset], p.pushSize);
+			}
+
+			switch (p.kind) {
+			case DrawKind::Draw:
+				recorder.draw(p.args[0], p.args[1]);
+				break;
+
+			case DrawKind::DrawInstanced:
+				recorder.drawInstanced(p.args[0], p.args[1]);
+				break;
+
+			case DrawKind::DrawIndexedInstanced:
+				recorder.drawIndexedInstanced(p.args[0], p.args[1]);
+				break;
+
+			case DrawKind::DrawIndexedOffset:
+				recorder.drawIndexedOffset(p.args[0], p.args[1], p.args[2], p.args[3]);
+				break;
+
+			case DrawKind::DrawIndexedVertexOffset:
+				recorder.drawIndexedVertexOffset(p.args[0], p.args[1], p.args[2], p.args[3], p.args[4]);
+				break;
+
+			case DrawKind::DrawIndirect:
+				recorder.drawIndirect(p.indirectBuffer, p.args[0]);
+				break;
+
+			case DrawKind::DrawIndexedIndirect:
+				recorder.drawIndexedIndirect(p.indirectBuffer, p.args[0]);
+				break;
+			}
+		}
+	}
+};
+
+
+}  // namespace renderer
+
+
+#endif  // DRAWLIST_H
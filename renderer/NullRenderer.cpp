@@ -32,29 +32,54 @@ namespace renderer {
 
 RendererImpl::RendererImpl(const RendererDesc &desc)
 : RendererBase(desc)
+, currentPipelineCompute(false)
 {
 	SDL_Init(SDL_INIT_EVENTS);
 
 	currentRefreshRate = 60;
 	maxRefreshRate     = 60;
 
-	recreateRingBuffer(desc.ephemeralRingBufSize);
+	features.computeShaders = true;
+	// creating only touches the resource containers
+	features.threadedResourceCreation = true;
 
-	frames.resize(desc.swapchain.numFrames);
+	unsigned int numFrames = desc.swapchain.framesInFlight;
+	frames.resize((numFrames != 0) ? numFrames : desc.swapchain.numFrames);
 }
 
 
-void RendererImpl::recreateRingBuffer(unsigned int newSize) {
-	assert(newSize > 0);
+void RendererImpl::createRingPage(unsigned int idx, unsigned int size) {
+	assert(size > 0);
 
-	ringBufPtr  = 0;
-	ringBufSize = newSize;
-	ringBuffer.resize(newSize, 0);
+	auto &page = ringPages.at(idx);
+	assert(page.size == 0);
+	page.size = size;
+	page.contents.resize(size, 0);
 	// TODO: use valgrind to make sure we only write to intended parts of ring buffer
 }
 
 
+void RendererImpl::destroyRingPage(unsigned int idx) {
+	auto &page = ringPages.at(idx);
+	assert(page.size != 0);
+	page.size = 0;
+	page.contents.clear();
+	page.contents.shrink_to_fit();
+}
+
+
+std::vector<DeviceInfo> RendererImpl::listDevices() {
+	std::vector<DeviceInfo> devices(1);
+	devices[0].name = "Null";
+	devices[0].type = "other";
+	return devices;
+}
+
+
 RendererImpl::~RendererImpl() {
+	// nothing is left to receive these
+	pendingReadbacks.clear();
+
 	while (!waitForDeviceIdle()) {
 		// run event loop to avoid hangs
 		SDL_PumpEvents();
@@ -78,15 +103,21 @@ bool RendererImpl::isRenderTargetFormatSupported(Format /* format */) const {
 }
 
 
-BufferHandle RendererImpl::createBuffer(BufferType /* type */, uint32_t size, const void *contents) {
-	assert(size != 0);
-	assert(contents != nullptr);
+bool RendererImpl::isTextureFormatSupported(Format /* format */) const {
+	return true;
+}
+
+
+BufferHandle RendererImpl::createBuffer(const BufferDesc &desc) {
+	assert(desc.type_ != +BufferType::Invalid);
+	assert(desc.size_ != 0);
+	assert(desc.contents_ != nullptr || desc.usage_ != +BufferUsage::Static);
 
 	auto result    = buffers.add();
 	Buffer &buffer = result.first;
-	buffer.ringBufferAlloc = false;
 	buffer.beginOffs       = 0;
-	buffer.size            = size;
+	buffer.size            = desc.size_;
+	buffer.usage           = desc.usage_;
 
 	// TODO: store contents into buffer
 
@@ -94,24 +125,30 @@ BufferHandle RendererImpl::createBuffer(BufferType /* type */, uint32_t size, co
 }
 
 
-BufferHandle RendererImpl::createEphemeralBuffer(BufferType /* type */, uint32_t size, const void *contents) {
+BufferHandle RendererImpl::createEphemeralBuffer(BufferType type, uint32_t size, const void *contents) {
 	assert(size != 0);
 	assert(contents != nullptr);
 
-	unsigned int beginPtr = ringBufferAllocate(size, 256);
+	unsigned int page     = 0;
+	unsigned int beginPtr = ringBufferAllocate(size, 256, page);
 
 	// TODO: use valgrind to enforce we only write to intended parts of ring buffer
-	memcpy(&ringBuffer[beginPtr], contents, size);
+	memcpy(&ringPages[page].contents[beginPtr], contents, size);
 
-	auto result    = buffers.add();
-	Buffer &buffer = result.first;
-	buffer.ringBufferAlloc = true;
-	buffer.beginOffs       = beginPtr;
-	buffer.size            = size;
+	return EphemeralBuffer(page, beginPtr, size, type).handle();
+}
 
-	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
 
-	return result.second;
+EphemeralAllocation RendererImpl::allocateEphemeral(BufferType type, uint32_t size) {
+	assert(size != 0);
+
+	unsigned int page     = 0;
+	unsigned int beginPtr = ringBufferAllocate(size, 256, page);
+
+	EphemeralAllocation result;
+	result.buffer   = EphemeralBuffer(page, beginPtr, size, type).handle();
+	result.contents = &ringPages[page].contents[beginPtr];
+	return result;
 }
 
 
@@ -141,6 +178,14 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 }
 
 
+PipelineHandle RendererImpl::createComputePipeline(const ComputePipelineDesc & /* desc */) {
+	auto result = pipelines.add();
+	auto &pipeline = result.first;
+	pipeline.compute = true;
+	return result.second;
+}
+
+
 RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc) {
 	assert(desc.width_  > 0);
 	assert(desc.height_ > 0);
@@ -163,6 +208,16 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 }
 
 
+void RendererImpl::precompileShaders(const PipelineDesc & /* desc */) {
+	// no shaders to compile
+}
+
+
+void RendererImpl::precompileShaders(const ComputePipelineDesc & /* desc */) {
+	// no shaders to compile
+}
+
+
 VertexShaderHandle RendererImpl::createVertexShader(const std::string &name, const ShaderMacros & /* macros */) {
 	std::string vertexShaderName   = name + ".vert";
 
@@ -196,6 +251,8 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	Texture &texture = result.first;
 	// TODO: check desc
 	texture.desc = desc;
+	// it's never called, don't keep what it captured alive
+	texture.desc.mipWriter_ = nullptr;
 
 	return result.second;
 }
@@ -206,6 +263,7 @@ DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *l
 	DescriptorSetLayout &dsLayout = result.first;
 
 	while (layout->type != +DescriptorType::End) {
+		assert(layout->type != +DescriptorType::TextureTable);
 		dsLayout.layout.push_back(*layout);
 		layout++;
 	}
@@ -222,7 +280,22 @@ TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle /* handle */,
 }
 
 
-void RendererImpl::deleteBuffer(BufferHandle /* handle */) {
+RenderTargetHandle RendererImpl::getSwapchainRenderTarget() const {
+	// features.swapchainRenderTarget is never set
+	UNREACHABLE();
+	return RenderTargetHandle();
+}
+
+
+unsigned int RendererImpl::getTextureTableIndex(TextureHandle /* handle */) const {
+	// features.textureTable is never set
+	UNREACHABLE();
+	return 0;
+}
+
+
+void RendererImpl::deleteBuffer(BufferHandle UNUSED handle) {
+	assert(!EphemeralBuffer::isEphemeral(handle));
 }
 
 
@@ -305,16 +378,27 @@ bool RendererImpl::beginFrame() {
 }
 
 
-void RendererImpl::presentFrame(RenderTargetHandle /* rt */) {
+void RendererImpl::presentFrame(RenderTargetHandle rt) {
 	assert(inFrame);
 	inFrame = false;
 
 	auto &frame = frames.at(currentFrameIdx);
 
-	frame.usedRingBufPtr = ringBufPtr;
+	if (readbackRequested) {
+		readbackRequested = false;
+		readbackRenderTarget(rt, [this] (FrameReadback &r) {
+			std::swap(readback, r);
+			readbackReady = true;
+		});
+	}
+
 	frame.outstanding    = true;
 	frame.lastFrameNum   = frameNum;
 
+	finishRingFrame();
+
+	damageRects.clear();
+
 	frameNum++;
 }
 
@@ -325,22 +409,22 @@ bool RendererImpl::waitForFrame(unsigned int frameIdx) {
 	Frame &frame = frames.at(frameIdx);
 	assert(frame.outstanding);
 
-	for (auto handle : frame.ephemeralBuffers) {
-		Buffer &buffer = buffers.get(handle);
-		if (buffer.ringBufferAlloc) {
-			buffer.ringBufferAlloc = false;
-		}
+	frame.outstanding    = false;
+	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
+	releaseRingPages(frame);
+	frame.arena.reset();
 
-		assert(buffer.size   >  0);
-		buffer.size = 0;
-		buffer.beginOffs = 0;
+	for (auto it = pendingReadbacks.begin(); it != pendingReadbacks.end(); ) {
+		if (it->readback.frameNum > lastSyncedFrame) {
+			++it;
+			continue;
+		}
 
-		buffers.remove(handle);
+		// callback might add more readbacks
+		PendingReadback r = std::move(*it);
+		it = pendingReadbacks.erase(it);
+		r.callback(r.readback);
 	}
-	frame.ephemeralBuffers.clear();
-	frame.outstanding    = false;
-	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
-	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
 
 	return true;
 }
@@ -351,6 +435,18 @@ void RendererImpl::deleteFrameInternal(Frame &f) {
 }
 
 
+void RendererImpl::beginAsyncCompute() {
+	// features.asyncCompute is never set
+	UNREACHABLE();
+}
+
+
+void RendererImpl::endAsyncCompute() {
+	// features.asyncCompute is never set
+	UNREACHABLE();
+}
+
+
 void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
 	assert(inFrame);
 	assert(!inRenderPass);
@@ -365,6 +461,17 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 }
 
 
+bool RendererImpl::beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+	// features.staticRenderPasses is never set, contents are recorded every time
+	beginRenderPass(rpHandle, fbHandle);
+	return true;
+}
+
+
+void RendererImpl::invalidateStaticRenderPass(RenderPassHandle /* rpHandle */) {
+}
+
+
 void RendererImpl::endRenderPass() {
 	assert(inFrame);
 	assert(inRenderPass);
@@ -372,6 +479,39 @@ void RendererImpl::endRenderPass() {
 }
 
 
+void RendererImpl::beginGPUTimer(const std::string & /* name */) {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(!inGPUTimer);
+	inGPUTimer = true;
+}
+
+
+void RendererImpl::endGPUTimer() {
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(inGPUTimer);
+	inGPUTimer = false;
+}
+
+
+void RendererImpl::pushDebugGroup(const char * /* name */) {
+#ifndef NDEBUG
+	assert(inFrame);
+	debugGroupDepth++;
+#endif  // NDEBUG
+}
+
+
+void RendererImpl::popDebugGroup() {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(debugGroupDepth > 0);
+	debugGroupDepth--;
+#endif  // NDEBUG
+}
+
+
 void RendererImpl::layoutTransition(RenderTargetHandle image, Layout src, Layout dest) {
 	assert(image);
 	assert(dest != +Layout::Undefined);
@@ -382,13 +522,16 @@ void RendererImpl::layoutTransition(RenderTargetHandle image, Layout src, Layout
 void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 	assert(inFrame);
 	assert(pipeline);
-	assert(inRenderPass);
 	assert(pipelineDrawn);
 	pipelineDrawn = false;
 	validPipeline = true;
 	scissorSet = false;
 
-	currentPipeline = pipelines.get(pipeline).desc;
+	const auto &p = pipelines.get(pipeline);
+	// compute pipelines are bound outside renderpasses
+	assert(inRenderPass == !p.compute);
+	currentPipeline        = p.desc;
+	currentPipelineCompute = p.compute;
 }
 
 
@@ -409,6 +552,12 @@ void RendererImpl::bindDescriptorSet(unsigned int /* index */, DSLayoutHandle /*
 }
 
 
+void RendererImpl::pushConstants(const void * /* data */, unsigned int UNUSED size) {
+	assert(validPipeline);
+	assert(size <= MAX_PUSH_CONSTANT_SIZE);
+}
+
+
 void RendererImpl::setViewport(unsigned int /* x */, unsigned int /* y */, unsigned int /* width */, unsigned int /* height */) {
 	assert(inFrame);
 }
@@ -421,6 +570,36 @@ void RendererImpl::setScissorRect(unsigned int /* x */, unsigned int /* y */, un
 }
 
 
+void RendererImpl::updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *data) {
+	assert(handle);
+	assert(!EphemeralBuffer::isEphemeral(handle));
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(size != 0);
+	assert(data != nullptr);
+	assert((offset % 4) == 0 && (size % 4) == 0);
+
+	const auto &buffer = buffers.get(handle);
+	assert(buffer.usage != +BufferUsage::Static);
+	assert(offset + size <= buffer.size);
+}
+
+
+void RendererImpl::updateTexture(TextureHandle handle, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data) {
+	assert(handle);
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(width > 0 && height > 0);
+	assert(data != nullptr);
+
+	const auto &tex = textures.get(handle);
+	assert(level < tex.desc.numMips_ || tex.desc.generateMips_);
+	assert(x + width  <= std::max(tex.desc.width_  >> level, 1U));
+	assert(y + height <= std::max(tex.desc.height_ >> level, 1U));
+	assert(size == formatDataSize(tex.desc.format_, width, height));
+}
+
+
 void RendererImpl::blit(RenderTargetHandle source, RenderTargetHandle target) {
 	assert(source);
 	assert(target);
@@ -429,6 +608,25 @@ void RendererImpl::blit(RenderTargetHandle source, RenderTargetHandle target) {
 }
 
 
+void RendererImpl::readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback) {
+	assert(handle);
+	assert(!inRenderPass);
+
+	// nothing was drawn so it's black
+	const auto &desc = rendertargets.get(handle).desc;
+	assert(!isDepthFormat(desc.format_));
+
+	PendingReadback r;
+	r.readback.frameNum = frameNum;
+	r.readback.width    = desc.width_;
+	r.readback.height   = desc.height_;
+	r.readback.format   = desc.format_;
+	r.readback.pixels.resize(size_t(desc.width_) * desc.height_ * formatSize(desc.format_), 0);
+	r.callback          = std::move(callback);
+	pendingReadbacks.emplace_back(std::move(r));
+}
+
+
 void RendererImpl::resolveMSAA(RenderTargetHandle source, RenderTargetHandle target) {
 	assert(source);
 	assert(target);
@@ -446,6 +644,16 @@ void RendererImpl::draw(unsigned int /* firstVertex */, unsigned int vertexCount
 }
 
 
+void RendererImpl::drawInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	assert(instanceCount > 0);
+	assert(!currentPipeline.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+}
+
+
 void RendererImpl::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
 	assert(inRenderPass);
 	assert(validPipeline);
@@ -465,6 +673,67 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int /* f
 }
 
 
+void RendererImpl::drawIndexedVertexOffset(unsigned int vertexCount, unsigned int /* firstIndex */, unsigned int /* vertexOffset */, unsigned int /* minIndex */, unsigned int /* maxIndex */) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	assert(!currentPipeline.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+}
+
+
+void RendererImpl::drawIndirect(BufferHandle buffer, unsigned int drawCount) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(buffer);
+	assert(drawCount > 0);
+	assert(!currentPipeline.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+}
+
+
+void RendererImpl::drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount) {
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(buffer);
+	assert(drawCount > 0);
+	assert(!currentPipeline.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+}
+
+
+bool RendererImpl::executeDrawList(const DrawList & /* list */) {
+	// features.parallelRecording is never set
+	return false;
+}
+
+
+void RendererImpl::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+	assert(!inRenderPass);
+	assert(validPipeline);
+	assert(currentPipelineCompute);
+	assert(x > 0);
+	assert(y > 0);
+	assert(z > 0);
+	pipelineDrawn = true;
+}
+
+
+void RendererImpl::dispatchIndirect(BufferHandle buffer) {
+	assert(!inRenderPass);
+	assert(validPipeline);
+	assert(currentPipelineCompute);
+	assert(buffer);
+	pipelineDrawn = true;
+}
+
+
+void RendererImpl::computeBarrier() {
+	assert(inFrame);
+	assert(!inRenderPass);
+}
+
+
 } // namespace renderer
 
 
@@ -29,16 +29,15 @@ namespace renderer {
 
 
 struct Buffer {
-	bool          ringBufferAlloc;
 	unsigned int  beginOffs;
 	unsigned int  size;
-	// TODO: usage flags for debugging
+	BufferUsage   usage;
 
 
 	Buffer()
-	: ringBufferAlloc(false)
-	, beginOffs(0)
+	: beginOffs(0)
 	, size(0)
+	, usage(BufferUsage::Static)
 	{
 	}
 
@@ -46,13 +45,13 @@ struct Buffer {
 	Buffer &operator=(const Buffer &) = delete;
 
 	Buffer(Buffer &&other)
-	: ringBufferAlloc(other.ringBufferAlloc)
-	, beginOffs(other.beginOffs)
+	: beginOffs(other.beginOffs)
 	, size(other.size)
+	, usage(other.usage)
 	{
-		other.ringBufferAlloc = false;
 		other.beginOffs       = 0;
 		other.size            = 0;
+		other.usage           = BufferUsage::Static;
 	}
 
 	Buffer &operator=(Buffer &&other) {
@@ -60,13 +59,13 @@ struct Buffer {
 			return *this;
 		}
 
-		ringBufferAlloc       = other.ringBufferAlloc;
 		beginOffs             = other.beginOffs;
 		size                  = other.size;
+		usage                 = other.usage;
 
-		other.ringBufferAlloc = false;
 		other.beginOffs       = 0;
 		other.size            = 0;
+		other.usage           = BufferUsage::Static;
 
 		return *this;
 	}
@@ -177,6 +176,7 @@ struct Framebuffer {
 
 struct Pipeline {
 	PipelineDesc  desc;
+	bool          compute;
 
 
 	Pipeline(const Pipeline &)            = delete;
@@ -184,8 +184,10 @@ struct Pipeline {
 
 	Pipeline(Pipeline &&other)
 	: desc(other.desc)
+	, compute(other.compute)
 	{
-		other.desc = PipelineDesc();
+		other.desc    = PipelineDesc();
+		other.compute = false;
 	}
 
 	Pipeline &operator=(Pipeline &&other) {
@@ -193,14 +195,18 @@ struct Pipeline {
 			return *this;
 		}
 
-		desc       = other.desc;
+		desc          = other.desc;
+		compute       = other.compute;
 
-		other.desc = PipelineDesc();
+		other.desc    = PipelineDesc();
+		other.compute = false;
 
 		return *this;
 	}
 
-	Pipeline() {}
+	Pipeline()
+	: compute(false)
+	{}
 
 	~Pipeline() {}
 };
@@ -368,17 +374,13 @@ struct VertexShader {
 
 struct Frame : public FrameBase {
 	bool                      outstanding;
-	unsigned int              usedRingBufPtr;
-	std::vector<BufferHandle> ephemeralBuffers;
 
 
 	Frame()
 	: outstanding(false)
-	, usedRingBufPtr(0)
 	{}
 
 	~Frame() {
-		assert(ephemeralBuffers.empty());
 		assert(!outstanding);
 	}
 
@@ -388,37 +390,48 @@ struct Frame : public FrameBase {
 	Frame(Frame &&other) noexcept
 	: FrameBase(std::move(other))
 	, outstanding(other.outstanding)
-	, usedRingBufPtr(other.usedRingBufPtr)
-	, ephemeralBuffers(std::move(other.ephemeralBuffers))
 	{
 		other.outstanding      = false;
 		other.lastFrameNum     = 0;
-		other.usedRingBufPtr   = 0;
 	}
 
 	Frame &operator=(Frame &&other) noexcept {
-		assert(ephemeralBuffers.empty());
-		ephemeralBuffers = std::move(other.ephemeralBuffers);
-		assert(other.ephemeralBuffers.empty());
-
 		outstanding = other.outstanding;
 		other.outstanding = false;
 
 		lastFrameNum = other.lastFrameNum;
+		timerNames   = std::move(other.timerNames);
 		other.lastFrameNum = 0;
 
-		usedRingBufPtr       = other.usedRingBufPtr;
-		other.usedRingBufPtr = 0;
+		assert(ringPages.empty());
+		ringPages    = std::move(other.ringPages);
+		assert(other.ringPages.empty());
+
+		arena        = std::move(other.arena);
 
 		return *this;
 	}
 };
 
 
+struct RingPage : public RingPageBase {
+	std::vector<char>  contents;
+};
+
+
+// nothing is drawn so the pixels are known already
+// only the callback waits for its frame
+struct PendingReadback {
+	FrameReadback     readback;
+	ReadbackCallback  callback;
+};
+
+
 struct RendererImpl : public RendererBase {
-	std::vector<char> ringBuffer;
+	std::vector<RingPage>                    ringPages;
 
 	std::vector<Frame>                       frames;
+	std::vector<PendingReadback>             pendingReadbacks;
 
 	ResourceContainer<Buffer>              buffers;
 	ResourceContainer<DescriptorSetLayout>  dsLayouts;
@@ -432,10 +445,17 @@ struct RendererImpl : public RendererBase {
 	ResourceContainer<VertexShader>          vertexShaders;
 
 	PipelineDesc  currentPipeline;
+	bool          currentPipelineCompute;
 
 
-	void recreateRingBuffer(unsigned int newSize);
-	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
+	void createRingPage(unsigned int idx, unsigned int size);
+	void destroyRingPage(unsigned int idx);
+	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignment, unsigned int &page);
+	unsigned int ringBufferAllocateShared(unsigned int size, unsigned int &page);
+	void switchRingPage(unsigned int size);
+	void finishRingFrame();
+	void freeRingPage(unsigned int idx);
+	void releaseRingPages(Frame &frame);
 
 	bool waitForFrame(unsigned int frameIdx) WARN_UNUSED_RESULT;
 	void deleteFrameInternal(Frame &f);
@@ -444,8 +464,11 @@ struct RendererImpl : public RendererBase {
 
 	~RendererImpl();
 
+	static std::vector<DeviceInfo> listDevices();
+
 
 	bool isRenderTargetFormatSupported(Format format) const;
+	bool isTextureFormatSupported(Format format) const;
 
 	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
 	VertexShaderHandle   createVertexShader(const std::string &name, const ShaderMacros &macros);
@@ -453,14 +476,20 @@ struct RendererImpl : public RendererBase {
 	FramebufferHandle    createFramebuffer(const FramebufferDesc &desc);
 	RenderPassHandle     createRenderPass(const RenderPassDesc &desc);
 	PipelineHandle       createPipeline(const PipelineDesc &desc);
-	BufferHandle         createBuffer(BufferType type, uint32_t size, const void *contents);
+	PipelineHandle       createComputePipeline(const ComputePipelineDesc &desc);
+	void                 precompileShaders(const PipelineDesc &desc);
+	void                 precompileShaders(const ComputePipelineDesc &desc);
+	BufferHandle         createBuffer(const BufferDesc &desc);
 	BufferHandle         createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
+	EphemeralAllocation  allocateEphemeral(BufferType type, uint32_t size);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
 
 	DSLayoutHandle       createDescriptorSetLayout(const DescriptorLayout *layout);
 
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
+	RenderTargetHandle   getSwapchainRenderTarget() const;
+	unsigned int         getTextureTableIndex(TextureHandle handle) const;
 
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
@@ -480,9 +509,20 @@ struct RendererImpl : public RendererBase {
 	bool beginFrame();
 	void presentFrame(RenderTargetHandle image);
 
+	void beginAsyncCompute();
+	void endAsyncCompute();
+
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	bool beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	void invalidateStaticRenderPass(RenderPassHandle rpHandle);
 	void endRenderPass();
 
+	void beginGPUTimer(const std::string &name);
+	void endGPUTimer();
+
+	void pushDebugGroup(const char *name);
+	void popDebugGroup();
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -493,13 +533,27 @@ struct RendererImpl : public RendererBase {
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
 
 	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
+	void pushConstants(const void *data, unsigned int size);
 
+	void updateBuffer(BufferHandle buffer, uint32_t offset, uint32_t size, const void *data);
+	void updateTexture(TextureHandle texture, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data);
 	void blit(RenderTargetHandle source, RenderTargetHandle target);
+	void readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback);
 	void resolveMSAA(RenderTargetHandle source, RenderTargetHandle target);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
+	void drawInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndirect(BufferHandle buffer, unsigned int drawCount);
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount);
+	// false if Renderer should replay it call by call
+	bool executeDrawList(const DrawList &list);
+
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+	void dispatchIndirect(BufferHandle buffer);
+	void computeBarrier();
 };
 
 
@@ -33,6 +33,8 @@ THE SOFTWARE.
 
 #include <spirv_glsl.hpp>
 
+#include <xxhash.h>
+
 #include "Renderer.h"
 #include "utils/Utils.h"
 #include "RendererInternal.h"
@@ -71,35 +73,39 @@ static void pushString(std::vector<char> &v, const std::string &str) {
 }
 
 
+// GL has no specialization for GLSL source, bake the values in as the defaults
+static void applySpecConstants(spirv_cross::CompilerGLSL &glsl, const std::array<uint32_t, MAX_SPEC_CONSTANTS> &values, uint32_t mask) {
+	for (const auto &c : glsl.get_specialization_constants()) {
+		if (c.constant_id < MAX_SPEC_CONSTANTS && (mask & (1U << c.constant_id)) != 0) {
+			glsl.get_constant(c.id).m.c[0].r[0].u32 = values[c.constant_id];
+		}
+	}
+}
+
+
 static std::vector<char> spirv2glsl(const std::string &name, const ShaderMacros &macros, spirv_cross::CompilerGLSL &glsl) {
 	std::string src_ = glsl.compile();
 
 	std::vector<char> result;
 	{
 		size_t size = src_.size() + 3 + name.size() + 1;
-		std::vector<std::string> sorted;
-		sorted.reserve(macros.size());
 		for (const auto &macro : macros) {
-			std::string str = macro.first;
-			if (!macro.second.empty()) {
-				str += "=";
-				str += macro.second;
-			}
-			size += 3 + str.size() + 1;
-			sorted.emplace_back(std::move(str));
+			size += 3 + macro.first.size() + 1 + macro.second.size() + 1;
 		}
 
-		std::sort(sorted.begin(), sorted.end());
-
 		result.reserve(size);
 
 		pushString(result, "// ");
 		pushString(result, name);
 		result.push_back('\n');
 
-		for (const auto &s : sorted) {
+		for (const auto &macro : macros) {
 			pushString(result, "// ");
-			pushString(result, s);
+			pushString(result, macro.first);
+			if (!macro.second.empty()) {
+				result.push_back('=');
+				pushString(result, macro.second);
+			}
 			result.push_back('\n');
 		}
 	}
@@ -109,10 +115,24 @@ static std::vector<char> spirv2glsl(const std::string &name, const ShaderMacros
 }
 
 
-static GLuint createShader(GLenum type, const std::string &name, const ShaderMacros &macros, spirv_cross::CompilerGLSL &glsl) {
-	assert(type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER);
+// SPIRV-Cross doesn't know the view count of the render pass
+// every vertex shader drawing into a multiview framebuffer needs it
+static void addMultiviewLayout(std::vector<char> &src, unsigned int views) {
+	static const char versionStr[] = "#version";
+	auto it = std::search(src.begin(), src.end(), versionStr, versionStr + sizeof(versionStr) - 1);
+	assert(it != src.end());
+	it = std::find(it, src.end(), '\n');
+	assert(it != src.end());
+
+	std::string layout = "\n#extension GL_OVR_multiview2 : require\nlayout(num_views = " + std::to_string(views) + ") in;";
+	src.insert(it, layout.begin(), layout.end());
+}
 
-	std::vector<char> src = spirv2glsl(name, macros, glsl);
+
+// status is checked by checkShader after the program has been linked
+// so the driver can compile all stages in parallel
+static GLuint startShader(GLenum type, const std::vector<char> &src) {
+	assert(type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER || type == GL_COMPUTE_SHADER);
 
 	const char *sourcePointer = &src[0];
 	GLint sourceLen = src.size();
@@ -121,7 +141,11 @@ static GLuint createShader(GLenum type, const std::string &name, const ShaderMac
 	glShaderSource(shader, 1, &sourcePointer, &sourceLen);
 	glCompileShader(shader);
 
-	// TODO: defer checking to enable multithreaded shader compile
+	return shader;
+}
+
+
+static bool checkShader(GLuint shader, const std::string &name) {
 	GLint status = 0;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
 
@@ -138,12 +162,7 @@ static GLuint createShader(GLenum type, const std::string &name, const ShaderMac
 		}
 	}
 
-	if (status != GL_TRUE) {
-		glDeleteShader(shader);
-		throw std::runtime_error("shader compile failed");
-	}
-
-	return shader;
+	return (status == GL_TRUE);
 }
 
 
@@ -171,6 +190,57 @@ static GLenum blendFunc(BlendFunc b) {
 }
 
 
+static GLenum depthFunc(DepthFunc f) {
+	switch (f) {
+	case DepthFunc::Less:
+		return GL_LESS;
+
+	case DepthFunc::Equal:
+		return GL_EQUAL;
+
+	}
+
+	UNREACHABLE();
+	return GL_NONE;
+}
+
+
+static GLenum stencilFunc(StencilFunc f) {
+	switch (f) {
+	case StencilFunc::Always:
+		return GL_ALWAYS;
+
+	case StencilFunc::Equal:
+		return GL_EQUAL;
+
+	case StencilFunc::NotEqual:
+		return GL_NOTEQUAL;
+
+	}
+
+	UNREACHABLE();
+	return GL_NONE;
+}
+
+
+static GLenum stencilOp(StencilOp o) {
+	switch (o) {
+	case StencilOp::Keep:
+		return GL_KEEP;
+
+	case StencilOp::Zero:
+		return GL_ZERO;
+
+	case StencilOp::Replace:
+		return GL_REPLACE;
+
+	}
+
+	UNREACHABLE();
+	return GL_NONE;
+}
+
+
 static GLenum glTexFormat(Format format) {
 	switch (format) {
 	case Format::Invalid:
@@ -200,6 +270,9 @@ static GLenum glTexFormat(Format format) {
 	case Format::RGBA32Float:
 		return GL_RGBA32F;
 
+	case Format::RG11B10Float:
+		return GL_R11F_G11F_B10F;
+
 	case Format::Depth16:
 		return GL_DEPTH_COMPONENT16;
 
@@ -215,6 +288,42 @@ static GLenum glTexFormat(Format format) {
 	case Format::Depth32Float:
 		return GL_DEPTH_COMPONENT32F;
 
+	case Format::BC1RGBA:
+		return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+
+	case Format::sBC1RGBA:
+		return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+
+	case Format::BC3RGBA:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+	case Format::sBC3RGBA:
+		return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+
+	case Format::BC7RGBA:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+	case Format::sBC7RGBA:
+		return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+
+	case Format::ETC2RGB8:
+		return GL_COMPRESSED_RGB8_ETC2;
+
+	case Format::sETC2RGB8:
+		return GL_COMPRESSED_SRGB8_ETC2;
+
+	case Format::ETC2RGBA8:
+		return GL_COMPRESSED_RGBA8_ETC2_EAC;
+
+	case Format::sETC2RGBA8:
+		return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+
+	case Format::ASTC4x4:
+		return GL_COMPRESSED_RGBA_ASTC_4x4_KHR;
+
+	case Format::sASTC4x4:
+		return GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR;
+
 	}
 
 	UNREACHABLE();
@@ -244,6 +353,9 @@ static GLenum glTexBaseFormat(Format format) {
 	case Format::sRGBA8:
 		return GL_RGBA;
 
+	case Format::RG11B10Float:
+		return GL_RGB;
+
 	case Format::Depth16:
 		// not supposed to use this format here
 		assert(false);
@@ -269,6 +381,72 @@ static GLenum glTexBaseFormat(Format format) {
 		assert(false);
 		return GL_NONE;
 
+	case Format::BC1RGBA:
+	case Format::sBC1RGBA:
+	case Format::BC3RGBA:
+	case Format::sBC3RGBA:
+	case Format::BC7RGBA:
+	case Format::sBC7RGBA:
+	case Format::ETC2RGB8:
+	case Format::sETC2RGB8:
+	case Format::ETC2RGBA8:
+	case Format::sETC2RGBA8:
+	case Format::ASTC4x4:
+	case Format::sASTC4x4:
+		// compressed uploads use the internal format
+		assert(false);
+		return GL_NONE;
+
+	}
+
+	UNREACHABLE();
+}
+
+
+// pixel type for reading back uncompressed color formats
+static GLenum glTexType(Format format) {
+	switch (format) {
+	case Format::Invalid:
+		UNREACHABLE();
+
+	case Format::R8:
+	case Format::RG8:
+	case Format::RGB8:
+	case Format::RGBA8:
+	case Format::sRGBA8:
+		return GL_UNSIGNED_BYTE;
+
+	case Format::RG16Float:
+	case Format::RGBA16Float:
+		return GL_HALF_FLOAT;
+
+	case Format::RGBA32Float:
+		return GL_FLOAT;
+
+	case Format::RG11B10Float:
+		return GL_UNSIGNED_INT_10F_11F_11F_REV;
+
+	case Format::Depth16:
+	case Format::Depth16S8:
+	case Format::Depth24S8:
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+	case Format::BC1RGBA:
+	case Format::sBC1RGBA:
+	case Format::BC3RGBA:
+	case Format::sBC3RGBA:
+	case Format::BC7RGBA:
+	case Format::sBC7RGBA:
+	case Format::ETC2RGB8:
+	case Format::sETC2RGB8:
+	case Format::ETC2RGBA8:
+	case Format::sETC2RGBA8:
+	case Format::ASTC4x4:
+	case Format::sASTC4x4:
+		// not supposed to use this format here
+		assert(false);
+		return GL_NONE;
+
 	}
 
 	UNREACHABLE();
@@ -454,17 +632,28 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 : RendererBase(desc)
 , window(nullptr)
 , context(nullptr)
-, ringBuffer(0)
-, persistentMapInUse(false)
-, persistentMapping(nullptr)
+, ringBufferMode(RingBufferMode::Persistent)
+, multiBind(false)
 , decriptorSetsDirty(true)
+, pushConstantBuffer(0)
+, programBinaries(false)
+, programCacheDirty(false)
+, programCacheSeed(0)
+, parallelShaderCompile(false)
 , debug(desc.debug)
 , tracing(desc.tracing)
+, pipelineStatistics(false)
 , vao(0)
 , idxBuf16Bit(false)
 , indexBufByteOffset(0)
 {
 
+	if (offscreen) {
+		// SDL's offscreen driver puts the context on an EGL pbuffer
+		// so no display server is needed
+		SDL_setenv("SDL_VIDEODRIVER", "offscreen", 1);
+	}
+
 	// TODO: check return value
 	SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO);
 
@@ -516,7 +705,18 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
 	}
 
-	window = SDL_CreateWindow(desc.applicationName.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, desc.swapchain.width, desc.swapchain.height, flags);
+	int windowWidth  = desc.swapchain.width;
+	int windowHeight = desc.swapchain.height;
+	if (offscreen) {
+		// the window only holds the context, frames end in our own rendertargets
+		// so keep the pbuffer small regardless of the rendering size
+		flags        = SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN;
+		windowWidth  = 1;
+		windowHeight = 1;
+		LOG("Offscreen rendering at %ux%u\n", desc.swapchain.width, desc.swapchain.height);
+	}
+
+	window = SDL_CreateWindow(desc.applicationName.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowWidth, windowHeight, flags);
 
 	if (!window) {
 		LOG("SDL_CreateWindow failed: %s\n", SDL_GetError());
@@ -578,6 +778,61 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		LOG("Shader storage buffer not supported\n");
 	}
 
+	if (GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_image_load_store && features.SSBOSupported)) {
+		features.computeShaders = true;
+		LOG("Compute shaders supported\n");
+	} else {
+		features.computeShaders = false;
+		LOG("Compute shaders not supported\n");
+	}
+
+	if (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) {
+		LOG("Multi-draw indirect supported\n");
+		features.multiDrawIndirect = true;
+	} else {
+		LOG("Multi-draw indirect not supported\n");
+		features.multiDrawIndirect = false;
+	}
+
+	if (desc.pipelineStatistics) {
+		// the bundled GLEW predates 4.6 and 4.6 drivers still advertise the extension
+		pipelineStatistics = GLEW_ARB_pipeline_statistics_query;
+		LOG("Pipeline statistics %s\n", pipelineStatistics ? "enabled" : "not supported");
+	}
+
+	if (GLEW_VERSION_4_4 || GLEW_ARB_multi_bind) {
+		LOG("Multi-bind supported\n");
+		multiBind = true;
+	} else {
+		LOG("Multi-bind not supported\n");
+		multiBind = false;
+	}
+
+	if (GLEW_OVR_multiview2) {
+		GLint maxViews = 1;
+		glGetIntegerv(GL_MAX_VIEWS_OVR, &maxViews);
+		features.maxMultiviewViews = std::max(maxViews, 1);
+		LOG("Multiview supported, max %u views\n", features.maxMultiviewViews);
+	} else {
+		LOG("Multiview not supported\n");
+		features.maxMultiviewViews = 1;
+	}
+
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+		GLint numFormats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		programBinaries = (numFormats > 0);
+	}
+	LOG("Program binaries %ssupported\n", programBinaries ? "" : "not ");
+
+	// KHR_parallel_shader_compile has the same tokens, GLEW only knows the ARB one
+	if (GLEW_ARB_parallel_shader_compile) {
+		// let the driver pick the number of threads
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFFU);
+		parallelShaderCompile = true;
+	}
+	LOG("Parallel shader compile %ssupported\n", parallelShaderCompile ? "" : "not ");
+
 	if (!GLEW_ARB_direct_state_access) {
 		LOG("ARB_direct_state_access not found\n");
 		throw std::runtime_error("ARB_direct_state_access not found");
@@ -623,6 +878,17 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	LOG("GL version: \"%s\"\n", glGetString(GL_VERSION));
 	LOG("GLSL version: \"%s\"\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 
+	// binaries are only valid for the driver which created them
+	{
+		std::string driver = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+		driver += reinterpret_cast<const char *>(glGetString(GL_VERSION));
+		programCacheSeed = XXH64(driver.data(), driver.size(), 0);
+	}
+
+	if (programBinaries && !skipShaderCache) {
+		loadProgramCache();
+	}
+
 	LOG("Interesting GL values:\n");
 	glValues.reserve(sizeof(interestingValues) / sizeof(interestingValues[0]));
 	for (const auto &v : interestingValues) {
@@ -643,65 +909,46 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	glCreateVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
+	pushConstantData.fill(0);
+	glCreateBuffers(1, &pushConstantBuffer);
+	glNamedBufferStorage(pushConstantBuffer, MAX_PUSH_CONSTANT_SIZE, pushConstantData.data(), GL_DYNAMIC_STORAGE_BIT);
+
 	if (!recreateSwapchain()) {
 		LOG("initial swapchain create failed\n");
 		throw std::runtime_error("initial swapchain create failed");
 	}
 
-	recreateRingBuffer(desc.ephemeralRingBufSize);
+	// if tracing is on, disable persistent buffer because apitrace can't trace it
+	// map each allocation instead, the frame fences already keep us
+	// from overwriting data the GPU still uses
+	ringBufferMode = tracing ? RingBufferMode::Unsynchronized : RingBufferMode::Persistent;
 
 	// swap once to get better traces
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-	SDL_GL_SwapWindow(window);
+	if (!offscreen) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		SDL_GL_SwapWindow(window);
+	}
 }
 
 
-void RendererImpl::recreateRingBuffer(unsigned int newSize) {
-	assert(newSize > 0);
-
-	// if buffer already exists, free it after it's no longer in use
-	if (ringBuffer) {
-		assert(ringBufSize       != 0);
-
-		if (persistentMapInUse) {
-			glUnmapNamedBuffer(ringBuffer);
-			persistentMapping = nullptr;
-		}
-
-		auto result = buffers.add();
-		frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
-
-		Buffer &buffer = result.first;
-
-		buffer.buffer          = ringBuffer;
-		ringBuffer             = 0;
+void RendererImpl::createRingPage(unsigned int idx, unsigned int size) {
+	assert(size > 0);
 
-		buffer.ringBufferAlloc = false;
-		buffer.offset          = 0;
-
-		buffer.type            = BufferType::Everything;
-
-		buffer.size            = ringBufSize;
-		ringBufSize            = 0;
-
-		ringBufPtr             = 0;
-	}
+	auto &page = ringPages.at(idx);
+	assert(page.size   == 0);
+	assert(page.buffer == 0);
+	assert(page.mapping == nullptr);
 
-	// set up ring buffer
-	glCreateBuffers(1, &ringBuffer);
+	glCreateBuffers(1, &page.buffer);
 	// TODO: proper error checking
-	assert(ringBuffer != 0);
-	assert(ringBufSize               == 0);
-	assert(ringBufPtr                == 0);
-	assert(persistentMapping         == nullptr);
-	unsigned int bufferFlags = 0;
-	// if tracing is on, disable persistent buffer because apitrace can't trace it
-	persistentMapInUse = !tracing;
-	ringBufSize        = newSize;
+	assert(page.buffer != 0);
+	page.size = size;
 
-	if (!persistentMapInUse) {
-		// need GL_DYNAMIC_STORAGE_BIT since we intend to glBufferSubData it
+	unsigned int bufferFlags = 0;
+	if (ringBufferMode != RingBufferMode::Persistent) {
+		// need GL_DYNAMIC_STORAGE_BIT in case mapping fails and we fall back to glBufferSubData
 		bufferFlags |= GL_DYNAMIC_STORAGE_BIT;
+		bufferFlags |= GL_MAP_WRITE_BIT;
 	} else {
 		// TODO: do we need GL_DYNAMIC_STORAGE_BIT?
 		// spec seems to say only for glBufferSubData, not persistent mapping
@@ -715,15 +962,66 @@ void RendererImpl::recreateRingBuffer(unsigned int newSize) {
 		bufferFlags |= GL_MAP_READ_BIT;
 	}
 
-	glNamedBufferStorage(ringBuffer, ringBufSize, nullptr, bufferFlags);
-	if (persistentMapInUse) {
-		persistentMapping = reinterpret_cast<char *>(glMapNamedBufferRange(ringBuffer, 0, ringBufSize, bufferFlags));
+	glNamedBufferStorage(page.buffer, size, nullptr, bufferFlags);
+	if (ringBufferMode == RingBufferMode::Persistent) {
+		page.mapping = reinterpret_cast<char *>(glMapNamedBufferRange(page.buffer, 0, size, bufferFlags));
+		assert(page.mapping != nullptr);
+	}
+
+	if (tracing) {
+		std::string name = "Ring buffer page " + std::to_string(idx);
+		glObjectLabel(GL_BUFFER, page.buffer, name.size(), name.c_str());
+	}
+}
+
+
+void RendererImpl::destroyRingPage(unsigned int idx) {
+	auto &page = ringPages.at(idx);
+	assert(page.size   != 0);
+	assert(page.buffer != 0);
+	assert(page.users  == 0);
+
+	if (page.mapping) {
+		glUnmapNamedBuffer(page.buffer);
+		page.mapping = nullptr;
 	}
+
+	glState.invalidateBindings();
+	glDeleteBuffers(1, &page.buffer);
+	page.buffer = 0;
+	page.size   = 0;
+}
+
+
+std::vector<DeviceInfo> RendererImpl::listDevices() {
+	// GL can't choose, the context goes wherever the window system puts it
+	std::vector<DeviceInfo> devices(1);
+	devices[0].name = "OpenGL default device";
+	devices[0].type = "other";
+	return devices;
 }
 
 
 RendererImpl::~RendererImpl() {
-	assert(ringBuffer != 0);
+
+	if (programBinaries && !skipShaderCache) {
+		saveProgramCache();
+	}
+
+	// precompiled but never used
+	for (auto &p : startedPipelines) {
+		for (GLuint shader : p.second.program.shaders) {
+			glDeleteShader(shader);
+		}
+		glDeleteProgram(p.second.program.program);
+	}
+	startedPipelines.clear();
+	precompileQueue.clear();
+
+	// nothing is left to receive these
+	for (auto &r : pendingReadbacks) {
+		r.callback = ReadbackCallback();
+	}
 
 	// wait for all pending frames to finish
 	while (!waitForDeviceIdle()) {
@@ -739,16 +1037,24 @@ RendererImpl::~RendererImpl() {
 	}
 	frames.clear();
 
+	// every frame has synced so these were all finished
+	assert(pendingReadbacks.empty());
 
-	if (persistentMapInUse) {
-		glUnmapNamedBuffer(ringBuffer);
-		persistentMapping = nullptr;
-	} else {
-		assert(persistentMapping == nullptr);
+	for (auto &upload : uploadBuffers) {
+		destroyUploadBuffer(upload);
 	}
-
-	glDeleteBuffers(1, &ringBuffer);
-	ringBuffer = 0;
+	uploadBuffers.clear();
+
+	currentRingPage = invalidRingPage;
+	freeRingPages.clear();
+	for (unsigned int i = 0; i < ringPages.size(); i++) {
+		auto &page = ringPages[i];
+		if (page.size != 0) {
+			page.users = 0;
+			destroyRingPage(i);
+		}
+	}
+	ringPages.clear();
 
 	framebuffers.clearWith([](Framebuffer &fb) {
 		assert(fb.fbo != 0);
@@ -793,8 +1099,11 @@ RendererImpl::~RendererImpl() {
 	} );
 
 
-	pipelines.clearWith([](Pipeline &p) {
+	pipelines.clearWith([this](Pipeline &p) {
 		assert(p.shader != 0);
+		if (glState.program.is(p.shader)) {
+			glState.program.invalidate();
+		}
 		glDeleteProgram(p.shader);
 		p.shader = 0;
 	} );
@@ -823,6 +1132,9 @@ RendererImpl::~RendererImpl() {
 		sampler.sampler = 0;
 	} );
 
+	glDeleteBuffers(1, &pushConstantBuffer);
+	pushConstantBuffer = 0;
+
 	glBindVertexArray(0);
 	glDeleteVertexArrays(1, &vao);
 
@@ -861,12 +1173,48 @@ bool RendererImpl::isRenderTargetFormatSupported(Format format) const {
 }
 
 
-BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const void *contents) {
-	assert(type != +BufferType::Invalid);
-	assert(size != 0);
-	assert(contents != nullptr);
+bool RendererImpl::isTextureFormatSupported(Format format) const {
+	GLenum target         = GL_TEXTURE_2D;
+	GLenum internalFormat = glTexFormat(format);
+	int params            = 0;
+
+	glGetInternalformativ(target, internalFormat, GL_INTERNALFORMAT_SUPPORTED, sizeof(int), &params);
+	if (params == GL_FALSE) {
+		return false;
+	}
+
+	// drivers report ASTC and ETC2 as supported and then decompress them in software
+	// that defeats the point so require full support
+	params = 0;
+	glGetInternalformativ(target, internalFormat, GL_FRAGMENT_TEXTURE, sizeof(int), &params);
+	if (params != GL_FULL_SUPPORT) {
+		return false;
+	}
+
+	return true;
+}
+
+
+BufferHandle RendererImpl::createBuffer(const BufferDesc &desc) {
+	assert(desc.type_ != +BufferType::Invalid);
+	assert(desc.size_ != 0);
+	assert(desc.contents_ != nullptr || desc.usage_ != +BufferUsage::Static);
 
 	unsigned int bufferFlags = 0;
+	switch (desc.usage_) {
+	case BufferUsage::Static:
+		break;
+
+	case BufferUsage::Dynamic:
+		bufferFlags |= GL_DYNAMIC_STORAGE_BIT;
+		break;
+
+	case BufferUsage::Streaming:
+		// hint to keep it in system memory like the ring buffer
+		bufferFlags |= GL_DYNAMIC_STORAGE_BIT | GL_CLIENT_STORAGE_BIT;
+		break;
+	}
+
 	if (tracing) {
 		bufferFlags |= GL_MAP_READ_BIT;
 	}
@@ -874,11 +1222,15 @@ BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const vo
 	auto result    = buffers.add();
 	Buffer &buffer = result.first;
 	glCreateBuffers(1, &buffer.buffer);
-	glNamedBufferStorage(buffer.buffer, size, contents, bufferFlags);
-	buffer.ringBufferAlloc = false;
+	glNamedBufferStorage(buffer.buffer, desc.size_, desc.contents_, bufferFlags);
 	buffer.offset          = 0;
-	buffer.size            = size;
-	buffer.type            = type;
+	buffer.size            = desc.size_;
+	buffer.type            = desc.type_;
+	buffer.usage           = desc.usage_;
+
+	if (tracing && !desc.name_.empty()) {
+		glObjectLabel(GL_BUFFER, buffer.buffer, desc.name_.size(), desc.name_.c_str());
+	}
 
 	return result.second;
 }
@@ -891,25 +1243,119 @@ BufferHandle RendererImpl::createEphemeralBuffer(BufferType type, uint32_t size,
 
 	// TODO: use appropriate alignment
 	// TODO: need buffer usage flags for that
-	unsigned int beginPtr = ringBufferAllocate(size, std::max(uboAlign, ssboAlign));
+	unsigned int pageIdx  = 0;
+	unsigned int beginPtr = ringBufferAllocate(size, std::max(uboAlign, ssboAlign), pageIdx);
 
-	if (persistentMapInUse) {
-		memcpy(persistentMapping + beginPtr, contents, size);
-	} else {
-		glNamedBufferSubData(ringBuffer, beginPtr, size, contents);
+	const auto &page = ringPages[pageIdx];
+
+	switch (ringBufferMode) {
+	case RingBufferMode::Persistent:
+		streamingCopy(page.mapping + beginPtr, contents, size);
+		break;
+
+	case RingBufferMode::Unsynchronized: {
+		void *ptr = glMapNamedBufferRange(page.buffer, beginPtr, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (ptr) {
+			memcpy(ptr, contents, size);
+			glUnmapNamedBuffer(page.buffer);
+			break;
+		}
+
+		LOG("Unsynchronized ring buffer mapping failed, falling back to glNamedBufferSubData\n");
+		ringBufferMode = RingBufferMode::SubData;
 	}
+		// fallthrough
 
-	auto result    = buffers.add();
-	Buffer &buffer = result.first;
-	buffer.buffer          = ringBuffer;
-	buffer.ringBufferAlloc = true;
-	buffer.offset          = beginPtr;
-	buffer.size            = size;
-	buffer.type            = type;
+	case RingBufferMode::SubData:
+		glNamedBufferSubData(page.buffer, beginPtr, size, contents);
+		break;
+	}
 
-	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
+	return EphemeralBuffer(pageIdx, beginPtr, size, type).handle();
+}
 
-	return result.second;
+
+EphemeralAllocation RendererImpl::allocateEphemeral(BufferType type, uint32_t size) {
+	assert(type != +BufferType::Invalid);
+	assert(size != 0);
+
+	unsigned int pageIdx  = 0;
+	unsigned int beginPtr = ringBufferAllocate(size, std::max(uboAlign, ssboAlign), pageIdx);
+
+	EphemeralAllocation result;
+	result.buffer = EphemeralBuffer(pageIdx, beginPtr, size, type).handle();
+
+	if (ringBufferMode == RingBufferMode::Persistent) {
+		result.contents = ringPages[pageIdx].mapping + beginPtr;
+		return result;
+	}
+
+	// no mapping to hand out, the caller writes to the frame's arena instead
+	// and the data is uploaded the first time the buffer is used
+	auto &frame = frames.at(currentFrameIdx);
+	char *ptr = reinterpret_cast<char *>(frame.arena.allocate(size, 16));
+
+	PendingEphemeralWrite w;
+	w.page     = pageIdx;
+	w.offset   = beginPtr;
+	w.size     = size;
+	w.contents = ptr;
+	pendingEphemeralWrites.push_back(w);
+
+	result.contents = ptr;
+	return result;
+}
+
+
+void RendererImpl::flushEphemeralWrites() {
+	for (const auto &w : pendingEphemeralWrites) {
+		glNamedBufferSubData(ringPages.at(w.page).buffer, w.offset, w.size, w.contents);
+	}
+	pendingEphemeralWrites.clear();
+}
+
+
+ResolvedBuffer RendererImpl::resolveBuffer(BufferHandle handle) {
+	if (EphemeralBuffer::isEphemeral(handle)) {
+		if (!pendingEphemeralWrites.empty()) {
+			flushEphemeralWrites();
+		}
+
+		EphemeralBuffer e(handle);
+		// ring buffer page, lives until the frame retires
+		const auto &page = ringPages.at(e.page);
+		assert(page.users > 0);
+		assert(page.buffer != 0);
+		assert(e.offset + e.size <= page.size);
+		return ResolvedBuffer(page.buffer, e.offset, e.size, e.type);
+	}
+
+	const Buffer &buffer = buffers.get(handle);
+	assert(buffer.buffer != 0);
+	assert(buffer.offset == 0);
+	return ResolvedBuffer(buffer.buffer, buffer.offset, buffer.size, buffer.type);
+}
+
+
+void RendererImpl::precompileShaders(const PipelineDesc &desc) {
+	assert(!desc.vertexShaderName.empty());
+	assert(!desc.fragmentShaderName.empty());
+
+	compileSpirvAsync(desc.vertexShaderName   + ".vert", desc.shaderMacros_, ShaderKind::Vertex);
+	compileSpirvAsync(desc.fragmentShaderName + ".frag", desc.shaderMacros_, ShaderKind::Fragment);
+
+	// the driver can compile the program on its own threads once the SPIR-V is done
+	// started programs aren't reloaded so not with hot reload
+	if (parallelShaderCompile && !shaderHotReload) {
+		precompileQueue.push_back(desc);
+	}
+}
+
+
+void RendererImpl::precompileShaders(const ComputePipelineDesc &desc) {
+	assert(!desc.computeShaderName.empty());
+
+	compileSpirvAsync(desc.computeShaderName + ".comp", desc.shaderMacros_, ShaderKind::Compute);
 }
 
 
@@ -968,9 +1414,71 @@ struct ResourceInfo {
 typedef HashMap<DSIndex, ResourceInfo> ResourceMap;
 
 
-static void processShaderResources(ShaderResources &shaderResources, const ResourceMap& dsResources, spirv_cross::CompilerGLSL &glsl) {
-	shaderResources.uboSizes.resize(shaderResources.ubos.size(), 0);
-
+static void buildResourceMap(const ResourceContainer<DescriptorSetLayout> &dsLayouts, const std::array<DSLayoutHandle, MAX_DESCRIPTOR_SETS> &layouts, ResourceMap &dsResources, ShaderResources &shaderResources) {
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		if (layouts[i]) {
+			const auto &layoutDesc = dsLayouts.get(layouts[i]).descriptors;
+			for (unsigned int binding = 0; binding < layoutDesc.size(); binding++) {
+				DSIndex idx;
+				idx.set     = i;
+				idx.binding = binding;
+				uint32_t glIndex = 0xFFFFFFFFU;
+
+				auto type = layoutDesc.at(binding).type;
+				switch (type) {
+				case DescriptorType::UniformBuffer:
+				case DescriptorType::UniformBufferDynamic:
+					glIndex = shaderResources.ubos.size();
+					shaderResources.ubos.push_back(idx);
+					break;
+
+				case DescriptorType::StorageBuffer:
+				case DescriptorType::StorageBufferDynamic:
+					glIndex = shaderResources.ssbos.size();
+					shaderResources.ssbos.push_back(idx);
+					break;
+
+				case DescriptorType::Sampler:
+				case DescriptorType::Texture:
+                    // gets assigned later after spirv-cross has built combined samplers
+					break;
+
+				case DescriptorType::StorageImage:
+					glIndex = shaderResources.images.size();
+					shaderResources.images.push_back(idx);
+					break;
+
+				case DescriptorType::CombinedSampler:
+					glIndex         = shaderResources.textures.size();
+					assert(glIndex == shaderResources.samplers.size());
+
+					shaderResources.textures.push_back(idx);
+					shaderResources.samplers.push_back(idx);
+					break;
+
+				case DescriptorType::Empty:
+					// not in the map so shaders using it fail to find it
+					continue;
+
+				case DescriptorType::TextureTable:
+					// createDescriptorSetLayout doesn't allow it
+					UNREACHABLE();
+
+				case DescriptorType::End:
+					assert(false);
+					break;
+				}
+
+				dsResources.emplace(idx, ResourceInfo(type, glIndex));
+			}
+		}
+	}
+}
+
+
+static void processShaderResources(ShaderResources &shaderResources, const ResourceMap& dsResources, uint32_t pushConstantSize, spirv_cross::CompilerGLSL &glsl) {
+	shaderResources.uboSizes.resize(shaderResources.ubos.size(), 0);
+
 	// TODO: only in debug mode
 	HashSet<DSIndex> bindings;
 
@@ -989,24 +1497,35 @@ static void processShaderResources(ShaderResources &shaderResources, const Resou
 			throw std::runtime_error("Duplicate UBO binding");
 		}
 
+		auto ranges = glsl.get_active_buffer_ranges(ubo.id);
+
 		auto it = dsResources.find(idx);
 		if (it == dsResources.end()) {
+			// shared headers declare blocks which not every shader uses
+			// those can sit on an Empty descriptor
+			if (ranges.empty()) {
+				LOG("Unused UBO (%u, %u) not in descriptor sets\n", idx.set, idx.binding);
+				glsl.unset_decoration(ubo.id, spv::DecorationDescriptorSet);
+				glsl.set_decoration(ubo.id, spv::DecorationBinding, 0);
+				continue;
+			}
+
             LOG("UBO (%u, %u) not in descriptor sets\n", idx.set, idx.binding);
 			throw std::runtime_error("UBO not in descriptor sets");
 		}
 
-		assert(it->second.type == +DescriptorType::UniformBuffer);
+		assert(it->second.type == +DescriptorType::UniformBuffer || it->second.type == +DescriptorType::UniformBufferDynamic);
 		unsigned int openglIDX = it->second.glIndex;
 		assert(openglIDX < shaderResources.ubos.size());
 		assert(shaderResources.ubos[openglIDX] == idx);
 
 		uint32_t maxOffset = 0;
-		LOG("UBO %u index %u ranges:\n", static_cast<uint32_t>(ubo.id), openglIDX);
-		for (auto r : glsl.get_active_buffer_ranges(ubo.id)) {
-			LOG("  %u:  %u  %u\n", r.index, static_cast<uint32_t>(r.offset), static_cast<uint32_t>(r.range));
+		LOG_DEBUG("UBO %u index %u ranges:\n", static_cast<uint32_t>(ubo.id), openglIDX);
+		for (auto r : ranges) {
+			LOG_DEBUG("  %u:  %u  %u\n", r.index, static_cast<uint32_t>(r.offset), static_cast<uint32_t>(r.range));
 			maxOffset = std::max(maxOffset, static_cast<uint32_t>(r.offset + r.range));
 		}
-		LOG(" max offset: %u\n", maxOffset);
+		LOG_DEBUG(" max offset: %u\n", maxOffset);
 		shaderResources.uboSizes[openglIDX] = maxOffset;
 
 		// opengl doesn't like set decorations, strip them
@@ -1014,6 +1533,22 @@ static void processShaderResources(ShaderResources &shaderResources, const Resou
 		glsl.set_decoration(ubo.id, spv::DecorationBinding, openglIDX);
 	}
 
+	// emitted as a UBO, see emit_push_constant_as_uniform_buffer
+	for (const auto &pc : spvResources.push_constant_buffers) {
+		uint32_t maxOffset = 0;
+		for (auto r : glsl.get_active_buffer_ranges(pc.id)) {
+			maxOffset = std::max(maxOffset, static_cast<uint32_t>(r.offset + r.range));
+		}
+
+		if (maxOffset > pushConstantSize) {
+			LOG("Push constants use %u bytes but pipeline only has %u\n", maxOffset, pushConstantSize);
+			throw std::runtime_error("Push constants not in pipeline");
+		}
+
+		// unused blocks from shared headers can go anywhere
+		glsl.set_decoration(pc.id, spv::DecorationBinding, (pushConstantSize > 0) ? shaderResources.ubos.size() : 0);
+	}
+
 	for (const auto &ssbo : spvResources.storage_buffers) {
 		DSIndex idx;
 		idx.set     = glsl.get_decoration(ssbo.id, spv::DecorationDescriptorSet);
@@ -1033,7 +1568,7 @@ static void processShaderResources(ShaderResources &shaderResources, const Resou
 			throw std::runtime_error("SSBO not in descriptor sets");
 		}
 
-		assert(it->second.type == +DescriptorType::StorageBuffer);
+		assert(it->second.type == +DescriptorType::StorageBuffer || it->second.type == +DescriptorType::StorageBufferDynamic);
 		unsigned int openglIDX = it->second.glIndex;
 		assert(openglIDX < shaderResources.ssbos.size());
 		assert(shaderResources.ssbos[openglIDX] == idx);
@@ -1074,6 +1609,35 @@ static void processShaderResources(ShaderResources &shaderResources, const Resou
 		glsl.set_decoration(s.id, spv::DecorationBinding, openglIDX);
 	}
 
+	for (const auto &img : spvResources.storage_images) {
+		DSIndex idx;
+		idx.set     = glsl.get_decoration(img.id, spv::DecorationDescriptorSet);
+		idx.binding = glsl.get_decoration(img.id, spv::DecorationBinding);
+
+		// must be the first time we find this (set, binding) combination
+		// if not, there's a bug in the shader
+		auto b = bindings.insert(idx);
+		if (!b.second) {
+			LOG("Duplicate storage image binding (%u, %u)\n", idx.set, idx.binding);
+			throw std::runtime_error("Duplicate storage image binding");
+		}
+
+		auto it = dsResources.find(idx);
+		if (it == dsResources.end()) {
+            LOG("Storage image (%u, %u) not in descriptor sets\n", idx.set, idx.binding);
+			throw std::runtime_error("Storage image not in descriptor sets");
+		}
+
+		assert(it->second.type == +DescriptorType::StorageImage);
+		unsigned int openglIDX = it->second.glIndex;
+		assert(openglIDX < shaderResources.images.size());
+		assert(shaderResources.images[openglIDX] == idx);
+
+		// opengl doesn't like set decorations, strip them
+		glsl.unset_decoration(img.id, spv::DecorationDescriptorSet);
+		glsl.set_decoration(img.id, spv::DecorationBinding, openglIDX);
+	}
+
 	// build combined image samplers
 	// TODO: need to store this info
 	glsl.build_combined_image_samplers();
@@ -1105,98 +1669,190 @@ static void processShaderResources(ShaderResources &shaderResources, const Resou
 }
 
 
-PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
-	assert(!desc.vertexShaderName.empty());
-	assert(!desc.fragmentShaderName.empty());
-	assert(desc.renderPass_);
-	assert(!desc.name_.empty());
+// on-disk program binary cache, all programs in one file:
+//   uint32_t magic, uint32_t count
+//   count times: uint64_t key, uint32_t format, uint32_t length, length bytes of binary
+// driver identity is part of the key so no version is needed
+static const uint32_t programCacheMagic = 0x43504C47;  // "GLPC"
 
-#ifndef NDEBUG
-	const auto &rp = renderPasses.get(desc.renderPass_);
-	assert(desc.numSamples_ == rp.numSamples);
-#endif //  NDEBUG
 
-	auto vshaderHandle = createVertexShader(desc.vertexShaderName, desc.shaderMacros_);
-	const auto &v = vertexShaders.get(vshaderHandle);
-	auto fshaderHandle = createFragmentShader(desc.fragmentShaderName, desc.shaderMacros_);
-	const auto &f = fragmentShaders.get(fshaderHandle);
+// standard texture upload buffers are kept for reuse
+static const unsigned int uploadBufferSize = 4 * 1024 * 1024;
+// offsets of compressed data must be multiples of the block size
+static const unsigned int uploadAlignment  = 16;
 
-	// construct map of descriptor set resources
-	ResourceMap      dsResources;
-	ShaderResources  shaderResources;
-	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
-		if (desc.descriptorSetLayouts[i]) {
-			const auto &layoutDesc = dsLayouts.get(desc.descriptorSetLayouts[i]).descriptors;
-			for (unsigned int binding = 0; binding < layoutDesc.size(); binding++) {
-				DSIndex idx;
-				idx.set     = i;
-				idx.binding = binding;
-				uint32_t glIndex = 0xFFFFFFFFU;
-
-				auto type = layoutDesc.at(binding).type;
-				switch (type) {
-				case DescriptorType::UniformBuffer:
-					glIndex = shaderResources.ubos.size();
-					shaderResources.ubos.push_back(idx);
-					break;
 
-				case DescriptorType::StorageBuffer:
-					glIndex = shaderResources.ssbos.size();
-					shaderResources.ssbos.push_back(idx);
-					break;
+void RendererImpl::loadProgramCache() {
+	std::string cacheName = spirvCacheDir + "glprogram.cache";
+	if (!fileExists(cacheName)) {
+		LOG("No program cache \"%s\"\n", cacheName.c_str());
+		return;
+	}
 
-				case DescriptorType::Sampler:
-				case DescriptorType::Texture:
-                    // gets assigned later after spirv-cross has built combined samplers
-					break;
+	MappedFile data(cacheName);
+	const char *ptr = data.data();
+	const char *end = ptr + data.size();
 
-				case DescriptorType::CombinedSampler:
-					glIndex         = shaderResources.textures.size();
-					assert(glIndex == shaderResources.samplers.size());
+	auto read = [&] (void *dest, size_t size) {
+		if (size_t(end - ptr) < size) {
+			return false;
+		}
+		memcpy(dest, ptr, size);
+		ptr += size;
+		return true;
+	};
+
+	uint32_t magic = 0, count = 0;
+	if (!read(&magic, sizeof(magic)) || !read(&count, sizeof(count))) {
+		LOG("Program cache \"%s\" is truncated\n", cacheName.c_str());
+		return;
+	}
 
-					shaderResources.textures.push_back(idx);
-					shaderResources.samplers.push_back(idx);
-					break;
+	if (magic != programCacheMagic) {
+		LOG("Program cache \"%s\" has bad magic\n", cacheName.c_str());
+		return;
+	}
 
-				case DescriptorType::End:
-					assert(false);
-					break;
-				}
+	programCache.reserve(count);
+	for (unsigned int i = 0; i < count; i++) {
+		uint64_t key    = 0;
+		uint32_t format = 0;
+		uint32_t length = 0;
+		if (!read(&key, sizeof(key)) || !read(&format, sizeof(format)) || !read(&length, sizeof(length))) {
+			LOG("Program cache \"%s\" is truncated\n", cacheName.c_str());
+			break;
+		}
 
-				dsResources.emplace(idx, ResourceInfo(type, glIndex));
-			}
+		ProgramBinary binary;
+		binary.format = format;
+		binary.data.resize(length);
+		if (length == 0 || !read(binary.data.data(), length)) {
+			LOG("Program cache \"%s\" is truncated\n", cacheName.c_str());
+			break;
 		}
+
+		programCache.emplace(key, std::move(binary));
 	}
 
-	GLuint vertexShader = 0;
-	GLuint fragmentShader = 0;
-	{
-		spirv_cross::CompilerGLSL::Options glslOptions;
-		glslOptions.vertex.fixup_clipspace = false;
-		glslOptions.vertex.support_nonzero_base_instance = false;
+	LOG("Loaded %u programs from program cache\n", static_cast<unsigned int>(programCache.size()));
+}
+
 
-		spirv_cross::CompilerGLSL glslVert(v.spirv);
-		glslVert.set_common_options(glslOptions);
-		processShaderResources(shaderResources, dsResources, glslVert);
+void RendererImpl::saveProgramCache() {
+	if (!programCacheDirty) {
+		return;
+	}
 
-		spirv_cross::CompilerGLSL glslFrag(f.spirv);
-		glslFrag.set_common_options(glslOptions);
-		processShaderResources(shaderResources, dsResources, glslFrag);
+	size_t size = 2 * sizeof(uint32_t);
+	for (const auto &p : programCache) {
+		size += sizeof(uint64_t) + 2 * sizeof(uint32_t) + p.second.data.size();
+	}
 
-		vertexShader = createShader(GL_VERTEX_SHADER, v.name, v.macros, glslVert);
-		fragmentShader = createShader(GL_FRAGMENT_SHADER, f.name, f.macros, glslFrag);
+	std::vector<char> data;
+	data.reserve(size);
+	auto write = [&] (const void *src, size_t s) {
+		const char *c = reinterpret_cast<const char *>(src);
+		data.insert(data.end(), c, c + s);
+	};
+
+	uint32_t count = static_cast<uint32_t>(programCache.size());
+	write(&programCacheMagic, sizeof(programCacheMagic));
+	write(&count,             sizeof(count));
+	for (const auto &p : programCache) {
+		uint32_t format = p.second.format;
+		uint32_t length = static_cast<uint32_t>(p.second.data.size());
+		write(&p.first,             sizeof(p.first));
+		write(&format,              sizeof(format));
+		write(&length,              sizeof(length));
+		write(p.second.data.data(), length);
 	}
+	assert(data.size() == size);
+
+	std::string cacheName = spirvCacheDir + "glprogram.cache";
+	LOG("Writing %u programs to program cache \"%s\"\n", count, cacheName.c_str());
+	writeFile(cacheName, data.data(), data.size());
+	programCacheDirty = false;
+}
 
-	// TODO: cache shaders
-	GLuint program = glCreateProgram();
 
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
-	glLinkProgram(program);
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+PendingProgram RendererImpl::startProgram(const std::vector<GLSLStage> &stages) {
+	assert(!stages.empty());
+
+	PendingProgram pending;
+	pending.stages = stages;
+
+	// the GLSL already reflects SPIR-V, macros and descriptor remapping
+	pending.cacheKey = programCacheSeed;
+	for (const auto &stage : stages) {
+		pending.cacheKey = XXH64(stage.source.data(), stage.source.size(), pending.cacheKey);
+	}
+
+	if (programBinaries && !skipShaderCache) {
+		auto it = programCache.find(pending.cacheKey);
+		if (it != programCache.end()) {
+			const auto &binary = it->second;
+			pending.program   = glCreateProgram();
+			pending.fromCache = true;
+			glProgramBinary(pending.program, binary.format, binary.data.data(), binary.data.size());
+			return pending;
+		}
+	}
+
+	pending.shaders.reserve(stages.size());
+	for (const auto &stage : stages) {
+		pending.shaders.push_back(startShader(stage.type, stage.source));
+	}
+
+	pending.program = glCreateProgram();
+	for (GLuint shader : pending.shaders) {
+		glAttachShader(pending.program, shader);
+	}
+	if (programBinaries && !skipShaderCache) {
+		glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(pending.program);
+
+	return pending;
+}
+
+
+GLuint RendererImpl::finishProgram(PendingProgram &pending) {
+	assert(pending.program != 0);
+
+	bool useCache = programBinaries && !skipShaderCache;
+
+	GLuint program = pending.program;
+	pending.program = 0;
 
 	GLint status = 0;
+	if (pending.fromCache) {
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == GL_TRUE) {
+			return program;
+		}
+
+		// driver rejected it, probably after an update
+		LOG("Cached program binary for \"%s\" rejected\n", pending.stages[0].name.c_str());
+		glDeleteProgram(program);
+		programCache.erase(pending.cacheKey);
+		programCacheDirty = true;
+
+		PendingProgram rebuilt = startProgram(pending.stages);
+		assert(!rebuilt.fromCache);
+		return finishProgram(rebuilt);
+	}
+
+	bool compiled = true;
+	for (unsigned int i = 0; i < pending.shaders.size(); i++) {
+		compiled = checkShader(pending.shaders[i], pending.stages[i].name) && compiled;
+		glDeleteShader(pending.shaders[i]);
+	}
+	pending.shaders.clear();
+	if (!compiled) {
+		glDeleteProgram(program);
+		throw std::runtime_error("shader compile failed");
+	}
+
 	glGetProgramiv(program, GL_LINK_STATUS, &status);
 	if (status != GL_TRUE) {
 		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &status);
@@ -1206,7 +1862,157 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 		LOG("info log: %s\n", &infoLog[0]); fflush(stdout);
 		throw std::runtime_error("shader link failed");
 	}
-	glUseProgram(program);
+
+	if (useCache) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length > 0) {
+			ProgramBinary binary;
+			binary.format = GL_NONE;
+			binary.data.resize(length);
+			GLsizei written = 0;
+			glGetProgramBinary(program, length, &written, &binary.format, binary.data.data());
+			binary.data.resize(written);
+			if (written > 0) {
+				programCache[pending.cacheKey] = std::move(binary);
+				programCacheDirty = true;
+			}
+		}
+	}
+
+	return program;
+}
+
+
+GLuint RendererImpl::createProgram(const std::vector<GLSLStage> &stages) {
+	PendingProgram pending = startProgram(stages);
+	return finishProgram(pending);
+}
+
+
+uint64_t RendererImpl::programKey(const PipelineDesc &desc, unsigned int views) {
+	// everything the GLSL of a pipeline depends on
+	uint64_t h = XXH64(desc.vertexShaderName.data(), desc.vertexShaderName.size(), views);
+	h = XXH64(desc.fragmentShaderName.data(), desc.fragmentShaderName.size(), h);
+
+	uint64_t macroHash = desc.shaderMacros_.hashValue();
+	h = XXH64(&macroHash,                   sizeof(macroHash),                                 h);
+	h = XXH64(&desc.specConstantMask,       sizeof(desc.specConstantMask),                     h);
+	h = XXH64(desc.specConstants_.data(),   desc.specConstants_.size() * sizeof(uint32_t),     h);
+	h = XXH64(&desc.descriptorSetLayouts,   sizeof(desc.descriptorSetLayouts),                 h);
+	h = XXH64(&desc.pushConstantSize_,      sizeof(desc.pushConstantSize_),                    h);
+
+	return h;
+}
+
+
+std::vector<GLSLStage> RendererImpl::pipelineStages(const PipelineDesc &desc, unsigned int views, ShaderResources &shaderResources, PipelineStats &pipelineStats) {
+	uint64_t shaderStart = now();
+	auto vshaderHandle = createVertexShader(desc.vertexShaderName, desc.shaderMacros_);
+	const auto &v = vertexShaders.get(vshaderHandle);
+	auto fshaderHandle = createFragmentShader(desc.fragmentShaderName, desc.shaderMacros_);
+	const auto &f = fragmentShaders.get(fshaderHandle);
+	pipelineStats.shaderTime = now() - shaderStart;
+
+	// construct map of descriptor set resources
+	ResourceMap      dsResources;
+	buildResourceMap(dsLayouts, desc.descriptorSetLayouts, dsResources, shaderResources);
+
+	uint64_t crossStart = now();
+	std::vector<GLSLStage> stages;
+	stages.reserve(2);
+
+	spirv_cross::CompilerGLSL::Options glslOptions;
+	glslOptions.vertex.fixup_clipspace = false;
+	glslOptions.vertex.support_nonzero_base_instance = false;
+	glslOptions.emit_push_constant_as_uniform_buffer = true;
+
+	spirv_cross::CompilerGLSL glslVert(v.spirv);
+	glslVert.set_common_options(glslOptions);
+	processShaderResources(shaderResources, dsResources, desc.pushConstantSize_, glslVert);
+	applySpecConstants(glslVert, desc.specConstants_, desc.specConstantMask);
+
+	spirv_cross::CompilerGLSL glslFrag(f.spirv);
+	glslFrag.set_common_options(glslOptions);
+	processShaderResources(shaderResources, dsResources, desc.pushConstantSize_, glslFrag);
+	applySpecConstants(glslFrag, desc.specConstants_, desc.specConstantMask);
+
+	stages.push_back(GLSLStage { GL_VERTEX_SHADER,   v.name, spirv2glsl(v.name, v.macros, glslVert) });
+	stages.push_back(GLSLStage { GL_FRAGMENT_SHADER, f.name, spirv2glsl(f.name, f.macros, glslFrag) });
+
+	if (views > 1) {
+		addMultiviewLayout(stages[0].source, views);
+	}
+	pipelineStats.crossTime = now() - crossStart;
+
+	return stages;
+}
+
+
+void RendererImpl::startPrecompiledPrograms() {
+	// only takes the ones whose SPIR-V is ready so this never waits
+	auto it = precompileQueue.begin();
+	while (it != precompileQueue.end()) {
+		const PipelineDesc &desc = *it;
+		if (!isSpirvReady(desc.vertexShaderName + ".vert", desc.shaderMacros_)
+		 || !isSpirvReady(desc.fragmentShaderName + ".frag", desc.shaderMacros_)) {
+			++it;
+			continue;
+		}
+
+		// precompiled descs have no render pass, multiview pipelines don't match
+		uint64_t key = programKey(desc, 1);
+		if (startedPipelines.find(key) == startedPipelines.end()) {
+			StartedPipeline started;
+			PipelineStats   unused;
+			auto stages       = pipelineStages(desc, 1, started.resources, unused);
+			started.program   = startProgram(stages);
+			startedPipelines.emplace(key, std::move(started));
+		}
+
+		it = precompileQueue.erase(it);
+	}
+}
+
+
+PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	assert(!desc.vertexShaderName.empty());
+	assert(!desc.fragmentShaderName.empty());
+	assert(desc.renderPass_);
+	assert(!desc.name_.empty());
+
+#ifndef NDEBUG
+	const auto &rp = renderPasses.get(desc.renderPass_);
+	assert(desc.numSamples_ == rp.numSamples);
+#endif //  NDEBUG
+
+	PipelineStats pipelineStats;
+	pipelineStats.name   = desc.name_;
+	pipelineStats.macros = shaderMacrosString(desc.shaderMacros_);
+
+	const unsigned int views = renderPasses.get(desc.renderPass_).desc.views_;
+
+	// precompileShaders might have started it already
+	ShaderResources  shaderResources;
+	PendingProgram   pending;
+	uint64_t         driverStart;
+	auto startedIt = startedPipelines.find(programKey(desc, views));
+	if (startedIt != startedPipelines.end()) {
+		pending         = std::move(startedIt->second.program);
+		shaderResources = std::move(startedIt->second.resources);
+		startedPipelines.erase(startedIt);
+		driverStart     = now();
+	} else {
+		auto stages = pipelineStages(desc, views, shaderResources, pipelineStats);
+		driverStart = now();
+		pending     = startProgram(stages);
+	}
+
+	// only blocks if the driver hasn't finished it yet
+	GLuint program = finishProgram(pending);
+	pipelineStats.driverTime = now() - driverStart;
+	addPipelineStats(pipelineStats);
+	useProgram(program);
 
 	auto result = pipelines.add();
 	Pipeline &pipeline = result.first;
@@ -1224,6 +2030,62 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 }
 
 
+PipelineHandle RendererImpl::createComputePipeline(const ComputePipelineDesc &desc) {
+	assert(!desc.computeShaderName.empty());
+	assert(!desc.name_.empty());
+	assert(features.computeShaders);
+
+	PipelineStats pipelineStats;
+	pipelineStats.name   = desc.name_;
+	pipelineStats.macros = shaderMacrosString(desc.shaderMacros_);
+
+	std::string computeShaderName = desc.computeShaderName + ".comp";
+	uint64_t shaderStart = now();
+	std::vector<uint32_t> spirv = compileSpirv(computeShaderName, desc.shaderMacros_, ShaderKind::Compute);
+	pipelineStats.shaderTime = now() - shaderStart;
+
+	ResourceMap      dsResources;
+	ShaderResources  shaderResources;
+	buildResourceMap(dsLayouts, desc.descriptorSetLayouts, dsResources, shaderResources);
+
+	uint64_t crossStart = now();
+	std::vector<GLSLStage> stages;
+	{
+		spirv_cross::CompilerGLSL::Options glslOptions;
+		glslOptions.emit_push_constant_as_uniform_buffer = true;
+
+		spirv_cross::CompilerGLSL glslComp(spirv);
+		glslComp.set_common_options(glslOptions);
+		processShaderResources(shaderResources, dsResources, desc.pushConstantSize_, glslComp);
+		applySpecConstants(glslComp, desc.specConstants_, desc.specConstantMask);
+
+		stages.push_back(GLSLStage { GL_COMPUTE_SHADER, computeShaderName, spirv2glsl(computeShaderName, desc.shaderMacros_, glslComp) });
+	}
+	pipelineStats.crossTime = now() - crossStart;
+
+	uint64_t driverStart = now();
+	GLuint program = createProgram(stages);
+	pipelineStats.driverTime = now() - driverStart;
+	addPipelineStats(pipelineStats);
+
+	auto result = pipelines.add();
+	Pipeline &pipeline = result.first;
+	// bindDescriptorSet checks layouts against desc so keep them there
+	pipeline.desc.descriptorSetLayouts = desc.descriptorSetLayouts;
+	pipeline.desc.pushConstantSize_    = desc.pushConstantSize_;
+	pipeline.desc.name_                = desc.name_;
+	pipeline.shader                    = program;
+	pipeline.resources                 = std::move(shaderResources);
+	pipeline.compute                   = true;
+
+	if (tracing) {
+		glObjectLabel(GL_PROGRAM, program, desc.name_.size(), desc.name_.c_str());
+	}
+
+	return result.second;
+}
+
+
 static const GLenum drawBuffers[MAX_COLOR_RENDERTARGETS] = {
 	  GL_COLOR_ATTACHMENT0
 	, GL_COLOR_ATTACHMENT1
@@ -1234,14 +2096,25 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 	assert(!desc.name_.empty());
 	assert(desc.renderPass_);
 
-#ifndef NDEBUG
 	auto &renderPass = renderPasses.get(desc.renderPass_);
-#endif  // NDEBUG
 
 	auto result = framebuffers.add();
 	Framebuffer &fb = result.first;
 	glCreateFramebuffers(1, &fb.fbo);
 
+	// OVR_multiview has no direct state access version
+	unsigned int views = renderPass.desc.views_;
+	assert(views <= features.maxMultiviewViews);
+	auto attach = [this, &fb, views] (GLenum attachment, GLuint tex) {
+		if (views > 1) {
+			assert(!inRenderPass);
+			bindFramebuffer(fb.fbo);
+			glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, attachment, tex, 0, 0, views);
+		} else {
+			glNamedFramebufferTexture(fb.fbo, attachment, tex, 0);
+		}
+	};
+
 	unsigned int width UNUSED = 0, height UNUSED = 0;
 
 	unsigned int numColorAttachments = 0;
@@ -1282,13 +2155,44 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		assert(colorRTtex.renderTarget);
 		assert(colorRTtex.tex != 0);
 
-		glNamedFramebufferTexture(fb.fbo, GL_COLOR_ATTACHMENT0 + i, colorRTtex.tex, 0);
+		assert(colorRT.layers >= views);
+		attach(GL_COLOR_ATTACHMENT0 + i, colorRTtex.tex);
 	}
 
 	glNamedFramebufferDrawBuffers(fb.fbo, numColorAttachments, drawBuffers);
 
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (!desc.resolves_[i]) {
+			assert(renderPass.desc.colorRTs_[i].resolveFormat == +Format::Invalid);
+			continue;
+		}
+		assert(desc.colors_[i]);
+		assert(renderPass.desc.colorRTs_[i].resolveFormat != +Format::Invalid);
+
+		auto &resolveRT = renderTargets.get(desc.resolves_[i]);
+		assert(resolveRT.numSamples == 1);
+		assert(resolveRT.width      == width);
+		assert(resolveRT.height     == height);
+		assert(resolveRT.format     == renderPass.desc.colorRTs_[i].resolveFormat);
+		// helper FBO blit only resolves one layer
+		assert(views == 1);
+		if (resolveRT.helperFBO == 0) {
+			createRTHelperFBO(resolveRT);
+		}
+		fb.resolves[i] = desc.resolves_[i];
+	}
+
 	if (desc.depthStencil_) {
 		const auto &depthRT = renderTargets.get(desc.depthStencil_);
+		if (numColorAttachments == 0) {
+			// depth only framebuffer
+			width         = depthRT.width;
+			height        = depthRT.height;
+			fb.renderPass = desc.renderPass_;
+			fb.numSamples = depthRT.numSamples;
+			fb.width      = depthRT.width;
+			fb.height     = depthRT.height;
+		}
 		assert(depthRT.format == renderPass.desc.depthStencilFormat_);
 		assert(depthRT.width  == width);
 		assert(depthRT.height == height);
@@ -1301,7 +2205,9 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 		assert(depthRTtex.renderTarget);
 		assert(depthRTtex.tex != 0);
 		fb.depthStencil = desc.depthStencil_;
-		glNamedFramebufferTexture(fb.fbo, GL_DEPTH_ATTACHMENT, depthRTtex.tex, 0);
+		GLenum attachment = isStencilFormat(depthRT.format) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		assert(depthRT.layers >= views);
+		attach(attachment, depthRTtex.tex);
 	} else {
 		assert(renderPass.desc.depthStencilFormat_ == +Format::Invalid);
 	}
@@ -1327,9 +2233,12 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 	assert(!desc.name_.empty());
 
 	GLbitfield clearMask = 0;
-	if (desc.clearDepthAttachment) {
+	if (desc.clearDepthAttachment || desc.depthStencilPassBegin_ == +PassBegin::Clear) {
 		clearMask |= GL_DEPTH_BUFFER_BIT;
 	}
+	if (desc.depthStencilFormat_ != +Format::Invalid && isStencilFormat(desc.depthStencilFormat_) && desc.stencilPassBegin_ == +PassBegin::Clear) {
+		clearMask |= GL_STENCIL_BUFFER_BIT;
+	}
 
 	auto result = renderPasses.add();
 	RenderPass &pass = result.first;
@@ -1368,7 +2277,17 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 
 	GLuint id = 0;
 	GLenum target;
-	if (desc.numSamples_ > 1) {
+	if (desc.layers_ > 1) {
+		if (desc.numSamples_ > 1) {
+			target = GL_TEXTURE_2D_MULTISAMPLE_ARRAY;
+			glCreateTextures(target, 1, &id);
+			glTextureStorage3DMultisample(id, desc.numSamples_, glTexFormat(desc.format_), desc.width_, desc.height_, desc.layers_, true);
+		} else {
+			target = GL_TEXTURE_2D_ARRAY;
+			glCreateTextures(target, 1, &id);
+			glTextureStorage3D(id, 1, glTexFormat(desc.format_), desc.width_, desc.height_, desc.layers_);
+		}
+	} else if (desc.numSamples_ > 1) {
 		target = GL_TEXTURE_2D_MULTISAMPLE;
 		glCreateTextures(target, 1, &id);
 		glTextureStorage2DMultisample(id, desc.numSamples_, glTexFormat(desc.format_), desc.width_, desc.height_, true);
@@ -1395,6 +2314,7 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	RenderTarget &rt = result.first;
 	rt.width  = desc.width_;
 	rt.height = desc.height_;
+	rt.layers = desc.layers_;
 	rt.format = desc.format_;
 	rt.numSamples = desc.numSamples_;
 	// TODO: std::move?
@@ -1403,7 +2323,7 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	if (desc.additionalViewFormat_ != +Format::Invalid) {
 		GLuint viewId = 0;
 		glGenTextures(1, &viewId);
-		glTextureView(viewId, tex.target, id, glTexFormat(desc.additionalViewFormat_), 0, 1, 0, 1);
+		glTextureView(viewId, tex.target, id, glTexFormat(desc.additionalViewFormat_), 0, 1, 0, desc.layers_);
 
 		auto viewResult   = textures.add();
 		Texture &view     = viewResult.first;
@@ -1449,7 +2369,15 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 	Sampler &sampler = result.first;
 	glCreateSamplers(1, &sampler.sampler);
 
-	glSamplerParameteri(sampler.sampler, GL_TEXTURE_MIN_FILTER, (desc.min == +FilterMode::Nearest) ? GL_NEAREST: GL_LINEAR);
+	GLint minFilter = (desc.min == +FilterMode::Nearest) ? GL_NEAREST: GL_LINEAR;
+	if (desc.mipmaps) {
+		if (desc.mip == +FilterMode::Nearest) {
+			minFilter = (desc.min == +FilterMode::Nearest) ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_NEAREST;
+		} else {
+			minFilter = (desc.min == +FilterMode::Nearest) ? GL_NEAREST_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
+		}
+	}
+	glSamplerParameteri(sampler.sampler, GL_TEXTURE_MIN_FILTER, minFilter);
 	glSamplerParameteri(sampler.sampler, GL_TEXTURE_MAG_FILTER, (desc.mag == +FilterMode::Nearest) ? GL_NEAREST: GL_LINEAR);
 	glSamplerParameteri(sampler.sampler, GL_TEXTURE_WRAP_S,     (desc.wrapMode == +WrapMode::Clamp) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
 	glSamplerParameteri(sampler.sampler, GL_TEXTURE_WRAP_T,     (desc.wrapMode == +WrapMode::Clamp) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
@@ -1470,19 +2398,54 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	GLuint texture = 0;
 	GLenum target = GL_TEXTURE_2D;
 	glCreateTextures(target, 1, &texture);
-	glTextureStorage2D(texture, 1, glTexFormat(desc.format_), desc.width_, desc.height_);
-	glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, desc.numMips_ - 1);
+
+	bool compressed = isCompressedFormat(desc.format_);
+	unsigned int numMips = desc.numMips_;
+	if (desc.generateMips_) {
+		assert(desc.numMips_ == 1);
+		assert(!compressed);
+		numMips = mipChainLength(desc.width_, desc.height_);
+	}
+
+	GLenum internalFormat = glTexFormat(desc.format_);
+	glTextureStorage2D(texture, numMips, internalFormat, desc.width_, desc.height_);
+	glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, numMips - 1);
 	unsigned int w = desc.width_, h = desc.height_;
 
+	// mips start at aligned offsets of the staging buffer
+	unsigned int uploadSize = 0;
+	for (unsigned int i = 0; i < desc.numMips_; i++) {
+		uploadSize += (desc.mipLevelSize(i) + uploadAlignment - 1) & ~(uploadAlignment - 1);
+	}
+
+	UploadBuffer &upload = getUploadBuffer(uploadSize);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+
+	unsigned int offset = 0;
 	for (unsigned int i = 0; i < desc.numMips_; i++) {
-		assert(desc.mipData_[i].data != nullptr);
-		assert(desc.mipData_[i].size != 0);
-		glTextureSubImage2D(texture, i, 0, 0, w, h, glTexBaseFormat(desc.format_), GL_UNSIGNED_BYTE, desc.mipData_[i].data);
+		unsigned int size = desc.mipLevelSize(i);
+		desc.writeMipLevel(i, upload.mapping + offset);
+		// offset into the bound unpack buffer
+		const void *src = reinterpret_cast<const void *>(static_cast<uintptr_t>(offset));
+		if (compressed) {
+			assert(size == formatDataSize(desc.format_, w, h));
+			glCompressedTextureSubImage2D(texture, i, 0, 0, w, h, internalFormat, size, src);
+		} else {
+			glTextureSubImage2D(texture, i, 0, 0, w, h, glTexBaseFormat(desc.format_), GL_UNSIGNED_BYTE, src);
+		}
+		offset += (size + uploadAlignment - 1) & ~(uploadAlignment - 1);
 
 		w = std::max(w / 2, 1u);
 		h = std::max(h / 2, 1u);
 	}
 
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	if (numMips > desc.numMips_) {
+		glGenerateTextureMipmap(texture);
+	}
+
 	auto result  = textures.add();
 	Texture &tex = result.first;
 	tex.tex    = texture;
@@ -1500,11 +2463,84 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 }
 
 
+UploadBuffer &RendererImpl::getUploadBuffer(unsigned int size) {
+	// retire buffers whose uploads have finished
+	// oversized ones were for a single large texture, they're returned unless this fits
+	auto it = uploadBuffers.begin();
+	while (it != uploadBuffers.end()) {
+		if (it->fence) {
+			GLenum result = glClientWaitSync(it->fence, 0, 0);
+			if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+				++it;
+				continue;
+			}
+			glDeleteSync(it->fence);
+			it->fence = nullptr;
+		}
+
+		if (it->size != uploadBufferSize && it->size < size) {
+			destroyUploadBuffer(*it);
+			it = uploadBuffers.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	for (auto &upload : uploadBuffers) {
+		if (!upload.fence && upload.size >= size) {
+			return upload;
+		}
+	}
+
+	UploadBuffer upload;
+	upload.size = std::max(uploadBufferSize, nextPow2(size));
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &upload.buffer);
+	glNamedBufferStorage(upload.buffer, upload.size, nullptr, flags);
+	upload.mapping = reinterpret_cast<char *>(glMapNamedBufferRange(upload.buffer, 0, upload.size, flags));
+	if (!upload.mapping) {
+		glDeleteBuffers(1, &upload.buffer);
+		throw std::runtime_error("Mapping texture upload buffer failed");
+	}
+	LOG_DEBUG("Created texture upload buffer of %u bytes\n", upload.size);
+
+	if (tracing) {
+		std::string name = "Texture upload " + std::to_string(uploadBuffers.size());
+		glObjectLabel(GL_BUFFER, upload.buffer, name.size(), name.c_str());
+	}
+
+	uploadBuffers.emplace_back(std::move(upload));
+	return uploadBuffers.back();
+}
+
+
+void RendererImpl::destroyUploadBuffer(UploadBuffer &upload) {
+	assert(upload.buffer != 0);
+
+	if (upload.fence) {
+		glClientWaitSync(upload.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(upload.fence);
+		upload.fence = nullptr;
+	}
+
+	glUnmapNamedBuffer(upload.buffer);
+	glDeleteBuffers(1, &upload.buffer);
+	upload.buffer  = 0;
+	upload.mapping = nullptr;
+	upload.size    = 0;
+}
+
+
 DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *layout) {
 	auto result = dsLayouts.add();
 	DescriptorSetLayout &dsLayout = result.first;
 
 	while (layout->type != +DescriptorType::End) {
+		if (layout->type == +DescriptorType::TextureTable) {
+			LOG("TextureTable descriptors are not supported on OpenGL\n");
+			throw std::runtime_error("TextureTable descriptors are not supported on OpenGL");
+		}
 		dsLayout.descriptors.push_back(*layout);
 		layout++;
 	}
@@ -1539,18 +2575,34 @@ TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle handle, Forma
 }
 
 
+RenderTargetHandle RendererImpl::getSwapchainRenderTarget() const {
+	// features.swapchainRenderTarget is never set
+	UNREACHABLE();
+	return RenderTargetHandle();
+}
+
+
+unsigned int RendererImpl::getTextureTableIndex(TextureHandle /* handle */) const {
+	// features.textureTable is never set
+	UNREACHABLE();
+	return 0;
+}
+
+
 void RendererImpl::deleteBuffer(BufferHandle handle) {
-	buffers.removeWith(handle, [](struct Buffer &b) {
+	assert(!EphemeralBuffer::isEphemeral(handle));
+	buffers.removeWith(handle, [this](struct Buffer &b) {
 		assert(b.buffer != 0);
+		glState.invalidateBindings();
 		glDeleteBuffers(1, &b.buffer);
 		b.buffer = 0;
 
 		assert(b.size != 0);
 		b.size   = 0;
 
-		assert(!b.ringBufferAlloc);
 		assert(b.type != +BufferType::Invalid);
 		b.type   = BufferType::Invalid;
+		b.usage  = BufferUsage::Static;
 	} );
 }
 
@@ -1567,8 +2619,11 @@ void RendererImpl::deleteFramebuffer(FramebufferHandle handle) {
 
 
 void RendererImpl::deletePipeline(PipelineHandle handle) {
-	pipelines.removeWith(handle, [](Pipeline &p) {
+	pipelines.removeWith(handle, [this](Pipeline &p) {
 		assert(p.shader != 0);
+		if (glState.program.is(p.shader)) {
+			glState.program.invalidate();
+		}
 		glDeleteProgram(p.shader);
 		p.shader = 0;
 	} );
@@ -1598,6 +2653,7 @@ void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 			assert(tex.target != GL_NONE);
 			tex.renderTarget = false;
 			assert(tex.tex != 0);
+			this->glState.invalidateBindings();
 			glDeleteTextures(1, &tex.tex);
 			tex.tex = 0;
 			tex.target = GL_NONE;
@@ -1624,9 +2680,10 @@ void RendererImpl::deleteRenderTarget(RenderTargetHandle &handle) {
 
 
 void RendererImpl::deleteSampler(SamplerHandle handle) {
-	samplers.removeWith(handle, [](Sampler &sampler) {
+	samplers.removeWith(handle, [this](Sampler &sampler) {
 		assert(sampler.sampler != 0);
 
+		glState.invalidateBindings();
 		glDeleteSamplers(1, &sampler.sampler);
 		sampler.sampler = 0;
 	} );
@@ -1634,11 +2691,12 @@ void RendererImpl::deleteSampler(SamplerHandle handle) {
 
 
 void RendererImpl::deleteTexture(TextureHandle handle) {
-	textures.removeWith(handle, [](Texture &tex) {
+	textures.removeWith(handle, [this](Texture &tex) {
 		assert(!tex.renderTarget);
 		assert(tex.tex != 0);
 		assert(tex.target != GL_NONE);
 
+		glState.invalidateBindings();
 		glDeleteTextures(1, &tex.tex);
 		tex.tex = 0;
 		tex.target = GL_NONE;
@@ -1652,7 +2710,9 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 
 	if (swapchainDesc.fullscreen != desc.fullscreen) {
 		changed = true;
-		if (desc.fullscreen) {
+		if (offscreen) {
+			// nothing to show fullscreen
+		} else if (desc.fullscreen) {
 			// TODO: check return val?
 			SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
 			LOG("Fullscreen\n");
@@ -1694,6 +2754,10 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 		changed = true;
 	}
 
+	if (swapchainDesc.framesInFlight != desc.framesInFlight) {
+		changed = true;
+	}
+
 	if (swapchainDesc.width     != desc.width) {
 		changed = true;
 	}
@@ -1710,6 +2774,10 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 
 
 glm::uvec2 RendererImpl::getDrawableSize() const {
+	if (offscreen) {
+		return glm::uvec2(wantedSwapchain.width, wantedSwapchain.height);
+	}
+
 	int w = -1, h = -1;
 	SDL_GL_GetDrawableSize(window, &w, &h);
 	if (w <= 0 || h <= 0) {
@@ -1723,42 +2791,63 @@ glm::uvec2 RendererImpl::getDrawableSize() const {
 bool RendererImpl::recreateSwapchain() {
 	assert(swapchainDirty);
 
-	int w = -1, h = -1;
-	SDL_GL_GetDrawableSize(window, &w, &h);
-	if (w <= 0 || h <= 0) {
-		throw std::runtime_error("drawable size is negative");
-	}
+	if (offscreen) {
+		// the default framebuffer isn't used so any size the rendertargets can have
+		GLint maxSize = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+		if (wantedSwapchain.width == 0 || wantedSwapchain.height == 0) {
+			throw std::runtime_error("offscreen size is zero");
+		}
+		if (wantedSwapchain.width > unsigned(maxSize) || wantedSwapchain.height > unsigned(maxSize)) {
+			LOG("Offscreen size %ux%u is over the texture size limit %d\n", wantedSwapchain.width, wantedSwapchain.height, maxSize);
+			throw std::runtime_error("offscreen size too large");
+		}
 
-	swapchainDesc.width  = w;
-	swapchainDesc.height = h;
+		swapchainDesc.width  = wantedSwapchain.width;
+		swapchainDesc.height = wantedSwapchain.height;
+	} else {
+		int w = -1, h = -1;
+		SDL_GL_GetDrawableSize(window, &w, &h);
+		if (w <= 0 || h <= 0) {
+			throw std::runtime_error("drawable size is negative");
+		}
+
+		swapchainDesc.width  = w;
+		swapchainDesc.height = h;
+	}
 
 	unsigned int numImages = wantedSwapchain.numFrames;
 	numImages = std::max(numImages, 1U);
 
 	LOG("Want %u images, using %u images\n", wantedSwapchain.numFrames, numImages);
 
-	swapchainDesc.fullscreen = wantedSwapchain.fullscreen;
-	swapchainDesc.numFrames  = numImages;
-	swapchainDesc.vsync      = wantedSwapchain.vsync;
+	// GL doesn't expose swapchain images, only the frame ring is ours
+	unsigned int numFrames = (wantedSwapchain.framesInFlight != 0) ? wantedSwapchain.framesInFlight : numImages;
+	LOG("%u frames in flight\n", numFrames);
 
-	if (frames.size() != numImages) {
-		if (numImages < frames.size()) {
+	swapchainDesc.fullscreen     = wantedSwapchain.fullscreen;
+	swapchainDesc.numFrames      = numImages;
+	swapchainDesc.framesInFlight = wantedSwapchain.framesInFlight;
+	swapchainDesc.vsync          = wantedSwapchain.vsync;
+
+	if (frames.size() != numFrames) {
+		if (numFrames < frames.size()) {
 			// FIXME: return false if waitForDeviceIdle fails
 			while (!waitForDeviceIdle()) {
 			}
 
 			// decreasing, delete old and resize
-			for (unsigned int i = numImages; i < frames.size(); i++) {
+			for (unsigned int i = numFrames; i < frames.size(); i++) {
 				auto &f = frames.at(i);
 				assert(!f.outstanding);
 
 				// delete contents of Frame
 				deleteFrameInternal(f);
 			}
-			frames.resize(numImages);
+			frames.resize(numFrames);
 		} else {
 			// increasing, resize and initialize new
-			frames.resize(numImages);
+			frames.resize(numFrames);
 
 			// TODO: put some stuff here
 		}
@@ -1781,7 +2870,7 @@ bool RendererImpl::waitForDeviceIdle() {
 		auto &f = frames.at(i);
 		if (f.outstanding) {
 			// try to wait
-			if (!waitForFrame(i)) {
+			if (!waitForFrame(i, 0)) {
 				assert(f.outstanding);
 				return false;
 			}
@@ -1793,6 +2882,15 @@ bool RendererImpl::waitForDeviceIdle() {
 }
 
 
+// in the order of GPUTiming's statistics
+static const std::array<GLenum, 4> statisticsTargets = { {
+	  GL_VERTEX_SHADER_INVOCATIONS_ARB
+	, GL_CLIPPING_OUTPUT_PRIMITIVES_ARB
+	, GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+	, GL_COMPUTE_SHADER_INVOCATIONS_ARB
+} };
+
+
 bool RendererImpl::beginFrame() {
 #ifndef NDEBUG
 	assert(!inFrame);
@@ -1814,7 +2912,7 @@ bool RendererImpl::beginFrame() {
 	// frames are a ringbuffer
 	// if the frame we want to reuse is still pending on the GPU, wait for it
 	if (frame.outstanding) {
-		if (!waitForFrame(currentFrameIdx)) {
+		if (!waitForFrame(currentFrameIdx, frameWaitTimeout)) {
 			return false;
 		}
 	}
@@ -1822,6 +2920,10 @@ bool RendererImpl::beginFrame() {
 
 	currentPipeline        = PipelineHandle();
 
+	if (!precompileQueue.empty()) {
+		startPrecompiledPrograms();
+	}
+
 #ifndef NDEBUG
 
 	inFrame       = true;
@@ -1832,17 +2934,33 @@ bool RendererImpl::beginFrame() {
 #endif //  NDEBUG
 
 	currentPipeline        = PipelineHandle();
-	descriptors.clear();
-
-	// TODO: reset all relevant state in case some 3rd-party program fucked them up
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glDepthMask(GL_TRUE);
+	descriptors            = ArenaHashMap<DSIndex, Descriptor>(ArenaAllocator<std::pair<const DSIndex, Descriptor> >(frame.arena));
 
-	if (features.sRGBFramebuffer) {
-		glEnable(GL_FRAMEBUFFER_SRGB);
-	} else {
-		glDisable(GL_FRAMEBUFFER_SRGB);
+	frame.timerNames.clear();
+	if (frame.timerQueries[0] == 0) {
+		glGenQueries(2 * MAX_GPU_TIMERS, &frame.timerQueries[0]);
+	}
+	if (pipelineStatistics && frame.statisticsQueries.empty()) {
+		frame.statisticsQueries.resize(statisticsTargets.size() * MAX_GPU_TIMERS, 0);
+		glGenQueries(static_cast<GLsizei>(frame.statisticsQueries.size()), frame.statisticsQueries.data());
 	}
+	if (frame.presentQuery == 0) {
+		glGenQueries(1, &frame.presentQuery);
+	}
+
+	// GL can't see the display so present time is when the GPU finished
+	// translate GL timestamps to our clock, this ignores any drift during the frame
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	frame.beginTime      = now();
+	frame.gpuClockOffset = static_cast<int64_t>(frame.beginTime) - gpuNow;
+
+	// forget shadowed state in case some 3rd-party program changed it
+	glState.invalidate();
+
+	bindFramebuffer(0);
+	setDepthMask(true);
+	setCapability(GLCapability::FramebufferSRGB, features.sRGBFramebuffer);
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	// TODO: only clear depth/stencil if we have it
@@ -1861,19 +2979,17 @@ void RendererImpl::presentFrame(RenderTargetHandle image) {
 
 	auto &frame = frames.at(currentFrameIdx);
 
+	// allocated but never used, nothing reads them
+	pendingEphemeralWrites.clear();
+
 	auto &rt = renderTargets.get(image);
 	assert(rt.currentLayout == +Layout::TransferSrc);
 
 	unsigned int width  = rt.width;
 	unsigned int height = rt.height;
 
-	// TODO: only if enabled
-	glDisable(GL_SCISSOR_TEST);
-	if (features.sRGBFramebuffer) {
-		glEnable(GL_FRAMEBUFFER_SRGB);
-	} else {
-		glDisable(GL_FRAMEBUFFER_SRGB);
-	}
+	setCapability(GLCapability::ScissorTest, false);
+	setCapability(GLCapability::FramebufferSRGB, features.sRGBFramebuffer);
 
 
 	// TODO: necessary? should do linear blit?
@@ -1883,28 +2999,54 @@ void RendererImpl::presentFrame(RenderTargetHandle image) {
 	assert(width > 0);
 	assert(height > 0);
 
-	if (rt.helperFBO == 0) {
-		createRTHelperFBO(rt);
+	// offscreen the frame ends in this rendertarget
+	if (!offscreen) {
+		if (rt.helperFBO == 0) {
+			createRTHelperFBO(rt);
+		}
+		assert(rt.helperFBO != 0);
+
+		glBlitNamedFramebuffer(rt.helperFBO, 0
+		                     , 0, 0, width, height
+		                     , 0, 0, width, height
+		                     , GL_COLOR_BUFFER_BIT, GL_NEAREST);
 	}
-	assert(rt.helperFBO != 0);
 
-	glBlitNamedFramebuffer(rt.helperFBO, 0
-	                     , 0, 0, width, height
-	                     , 0, 0, width, height
-	                     , GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	if (readbackRequested) {
+		readbackRequested = false;
+		readbackRenderTarget(image, [this] (FrameReadback &r) {
+			std::swap(readback, r);
+			readbackReady = true;
+		});
+	}
+
+	glQueryCounter(frame.presentQuery, GL_TIMESTAMP);
+
+	if (offscreen) {
+		// no swap to submit the frame's commands
+		glFlush();
+	} else {
+		SDL_GL_SwapWindow(window);
+	}
 
-	SDL_GL_SwapWindow(window);
+	presentTimings.clear();
+	// SDL has no swap with damage
+	damageRects.clear();
+
+	// must not outlive the frame's arena
+	descriptors = ArenaHashMap<DSIndex, Descriptor>();
 
 	frame.fence        = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-	frame.usedRingBufPtr = ringBufPtr;
 	frame.outstanding  = true;
 	frame.lastFrameNum = frameNum;
 
+	finishRingFrame();
+
 	frameNum++;
 }
 
 
-bool RendererImpl::waitForFrame(unsigned int frameIdx) {
+bool RendererImpl::waitForFrame(unsigned int frameIdx, uint64_t timeout) {
 	assert(frameIdx < frames.size());
 
 	Frame &frame = frames.at(frameIdx);
@@ -1912,7 +3054,7 @@ bool RendererImpl::waitForFrame(unsigned int frameIdx) {
 
 	// wait for the fence
 	assert(frame.fence);
-	GLenum result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	GLenum result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
 	switch (result) {
 	case GL_ALREADY_SIGNALED:
 	case GL_CONDITION_SATISFIED:
@@ -1931,35 +3073,107 @@ bool RendererImpl::waitForFrame(unsigned int frameIdx) {
 	glDeleteSync(frame.fence);
 	frame.fence = nullptr;
 
-	for (auto handle : frame.ephemeralBuffers) {
-		Buffer &buffer = buffers.get(handle);
-		if (buffer.ringBufferAlloc) {
-			buffer.buffer          = 0;
-			buffer.ringBufferAlloc = false;
-		} else {
-			glDeleteBuffers(1, &buffer.buffer);
-			buffer.buffer = 0;
+	if (!frame.timerNames.empty()) {
+		// fence has signaled so the timestamps are available without stalling
+		unsigned int numTimers = std::min(static_cast<unsigned int>(frame.timerNames.size()), static_cast<unsigned int>(MAX_GPU_TIMERS));
+		gpuTimings.clear();
+		gpuTimings.reserve(numTimers);
+		for (unsigned int i = 0; i < numTimers; i++) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.timerQueries[2 * i],     GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.timerQueries[2 * i + 1], GL_QUERY_RESULT, &end);
+
+			GPUTiming t;
+			t.name        = std::move(frame.timerNames[i]);
+			t.nanoseconds = end - begin;
+			t.start       = static_cast<uint64_t>(static_cast<int64_t>(begin) + frame.gpuClockOffset);
+			if (!frame.statisticsQueries.empty()) {
+				const GLuint *q = &frame.statisticsQueries[statisticsTargets.size() * i];
+				glGetQueryObjectui64v(q[0], GL_QUERY_RESULT, &t.vertexInvocations);
+				glGetQueryObjectui64v(q[1], GL_QUERY_RESULT, &t.clippingPrimitives);
+				glGetQueryObjectui64v(q[2], GL_QUERY_RESULT, &t.fragmentInvocations);
+				glGetQueryObjectui64v(q[3], GL_QUERY_RESULT, &t.computeInvocations);
+				t.hasStatistics = true;
+			}
+			gpuTimings.emplace_back(std::move(t));
 		}
+		frame.timerNames.clear();
+	}
 
-		assert(buffer.size   >  0);
-		buffer.size = 0;
-		buffer.offset = 0;
-		assert(buffer.type != +BufferType::Invalid);
-		buffer.type   = BufferType::Invalid;
-
-		buffers.remove(handle);
+	{
+		GLuint64 presentTime = 0;
+		glGetQueryObjectui64v(frame.presentQuery, GL_QUERY_RESULT, &presentTime);
+		presentTimings.emplace_back(frame.lastFrameNum, frame.beginTime, static_cast<uint64_t>(static_cast<int64_t>(presentTime) + frame.gpuClockOffset), false);
 	}
-	frame.ephemeralBuffers.clear();
+
 	frame.outstanding = false;
 	lastSyncedFrame = std::max(lastSyncedFrame, frame.lastFrameNum);
-	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+	releaseRingPages(frame);
+	frame.arena.reset();
+
+	for (auto it = pendingReadbacks.begin(); it != pendingReadbacks.end(); ) {
+		if (it->frameNum > lastSyncedFrame) {
+			++it;
+			continue;
+		}
+
+		size_t rowSize = size_t(it->width) * formatSize(it->format);
+		FrameReadback frameReadback;
+		frameReadback.frameNum = it->frameNum;
+		frameReadback.width    = it->width;
+		frameReadback.height   = it->height;
+		frameReadback.format   = it->format;
+		frameReadback.pixels.resize(rowSize * it->height);
+
+		// GL rows are bottom up
+		const uint8_t *src = static_cast<const uint8_t *>(glMapNamedBufferRange(it->buffer, 0, rowSize * it->height, GL_MAP_READ_BIT));
+		for (unsigned int y = 0; y < it->height; y++) {
+			memcpy(&frameReadback.pixels[(it->height - 1 - y) * rowSize], src + y * rowSize, rowSize);
+		}
+		glUnmapNamedBuffer(it->buffer);
+		glDeleteBuffers(1, &it->buffer);
+
+		// callback might add more readbacks
+		ReadbackCallback callback = std::move(it->callback);
+		it = pendingReadbacks.erase(it);
+		if (callback) {
+			callback(frameReadback);
+		}
+	}
 
 	return true;
 }
 
 
-void RendererImpl::deleteFrameInternal(Frame &f UNUSED) {
+void RendererImpl::deleteFrameInternal(Frame &f) {
 	assert(!f.outstanding);
+
+	if (f.timerQueries[0] != 0) {
+		glDeleteQueries(2 * MAX_GPU_TIMERS, &f.timerQueries[0]);
+		f.timerQueries.fill(0);
+	}
+
+	if (!f.statisticsQueries.empty()) {
+		glDeleteQueries(static_cast<GLsizei>(f.statisticsQueries.size()), f.statisticsQueries.data());
+		f.statisticsQueries.clear();
+	}
+
+	if (f.presentQuery != 0) {
+		glDeleteQueries(1, &f.presentQuery);
+		f.presentQuery = 0;
+	}
+}
+
+
+void RendererImpl::beginAsyncCompute() {
+	// features.asyncCompute is never set
+	UNREACHABLE();
+}
+
+
+void RendererImpl::endAsyncCompute() {
+	// features.asyncCompute is never set
+	UNREACHABLE();
 }
 
 
@@ -1990,17 +3204,33 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 	assert(fb.width > 0);
 	assert(fb.height > 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fb.fbo);
-	if (fb.sRGB) {
-		glEnable(GL_FRAMEBUFFER_SRGB);
-	} else {
-		glDisable(GL_FRAMEBUFFER_SRGB);
-	}
+	bindFramebuffer(fb.fbo);
+	setCapability(GLCapability::FramebufferSRGB, fb.sRGB);
+	setCapability(GLCapability::Multisample,     fb.numSamples > 1);
 
-	if (fb.numSamples > 1) {
-		glEnable(GL_MULTISAMPLE);
-	} else {
-		glDisable(GL_MULTISAMPLE);
+	// attachments whose previous contents aren't needed
+	// tilers don't have to load them
+	std::array<GLenum, MAX_COLOR_RENDERTARGETS + 2> invalidated;
+	unsigned int numInvalidated = 0;
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (fb.colors[i] && rp.desc.colorRTs_[i].passBegin == +PassBegin::DontCare) {
+			invalidated[numInvalidated] = GL_COLOR_ATTACHMENT0 + i;
+			numInvalidated++;
+		}
+	}
+	if (fb.depthStencil) {
+		const auto &depthRT = renderTargets.get(fb.depthStencil);
+		if (rp.desc.depthStencilPassBegin_ == +PassBegin::DontCare && !rp.desc.clearDepthAttachment) {
+			invalidated[numInvalidated] = GL_DEPTH_ATTACHMENT;
+			numInvalidated++;
+		}
+		if (isStencilFormat(depthRT.format) && rp.desc.stencilPassBegin_ == +PassBegin::DontCare) {
+			invalidated[numInvalidated] = GL_STENCIL_ATTACHMENT;
+			numInvalidated++;
+		}
+	}
+	if (numInvalidated > 0) {
+		glInvalidateNamedFramebufferData(fb.fbo, numInvalidated, &invalidated[0]);
 	}
 
 	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
@@ -2011,10 +3241,16 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 	}
 
 	if (rp.clearMask) {
-		// TODO: stencil
 		if ((rp.clearMask & GL_DEPTH_BUFFER_BIT) != 0) {
+			// depth clears obey the depth mask left by the previous pipeline
+			setDepthMask(true);
 			glClearBufferfv(GL_DEPTH, 0, &rp.depthClearValue);
 		}
+		// stencil write mask is never changed from default so this clears all bits
+		if ((rp.clearMask & GL_STENCIL_BUFFER_BIT) != 0) {
+			GLint stencilClear = rp.desc.stencilClearValue;
+			glClearBufferiv(GL_STENCIL, 0, &stencilClear);
+		}
 	}
 
 	currentRenderPass  = rpHandle;
@@ -2022,6 +3258,17 @@ void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle
 }
 
 
+bool RendererImpl::beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+	// GL has nothing to replay, contents are recorded every time
+	beginRenderPass(rpHandle, fbHandle);
+	return true;
+}
+
+
+void RendererImpl::invalidateStaticRenderPass(RenderPassHandle /* rpHandle */) {
+}
+
+
 void RendererImpl::endRenderPass() {
 #ifndef NDEBUG
 	assert(inFrame);
@@ -2042,6 +3289,39 @@ void RendererImpl::endRenderPass() {
 			auto &rt = renderTargets.get(fb.colors[i]);
 			rt.currentLayout = pass.desc.colorRTs_[i].finalLayout;
 		}
+
+		if (fb.resolves[i]) {
+			auto &rt = renderTargets.get(fb.resolves[i]);
+			assert(rt.helperFBO != 0);
+
+			glNamedFramebufferReadBuffer(fb.fbo, GL_COLOR_ATTACHMENT0 + i);
+			glBlitNamedFramebuffer(fb.fbo, rt.helperFBO
+			                     , 0, 0, fb.width, fb.height
+			                     , 0, 0, rt.width, rt.height
+			                     , GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			rt.currentLayout = pass.desc.colorRTs_[i].resolveFinalLayout;
+		}
+	}
+
+	glNamedFramebufferReadBuffer(fb.fbo, GL_COLOR_ATTACHMENT0);
+
+	// attachments whose contents aren't needed after the pass
+	std::array<GLenum, MAX_COLOR_RENDERTARGETS + 1> discarded;
+	unsigned int numDiscarded = 0;
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (fb.colors[i] && !pass.desc.colorRTs_[i].store) {
+			discarded[numDiscarded] = GL_COLOR_ATTACHMENT0 + i;
+			numDiscarded++;
+		}
+	}
+	if (fb.depthStencil && !pass.desc.storeDepth_) {
+		const auto &depthRT = renderTargets.get(fb.depthStencil);
+		bool discardStencil = isStencilFormat(depthRT.format) && !pass.desc.storeStencil_;
+		discarded[numDiscarded] = discardStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		numDiscarded++;
+	}
+	if (numDiscarded > 0) {
+		glInvalidateNamedFramebufferData(fb.fbo, numDiscarded, &discarded[0]);
 	}
 
 	currentRenderPass = RenderPassHandle();
@@ -2049,20 +3329,152 @@ void RendererImpl::endRenderPass() {
 }
 
 
+void RendererImpl::beginGPUTimer(const std::string &name) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(!inGPUTimer);
+	inGPUTimer = true;
+#endif  // NDEBUG
+
+	auto &frame = frames.at(currentFrameIdx);
+	assert(frame.timerQueries[0] != 0);
+
+	// timers past the end of the query array are not recorded
+	unsigned int query = static_cast<unsigned int>(2 * frame.timerNames.size());
+	frame.timerNames.push_back(name);
+	if (query >= 2 * MAX_GPU_TIMERS) {
+		return;
+	}
+	glQueryCounter(frame.timerQueries[query], GL_TIMESTAMP);
+
+	if (!frame.statisticsQueries.empty()) {
+		const GLuint *q = &frame.statisticsQueries[statisticsTargets.size() * (query / 2)];
+		for (unsigned int i = 0; i < statisticsTargets.size(); i++) {
+			glBeginQuery(statisticsTargets[i], q[i]);
+		}
+	}
+}
+
+
+void RendererImpl::endGPUTimer() {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(inGPUTimer);
+	inGPUTimer = false;
+#endif  // NDEBUG
+
+	auto &frame = frames.at(currentFrameIdx);
+	assert(!frame.timerNames.empty());
+
+	unsigned int query = static_cast<unsigned int>(2 * frame.timerNames.size() - 1);
+	if (query >= 2 * MAX_GPU_TIMERS) {
+		return;
+	}
+	glQueryCounter(frame.timerQueries[query], GL_TIMESTAMP);
+
+	if (!frame.statisticsQueries.empty()) {
+		for (GLenum target : statisticsTargets) {
+			glEndQuery(target);
+		}
+	}
+}
+
+
+void RendererImpl::pushDebugGroup(const char *name) {
+#ifndef NDEBUG
+	assert(inFrame);
+	debugGroupDepth++;
+#endif  // NDEBUG
+
+	if (tracing) {
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, name);
+	}
+}
+
+
+void RendererImpl::popDebugGroup() {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(debugGroupDepth > 0);
+	debugGroupDepth--;
+#endif  // NDEBUG
+
+	if (tracing) {
+		glPopDebugGroup();
+	}
+}
+
+
 void RendererImpl::layoutTransition(RenderTargetHandle image, Layout src UNUSED, Layout dest) {
 	assert(image);
 	assert(dest != +Layout::Undefined);
 	assert(src != dest);
 
-	auto &rt = renderTargets.get(image);
-	assert(src == +Layout::Undefined || rt.currentLayout == src);
-	rt.currentLayout = dest;
+	auto &rt = renderTargets.get(image);
+	assert(src == +Layout::Undefined || rt.currentLayout == src);
+	rt.currentLayout = dest;
+
+	// image stores are incoherent, make them visible to whatever comes next
+	if (src == +Layout::General) {
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+	}
+}
+
+
+static const std::array<GLenum, static_cast<size_t>(GLCapability::Count)> glCapabilities = { {
+	  GL_DEPTH_TEST
+	, GL_STENCIL_TEST
+	, GL_CULL_FACE
+	, GL_SCISSOR_TEST
+	, GL_BLEND
+	, GL_FRAMEBUFFER_SRGB
+	, GL_MULTISAMPLE
+} };
+
+
+void RendererImpl::setCapability(GLCapability cap, bool enabled) {
+	auto idx = static_cast<size_t>(cap);
+	if (!glState.capabilities[idx].set(enabled)) {
+		return;
+	}
+
+	if (enabled) {
+		glEnable(glCapabilities[idx]);
+	} else {
+		glDisable(glCapabilities[idx]);
+	}
+}
+
+
+void RendererImpl::useProgram(GLuint program) {
+	if (glState.program.set(program)) {
+		glUseProgram(program);
+	}
+}
+
+
+void RendererImpl::bindFramebuffer(GLuint fbo) {
+	if (glState.framebuffer.set(fbo)) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	}
+}
+
+
+void RendererImpl::setDepthMask(bool enabled) {
+	if (glState.depthMask.set(enabled)) {
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	}
 }
 
 
 void RendererImpl::setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
 	assert(inFrame);
-	glViewport(x, y, width, height);
+	std::array<GLint, 4> vp = { { GLint(x), GLint(y), GLint(width), GLint(height) } };
+	if (glState.viewport.set(vp)) {
+		glViewport(x, y, width, height);
+	}
 }
 
 
@@ -2077,15 +3489,21 @@ void RendererImpl::setScissorRect(unsigned int x, unsigned int y, unsigned int w
 
 	// flip y from Vulkan convention to OpenGL convention
 	// TODO: should use current FB height
-	glScissor(x, swapchainDesc.height - (y + height), width, height);
+	GLint flippedY = swapchainDesc.height - (y + height);
+	std::array<GLint, 4> rect = { { GLint(x), flippedY, GLint(width), GLint(height) } };
+	if (glState.scissor.set(rect)) {
+		glScissor(x, flippedY, width, height);
+	}
 }
 
 
 void RendererImpl::bindPipeline(PipelineHandle pipeline) {
+	const auto &p = pipelines.get(pipeline);
+
 #ifndef NDEBUG
 	assert(inFrame);
 	assert(pipeline);
-	assert(inRenderPass);
+	assert(inRenderPass == !p.compute);
 	assert(pipelineDrawn);
 	pipelineDrawn = false;
 	validPipeline = true;
@@ -2094,45 +3512,58 @@ void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 
 	decriptorSetsDirty = true;
 
-	const auto &p = pipelines.get(pipeline);
+	useProgram(p.shader);
 
-	// TODO: shadow state, set only necessary
-	glUseProgram(p.shader);
-	if (p.desc.depthWrite_) {
-		glDepthMask(GL_TRUE);
-	} else {
-		glDepthMask(GL_FALSE);
-	}
+	if (p.compute) {
+		// compute pipelines have no fixed function state
+		// but old vertex attributes must be disabled so the masks stay in sync
+		uint32_t oldMask = currentPipeline ? (pipelines.get(currentPipeline).desc.vertexAttribMask) : 0;
+		forEachSetBit(oldMask, [] (uint32_t bit, uint32_t /* mask */ ) {
+			glDisableVertexAttribArray(bit);
+		});
 
-	if (p.desc.depthTest_) {
-		glEnable(GL_DEPTH_TEST);
-	} else {
-		glDisable(GL_DEPTH_TEST);
+		currentPipeline = pipeline;
+		return;
 	}
+	setDepthMask(p.desc.depthWrite_);
+	setCapability(GLCapability::DepthTest,   p.desc.depthTest_);
+	setCapability(GLCapability::StencilTest, p.desc.stencilTest_);
+	setCapability(GLCapability::CullFace,    p.desc.cullFaces_);
+	setCapability(GLCapability::ScissorTest, p.desc.scissorTest_);
+	setCapability(GLCapability::Blend,       p.desc.blending_);
 
-	if (p.desc.cullFaces_) {
-		glEnable(GL_CULL_FACE);
-	} else {
-		glDisable(GL_CULL_FACE);
+	if (p.desc.depthTest_) {
+		GLenum func = depthFunc(p.desc.depthFunc_);
+		if (glState.depthFunc.set(func)) {
+			glDepthFunc(func);
+		}
 	}
 
-	if (p.desc.scissorTest_) {
-		glEnable(GL_SCISSOR_TEST);
-	} else {
-		glDisable(GL_SCISSOR_TEST);
+	if (p.desc.stencilTest_) {
+		std::array<GLint, 3> func = { { GLint(stencilFunc(p.desc.stencilFunc_)), GLint(p.desc.stencilRef_), 0xFF } };
+		if (glState.stencilFunc.set(func)) {
+			glStencilFunc(stencilFunc(p.desc.stencilFunc_), p.desc.stencilRef_, 0xFF);
+		}
+		GLenum passOp = stencilOp(p.desc.stencilPassOp_);
+		if (glState.stencilPassOp.set(passOp)) {
+			glStencilOp(GL_KEEP, GL_KEEP, passOp);
+		}
 	}
 
 	if (p.desc.blending_) {
-		glEnable(GL_BLEND);
 		// TODO: get from Pipeline
-		glBlendEquation(GL_FUNC_ADD);
-		glBlendFunc(p.srcBlend, p.destBlend);
+		if (glState.blendEquation.set(GL_FUNC_ADD)) {
+			glBlendEquation(GL_FUNC_ADD);
+		}
+		if (glState.blendFunc.set(std::make_pair(p.srcBlend, p.destBlend))) {
+			glBlendFunc(p.srcBlend, p.destBlend);
+		}
 		if (p.srcBlend == GL_CONSTANT_ALPHA || p.destBlend == GL_CONSTANT_ALPHA) {
 			// TODO: get from Pipeline
-			glBlendColor(0.5f, 0.5f, 0.5f, 0.5f);
+			if (glState.blendColor.set(glm::vec4(0.5f))) {
+				glBlendColor(0.5f, 0.5f, 0.5f, 0.5f);
+			}
 		}
-	} else {
-		glDisable(GL_BLEND);
 	}
 
 	uint32_t oldMask = currentPipeline ? (pipelines.get(currentPipeline).desc.vertexAttribMask) : 0;
@@ -2177,16 +3608,9 @@ void RendererImpl::bindIndexBuffer(BufferHandle handle, bool bit16) {
 	assert(inFrame);
 	assert(validPipeline);
 
-	const Buffer &buffer = buffers.get(handle);
+	auto buffer = resolveBuffer(handle);
 	assert(buffer.size > 0);
 	assert(buffer.type == +BufferType::Index);
-	if (buffer.ringBufferAlloc) {
-		assert(buffer.buffer == ringBuffer);
-		assert(buffer.offset + buffer.size < ringBufSize);
-	} else {
-		assert(buffer.buffer != 0);
-		assert(buffer.offset == 0);
-	}
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.buffer);
 	indexBufByteOffset = buffer.offset;
 	idxBuf16Bit = bit16;
@@ -2197,18 +3621,9 @@ void RendererImpl::bindVertexBuffer(unsigned int binding, BufferHandle handle) {
 	assert(inFrame);
 	assert(validPipeline);
 
-	const Buffer &buffer = buffers.get(handle);
+	auto buffer = resolveBuffer(handle);
 	assert(buffer.size >  0);
 	assert(buffer.type == +BufferType::Vertex);
-	if (buffer.ringBufferAlloc) {
-		// this is not strictly correct since we might have reallocated the ringbuf bigger
-		// but it should never fail, at worst it will not spot some errors immediately after realloc
-		// which are rare events anyway
-		assert(buffer.offset + buffer.size < ringBufSize);
-	} else {
-		assert(buffer.buffer != 0);
-		assert(buffer.offset == 0);
-	}
 	const auto &p = pipelines.get(currentPipeline);
 	glBindVertexBuffer(binding, buffer.buffer, buffer.offset, p.desc.vertexBuffers[binding].stride);
 }
@@ -2239,34 +3654,27 @@ void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layoutHa
 			UNREACHABLE();
 			break;
 
-		case DescriptorType::UniformBuffer: {
+		// OpenGL binds buffer ranges anyway so dynamic buffers need nothing special
+		case DescriptorType::UniformBuffer:
+		case DescriptorType::UniformBufferDynamic: {
 			// this is part of the struct, we know it's correctly aligned and right type
 			BufferHandle handle = *reinterpret_cast<const BufferHandle *>(data + l.offset);
-			const Buffer &buffer = buffers.get(handle);
+#ifndef NDEBUG
+			auto buffer = resolveBuffer(handle);
 			assert(buffer.size > 0);
 			assert(buffer.type == +BufferType::Uniform);
-			if (buffer.ringBufferAlloc) {
-				assert(buffer.buffer == ringBuffer);
-				assert(buffer.offset + buffer.size < ringBufSize);
-			} else {
-				assert(buffer.buffer != 0);
-				assert(buffer.offset == 0);
-			}
+#endif  // NDEBUG
 			descriptors[idx] = handle;
 		} break;
 
-		case DescriptorType::StorageBuffer: {
+		case DescriptorType::StorageBuffer:
+		case DescriptorType::StorageBufferDynamic: {
 			BufferHandle handle = *reinterpret_cast<const BufferHandle *>(data + l.offset);
-			const Buffer &buffer = buffers.get(handle);
+#ifndef NDEBUG
+			auto buffer = resolveBuffer(handle);
 			assert(buffer.size  > 0);
-			assert(buffer.type == +BufferType::Storage);
-			if (buffer.ringBufferAlloc) {
-				assert(buffer.buffer == ringBuffer);
-				assert(buffer.offset + buffer.size < ringBufSize);
-			} else {
-				assert(buffer.buffer != 0);
-				assert(buffer.offset == 0);
-			}
+			assert(buffer.type == +BufferType::Storage || buffer.type == +BufferType::Indirect);
+#endif  // NDEBUG
 			descriptors[idx] = handle;
 		} break;
 
@@ -2286,6 +3694,18 @@ void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layoutHa
 			descriptors[idx] = texHandle;
 		} break;
 
+		case DescriptorType::StorageImage: {
+			TextureHandle texHandle = *reinterpret_cast<const TextureHandle *>(data + l.offset);
+
+#ifndef NDEBUG
+			const Texture &tex = textures.get(texHandle);
+			assert(tex.tex);
+			assert(tex.renderTarget);
+#endif  // NDEBUG
+
+			descriptors[idx] = texHandle;
+		} break;
+
 		case DescriptorType::CombinedSampler: {
 			const CSampler &combined = *reinterpret_cast<const CSampler *>(data + l.offset);
 
@@ -2300,6 +3720,13 @@ void RendererImpl::bindDescriptorSet(unsigned int index, DSLayoutHandle layoutHa
 			descriptors[idx] = combined;
 		} break;
 
+		case DescriptorType::Empty:
+			break;
+
+		case DescriptorType::TextureTable:
+			UNREACHABLE();
+			break;
+
 		}
 
 		descIndex++;
@@ -2342,28 +3769,147 @@ bool RendererImpl::isRenderPassCompatible(const RenderPass &pass, const Framebuf
 }
 
 
+// update shadowed bindings, returns the range of slots [first, last) which changed
+template <typename T>
+static bool updateBindings(std::vector<ShadowedState<T> > &bound, const T *wanted, unsigned int count, unsigned int &first, unsigned int &last) {
+	if (bound.size() < count) {
+		bound.resize(count);
+	}
+
+	bool changed = false;
+	first = 0;
+	last  = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		if (bound[i].set(wanted[i])) {
+			if (!changed) {
+				first   = i;
+				changed = true;
+			}
+			last = i + 1;
+		}
+	}
+
+	return changed;
+}
+
+
+void RendererImpl::bindBuffers(GLenum target, std::vector<ShadowedState<BufferBinding> > &bound) {
+	unsigned int first = 0, last = 0;
+	if (!updateBindings(bound, scratchBuffers.data(), scratchBuffers.size(), first, last)) {
+		return;
+	}
+
+	if (multiBind) {
+		scratchNames.clear();
+		scratchOffsets.clear();
+		scratchSizes.clear();
+		for (unsigned int i = first; i < last; i++) {
+			const auto &b = scratchBuffers[i];
+			scratchNames.push_back(b.buffer);
+			scratchOffsets.push_back(b.offset);
+			scratchSizes.push_back(b.size);
+		}
+		glBindBuffersRange(target, first, last - first, scratchNames.data(), scratchOffsets.data(), scratchSizes.data());
+	} else {
+		for (unsigned int i = first; i < last; i++) {
+			const auto &b = scratchBuffers[i];
+			glBindBufferRange(target, i, b.buffer, b.offset, b.size);
+		}
+	}
+}
+
+
+void RendererImpl::bindTextureUnits() {
+	unsigned int first = 0, last = 0;
+	if (!updateBindings(glState.textureUnits, scratchNames.data(), scratchNames.size(), first, last)) {
+		return;
+	}
+
+	if (multiBind) {
+		glBindTextures(first, last - first, scratchNames.data() + first);
+	} else {
+		for (unsigned int i = first; i < last; i++) {
+			glBindTextureUnit(i, scratchNames[i]);
+		}
+	}
+}
+
+
+void RendererImpl::bindSamplerUnits() {
+	unsigned int first = 0, last = 0;
+	if (!updateBindings(glState.samplerUnits, scratchNames.data(), scratchNames.size(), first, last)) {
+		return;
+	}
+
+	if (multiBind) {
+		glBindSamplers(first, last - first, scratchNames.data() + first);
+	} else {
+		for (unsigned int i = first; i < last; i++) {
+			glBindSampler(i, scratchNames[i]);
+		}
+	}
+}
+
+
+void RendererImpl::pushConstants(const void *data, unsigned int size) {
+	assert(inFrame);
+	assert(validPipeline);
+	assert(data != nullptr);
+	assert(size > 0);
+	assert(size == pipelines.get(currentPipeline).desc.pushConstantSize_);
+
+	if (memcmp(pushConstantData.data(), data, size) == 0) {
+		return;
+	}
+
+	memcpy(pushConstantData.data(), data, size);
+	glNamedBufferSubData(pushConstantBuffer, 0, size, data);
+}
+
+
 void RendererImpl::rebindDescriptorSets() {
 	assert(decriptorSetsDirty);
 
 	const auto &pipeline  = pipelines.get(currentPipeline);
 	const auto &resources = pipeline.resources;
 
-	// TODO: only change what is necessary
+	// only slots whose contents changed since the last draw are rebound
+	scratchBuffers.clear();
 	for (unsigned int i = 0; i < resources.ubos.size(); i++) {
 		const auto &r = resources.ubos.at(i);
 		const auto &d = descriptors.at(r);
-		const Buffer &buffer = buffers.get(boost::get<BufferHandle>(d));
+		auto buffer = resolveBuffer(boost::get<BufferHandle>(d));
 		assert(resources.uboSizes[i] <= buffer.size);
-		glBindBufferRange(GL_UNIFORM_BUFFER, i, buffer.buffer, buffer.offset, buffer.size);
+		scratchBuffers.emplace_back(buffer.buffer, buffer.offset, buffer.size);
+	}
+	if (pipeline.desc.pushConstantSize_ > 0) {
+		scratchBuffers.emplace_back(pushConstantBuffer, 0, pipeline.desc.pushConstantSize_);
 	}
+	bindBuffers(GL_UNIFORM_BUFFER, glState.uniformBuffers);
 
+	scratchBuffers.clear();
 	for (unsigned int i = 0; i < resources.ssbos.size(); i++) {
 		const auto &r = resources.ssbos.at(i);
 		const auto &d = descriptors.at(r);
-		const Buffer &buffer = buffers.get(boost::get<BufferHandle>(d));
-		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, i, buffer.buffer, buffer.offset, buffer.size);
+		auto buffer = resolveBuffer(boost::get<BufferHandle>(d));
+		scratchBuffers.emplace_back(buffer.buffer, buffer.offset, buffer.size);
+	}
+	bindBuffers(GL_SHADER_STORAGE_BUFFER, glState.storageBuffers);
+
+	// images are rare and need a format each, so no multi-bind
+	if (glState.imageUnits.size() < resources.images.size()) {
+		glState.imageUnits.resize(resources.images.size());
+	}
+	for (unsigned int i = 0; i < resources.images.size(); i++) {
+		const auto &r = resources.images.at(i);
+		const auto &d = descriptors.at(r);
+		const Texture &tex = textures.get(boost::get<TextureHandle>(d));
+		if (glState.imageUnits[i].set(tex.tex)) {
+			glBindImageTexture(i, tex.tex, 0, GL_FALSE, 0, GL_READ_WRITE, glTexFormat(tex.format));
+		}
 	}
 
+	scratchNames.clear();
 	for (unsigned int i = 0; i < resources.textures.size(); i++) {
 		const auto &r = resources.textures.at(i);
 		const auto &d = descriptors.at(r);
@@ -2374,13 +3920,13 @@ void RendererImpl::rebindDescriptorSets() {
 		case 1: {
 			const CSampler &combined = boost::get<CSampler>(d);
 			const Texture &tex  = textures.get(combined.tex);
-			glBindTextureUnit(i, tex.tex);
+			scratchNames.push_back(tex.tex);
 		} break;
 
 		case 3: {
 			const TextureHandle &handle = boost::get<TextureHandle>(d);
 			const Texture &tex  = textures.get(handle);
-			glBindTextureUnit(i, tex.tex);
+			scratchNames.push_back(tex.tex);
 		} break;
 
 		default:
@@ -2388,7 +3934,9 @@ void RendererImpl::rebindDescriptorSets() {
 			break;
 		}
 	}
+	bindTextureUnits();
 
+	scratchNames.clear();
 	for (unsigned int i = 0; i < resources.samplers.size(); i++) {
 		const auto &r = resources.samplers.at(i);
 		const auto &d = descriptors.at(r);
@@ -2398,13 +3946,13 @@ void RendererImpl::rebindDescriptorSets() {
 		case 1: {
 			const CSampler &combined = boost::get<CSampler>(d);
 			const auto &sampler = samplers.get(combined.sampler);
-			glBindSampler(i, sampler.sampler);
+			scratchNames.push_back(sampler.sampler);
 		} break;
 
 		case 2: {
 			const SamplerHandle &handle = boost::get<SamplerHandle>(d);
 			const auto &sampler = samplers.get(handle);
-			glBindSampler(i, sampler.sampler);
+			scratchNames.push_back(sampler.sampler);
 		} break;
 
 		default:
@@ -2412,11 +3960,96 @@ void RendererImpl::rebindDescriptorSets() {
 			break;
 		}
 	}
+	bindSamplerUnits();
 
 	decriptorSetsDirty = false;
 }
 
 
+void RendererImpl::readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback) {
+	assert(handle);
+	assert(!inRenderPass);
+
+	auto &rt = renderTargets.get(handle);
+	assert(rt.numSamples == 1);
+	assert(rt.currentLayout == +Layout::TransferSrc);
+	assert(!isDepthFormat(rt.format));
+
+	// into a buffer so it doesn't stall, mapped once the frame's fence has signaled
+	PendingReadback r;
+	r.frameNum = frameNum;
+	r.width    = rt.width;
+	r.height   = rt.height;
+	r.format   = rt.format;
+	r.callback = std::move(callback);
+
+	GLsizei size = static_cast<GLsizei>(rt.width * rt.height * formatSize(rt.format));
+	glCreateBuffers(1, &r.buffer);
+	glNamedBufferStorage(r.buffer, size, nullptr, GL_MAP_READ_BIT);
+
+	// rows of RGB8 and R8 aren't always a multiple of 4 bytes
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.buffer);
+	glGetTextureImage(textures.get(rt.texture).tex, 0, glTexBaseFormat(rt.format), glTexType(rt.format), size, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	pendingReadbacks.emplace_back(std::move(r));
+}
+
+
+void RendererImpl::updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *data) {
+	assert(handle);
+	assert(!EphemeralBuffer::isEphemeral(handle));
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(size != 0);
+	assert(data != nullptr);
+	assert((offset % 4) == 0 && (size % 4) == 0);
+
+	const auto &buffer = buffers.get(handle);
+	assert(buffer.buffer);
+	assert(buffer.usage != +BufferUsage::Static);
+	assert(offset + size <= buffer.size);
+
+	// the driver orders this after earlier draws which read the buffer
+	glNamedBufferSubData(buffer.buffer, offset, size, data);
+}
+
+
+void RendererImpl::updateTexture(TextureHandle handle, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data) {
+	assert(handle);
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(width > 0 && height > 0);
+	assert(data != nullptr);
+
+	const auto &tex = textures.get(handle);
+	assert(tex.tex);
+	assert(!tex.renderTarget);
+	assert(x + width  <= std::max(tex.width  >> level, 1U));
+	assert(y + height <= std::max(tex.height >> level, 1U));
+	assert(size == formatDataSize(tex.format, width, height));
+
+	// staged like createTexture so the call doesn't wait for draws still reading the texture
+	UploadBuffer &upload = getUploadBuffer(size);
+	memcpy(upload.mapping, data, size);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+
+	if (isCompressedFormat(tex.format)) {
+		glCompressedTextureSubImage2D(tex.tex, level, x, y, width, height, glTexFormat(tex.format), size, nullptr);
+	} else {
+		// RGB8 rows aren't 4 byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTextureSubImage2D(tex.tex, level, x, y, width, height, glTexBaseFormat(tex.format), glTexType(tex.format), nullptr);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+
 void RendererImpl::blit(RenderTargetHandle source, RenderTargetHandle target) {
 	assert(source);
 	assert(target);
@@ -2520,6 +4153,31 @@ void RendererImpl::draw(unsigned int firstVertex, unsigned int vertexCount) {
 }
 
 
+void RendererImpl::drawInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(instanceCount > 0);
+	assert(vertexCount > 0);
+	const auto &p = pipelines.get(currentPipeline);
+	assert(!p.desc.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	// TODO: get primitive from current pipeline
+	if (instanceCount == 1) {
+		glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+	} else {
+		glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, instanceCount);
+	}
+}
+
+
 void RendererImpl::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
 #ifndef NDEBUG
 	assert(inRenderPass);
@@ -2570,6 +4228,157 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firs
 }
 
 
+void RendererImpl::drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	const auto &p = pipelines.get(currentPipeline);
+	assert(!p.desc.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	GLenum format        = idxBuf16Bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	unsigned int idxSize = idxBuf16Bit ? 2                 : 4 ;
+	auto ptr = reinterpret_cast<char *>(firstIndex * idxSize + indexBufByteOffset);
+	// TODO: get primitive from current pipeline
+	glDrawRangeElementsBaseVertex(GL_TRIANGLES, minIndex, maxIndex, vertexCount, format, ptr, static_cast<GLint>(vertexOffset));
+}
+
+
+void RendererImpl::drawIndirect(BufferHandle handle, unsigned int drawCount) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(drawCount > 0);
+	const auto &p = pipelines.get(currentPipeline);
+	assert(!p.desc.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	auto buffer = resolveBuffer(handle);
+	assert(buffer.type == +BufferType::Indirect);
+	assert(buffer.size >= drawCount * sizeof(DrawIndirectArgs));
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.buffer);
+	// TODO: get primitive from current pipeline
+	if (features.multiDrawIndirect) {
+		auto ptr = reinterpret_cast<const void *>(static_cast<uintptr_t>(buffer.offset));
+		glMultiDrawArraysIndirect(GL_TRIANGLES, ptr, drawCount, sizeof(DrawIndirectArgs));
+	} else {
+		for (unsigned int i = 0; i < drawCount; i++) {
+			auto ptr = reinterpret_cast<const void *>(static_cast<uintptr_t>(buffer.offset + i * sizeof(DrawIndirectArgs)));
+			glDrawArraysIndirect(GL_TRIANGLES, ptr);
+		}
+	}
+}
+
+
+void RendererImpl::drawIndexedIndirect(BufferHandle handle, unsigned int drawCount) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(drawCount > 0);
+	const auto &p = pipelines.get(currentPipeline);
+	assert(!p.desc.scissorTest_ || scissorSet);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	// firstIndex counts from the start of the element array buffer
+	assert(indexBufByteOffset == 0);
+
+	auto buffer = resolveBuffer(handle);
+	assert(buffer.type == +BufferType::Indirect);
+	assert(buffer.size >= drawCount * sizeof(DrawIndexedIndirectArgs));
+
+	GLenum format = idxBuf16Bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.buffer);
+	// TODO: get primitive from current pipeline
+	if (features.multiDrawIndirect) {
+		auto ptr = reinterpret_cast<const void *>(static_cast<uintptr_t>(buffer.offset));
+		glMultiDrawElementsIndirect(GL_TRIANGLES, format, ptr, drawCount, sizeof(DrawIndexedIndirectArgs));
+	} else {
+		for (unsigned int i = 0; i < drawCount; i++) {
+			auto ptr = reinterpret_cast<const void *>(static_cast<uintptr_t>(buffer.offset + i * sizeof(DrawIndexedIndirectArgs)));
+			glDrawElementsIndirect(GL_TRIANGLES, format, ptr);
+		}
+	}
+}
+
+
+bool RendererImpl::executeDrawList(const DrawList & /* list */) {
+	// features.parallelRecording is never set, a GL context is current on one thread only
+	return false;
+}
+
+
+void RendererImpl::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(validPipeline);
+	assert(x > 0);
+	assert(y > 0);
+	assert(z > 0);
+	pipelineDrawn = true;
+#endif  // NDEBUG
+	assert(pipelines.get(currentPipeline).compute);
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	glDispatchCompute(x, y, z);
+}
+
+
+void RendererImpl::dispatchIndirect(BufferHandle handle) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(validPipeline);
+	pipelineDrawn = true;
+#endif  // NDEBUG
+	assert(pipelines.get(currentPipeline).compute);
+
+	if (decriptorSetsDirty) {
+		rebindDescriptorSets();
+	}
+	assert(!decriptorSetsDirty);
+
+	auto buffer = resolveBuffer(handle);
+	assert(buffer.type == +BufferType::Indirect);
+	assert(buffer.size >= 3 * sizeof(uint32_t));
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer.buffer);
+	glDispatchComputeIndirect(buffer.offset);
+}
+
+
+void RendererImpl::computeBarrier() {
+	assert(inFrame);
+	assert(!inRenderPass);
+
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+
 } // namespace renderer
 
 
@@ -41,6 +41,7 @@ struct ShaderResources {
 	std::vector<DSIndex>        ssbos;
 	std::vector<DSIndex>        textures;
 	std::vector<DSIndex>        samplers;
+	std::vector<DSIndex>        images;
 
 	// TODO: debug only, hide when NDEBUG
 	std::vector<uint32_t>       uboSizes;
@@ -59,36 +60,36 @@ struct ShaderResources {
 
 
 struct Buffer {
-	bool           ringBufferAlloc;
 	uint32_t       size;
 	uint32_t       offset;
 	GLuint         buffer;
 	BufferType     type;
+	BufferUsage    usage;
 
 
 	Buffer()
-	: ringBufferAlloc(false)
-	, size(0)
+	: size(0)
 	, offset(0)
 	, buffer(0)
 	, type(BufferType::Invalid)
+	, usage(BufferUsage::Static)
 	{}
 
 	Buffer(const Buffer &)            = delete;
 	Buffer &operator=(const Buffer &) = delete;
 
 	Buffer(Buffer &&other) noexcept
-	: ringBufferAlloc(other.ringBufferAlloc)
-	, size(other.size)
+	: size(other.size)
 	, offset(other.offset)
 	, buffer(other.buffer)
 	, type(other.type)
+	, usage(other.usage)
 	{
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = 0;
 		other.type            = BufferType::Invalid;
+		other.usage           = BufferUsage::Static;
 	}
 
 	Buffer &operator=(Buffer &&other) noexcept {
@@ -98,23 +99,22 @@ struct Buffer {
 
 		assert(!buffer);
 
-		ringBufferAlloc       = other.ringBufferAlloc;
 		size                  = other.size;
 		offset                = other.offset;
 		buffer                = other.buffer;
 		type                  = other.type;
+		usage                 = other.usage;
 
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = 0;
 		other.type            = BufferType::Invalid;
+		other.usage           = BufferUsage::Static;
 
 		return *this;
 	}
 
 	~Buffer() {
-		assert(!ringBufferAlloc);
 		assert(size   == 0);
 		assert(offset == 0);
 		assert(!buffer);
@@ -123,6 +123,24 @@ struct Buffer {
 };
 
 
+// what a BufferHandle refers to, either a Buffer or an ephemeral ring buffer range
+struct ResolvedBuffer {
+	GLuint         buffer;
+	uint32_t       offset;
+	uint32_t       size;
+	BufferType     type;
+
+
+	ResolvedBuffer(GLuint buffer_, uint32_t offset_, uint32_t size_, BufferType type_)
+	: buffer(buffer_)
+	, offset(offset_)
+	, size(size_)
+	, type(type_)
+	{
+	}
+};
+
+
 struct DescriptorSetLayout {
 	std::vector<DescriptorLayout>  descriptors;
 
@@ -203,6 +221,8 @@ struct Framebuffer {
 	GLuint                                                   fbo;
 	RenderTargetHandle                                       depthStencil;
 	std::array<RenderTargetHandle, MAX_COLOR_RENDERTARGETS>  colors;
+	// blitted to at the end of the render pass
+	std::array<RenderTargetHandle, MAX_COLOR_RENDERTARGETS>  resolves;
 	RenderPassHandle                                         renderPass;
 
 
@@ -216,6 +236,8 @@ struct Framebuffer {
 	, sRGB(other.sRGB)
 	, fbo(other.fbo)
 	, depthStencil(other.depthStencil)
+	, colors(other.colors)
+	, resolves(other.resolves)
 	, renderPass(other.renderPass)
 	{
 		other.width        = 0;
@@ -223,10 +245,8 @@ struct Framebuffer {
 		other.numSamples   = 0;
 		other.sRGB         = false;
 		other.fbo          = 0;
-		// TODO: use std::move
-		assert(!other.colors[1]);
-		this->colors[0]    = other.colors[0];
-		other.colors[0]    = RenderTargetHandle();
+		other.colors.fill(RenderTargetHandle());
+		other.resolves.fill(RenderTargetHandle());
 		other.renderPass   = RenderPassHandle();
 		other.depthStencil = RenderTargetHandle();
 	}
@@ -255,6 +275,7 @@ struct Pipeline {
 	GLenum           srcBlend;
 	GLenum           destBlend;
 	ShaderResources  resources;
+	bool             compute;
 
 
 	Pipeline(const Pipeline &)            = delete;
@@ -266,12 +287,14 @@ struct Pipeline {
 	, srcBlend(other.srcBlend)
 	, destBlend(other.destBlend)
 	, resources(other.resources)
+	, compute(other.compute)
 	{
 		other.desc      = PipelineDesc();
 		other.shader    = 0;
 		other.srcBlend  = GL_NONE;
 		other.destBlend = GL_NONE;
 		other.resources = ShaderResources();
+		other.compute   = false;
 	}
 
 	Pipeline &operator=(Pipeline &&other) noexcept {
@@ -284,12 +307,14 @@ struct Pipeline {
 		srcBlend        = other.srcBlend;
 		destBlend       = other.destBlend;
 		resources       = other.resources;
+		compute         = other.compute;
 
 		other.desc      = PipelineDesc();
 		other.shader    = 0;
 		other.srcBlend  = GL_NONE;
 		other.destBlend = GL_NONE;
 		other.resources = ShaderResources();
+		other.compute   = false;
 
 		return *this;
 	}
@@ -298,6 +323,7 @@ struct Pipeline {
 	: shader(0)
 	, srcBlend(GL_ONE)
 	, destBlend(GL_ZERO)
+	, compute(false)
 	{
 	}
 
@@ -360,6 +386,7 @@ struct RenderPass {
 struct RenderTarget {
 	unsigned int   width, height;
 	unsigned int   numSamples;
+	unsigned int   layers;
 	Layout         currentLayout;
 	TextureHandle  texture;
 	TextureHandle  additionalView;
@@ -371,6 +398,7 @@ struct RenderTarget {
 	: width(0)
 	, height(0)
 	, numSamples(0)
+	, layers(0)
 	, currentLayout(Layout::Undefined)
 	, helperFBO(0)
 	, format(Format::Invalid)
@@ -384,6 +412,7 @@ struct RenderTarget {
 	: width(other.width)
 	, height(other.height)
 	, numSamples(other.numSamples)
+	, layers(other.layers)
 	, currentLayout(other.currentLayout)
 	, texture(other.texture)   // TODO: use std::move
 	, additionalView(other.additionalView)
@@ -393,6 +422,7 @@ struct RenderTarget {
 		other.width           = 0;
 		other.height          = 0;
 		other.numSamples      = 0;
+		other.layers          = 0;
 		other.currentLayout   = Layout::Undefined;
 		other.texture         = TextureHandle();
 		other.additionalView  = TextureHandle();
@@ -411,6 +441,7 @@ struct RenderTarget {
 		width                 = other.width;
 		height                = other.height;
 		numSamples            = other.numSamples;
+		layers                = other.layers;
 		currentLayout         = other.currentLayout;
 		texture               = other.texture;
 		additionalView        = other.additionalView;
@@ -420,6 +451,7 @@ struct RenderTarget {
 		other.width           = 0;
 		other.height          = 0;
 		other.numSamples      = 0;
+		other.layers          = 0;
 		other.currentLayout   = Layout::Undefined;
 		other.texture         = TextureHandle();
 		other.additionalView  = TextureHandle();
@@ -593,21 +625,32 @@ typedef boost::variant<BufferHandle, CSampler, SamplerHandle, TextureHandle> Des
 
 struct Frame : public FrameBase {
 	bool                      outstanding;
-	unsigned int              usedRingBufPtr;
-	std::vector<BufferHandle> ephemeralBuffers;
 	GLsync                    fence;
+	// begin and end timestamp query for each GPU timer
+	std::array<GLuint, 2 * MAX_GPU_TIMERS> timerQueries;
+	// statisticsTargets queries for each GPU timer, only with pipelineStatistics
+	std::vector<GLuint>       statisticsQueries;
+	// timestamp query after the final blit
+	GLuint                    presentQuery;
+	// RendererBase::now() minus GL timestamp at beginFrame
+	int64_t                   gpuClockOffset;
 
 
 	Frame()
 	: outstanding(false)
-	, usedRingBufPtr(0)
 	, fence(nullptr)
-	{}
+	, presentQuery(0)
+	, gpuClockOffset(0)
+	{
+		timerQueries.fill(0);
+	}
 
 	~Frame() {
 		assert(!outstanding);
 		assert(!fence);
-		assert(ephemeralBuffers.empty());
+		assert(timerQueries[0] == 0);
+		assert(statisticsQueries.empty());
+		assert(presentQuery == 0);
 	}
 
 	Frame(const Frame &)            = delete;
@@ -616,14 +659,17 @@ struct Frame : public FrameBase {
 	Frame(Frame &&other) noexcept
 	: FrameBase(std::move(other))
 	, outstanding(other.outstanding)
-	, usedRingBufPtr(other.usedRingBufPtr)
-	, ephemeralBuffers(std::move(other.ephemeralBuffers))
 	, fence(other.fence)
+	, timerQueries(other.timerQueries)
+	, statisticsQueries(std::move(other.statisticsQueries))
+	, presentQuery(other.presentQuery)
+	, gpuClockOffset(other.gpuClockOffset)
 	{
 		other.outstanding     = false;
 		other.fence           = nullptr;
-		other.usedRingBufPtr  = 0;
-		assert(other.ephemeralBuffers.empty());
+		other.timerQueries.fill(0);
+		other.statisticsQueries.clear();
+		other.presentQuery    = 0;
 	}
 
 	Frame &operator=(Frame &&other) noexcept {
@@ -632,23 +678,276 @@ struct Frame : public FrameBase {
 		other.outstanding      = false;
 
 		lastFrameNum           = other.lastFrameNum;
+		beginTime              = other.beginTime;
+		timerNames             = std::move(other.timerNames);
+
+		assert(ringPages.empty());
+		ringPages              = std::move(other.ringPages);
+		assert(other.ringPages.empty());
 
-		usedRingBufPtr         = other.usedRingBufPtr;
-		other.usedRingBufPtr   = 0;
+		arena                  = std::move(other.arena);
 
 		assert(!fence);
 		fence                  = other.fence;
 		other.fence            = nullptr;
 
-		assert(ephemeralBuffers.empty());
-		ephemeralBuffers       = std::move(other.ephemeralBuffers);
-		assert(other.ephemeralBuffers.empty());
+		assert(timerQueries[0] == 0);
+		timerQueries           = other.timerQueries;
+		other.timerQueries.fill(0);
+
+		assert(statisticsQueries.empty());
+		statisticsQueries      = std::move(other.statisticsQueries);
+		other.statisticsQueries.clear();
+
+		assert(presentQuery == 0);
+		presentQuery           = other.presentQuery;
+		other.presentQuery     = 0;
+		gpuClockOffset         = other.gpuClockOffset;
 
 		return *this;
 	}
 };
 
 
+// last value given to GL, used to skip redundant state changes
+// starts out unknown so the first set always reaches GL
+template <typename T>
+class ShadowedState {
+	T     value;
+	bool  known;
+
+public:
+
+	ShadowedState()
+	: value()
+	, known(false)
+	{
+	}
+
+	// returns true if the value changed and GL must be called
+	bool set(const T &newValue) {
+		if (known && value == newValue) {
+			return false;
+		}
+
+		value = newValue;
+		known = true;
+		return true;
+	}
+
+	bool is(const T &other) const {
+		return known && value == other;
+	}
+
+	void invalidate() {
+		known = false;
+	}
+};
+
+
+enum class GLCapability : uint8_t {
+	  DepthTest
+	, StencilTest
+	, CullFace
+	, ScissorTest
+	, Blend
+	, FramebufferSRGB
+	, Multisample
+	, Count
+};
+
+
+// how ephemeral data gets into the ring buffer
+enum class RingBufferMode : uint8_t {
+	  Persistent      // coherent persistent mapping, fastest
+	, Unsynchronized  // map each allocation unsynchronized, apitrace can see it
+	, SubData         // glNamedBufferSubData, fallback if mapping fails
+};
+
+
+struct RingPage : public RingPageBase {
+	GLuint             buffer;
+	// only in persistent mode
+	char               *mapping;
+
+
+	RingPage()
+	: buffer(0)
+	, mapping(nullptr)
+	{
+	}
+};
+
+
+// allocateEphemeral contents in the frame's arena when ring pages aren't mapped
+struct PendingEphemeralWrite {
+	unsigned int       page;
+	unsigned int       offset;
+	unsigned int       size;
+	const char         *contents;
+};
+
+
+struct GLSLStage {
+	GLenum             type;
+	std::string        name;
+	std::vector<char>  source;
+};
+
+
+struct ProgramBinary {
+	GLenum             format;
+	std::vector<char>  data;
+};
+
+
+// compile and link have been issued but the result not checked yet
+// with ARB_parallel_shader_compile the driver works on it in the background
+struct PendingProgram {
+	GLuint                  program;
+	std::vector<GLuint>     shaders;
+	std::vector<GLSLStage>  stages;
+	uint64_t                cacheKey;
+	bool                    fromCache;
+
+
+	PendingProgram()
+	: program(0)
+	, cacheKey(0)
+	, fromCache(false)
+	{
+	}
+};
+
+
+// started from precompileShaders, createPipeline takes it over
+struct StartedPipeline {
+	PendingProgram   program;
+	ShaderResources  resources;
+};
+
+
+struct BufferBinding {
+	GLuint      buffer;
+	GLintptr    offset;
+	GLsizeiptr  size;
+
+
+	BufferBinding()
+	: buffer(0)
+	, offset(0)
+	, size(0)
+	{
+	}
+
+	BufferBinding(GLuint buffer_, GLintptr offset_, GLsizeiptr size_)
+	: buffer(buffer_)
+	, offset(offset_)
+	, size(size_)
+	{
+	}
+
+	bool operator==(const BufferBinding &other) const {
+		return buffer == other.buffer
+		    && offset == other.offset
+		    && size   == other.size;
+	}
+};
+
+
+struct GLState {
+	ShadowedState<GLuint>                                   program;
+	ShadowedState<GLuint>                                   framebuffer;
+	ShadowedState<bool>                                     depthMask;
+	ShadowedState<GLenum>                                   depthFunc;
+	std::array<ShadowedState<bool>, static_cast<size_t>(GLCapability::Count)>  capabilities;
+	// func, ref, mask
+	ShadowedState<std::array<GLint, 3> >                    stencilFunc;
+	ShadowedState<GLenum>                                   stencilPassOp;
+	ShadowedState<GLenum>                                   blendEquation;
+	// source, destination
+	ShadowedState<std::pair<GLenum, GLenum> >               blendFunc;
+	ShadowedState<glm::vec4>                                blendColor;
+	ShadowedState<std::array<GLint, 4> >                    viewport;
+	ShadowedState<std::array<GLint, 4> >                    scissor;
+
+	// indexed by binding slot, grown as pipelines need more
+	std::vector<ShadowedState<BufferBinding> >              uniformBuffers;
+	std::vector<ShadowedState<BufferBinding> >              storageBuffers;
+	std::vector<ShadowedState<GLuint> >                     textureUnits;
+	std::vector<ShadowedState<GLuint> >                     samplerUnits;
+	std::vector<ShadowedState<GLuint> >                     imageUnits;
+
+
+	// GL reuses names, so bindings must be forgotten when objects are deleted
+	void invalidateBindings() {
+		uniformBuffers.clear();
+		storageBuffers.clear();
+		textureUnits.clear();
+		samplerUnits.clear();
+		imageUnits.clear();
+	}
+
+	void invalidate() {
+		program.invalidate();
+		framebuffer.invalidate();
+		depthMask.invalidate();
+		depthFunc.invalidate();
+		for (auto &c : capabilities) {
+			c.invalidate();
+		}
+		stencilFunc.invalidate();
+		stencilPassOp.invalidate();
+		blendEquation.invalidate();
+		blendFunc.invalidate();
+		blendColor.invalidate();
+		viewport.invalidate();
+		scissor.invalidate();
+		invalidateBindings();
+	}
+};
+
+
+// persistently mapped staging for texture data
+// the driver copies from it on the GPU timeline instead of from client memory
+// reusable once the fence after its last upload has signaled
+struct UploadBuffer {
+	GLuint        buffer;
+	char         *mapping;
+	unsigned int  size;
+	GLsync        fence;
+
+
+	UploadBuffer()
+	: buffer(0)
+	, mapping(nullptr)
+	, size(0)
+	, fence(nullptr)
+	{
+	}
+};
+
+
+// copy of a rendertarget, read once its frame has synced
+struct PendingReadback {
+	uint32_t          frameNum;
+	GLuint            buffer;
+	unsigned int      width, height;
+	Format            format;
+	ReadbackCallback  callback;
+
+
+	PendingReadback()
+	: frameNum(0)
+	, buffer(0)
+	, width(0)
+	, height(0)
+	, format(Format::Invalid)
+	{
+	}
+};
+
+
 struct RendererImpl : public RendererBase {
 	SDL_Window                               *window;
 	SDL_GLContext                            context;
@@ -656,6 +955,8 @@ struct RendererImpl : public RendererBase {
 	HashMap<GLenum, int>                     glValues;
 
 	std::vector<Frame>                       frames;
+	std::vector<PendingReadback>             pendingReadbacks;
+	std::vector<UploadBuffer>                uploadBuffers;
 
 	ResourceContainer<Buffer>                buffers;
 	ResourceContainer<DescriptorSetLayout>   dsLayouts;
@@ -668,19 +969,49 @@ struct RendererImpl : public RendererBase {
 	ResourceContainer<Texture>               textures;
 	ResourceContainer<VertexShader>          vertexShaders;
 
-	GLuint                                   ringBuffer;
-	bool                                     persistentMapInUse;
-	char                                     *persistentMapping;
+	std::vector<RingPage>                    ringPages;
+	RingBufferMode                           ringBufferMode;
+	// uploaded by resolveBuffer, the caller is done writing by the time it's used
+	std::vector<PendingEphemeralWrite>       pendingEphemeralWrites;
 
 	PipelineHandle                           currentPipeline;
 	RenderPassHandle                         currentRenderPass;
 	FramebufferHandle                        currentFramebuffer;
 
+	GLState                                  glState;
+	bool                                     multiBind;
+	// reused between rebindDescriptorSets calls to avoid allocations
+	std::vector<BufferBinding>               scratchBuffers;
+	std::vector<GLuint>                      scratchNames;
+	std::vector<GLintptr>                    scratchOffsets;
+	std::vector<GLsizeiptr>                  scratchSizes;
+
 	bool                                     decriptorSetsDirty;
-	HashMap<DSIndex, Descriptor>             descriptors;
+	// from the current frame's arena, replaced in beginFrame and presentFrame
+	ArenaHashMap<DSIndex, Descriptor>        descriptors;
+
+	// push constants are emulated with a small UBO bound after the pipeline's own UBOs
+	// contents are shadowed so repeated identical pushes don't touch the buffer
+	GLuint                                   pushConstantBuffer;
+	std::array<char, MAX_PUSH_CONSTANT_SIZE> pushConstantData;
+
+	// linked programs keyed on GLSL source and driver identity
+	bool                                     programBinaries;
+	bool                                     programCacheDirty;
+	uint64_t                                 programCacheSeed;
+	HashMap<uint64_t, ProgramBinary>         programCache;
+
+	// ARB_parallel_shader_compile
+	bool                                     parallelShaderCompile;
+	// precompiled pipelines whose programs haven't been started yet
+	std::vector<PipelineDesc>                precompileQueue;
+	// keyed on programKey
+	HashMap<uint64_t, StartedPipeline>       startedPipelines;
 
 	bool                                     debug;
 	bool                                     tracing;
+	// RendererDesc::pipelineStatistics and GL_ARB_pipeline_statistics_query
+	bool                                     pipelineStatistics;
 	GLuint                                   vao;
 	bool                                     idxBuf16Bit;
 	unsigned int                             indexBufByteOffset;
@@ -689,12 +1020,40 @@ struct RendererImpl : public RendererBase {
 	bool isRenderPassCompatible(const RenderPass &pass, const Framebuffer &fb);
 
 	void rebindDescriptorSets();
+	ResolvedBuffer resolveBuffer(BufferHandle handle);
+	void flushEphemeralWrites();
+
+	PendingProgram startProgram(const std::vector<GLSLStage> &stages);
+	GLuint finishProgram(PendingProgram &pending);
+	GLuint createProgram(const std::vector<GLSLStage> &stages);
+	UploadBuffer &getUploadBuffer(unsigned int size);
+	void destroyUploadBuffer(UploadBuffer &upload);
+	static uint64_t programKey(const PipelineDesc &desc, unsigned int views);
+	std::vector<GLSLStage> pipelineStages(const PipelineDesc &desc, unsigned int views, ShaderResources &shaderResources, PipelineStats &pipelineStats);
+	void startPrecompiledPrograms();
+	void loadProgramCache();
+	void saveProgramCache();
+	void bindBuffers(GLenum target, std::vector<ShadowedState<BufferBinding> > &bound);
+	void bindTextureUnits();
+	void bindSamplerUnits();
+
+	void setCapability(GLCapability cap, bool enabled);
+	void useProgram(GLuint program);
+	void bindFramebuffer(GLuint fbo);
+	void setDepthMask(bool enabled);
 
 	bool recreateSwapchain() WARN_UNUSED_RESULT;
-	void recreateRingBuffer(unsigned int newSize);
-	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
-
-	bool waitForFrame(unsigned int frameIdx) WARN_UNUSED_RESULT;
+	void createRingPage(unsigned int idx, unsigned int size);
+	void destroyRingPage(unsigned int idx);
+	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignment, unsigned int &page);
+	unsigned int ringBufferAllocateShared(unsigned int size, unsigned int &page);
+	void switchRingPage(unsigned int size);
+	void finishRingFrame();
+	void freeRingPage(unsigned int idx);
+	void releaseRingPages(Frame &frame);
+
+	// timeout in nanoseconds, 0 to poll
+	bool waitForFrame(unsigned int frameIdx, uint64_t timeout) WARN_UNUSED_RESULT;
 	void deleteFrameInternal(Frame &f);
 
 	void createRTHelperFBO(RenderTarget &rt);
@@ -703,8 +1062,11 @@ struct RendererImpl : public RendererBase {
 
 	~RendererImpl();
 
+	static std::vector<DeviceInfo> listDevices();
+
 
 	bool isRenderTargetFormatSupported(Format format) const;
+	bool isTextureFormatSupported(Format format) const;
 
 	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
 	VertexShaderHandle   createVertexShader(const std::string &name, const ShaderMacros &macros);
@@ -712,14 +1074,20 @@ struct RendererImpl : public RendererBase {
 	FramebufferHandle    createFramebuffer(const FramebufferDesc &desc);
 	RenderPassHandle     createRenderPass(const RenderPassDesc &desc);
 	PipelineHandle       createPipeline(const PipelineDesc &desc);
-	BufferHandle         createBuffer(BufferType type, uint32_t size, const void *contents);
+	PipelineHandle       createComputePipeline(const ComputePipelineDesc &desc);
+	void                 precompileShaders(const PipelineDesc &desc);
+	void                 precompileShaders(const ComputePipelineDesc &desc);
+	BufferHandle         createBuffer(const BufferDesc &desc);
 	BufferHandle         createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
+	EphemeralAllocation  allocateEphemeral(BufferType type, uint32_t size);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
 
 	DSLayoutHandle       createDescriptorSetLayout(const DescriptorLayout *layout);
 
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
+	RenderTargetHandle   getSwapchainRenderTarget() const;
+	unsigned int         getTextureTableIndex(TextureHandle handle) const;
 
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
@@ -739,9 +1107,20 @@ struct RendererImpl : public RendererBase {
 	bool beginFrame();
 	void presentFrame(RenderTargetHandle image);
 
+	void beginAsyncCompute();
+	void endAsyncCompute();
+
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	bool beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	void invalidateStaticRenderPass(RenderPassHandle rpHandle);
 	void endRenderPass();
 
+	void beginGPUTimer(const std::string &name);
+	void endGPUTimer();
+
+	void pushDebugGroup(const char *name);
+	void popDebugGroup();
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -752,13 +1131,27 @@ struct RendererImpl : public RendererBase {
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
 
 	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
+	void pushConstants(const void *data, unsigned int size);
 
+	void updateBuffer(BufferHandle buffer, uint32_t offset, uint32_t size, const void *data);
+	void updateTexture(TextureHandle texture, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data);
 	void blit(RenderTargetHandle source, RenderTargetHandle target);
+	void readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback);
 	void resolveMSAA(RenderTargetHandle source, RenderTargetHandle target);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
+	void drawInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndirect(BufferHandle buffer, unsigned int drawCount);
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount);
+	// false if Renderer should replay it call by call
+	bool executeDrawList(const DrawList &list);
+
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+	void dispatchIndirect(BufferHandle buffer);
+	void computeBarrier();
 };
 
 
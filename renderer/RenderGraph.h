@@ -3,6 +3,7 @@
 
 
 #include "utils/Hash.h"
+#include "utils/Profiler.h"
 
 
 namespace renderer {
@@ -60,14 +61,21 @@ public:
 	struct PassDesc {
 		PassDesc()
 		: depthStencil_(Default<RT>::value)
+		, depthStencilPassBegin_(PassBegin::DontCare)
 		, numSamples_(1)
+		, views_(1)
 		, clearDepthAttachment(false)
 		, depthClearValue(1.0f)
+		, stencilPassBegin_(PassBegin::DontCare)
+		, storeStencil_(false)
+		, stencilClearValue(0)
+		, staticContents_(false)
 		{
 			for (auto &rt : colorRTs_) {
 				rt.id            = Default<RT>::value;
 				rt.passBegin     = PassBegin::DontCare;
 				rt.clearValue    = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+				rt.resolve       = Default<RT>::value;
 			}
 		}
 
@@ -79,8 +87,18 @@ public:
 		PassDesc &operator=(const PassDesc &)     = default;
 		PassDesc &operator=(PassDesc &&) noexcept = default;
 
-		PassDesc &depthStencil(RT ds, PassBegin) {
-			depthStencil_ = ds;
+		PassDesc &depthStencil(RT ds, PassBegin pb) {
+			depthStencil_          = ds;
+			depthStencilPassBegin_ = pb;
+			return *this;
+		}
+
+		PassDesc &stencil(PassBegin pb, bool store, uint8_t clear = 0) {
+			stencilPassBegin_ = pb;
+			storeStencil_     = store;
+			if (pb == +PassBegin::Clear) {
+				stencilClearValue = clear;
+			}
 			return *this;
 		}
 
@@ -95,6 +113,17 @@ public:
 			return *this;
 		}
 
+		// resolve multisampled color attachment index into a single-sampled rendertarget
+		// at the end of the pass instead of a separate resolveMSAA operation
+		PassDesc &resolve(unsigned int index, RT id) {
+			assert(index < MAX_COLOR_RENDERTARGETS);
+			assert(id != Default<RT>::value);
+			assert(colorRTs_[index].id != Default<RT>::value);
+			assert(colorRTs_[index].id != id);
+			colorRTs_[index].resolve        = id;
+			return *this;
+		}
+
 		PassDesc &clearDepth(float v) {
 			clearDepthAttachment  = true;
 			depthClearValue       = v;
@@ -111,25 +140,114 @@ public:
 			return *this;
 		}
 
+		// multiview, see RenderPassDesc::views
+		PassDesc &views(unsigned int n) {
+			views_ = n;
+			return *this;
+		}
+
 		PassDesc &inputRendertarget(RT id) {
 			auto success DEBUG_ASSERTED = inputRendertargets.emplace(id);
 			assert(success.second);
 			return *this;
 		}
 
+		// the function records the same commands every frame
+		// so they're replayed until invalidateStaticPasses or the next build
+		// it must bind all its descriptor sets and not use ephemeral buffers
+		// ignored if the pass has external inputs
+		PassDesc &staticContents(bool s) {
+			staticContents_ = s;
+			return *this;
+		}
+
+		// evaluated every frame in render, if false the pass is skipped
+		// so it can be toggled without rebuilding the graph
+		// the pass must only draw on top of existing contents
+		// so all attachments are Keep and nothing is resolved
+		PassDesc &enabledIf(std::function<bool()> f) {
+			enabled_ = std::move(f);
+			return *this;
+		}
+
+		// output depends only on the inputs and these counters
+		// while none of them changes and no cached pass it reads from runs
+		// the pass is skipped and its attachments keep what it rendered last time
+		// so they get their own memory, everything it reads must come from cached passes
+		PassDesc &cachedOn(const uint64_t &version) {
+			versions_.push_back(&version);
+			return *this;
+		}
+
 		struct RTInfo {
 			RT             id;
 			PassBegin      passBegin;
 			glm::vec4      clearValue;
+			RT             resolve;
 		};
 
 		RT                                           depthStencil_;
+		PassBegin                                    depthStencilPassBegin_;
 		std::array<RTInfo, MAX_COLOR_RENDERTARGETS>  colorRTs_;
 		HashSet<RT>                                  inputRendertargets;
 		unsigned int                                 numSamples_;
+		unsigned int                                 views_;
 		std::string                                  name_;
 		bool                                         clearDepthAttachment;
 		float                                        depthClearValue;
+		PassBegin                                    stencilPassBegin_;
+		bool                                         storeStencil_;
+		uint8_t                                      stencilClearValue;
+		bool                                         staticContents_;
+		std::function<bool()>                        enabled_;
+		std::vector<const uint64_t *>                versions_;
+	};
+
+	struct ComputePassDesc {
+		ComputePassDesc()
+		: async_(false)
+		{}
+
+		~ComputePassDesc() { }
+
+		ComputePassDesc(const ComputePassDesc &)                = default;
+		ComputePassDesc(ComputePassDesc &&) noexcept            = default;
+
+		ComputePassDesc &operator=(const ComputePassDesc &)     = default;
+		ComputePassDesc &operator=(ComputePassDesc &&) noexcept = default;
+
+		ComputePassDesc &name(const std::string &str) {
+			name_ = str;
+			return *this;
+		}
+
+		ComputePassDesc &inputRendertarget(RT id) {
+			assert(storageRendertargets.find(id) == storageRendertargets.end());
+			auto success DEBUG_ASSERTED = inputRendertargets.emplace(id);
+			assert(success.second);
+			return *this;
+		}
+
+		// read and written as storage image, stays in General layout during the pass
+		ComputePassDesc &storageRendertarget(RT id) {
+			assert(id != Default<RT>::value);
+			assert(inputRendertargets.find(id) == inputRendertargets.end());
+			auto success DEBUG_ASSERTED = storageRendertargets.emplace(id);
+			assert(success.second);
+			return *this;
+		}
+
+		// run on the async compute queue if the renderer supports it
+		// consecutive async passes share one section, only the first such run is async
+		ComputePassDesc &async(bool a) {
+			async_ = a;
+			return *this;
+		}
+
+		HashSet<RT>                                  inputRendertargets;
+		HashSet<RT>                                  storageRendertargets;
+		std::string                                  name_;
+		bool                                         async_;
 	};
 
 	typedef  std::function<void(RP, PassResources &)>  RenderPassFunc;
@@ -137,18 +255,83 @@ public:
 
 private:
 
+	// color attachments followed by depth and resolve targets
+	typedef std::array<RenderTargetHandle, 2 * MAX_COLOR_RENDERTARGETS + 1> FramebufferKey;
+
+	// enough for ping-ponging temporal AA targets
+	// or rendering into each swapchain image
+	static const unsigned int maxExternalFramebuffers = 4;
+
+
+	struct LayoutChange {
+		RT             rt;
+		Layout         from;
+		Layout         to;
+	};
+
+
 	struct RenderPass {
 		RenderPassHandle   handle;
 		FramebufferHandle  fb;
 		RenderPassFunc     func;
 		PassDesc           desc;
 		RenderPassDesc     rpDesc;
+		// views of inputs, built once in build
+		// external ones are updated every frame in render
+		PassResources      resources;
+		// framebuffers of passes with external RTs, keyed by attachment handles
+		std::vector<std::pair<FramebufferKey, FramebufferHandle> >  externalFramebuffers;
+		// desc.staticContents_ unless the inputs change every frame
+		bool               staticContents;
+		// cached passes only, the counters at the last run
+		std::vector<uint64_t>      cachedVersions;
+		// earlier cached passes writing what this one reads
+		std::vector<RP>            cachedProducers;
+		// done instead of the pass when it's skipped
+		std::vector<LayoutChange>  skipTransitions;
+		// frameNumber of the last run, 0 if it must run again
+		uint64_t           lastRun;
+
+		RenderPass()
+		: staticContents(false)
+		, lastRun(0)
+		{
+		}
+
+		bool cached() const {
+			return !desc.versions_.empty();
+		}
+	};
+
+
+	struct ComputePass {
+		RenderPassFunc       func;
+		ComputePassDesc      desc;
+		HashMap<RT, Layout>  initialLayouts;
+		HashMap<RT, Layout>  finalLayouts;
+		PassResources        resources;
 	};
 
 
 	struct InternalRT {
 		RenderTargetHandle  handle;
 		RenderTargetDesc    desc;
+		// if set, handle belongs to that rendertarget and is only borrowed
+		RT                  aliasOf;
+
+		InternalRT()
+		: aliasOf(Default<RT>::value)
+		{
+		}
+	};
+
+
+	// first and last operation using a rendertarget
+	struct Lifetime {
+		unsigned int  first;
+		unsigned int  last;
+		// first use reads the previous contents
+		bool          firstReads;
 	};
 
 
@@ -304,6 +487,76 @@ private:
 	}
 
 
+	void addViews(Renderer &r, PassResources &res, RT rt) const {
+		// get rendertarget desc
+		auto rtIt = rendertargets.find(rt);
+		assert(rtIt != rendertargets.end());
+
+		// get format
+		Format fmt = getFormat(rtIt->second);
+		assert(fmt != +Format::Invalid);
+
+		{
+			// get view from renderer, add to res
+			TextureHandle view = r.getRenderTargetView(getHandle(rtIt->second), fmt);
+			res.rendertargets[std::make_pair(rt, fmt)] = view;
+			// also add it with Format::Invalid so default works easier
+			res.rendertargets[std::make_pair(rt, Format::Invalid)] = view;
+		}
+
+		// do the same for additional view format if there is one
+		Format additionalFmt = getAdditionalViewFormat(rtIt->second);
+		if (additionalFmt != +Format::Invalid) {
+			assert(additionalFmt != fmt);
+			TextureHandle view = r.getRenderTargetView(getHandle(rtIt->second), additionalFmt);
+			res.rendertargets[std::make_pair(rt, additionalFmt)] = view;
+		}
+	}
+
+
+	// internal views are known after build, external ones only get a placeholder
+	void buildPassResources(Renderer &renderer, RP id, const HashSet<RT> &inputs, PassResources &res) {
+		for (RT rt : inputs) {
+			auto it = rendertargets.find(rt);
+			assert(it != rendertargets.end());
+			if (isExternal(it->second)) {
+				externalInputs.push_back(ExternalInput{ id, rt, RenderTargetHandle() });
+			} else {
+				addViews(renderer, res, rt);
+			}
+		}
+	}
+
+
+	FramebufferKey framebufferKey(const RenderPass &rp) const {
+		const auto &desc = rp.desc;
+
+		FramebufferKey key;
+		for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+			const auto &rt = desc.colorRTs_[i];
+			if (rt.id != Default<RT>::value) {
+				auto it = rendertargets.find(rt.id);
+				assert(it != rendertargets.end());
+				key[i] = getHandle(it->second);
+			}
+
+			if (rt.resolve != Default<RT>::value) {
+				auto it = rendertargets.find(rt.resolve);
+				assert(it != rendertargets.end());
+				key[MAX_COLOR_RENDERTARGETS + 1 + i] = getHandle(it->second);
+			}
+		}
+
+		if (desc.depthStencil_ != Default<RT>::value) {
+			auto it = rendertargets.find(desc.depthStencil_);
+			assert(it != rendertargets.end());
+			key[MAX_COLOR_RENDERTARGETS] = getHandle(it->second);
+		}
+
+		return key;
+	}
+
+
 	void buildRenderPassFramebuffer(Renderer &renderer, RenderPass &rp) {
 		const auto &desc = rp.desc;
 
@@ -324,6 +577,12 @@ private:
 				assert(it != rendertargets.end());
 				fbDesc.color(i, getHandle(it->second));
 			}
+
+			if (rt.resolve != Default<RT>::value) {
+				auto it = rendertargets.find(rt.resolve);
+				assert(it != rendertargets.end());
+				fbDesc.resolve(i, getHandle(it->second));
+			}
 		}
 
 		// TODO: cache framebuffers
@@ -337,6 +596,8 @@ private:
 		RT             source;
 		RT             dest;
 		Layout         finalLayout;
+		// source stays in this layout around the blit when later passes read it
+		Layout         sourceLayout;
 	};
 
 	struct ResolveMSAA {
@@ -345,168 +606,753 @@ private:
 		Layout         finalLayout;
 	};
 
-	struct Pipeline {
-		PipelineDesc    desc;
-		PipelineHandle  handle;
+	struct Compute {
+		RP             id;
 	};
 
-	typedef boost::variant<Blit, RP, ResolveMSAA> Operation;
-
+	// armed by requestReadback, does nothing otherwise
+	struct Readback {
+		RT                source;
+		// what the operations after this expect, Undefined if nothing uses it
+		Layout            finalLayout;
+		ReadbackCallback  callback;
+	};
 
-	RGState                                          state;
-	std::exception_ptr                               storedException;
-	bool                                             hasExternalRTs;
-	RP                                               currentRP;
-	std::vector<Operation>                           operations;
-	RT                                               finalTarget;
+	struct Pipeline {
+		PipelineDesc      desc;
+		PipelineHandle    handle;
+		RenderPassHandle  renderPass;
+		// generation of the graph which stopped using it
+		unsigned int      retired;
+
+		Pipeline()
+		: retired(0)
+		{
+		}
+	};
 
-	HashMap<RT, Rendertarget>                        rendertargets;
+	struct ComputePipeline {
+		ComputePipelineDesc  desc;
+		PipelineHandle       handle;
+		unsigned int         retired;
 
-	// TODO: use hash map
-	std::vector<Pipeline>                            pipelines;
+		ComputePipeline()
+		: retired(0)
+		{
+		}
+	};
 
-	HashMap<RP, RenderPass>                          renderPasses;
-	HashSet<RP>                                      renderpassesWithExternalRTs;
+	// rendertarget or renderpass of an earlier graph which a later one can take over
+	template <typename Desc, typename Handle> struct Retired {
+		Desc          desc;
+		Handle        handle;
+		unsigned int  retired;
 
+		Retired(const Desc &desc_, Handle handle_, unsigned int retired_)
+		: desc(desc_)
+		, handle(handle_)
+		, retired(retired_)
+		{
+		}
+	};
 
-	RenderGraph(const RenderGraph &)                = delete;
-	RenderGraph(RenderGraph &&) noexcept            = delete;
+	typedef boost::variant<Blit, RP, ResolveMSAA, Compute, Readback> Operation;
 
-	RenderGraph &operator=(const RenderGraph &)     = delete;
-	RenderGraph &operator=(RenderGraph &&) noexcept = delete;
 
+	// calls f(rt, reads, writes) for every rendertarget used by operation
+	template <typename F>
+	void forEachRTUse(const Operation &op, F &&f) const {
+		struct UseVisitor final : public boost::static_visitor<void> {
+			const RenderGraph &rg;
+			F                 &f;
 
-public:
 
+			UseVisitor(const RenderGraph &rg_, F &f_)
+			: rg(rg_)
+			, f(f_)
+			{
+			}
 
-	RenderGraph()
-	: state(RGState::Invalid)
-	, hasExternalRTs(false)
-	, currentRP(Default<RP>::value)
-	, finalTarget(Default<RT>::value)
-	{
-	}
+			void operator()(const Blit &b) const {
+				f(b.source, true,  false);
+				f(b.dest,   false, true);
+			}
 
+			void operator()(const RP &rpId) const {
+				auto it = rg.renderPasses.find(rpId);
+				assert(it != rg.renderPasses.end());
+				const auto &desc = it->second.desc;
 
-	~RenderGraph() {
-	}
+				if (desc.depthStencil_ != Default<RT>::value) {
+					bool keep = (desc.depthStencilPassBegin_ == +PassBegin::Keep) || (desc.stencilPassBegin_ == +PassBegin::Keep);
+					f(desc.depthStencil_, keep, true);
+				}
 
+				for (const auto &rt : desc.colorRTs_) {
+					if (rt.id != Default<RT>::value) {
+						f(rt.id, rt.passBegin == +PassBegin::Keep, true);
+					}
 
-	void reset(Renderer &renderer, std::function<void(void)> processEvents) {
-		assert(state == +RGState::Invalid || state == +RGState::Ready);
-		state = RGState::Building;
+					if (rt.resolve != Default<RT>::value) {
+						f(rt.resolve, false, true);
+					}
+				}
 
-		renderPasses.clear();
-		renderpassesWithExternalRTs.clear();
-		hasExternalRTs = false;
+				for (RT inputRT : desc.inputRendertargets) {
+					f(inputRT, true, false);
+				}
+			}
 
-		for (auto &p : pipelines) {
-			renderer.deletePipeline(p.handle);
-			p.handle = PipelineHandle();
-		}
-		pipelines.clear();
+			void operator()(const ResolveMSAA &resolve) const {
+				f(resolve.source, true,  false);
+				f(resolve.dest,   false, true);
+			}
 
-		for (auto &rt : rendertargets) {
-			assert(rt.first != Default<RT>::value);
+			void operator()(const Compute &c) const {
+				auto it = rg.computePasses.find(c.id);
+				assert(it != rg.computePasses.end());
+				const auto &desc = it->second.desc;
 
-			visitRendertarget(rt.second
-							  , nopExternal
-							  , [&] (InternalRT &i) {
-								  assert(i.handle);
-								  renderer.deleteRenderTarget(i.handle);
-								  i.handle = RenderTargetHandle();
-							  }
-							 );
-		}
-		rendertargets.clear();
+				// we don't know which parts of storage images get written
+				// so assume old contents are needed
+				for (RT storageRT : desc.storageRendertargets) {
+					f(storageRT, true, true);
+				}
 
-		for (auto &p : renderPasses) {
-			auto &rp = p.second;
-			if (rp.handle) {
-				renderer.deleteRenderPass(rp.handle);
-				rp.handle = RenderPassHandle();
+				for (RT inputRT : desc.inputRendertargets) {
+					f(inputRT, true, false);
+				}
 			}
 
-			if (rp.fb) {
-				renderer.deleteFramebuffer(rp.fb);
-				rp.fb = FramebufferHandle();
+			void operator()(const Readback &rb) const {
+				f(rb.source, true, false);
 			}
-		}
-		renderPasses.clear();
-
-		operations.clear();
+		};
 
-		while (!renderer.waitForDeviceIdle()) {
-			processEvents();
-		}
+		boost::apply_visitor(UseVisitor(*this, f), op);
 	}
 
 
-	void renderTarget(RT rt, const RenderTargetDesc &desc) {
-		assert(state == +RGState::Building);
-		assert(rt != Default<RT>::value);
+	const RenderPass *cachedPass(const Operation &op) const {
+		const RP *rpId = boost::get<RP>(&op);
+		if (!rpId) {
+			return nullptr;
+		}
 
-		InternalRT temp1;
-		temp1.desc   = desc;
-		auto DEBUG_ASSERTED temp2 = rendertargets.emplace(rt, temp1);
-		assert(temp2.second);
+		const auto &rp = renderPasses.at(*rpId);
+		return rp.cached() ? &rp : nullptr;
 	}
 
 
-	void externalRenderTarget(RT rt, Format format, Layout initialLayout, Layout finalLayout) {
-		assert(state == +RGState::Building);
-		assert(rt != Default<RT>::value);
-		assert(rendertargets.find(rt) == rendertargets.end());
+	// updates layouts to what op leaves its rendertargets in once build has decided them
+	// depth attachments are always left in ShaderRead so they're not tracked
+	void trackLayouts(const Operation &op, HashMap<RT, Layout> &layouts) const {
+		struct TrackVisitor final : public boost::static_visitor<void> {
+			const RenderGraph    &rg;
+			HashMap<RT, Layout>  &layouts;
 
-		hasExternalRTs = true;
-
-		ExternalRT e;
-		e.format = format;
-		e.initialLayout = initialLayout;
-		e.finalLayout   = finalLayout;
-		// leave handle undefined, it's set later by bindExternalRT
-		auto temp DEBUG_ASSERTED = rendertargets.emplace(rt, e);
-		assert(temp.second);
-	}
 
+			TrackVisitor(const RenderGraph &rg_, HashMap<RT, Layout> &layouts_)
+			: rg(rg_)
+			, layouts(layouts_)
+			{
+			}
 
-	void renderPass(RP rp, const PassDesc &desc, RenderPassFunc f) {
-		assert(state == +RGState::Building);
+			void operator()(const Blit &b) const {
+				layouts[b.source] = b.sourceLayout;
+				layouts[b.dest]   = b.finalLayout;
+			}
 
-		RenderPass temp1;
-		temp1.desc   = desc;
-		temp1.func   = f;
+			void operator()(const RP &rpId) const {
+				const auto &rp = rg.renderPasses.at(rpId);
+				for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+					if (rp.desc.colorRTs_[i].id != Default<RT>::value) {
+						layouts[rp.desc.colorRTs_[i].id] = rp.rpDesc.color(i).finalLayout;
+					}
 
-		auto temp2 DEBUG_ASSERTED = renderPasses.emplace(rp, temp1);
-		assert(temp2.second);
+					if (rp.desc.colorRTs_[i].resolve != Default<RT>::value) {
+						layouts[rp.desc.colorRTs_[i].resolve] = rp.rpDesc.color(i).resolveFinalLayout;
+					}
+				}
+			}
 
-		operations.push_back(rp);
-	}
+			void operator()(const ResolveMSAA &resolve) const {
+				layouts[resolve.source] = Layout::TransferSrc;
+				layouts[resolve.dest]   = resolve.finalLayout;
+			}
 
+			void operator()(const Readback &rb) const {
+				layouts[rb.source] = (rb.finalLayout == +Layout::Undefined) ? +Layout::TransferSrc : rb.finalLayout;
+			}
 
-	void resolveMSAA(RT source, RT dest) {
-		assert(state == +RGState::Building);
+			void operator()(const Compute &c) const {
+				for (const auto &p : rg.computePasses.at(c.id).finalLayouts) {
+					layouts[p.first] = p.second;
+				}
+			}
+		};
 
-		ResolveMSAA op;
-		op.source = source;
-		op.dest   = dest;
-		operations.push_back(op);
+		boost::apply_visitor(TrackVisitor(*this, layouts), op);
 	}
 
 
-	void blit(RT source, RT dest) {
-		assert(state == +RGState::Building);
+	// order operations so every rendertarget is written before it's read
+	// a rendertarget with only one writer doesn't depend on the order operations were added in
+	// with several writers the order they were added in is kept for all of its users
+	// otherwise add order is only used to break ties
+	void sortOperations() {
+		unsigned int numOps = static_cast<unsigned int>(operations.size());
 
-		Blit op;
-		op.source = source;
-		op.dest   = dest;
-		operations.push_back(op);
-	}
+		struct Access {
+			unsigned int  op;
+			bool          reads;
+			bool          writes;
+		};
 
+		HashMap<RT, std::vector<Access> > accesses;
+		for (unsigned int i = 0; i < numOps; i++) {
+			forEachRTUse(operations[i], [&] (RT rt, bool reads, bool writes) {
+				auto &v = accesses[rt];
+				if (!v.empty() && v.back().op == i) {
+					v.back().reads  = v.back().reads  || reads;
+					v.back().writes = v.back().writes || writes;
+				} else {
+					Access a;
+					a.op     = i;
+					a.reads  = reads;
+					a.writes = writes;
+					v.push_back(a);
+				}
+			});
+		}
+
+		std::vector<std::vector<unsigned int> > successors(numOps);
+		std::vector<unsigned int>                numPredecessors(numOps, 0);
+		auto addEdge = [&] (unsigned int from, unsigned int to) {
+			if (from != to) {
+				successors[from].push_back(to);
+				numPredecessors[to]++;
+			}
+		};
+
+		for (const auto &p : accesses) {
+			const auto &v = p.second;
+
+			unsigned int numWriters = 0;
+			unsigned int writer     = 0;
+			for (const auto &a : v) {
+				if (a.writes) {
+					numWriters++;
+					writer = a.op;
+				}
+			}
+
+			if (numWriters == 1) {
+				for (const auto &a : v) {
+					addEdge(writer, a.op);
+				}
+			} else if (numWriters > 1) {
+				bool                       haveWrite = false;
+				unsigned int               lastWrite = 0;
+				std::vector<unsigned int>  readsSinceWrite;
+				for (const auto &a : v) {
+					if (haveWrite) {
+						addEdge(lastWrite, a.op);
+					}
+
+					if (a.writes) {
+						for (unsigned int r : readsSinceWrite) {
+							addEdge(r, a.op);
+						}
+						readsSinceWrite.clear();
+						haveWrite = true;
+						lastWrite = a.op;
+					} else {
+						readsSinceWrite.push_back(a.op);
+					}
+				}
+			}
+		}
+
+		// there are only a handful of operations so a linear search is fine
+		std::vector<unsigned int>  order;
+		std::vector<bool>          scheduled(numOps, false);
+		order.reserve(numOps);
+		while (order.size() < numOps) {
+			unsigned int next = numOps;
+			for (unsigned int i = 0; i < numOps; i++) {
+				if (!scheduled[i] && numPredecessors[i] == 0) {
+					next = i;
+					break;
+				}
+			}
+
+			if (next == numOps) {
+				throw std::runtime_error("RenderGraph operations have circular dependencies");
+			}
+
+			scheduled[next] = true;
+			order.push_back(next);
+			for (unsigned int s : successors[next]) {
+				assert(numPredecessors[s] > 0);
+				numPredecessors[s]--;
+			}
+		}
+
+		std::vector<Operation> sorted;
+		sorted.reserve(numOps);
+		for (unsigned int i : order) {
+			sorted.push_back(std::move(operations[i]));
+		}
+		operations = std::move(sorted);
+	}
+
+
+	// remove operations whose results never reach the final rendertarget
+	// writes to external rendertargets are always kept since they are used outside the graph
+	void removeUnusedOperations() {
+		HashSet<RT> needed;
+		needed.insert(finalTarget);
+		for (const auto &p : rendertargets) {
+			if (isExternal(p.second)) {
+				needed.insert(p.first);
+			}
+		}
+
+		std::vector<bool> used(operations.size(), false);
+		for (unsigned int i = static_cast<unsigned int>(operations.size()); i > 0; i--) {
+			const auto &op = operations[i - 1];
+
+			bool isUsed = false;
+			forEachRTUse(op, [&] (RT rt, bool /* reads */, bool writes) {
+				if (writes && needed.find(rt) != needed.end()) {
+					isUsed = true;
+				}
+			});
+
+			// compute passes which only write buffers
+			if (const Compute *c = boost::get<Compute>(&op)) {
+				auto it = computePasses.find(c->id);
+				assert(it != computePasses.end());
+				if (it->second.desc.storageRendertargets.empty()) {
+					isUsed = true;
+				}
+			}
+			// readbacks are used outside the graph
+			if (boost::get<Readback>(&op)) {
+				isUsed = true;
+			}
+			if (!isUsed) {
+				continue;
+			}
+			used[i - 1] = true;
+
+			// anything before this which only writes these is overwritten
+			forEachRTUse(op, [&] (RT rt, bool reads, bool writes) {
+				if (writes && !reads) {
+					auto it = rendertargets.find(rt);
+					assert(it != rendertargets.end());
+					if (!isExternal(it->second)) {
+						needed.erase(rt);
+					}
+				}
+			});
+
+			forEachRTUse(op, [&] (RT rt, bool reads, bool /* writes */) {
+				if (reads) {
+					needed.insert(rt);
+				}
+			});
+		}
+
+		std::vector<Operation> remaining;
+		remaining.reserve(operations.size());
+		for (unsigned int i = 0; i < operations.size(); i++) {
+			if (used[i]) {
+				remaining.push_back(std::move(operations[i]));
+				continue;
+			}
+
+			const auto &op = operations[i];
+			if (const RP *rp = boost::get<RP>(&op)) {
+				LOG_DEBUG("Removing unused renderpass %s\n", to_string(*rp));
+				renderPasses.erase(*rp);
+			} else if (const Compute *c = boost::get<Compute>(&op)) {
+				LOG_DEBUG("Removing unused compute pass %s\n", to_string(c->id));
+				computePasses.erase(c->id);
+			} else {
+				LOG_DEBUG("Removing unused blit or resolve\n");
+			}
+		}
+		operations = std::move(remaining);
+	}
+
+
+	static bool canAlias(const RenderTargetDesc &a, const RenderTargetDesc &b) {
+		return (a.width()                == b.width())
+		    && (a.height()               == b.height())
+		    && (a.numSamples()           == b.numSamples())
+		    && (a.layers()               == b.layers())
+		    && (a.format()               == b.format())
+		    && (a.additionalViewFormat() == b.additionalViewFormat())
+		    && (a.storage()              == b.storage())
+		    && (a.transient()            == b.transient());
+	}
+
+
+	RenderTargetHandle takeOldRendertarget(const RenderTargetDesc &desc) {
+		for (auto it = oldRendertargets.begin(); it != oldRendertargets.end(); it++) {
+			if (canAlias(it->desc, desc)) {
+				RenderTargetHandle handle = it->handle;
+				oldRendertargets.erase(it);
+				return handle;
+			}
+		}
+
+		return RenderTargetHandle();
+	}
+
+
+	RenderPassHandle takeOldRenderPass(const RenderPassDesc &desc) {
+		for (auto it = oldRenderPasses.begin(); it != oldRenderPasses.end(); it++) {
+			if (it->desc == desc) {
+				RenderPassHandle handle = it->handle;
+				oldRenderPasses.erase(it);
+				return handle;
+			}
+		}
+
+		return RenderPassHandle();
+	}
+
+
+	void deleteOldPipelines(Renderer &renderer) {
+		for (auto &p : oldPipelines) {
+			renderer.deletePipeline(p.second.handle);
+			p.second.handle = PipelineHandle();
+		}
+		oldPipelines.clear();
+
+		for (auto &p : oldComputePipelines) {
+			renderer.deletePipeline(p.handle);
+			p.handle = PipelineHandle();
+		}
+		oldComputePipelines.clear();
+	}
+
+
+	// old rendertargets and renderpasses which retainedBuilds graphs since have had a chance to take over
+	// pipelines are created lazily after build so deleteExpiredPipelines gives them one graph more
+	bool expired(unsigned int retired) const {
+		return retired + retainedBuilds <= generation;
+	}
+
+
+	void deleteExpiredPipelines(Renderer &renderer) {
+		for (auto it = oldPipelines.begin(); it != oldPipelines.end(); ) {
+			if (it->second.retired + retainedBuilds < generation) {
+				renderer.deletePipeline(it->second.handle);
+				it = oldPipelines.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		for (auto it = oldComputePipelines.begin(); it != oldComputePipelines.end(); ) {
+			if (it->retired + retainedBuilds < generation) {
+				renderer.deletePipeline(it->handle);
+				it = oldComputePipelines.erase(it);
+			} else {
+				it++;
+			}
+		}
+	}
+
+
+	void deleteOldResources(Renderer &renderer) {
+		deleteOldPipelines(renderer);
+
+		for (auto &rt : oldRendertargets) {
+			renderer.deleteRenderTarget(rt.handle);
+		}
+		oldRendertargets.clear();
+
+		for (auto &rp : oldRenderPasses) {
+			renderer.deleteRenderPass(rp.handle);
+		}
+		oldRenderPasses.clear();
+	}
+
+
+	RGState                                          state;
+	std::exception_ptr                               storedException;
+	bool                                             hasExternalRTs;
+	RP                                               currentRP;
+	std::vector<Operation>                           operations;
+	RT                                               finalTarget;
+
+	HashMap<RT, Rendertarget>                        rendertargets;
+
+	// keyed by PipelineDesc::hashValue
+	HashMap<uint64_t, Pipeline>                      pipelines;
+	// TODO: use hash map
+	std::vector<ComputePipeline>                     computePipelines;
+
+	HashMap<RP, RenderPass>                          renderPasses;
+	HashMap<RP, ComputePass>                         computePasses;
+	HashSet<RP>                                      renderpassesWithExternalRTs;
+	// external rendertargets used as inputs, their views change when the bound rendertarget does
+	struct ExternalInput {
+		RP                  pass;
+		RT                  rt;
+		// rendertarget whose views are currently in the pass resources
+		RenderTargetHandle  viewsOf;
+	};
+	std::vector<ExternalInput>                       externalInputs;
+
+	// incremented by every reset
+	unsigned int                                     generation;
+	// incremented by every render, RenderPass::lastRun of cached passes
+	uint64_t                                         frameNumber;
+	// see setRetainedBuilds
+	unsigned int                                     retainedBuilds;
+
+	// objects of earlier graphs, reused by build and createPipeline if they match
+	// whatever expires is deleted through the renderer so the GPU can still be using it
+	std::vector<Retired<RenderTargetDesc, RenderTargetHandle> >  oldRendertargets;
+	std::vector<Retired<RenderPassDesc, RenderPassHandle> >      oldRenderPasses;
+	HashMap<uint64_t, Pipeline>                                  oldPipelines;
+	std::vector<ComputePipeline>                                 oldComputePipelines;
+
+
+	RenderGraph(const RenderGraph &)                = delete;
+	RenderGraph(RenderGraph &&) noexcept            = delete;
+
+	RenderGraph &operator=(const RenderGraph &)     = delete;
+	RenderGraph &operator=(RenderGraph &&) noexcept = delete;
 
-	void presentRenderTarget(RT rt) {
-		assert(state == +RGState::Building);
-		assert(rt != Default<RT>::value);
+
+public:
+
+
+	RenderGraph()
+	: state(RGState::Invalid)
+	, hasExternalRTs(false)
+	, currentRP(Default<RP>::value)
+	, finalTarget(Default<RT>::value)
+	, generation(0)
+	, frameNumber(0)
+	, retainedBuilds(0)
+	{
+	}
+
+
+	~RenderGraph() {
+	}
+
+
+	// keep unused rendertargets, renderpasses and pipelines around for this many rebuilds
+	// so switching back to an earlier configuration doesn't create anything
+	// costs the memory of the retained rendertargets, 0 deletes them at the next build
+	void setRetainedBuilds(unsigned int n) {
+		retainedBuilds = n;
+	}
+
+
+	// doesn't wait for the GPU, objects the next graph can't use are deleted by build
+	void reset(Renderer &renderer) {
+		assert(state == +RGState::Invalid || state == +RGState::Ready);
+		state = RGState::Building;
+
+		renderpassesWithExternalRTs.clear();
+		externalInputs.clear();
+		hasExternalRTs = false;
+
+		generation++;
+
+		// pipelines no graph since has taken over are not going to be used again
+		deleteExpiredPipelines(renderer);
+
+		for (auto &p : pipelines) {
+			p.second.retired = generation;
+			auto DEBUG_ASSERTED temp = oldPipelines.emplace(p.first, std::move(p.second));
+			assert(temp.second);
+		}
+		pipelines.clear();
+
+		for (auto &p : computePipelines) {
+			p.retired = generation;
+			oldComputePipelines.emplace_back(std::move(p));
+		}
+		computePipelines.clear();
+
+		for (auto &rt : rendertargets) {
+			assert(rt.first != Default<RT>::value);
+
+			visitRendertarget(rt.second
+							  , nopExternal
+							  , [&] (InternalRT &i) {
+								  assert(i.handle);
+								  if (i.aliasOf == Default<RT>::value) {
+									  oldRendertargets.emplace_back(i.desc, i.handle, generation);
+								  }
+								  i.handle = RenderTargetHandle();
+							  }
+							 );
+		}
+		rendertargets.clear();
+
+		for (auto &p : renderPasses) {
+			auto &rp = p.second;
+			if (rp.handle) {
+				// the next graph could reuse the handle with different inputs
+				if (rp.staticContents) {
+					renderer.invalidateStaticRenderPass(rp.handle);
+				}
+				oldRenderPasses.emplace_back(rp.rpDesc, rp.handle, generation);
+				rp.handle = RenderPassHandle();
+			}
+
+			if (rp.fb) {
+				renderer.deleteFramebuffer(rp.fb);
+				rp.fb = FramebufferHandle();
+			}
+
+			for (auto &fb : rp.externalFramebuffers) {
+				renderer.deleteFramebuffer(fb.second);
+			}
+			rp.externalFramebuffers.clear();
+		}
+		renderPasses.clear();
+		computePasses.clear();
+
+		operations.clear();
+	}
+
+
+	// delete everything, for shutdown
+	void clear(Renderer &renderer) {
+		reset(renderer);
+		deleteOldResources(renderer);
+		state = RGState::Invalid;
+	}
+
+
+	void renderTarget(RT rt, const RenderTargetDesc &desc) {
+		assert(state == +RGState::Building);
+		assert(rt != Default<RT>::value);
+
+		InternalRT temp1;
+		temp1.desc   = desc;
+		auto DEBUG_ASSERTED temp2 = rendertargets.emplace(rt, temp1);
+		assert(temp2.second);
+	}
+
+
+	void externalRenderTarget(RT rt, Format format, Layout initialLayout, Layout finalLayout) {
+		assert(state == +RGState::Building);
+		assert(rt != Default<RT>::value);
+		assert(rendertargets.find(rt) == rendertargets.end());
+
+		hasExternalRTs = true;
+
+		ExternalRT e;
+		e.format = format;
+		e.initialLayout = initialLayout;
+		e.finalLayout   = finalLayout;
+		// leave handle undefined, it's set later by bindExternalRT
+		auto temp DEBUG_ASSERTED = rendertargets.emplace(rt, e);
+		assert(temp.second);
+	}
+
+
+	void renderPass(RP rp, const PassDesc &desc, RenderPassFunc f) {
+		assert(state == +RGState::Building);
+
+		RenderPass temp1;
+		temp1.desc   = desc;
+		temp1.func   = f;
+
+		auto temp2 DEBUG_ASSERTED = renderPasses.emplace(rp, temp1);
+		assert(temp2.second);
+
+		operations.push_back(rp);
+	}
+
+
+	// a compute pass without storage rendertargets writes only buffers
+	// the graph doesn't track those so it's never removed
+	// and it runs before every operation added after it
+	void computePass(RP rp, const ComputePassDesc &desc, RenderPassFunc f) {
+		assert(state == +RGState::Building);
+		assert(renderPasses.find(rp) == renderPasses.end());
+
+		ComputePass temp1;
+		temp1.desc   = desc;
+		temp1.func   = f;
+
+		auto temp2 DEBUG_ASSERTED = computePasses.emplace(rp, temp1);
+		assert(temp2.second);
+
+		Compute op;
+		op.id = rp;
+		operations.push_back(op);
+	}
+
+
+	void resolveMSAA(RT source, RT dest) {
+		assert(state == +RGState::Building);
+
+		ResolveMSAA op;
+		op.source = source;
+		op.dest   = dest;
+		operations.push_back(op);
+	}
+
+
+	void blit(RT source, RT dest) {
+		assert(state == +RGState::Building);
+
+		Blit op;
+		op.source       = source;
+		op.dest         = dest;
+		op.finalLayout  = Layout::Undefined;
+		op.sourceLayout = Layout::TransferSrc;
+		operations.push_back(op);
+	}
+
+
+	// makes rt readable at this point so requestReadback can copy it
+	void readback(RT rt) {
+		assert(state == +RGState::Building);
+
+		Readback op;
+		op.source      = rt;
+		op.finalLayout = Layout::Undefined;
+		operations.push_back(op);
+	}
+
+
+	// copy rt to CPU memory during the next render
+	// rt needs a readback operation in the graph
+	void requestReadback(RT rt, ReadbackCallback callback) {
+		assert(state == +RGState::Ready);
+
+		for (auto &op : operations) {
+			Readback *rb = boost::get<Readback>(&op);
+			if (rb && rb->source == rt) {
+				rb->callback = std::move(callback);
+				return;
+			}
+		}
+
+		throw std::runtime_error(std::string("RenderGraph has no readback of ") + to_string(rt));
+	}
+
+
+	void presentRenderTarget(RT rt) {
+		assert(state == +RGState::Building);
+		assert(rt != Default<RT>::value);
 
 		finalTarget = rt;
 	}
@@ -520,19 +1366,245 @@ public:
 
 		LOG("RenderGraph::build start\n");
 
-		// TODO: sort operations so they don't have to be added in order
+		sortOperations();
 
-		// create rendertargets
-		// TODO: remove unused RTs first
+		removeUnusedOperations();
+
+		// skipping a conditional pass must leave every attachment as it was
+		// so later passes see valid contents either way
+		for (const auto &p : renderPasses) {
+			const auto &desc = p.second.desc;
+			if (!desc.enabled_) {
+				continue;
+			}
+
+			bool valid = true;
+			if (desc.depthStencil_ != Default<RT>::value) {
+				valid = valid && (desc.depthStencilPassBegin_ == +PassBegin::Keep) && !desc.clearDepthAttachment;
+				valid = valid && (desc.stencilPassBegin_ != +PassBegin::Clear);
+			}
+			for (const auto &rt : desc.colorRTs_) {
+				if (rt.id != Default<RT>::value) {
+					valid = valid && (rt.passBegin == +PassBegin::Keep) && (rt.resolve == Default<RT>::value);
+				}
+			}
+
+			if (!valid) {
+				throw std::runtime_error(std::string("Conditional renderpass ") + to_string(p.first) + " doesn't keep all its attachments");
+			}
+		}
+
+		// a skipped cached pass must see the same inputs it rendered from last time
+		// so nothing else can write what it uses
+		HashSet<RT> cachedOutputs;
+		{
+			HashSet<RT> otherOutputs;
+			for (const auto &op : operations) {
+				bool cached = (cachedPass(op) != nullptr);
+				forEachRTUse(op, [&] (RT rt, bool /* reads */, bool writes) {
+					if (writes) {
+						if (cached) {
+							cachedOutputs.insert(rt);
+						} else {
+							otherOutputs.insert(rt);
+						}
+					}
+				});
+			}
+
+			for (const auto &op : operations) {
+				const RenderPass *rp = cachedPass(op);
+				if (!rp) {
+					continue;
+				}
+
+				const RP &rpId = boost::get<RP>(op);
+				if (rp->desc.enabled_) {
+					throw std::runtime_error(std::string("Cached renderpass ") + to_string(rpId) + " can't be conditional");
+				}
+
+				forEachRTUse(op, [&] (RT rt, bool /* reads */, bool /* writes */) {
+					if (isExternal(rendertargets.at(rt)) || otherOutputs.find(rt) != otherOutputs.end()) {
+						throw std::runtime_error(std::string("Cached renderpass ") + to_string(rpId) + " uses " + to_string(rt) + " which changes outside cached passes");
+					}
+				});
+			}
+		}
+
+		// rendertargets written by compute passes need storage image usage
+		for (const auto &p : computePasses) {
+			for (RT storageRT : p.second.desc.storageRendertargets) {
+				auto it = rendertargets.find(storageRT);
+				assert(it != rendertargets.end());
+				visitRendertarget(it->second
+								  , [] (ExternalRT & /* e */) {
+									  // external RTs can't be storage images
+									  assert(false);
+								  }
+								  , [] (InternalRT &i) {
+									  i.desc.storage(true);
+								  }
+								 );
+			}
+		}
+
+		// find out which operations use each rendertarget
+		HashMap<RT, Lifetime> lifetimes;
+		for (unsigned int i = 0; i < operations.size(); i++) {
+			forEachRTUse(operations[i], [&] (RT rt, bool reads, bool /* writes */) {
+				assert(rendertargets.find(rt) != rendertargets.end());
+
+				auto it = lifetimes.find(rt);
+				if (it == lifetimes.end()) {
+					Lifetime l;
+					l.first      = i;
+					l.last       = i;
+					l.firstReads = reads;
+					lifetimes.emplace(rt, l);
+				} else {
+					assert(it->second.last <= i);
+					if (it->second.first == i) {
+						it->second.firstReads = it->second.firstReads || reads;
+					}
+					it->second.last = i;
+				}
+			});
+		}
+
+		// final target is read by present after all operations
+		{
+			auto it = lifetimes.find(finalTarget);
+			assert(it != lifetimes.end());
+			it->second.last = static_cast<unsigned int>(operations.size());
+		}
+
+		// outputs of cached passes are read in later frames until the pass runs again
+		for (RT rt : cachedOutputs) {
+			auto &lifetime      = lifetimes.at(rt);
+			lifetime.firstReads = true;
+			lifetime.last       = static_cast<unsigned int>(operations.size());
+		}
+
+		// rendertargets which are only attachments of a single render pass
+		// and don't need their previous contents never leave that pass
+		// so they might not need memory at all
 		for (auto &p : rendertargets) {
-			assert(p.first != Default<RT>::value);
+			if (isExternal(p.second) || p.first == finalTarget) {
+				continue;
+			}
 
-			visitRendertarget(p.second
-							  , nopExternal
-							  , [&] (InternalRT &i) {
-								  i.handle = renderer.createRenderTarget(i.desc);
-							  }
-							 );
+			auto lifetimeIt = lifetimes.find(p.first);
+			if (lifetimeIt == lifetimes.end()) {
+				continue;
+			}
+
+			const auto &lifetime = lifetimeIt->second;
+			if (lifetime.first != lifetime.last || lifetime.firstReads) {
+				continue;
+			}
+
+			const RP *rpId = boost::get<RP>(&operations[lifetime.first]);
+			if (!rpId) {
+				continue;
+			}
+
+			// resolve targets are read after the pass
+			const auto &desc = renderPasses.at(*rpId).desc;
+			bool attachment = (desc.depthStencil_ == p.first);
+			for (const auto &rt : desc.colorRTs_) {
+				if (rt.id == p.first) {
+					attachment = true;
+				}
+			}
+
+			if (attachment) {
+				LOG_DEBUG("Rendertarget %s is transient\n", to_string(p.first));
+				boost::get<InternalRT>(p.second).desc.transient(true);
+			}
+		}
+
+		// remove rendertargets nothing uses
+		for (auto it = rendertargets.begin(); it != rendertargets.end(); ) {
+			assert(it->first != Default<RT>::value);
+			if (!isExternal(it->second) && lifetimes.find(it->first) == lifetimes.end()) {
+				LOG_DEBUG("Removing unused rendertarget %s\n", to_string(it->first));
+				it = rendertargets.erase(it);
+			} else {
+				it++;
+			}
+		}
+
+		// create rendertargets
+		// internal rendertargets whose lifetimes don't overlap share the same one
+		// if their descriptions match
+		{
+			std::vector<std::pair<unsigned int, RT> > order;
+			order.reserve(rendertargets.size());
+			for (const auto &p : rendertargets) {
+				if (!isExternal(p.second)) {
+					order.emplace_back(lifetimes.at(p.first).first, p.first);
+				}
+			}
+			std::sort(order.begin(), order.end());
+
+			struct Physical {
+				RT            owner;
+				unsigned int  last;
+			};
+			std::vector<Physical> physicals;
+
+			for (const auto &o : order) {
+				RT rt = o.second;
+				const auto &lifetime = lifetimes.at(rt);
+				auto &i = boost::get<InternalRT>(rendertargets.at(rt));
+				assert(!i.handle);
+				assert(i.aliasOf == Default<RT>::value);
+
+				// rendertargets which read before writing need their own contents
+				if (!lifetime.firstReads) {
+					for (auto &phys : physicals) {
+						if (phys.last >= lifetime.first) {
+							continue;
+						}
+
+						auto &owner = boost::get<InternalRT>(rendertargets.at(phys.owner));
+						if (!canAlias(owner.desc, i.desc)) {
+							continue;
+						}
+
+						LOG_DEBUG("Rendertarget %s aliases %s\n", to_string(rt), to_string(phys.owner));
+						i.handle  = owner.handle;
+						i.aliasOf = phys.owner;
+						phys.last = lifetime.last;
+						break;
+					}
+				}
+
+				if (!i.handle) {
+					// same goes for taking over one from the previous graph
+					if (!lifetime.firstReads) {
+						i.handle = takeOldRendertarget(i.desc);
+					}
+
+					if (!i.handle) {
+						i.handle = renderer.createRenderTarget(i.desc);
+					}
+
+					Physical phys;
+					phys.owner = rt;
+					phys.last  = lifetime.last;
+					physicals.push_back(phys);
+				}
+			}
+
+			for (auto it = oldRendertargets.begin(); it != oldRendertargets.end(); ) {
+				if (expired(it->retired)) {
+					renderer.deleteRenderTarget(it->handle);
+					it = oldRendertargets.erase(it);
+				} else {
+					it++;
+				}
+			}
 		}
 
 		// automatically decide layouts
@@ -552,20 +1624,40 @@ public:
 								 );
 			}
 
+			// rendertargets some later operation reads before overwriting
+			// attachments not in here are not stored at the end of a pass
+			// external ones, the final target and those the next frame reads are needed after the graph
+			HashSet<RT> contentsNeeded;
+			contentsNeeded.insert(finalTarget);
+			for (const auto &rt : rendertargets) {
+				if (isExternal(rt.second) || lifetimes.at(rt.first).firstReads) {
+					contentsNeeded.insert(rt.first);
+				}
+			}
+
 			struct LayoutVisitor final : public boost::static_visitor<void> {
 				HashMap<RT, Layout> &currentLayouts;
 				RenderGraph &rg;
+				const HashSet<RT> &contentsNeeded;
 
 
-				LayoutVisitor(HashMap<RT, Layout> &currentLayouts_, RenderGraph &rg_)
+				LayoutVisitor(HashMap<RT, Layout> &currentLayouts_, RenderGraph &rg_, const HashSet<RT> &contentsNeeded_)
 				: currentLayouts(currentLayouts_)
 				, rg(rg_)
+				, contentsNeeded(contentsNeeded_)
 				{
 				}
 
 				void operator()(Blit &b) const {
 					b.finalLayout            = currentLayouts[b.dest];
-					currentLayouts[b.source] = Layout::TransferSrc;
+
+					auto it = currentLayouts.find(b.source);
+					if (it != currentLayouts.end() && it->second == +Layout::ShaderRead) {
+						b.sourceLayout = Layout::ShaderRead;
+					} else {
+						b.sourceLayout = Layout::TransferSrc;
+					}
+					currentLayouts[b.source] = b.sourceLayout;
 				}
 
 				void operator()(RP &rpId) const {
@@ -578,6 +1670,7 @@ public:
 
 					rpDesc.name(desc.name_);
 					rpDesc.numSamples(desc.numSamples_);
+					rpDesc.views(desc.views_);
 
 					if (desc.depthStencil_ != Default<RT>::value) {
 						auto rtIt = rg.rendertargets.find(desc.depthStencil_);
@@ -586,10 +1679,18 @@ public:
 						Format fmt = getFormat(rtIt->second);
 						assert(fmt != +Format::Invalid);
 
-						rpDesc.depthStencil(fmt, PassBegin::DontCare);
+						rpDesc.depthStencil(fmt, desc.depthStencilPassBegin_);
 						if (desc.clearDepthAttachment) {
 							rpDesc.clearDepth(desc.depthClearValue);
 						}
+
+						// nothing reads it after this pass
+						bool store = (contentsNeeded.find(desc.depthStencil_) != contentsNeeded.end());
+						if (!store) {
+							rpDesc.discardDepth();
+						}
+						// ignored by the backend if the format has no stencil
+						rpDesc.stencil(desc.stencilPassBegin_, desc.storeStencil_ && store, desc.stencilClearValue);
 					}
 
 					for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
@@ -609,39 +1710,238 @@ public:
 								initial = Layout::ColorAttachment;
 							}
 
-							Layout final = Layout::ColorAttachment;
-							auto layoutIt = currentLayouts.find(rtId);
-							if (layoutIt == currentLayouts.end()) {
-								// unused
-								// TODO: remove it entirely
-							} else {
-								final = layoutIt->second;
-							}
-							assert(final != +Layout::Undefined);
-							assert(final != +Layout::TransferDst);
+							RT resolveId = desc.colorRTs_[i].resolve;
+							Layout final = Layout::ColorAttachment;
+							auto layoutIt = currentLayouts.find(rtId);
+							if (layoutIt != currentLayouts.end()) {
+								final = layoutIt->second;
+							}
+							// this includes multisampled contents nothing reads once resolved
+							bool discard = (contentsNeeded.find(rtId) == contentsNeeded.end());
+							assert(final != +Layout::Undefined);
+							assert(final != +Layout::TransferDst);
+
+							rpDesc.color(i, fmt, pb, initial, final, desc.colorRTs_[i].clearValue);
+							if (discard) {
+								rpDesc.discardColor(i);
+							}
+							currentLayouts[rtId] = initial;
+
+							if (resolveId != Default<RT>::value) {
+								auto resolveIt = rg.rendertargets.find(resolveId);
+								assert(resolveIt != rg.rendertargets.end());
+
+								Layout resolveFinal = Layout::ShaderRead;
+								auto resolveLayoutIt = currentLayouts.find(resolveId);
+								if (resolveLayoutIt != currentLayouts.end()) {
+									resolveFinal = resolveLayoutIt->second;
+								}
+
+								rpDesc.resolve(i, getFormat(resolveIt->second), resolveFinal);
+								// whole target is overwritten
+								currentLayouts[resolveId] = Layout::Undefined;
+							}
+						}
+					}
+
+					// mark input rt current layout as shader read
+					for (RT inputRT : desc.inputRendertargets) {
+						currentLayouts[inputRT] = Layout::ShaderRead;
+					}
+				}
+
+				void operator()(ResolveMSAA &resolve) const {
+					resolve.finalLayout            = currentLayouts[resolve.dest];
+					currentLayouts[resolve.source] = Layout::TransferSrc;
+				}
+
+				void operator()(Readback &rb) const {
+					rb.finalLayout = Layout::Undefined;
+					auto layoutIt = currentLayouts.find(rb.source);
+					if (layoutIt != currentLayouts.end()) {
+						rb.finalLayout = layoutIt->second;
+					}
+					currentLayouts[rb.source] = Layout::TransferSrc;
+				}
+
+				void operator()(Compute &c) const {
+					auto it = rg.computePasses.find(c.id);
+					assert(it != rg.computePasses.end());
+
+					auto &cp = it->second;
+					for (RT storageRT : cp.desc.storageRendertargets) {
+						Layout final = Layout::General;
+						auto layoutIt = currentLayouts.find(storageRT);
+						if (layoutIt != currentLayouts.end()) {
+							final = layoutIt->second;
+						}
+						assert(final != +Layout::Undefined);
+						assert(final != +Layout::TransferDst);
+
+						cp.finalLayouts[storageRT] = final;
+						currentLayouts[storageRT]  = Layout::General;
+					}
+
+					for (RT inputRT : cp.desc.inputRendertargets) {
+						currentLayouts[inputRT] = Layout::ShaderRead;
+					}
+				}
+			};
+
+			LayoutVisitor lv(currentLayouts, *this, contentsNeeded);
+			for (auto it = operations.rbegin(); it != operations.rend(); it++) {
+				boost::apply_visitor(lv, *it);
+
+				// earlier contents are only needed if this reads them before writing
+				forEachRTUse(*it, [&contentsNeeded] (RT rt, bool reads, bool writes) {
+					if (writes && !reads) {
+						contentsNeeded.erase(rt);
+					}
+				});
+				forEachRTUse(*it, [&contentsNeeded] (RT rt, bool reads, bool /* writes */) {
+					if (reads) {
+						contentsNeeded.insert(rt);
+					}
+				});
+			}
+
+		}
+
+		// compute passes make their own layout transitions
+		// so they need to know what the previous operation left behind
+		if (!computePasses.empty()) {
+			HashMap<RT, Layout> currentLayouts;
+
+			for (const auto &rt : rendertargets) {
+				visitRendertarget(rt.second
+								  , [&rt, &currentLayouts] (const ExternalRT &e) {
+									  currentLayouts[rt.first] = e.initialLayout;
+								  }
+								  , nopInternal
+								 );
+			}
+
+			struct ForwardLayoutVisitor final : public boost::static_visitor<void> {
+				HashMap<RT, Layout> &currentLayouts;
+				RenderGraph &rg;
+
+
+				ForwardLayoutVisitor(HashMap<RT, Layout> &currentLayouts_, RenderGraph &rg_)
+				: currentLayouts(currentLayouts_)
+				, rg(rg_)
+				{
+				}
+
+				void operator()(const Blit &b) const {
+					currentLayouts[b.source] = b.sourceLayout;
+					currentLayouts[b.dest]   = b.finalLayout;
+				}
+
+				void operator()(const RP &rpId) const {
+					auto it = rg.renderPasses.find(rpId);
+					assert(it != rg.renderPasses.end());
+
+					const auto &rp = it->second;
+					for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+						auto rtId = rp.desc.colorRTs_[i].id;
+						if (rtId != Default<RT>::value) {
+							currentLayouts[rtId] = rp.rpDesc.color(i).finalLayout;
+						}
+
+						RT resolveId = rp.desc.colorRTs_[i].resolve;
+						if (resolveId != Default<RT>::value) {
+							currentLayouts[resolveId] = rp.rpDesc.color(i).resolveFinalLayout;
+						}
+					}
+				}
+
+				void operator()(const ResolveMSAA &resolve) const {
+					currentLayouts[resolve.dest] = resolve.finalLayout;
+				}
+
+				void operator()(const Readback &rb) const {
+					if (rb.finalLayout != +Layout::Undefined) {
+						currentLayouts[rb.source] = rb.finalLayout;
+					}
+				}
+
+				void operator()(const Compute &c) const {
+					auto it = rg.computePasses.find(c.id);
+					assert(it != rg.computePasses.end());
+
+					auto &cp = it->second;
+					for (RT storageRT : cp.desc.storageRendertargets) {
+						Layout initial = Layout::Undefined;
+						auto layoutIt = currentLayouts.find(storageRT);
+						if (layoutIt != currentLayouts.end()) {
+							initial = layoutIt->second;
+						}
+						cp.initialLayouts[storageRT] = initial;
+
+						auto finalIt = cp.finalLayouts.find(storageRT);
+						assert(finalIt != cp.finalLayouts.end());
+						currentLayouts[storageRT] = finalIt->second;
+					}
+				}
+			};
+
+			ForwardLayoutVisitor flv(currentLayouts, *this);
+			for (const auto &op : operations) {
+				boost::apply_visitor(flv, op);
+			}
+		}
+
+		// skipping a cached pass leaves its attachments as the previous frame did
+		// they still have to end up in the layouts running it would have left
+		if (!cachedOutputs.empty()) {
+			HashMap<RT, Layout> layouts;
+			// first round only finds what the end of the frame leaves behind
+			for (const auto &op : operations) {
+				trackLayouts(op, layouts);
+			}
+
+			// last cached pass writing each rendertarget so far
+			HashMap<RT, RP> cachedWriters;
+			for (const auto &op : operations) {
+				const RP *rpId = boost::get<RP>(&op);
+				if (rpId && renderPasses.at(*rpId).cached()) {
+					auto &rp = renderPasses.at(*rpId);
+
+					forEachRTUse(op, [&] (RT rt, bool reads, bool /* writes */) {
+						auto it = cachedWriters.find(rt);
+						if (reads && it != cachedWriters.end() && std::find(rp.cachedProducers.begin(), rp.cachedProducers.end(), it->second) == rp.cachedProducers.end()) {
+							rp.cachedProducers.push_back(it->second);
+						}
+					});
+
+					auto addChange = [&] (RT rt, Layout to) {
+						auto it = layouts.find(rt);
+						assert(it != layouts.end());
+						if (it->second != to) {
+							rp.skipTransitions.push_back(LayoutChange{ rt, it->second, to });
+						}
+					};
 
-							rpDesc.color(i, fmt, pb, initial, final, desc.colorRTs_[i].clearValue);
-							currentLayouts[rtId] = initial;
+					for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+						const auto &rt = rp.desc.colorRTs_[i];
+						if (rt.id != Default<RT>::value) {
+							addChange(rt.id, rp.rpDesc.color(i).finalLayout);
 						}
-					}
 
-					// mark input rt current layout as shader read
-					for (RT inputRT : desc.inputRendertargets) {
-						currentLayouts[inputRT] = Layout::ShaderRead;
+						if (rt.resolve != Default<RT>::value) {
+							addChange(rt.resolve, rp.rpDesc.color(i).resolveFinalLayout);
+						}
 					}
-				}
 
-				void operator()(ResolveMSAA &resolve) const {
-					resolve.finalLayout            = currentLayouts[resolve.dest];
-					currentLayouts[resolve.source] = Layout::TransferSrc;
+					forEachRTUse(op, [&] (RT rt, bool /* reads */, bool writes) {
+						if (writes) {
+							cachedWriters[rt] = *rpId;
+						}
+					});
 				}
-			};
 
-			LayoutVisitor lv(currentLayouts, *this);
-			for (auto it = operations.rbegin(); it != operations.rend(); it++) {
-				boost::apply_visitor(lv, *it);
+				trackLayouts(op, layouts);
 			}
-
 		}
 
 		// create low-level renderpass objects
@@ -650,8 +1950,10 @@ public:
 			const auto &desc = temp.desc;
 
 			assert(!temp.handle);
-			// TODO: cache render passes
-			auto rpHandle = renderer.createRenderPass(temp.rpDesc);
+			auto rpHandle = takeOldRenderPass(temp.rpDesc);
+			if (!rpHandle) {
+				rpHandle = renderer.createRenderPass(temp.rpDesc);
+			}
 			assert(rpHandle);
 			temp.handle = rpHandle;
 
@@ -668,6 +1970,15 @@ public:
 						break;
 					}
 				}
+
+				if (rt.resolve != Default<RT>::value) {
+					auto it = rendertargets.find(rt.resolve);
+					assert(it != rendertargets.end());
+					if (isExternal(it->second)) {
+						hasExternal = true;
+						break;
+					}
+				}
 			}
 			// TODO: check depthStencil too
 
@@ -677,6 +1988,40 @@ public:
 				auto result DEBUG_ASSERTED = renderpassesWithExternalRTs.insert(p.first);
 				assert(result.second);
 			}
+
+			size_t numExternalInputs = externalInputs.size();
+			buildPassResources(renderer, p.first, desc.inputRendertargets, temp.resources);
+			temp.staticContents = desc.staticContents_ && externalInputs.size() == numExternalInputs;
+		}
+
+		for (auto &p : computePasses) {
+			auto &cp = p.second;
+			buildPassResources(renderer, p.first, cp.desc.inputRendertargets, cp.resources);
+			// storage images can't be external
+			for (RT storageRT : cp.desc.storageRendertargets) {
+				addViews(renderer, cp.resources, storageRT);
+			}
+		}
+
+		// render passes no graph since has had use for
+		// their handles can be reused so pipelines referring to them must go too
+		for (auto oldIt = oldRenderPasses.begin(); oldIt != oldRenderPasses.end(); ) {
+			if (!expired(oldIt->retired)) {
+				oldIt++;
+				continue;
+			}
+
+			for (auto it = oldPipelines.begin(); it != oldPipelines.end(); ) {
+				if (it->second.renderPass == oldIt->handle) {
+					renderer.deletePipeline(it->second.handle);
+					it = oldPipelines.erase(it);
+				} else {
+					it++;
+				}
+			}
+
+			renderer.deleteRenderPass(oldIt->handle);
+			oldIt = oldRenderPasses.erase(oldIt);
 		}
 
 		// write description to debug log
@@ -692,29 +2037,34 @@ public:
 
 
 				void operator()(const Blit &b) const {
-					LOG("Blit %s -> %s\t%s\n", to_string(b.source), to_string(b.dest), b.finalLayout._to_string());
+					LOG_DEBUG("Blit %s (%s) -> %s\t%s\n", to_string(b.source), b.sourceLayout._to_string(), to_string(b.dest), b.finalLayout._to_string());
 				}
 
 				void operator()(const RP &rpId) const {
-					LOG("RenderPass %s\n", to_string(rpId));
 					auto it = rg.renderPasses.find(rpId);
 					assert(it != rg.renderPasses.end());
+					LOG_DEBUG("RenderPass %s%s%s\n", to_string(rpId), it->second.desc.enabled_ ? "\tconditional" : "", it->second.cached() ? "\tcached" : "");
 					const auto &desc   = it->second.desc;
 					const auto &rpDesc = it->second.rpDesc;
 
 					if (desc.depthStencil_ != Default<RT>::value) {
-						LOG(" depthStencil %s\n", to_string(desc.depthStencil_));
+						LOG_DEBUG(" depthStencil %s\t%s%s\n", to_string(desc.depthStencil_), desc.depthStencilPassBegin_._to_string(), rpDesc.storeDepth() ? "" : "\tdiscard");
 					}
 
 					for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
 						if (desc.colorRTs_[i].id != Default<RT>::value) {
 							const auto &rt = rpDesc.color(i);
-							LOG(" color %u: %s\t%s\t%s\t%s\n", i, to_string(desc.colorRTs_[i].id), rt.passBegin._to_string(), rt.initialLayout._to_string(), rt.finalLayout._to_string());
+							LOG_DEBUG(" color %u: %s\t%s\t%s\t%s%s\n", i, to_string(desc.colorRTs_[i].id), rt.passBegin._to_string(), rt.initialLayout._to_string(), rt.finalLayout._to_string(), rt.store ? "" : "\tdiscard");
+						}
+
+						if (desc.colorRTs_[i].resolve != Default<RT>::value) {
+							const auto &rt = rpDesc.color(i);
+							LOG_DEBUG(" resolve %u: %s\t%s\n", i, to_string(desc.colorRTs_[i].resolve), rt.resolveFinalLayout._to_string());
 						}
 					}
 
 					if (!desc.inputRendertargets.empty()) {
-						LOG(" inputs:\n");
+						LOG_DEBUG(" inputs:\n");
 						std::vector<RT> inputs;
 						inputs.reserve(desc.inputRendertargets.size());
 						for (auto i : desc.inputRendertargets) {
@@ -723,13 +2073,49 @@ public:
 
 						std::sort(inputs.begin(), inputs.end());
 						for (auto i : inputs) {
-							LOG("  %s\n", to_string(i));
+							LOG_DEBUG("  %s\n", to_string(i));
 						}
 					}
 				}
 
 				void operator()(const ResolveMSAA &r) const {
-					LOG("ResolveMSAA %s -> %s\t%s\n", to_string(r.source), to_string(r.dest), r.finalLayout._to_string());
+					LOG_DEBUG("ResolveMSAA %s -> %s\t%s\n", to_string(r.source), to_string(r.dest), r.finalLayout._to_string());
+				}
+
+				void operator()(const Readback &rb) const {
+					LOG_DEBUG("Readback %s\t%s\n", to_string(rb.source), rb.finalLayout._to_string());
+				}
+
+				void operator()(const Compute &c) const {
+					LOG_DEBUG("ComputePass %s\n", to_string(c.id));
+					auto it = rg.computePasses.find(c.id);
+					assert(it != rg.computePasses.end());
+					const auto &cp = it->second;
+
+					std::vector<RT> storage;
+					storage.reserve(cp.desc.storageRendertargets.size());
+					for (auto i : cp.desc.storageRendertargets) {
+						storage.push_back(i);
+					}
+
+					std::sort(storage.begin(), storage.end());
+					for (auto i : storage) {
+						LOG_DEBUG(" storage %s\t%s\t%s\n", to_string(i), cp.initialLayouts.at(i)._to_string(), cp.finalLayouts.at(i)._to_string());
+					}
+
+					if (!cp.desc.inputRendertargets.empty()) {
+						LOG_DEBUG(" inputs:\n");
+						std::vector<RT> inputs;
+						inputs.reserve(cp.desc.inputRendertargets.size());
+						for (auto i : cp.desc.inputRendertargets) {
+							inputs.push_back(i);
+						}
+
+						std::sort(inputs.begin(), inputs.end());
+						for (auto i : inputs) {
+							LOG_DEBUG("  %s\n", to_string(i));
+						}
+					}
 				}
 			};
 
@@ -759,10 +2145,197 @@ public:
 	}
 
 
+	// estimated memory traffic of every operation and size of every rendertarget after build
+	// from formats, sizes and sample counts, each read or write counts the whole rendertarget
+	// totals are given both with every rendertarget on its own and with aliasing
+	// timings are matched to operations by GPU timer name
+	// external rendertargets have no size here, they're taken as externalWidth x externalHeight
+	// JSON if filename ends in .json, GraphViz otherwise
+	void writeReport(const std::string &filename, const std::vector<GPUTiming> &timings, unsigned int externalWidth, unsigned int externalHeight) const {
+		assert(state != +RGState::Invalid);
+		assert(state != +RGState::Building);
+
+		const bool json = (filename.size() >= 5) && (filename.compare(filename.size() - 5, 5, ".json") == 0);
+
+		auto megabytes = [] (uint64_t bytes) {
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%.2f", double(bytes) / (1024.0 * 1024.0));
+			return std::string(buf);
+		};
+
+		auto rtBytes = [externalWidth, externalHeight] (const Rendertarget &rt) {
+			return visitRendertargetValue<uint64_t>(rt
+			         , [externalWidth, externalHeight] (const ExternalRT &e) {
+			             return uint64_t(externalWidth) * externalHeight * formatSize(e.format);
+			         }
+			         , [] (const InternalRT &i) {
+			             return uint64_t(i.desc.width()) * i.desc.height() * i.desc.numSamples() * i.desc.layers() * formatSize(i.desc.format());
+			         }
+			        );
+		};
+
+		struct OperationName final : public boost::static_visitor<std::string> {
+			std::string operator()(const Blit &b) const {
+				return std::string("Blit ") + to_string(b.source) + " to " + to_string(b.dest);
+			}
+
+			std::string operator()(const RP &rp) const {
+				return to_string(rp);
+			}
+
+			std::string operator()(const ResolveMSAA &r) const {
+				return std::string("ResolveMSAA ") + to_string(r.source) + " to " + to_string(r.dest);
+			}
+
+			std::string operator()(const Compute &c) const {
+				return to_string(c.id);
+			}
+
+			std::string operator()(const Readback &rb) const {
+				return std::string("Readback ") + to_string(rb.source);
+			}
+		};
+
+		// one timer per pass but the backend might report it more than once
+		HashMap<std::string, uint64_t> passTimes;
+		for (const auto &t : timings) {
+			passTimes[t.name] += t.nanoseconds;
+		}
+
+		// sorted so reports of different builds can be compared
+		std::vector<RT> rts;
+		rts.reserve(rendertargets.size());
+		uint64_t unaliasedBytes = 0, aliasedBytes = 0;
+		for (const auto &p : rendertargets) {
+			rts.push_back(p.first);
+			if (!isExternal(p.second)) {
+				uint64_t bytes = rtBytes(p.second);
+				unaliasedBytes += bytes;
+				if (boost::get<InternalRT>(p.second).aliasOf == Default<RT>::value) {
+					aliasedBytes += bytes;
+				}
+			}
+		}
+		std::sort(rts.begin(), rts.end());
+
+		std::string report;
+		if (json) {
+			report += "{\n\t\"rendertargets\": [\n";
+		} else {
+			report += "digraph RenderGraph {\n\trankdir=LR;\n\tnode [fontname=\"sans-serif\"];\n\tedge [fontname=\"sans-serif\"];\n";
+		}
+
+		for (unsigned int i = 0; i < rts.size(); i++) {
+			RT rt = rts[i];
+			const auto &r = rendertargets.at(rt);
+			uint64_t bytes = rtBytes(r);
+
+			std::string size, aliasOf;
+			unsigned int samples = 1;
+			bool transient = false;
+			if (isExternal(r)) {
+				size = std::to_string(externalWidth) + "x" + std::to_string(externalHeight);
+			} else {
+				const auto &internal = boost::get<InternalRT>(r);
+				size      = std::to_string(internal.desc.width()) + "x" + std::to_string(internal.desc.height());
+				samples   = internal.desc.numSamples();
+				transient = internal.desc.transient();
+				if (internal.aliasOf != Default<RT>::value) {
+					aliasOf = to_string(internal.aliasOf);
+				}
+			}
+
+			if (json) {
+				report += std::string("\t\t{ \"name\": \"") + to_string(rt) + "\", \"format\": \"" + getFormat(r)._to_string() + "\", \"size\": \"" + size + "\""
+				        + ", \"samples\": " + std::to_string(samples) + ", \"bytes\": " + std::to_string(bytes)
+				        + ", \"external\": " + (isExternal(r) ? "true" : "false") + ", \"transient\": " + (transient ? "true" : "false")
+				        + ", \"aliasOf\": " + (aliasOf.empty() ? std::string("null") : "\"" + aliasOf + "\"")
+				        + ((i + 1 < rts.size()) ? " },\n" : " }\n");
+			} else {
+				std::string label = std::string(to_string(rt)) + "\\n" + getFormat(r)._to_string() + " " + size;
+				if (samples > 1) {
+					label += " " + std::to_string(samples) + "x";
+				}
+				label += "\\n" + megabytes(bytes) + " MB";
+				if (!aliasOf.empty()) {
+					label += "\\nin " + aliasOf;
+				}
+				report += std::string("\t\"") + to_string(rt) + "\" [shape=" + (isExternal(r) ? "doubleoctagon" : "ellipse")
+				        + (transient ? ", style=dashed" : "") + ", label=\"" + label + "\"];\n";
+			}
+		}
+
+		if (json) {
+			report += "\t],\n\t\"operations\": [\n";
+		}
+
+		uint64_t totalRead = 0, totalWritten = 0;
+		for (unsigned int i = 0; i < operations.size(); i++) {
+			const auto &op = operations[i];
+			std::string name = boost::apply_visitor(OperationName(), op);
+
+			uint64_t readBytes = 0, writtenBytes = 0;
+			std::string reads, writes, edges;
+			forEachRTUse(op, [&] (RT rt, bool r, bool w) {
+				uint64_t bytes = rtBytes(rendertargets.at(rt));
+				std::string quoted = std::string("\"") + to_string(rt) + "\"";
+				if (r) {
+					readBytes += bytes;
+					reads += (reads.empty() ? "" : ", ") + quoted;
+					edges += "\t" + quoted + " -> op" + std::to_string(i) + " [label=\"" + megabytes(bytes) + " MB\"];\n";
+				}
+				if (w) {
+					writtenBytes += bytes;
+					writes += (writes.empty() ? "" : ", ") + quoted;
+					edges += "\top" + std::to_string(i) + " -> " + quoted + " [label=\"" + megabytes(bytes) + " MB\"];\n";
+				}
+			});
+			totalRead    += readBytes;
+			totalWritten += writtenBytes;
+
+			auto timeIt = passTimes.find(name);
+			std::string time;
+			if (timeIt != passTimes.end()) {
+				char buf[32];
+				snprintf(buf, sizeof(buf), "%.4f", double(timeIt->second) / 1000000.0);
+				time = buf;
+			}
+
+			if (json) {
+				report += "\t\t{ \"name\": \"" + name + "\", \"readBytes\": " + std::to_string(readBytes) + ", \"writtenBytes\": " + std::to_string(writtenBytes)
+				        + ", \"gpuTime\": " + (time.empty() ? std::string("null") : time)
+				        + ", \"reads\": [" + reads + "], \"writes\": [" + writes + "]"
+				        + ((i + 1 < operations.size()) ? " },\n" : " }\n");
+			} else {
+				std::string label = name + "\\nread " + megabytes(readBytes) + " MB, written " + megabytes(writtenBytes) + " MB";
+				if (!time.empty()) {
+					label += "\\n" + time + " ms";
+				}
+				report += "\top" + std::to_string(i) + " [shape=box, label=\"" + label + "\"];\n" + edges;
+			}
+		}
+
+		if (json) {
+			report += "\t],\n\t\"readBytes\": " + std::to_string(totalRead) + ",\n\t\"writtenBytes\": " + std::to_string(totalWritten)
+			        + ",\n\t\"rendertargetBytes\": " + std::to_string(unaliasedBytes) + ",\n\t\"aliasedRendertargetBytes\": " + std::to_string(aliasedBytes) + "\n}\n";
+		} else {
+			report += "\tlabel=\"read " + megabytes(totalRead) + " MB, written " + megabytes(totalWritten) + " MB per frame\\n"
+			        + "rendertargets " + megabytes(unaliasedBytes) + " MB, " + megabytes(aliasedBytes) + " MB with aliasing\";\n}\n";
+		}
+
+		writeFile(filename, report.data(), report.size());
+		LOG("Wrote render graph report to \"%s\"\n", filename.c_str());
+	}
+
+
 	void render(Renderer &renderer) {
+		PROFILE_ZONE("RenderGraph::render");
+
 		assert(state == +RGState::Ready);
 		state = RGState::Rendering;
 
+		frameNumber++;
+
 		if (hasExternalRTs) {
 			bool hasExternal = false;
 			for (const auto &p : rendertargets) {
@@ -781,9 +2354,46 @@ public:
 				auto &rp = it->second;
 
 				assert(!rp.fb);
-				buildRenderPassFramebuffer(renderer, rp);
+				FramebufferKey key = framebufferKey(rp);
+				for (const auto &fb : rp.externalFramebuffers) {
+					if (fb.first == key) {
+						rp.fb = fb.second;
+						break;
+					}
+				}
+
+				if (!rp.fb) {
+					if (rp.externalFramebuffers.size() >= maxExternalFramebuffers) {
+						renderer.deleteFramebuffer(rp.externalFramebuffers.front().second);
+						rp.externalFramebuffers.erase(rp.externalFramebuffers.begin());
+					}
+
+					buildRenderPassFramebuffer(renderer, rp);
+					rp.externalFramebuffers.emplace_back(key, rp.fb);
+				}
 				assert(rp.fb);
 			}
+
+			// update views of external inputs
+			// the renderer creates views with the rendertarget so they only change if it does
+			for (auto &e : externalInputs) {
+				auto rtIt = rendertargets.find(e.rt);
+				assert(rtIt != rendertargets.end());
+				RenderTargetHandle handle = getHandle(rtIt->second);
+				if (handle == e.viewsOf) {
+					continue;
+				}
+				e.viewsOf = handle;
+
+				auto rpIt = renderPasses.find(e.pass);
+				if (rpIt != renderPasses.end()) {
+					addViews(renderer, rpIt->second.resources, e.rt);
+				} else {
+					auto cpIt = computePasses.find(e.pass);
+					assert(cpIt != computePasses.end());
+					addViews(renderer, cpIt->second.resources, e.rt);
+				}
+			}
 		}
 
 		struct OpVisitor final : public boost::static_visitor<void> {
@@ -799,6 +2409,8 @@ public:
 
 
 			void operator()(const Blit &b) const {
+				PROFILE_ZONE("Blit");
+
 				auto srcIt = rg.rendertargets.find(b.source);
 				assert(srcIt != rg.rendertargets.end());
 				RenderTargetHandle sourceHandle = getHandle(srcIt->second);
@@ -807,9 +2419,60 @@ public:
 				assert(destIt != rg.rendertargets.end());
 				RenderTargetHandle targetHandle = getHandle(destIt->second);
 
+				r.pushDebugGroup("Blit");
+				if (b.sourceLayout != +Layout::TransferSrc) {
+					r.layoutTransition(sourceHandle, b.sourceLayout, Layout::TransferSrc);
+				}
 				r.layoutTransition(targetHandle, Layout::Undefined, Layout::TransferDst);
 				r.blit(sourceHandle, targetHandle);
 				r.layoutTransition(targetHandle, Layout::TransferDst, b.finalLayout);
+				if (b.sourceLayout != +Layout::TransferSrc) {
+					r.layoutTransition(sourceHandle, Layout::TransferSrc, b.sourceLayout);
+				}
+				r.popDebugGroup();
+			}
+
+			// disabled conditional pass, contents stay as they were
+			// but attachments must still end up in the layouts later operations expect
+			// depth is loaded from and left in ShaderRead so it needs nothing
+			void skip(const RenderPass &pass) const {
+				for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+					RT rtId = pass.desc.colorRTs_[i].id;
+					if (rtId == Default<RT>::value) {
+						continue;
+					}
+
+					const auto &info = pass.rpDesc.color(i);
+					if (info.initialLayout != info.finalLayout) {
+						auto rtIt = rg.rendertargets.find(rtId);
+						assert(rtIt != rg.rendertargets.end());
+						r.layoutTransition(getHandle(rtIt->second), info.initialLayout, info.finalLayout);
+					}
+				}
+			}
+
+			// nothing the cached pass depends on has changed since it last ran
+			bool cacheHit(RenderPass &pass) const {
+				bool hit = (pass.lastRun != 0);
+				for (RP producer : pass.cachedProducers) {
+					if (rg.renderPasses.at(producer).lastRun == rg.frameNumber) {
+						hit = false;
+					}
+				}
+
+				pass.cachedVersions.resize(pass.desc.versions_.size());
+				for (unsigned int i = 0; i < pass.desc.versions_.size(); i++) {
+					uint64_t v = *pass.desc.versions_[i];
+					if (v != pass.cachedVersions[i]) {
+						pass.cachedVersions[i] = v;
+						hit = false;
+					}
+				}
+
+				if (!hit) {
+					pass.lastRun = rg.frameNumber;
+				}
+				return hit;
 			}
 
 			void operator()(const RP &rp) const {
@@ -819,38 +2482,41 @@ public:
 				auto it = rg.renderPasses.find(rp);
 				assert(it != rg.renderPasses.end());
 
-				r.beginRenderPass(it->second.handle, it->second.fb);
-
-				PassResources res;
-				// TODO: build ahead of time, fill here?
-				for (RT inputRT : it->second.desc.inputRendertargets) {
-					// get rendertarget desc
-					auto rtIt = rg.rendertargets.find(inputRT);
-					assert(rtIt != rg.rendertargets.end());
+				if (it->second.desc.enabled_ && !it->second.desc.enabled_()) {
+					skip(it->second);
 
-					// get format
-					Format fmt = getFormat(rtIt->second);
-					assert(fmt != +Format::Invalid);
+					assert(rg.currentRP == rp);
+					rg.currentRP = Default<RP>::value;
+					return;
+				}
 
-					{
-						// get view from renderer, add to res
-						TextureHandle view = r.getRenderTargetView(getHandle(rtIt->second), fmt);
-						res.rendertargets.emplace(std::make_pair(inputRT, fmt), view);
-						// also add it with Format::Invalid so default works easier
-						res.rendertargets.emplace(std::make_pair(inputRT, Format::Invalid), view);
+				if (it->second.cached() && cacheHit(it->second)) {
+					for (const auto &change : it->second.skipTransitions) {
+						auto rtIt = rg.rendertargets.find(change.rt);
+						assert(rtIt != rg.rendertargets.end());
+						r.layoutTransition(getHandle(rtIt->second), change.from, change.to);
 					}
 
-					// do the same for additional view format if there is one
-					Format additionalFmt = getAdditionalViewFormat(rtIt->second);
-					if (additionalFmt != +Format::Invalid) {
-						assert(additionalFmt != fmt);
-						TextureHandle view = r.getRenderTargetView(getHandle(rtIt->second), additionalFmt);
-						res.rendertargets.emplace(std::make_pair(inputRT, additionalFmt), view);
-					}
+					assert(rg.currentRP == rp);
+					rg.currentRP = Default<RP>::value;
+					return;
+				}
+
+				PROFILE_ZONE(to_string(rp));
+				const std::string &name = it->second.desc.name_;
+				r.pushDebugGroup(name.empty() ? to_string(rp) : name.c_str());
+				r.beginGPUTimer(to_string(rp));
+				bool record = true;
+				if (it->second.staticContents) {
+					record = r.beginStaticRenderPass(it->second.handle, it->second.fb);
+				} else {
+					r.beginRenderPass(it->second.handle, it->second.fb);
 				}
 
 				try {
-					it->second.func(rp, res);
+					if (record) {
+						it->second.func(rp, it->second.resources);
+					}
 				} catch (std::exception &e) {
 					// TODO: log renderpass
 					LOG("Exception \"%s\" during renderpass\n", e.what());
@@ -862,12 +2528,16 @@ public:
 
 				}
 				r.endRenderPass();
+				r.endGPUTimer();
+				r.popDebugGroup();
 
 				assert(rg.currentRP == rp);
 				rg.currentRP = Default<RP>::value;
 			}
 
 			void operator()(const ResolveMSAA &resolve) const {
+				PROFILE_ZONE("ResolveMSAA");
+
 				auto srcIt = rg.rendertargets.find(resolve.source);
 				assert(srcIt != rg.rendertargets.end());
 				RenderTargetHandle sourceHandle = getHandle(srcIt->second);
@@ -876,19 +2546,118 @@ public:
 				assert(destIt != rg.rendertargets.end());
 				RenderTargetHandle targetHandle = getHandle(destIt->second);
 
+				r.pushDebugGroup("ResolveMSAA");
 				r.layoutTransition(targetHandle, Layout::Undefined, Layout::TransferDst);
 				r.resolveMSAA(sourceHandle, targetHandle);
 				r.layoutTransition(targetHandle, Layout::TransferDst, resolve.finalLayout);
+				r.popDebugGroup();
+			}
+
+			void operator()(Readback &rb) const {
+				PROFILE_ZONE("Readback");
+
+				auto srcIt = rg.rendertargets.find(rb.source);
+				assert(srcIt != rg.rendertargets.end());
+				RenderTargetHandle sourceHandle = getHandle(srcIt->second);
+
+				if (rb.callback) {
+					r.readbackRenderTarget(sourceHandle, std::move(rb.callback));
+					rb.callback = ReadbackCallback();
+				}
+
+				// left in TransferSrc whether it was copied or not
+				if (rb.finalLayout != +Layout::Undefined && rb.finalLayout != +Layout::TransferSrc) {
+					r.layoutTransition(sourceHandle, Layout::TransferSrc, rb.finalLayout);
+				}
+			}
+
+			void operator()(const Compute &c) const {
+				assert(rg.currentRP == Default<RP>::value);
+				rg.currentRP = c.id;
+
+				auto it = rg.computePasses.find(c.id);
+				assert(it != rg.computePasses.end());
+				auto &cp = it->second;
+
+				PROFILE_ZONE(to_string(c.id));
+				r.pushDebugGroup(cp.desc.name_.empty() ? to_string(c.id) : cp.desc.name_.c_str());
+				r.beginGPUTimer(to_string(c.id));
+
+				// previous writes in General layout don't get a transition
+				// so they need an explicit barrier instead
+				bool needBarrier = false;
+				for (RT storageRT : cp.desc.storageRendertargets) {
+					auto rtIt = rg.rendertargets.find(storageRT);
+					assert(rtIt != rg.rendertargets.end());
+
+					Layout initial = cp.initialLayouts.at(storageRT);
+					if (initial == +Layout::General) {
+						needBarrier = true;
+					} else {
+						r.layoutTransition(getHandle(rtIt->second), initial, Layout::General);
+					}
+				}
+				if (needBarrier) {
+					r.computeBarrier();
+				}
+
+				try {
+					cp.func(c.id, cp.resources);
+				} catch (std::exception &e) {
+					LOG("Exception \"%s\" during compute pass\n", e.what());
+					if (rg.storedException) {
+						LOG("Already have an exception, not stored\n");
+					} else {
+						rg.storedException = std::current_exception();
+					}
+
+				}
+
+				for (RT storageRT : cp.desc.storageRendertargets) {
+					Layout final = cp.finalLayouts.at(storageRT);
+					if (final != +Layout::General) {
+						auto rtIt = rg.rendertargets.find(storageRT);
+						assert(rtIt != rg.rendertargets.end());
+						r.layoutTransition(getHandle(rtIt->second), Layout::General, final);
+					}
+				}
+
+				r.endGPUTimer();
+				r.popDebugGroup();
+
+				assert(rg.currentRP == c.id);
+				rg.currentRP = Default<RP>::value;
 			}
 		};
 
-		for (const auto &op : operations) {
+		bool asyncCompute = renderer.getFeatures().asyncCompute;
+		bool asyncActive  = false;
+		bool asyncUsed    = false;
+		for (auto &op : operations) {
+			if (asyncCompute) {
+				const Compute *c = boost::get<Compute>(&op);
+				bool async       = c && computePasses.at(c->id).desc.async_;
+				if (async && !asyncActive && !asyncUsed) {
+					renderer.beginAsyncCompute();
+					asyncActive = true;
+					asyncUsed   = true;
+				} else if (!async && asyncActive) {
+					renderer.endAsyncCompute();
+					asyncActive = false;
+				}
+			}
+
 			boost::apply_visitor(OpVisitor(renderer, *this), op);
 		}
 
+		if (asyncActive) {
+			renderer.endAsyncCompute();
+		}
+
 		{
 			auto it = rendertargets.find(finalTarget);
 			assert(it != rendertargets.end());
+			PROFILE_ZONE("present");
 			renderer.presentFrame(getHandle(it->second));
 		}
 
@@ -913,9 +2682,8 @@ public:
 				assert(it != renderPasses.end());
 				auto &rp = it->second;
 
+				// still owned by externalFramebuffers
 				assert(rp.fb);
-				// TODO: cache them
-				renderer.deleteFramebuffer(rp.fb);
 				rp.fb = FramebufferHandle();
 			}
 		}
@@ -928,31 +2696,146 @@ public:
 	}
 
 
-	PipelineHandle createPipeline(Renderer &renderer, RP rp, PipelineDesc &desc) {
+	// takes a copy since the render pass gets filled in, callers can pass temporaries
+	PipelineHandle createPipeline(Renderer &renderer, RP rp, PipelineDesc desc) {
 		assert(state == +RGState::Ready || state == +RGState::Rendering);
 
 		auto it = renderPasses.find(rp);
 		assert(it != renderPasses.end());
 		desc.renderPass(it->second.handle);
 
+		uint64_t hash = desc.hashValue();
+		auto pipelineIt = pipelines.find(hash);
+		if (pipelineIt != pipelines.end()) {
+			// 64-bit collisions are unlikely enough to only check in debug builds
+			assert(pipelineIt->second.desc == desc);
+			return pipelineIt->second.handle;
+		}
+
+		// previous graph might have had the same one
+		auto oldIt = oldPipelines.find(hash);
+		if (oldIt != oldPipelines.end()) {
+			assert(oldIt->second.desc == desc);
+			auto handle = oldIt->second.handle;
+			pipelines.emplace(hash, std::move(oldIt->second));
+			oldPipelines.erase(oldIt);
+
+			return handle;
+		}
+
+		auto handle = renderer.createPipeline(desc);
+
+		Pipeline pipeline;
+		pipeline.desc       = std::move(desc);
+		pipeline.handle     = handle;
+		pipeline.renderPass = it->second.handle;
+		pipelines.emplace(hash, std::move(pipeline));
+
+		return handle;
+	}
+
+
+	PipelineHandle createComputePipeline(Renderer &renderer, const ComputePipelineDesc &desc) {
+		assert(state == +RGState::Ready || state == +RGState::Rendering);
+
 		// TODO: use hash map
-		for (const auto &pipeline : pipelines) {
+		for (const auto &pipeline : computePipelines) {
 			if (pipeline.desc == desc) {
 				return pipeline.handle;
 			}
 		}
 
-		auto handle = renderer.createPipeline(desc);
+		for (auto oldIt = oldComputePipelines.begin(); oldIt != oldComputePipelines.end(); oldIt++) {
+			if (oldIt->desc == desc) {
+				auto handle = oldIt->handle;
+				computePipelines.emplace_back(std::move(*oldIt));
+				oldComputePipelines.erase(oldIt);
 
-		Pipeline pipeline;
+				return handle;
+			}
+		}
+
+		auto handle = renderer.createComputePipeline(desc);
+
+		ComputePipeline pipeline;
 		pipeline.desc   = desc;
 		pipeline.handle = handle;
-		pipelines.emplace_back(std::move(pipeline));
+		computePipelines.emplace_back(std::move(pipeline));
 
 		return handle;
 	}
 
 
+	// recreates the pipelines using any of the shader files from Renderer::takeReloadedShaders
+	// replaced ones are deleted through the renderer so frames in flight can finish with them
+	// returns true if anything was replaced, handles from createPipeline must be fetched again
+	bool reloadPipelines(Renderer &renderer, const std::vector<std::string> &shaders) {
+		assert(state == +RGState::Ready);
+
+		auto usesAny = [&] (const auto &desc) {
+			for (const auto &s : shaders) {
+				if (desc.usesShaderSource(s)) {
+					return true;
+				}
+			}
+			return false;
+		};
+
+		bool replaced = false;
+		for (auto &p : pipelines) {
+			if (usesAny(p.second.desc)) {
+				PipelineHandle handle = renderer.createPipeline(p.second.desc);
+				renderer.deletePipeline(p.second.handle);
+				p.second.handle = handle;
+				replaced = true;
+			}
+		}
+
+		for (auto &p : computePipelines) {
+			if (usesAny(p.desc)) {
+				PipelineHandle handle = renderer.createComputePipeline(p.desc);
+				renderer.deletePipeline(p.handle);
+				p.handle = handle;
+				replaced = true;
+			}
+		}
+
+		// would be stale if a later graph took them over
+		deleteOldPipelines(renderer);
+
+		// recorded with the old pipelines
+		if (replaced) {
+			invalidateStaticPasses(renderer);
+			invalidateCachedPasses();
+		}
+
+		return replaced;
+	}
+
+
+	// something static passes recorded changed outside the graph, record them again next frame
+	void invalidateStaticPasses(Renderer &renderer) {
+		assert(state == +RGState::Ready);
+
+		for (const auto &p : renderPasses) {
+			if (p.second.staticContents) {
+				assert(p.second.handle);
+				renderer.invalidateStaticRenderPass(p.second.handle);
+			}
+		}
+	}
+
+
+	// something cached passes depend on changed without their counters, run them next frame
+	void invalidateCachedPasses() {
+		assert(state == +RGState::Ready);
+
+		for (auto &p : renderPasses) {
+			p.second.lastRun = 0;
+		}
+	}
+
+
 };
 
 
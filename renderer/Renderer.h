@@ -25,8 +25,13 @@ THE SOFTWARE.
 #define RENDERER_H
 
 
+#include <algorithm>
 #include <string>
 #include <array>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE 1
@@ -44,6 +49,9 @@ THE SOFTWARE.
 #include "utils/Utils.h"  // for isPow2
 
 
+class JobSystem;
+
+
 namespace renderer {
 
 
@@ -51,10 +59,16 @@ namespace renderer {
 #define MAX_VERTEX_ATTRIBS      4
 #define MAX_VERTEX_BUFFERS      1
 #define MAX_DESCRIPTOR_SETS     2  // per pipeline
+#define MAX_DESCRIPTORS         8  // per descriptor set
 #define MAX_TEXTURE_MIPLEVELS   14
 #define MAX_TEXTURE_SIZE        (1 << (MAX_TEXTURE_MIPLEVELS - 1))
+#define MAX_GPU_TIMERS          32  // per frame
+#define MAX_PUSH_CONSTANT_SIZE  128  // bytes, minimum guaranteed by Vulkan
+#define MAX_SPEC_CONSTANTS      8    // constant_id must be less than this
+#define MAX_TEXTURE_TABLE_SIZE  4096
 
 
+class DrawList;
 struct Buffer;
 struct DescriptorSetLayout;
 struct Framebuffer;
@@ -66,16 +80,35 @@ struct Texture;
 
 
 template <class T> class ResourceContainer;
+struct HandleAccess;
+struct CaptureAccess;
+struct CaptureReader;
+
+
+template <class T>
+struct HandleTraits {
+	typedef uint32_t  Storage;
+};
+
+
+// buffer handles are wide enough to encode an ephemeral ring buffer allocation directly
+template <>
+struct HandleTraits<Buffer> {
+	typedef uint64_t  Storage;
+};
 
 
 template <class T>
 class Handle {
 	friend class ResourceContainer<T>;
+	friend struct HandleAccess;
 
-	uint32_t handle;
+	typedef typename HandleTraits<T>::Storage  Storage;
 
+	Storage handle;
 
-	explicit Handle(uint32_t handle_)
+
+	explicit Handle(Storage handle_)
 	: handle(handle_)
 	{
 	}
@@ -141,10 +174,23 @@ BETTER_ENUM(BufferType, uint8_t
 	, Uniform
 	, Storage
 	, Vertex
+	// indirect dispatch arguments, also usable as a storage buffer
+	, Indirect
 	, Everything
 )
 
 
+// how often the contents of a createBuffer buffer change
+BETTER_ENUM(BufferUsage, uint8_t
+	// never, updateBuffer is not allowed
+	, Static
+	// occasionally, kept in GPU memory and updated through a copy
+	, Dynamic
+	// most frames, kept in host visible memory the GPU reads directly
+	, Streaming
+)
+
+
 BETTER_ENUM(DescriptorType, uint8_t
 	, End
 	, UniformBuffer
@@ -152,6 +198,16 @@ BETTER_ENUM(DescriptorType, uint8_t
 	, Sampler
 	, Texture
 	, CombinedSampler
+	// whole buffer is bound once, buffer offset is given when binding the set
+	, UniformBufferDynamic
+	, StorageBufferDynamic
+	// rendertarget texture written from compute shaders, must be in General layout
+	, StorageImage
+	// binding number is reserved but nothing is bound, shaders must not use it
+	, Empty
+	// array of every texture from createTexture, indexed with getTextureTableIndex
+	// must be the only descriptor in its set, nothing is read from the struct
+	, TextureTable
 )
 
 
@@ -176,6 +232,22 @@ BETTER_ENUM(Format, uint8_t
 	, Depth24S8
 	, Depth24X8
 	, Depth32Float
+	// block compressed, only for textures
+	// appended so existing values in captures don't change
+	, BC1RGBA
+	, sBC1RGBA
+	, BC3RGBA
+	, sBC3RGBA
+	, BC7RGBA
+	, sBC7RGBA
+	, ETC2RGB8
+	, sETC2RGB8
+	, ETC2RGBA8
+	, sETC2RGBA8
+	, ASTC4x4
+	, sASTC4x4
+	// packed unsigned float, for HDR-ish rendertargets at half the size of RGBA16Float
+	, RG11B10Float
 )
 
 
@@ -185,6 +257,9 @@ BETTER_ENUM(Layout, uint8_t
 	, TransferSrc
 	, TransferDst
 	, ColorAttachment
+	, General
+	// swapchain image handed to presentation, see getSwapchainRenderTarget
+	, Present
 )
 
 
@@ -196,6 +271,28 @@ BETTER_ENUM(PassBegin, uint8_t
 )
 
 
+BETTER_ENUM(DepthFunc, uint8_t
+	, Less
+	, Equal
+)
+
+
+BETTER_ENUM(StencilFunc, uint8_t
+	, Always
+	, Equal
+	, NotEqual
+)
+
+
+// what happens to stencil value when a fragment passes stencil and depth tests
+// failing fragments always keep the old value
+BETTER_ENUM(StencilOp, uint8_t
+	, Keep
+	, Zero
+	, Replace
+)
+
+
 BETTER_ENUM(VSync, uint8_t
 	, Off
 	, On
@@ -203,6 +300,23 @@ BETTER_ENUM(VSync, uint8_t
 )
 
 
+// how beginFrame waits for a swapchain image and the GPU to finish with its frame
+BETTER_ENUM(FrameWait, uint8_t
+	// never wait, beginFrame returns false and the caller tries again later
+	, Poll
+	// sleep in the driver up to frameWaitTimeout before returning false
+	, Block
+)
+
+
+// SPIRV-Tools pass recipe compileSpirv runs on a fresh compile
+BETTER_ENUM(ShaderOptimization, uint8_t
+	, None
+	, Performance
+	, Size
+)
+
+
 BETTER_ENUM(VtxFormat, uint8_t
 	, Float
 	, UNorm8
@@ -243,11 +357,71 @@ struct DescriptorLayout {
 };
 
 
+// what memory is used for, indexes MemoryStats::kindBytes
+BETTER_ENUM(MemoryKind, uint8_t
+	, RenderTarget
+	, Texture
+	, Buffer
+	// ephemeral buffer pages
+	, RingBuffer
+	// upload and readback buffers
+	, Staging
+)
+
+
+struct MemoryHeapStats {
+	uint64_t  size;
+	bool      deviceLocal;
+	uint32_t  allocationCount;
+	uint32_t  subAllocationCount;
+	uint64_t  usedBytes;
+	uint64_t  unusedBytes;
+	// includes other allocations than ours, 0 if not known
+	uint64_t  budgetBytes;
+	uint64_t  budgetUsageBytes;
+
+
+	MemoryHeapStats()
+	: size(0)
+	, deviceLocal(false)
+	, allocationCount(0)
+	, subAllocationCount(0)
+	, usedBytes(0)
+	, unusedBytes(0)
+	, budgetBytes(0)
+	, budgetUsageBytes(0)
+	{
+	}
+};
+
+
 struct MemoryStats {
+	// memory blocks allocated from the driver
 	uint32_t allocationCount;
+	// resources placed in those blocks
 	uint32_t subAllocationCount;
 	uint64_t usedBytes;
 	uint64_t unusedBytes;
+	// free ranges between suballocations, many small ones mean fragmentation
+	uint32_t unusedRangeCount;
+	uint64_t largestUnusedRange;
+	// device local memory this process may use and is using, includes other allocations than ours
+	// from VK_EXT_memory_budget if available, otherwise an estimate
+	// 0 if not known
+	uint64_t budgetBytes;
+	uint64_t budgetUsageBytes;
+	// used bytes by MemoryKind
+	std::array<uint64_t, MemoryKind::_size_constant>  kindBytes;
+	// small static buffers packed into shared buffers
+	// each shared buffer is one suballocation above
+	uint32_t arenaBufferCount;
+	uint64_t arenaUsedBytes;
+	uint64_t arenaUnusedBytes;
+	// ephemeral ring buffer page size now, it follows ringPeakFrameBytes
+	// and the most any frame has used so far
+	uint32_t ringPageBytes;
+	uint64_t ringPeakFrameBytes;
+	std::vector<MemoryHeapStats>                      heaps;
 
 
 	MemoryStats()
@@ -255,7 +429,17 @@ struct MemoryStats {
 	, subAllocationCount(0)
 	, usedBytes(0)
 	, unusedBytes(0)
+	, unusedRangeCount(0)
+	, largestUnusedRange(0)
+	, budgetBytes(0)
+	, budgetUsageBytes(0)
+	, arenaBufferCount(0)
+	, arenaUsedBytes(0)
+	, arenaUnusedBytes(0)
+	, ringPageBytes(0)
+	, ringPeakFrameBytes(0)
 	{
+		kindBytes.fill(0);
 	}
 
 	~MemoryStats() {}
@@ -268,10 +452,357 @@ struct MemoryStats {
 };
 
 
-typedef HashMap<std::string, std::string> ShaderMacros;
+// when a finished frame reached the screen
+// times are nanoseconds on the renderer's monotonic clock
+struct PresentTiming {
+	unsigned int  frameNum;
+	// when beginFrame returned, input for the frame was gathered just before
+	uint64_t      beginTime;
+	// when the image was displayed or, if the backend can't see the display,
+	// when the GPU finished the frame
+	uint64_t      presentTime;
+	// presentTime comes from the display and not from GPU completion
+	bool          displayed;
+
+
+	PresentTiming()
+	: frameNum(0)
+	, beginTime(0)
+	, presentTime(0)
+	, displayed(false)
+	{
+	}
+
+
+	PresentTiming(unsigned int frameNum_, uint64_t beginTime_, uint64_t presentTime_, bool displayed_)
+	: frameNum(frameNum_)
+	, beginTime(beginTime_)
+	, presentTime(presentTime_)
+	, displayed(displayed_)
+	{
+	}
+};
+
+
+struct GPUTiming {
+	std::string  name;
+	uint64_t     nanoseconds;
+	// when the GPU started it, on the same clock as PresentTiming
+	// 0 if the backend can't correlate GPU and CPU time
+	uint64_t     start;
+	// pipeline statistics of the timed commands
+	// only with RendererDesc::pipelineStatistics when the device supports them
+	bool         hasStatistics;
+	uint64_t     vertexInvocations;
+	uint64_t     clippingPrimitives;
+	uint64_t     fragmentInvocations;
+	uint64_t     computeInvocations;
+	// values of Renderer::getPerformanceCounters(), empty if they weren't sampled
+	std::vector<double>  counters;
+
+
+	GPUTiming()
+	: nanoseconds(0)
+	, start(0)
+	, hasStatistics(false)
+	, vertexInvocations(0)
+	, clippingPrimitives(0)
+	, fragmentInvocations(0)
+	, computeInvocations(0)
+	{
+	}
+
+	~GPUTiming() {}
+
+	GPUTiming(const GPUTiming &)                = default;
+	GPUTiming(GPUTiming &&) noexcept            = default;
+
+	GPUTiming &operator=(const GPUTiming &)     = default;
+	GPUTiming &operator=(GPUTiming &&) noexcept = default;
+};
+
+
+// presented image copied back to the CPU, see requestFrameReadback
+struct FrameReadback {
+	uint32_t              frameNum;
+	unsigned int          width, height;
+	Format                format;
+	// tightly packed rows of formatSize(format) pixels, top row first
+	std::vector<uint8_t>  pixels;
+
+
+	FrameReadback()
+	: frameNum(0)
+	, width(0)
+	, height(0)
+	, format(Format::Invalid)
+	{
+	}
+};
+
+
+// called from beginFrame once the frame which made the copy has completed
+// must not call the renderer, pixels can be swapped out
+typedef std::function<void (FrameReadback &)> ReadbackCallback;
+
+
+// times in nanoseconds
+struct ShaderVariantStats {
+	std::string  name;
+	bool         cacheHit;
+	// include resolution and preprocessing for the cache key
+	uint64_t     preprocessTime;
+	// glslang parse, link and SPIR-V generation
+	uint64_t     compileTime;
+	// SPIRV-Tools optimizer and remapper
+	uint64_t     optimizeTime;
+
+
+	ShaderVariantStats()
+	: cacheHit(false)
+	, preprocessTime(0)
+	, compileTime(0)
+	, optimizeTime(0)
+	{
+	}
+};
+
+
+// one compiled stage of a pipeline as the driver reports it
+struct ShaderExecutableStats {
+	std::string  name;
+	// register and instruction counts etc, names and meaning are driver specific
+	std::vector<std::pair<std::string, double> >  statistics;
+};
+
+
+struct PipelineStats {
+	std::string  name;
+	// PipelineDesc shader macros as sorted NAME=value pairs
+	std::string  macros;
+	// getting the SPIR-V, including waiting for a background compile
+	uint64_t     shaderTime;
+	// SPIRV-Cross conversion to GLSL, OpenGL only
+	uint64_t     crossTime;
+	// pipeline or program creation in the driver
+	uint64_t     driverTime;
+	// only with RendererDesc::shaderStatistics
+	std::vector<ShaderExecutableStats>  executables;
+
+
+	PipelineStats()
+	: shaderTime(0)
+	, crossTime(0)
+	, driverTime(0)
+	{
+	}
+};
+
+
+// everything compiled since the renderer was created
+struct ShaderStats {
+	std::vector<ShaderVariantStats>  variants;
+	std::vector<PipelineStats>       pipelines;
+	unsigned int                     cacheHits;
+	unsigned int                     cacheMisses;
+
+
+	ShaderStats()
+	: cacheHits(0)
+	, cacheMisses(0)
+	{
+	}
+};
+
+
+// Renderer API calls timed when built with RENDERER_CALL_STATS
+BETTER_ENUM(RendererCall, uint8_t
+	, CreateEphemeralBuffer
+	, AllocateEphemeral
+	, UpdateBuffer
+	, UpdateTexture
+	, CreateFramebuffer
+	, CreatePipeline
+	, CreateComputePipeline
+	, CreateRenderPass
+	, CreateRenderTarget
+	, GetRenderTargetView
+	, BeginFrame
+	, PresentFrame
+	, BeginRenderPass
+	, EndRenderPass
+	, BeginGPUTimer
+	, EndGPUTimer
+	, PushDebugGroup
+	, PopDebugGroup
+	, LayoutTransition
+	, BindPipeline
+	, BindIndexBuffer
+	, BindVertexBuffer
+	, BindDescriptorSet
+	, PushConstants
+	, SetScissorRect
+	, SetViewport
+	, Blit
+	, ResolveMSAA
+	, ReadbackRenderTarget
+	// variants of the same command share one entry
+	, Draw
+	, DrawIndexed
+	, DrawIndirect
+	, ExecuteDrawList
+	, Dispatch
+	, ComputeBarrier
+)
+
+
+// times in nanoseconds
+struct CallStats {
+	std::string  name;
+	uint64_t     count;
+	// wall time spent inside the call, includes the timer itself
+	uint64_t     nanoseconds;
+
+
+	CallStats()
+	: count(0)
+	, nanoseconds(0)
+	{
+	}
+};
+
+
+// preprocessor macros of a shader variant
+// kept sorted by name with the hash up to date so descs can compare and hash them cheaply
+class ShaderMacros {
+	typedef std::pair<std::string, std::string>  Macro;
+
+	std::vector<Macro>  macros;
+	uint64_t            hash;
+
+
+	void rehash();
+
+public:
+
+	typedef std::vector<Macro>::const_iterator  const_iterator;
+
+
+	ShaderMacros()
+	: hash(0)
+	{
+	}
+
+	ShaderMacros(const ShaderMacros &other)                = default;
+	ShaderMacros(ShaderMacros &&other) noexcept            = default;
+
+	ShaderMacros &operator=(const ShaderMacros &other)     = default;
+	ShaderMacros &operator=(ShaderMacros &&other) noexcept = default;
+
+	~ShaderMacros() {}
+
+	// like HashMap::emplace an existing macro keeps its old value
+	void emplace(std::string name, std::string value);
+
+	size_t size() const {
+		return macros.size();
+	}
+
+	bool empty() const {
+		return macros.empty();
+	}
+
+	const_iterator begin() const {
+		return macros.begin();
+	}
+
+	const_iterator end() const {
+		return macros.end();
+	}
+
+	uint64_t hashValue() const {
+		return hash;
+	}
+
+	bool operator==(const ShaderMacros &other) const {
+		return hash == other.hash && macros == other.macros;
+	}
+
+	bool operator!=(const ShaderMacros &other) const {
+		return !(*this == other);
+	}
+};
 
 
+// bytes per pixel, or per block for compressed formats
 uint32_t formatSize(Format format);
+bool isCompressedFormat(Format format);
+// width and height of a compressed block, 1 for uncompressed formats
+uint32_t formatBlockDim(Format format);
+// bytes in one mip level of this size
+// 64 bits so untrusted sizes from files can't wrap around
+uint64_t formatDataSize(Format format, unsigned int width, unsigned int height);
+// number of levels down to 1x1
+unsigned int mipChainLength(unsigned int width, unsigned int height);
+
+
+struct BufferDesc {
+	BufferDesc()
+	: type_(BufferType::Invalid)
+	, size_(0)
+	, usage_(BufferUsage::Static)
+	, contents_(nullptr)
+	{
+	}
+
+	~BufferDesc() { }
+
+	BufferDesc(const BufferDesc &)                = default;
+	BufferDesc(BufferDesc &&) noexcept            = default;
+
+	BufferDesc &operator=(const BufferDesc &)     = default;
+	BufferDesc &operator=(BufferDesc &&) noexcept = default;
+
+
+	BufferDesc &type(BufferType t) {
+		type_ = t;
+		return *this;
+	}
+
+	BufferDesc &size(uint32_t s) {
+		size_ = s;
+		return *this;
+	}
+
+	BufferDesc &usage(BufferUsage u) {
+		usage_ = u;
+		return *this;
+	}
+
+	// size bytes, only read during createBuffer
+	// required for Static buffers, the others are undefined until updateBuffer without it
+	BufferDesc &contents(const void *data) {
+		contents_ = data;
+		return *this;
+	}
+
+	BufferDesc &name(const std::string &str) {
+		name_ = str;
+		return *this;
+	}
+
+
+private:
+
+	BufferType   type_;
+	uint32_t     size_;
+	BufferUsage  usage_;
+	const void   *contents_;
+	std::string  name_;
+
+	friend struct RendererImpl;
+	friend struct CaptureAccess;
+};
 
 
 struct FramebufferDesc {
@@ -304,6 +835,13 @@ struct FramebufferDesc {
 		return *this;
 	}
 
+	// single-sampled target color attachment index is resolved to at the end of the pass
+	FramebufferDesc &resolve(unsigned int index, RenderTargetHandle r) {
+		assert(index < MAX_COLOR_RENDERTARGETS);
+		resolves_[index] = r;
+		return *this;
+	}
+
 	FramebufferDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -315,9 +853,11 @@ private:
 	RenderPassHandle                                         renderPass_;
 	RenderTargetHandle                                       depthStencil_;
 	std::array<RenderTargetHandle, MAX_COLOR_RENDERTARGETS>  colors_;
+	std::array<RenderTargetHandle, MAX_COLOR_RENDERTARGETS>  resolves_;
 	std::string                                              name_;
 
 	friend struct RendererImpl;
+	friend struct CaptureAccess;
 };
 
 
@@ -326,15 +866,23 @@ class PipelineDesc {
 	std::string           fragmentShaderName;
 	RenderPassHandle      renderPass_;
 	ShaderMacros          shaderMacros_;
+	// indexed by constant_id, applies to all stages
+	std::array<uint32_t, MAX_SPEC_CONSTANTS>  specConstants_;
+	uint32_t              specConstantMask;
 	uint32_t              vertexAttribMask;
 	unsigned int          numSamples_;
 	bool                  depthWrite_;
 	bool                  depthTest_;
+	DepthFunc             depthFunc_;
 	bool                  cullFaces_;
 	bool                  scissorTest_;
 	bool                  blending_;
 	BlendFunc             sourceBlend_;
 	BlendFunc             destinationBlend_;
+	bool                  stencilTest_;
+	StencilFunc           stencilFunc_;
+	StencilOp             stencilPassOp_;
+	uint8_t               stencilRef_;
 	// TODO: blend equation
 	// TODO: per-MRT blending
 
@@ -358,31 +906,56 @@ class PipelineDesc {
 	std::array<VertexAttr,     MAX_VERTEX_ATTRIBS>   vertexAttribs;
 	std::array<VertexBuf,      MAX_VERTEX_BUFFERS>   vertexBuffers;
 	std::array<DSLayoutHandle, MAX_DESCRIPTOR_SETS>  descriptorSetLayouts;
+	uint32_t                                         pushConstantSize_;
 
 	std::string                                      name_;
 
+	// 0 means not computed yet, cleared by every setter
+	mutable uint64_t                                 hash_;
+
+	uint64_t computeHash() const;
+
 
 public:
 
 	PipelineDesc &vertexShader(const std::string &name) {
 		assert(!name.empty());
 		vertexShaderName = name;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &fragmentShader(const std::string &name) {
 		assert(!name.empty());
 		fragmentShaderName = name;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &shaderMacros(const ShaderMacros &m) {
 		shaderMacros_ = m;
+		hash_ = 0;
+		return *this;
+	}
+
+	// the value the driver uses for constant_id id, without a new SPIR-V variant
+	PipelineDesc &specConstant(uint32_t id, uint32_t value) {
+		assert(id < MAX_SPEC_CONSTANTS);
+		specConstants_[id] = value;
+		specConstantMask |= (1 << id);
+		hash_ = 0;
 		return *this;
 	}
 
+	PipelineDesc &specConstant(uint32_t id, float value) {
+		uint32_t bits = 0;
+		memcpy(&bits, &value, sizeof(bits));
+		return specConstant(id, bits);
+	}
+
 	PipelineDesc &renderPass(RenderPassHandle h) {
 		renderPass_ = h;
+		hash_ = 0;
 		return *this;
 	}
 
@@ -396,6 +969,7 @@ public:
 
 
 		vertexAttribMask |= (1 << attrib);
+		hash_ = 0;
 		return *this;
 	}
 
@@ -403,60 +977,117 @@ public:
 		assert(buf < MAX_VERTEX_BUFFERS);
 		vertexBuffers[buf].stride = stride;
 
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &descriptorSetLayout(unsigned int index, DSLayoutHandle handle) {
 		assert(index < MAX_DESCRIPTOR_SETS);
 		descriptorSetLayouts[index] = handle;
+		hash_ = 0;
 		return *this;
 	}
 
 	template <typename T> PipelineDesc &descriptorSetLayout(unsigned int index) {
 		assert(index < MAX_DESCRIPTOR_SETS);
 		descriptorSetLayouts[index] = T::layoutHandle;
+		hash_ = 0;
 		return *this;
 	}
 
+	PipelineDesc &pushConstantSize(uint32_t size) {
+		assert(size <= MAX_PUSH_CONSTANT_SIZE);
+		assert(size % 4 == 0);
+		pushConstantSize_ = size;
+		hash_ = 0;
+		return *this;
+	}
+
+	template <typename T> PipelineDesc &pushConstants() {
+		return pushConstantSize(sizeof(T));
+	}
+
 	PipelineDesc &blending(bool b) {
 		blending_ = b;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &sourceBlend(BlendFunc b) {
 		assert(blending_);
 		sourceBlend_ = b;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &destinationBlend(BlendFunc b) {
 		assert(blending_);
 		destinationBlend_ = b;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &depthWrite(bool d) {
 		depthWrite_ = d;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &depthTest(bool d) {
 		depthTest_ = d;
+		hash_ = 0;
+		return *this;
+	}
+
+	PipelineDesc &depthFunc(DepthFunc f) {
+		assert(depthTest_);
+		depthFunc_ = f;
+		hash_ = 0;
+		return *this;
+	}
+
+	PipelineDesc &stencilTest(bool s) {
+		stencilTest_ = s;
+		hash_ = 0;
+		return *this;
+	}
+
+	PipelineDesc &stencilFunc(StencilFunc f) {
+		assert(stencilTest_);
+		stencilFunc_ = f;
+		hash_ = 0;
+		return *this;
+	}
+
+	PipelineDesc &stencilPassOp(StencilOp o) {
+		assert(stencilTest_);
+		stencilPassOp_ = o;
+		hash_ = 0;
+		return *this;
+	}
+
+	PipelineDesc &stencilRef(uint8_t r) {
+		assert(stencilTest_);
+		stencilRef_ = r;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &cullFaces(bool c) {
 		cullFaces_ = c;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &scissorTest(bool s) {
 		scissorTest_ = s;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc &name(const std::string &str) {
 		name_ = str;
+		hash_ = 0;
 		return *this;
 	}
 
@@ -464,19 +1095,28 @@ public:
 		assert(n != 0);
 		assert(isPow2(n));
 		numSamples_ = n;
+		hash_ = 0;
 		return *this;
 	}
 
 	PipelineDesc()
-	: vertexAttribMask(0)
+	: specConstantMask(0)
+	, vertexAttribMask(0)
 	, numSamples_(1)
 	, depthWrite_(false)
 	, depthTest_(false)
+	, depthFunc_(DepthFunc::Less)
 	, cullFaces_(false)
 	, scissorTest_(false)
 	, blending_(false)
 	, sourceBlend_(BlendFunc::One)
 	, destinationBlend_(BlendFunc::Zero)
+	, stencilTest_(false)
+	, stencilFunc_(StencilFunc::Always)
+	, stencilPassOp_(StencilOp::Keep)
+	, stencilRef_(0)
+	, pushConstantSize_(0)
+	, hash_(0)
 	{
 		for (unsigned int i = 0; i < MAX_VERTEX_ATTRIBS; i++) {
 			vertexAttribs[i].bufBinding = 0;
@@ -487,6 +1127,8 @@ public:
 		for (unsigned int i = 0; i < MAX_VERTEX_BUFFERS; i++) {
 			vertexBuffers[i].stride = 0;
 		}
+
+		specConstants_.fill(0);
 	}
 
 	~PipelineDesc() {}
@@ -499,24 +1141,139 @@ public:
 
 	bool operator==(const PipelineDesc &other) const;
 
+	// equal descs have equal hashes
+	uint64_t hashValue() const {
+		if (hash_ == 0) {
+			hash_ = computeHash();
+		}
+		return hash_;
+	}
+
+	// source is a shader file name as returned by Renderer::takeReloadedShaders
+	bool usesShaderSource(const std::string &source) const {
+		return (source == vertexShaderName + ".vert") || (source == fragmentShaderName + ".frag");
+	}
+
+
+	friend struct RendererImpl;
+	friend struct CaptureAccess;
+};
+
+
+class ComputePipelineDesc {
+	std::string                                      computeShaderName;
+	ShaderMacros                                     shaderMacros_;
+	std::array<uint32_t, MAX_SPEC_CONSTANTS>         specConstants_;
+	uint32_t                                         specConstantMask;
+	std::array<DSLayoutHandle, MAX_DESCRIPTOR_SETS>  descriptorSetLayouts;
+	uint32_t                                         pushConstantSize_;
+
+	std::string                                      name_;
+
+
+public:
+
+	ComputePipelineDesc &computeShader(const std::string &name) {
+		assert(!name.empty());
+		computeShaderName = name;
+		return *this;
+	}
+
+	ComputePipelineDesc &shaderMacros(const ShaderMacros &m) {
+		shaderMacros_ = m;
+		return *this;
+	}
+
+	ComputePipelineDesc &specConstant(uint32_t id, uint32_t value) {
+		assert(id < MAX_SPEC_CONSTANTS);
+		specConstants_[id] = value;
+		specConstantMask |= (1 << id);
+		return *this;
+	}
+
+	ComputePipelineDesc &specConstant(uint32_t id, float value) {
+		uint32_t bits = 0;
+		memcpy(&bits, &value, sizeof(bits));
+		return specConstant(id, bits);
+	}
+
+	ComputePipelineDesc &descriptorSetLayout(unsigned int index, DSLayoutHandle handle) {
+		assert(index < MAX_DESCRIPTOR_SETS);
+		descriptorSetLayouts[index] = handle;
+		return *this;
+	}
+
+	template <typename T> ComputePipelineDesc &descriptorSetLayout(unsigned int index) {
+		assert(index < MAX_DESCRIPTOR_SETS);
+		descriptorSetLayouts[index] = T::layoutHandle;
+		return *this;
+	}
+
+	ComputePipelineDesc &pushConstantSize(uint32_t size) {
+		assert(size <= MAX_PUSH_CONSTANT_SIZE);
+		assert(size % 4 == 0);
+		pushConstantSize_ = size;
+		return *this;
+	}
+
+	template <typename T> ComputePipelineDesc &pushConstants() {
+		return pushConstantSize(sizeof(T));
+	}
+
+	ComputePipelineDesc &name(const std::string &str) {
+		name_ = str;
+		return *this;
+	}
+
+	ComputePipelineDesc()
+	: specConstantMask(0)
+	, pushConstantSize_(0)
+	{
+		specConstants_.fill(0);
+	}
+
+	~ComputePipelineDesc() {}
+
+	ComputePipelineDesc(const ComputePipelineDesc &desc)                = default;
+	ComputePipelineDesc(ComputePipelineDesc &&desc) noexcept            = default;
+
+	ComputePipelineDesc &operator=(const ComputePipelineDesc &desc)     = default;
+	ComputePipelineDesc &operator=(ComputePipelineDesc &&desc) noexcept = default;
+
+	bool operator==(const ComputePipelineDesc &other) const;
+
+	bool usesShaderSource(const std::string &source) const {
+		return source == computeShaderName + ".comp";
+	}
+
 
 	friend struct RendererImpl;
+	friend struct CaptureAccess;
 };
 
 
 struct RenderPassDesc {
 	RenderPassDesc()
 	: depthStencilFormat_(Format::Invalid)
+	, depthStencilPassBegin_(PassBegin::DontCare)
+	, storeDepth_(true)
 	, numSamples_(1)
+	, views_(1)
 	, clearDepthAttachment(false)
 	, depthClearValue(1.0f)
+	, stencilPassBegin_(PassBegin::DontCare)
+	, storeStencil_(false)
+	, stencilClearValue(0)
 	{
 		for (auto &rt : colorRTs_) {
-			rt.format        = Format::Invalid;
-			rt.passBegin     = PassBegin::DontCare;
-			rt.initialLayout = Layout::Undefined;
-			rt.finalLayout   = Layout::Undefined;
-			rt.clearValue    = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+			rt.format             = Format::Invalid;
+			rt.passBegin          = PassBegin::DontCare;
+			rt.initialLayout      = Layout::Undefined;
+			rt.finalLayout        = Layout::Undefined;
+			rt.clearValue         = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+			rt.store              = true;
+			rt.resolveFormat      = Format::Invalid;
+			rt.resolveFinalLayout = Layout::Undefined;
 		}
 	}
 
@@ -528,8 +1285,19 @@ struct RenderPassDesc {
 	RenderPassDesc &operator=(const RenderPassDesc &)     = default;
 	RenderPassDesc &operator=(RenderPassDesc &&) noexcept = default;
 
-	RenderPassDesc &depthStencil(Format ds, PassBegin) {
-		depthStencilFormat_ = ds;
+	RenderPassDesc &depthStencil(Format ds, PassBegin pb) {
+		depthStencilFormat_    = ds;
+		depthStencilPassBegin_ = pb;
+		return *this;
+	}
+
+	// stencil contents are discarded at the end of the pass unless store is set
+	RenderPassDesc &stencil(PassBegin pb, bool store, uint8_t clear = 0) {
+		stencilPassBegin_ = pb;
+		storeStencil_     = store;
+		if (pb == +PassBegin::Clear) {
+			stencilClearValue = clear;
+		}
 		return *this;
 	}
 
@@ -545,12 +1313,39 @@ struct RenderPassDesc {
 		return *this;
 	}
 
+	// multisampled color attachment is resolved to a single-sampled target at the end of the pass
+	// resolve target contents before the pass are discarded
+	RenderPassDesc &resolve(unsigned int index, Format f, Layout final) {
+		assert(index < MAX_COLOR_RENDERTARGETS);
+		assert(colorRTs_[index].format != +Format::Invalid);
+		assert(f == colorRTs_[index].format);
+		assert(final != +Layout::Undefined);
+		assert(final != +Layout::TransferDst);
+		colorRTs_[index].resolveFormat      = f;
+		colorRTs_[index].resolveFinalLayout = final;
+		return *this;
+	}
+
+	// color attachment contents are not needed after the pass
+	RenderPassDesc &discardColor(unsigned int index) {
+		assert(index < MAX_COLOR_RENDERTARGETS);
+		colorRTs_[index].store = false;
+		return *this;
+	}
+
 	RenderPassDesc &clearDepth(float v) {
 		clearDepthAttachment  = true;
 		depthClearValue       = v;
 		return *this;
 	}
 
+	// depth contents are not needed after the pass
+	// it's left in attachment layout instead of ShaderRead
+	RenderPassDesc &discardDepth() {
+		storeDepth_ = false;
+		return *this;
+	}
+
 	RenderPassDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -561,6 +1356,15 @@ struct RenderPassDesc {
 		return *this;
 	}
 
+	// multiview, draws are broadcast to the first n layers of every attachment
+	// shaders see the layer as gl_ViewIndex
+	// needs n <= RendererFeatures::maxMultiviewViews
+	RenderPassDesc &views(unsigned int n) {
+		assert(n > 0);
+		views_ = n;
+		return *this;
+	}
+
 
 	struct RTInfo {
 		Format     format;
@@ -568,6 +1372,10 @@ struct RenderPassDesc {
 		Layout     initialLayout;
 		Layout     finalLayout;
 		glm::vec4  clearValue;
+		bool       store;
+		// Invalid if not resolved
+		Format     resolveFormat;
+		Layout     resolveFinalLayout;
 	};
 
 
@@ -577,17 +1385,32 @@ struct RenderPassDesc {
 	}
 
 
+	bool storeDepth() const {
+		return storeDepth_;
+	}
+
+
+	bool operator==(const RenderPassDesc &other) const;
+
+
 private:
 
 	Format                                       depthStencilFormat_;
+	PassBegin                                    depthStencilPassBegin_;
+	bool                                         storeDepth_;
 	std::array<RTInfo, MAX_COLOR_RENDERTARGETS>  colorRTs_;
 	unsigned int                                 numSamples_;
+	unsigned int                                 views_;
 	std::string                                  name_;
 	bool                                         clearDepthAttachment;
 	float                                        depthClearValue;
+	PassBegin                                    stencilPassBegin_;
+	bool                                         storeStencil_;
+	uint8_t                                      stencilClearValue;
 
 
 	friend struct RendererImpl;
+	friend struct CaptureAccess;
 };
 
 
@@ -596,8 +1419,11 @@ struct RenderTargetDesc {
 	: width_(0)
 	, height_(0)
 	, numSamples_(1)
+	, layers_(1)
 	, format_(Format::Invalid)
 	, additionalViewFormat_(Format::Invalid)
+	, storage_(false)
+	, transient_(false)
 	{
 	}
 
@@ -628,6 +1454,13 @@ struct RenderTargetDesc {
 		return *this;
 	}
 
+	// array rendertarget for multiview passes, sampled as an array texture
+	RenderTargetDesc &layers(unsigned int l) {
+		assert(l > 0);
+		layers_ = l;
+		return *this;
+	}
+
 	RenderTargetDesc &format(Format f) {
 		format_ = f;
 		return *this;
@@ -638,6 +1471,20 @@ struct RenderTargetDesc {
 		return *this;
 	}
 
+	// allow binding as StorageImage in compute shaders
+	RenderTargetDesc &storage(bool s) {
+		storage_ = s;
+		return *this;
+	}
+
+	// only used as an attachment within a render pass and never stored
+	// can't be sampled, blitted or resolved from
+	// backends may give it no memory at all on tilers
+	RenderTargetDesc &transient(bool t) {
+		transient_ = t;
+		return *this;
+	}
+
 	RenderTargetDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -646,18 +1493,25 @@ struct RenderTargetDesc {
 	unsigned int width()      const  { return width_; }
 	unsigned int height()     const  { return height_; }
 	unsigned int numSamples() const  { return numSamples_; }
+	unsigned int layers()     const  { return layers_; }
 	Format       format()     const  { return format_; }
 	Format       additionalViewFormat() const  { return additionalViewFormat_; }
+	bool         storage()    const  { return storage_; }
+	bool         transient()  const  { return transient_; }
 
 private:
 
 	unsigned int   width_, height_;
 	unsigned int   numSamples_;
+	unsigned int   layers_;
 	Format         format_;
 	Format         additionalViewFormat_;
+	bool           storage_;
+	bool           transient_;
 	std::string    name_;
 
 	friend struct RendererImpl;
+	friend struct CaptureAccess;
 };
 
 
@@ -665,6 +1519,8 @@ struct SamplerDesc {
 	SamplerDesc()
 	: min(FilterMode::Nearest)
 	, mag(FilterMode::Nearest)
+	, mip(FilterMode::Nearest)
+	, mipmaps(false)
 	, wrapMode(WrapMode::Clamp)
 	{
 	}
@@ -687,34 +1543,68 @@ struct SamplerDesc {
 		return *this;
 	}
 
+	// without this only the top mip level is sampled
+	SamplerDesc &mipFilter(FilterMode m) {
+		mip     = m;
+		mipmaps = true;
+		return *this;
+	}
+
 	SamplerDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
 	}
 
+	// name is only for debugging and is not compared
+	bool operator==(const SamplerDesc &other) const {
+		return hashValue() == other.hashValue();
+	}
+
+	// all the state packed together so unequal descs never collide
+	uint64_t hashValue() const {
+		return (uint64_t(min._to_integral())      << 32)
+		     | (uint64_t(mag._to_integral())      << 24)
+		     | (uint64_t(mip._to_integral())      << 16)
+		     | (uint64_t(wrapMode._to_integral()) <<  8)
+		     |  uint64_t(mipmaps);
+	}
+
 private:
 
-	FilterMode  min, mag;
+	FilterMode  min, mag, mip;
+	bool        mipmaps;
 	WrapMode    wrapMode;
 	std::string name_;
 
 	friend struct RendererImpl;
+	friend struct CaptureAccess;
 };
 
 
 struct SwapchainDesc {
 	unsigned int  width, height;
+	// swapchain images, the driver might give us more
 	unsigned int  numFrames;
+	// CPU frames recorded ahead of the GPU, 0 for one per swapchain image
+	unsigned int  framesInFlight;
 	VSync         vsync;
 	bool          fullscreen;
+	// use the surface's current transform so the compositor doesn't rotate
+	// presentFrame's blit does it instead, only mirroring transforms are used
+	bool          preTransform;
+	// pass addDamageRect regions to the presentation engine when supported
+	bool          incrementalPresent;
 
 
 	SwapchainDesc()
 	: width(0)
 	, height(0)
 	, numFrames(3)
+	, framesInFlight(0)
 	, vsync(VSync::On)
 	, fullscreen(false)
+	, preTransform(false)
+	, incrementalPresent(false)
 	{
 	}
 };
@@ -726,6 +1616,7 @@ struct TextureDesc {
 	, height_(0)
 	, numMips_(1)
 	, format_(Format::Invalid)
+	, generateMips_(false)
 	{
 		std::fill(mipData_.begin(), mipData_.end(), MipLevel());
 	}
@@ -756,6 +1647,20 @@ struct TextureDesc {
 		return *this;
 	}
 
+	TextureDesc &numMips(unsigned int n) {
+		assert(n > 0);
+		assert(n <= MAX_TEXTURE_MIPLEVELS);
+		numMips_ = n;
+		return *this;
+	}
+
+	// only level 0 has data, the rest of the chain is made on the GPU during upload
+	// not for compressed formats
+	TextureDesc &generateMips(bool g) {
+		generateMips_ = g;
+		return *this;
+	}
+
 	TextureDesc &mipLevelData(unsigned int level, const void *data, unsigned int size) {
 		assert(level < numMips_);
 		mipData_[level].data = data;
@@ -763,6 +1668,35 @@ struct TextureDesc {
 		return *this;
 	}
 
+	// instead of mipLevelData, createTexture calls this for every level
+	// to write it straight into upload memory, saving a copy of the whole texture
+	// size is formatDataSize of the level, rows are tightly packed
+	// runs on the calling thread while that thread's uploads can't be submitted
+	// dst might be uncached memory where reading back is slow
+	TextureDesc &mipLevelWriter(std::function<void (unsigned int level, void *dst, unsigned int size)> writer) {
+		mipWriter_ = std::move(writer);
+		return *this;
+	}
+
+	// copy with the writer's output as mipLevelData in storage
+	// for captures and renderers which can't give out upload memory
+	TextureDesc writeMipLevels(std::vector<std::vector<char> > &storage) const {
+		TextureDesc result(*this);
+		result.mipWriter_ = nullptr;
+		if (!mipWriter_) {
+			return result;
+		}
+
+		storage.resize(numMips_);
+		for (unsigned int i = 0; i < numMips_; i++) {
+			storage[i].resize(mipLevelSize(i));
+			mipWriter_(i, storage[i].data(), static_cast<unsigned int>(storage[i].size()));
+			result.mipLevelData(i, storage[i].data(), static_cast<unsigned int>(storage[i].size()));
+		}
+
+		return result;
+	}
+
 	TextureDesc &name(const std::string &str) {
 		name_ = str;
 		return *this;
@@ -785,10 +1719,33 @@ private:
 	unsigned int                                 width_, height_;
 	unsigned int                                 numMips_;
 	Format                                       format_;
+	bool                                         generateMips_;
 	std::array<MipLevel, MAX_TEXTURE_MIPLEVELS>  mipData_;
+	std::function<void (unsigned int level, void *dst, unsigned int size)>  mipWriter_;
 	std::string                                  name_;
 
+
+	unsigned int mipLevelSize(unsigned int level) const {
+		assert(level < numMips_);
+		if (mipWriter_) {
+			return static_cast<unsigned int>(formatDataSize(format_, std::max(width_ >> level, 1u), std::max(height_ >> level, 1u)));
+		}
+
+		assert(mipData_[level].data != nullptr);
+		assert(mipData_[level].size != 0);
+		return mipData_[level].size;
+	}
+
+	void writeMipLevel(unsigned int level, void *dst) const {
+		if (mipWriter_) {
+			mipWriter_(level, dst, mipLevelSize(level));
+		} else {
+			memcpy(dst, mipData_[level].data, mipData_[level].size);
+		}
+	}
+
 	friend struct RendererImpl;
+	friend struct CaptureAccess;
 };
 
 
@@ -814,6 +1771,31 @@ struct Version {
 };
 
 
+// a device the renderer could run on, from Renderer::listDevices
+struct DeviceInfo {
+	// RendererDesc::vulkanDeviceIndex which selects this device
+	unsigned int  index;
+	std::string   name;
+	// discrete, integrated, virtual, cpu or other
+	std::string   type;
+	uint32_t      vendorID;
+	uint32_t      deviceID;
+	Version       apiVersion;
+	Version       driverVersion;
+	// total of device local heaps in bytes, 0 if unknown
+	uint64_t      localMemory;
+
+
+	DeviceInfo()
+	: index(0)
+	, vendorID(0)
+	, deviceID(0)
+	, localMemory(0)
+	{
+	}
+};
+
+
 struct RendererDesc {
 	bool           debug;
 	bool           robustness;
@@ -822,13 +1804,62 @@ struct RendererDesc {
 	bool           optimizeShaders;
 	bool           validateShaders;
 	bool           transferQueue;
+	// write buffer contents straight into device local memory when most of it is host visible
+	bool           directUploads;
+	// record render pass contents into secondary command buffers
+	bool           secondaryCommandBuffers;
+	// Vulkan: begin render passes with VK_KHR_dynamic_rendering when supported
+	// instead of creating vk::RenderPass and vk::Framebuffer objects
+	bool           dynamicRendering;
+	// run compute between beginAsyncCompute and endAsyncCompute on a second queue
+	bool           asyncCompute;
+	// Vulkan: presentFrame hands the frame's submits and present to a thread of their own
+	// so blocking in them under vsync doesn't hold up the next frame's CPU work
+	// beginFrame still waits for the last present before acquiring the next image
+	bool           submitThread;
+	// count shader invocations and primitives inside each GPU timer, see GPUTiming
+	bool           pipelineStatistics;
+	// Vulkan: sample these VK_KHR_performance_query counters inside each GPU timer
+	// names as the driver reports them, all available ones are logged when this is not empty
+	std::vector<std::string>  performanceCounters;
+	// Vulkan: get register usage and instruction counts of each pipeline, see PipelineStats
+	// VK_AMD_shader_info disables the driver's pipeline cache on some drivers
+	bool           shaderStatistics;
+	// smallest size of one ephemeral ring buffer page, more pages are added as needed
+	// pages grow to fit a frame and start at the size the last run needed
 	unsigned int   ephemeralRingBufSize;
+	// bytes of buffer memory beginFrame may move to undo fragmentation
+	// after resources have been deleted, 0 to disable
+	unsigned int   defragmentBytesPerFrame;
+	FrameWait      frameWait;
+	// milliseconds, short enough to keep pumping window events
+	unsigned int   frameWaitTimeout;
+	// no window or swapchain, swapchain width and height are the drawable size
+	// presentFrame only finishes the frame, use readbacks to get at the image
+	bool           offscreen;
 	SwapchainDesc  swapchain;
 	std::string    applicationName;
 	Version        applicationVersion;
 	std::string    engineName;
 	Version        engineVersion;
 	std::string    vulkanDeviceFilter;
+	// index from Renderer::listDevices, overrides vulkanDeviceFilter, -1 for none
+	int            vulkanDeviceIndex;
+	// where spirv.cache is loaded from and saved to, empty for the user's pref path
+	std::string    shaderCacheDir;
+	// watch shader sources and includes, recompile what changed in the background
+	bool           shaderHotReload;
+	// used for every shader without an override, ignored if optimizeShaders is false
+	ShaderOptimization  shaderOptimization;
+	// keyed on file name ("smaaEdge.frag") or name without extension ("smaaEdge")
+	HashMap<std::string, ShaderOptimization>  shaderOptimizationOverrides;
+	// record every Renderer call to this file for CaptureReplay, empty for none
+	std::string    captureFile;
+	// the file is written after this many frames or when the renderer is destroyed
+	unsigned int   captureFrames;
+	// background shader compiles run here, null to have the renderer start its own
+	// must outlive the renderer
+	JobSystem     *jobSystem;
 
 
 	RendererDesc()
@@ -839,7 +1870,23 @@ struct RendererDesc {
 	, optimizeShaders(true)
 	, validateShaders(false)
 	, transferQueue(true)
+	, directUploads(true)
+	, secondaryCommandBuffers(false)
+	, dynamicRendering(true)
+	, asyncCompute(false)
+	, submitThread(false)
+	, pipelineStatistics(false)
+	, shaderStatistics(false)
 	, ephemeralRingBufSize(1 * 1048576)
+	, defragmentBytesPerFrame(0)
+	, frameWait(FrameWait::Block)
+	, frameWaitTimeout(100)
+	, offscreen(false)
+	, vulkanDeviceIndex(-1)
+	, shaderHotReload(false)
+	, shaderOptimization(ShaderOptimization::Performance)
+	, captureFrames(10)
+	, jobSystem(nullptr)
 	{
 	}
 };
@@ -849,17 +1896,83 @@ struct RendererFeatures {
 	uint32_t  maxMSAASamples;
 	bool      sRGBFramebuffer;
 	bool      SSBOSupported;
+	bool      computeShaders;
+	// drawIndirect with drawCount > 1 is a single call instead of a loop
+	bool      multiDrawIndirect;
+	// DescriptorType::TextureTable can be used
+	bool      textureTable;
+	// getSwapchainRenderTarget returns an sRGBA8 rendertarget
+	// which presentFrame takes without the blit
+	bool      swapchainRenderTarget;
+	// beginAsyncCompute and endAsyncCompute can be used
+	bool      asyncCompute;
+	// native 16-bit float ALU, RelaxedPrecision (mediump) math can run at half precision
+	// without it mediump is legal but only a hint
+	bool      halfPrecision;
+	// compute shaders can use GL_ARB_shader_ballot and 64-bit integers
+	bool      subgroupBallot;
+	// largest RenderPassDesc::views, 1 if multiview is not supported
+	uint32_t  maxMultiviewViews;
+	// beginStaticRenderPass replays contents recorded by an earlier frame
+	bool      staticRenderPasses;
+	// createBuffer, createTexture and createSampler can be called from any thread
+	// except while capturing, uploads from other threads become visible at the next presentFrame
+	bool      threadedResourceCreation;
+	// executeDrawList records large lists on the job system's threads
+	// into secondary command buffers from per-thread, per-frame pools
+	bool      parallelRecording;
 
 
 	RendererFeatures()
 	: maxMSAASamples(1)
 	, sRGBFramebuffer(false)
 	, SSBOSupported(false)
+	, computeShaders(false)
+	, multiDrawIndirect(false)
+	, textureTable(false)
+	, swapchainRenderTarget(false)
+	, asyncCompute(false)
+	, halfPrecision(false)
+	, subgroupBallot(false)
+	, maxMultiviewViews(1)
+	, staticRenderPasses(false)
+	, threadedResourceCreation(false)
+	, parallelRecording(false)
 	{
 	}
 };
 
 
+// arguments of drawIndirect, same layout in GL and Vulkan
+struct DrawIndirectArgs {
+	uint32_t  vertexCount;
+	uint32_t  instanceCount;
+	uint32_t  firstVertex;
+	// must be 0
+	uint32_t  firstInstance;
+};
+
+
+// arguments of drawIndexedIndirect, same layout in GL and Vulkan
+struct DrawIndexedIndirectArgs {
+	uint32_t  indexCount;
+	uint32_t  instanceCount;
+	uint32_t  firstIndex;
+	int32_t   vertexOffset;
+	// must be 0
+	uint32_t  firstInstance;
+};
+
+
+// ring buffer memory returned by allocateEphemeral
+// contents must be written before the next Renderer call
+// write-only, it's often uncached and reading it back is very slow
+struct EphemeralAllocation {
+	BufferHandle  buffer;
+	void          *contents;
+};
+
+
 struct RendererImpl;
 
 
@@ -877,6 +1990,10 @@ public:
 
 	static Renderer createRenderer(const RendererDesc &desc);
 
+	// devices of the compiled-in backend, without creating a renderer
+	// backends without device selection report a single device
+	static std::vector<DeviceInfo> listDevices();
+
 	Renderer(const Renderer &)            = delete;
 	Renderer &operator=(const Renderer &) = delete;
 
@@ -911,31 +2028,60 @@ public:
 
 
 	bool isRenderTargetFormatSupported(Format format) const;
+	// can be sampled and uploaded with createTexture
+	bool isTextureFormatSupported(Format format) const;
 	unsigned int getCurrentRefreshRate() const;
 	unsigned int getMaxRefreshRate() const;
 
 	const RendererFeatures &getFeatures() const;
 
-	// TODO: add buffer usage flags
+	// createBuffer, createSampler and createTexture can be called from any thread
+	// if features.threadedResourceCreation, the rest only from the one which created the renderer
+	// same as BufferUsage::Static
 	BufferHandle          createBuffer(BufferType type, uint32_t size, const void *contents);
+	BufferHandle          createBuffer(const BufferDesc &desc);
 	BufferHandle          createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
+	// like createEphemeralBuffer but the caller writes the contents in place
+	EphemeralAllocation   allocateEphemeral(BufferType type, uint32_t size);
 	FramebufferHandle     createFramebuffer(const FramebufferDesc &desc);
 	PipelineHandle        createPipeline(const PipelineDesc &desc);
+	// requires features.computeShaders
+	PipelineHandle        createComputePipeline(const ComputePipelineDesc &desc);
 	RenderPassHandle      createRenderPass(const RenderPassDesc &desc);
 	RenderTargetHandle    createRenderTarget(const RenderTargetDesc &desc);
+	// equal descs share one sampler, each create needs its own deleteSampler
 	SamplerHandle         createSampler(const SamplerDesc &desc);
 	TextureHandle         createTexture(const TextureDesc &desc);
 	// TODO: non-ephemeral descriptor set
 
+	// start compiling the shaders of a pipeline in the background
+	// only shader names and macros are used, createPipeline waits for the result
+	void precompileShaders(const PipelineDesc &desc);
+	void precompileShaders(const ComputePipelineDesc &desc);
+	// block until all precompiled shaders are done and write the shader cache
+	// rethrows compile errors
+	void waitForShaders();
+	// shader files which changed on disk since the last call, with all their variants recompiled
+	// only if shaderHotReload, pass to RenderGraph::reloadPipelines between frames
+	std::vector<std::string> takeReloadedShaders();
+
 	DSLayoutHandle createDescriptorSetLayout(const DescriptorLayout *layout);
 	template <typename T> void registerDescriptorSetLayout() {
 		T::layoutHandle = createDescriptorSetLayout(T::layout);
 	}
 
 	// gets the textures of a rendertarget to be used for sampling
-	// might be ephemeral, don't store
+	// views are created with the rendertarget and stay valid until it is deleted
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
 
+	// the swapchain image acquired by beginFrame, only valid until presentFrame
+	// only if features.swapchainRenderTarget, must end up in Present layout
+	RenderTargetHandle   getSwapchainRenderTarget() const;
+
+	// index of a texture in the TextureTable descriptor
+	// only valid if features.textureTable and not for rendertargets
+	unsigned int         getTextureTableIndex(TextureHandle handle) const;
+
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
 	void deletePipeline(PipelineHandle handle);
@@ -949,16 +2095,66 @@ public:
 	bool isSwapchainDirty() const;
 	glm::uvec2 getDrawableSize() const;
 	MemoryStats getMemStats() const;
+	ShaderStats getShaderStats() const;
+	// one entry per RendererCall, all zero unless built with RENDERER_CALL_STATS
+	std::vector<CallStats> getCallStats() const;
+	void resetCallStats();
+
+	// GPU timer results of the most recently synced frame
+	const std::vector<GPUTiming> &getGPUTimings() const;
+
+	// RendererDesc::performanceCounters which could be sampled, in GPUTiming::counters order
+	const std::vector<std::string> &getPerformanceCounters() const;
+
+	// frames whose present time became known during the last beginFrame
+	const std::vector<PresentTiming> &getPresentTimings() const;
+
+	// the next presentFrame also copies the presented image to CPU memory
+	// not possible when rendering straight into the swapchain image
+	void requestFrameReadback();
+	// image of the most recently synced frame which requested a readback
+	// false if none arrived since the last call, reuses readback's memory
+	bool getFrameReadback(FrameReadback &readback);
+	// nanoseconds, 0 if the display refresh isn't known
+	uint64_t getRefreshInterval() const;
+	// nanoseconds until the display's next refresh, 0 if unknown
+	uint64_t getTimeToNextRefresh() const;
 
 	bool waitForDeviceIdle() WARN_UNUSED_RESULT;
 
 	// rendering
 	bool beginFrame() WARN_UNUSED_RESULT;
 	void presentFrame(RenderTargetHandle image);
+	// region of the next presentFrame which changed since the previous one
+	// none means the whole image
+	void addDamageRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+	// commands between these run on the async compute queue
+	// overlapping with the start of the next frame
+	// only compute, must be outside renderpass
+	void beginAsyncCompute();
+	void endAsyncCompute();
 
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	// like beginRenderPass but the commands until endRenderPass are kept and replayed by later calls
+	// true if the caller must record them, false if they were replayed and only endRenderPass is allowed
+	// the contents can't use ephemeral buffers and don't see descriptor sets bound before the pass
+	// always true without RendererFeatures::staticRenderPasses
+	bool beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) WARN_UNUSED_RESULT;
+	// drop recorded contents, the next beginStaticRenderPass records them again
+	// needed when anything they used changes or is deleted
+	void invalidateStaticRenderPass(RenderPassHandle rpHandle);
 	void endRenderPass();
 
+	// GPU timers must not be nested
+	void beginGPUTimer(const std::string &name);
+	void endGPUTimer();
+
+	// named command regions for RenderDoc and vendor profilers, only recorded with RendererDesc::tracing
+	// can be nested, ones pushed inside a renderpass must be popped inside it
+	void pushDebugGroup(const char *name);
+	void popDebugGroup();
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -970,15 +2166,80 @@ public:
 		bindDescriptorSet(index, T::layoutHandle, &data);
 	}
 
+	// small per-draw parameters, size must match the bound pipeline's pushConstantSize
+	void pushConstants(const void *data, unsigned int size);
+	template <typename T> void pushConstants(const T &data) {
+		pushConstants(&data, sizeof(T));
+	}
+
 	void bindIndexBuffer(BufferHandle buffer, bool bit16);
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
 
+	// overwrites part of a Dynamic or Streaming buffer, offset and size multiples of 4
+	// commands recorded before it still see the old contents, not inside a render pass
+	void updateBuffer(BufferHandle buffer, uint32_t offset, uint32_t size, const void *data);
+	// overwrites a rectangle of one mip level of a createTexture texture, ordered like updateBuffer
+	// data is tightly packed rows like TextureDesc::mipLevelData, size is formatDataSize(format, width, height)
+	// compressed formats need the rectangle on block boundaries except where it ends at the level's edge
+	// levels made by TextureDesc::generateMips are not updated from the base level
+	void updateTexture(TextureHandle texture, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data);
+
 	void blit(RenderTargetHandle source, RenderTargetHandle target);
 	void resolveMSAA(RenderTargetHandle source, RenderTargetHandle target);
+	// copies a color rendertarget in TransferSrc layout to CPU memory
+	// without waiting for the GPU, callback gets it after the frame has completed
+	void readbackRenderTarget(RenderTargetHandle rt, ReadbackCallback callback);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
+	void drawInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int minIndex, unsigned int maxIndex);
+	// vertexOffset is added to every index, minIndex and maxIndex are before adding it
+	void drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex);
+	// buffer must be BufferType::Indirect with drawCount DrawIndirectArgs records
+	void drawIndirect(BufferHandle buffer, unsigned int drawCount);
+	// buffer must be BufferType::Indirect with drawCount DrawIndexedIndirectArgs records
+	// index buffer must not be ephemeral since GL doesn't apply its offset
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount);
+	// list must be sorted, DrawList::execute calls this
+	// blocks until every draw is recorded, with RendererFeatures::parallelRecording they're split between threads
+	// pipeline and bindings are left in an unspecified state afterwards
+	void executeDrawList(const DrawList &list);
+
+	// compute, must be outside renderpass with a compute pipeline bound
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+	// buffer must be BufferType::Indirect, arguments are 3 uints at the beginning
+	void dispatchIndirect(BufferHandle buffer);
+	// make writes of previous dispatches visible to later dispatches,
+	// indirect arguments, vertex and fragment shaders
+	void computeBarrier();
+};
+
+
+// plays back a stream written with RendererDesc::captureFile into any renderer
+// texture table indices in push constants are only right if the textures are created in the same order
+class CaptureReplay {
+	std::unique_ptr<CaptureReader>  reader;
+
+
+public:
+
+	// throws std::runtime_error if the file is not a valid capture
+	explicit CaptureReplay(const std::string &filename);
+
+	CaptureReplay(const CaptureReplay &)                = delete;
+	CaptureReplay(CaptureReplay &&) noexcept            = delete;
+
+	CaptureReplay &operator=(const CaptureReplay &)     = delete;
+	CaptureReplay &operator=(CaptureReplay &&) noexcept = delete;
+
+	~CaptureReplay();
+
+	unsigned int numFrames() const;
+
+	// creates everything made before frame, then renders frame loops times
+	// only call once per renderer, returns nanoseconds of each loop
+	std::vector<uint64_t> replay(Renderer &renderer, unsigned int frame, unsigned int loops);
 };
 
 
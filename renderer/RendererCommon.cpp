@@ -22,11 +22,14 @@ THE SOFTWARE.
 
 
 #include "RendererInternal.h"
+#include "Capture.h"
+#include "DrawList.h"
+#include "utils/Profiler.h"
+#include "utils/ThreadPlacement.h"
 #include "utils/Utils.h"
 
 #include <algorithm>
-#include <sstream>
-#include <boost/algorithm/string/split.hpp>
+#include <chrono>
 
 #include <spirv-tools/optimizer.hpp>
 #include <SPIRV/SPVRemapper.h>
@@ -72,6 +75,7 @@ bool isDepthFormat(Format format) {
 
 	case Format::RG16Float:
 	case Format::RGBA16Float:
+	case Format::RG11B10Float:
 		return false;
 
 	case Format::RGBA32Float:
@@ -92,6 +96,69 @@ bool isDepthFormat(Format format) {
 	case Format::Depth32Float:
 		return true;
 
+	case Format::BC1RGBA:
+	case Format::sBC1RGBA:
+	case Format::BC3RGBA:
+	case Format::sBC3RGBA:
+	case Format::BC7RGBA:
+	case Format::sBC7RGBA:
+	case Format::ETC2RGB8:
+	case Format::sETC2RGB8:
+	case Format::ETC2RGBA8:
+	case Format::sETC2RGBA8:
+	case Format::ASTC4x4:
+	case Format::sASTC4x4:
+		return false;
+
+	}
+
+	UNREACHABLE();
+	return false;
+}
+
+
+bool isStencilFormat(Format format) {
+	switch (format) {
+	case Format::Invalid:
+		UNREACHABLE();
+		return false;
+
+	case Format::R8:
+	case Format::RG8:
+	case Format::RGB8:
+	case Format::RGBA8:
+	case Format::sRGBA8:
+	case Format::RG16Float:
+	case Format::RGBA16Float:
+	case Format::RGBA32Float:
+	case Format::RG11B10Float:
+		return false;
+
+	case Format::Depth16:
+		return false;
+
+	case Format::Depth16S8:
+	case Format::Depth24S8:
+		return true;
+
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+		return false;
+
+	case Format::BC1RGBA:
+	case Format::sBC1RGBA:
+	case Format::BC3RGBA:
+	case Format::sBC3RGBA:
+	case Format::BC7RGBA:
+	case Format::sBC7RGBA:
+	case Format::ETC2RGB8:
+	case Format::sETC2RGB8:
+	case Format::ETC2RGBA8:
+	case Format::sETC2RGBA8:
+	case Format::ASTC4x4:
+	case Format::sASTC4x4:
+		return false;
+
 	}
 
 	UNREACHABLE();
@@ -112,6 +179,7 @@ bool issRGBFormat(Format format) {
 	case Format::RG16Float:
 	case Format::RGBA16Float:
 	case Format::RGBA32Float:
+	case Format::RG11B10Float:
 		return false;
 
 	case Format::sRGBA8:
@@ -124,6 +192,22 @@ bool issRGBFormat(Format format) {
 	case Format::Depth32Float:
 		return false;
 
+	case Format::BC1RGBA:
+	case Format::BC3RGBA:
+	case Format::BC7RGBA:
+	case Format::ETC2RGB8:
+	case Format::ETC2RGBA8:
+	case Format::ASTC4x4:
+		return false;
+
+	case Format::sBC1RGBA:
+	case Format::sBC3RGBA:
+	case Format::sBC7RGBA:
+	case Format::sETC2RGB8:
+	case Format::sETC2RGBA8:
+	case Format::sASTC4x4:
+		return true;
+
 	}
 
 	UNREACHABLE();
@@ -131,6 +215,40 @@ bool issRGBFormat(Format format) {
 }
 
 
+void ShaderMacros::emplace(std::string name, std::string value) {
+	auto it = std::lower_bound(macros.begin(), macros.end(), name
+	                          , [] (const Macro &m, const std::string &n) { return m.first < n; });
+	if (it != macros.end() && it->first == name) {
+		return;
+	}
+
+	macros.emplace(it, std::move(name), std::move(value));
+	rehash();
+}
+
+
+void ShaderMacros::rehash() {
+	uint64_t h = 0;
+	for (const auto &m : macros) {
+		h = XXH64(m.first.data(),  m.first.size(),  h);
+		h = XXH64(m.second.data(), m.second.size(), h);
+	}
+	hash = h;
+}
+
+
+std::string shaderMacrosString(const ShaderMacros &macros) {
+	std::string result;
+	for (const auto &m : macros) {
+		if (!result.empty()) {
+			result += " ";
+		}
+		result += m.first + "=" + m.second;
+	}
+	return result;
+}
+
+
 uint32_t formatSize(Format format) {
 	switch (format) {
 	case Format::Invalid:
@@ -161,6 +279,9 @@ uint32_t formatSize(Format format) {
 	case Format::RGBA32Float:
 		return 4 * 4;
 
+	case Format::RG11B10Float:
+		return 4;
+
 	case Format::Depth16:
 		return 2;
 
@@ -176,6 +297,22 @@ uint32_t formatSize(Format format) {
 	case Format::Depth32Float:
 		return 4;
 
+	case Format::BC1RGBA:
+	case Format::sBC1RGBA:
+	case Format::ETC2RGB8:
+	case Format::sETC2RGB8:
+		return 8;
+
+	case Format::BC3RGBA:
+	case Format::sBC3RGBA:
+	case Format::BC7RGBA:
+	case Format::sBC7RGBA:
+	case Format::ETC2RGBA8:
+	case Format::sETC2RGBA8:
+	case Format::ASTC4x4:
+	case Format::sASTC4x4:
+		return 16;
+
 	}
 
 	UNREACHABLE();
@@ -183,6 +320,76 @@ uint32_t formatSize(Format format) {
 }
 
 
+bool isCompressedFormat(Format format) {
+	switch (format) {
+	case Format::Invalid:
+		UNREACHABLE();
+		return false;
+
+	case Format::R8:
+	case Format::RG8:
+	case Format::RGB8:
+	case Format::RGBA8:
+	case Format::sRGBA8:
+	case Format::RG16Float:
+	case Format::RGBA16Float:
+	case Format::RGBA32Float:
+	case Format::RG11B10Float:
+	case Format::Depth16:
+	case Format::Depth16S8:
+	case Format::Depth24S8:
+	case Format::Depth24X8:
+	case Format::Depth32Float:
+		return false;
+
+	case Format::BC1RGBA:
+	case Format::sBC1RGBA:
+	case Format::BC3RGBA:
+	case Format::sBC3RGBA:
+	case Format::BC7RGBA:
+	case Format::sBC7RGBA:
+	case Format::ETC2RGB8:
+	case Format::sETC2RGB8:
+	case Format::ETC2RGBA8:
+	case Format::sETC2RGBA8:
+	case Format::ASTC4x4:
+	case Format::sASTC4x4:
+		return true;
+
+	}
+
+	UNREACHABLE();
+	return false;
+}
+
+
+uint32_t formatBlockDim(Format format) {
+	// all the compressed formats we have use 4x4 blocks
+	return isCompressedFormat(format) ? 4 : 1;
+}
+
+
+uint64_t formatDataSize(Format format, unsigned int width, unsigned int height) {
+	uint64_t dim = formatBlockDim(format);
+	uint64_t blocksWide = (width  + dim - 1) / dim;
+	uint64_t blocksHigh = (height + dim - 1) / dim;
+
+	return blocksWide * blocksHigh * formatSize(format);
+}
+
+
+unsigned int mipChainLength(unsigned int width, unsigned int height) {
+	unsigned int size   = std::max(width, height);
+	unsigned int levels = 1;
+	while (size > 1) {
+		size /= 2;
+		levels++;
+	}
+
+	return levels;
+}
+
+
 bool PipelineDesc::VertexAttr::operator==(const VertexAttr &other) const {
 	if (this->bufBinding != other.bufBinding) {
 		return false;
@@ -240,6 +447,15 @@ bool PipelineDesc::operator==(const PipelineDesc &other) const {
 		return false;
 	}
 
+	if (this->specConstantMask   != other.specConstantMask) {
+		return false;
+	}
+
+	// unset ones are always 0
+	if (this->specConstants_     != other.specConstants_) {
+		return false;
+	}
+
 	if (this->vertexAttribMask   != other.vertexAttribMask) {
 		return false;
 	}
@@ -256,6 +472,10 @@ bool PipelineDesc::operator==(const PipelineDesc &other) const {
 		return false;
 	}
 
+	if (this->depthTest_ && this->depthFunc_ != other.depthFunc_) {
+		return false;
+	}
+
 	if (this->cullFaces_         != other.cullFaces_) {
 		return false;
 	}
@@ -264,6 +484,24 @@ bool PipelineDesc::operator==(const PipelineDesc &other) const {
 		return false;
 	}
 
+	if (this->stencilTest_       != other.stencilTest_) {
+		return false;
+	}
+
+	if (this->stencilTest_) {
+		if (this->stencilFunc_      != other.stencilFunc_) {
+			return false;
+		}
+
+		if (this->stencilPassOp_    != other.stencilPassOp_) {
+			return false;
+		}
+
+		if (this->stencilRef_       != other.stencilRef_) {
+			return false;
+		}
+	}
+
 	if (this->blending_          != other.blending_) {
 		return false;
 	}
@@ -297,6 +535,196 @@ bool PipelineDesc::operator==(const PipelineDesc &other) const {
 		}
 	}
 
+	if (this->pushConstantSize_ != other.pushConstantSize_) {
+		return false;
+	}
+
+	if (this->name_ != other.name_) {
+		return false;
+	}
+
+	return true;
+}
+
+
+uint64_t PipelineDesc::computeHash() const {
+	uint64_t h = 0;
+	auto add = [&h] (const void *data, size_t size) {
+		h = XXH64(data, size, h);
+	};
+	auto addString = [&add] (const std::string &str) {
+		// include length so ("ab", "c") and ("a", "bc") differ
+		uint64_t len = str.size();
+		add(&len, sizeof(len));
+		add(str.data(), str.size());
+	};
+
+	addString(vertexShaderName);
+	addString(fragmentShaderName);
+	add(&renderPass_, sizeof(renderPass_));
+
+	uint64_t macroHash = shaderMacros_.hashValue();
+	uint64_t numMacros = shaderMacros_.size();
+	add(&macroHash, sizeof(macroHash));
+	add(&numMacros, sizeof(numMacros));
+
+	add(&specConstantMask,      sizeof(specConstantMask));
+	add(specConstants_.data(),  specConstants_.size() * sizeof(uint32_t));
+
+	add(&vertexAttribMask, sizeof(vertexAttribMask));
+	add(&numSamples_,      sizeof(numSamples_));
+
+	// same fields as operator==, disabled depth, stencil and blend state is ignored
+	uint8_t state[12] = {
+		  depthWrite_
+		, depthTest_
+		, static_cast<uint8_t>(depthTest_   ? depthFunc_._to_integral()        : 0)
+		, cullFaces_
+		, scissorTest_
+		, stencilTest_
+		, static_cast<uint8_t>(stencilTest_ ? stencilFunc_._to_integral()      : 0)
+		, static_cast<uint8_t>(stencilTest_ ? stencilPassOp_._to_integral()    : 0)
+		, static_cast<uint8_t>(stencilTest_ ? stencilRef_                      : 0)
+		, blending_
+		, static_cast<uint8_t>(blending_    ? sourceBlend_._to_integral()      : 0)
+		, static_cast<uint8_t>(blending_    ? destinationBlend_._to_integral() : 0)
+	};
+	add(state, sizeof(state));
+
+	for (const auto &attr : vertexAttribs) {
+		uint8_t a[4] = { attr.bufBinding, attr.count, attr.format._to_integral(), attr.offset };
+		add(a, sizeof(a));
+	}
+
+	for (const auto &buf : vertexBuffers) {
+		add(&buf.stride, sizeof(buf.stride));
+	}
+
+	for (const auto &layout : descriptorSetLayouts) {
+		add(&layout, sizeof(layout));
+	}
+
+	add(&pushConstantSize_, sizeof(pushConstantSize_));
+
+	addString(name_);
+
+	return h;
+}
+
+
+bool ComputePipelineDesc::operator==(const ComputePipelineDesc &other) const {
+	if (this->computeShaderName != other.computeShaderName) {
+		return false;
+	}
+
+	if (this->shaderMacros_     != other.shaderMacros_) {
+		return false;
+	}
+
+	if (this->specConstantMask  != other.specConstantMask) {
+		return false;
+	}
+
+	if (this->specConstants_    != other.specConstants_) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		if (this->descriptorSetLayouts[i] != other.descriptorSetLayouts[i]) {
+			return false;
+		}
+	}
+
+	if (this->pushConstantSize_ != other.pushConstantSize_) {
+		return false;
+	}
+
+	if (this->name_ != other.name_) {
+		return false;
+	}
+
+	return true;
+}
+
+
+bool RenderPassDesc::operator==(const RenderPassDesc &other) const {
+	if (this->depthStencilFormat_    != other.depthStencilFormat_) {
+		return false;
+	}
+
+	if (this->depthStencilPassBegin_ != other.depthStencilPassBegin_) {
+		return false;
+	}
+
+	if (this->storeDepth_            != other.storeDepth_) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		const auto &a = this->colorRTs_[i];
+		const auto &b = other.colorRTs_[i];
+
+		if (a.format        != b.format) {
+			return false;
+		}
+
+		if (a.passBegin     != b.passBegin) {
+			return false;
+		}
+
+		if (a.initialLayout != b.initialLayout) {
+			return false;
+		}
+
+		if (a.finalLayout   != b.finalLayout) {
+			return false;
+		}
+
+		if (a.passBegin == +PassBegin::Clear && a.clearValue != b.clearValue) {
+			return false;
+		}
+
+		if (a.store         != b.store) {
+			return false;
+		}
+
+		if (a.resolveFormat != b.resolveFormat) {
+			return false;
+		}
+
+		if (a.resolveFormat != +Format::Invalid && a.resolveFinalLayout != b.resolveFinalLayout) {
+			return false;
+		}
+	}
+
+	if (this->numSamples_            != other.numSamples_) {
+		return false;
+	}
+
+	if (this->views_                 != other.views_) {
+		return false;
+	}
+
+	if (this->clearDepthAttachment   != other.clearDepthAttachment) {
+		return false;
+	}
+
+	if (this->depthClearValue        != other.depthClearValue) {
+		return false;
+	}
+
+	if (this->stencilPassBegin_      != other.stencilPassBegin_) {
+		return false;
+	}
+
+	if (this->storeStencil_          != other.storeStencil_) {
+		return false;
+	}
+
+	if (this->stencilPassBegin_ == +PassBegin::Clear && this->stencilClearValue != other.stencilClearValue) {
+		return false;
+	}
+
 	if (this->name_ != other.name_) {
 		return false;
 	}
@@ -306,7 +734,8 @@ bool PipelineDesc::operator==(const PipelineDesc &other) const {
 
 
 class Includer final : public TShader::Includer {
-	HashMap<std::string, std::vector<char> > &cache;
+	RendererBase       &renderer;
+	const std::string  &shaderName;
 
 public:
 
@@ -317,28 +746,25 @@ public:
 	IncludeResult* includeLocal(const char *headerName, const char * /* includerName */, size_t /* inclusionDepth */) override {
 		std::string filename(headerName);
 
-		// HashMap<std::string, std::vector<char> >::iterator it = cache.find(filename);
-		auto it = cache.find(filename);
-		if (it == cache.end()) {
-			auto contents = readFile(headerName);
-			bool inserted = false;
-			std::tie(it, inserted) = cache.emplace(std::move(filename), std::move(contents));
-			// since we just checked it's not there this must succeed
-			assert(inserted);
+		// keeps the contents alive until releaseInclude even if the cache reloads the file
+		auto contents = new std::shared_ptr<const MappedFile>(renderer.loadInclude(filename));
+		if (renderer.shaderHotReload) {
+			renderer.watchShaderFile(shaderName, filename);
 		}
 
-		return new IncludeResult(filename, it->second.data(), it->second.size(), nullptr);
+		return new IncludeResult(filename, (*contents)->data(), (*contents)->size(), contents);
 	}
 
 	void releaseInclude(IncludeResult *data) override {
 		assert(data);
-		// no need to delete any of data's contents, they're owned by someone else
+		delete reinterpret_cast<std::shared_ptr<const MappedFile> *>(data->userData);
 
 		delete data;
 	}
 
-	explicit Includer(HashMap<std::string, std::vector<char> > &cache_)
-	: cache(cache_)
+	Includer(RendererBase &renderer_, const std::string &shaderName_)
+	: renderer(renderer_)
+	, shaderName(shaderName_)
 	{
 	}
 
@@ -352,10 +778,31 @@ public:
 };
 
 
+// shared ring buffer allocations are rounded to this
+// must be at least the largest buffer alignment any backend asks for
+static const unsigned int ringGranularity  = 256;
+static const unsigned int maxRingChunkSize = 64 * 1024;
+
+// unique across renderer instances so stale thread local chunks are never reused
+static std::atomic<uint64_t> nextRingEpoch(1);
+
+
+struct RingChunk {
+	uint64_t      epoch;
+	unsigned int  page;
+	unsigned int  ptr;
+	unsigned int  end;
+};
+
+
+static thread_local RingChunk ringChunk = { 0, invalidRingPage, 0, 0 };
+
+
 RendererBase::RendererBase(const RendererDesc &desc)
 : swapchainDesc(desc.swapchain)
 , wantedSwapchain(desc.swapchain)
 , swapchainDirty(true)
+, offscreen(desc.offscreen)
 , currentFrameIdx(0)
 , lastSyncedFrame(0)
 , currentRefreshRate(0)
@@ -363,181 +810,379 @@ RendererBase::RendererBase(const RendererDesc &desc)
 , skipShaderCache(desc.skipShaderCache || !desc.optimizeShaders)
 , optimizeShaders(desc.optimizeShaders)
 , validateShaders(desc.validateShaders)
+, shaderDebugInfo(desc.tracing)
+, shaderOptimization(desc.shaderOptimization)
+, shaderOptimizationOverrides(desc.shaderOptimizationOverrides)
+, recheckCachedShaders(desc.debug || desc.validateShaders)
 , frameNum(0)
+, renderThread(std::this_thread::get_id())
+, frameWaitTimeout((desc.frameWait == +FrameWait::Block) ? uint64_t(desc.frameWaitTimeout) * 1000000ULL : 0)
 , uboAlign(0)
 , ssboAlign(0)
-, ringBufSize(0)
-, ringBufPtr(0)
-, lastSyncedRingBufPtr(0)
+, ringPageSize(desc.ephemeralRingBufSize)
+, ringChunkSize(0)
+, ringCursor(uint64_t(invalidRingPage) << 32)
+, ringEpoch(0)
+, currentRingPage(invalidRingPage)
+, minRingPageSize(desc.ephemeralRingBufSize)
+, ringFrameBytes(0)
+, ringPeakFrameBytes(0)
+, ringWindowPeakBytes(0)
+, ringWindowFrames(0)
+, spirvCacheDirty(false)
+, jobSystem(desc.jobSystem)
+, compileStop(false)
+, shaderHotReload(desc.shaderHotReload)
+, shaderWatchStop(false)
+, refreshInterval(0)
+, lastDisplayTime(0)
+, readbackRequested(false)
+, readbackReady(false)
 #ifndef NDEBUG
 , inFrame(false)
 , inRenderPass(false)
 , validPipeline(false)
 , pipelineDrawn(false)
 , scissorSet(false)
+, inGPUTimer(false)
+, debugGroupDepth(0)
 #endif //  NDEBUG
 {
-	char *prefPath = SDL_GetPrefPath("", "SMAADemo");
-	spirvCacheDir = prefPath;
-	SDL_free(prefPath);
+	// from the smallest page size so it fits in all of them
+	ringChunkSize = std::max(ringGranularity, std::min(maxRingChunkSize, (minRingPageSize / 4) & ~(ringGranularity - 1)));
+	ringEpoch     = nextRingEpoch.fetch_add(1);
+
+	if (!desc.captureFile.empty()) {
+		capture = std::make_unique<CaptureWriter>(desc.captureFile, std::max(1U, desc.captureFrames), desc.swapchain);
+	}
+
+	if (desc.shaderCacheDir.empty()) {
+		char *prefPath = SDL_GetPrefPath("", "SMAADemo");
+		spirvCacheDir = prefPath;
+		SDL_free(prefPath);
+	} else {
+		spirvCacheDir = desc.shaderCacheDir;
+		if (spirvCacheDir.back() != '/') {
+			spirvCacheDir += '/';
+		}
+	}
 
 	bool success = InitializeProcess();
 	if (!success) {
 		throw std::runtime_error("glslang initialization failed");
 	}
+
+	if (!jobSystem) {
+		ownJobSystem = std::make_unique<JobSystem>();
+		jobSystem    = ownJobSystem.get();
+	}
+	// compiles go to the background threads when there are any
+	unsigned int compileThreads = jobSystem->numBackgroundThreads();
+	LOG("Using %u shader compile threads\n", (compileThreads != 0) ? compileThreads : jobSystem->numThreads());
+
+	loadRingSize();
+
+	// read while the backend creates the device, loadCachedSPV waits for it
+	if (!skipShaderCache) {
+		jobSystem->run(&spirvCacheLoad, [this] () { loadSPVCache(); } );
+	}
+
+	if (shaderHotReload) {
+		shaderWatchThread = std::thread(&RendererBase::shaderWatchThreadFunc, this);
+	}
 }
 
 
 RendererBase::~RendererBase() {
+	// before the compile threads, it might be waiting for them
+	if (shaderWatchThread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(shaderWatchMutex);
+			shaderWatchStop = true;
+		}
+		shaderWatchCV.notify_all();
+		shaderWatchThread.join();
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(compileMutex);
+		compileStop = true;
+	}
+
+	// queued ones return without doing anything
+	jobSystem->wait(backgroundJobs);
+	pendingShaders.clear();
+
+	if (!skipShaderCache) {
+		saveSPVCache();
+	}
+	saveRingSize();
+
+	logShaderStats();
+
 	FinalizeProcess();
 }
 
 
-std::vector<char> RendererBase::loadSource(const std::string &name) {
+void RendererBase::runBackground(std::function<void()> job) {
+	jobSystem->runBackground(&backgroundJobs, [this, job] () {
+		{
+			std::unique_lock<std::mutex> lock(compileMutex);
+			if (compileStop) {
+				return;
+			}
+		}
+
+		job();
+	} );
+}
+
+
+std::shared_ptr<const MappedFile> RendererBase::loadSource(const std::string &name) {
+	std::unique_lock<std::mutex> lock(shaderSourcesMutex);
+
 	auto it = shaderSources.find(name);
 	if (it != shaderSources.end()) {
 		return it->second;
 	} else {
-		auto source = readFile(name);
+		auto source = std::make_shared<const MappedFile>(name);
 		shaderSources.emplace(name, source);
 		return source;
 	}
 }
 
 
+std::shared_ptr<const MappedFile> RendererBase::loadInclude(const std::string &name) {
+	// stat outside the lock, it's the only disk access on a cache hit
+	int64_t timestamp = getFileTimestamp(name);
+
+	{
+		std::unique_lock<std::mutex> lock(includeCacheMutex);
+		auto it = includeCache.find(name);
+		if (it != includeCache.end() && it->second.timestamp == timestamp) {
+			return it->second.contents;
+		}
+	}
+
+	// several threads might read the same file here, the last one wins
+	IncludeFile file;
+	file.timestamp = timestamp;
+	file.contents  = std::make_shared<const MappedFile>(name);
+
+	std::unique_lock<std::mutex> lock(includeCacheMutex);
+	includeCache[name] = file;
+	return file.contents;
+}
+
+
 // increase this when the shader compiler options change
 // so that the same source generates a different SPV
 const unsigned int shaderVersion = 79;
 
 
-struct CacheData {
-	unsigned int              version;
-	uint64_t                  hash;
-	std::vector<std::string>  dependencies;
+// on-disk SPIR-V cache, all shaders in one file:
+//   uint32_t magic, uint32_t version, uint32_t count
+//   count times: uint64_t key, uint32_t numWords, numWords * uint32_t SPIR-V
+static const uint32_t spirvCacheMagic = 0x43565053;  // "SPVC"
 
 
-	CacheData()
-	: version(0)
-	, hash(0)
-	{
+uint64_t RendererBase::now() {
+	// steady_clock is CLOCK_MONOTONIC on Linux, which is the display timing clock
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t).count());
+}
+
+
+uint64_t RendererBase::timeToNextRefresh() const {
+	if (refreshInterval == 0 || lastDisplayTime == 0) {
+		return 0;
 	}
 
-	CacheData(const CacheData &)            = default;
-	CacheData &operator=(const CacheData &) = default;
+	// refreshes continue at a fixed rate from the last one we saw
+	uint64_t t     = now();
+	if (t < lastDisplayTime) {
+		return lastDisplayTime - t;
+	}
+	uint64_t phase = (t - lastDisplayTime) % refreshInterval;
+	return refreshInterval - phase;
+}
 
-	CacheData(CacheData &&)                 = default;
-	CacheData &operator=(CacheData &&)      = default;
 
-	~CacheData() {}
+void RendererBase::loadSPVCache() {
+	std::string cacheName = spirvCacheDir + "spirv.cache";
+	if (!fileExists(cacheName)) {
+		LOG("No SPIR-V cache \"%s\"\n", cacheName.c_str());
+		return;
+	}
 
+	MappedFile data(cacheName);
+	const char *ptr = data.data();
+	const char *end = ptr + data.size();
 
-	static CacheData parse(const std::vector<char> &cacheStr_) {
-		std::vector<std::string> split;
-		split.reserve(3);
-		{
-		std::string cacheStr(cacheStr_.begin(), cacheStr_.end());
-			boost::algorithm::split(split, cacheStr, [] (char c) -> bool { return c == ','; });
+	auto read = [&] (void *dest, size_t size) {
+		if (size_t(end - ptr) < size) {
+			return false;
 		}
+		memcpy(dest, ptr, size);
+		ptr += size;
+		return true;
+	};
 
-		CacheData cacheData;
-		if (split.size() < 2) {
-			// not enough components, parse fails
-            return cacheData;
-		}
+	uint32_t magic = 0, version = 0, count = 0;
+	if (!read(&magic, sizeof(magic)) || !read(&version, sizeof(version)) || !read(&count, sizeof(count))) {
+		LOG("SPIR-V cache \"%s\" is truncated\n", cacheName.c_str());
+		return;
+	}
 
-		cacheData.version = atoi(split[0].c_str());
-		if (cacheData.version != shaderVersion) {
-			// version mismatch, don't try to continue parsing
-			return cacheData;
-		}
+	if (magic != spirvCacheMagic) {
+		LOG("SPIR-V cache \"%s\" has bad magic\n", cacheName.c_str());
+		return;
+	}
 
-		try {
-			cacheData.hash = std::stoull(split[1].c_str(), nullptr, 16);
-		} catch (...) {
-			// parsing fails
-			cacheData.version = 0;
-			return cacheData;
+	if (version != shaderVersion) {
+		LOG("SPIR-V cache version mismatch, found %u when expected %u\n", version, shaderVersion);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(spirvCacheMutex);
+	spirvCache.reserve(count);
+	for (unsigned int i = 0; i < count; i++) {
+		uint64_t key      = 0;
+		uint32_t numWords = 0;
+		if (!read(&key, sizeof(key)) || !read(&numWords, sizeof(numWords))) {
+			LOG("SPIR-V cache \"%s\" is truncated\n", cacheName.c_str());
+			break;
 		}
 
-		if (split.size() >= 3) {
-			cacheData.dependencies.insert(cacheData.dependencies.end(), split.begin() + 2, split.end());
+		std::vector<uint32_t> spirv(numWords);
+		if (numWords == 0 || !read(spirv.data(), numWords * sizeof(uint32_t))) {
+			LOG("SPIR-V cache \"%s\" is truncated\n", cacheName.c_str());
+			break;
 		}
 
-		return cacheData;
+		spirvCache.emplace(key, std::move(spirv));
 	}
 
+	LOG("Loaded %u shaders from SPIR-V cache\n", static_cast<unsigned int>(spirvCache.size()));
+}
 
-	std::string serialize() const {
-		std::stringstream cacheStr;
-        cacheStr << version;
 
-		cacheStr << "," << std::hex << hash;
+void RendererBase::saveSPVCache() {
+	jobSystem->wait(spirvCacheLoad);
 
-		for (const auto &f : dependencies) {
-			cacheStr << "," << f;
-		}
+	std::unique_lock<std::mutex> lock(spirvCacheMutex);
+	if (!spirvCacheDirty) {
+		return;
+	}
 
-		return cacheStr.str();
+	size_t size = 3 * sizeof(uint32_t);
+	for (const auto &p : spirvCache) {
+		size += sizeof(uint64_t) + sizeof(uint32_t) + p.second.size() * sizeof(uint32_t);
 	}
-};
 
+	std::vector<char> data;
+	data.reserve(size);
+	auto write = [&] (const void *src, size_t s) {
+		const char *c = reinterpret_cast<const char *>(src);
+		data.insert(data.end(), c, c + s);
+	};
+
+	uint32_t count = static_cast<uint32_t>(spirvCache.size());
+	write(&spirvCacheMagic, sizeof(spirvCacheMagic));
+	write(&shaderVersion,   sizeof(shaderVersion));
+	write(&count,           sizeof(count));
+	for (const auto &p : spirvCache) {
+		uint32_t numWords = static_cast<uint32_t>(p.second.size());
+		write(&p.first,        sizeof(p.first));
+		write(&numWords,       sizeof(numWords));
+		write(p.second.data(), numWords * sizeof(uint32_t));
+	}
+	assert(data.size() == size);
 
-std::string RendererBase::makeSPVCacheName(uint64_t hash) {
-	char buffer[512];
-	auto ret DEBUG_ASSERTED = snprintf(buffer, sizeof(buffer), "%s%08" PRIx64 ".spv", spirvCacheDir.c_str(), hash);
-	assert(ret >= 5);
-	return std::string(buffer);
+	std::string cacheName = spirvCacheDir + "spirv.cache";
+	LOG("Writing %u shaders to SPIR-V cache \"%s\"\n", count, cacheName.c_str());
+	writeFile(cacheName, data.data(), data.size());
+	spirvCacheDirty = false;
 }
 
 
-bool RendererBase::loadCachedSPV(const std::string &name, const std::string &shaderName, std::vector<uint32_t> &spirv) {
-	std::string cacheName = spirvCacheDir + shaderName + ".cache";
+// uint32_t magic, uint64_t bytes
+static const uint32_t ringCacheMagic = 0x474E4952;  // "RING"
+
+
+void RendererBase::loadRingSize() {
+	std::string cacheName = spirvCacheDir + "ring.cache";
 	if (!fileExists(cacheName)) {
-		return false;
+		return;
 	}
 
-	CacheData cacheData = CacheData::parse(readFile(cacheName));
-	if (cacheData.version != int(shaderVersion)) {
-		LOG("version mismatch, found %d when expected %u\n", cacheData.version, shaderVersion);
-		return false;
+	uint32_t magic = 0;
+	uint64_t bytes = 0;
+	try {
+		auto data = readFile(cacheName);
+		if (data.size() != sizeof(magic) + sizeof(bytes)) {
+			LOG("Ring buffer cache \"%s\" has bad size\n", cacheName.c_str());
+			return;
+		}
+		memcpy(&magic, data.data(), sizeof(magic));
+		memcpy(&bytes, data.data() + sizeof(magic), sizeof(bytes));
+	} catch (std::exception &e) {
+		LOG("Failed to read ring buffer cache: %s\n", e.what());
+		return;
 	}
 
-	std::string spvName   = makeSPVCacheName(cacheData.hash);
-	if (!fileExists(spvName)) {
-		return false;
+	if (magic != ringCacheMagic) {
+		LOG("Ring buffer cache \"%s\" has bad magic\n", cacheName.c_str());
+		return;
+	}
+
+	if (bytes > ringPageSize) {
+		ringPageSize = std::max(ringPageSize, nextPow2(static_cast<unsigned int>(std::min(bytes, uint64_t(maxRingPageSize)))));
+		LOG("Ring buffer pages of %u bytes from last run\n", ringPageSize);
 	}
+}
 
-	// check timestamp against source and header files
-	int64_t sourceTime = getFileTimestamp(name);
-	int64_t cacheTime  = getFileTimestamp(cacheName);
 
-	if (sourceTime > cacheTime) {
-		LOG("Shader \"%s\" source is newer than cache, recompiling\n", spvName.c_str());
-		return false;
+void RendererBase::saveRingSize() {
+	if (ringPeakFrameBytes == 0) {
+		return;
 	}
 
-	for (const auto &filename : cacheData.dependencies) {
-		int64_t includeTime = getFileTimestamp(filename);
-		if (includeTime > cacheTime) {
-			LOG("Include \"%s\" is newer than cache, recompiling\n", filename.c_str());
-			return false;
-		}
+	char data[sizeof(ringCacheMagic) + sizeof(ringPeakFrameBytes)];
+	memcpy(data, &ringCacheMagic, sizeof(ringCacheMagic));
+	memcpy(data + sizeof(ringCacheMagic), &ringPeakFrameBytes, sizeof(ringPeakFrameBytes));
+
+	try {
+		writeFile(spirvCacheDir + "ring.cache", data, sizeof(data));
+	} catch (std::exception &e) {
+		LOG("Failed to write ring buffer cache: %s\n", e.what());
 	}
+}
+
 
-	auto temp = readFile(spvName);
-	if (temp.size() % 4 != 0) {
-		LOG("Shader \"%s\" has incorrect size\n", spvName.c_str());
+bool RendererBase::loadCachedSPV(uint64_t key, std::vector<uint32_t> &spirv) {
+	jobSystem->wait(spirvCacheLoad);
+
+	std::unique_lock<std::mutex> lock(spirvCacheMutex);
+
+	auto it = spirvCache.find(key);
+	if (it == spirvCache.end()) {
 		return false;
 	}
 
-	spirv.resize(temp.size() / 4);
-	memcpy(&spirv[0], &temp[0], temp.size());
-	LOG("Loaded shader \"%s\" from cache\n", spvName.c_str());
-
+	spirv = it->second;
 	return true;
 }
 
 
+static void setShaderEnv(TShader &shader, EShLanguage language, char **sourceString, int *sourceLen, const char **filename) {
+	shader.setStringsWithLengthsAndNames(sourceString, sourceLen, filename, 1);
+	shader.setEnvInput(EShSourceGlsl, language, EShClientVulkan, 450);
+	shader.setEnvClient(EShClientVulkan, EShTargetVulkan_1_0);
+	shader.setEnvTarget(EShTargetSpv, EShTargetSpv_1_0);
+}
+
+
 static void logSpvMessage(spv_message_level_t level_, const char *source, const spv_position_t &position, const char *message) {
 	const char *level;
 	switch (level_) {
@@ -595,12 +1240,12 @@ static void checkSPVBindings(const std::vector<uint32_t> &spirv) {
 		}
 
 		uint32_t maxOffset = 0;
-		LOG("UBO %u (%u, %u) ranges:\n", static_cast<uint32_t>(ubo.id), idx.set, idx.binding);
+		LOG_DEBUG("UBO %u (%u, %u) ranges:\n", static_cast<uint32_t>(ubo.id), idx.set, idx.binding);
 		for (auto r : compiler.get_active_buffer_ranges(ubo.id)) {
-			LOG("  %u:  %u  %u\n", r.index, static_cast<uint32_t>(r.offset), static_cast<uint32_t>(r.range));
+			LOG_DEBUG("  %u:  %u  %u\n", r.index, static_cast<uint32_t>(r.offset), static_cast<uint32_t>(r.range));
 			maxOffset = std::max(maxOffset, static_cast<uint32_t>(r.offset + r.range));
 		}
-		LOG(" max offset: %u\n", maxOffset);
+		LOG_DEBUG(" max offset: %u\n", maxOffset);
 		uboSizes.emplace(idx, maxOffset);
 	}
 
@@ -662,46 +1307,325 @@ static void checkSPVBindings(const std::vector<uint32_t> &spirv) {
 }
 
 
-std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const ShaderMacros &macros, ShaderKind kind_) {
-	// check spir-v cache first
+static std::string makeShaderName(const std::string &name, const ShaderMacros &macros) {
 	std::string shaderName = name;
+
+	for (const auto &macro : macros) {
+		shaderName += "_";
+		shaderName += macro.first;
+		if (!macro.second.empty()) {
+			shaderName += "=";
+			shaderName += macro.second;
+		}
+	}
+
+	return shaderName;
+}
+
+
+void RendererBase::compileSpirvAsync(const std::string &name, const ShaderMacros &macros, ShaderKind kind) {
+	queueCompile(name, makeShaderName(name, macros), macros, kind, false);
+}
+
+
+bool RendererBase::isSpirvReady(const std::string &name, const ShaderMacros &macros) {
+	std::unique_lock<std::mutex> lock(compileMutex);
+	auto it = pendingShaders.find(makeShaderName(name, macros));
+	if (it == pendingShaders.end()) {
+		return true;
+	}
+
+	return it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+
+std::shared_future<std::vector<uint32_t> > RendererBase::queueCompile(const std::string &name, const std::string &shaderName, const ShaderMacros &macros, ShaderKind kind, bool replace) {
+	// packaged_task is move-only but std::function must be copyable
+	auto task = std::make_shared<std::packaged_task<std::vector<uint32_t>()> >(
+		[this, name, shaderName, macros, kind] () {
+			return compileSpirvInternal(name, shaderName, macros, kind);
+		}
+	);
+
+	std::shared_future<std::vector<uint32_t> > future;
 	{
-		std::vector<std::string> sorted;
-		sorted.reserve(macros.size());
-		for (const auto &macro : macros) {
-			std::string s = macro.first;
-			if (!macro.second.empty()) {
-				s += "=";
-				s += macro.second;
+		std::unique_lock<std::mutex> lock(compileMutex);
+		auto it = pendingShaders.find(shaderName);
+		if (it != pendingShaders.end() && !replace) {
+			// already requested
+			return it->second;
+		}
+
+		future = task->get_future().share();
+		pendingShaders[shaderName] = future;
+	}
+
+	// exceptions end up in the future and are rethrown in compileSpirv
+	runBackground([task] () { (*task)(); });
+
+	return future;
+}
+
+
+void RendererBase::watchShader(const std::string &name, const std::string &shaderName, const ShaderMacros &macros, ShaderKind kind) {
+	{
+		std::unique_lock<std::mutex> lock(shaderWatchMutex);
+		shaderVariants.emplace(shaderName, ShaderVariant(name, macros, kind));
+	}
+
+	watchShaderFile(shaderName, name);
+}
+
+
+void RendererBase::watchShaderFile(const std::string &shaderName, const std::string &filename) {
+	int64_t timestamp = getFileTimestamp(filename);
+
+	std::unique_lock<std::mutex> lock(shaderWatchMutex);
+	auto it = shaderVariants.find(shaderName);
+	assert(it != shaderVariants.end());
+	it->second.files.insert(filename);
+
+	// an existing entry is what the watch thread has last seen, keep it
+	watchedFiles.emplace(filename, timestamp);
+}
+
+
+// milliseconds between checking watched shader files
+static const unsigned int shaderWatchInterval = 250;
+
+
+void RendererBase::shaderWatchThreadFunc() {
+	placeCurrentThread(CoreClass::Efficiency);
+
+	std::unique_lock<std::mutex> lock(shaderWatchMutex);
+	while (true) {
+		shaderWatchCV.wait_for(lock, std::chrono::milliseconds(shaderWatchInterval), [this] () { return shaderWatchStop; });
+		if (shaderWatchStop) {
+			return;
+		}
+
+		HashSet<std::string> changed;
+		for (auto &f : watchedFiles) {
+			int64_t timestamp = 0;
+			try {
+				timestamp = getFileTimestamp(f.first);
+			} catch (std::exception &) {
+				// editors often save by replacing the file, try again next time
+				continue;
+			}
+
+			if (timestamp != f.second) {
+				LOG("Shader file \"%s\" changed\n", f.first.c_str());
+				f.second = timestamp;
+				changed.insert(f.first);
 			}
-			sorted.emplace_back(std::move(s));
 		}
 
-		std::sort(sorted.begin(), sorted.end());
-		for (const auto &s : sorted) {
-			shaderName += "_" + s;
+		if (changed.empty()) {
+			continue;
+		}
+
+		std::vector<std::pair<std::string, ShaderVariant> > variants;
+		for (const auto &v : shaderVariants) {
+			for (const auto &f : v.second.files) {
+				if (changed.find(f) != changed.end()) {
+					variants.emplace_back(v.first, v.second);
+					break;
+				}
+			}
+		}
+
+		// compiles need this lock to register their includes
+		lock.unlock();
+		reloadShaders(changed, variants);
+		lock.lock();
+	}
+}
+
+
+void RendererBase::reloadShaders(const HashSet<std::string> &changed, const std::vector<std::pair<std::string, ShaderVariant> > &variants) {
+	{
+		std::unique_lock<std::mutex> lock(shaderSourcesMutex);
+		for (const auto &f : changed) {
+			shaderSources.erase(f);
 		}
 	}
 
-	std::vector<uint32_t> spirv;
-	if (!skipShaderCache) {
-		LOG("Looking for \"%s\" in cache...\n", shaderName.c_str());
-		bool found = loadCachedSPV(name, shaderName, spirv);
-		if (found) {
-			LOG("\"%s\" found in cache\n", shaderName.c_str());
-
-			// TODO: only in debug
-			// need to move debug flag to base class
-			if (true) {
-				checkSPVBindings(spirv);
+	std::vector<std::shared_future<std::vector<uint32_t> > > futures;
+	futures.reserve(variants.size());
+	for (const auto &v : variants) {
+		LOG("Recompiling \"%s\"\n", v.first.c_str());
+		futures.emplace_back(queueCompile(v.second.name, v.first, v.second.macros, v.second.kind, true));
+	}
+
+	bool failed = false;
+	std::vector<std::string> succeeded;
+	for (unsigned int i = 0; i < variants.size(); i++) {
+		try {
+			futures[i].get();
+			succeeded.push_back(variants[i].second.name);
+		} catch (std::exception &e) {
+			LOG("Recompiling \"%s\" failed: %s\n", variants[i].first.c_str(), e.what());
+			failed = true;
+
+			// createPipeline would rethrow this
+			std::unique_lock<std::mutex> lock(compileMutex);
+			pendingShaders.erase(variants[i].first);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(shaderWatchMutex);
+	if (failed) {
+		// a pipeline might combine a failed shader with one which compiled
+		// keep the old ones until the next change fixes it
+		LOG("Not reloading shaders\n");
+		heldBackShaders.insert(heldBackShaders.end(), succeeded.begin(), succeeded.end());
+		return;
+	}
+
+	succeeded.insert(succeeded.end(), heldBackShaders.begin(), heldBackShaders.end());
+	heldBackShaders.clear();
+	for (const auto &name : succeeded) {
+		if (std::find(reloadedShaders.begin(), reloadedShaders.end(), name) == reloadedShaders.end()) {
+			reloadedShaders.push_back(name);
+		}
+	}
+}
+
+
+void RendererBase::addShaderStats(const ShaderVariantStats &stats) {
+	std::unique_lock<std::mutex> lock(shaderStatsMutex);
+	if (stats.cacheHit) {
+		shaderStats.cacheHits++;
+	} else {
+		shaderStats.cacheMisses++;
+	}
+	shaderStats.variants.push_back(stats);
+}
+
+
+void RendererBase::addPipelineStats(const PipelineStats &stats) {
+	std::unique_lock<std::mutex> lock(shaderStatsMutex);
+	shaderStats.pipelines.push_back(stats);
+}
+
+
+ShaderStats RendererBase::getShaderStats() {
+	std::unique_lock<std::mutex> lock(shaderStatsMutex);
+	return shaderStats;
+}
+
+
+void RendererBase::logShaderStats() {
+	std::unique_lock<std::mutex> lock(shaderStatsMutex);
+
+	uint64_t preprocessTotal = 0, compileTotal = 0, optimizeTotal = 0;
+	LOG("Shader variants (preprocess / compile / optimize ms):\n");
+	for (const auto &v : shaderStats.variants) {
+		LOG("  %-60s %s %8.3f %8.3f %8.3f\n", v.name.c_str(), v.cacheHit ? "hit " : "miss"
+		   , double(v.preprocessTime) / 1000000.0, double(v.compileTime) / 1000000.0, double(v.optimizeTime) / 1000000.0);
+		preprocessTotal += v.preprocessTime;
+		compileTotal    += v.compileTime;
+		optimizeTotal   += v.optimizeTime;
+	}
+
+	uint64_t shaderTotal = 0, crossTotal = 0, driverTotal = 0;
+	LOG("Pipelines (shaders / SPIRV-Cross / driver ms):\n");
+	for (const auto &p : shaderStats.pipelines) {
+		LOG("  %-60s %8.3f %8.3f %8.3f\n", p.name.c_str()
+		   , double(p.shaderTime) / 1000000.0, double(p.crossTime) / 1000000.0, double(p.driverTime) / 1000000.0);
+		for (const auto &e : p.executables) {
+			LOG("    %s [%s]\n", e.name.c_str(), p.macros.c_str());
+			for (const auto &stat : e.statistics) {
+				LOG("      %-40s %g\n", stat.first.c_str(), stat.second);
 			}
+		}
+		shaderTotal += p.shaderTime;
+		crossTotal  += p.crossTime;
+		driverTotal += p.driverTime;
+	}
 
-			return spirv;
-		} else {
-			LOG("\"%s\" not found in cache\n", shaderName.c_str());
+	LOG("SPIR-V cache %u hits %u misses, preprocess %.3f ms compile %.3f ms optimize %.3f ms\n"
+	   , shaderStats.cacheHits, shaderStats.cacheMisses
+	   , double(preprocessTotal) / 1000000.0, double(compileTotal) / 1000000.0, double(optimizeTotal) / 1000000.0);
+	LOG("%u pipelines, shaders %.3f ms SPIRV-Cross %.3f ms driver %.3f ms\n"
+	   , static_cast<unsigned int>(shaderStats.pipelines.size())
+	   , double(shaderTotal) / 1000000.0, double(crossTotal) / 1000000.0, double(driverTotal) / 1000000.0);
+}
+
+
+std::vector<std::string> RendererBase::takeReloadedShaders() {
+	std::vector<std::string> result;
+
+	std::unique_lock<std::mutex> lock(shaderWatchMutex);
+	std::swap(result, reloadedShaders);
+
+	return result;
+}
+
+
+void RendererBase::waitForShaders() {
+	HashMap<std::string, std::shared_future<std::vector<uint32_t> > > pending;
+	{
+		std::unique_lock<std::mutex> lock(compileMutex);
+		std::swap(pending, pendingShaders);
+	}
+
+	LOG("Waiting for %u background shader compiles\n", static_cast<unsigned int>(pending.size()));
+	for (auto &p : pending) {
+		// results are in spirvCache now, createPipeline finds them there
+		p.second.get();
+	}
+
+	if (!skipShaderCache) {
+		saveSPVCache();
+	}
+}
+
+
+std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const ShaderMacros &macros, ShaderKind kind) {
+	std::string shaderName = makeShaderName(name, macros);
+
+	std::shared_future<std::vector<uint32_t> > pending;
+	{
+		std::unique_lock<std::mutex> lock(compileMutex);
+		auto it = pendingShaders.find(shaderName);
+		if (it != pendingShaders.end()) {
+			pending = std::move(it->second);
+			pendingShaders.erase(it);
 		}
 	}
 
+	if (pending.valid()) {
+		// only blocks if the compile threads haven't got to it yet
+		LOG("Waiting for background compile of \"%s\"\n", shaderName.c_str());
+		return pending.get();
+	}
+
+	return compileSpirvInternal(name, shaderName, macros, kind);
+}
+
+
+ShaderOptimization RendererBase::shaderOptimizationFor(const std::string &name) const {
+	if (!optimizeShaders) {
+		return ShaderOptimization::None;
+	}
+
+	auto it = shaderOptimizationOverrides.find(name);
+	if (it == shaderOptimizationOverrides.end()) {
+		it = shaderOptimizationOverrides.find(name.substr(0, name.rfind('.')));
+	}
+	if (it != shaderOptimizationOverrides.end()) {
+		return it->second;
+	}
+
+	return shaderOptimization;
+}
+
+
+std::vector<uint32_t> RendererBase::compileSpirvInternal(const std::string &name, const std::string &shaderName, const ShaderMacros &macros, ShaderKind kind_) {
+	PROFILE_ZONE("compileSpirv");
+
 	std::function<bool(const std::vector<uint32_t> &)> validate;
 	if (validateShaders) {
 		validate =
@@ -715,11 +1639,23 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		validate = [] (const std::vector<uint32_t> &) { return true; };
 	}
 
-	// TODO: cache includes globally
-	HashMap<std::string, std::vector<char> > includeCache;
+	if (shaderHotReload) {
+		watchShader(name, shaderName, macros, kind_);
+	}
+
+	Includer includer(*this, shaderName);
+
+	std::vector<uint32_t> spirv;
+	uint64_t              cacheKey = 0;
+	ShaderOptimization    optimization = shaderOptimizationFor(name);
+
+	ShaderVariantStats stats;
+	stats.name = shaderName;
 
 	{
-		auto src = loadSource(name);
+		// lines point into the mapped source until they're joined into src
+		auto source = loadSource(name);
+		std::vector<char> src;
 
 		// shaderc will add GOOGLE_include_directive for us
 		// glslang will not
@@ -727,8 +1663,8 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 			// break shader into lines
 			std::vector<nonstd::string_view> lines;
 			lines.reserve(128);  // picked a value larger than any current shader
-			const char *it        = &src[0];
-			const char *end       = &src[src.size() - 1] + 1;
+			const char *it        = source->begin();
+			const char *end       = source->end();
 			const char *lineStart = it;
 			while (it < end) {
 				if (*it == '\n') {
@@ -753,23 +1689,20 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 
 			// shaderc can take predefined macros
 			// glslang can not
-			std::vector<std::string> sorted;
-			if (!macros.empty()) {
-				sorted.reserve(macros.size());
-				for (const auto &macro : macros) {
-					std::string s = "#define " + macro.first;
-					if (!macro.second.empty()) {
-						s += " ";
-						s += macro.second;
-					}
-					sorted.emplace_back(std::move(s));
-				}
-
-				std::sort(sorted.begin(), sorted.end());
-				for (const auto &s : sorted) {
-					interestingLine = lines.emplace(interestingLine, s);
-					interestingLine++;
+			// macros are already sorted so the source stays the same between runs
+			std::vector<std::string> defines;
+			defines.reserve(macros.size());
+			for (const auto &macro : macros) {
+				std::string s = "#define " + macro.first;
+				if (!macro.second.empty()) {
+					s += " ";
+					s += macro.second;
 				}
+				defines.emplace_back(std::move(s));
+			}
+			for (const auto &s : defines) {
+				interestingLine = lines.emplace(interestingLine, s);
+				interestingLine++;
 			}
 
 			size_t len = lines.size();  // the newlines
@@ -777,14 +1710,11 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 				len += l.size();
 			}
 
-			std::vector<char> newSrc;
-			newSrc.reserve(len);
+			src.reserve(len);
 			for (const auto &l : lines) {
-				newSrc.insert(newSrc.end(), l.begin(), l.end());
-				newSrc.emplace_back('\n');
+				src.insert(src.end(), l.begin(), l.end());
+				src.emplace_back('\n');
 			}
-
-			std::swap(src, newSrc);
 		}
 
 		EShLanguage language;
@@ -797,26 +1727,70 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 			language = EShLangFragment;
 			break;
 
+		case ShaderKind::Compute:
+			language = EShLangCompute;
+			break;
+
 		default:
 			UNREACHABLE();  // shouldn't happen
 			break;
 
 		}
 
-		TShader shader(language);
-
 		char *sourceString   = src.data();
 		int sourceLen        = src.size();
 		const char *filename = name.c_str();
 
-		shader.setStringsWithLengthsAndNames(&sourceString, &sourceLen, &filename, 1);
-		shader.setEnvInput(EShSourceGlsl, language, EShClientVulkan, 450);
-		shader.setEnvClient(EShClientVulkan, EShTargetVulkan_1_0);
-		shader.setEnvTarget(EShTargetSpv, EShTargetSpv_1_0);
-
 		// TODO: move to RendererBase?
 		TBuiltInResource resource(DefaultTBuiltInResource);
-		Includer includer(includeCache);
+
+		// check spir-v cache first
+		// keyed on the preprocessed source so changes in included files are noticed
+		if (!skipShaderCache) {
+			uint64_t preprocessStart = now();
+			TShader preShader(language);
+			setShaderEnv(preShader, language, &sourceString, &sourceLen, &filename);
+
+			std::string preprocessed;
+			bool success = preShader.preprocess(&resource, 450, ECoreProfile, false, false, EShMsgDefault, &preprocessed, includer);
+			if (!success) {
+				const char *infoLog = preShader.getInfoLog();
+				if (infoLog != nullptr && infoLog[0] != '\0') {
+					LOG("Shader info log:\n\"%s\"\n", infoLog);
+				}
+				LOG("Failed to preprocess shader\n");
+				throw std::runtime_error("Failed to preprocess shader");
+			}
+
+			cacheKey = XXH64(preprocessed.data(), preprocessed.size(), shaderVersion);
+			cacheKey = XXH64(shaderName.data(), shaderName.size(), cacheKey);
+			// same source gives different SPIR-V for each recipe and with or without debug info
+			uint8_t codegen[2] = { optimization._to_integral(), uint8_t(shaderDebugInfo) };
+			cacheKey = XXH64(codegen, sizeof(codegen), cacheKey);
+			stats.preprocessTime = now() - preprocessStart;
+
+			LOG_DEBUG("Looking for \"%s\" (%016" PRIx64 ") in cache...\n", shaderName.c_str(), cacheKey);
+			bool found = loadCachedSPV(cacheKey, spirv);
+			if (found) {
+				LOG_DEBUG("\"%s\" found in cache\n", shaderName.c_str());
+
+				// only SPIR-V which passed the check below is ever cached
+				if (recheckCachedShaders) {
+					checkSPVBindings(spirv);
+				}
+
+				stats.cacheHit = true;
+				addShaderStats(stats);
+
+				return spirv;
+			} else {
+				LOG_DEBUG("\"%s\" not found in cache\n", shaderName.c_str());
+			}
+		}
+
+		uint64_t compileStart = now();
+		TShader shader(language);
+		setShaderEnv(shader, language, &sourceString, &sourceLen, &filename);
 
 		// compile
 		bool success = shader.parse(&resource, 450, ECoreProfile, false, false, EShMsgDefault, includer);
@@ -849,8 +1823,7 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		// convert to SPIR-V
 		spv::SpvBuildLogger logger;
 		glslang::SpvOptions spvOptions;
-		// TODO: only when tracing
-		if (true) {
+		if (shaderDebugInfo) {
 			spvOptions.generateDebugInfo = true;
 		} else {
 			spvOptions.stripDebugInfo = true;
@@ -859,6 +1832,7 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		spvOptions.optimizeSize     = false;
 		spvOptions.validate         = validateShaders;
 		glslang::GlslangToSpv(*program.getIntermediate(language), spirv, &logger, &spvOptions);
+		stats.compileTime = now() - compileStart;
 
 		if (!validate(spirv)) {
 			LOG("SPIR-V for shader \"%s\" is not valid after compilation\n", shaderName.c_str());
@@ -866,14 +1840,12 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		}
 	}
 
-	// TODO: only in debug
-	// need to move debug flag to base class
-	if (true) {
-		checkSPVBindings(spirv);
-	}
+	// always on a fresh compile so cache hits can skip it
+	checkSPVBindings(spirv);
 
 	// SPIR-V optimization
-	if (optimizeShaders) {
+	if (optimization != +ShaderOptimization::None) {
+		uint64_t optimizeStart = now();
 		// TODO: better target environment selection?
 		spvtools::Optimizer opt(SPV_ENV_UNIVERSAL_1_2);
 
@@ -882,7 +1854,11 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		});
 
 		// SPIRV-Tools optimizer
-		opt.RegisterPerformancePasses();
+		if (optimization == +ShaderOptimization::Size) {
+			opt.RegisterSizePasses();
+		} else {
+			opt.RegisterPerformancePasses();
+		}
 
 		std::vector<uint32_t> optimized;
 		optimized.reserve(spirv.size());
@@ -899,7 +1875,8 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		// glslang SPV remapper
 		{
 			spv::spirvbin_t remapper;
-			remapper.remap(optimized);
+			// the default also strips debug info
+			remapper.remap(optimized, shaderDebugInfo ? spv::spirvbin_t::ALL_BUT_STRIP : spv::spirvbin_t::DO_EVERYTHING);
 
 			if (!validate(optimized)) {
 				LOG("SPIR-V for shader \"%s\" is not valid after remapping\n", shaderName.c_str());
@@ -908,34 +1885,78 @@ std::vector<uint32_t> RendererBase::compileSpirv(const std::string &name, const
 		}
 
 		std::swap(spirv, optimized);
+		stats.optimizeTime = now() - optimizeStart;
 	}
 
-	if (!skipShaderCache) {
-		CacheData cacheData;
-		cacheData.version = shaderVersion;
-		cacheData.hash    = XXH64(spirv.data(), spirv.size() * 4, 0);;
-		std::string spvName   = makeSPVCacheName(cacheData.hash);
-		LOG("Writing shader \"%s\" to \"%s\"\n", shaderName.c_str(), spvName.c_str());
-		cacheData.dependencies.reserve(includeCache.size());
-		for (const auto &p : includeCache) {
-			cacheData.dependencies.push_back(p.first);
-		}
-		std::string cacheStr = cacheData.serialize();
+	addShaderStats(stats);
 
-		std::string cacheName = spirvCacheDir + shaderName + ".cache";
-		writeFile(cacheName, cacheStr.c_str(), cacheStr.size());
-		writeFile(spvName, &spirv[0], spirv.size() * 4);
+	if (!skipShaderCache) {
+		LOG_DEBUG("Adding shader \"%s\" (%016" PRIx64 ") to cache\n", shaderName.c_str(), cacheKey);
+		std::unique_lock<std::mutex> lock(spirvCacheMutex);
+		spirvCache[cacheKey] = spirv;
+		spirvCacheDirty      = true;
 	}
 
 	return spirv;
 }
 
 
+#ifdef RENDERER_CALL_STATS
+
+
+class CallTimer {
+	CallStats  &stats;
+	uint64_t   start;
+
+public:
+
+	explicit CallTimer(CallStats &stats_)
+	: stats(stats_)
+	, start(RendererBase::now())
+	{
+	}
+
+	CallTimer(const CallTimer &)                = delete;
+	CallTimer(CallTimer &&) noexcept            = delete;
+
+	CallTimer &operator=(const CallTimer &)     = delete;
+	CallTimer &operator=(CallTimer &&) noexcept = delete;
+
+	~CallTimer() {
+		stats.count++;
+		stats.nanoseconds += RendererBase::now() - start;
+	}
+};
+
+
+#define CALL_STATS(call) CallTimer callTimer(impl->callStats[RendererCall::call])
+
+
+#else  // RENDERER_CALL_STATS
+
+
+#define CALL_STATS(call)
+
+
+#endif  // RENDERER_CALL_STATS
+
+
+#define CAPTURE(op, ...) \
+	if (impl->capture) { \
+		impl->capture->record(CaptureOp::op, ##__VA_ARGS__); \
+	}
+
+
 Renderer Renderer::createRenderer(const RendererDesc &desc) {
 	return Renderer(new RendererImpl(desc));
 }
 
 
+std::vector<DeviceInfo> Renderer::listDevices() {
+	return RendererImpl::listDevices();
+}
+
+
 Renderer::~Renderer() {
 	if (impl) {
 		delete impl;
@@ -949,6 +1970,11 @@ bool Renderer::isRenderTargetFormatSupported(Format format) const {
 }
 
 
+bool Renderer::isTextureFormatSupported(Format format) const {
+	return impl->isTextureFormatSupported(format);
+}
+
+
 unsigned int Renderer::getCurrentRefreshRate() const {
 	return impl->currentRefreshRate;
 }
@@ -965,97 +1991,331 @@ const RendererFeatures &Renderer::getFeatures() const {
 
 
 BufferHandle Renderer::createBuffer(BufferType type, uint32_t size, const void *contents) {
-	return impl->createBuffer(type, size, contents);
+	BufferDesc desc;
+	desc.type(type)
+	    .size(size)
+	    .contents(contents);
+	return createBuffer(desc);
+}
+
+
+BufferHandle Renderer::createBuffer(const BufferDesc &desc) {
+	assert(impl->features.threadedResourceCreation || impl->isRenderThread());
+	// captures need every call in the order it was made
+	assert(!impl->capture || impl->isRenderThread());
+
+	BufferHandle handle = impl->createBuffer(desc);
+	CAPTURE(CreateBuffer, desc, handle);
+	return handle;
 }
 
 
 BufferHandle Renderer::createEphemeralBuffer(BufferType type, uint32_t size, const void *contents) {
-	return impl->createEphemeralBuffer(type, size, contents);
+	CALL_STATS(CreateEphemeralBuffer);
+	BufferHandle handle = impl->createEphemeralBuffer(type, size, contents);
+	CAPTURE(CreateEphemeralBuffer, type, CaptureBlob(contents, size), handle);
+	return handle;
+}
+
+
+EphemeralAllocation Renderer::allocateEphemeral(BufferType type, uint32_t size) {
+	CALL_STATS(AllocateEphemeral);
+	EphemeralAllocation result = impl->allocateEphemeral(type, size);
+	// contents aren't there yet, the capture picks them up before the next call
+	if (impl->capture) {
+		impl->capture->allocateEphemeral(type, size, result.contents, result.buffer);
+	}
+	return result;
 }
 
 
 FramebufferHandle Renderer::createFramebuffer(const FramebufferDesc &desc) {
-	return impl->createFramebuffer(desc);
+	CALL_STATS(CreateFramebuffer);
+	FramebufferHandle handle = impl->createFramebuffer(desc);
+	CAPTURE(CreateFramebuffer, desc, handle);
+	return handle;
 }
 
 
 PipelineHandle Renderer::createPipeline(const PipelineDesc &desc) {
-	return impl->createPipeline(desc);
+	CALL_STATS(CreatePipeline);
+	PipelineHandle handle = impl->createPipeline(desc);
+	CAPTURE(CreatePipeline, desc, handle);
+	return handle;
+}
+
+
+void Renderer::precompileShaders(const PipelineDesc &desc) {
+	impl->precompileShaders(desc);
+}
+
+
+PipelineHandle Renderer::createComputePipeline(const ComputePipelineDesc &desc) {
+	CALL_STATS(CreateComputePipeline);
+	PipelineHandle handle = impl->createComputePipeline(desc);
+	CAPTURE(CreateComputePipeline, desc, handle);
+	return handle;
+}
+
+
+void Renderer::precompileShaders(const ComputePipelineDesc &desc) {
+	impl->precompileShaders(desc);
+}
+
+
+void Renderer::waitForShaders() {
+	impl->waitForShaders();
+}
+
+
+std::vector<std::string> Renderer::takeReloadedShaders() {
+	return impl->takeReloadedShaders();
 }
 
 
 RenderPassHandle Renderer::createRenderPass(const RenderPassDesc &desc) {
-	return impl->createRenderPass(desc);
+	CALL_STATS(CreateRenderPass);
+	RenderPassHandle handle = impl->createRenderPass(desc);
+	CAPTURE(CreateRenderPass, desc, handle);
+	return handle;
 }
 
 
 RenderTargetHandle Renderer::createRenderTarget(const RenderTargetDesc &desc) {
-	return impl->createRenderTarget(desc);
+	CALL_STATS(CreateRenderTarget);
+	RenderTargetHandle handle = impl->createRenderTarget(desc);
+	CAPTURE(CreateRenderTarget, desc, handle);
+	return handle;
 }
 
 
 SamplerHandle Renderer::createSampler(const SamplerDesc &desc) {
-	return impl->createSampler(desc);
+	assert(impl->features.threadedResourceCreation || impl->isRenderThread());
+	assert(!impl->capture || impl->isRenderThread());
+
+	// held while creating so two threads don't both create the same one
+	std::lock_guard<std::mutex> lock(impl->sharedSamplersMutex);
+	auto it = impl->sharedSamplers.find(desc.hashValue());
+	if (it != impl->sharedSamplers.end()) {
+		it->second.refs++;
+		return it->second.handle;
+	}
+
+	SamplerHandle handle = impl->createSampler(desc);
+	CAPTURE(CreateSampler, desc, handle);
+	impl->sharedSamplers.emplace(desc.hashValue(), RendererBase::SharedSampler{ handle, 1 });
+	return handle;
 }
 
 
 TextureHandle Renderer::createTexture(const TextureDesc &desc) {
-	return impl->createTexture(desc);
+	assert(impl->features.threadedResourceCreation || impl->isRenderThread());
+	assert(!impl->capture || impl->isRenderThread());
+
+	if (impl->capture) {
+		// the capture needs the contents of a mipLevelWriter too
+		std::vector<std::vector<char> > storage;
+		TextureDesc written = desc.writeMipLevels(storage);
+		TextureHandle handle = impl->createTexture(written);
+		CAPTURE(CreateTexture, written, handle);
+		return handle;
+	}
+
+	TextureHandle handle = impl->createTexture(desc);
+	CAPTURE(CreateTexture, desc, handle);
+	return handle;
 }
 
 
 DSLayoutHandle Renderer::createDescriptorSetLayout(const DescriptorLayout *layout) {
-	return impl->createDescriptorSetLayout(layout);
+	std::vector<DescriptorLayout> descriptors;
+	for (const DescriptorLayout *l = layout; l->type != +DescriptorType::End; l++) {
+		descriptors.push_back(*l);
+	}
+
+	// different structs with the same members in the same places can use one layout
+	for (const auto &shared : impl->sharedDSLayouts) {
+		const auto &other = shared.first;
+		if (other.size() == descriptors.size()
+		    && std::equal(other.begin(), other.end(), descriptors.begin()
+		                 , [] (const DescriptorLayout &a, const DescriptorLayout &b) { return a.type == b.type && a.offset == b.offset; })) {
+			return shared.second;
+		}
+	}
+
+	DSLayoutHandle handle = impl->createDescriptorSetLayout(layout);
+	if (impl->capture) {
+		impl->capture->createDescriptorSetLayout(layout, handle);
+	}
+	impl->sharedDSLayouts.emplace_back(std::move(descriptors), handle);
+	return handle;
 }
 
 
 TextureHandle Renderer::getRenderTargetView(RenderTargetHandle handle, Format f) {
-	return impl->getRenderTargetView(handle, f);
+	CALL_STATS(GetRenderTargetView);
+	TextureHandle view = impl->getRenderTargetView(handle, f);
+	CAPTURE(GetRenderTargetView, handle, f, view);
+	return view;
+}
+
+
+RenderTargetHandle Renderer::getSwapchainRenderTarget() const {
+	RenderTargetHandle handle = impl->getSwapchainRenderTarget();
+	CAPTURE(GetSwapchainRenderTarget, handle);
+	return handle;
+}
+
+
+unsigned int Renderer::getTextureTableIndex(TextureHandle handle) const {
+	return impl->getTextureTableIndex(handle);
 }
 
 
 void Renderer::deleteBuffer(BufferHandle handle) {
+	CAPTURE(DeleteBuffer, handle);
 	impl->deleteBuffer(handle);
 }
 
 
 void Renderer::deleteFramebuffer(FramebufferHandle handle) {
+	CAPTURE(DeleteFramebuffer, handle);
 	impl->deleteFramebuffer(handle);
 }
 
 
 void Renderer::deletePipeline(PipelineHandle handle) {
+	CAPTURE(DeletePipeline, handle);
 	impl->deletePipeline(handle);
 }
 
 
 void Renderer::deleteRenderPass(RenderPassHandle handle) {
+	CAPTURE(DeleteRenderPass, handle);
 	impl->deleteRenderPass(handle);
 }
 
 
 void Renderer::deleteRenderTarget(RenderTargetHandle &rt) {
+	CAPTURE(DeleteRenderTarget, rt);
 	impl->deleteRenderTarget(rt);
 }
 
 
 void Renderer::deleteSampler(SamplerHandle handle) {
+	std::unique_lock<std::mutex> lock(impl->sharedSamplersMutex);
+	for (auto it = impl->sharedSamplers.begin(); it != impl->sharedSamplers.end(); it++) {
+		if (it->second.handle == handle) {
+			assert(it->second.refs > 0);
+			it->second.refs--;
+			if (it->second.refs > 0) {
+				return;
+			}
+			impl->sharedSamplers.erase(it);
+			break;
+		}
+	}
+	lock.unlock();
+
+	CAPTURE(DeleteSampler, handle);
 	impl->deleteSampler(handle);
 }
 
 
 void Renderer::deleteTexture(TextureHandle handle) {
+	CAPTURE(DeleteTexture, handle);
 	impl->deleteTexture(handle);
 }
 
 
 void Renderer::setSwapchainDesc(const SwapchainDesc &desc) {
 	impl->setSwapchainDesc(desc);
+	CAPTURE(SetSwapchainDesc, desc);
 }
 
 
 MemoryStats Renderer::getMemStats() const {
-	return impl->getMemStats();
+	MemoryStats stats = impl->getMemStats();
+
+	std::unique_lock<std::mutex> lock(impl->ringPageMutex);
+	stats.ringPageBytes      = impl->ringPageSize;
+	stats.ringPeakFrameBytes = impl->ringPeakFrameBytes;
+
+	return stats;
+}
+
+
+ShaderStats Renderer::getShaderStats() const {
+	return impl->getShaderStats();
+}
+
+
+std::vector<CallStats> Renderer::getCallStats() const {
+	std::vector<CallStats> result(RendererCall::_size());
+	for (unsigned int i = 0; i < result.size(); i++) {
+#ifdef RENDERER_CALL_STATS
+		result[i] = impl->callStats[i];
+#endif  // RENDERER_CALL_STATS
+		result[i].name = RendererCall::_from_index(i)._to_string();
+	}
+
+	return result;
+}
+
+
+void Renderer::resetCallStats() {
+#ifdef RENDERER_CALL_STATS
+	for (auto &c : impl->callStats) {
+		c = CallStats();
+	}
+#endif  // RENDERER_CALL_STATS
+}
+
+
+const std::vector<GPUTiming> &Renderer::getGPUTimings() const {
+	return impl->gpuTimings;
+}
+
+
+const std::vector<std::string> &Renderer::getPerformanceCounters() const {
+	return impl->performanceCounterNames;
+}
+
+
+const std::vector<PresentTiming> &Renderer::getPresentTimings() const {
+	return impl->presentTimings;
+}
+
+
+void Renderer::requestFrameReadback() {
+	impl->readbackRequested = true;
+}
+
+
+bool Renderer::getFrameReadback(FrameReadback &readback) {
+	if (!impl->readbackReady) {
+		return false;
+	}
+
+	readback.frameNum = impl->readback.frameNum;
+	readback.width    = impl->readback.width;
+	readback.height   = impl->readback.height;
+	readback.format   = impl->readback.format;
+	// swap so neither side reallocates every frame
+	std::swap(readback.pixels, impl->readback.pixels);
+	impl->readbackReady = false;
+
+	return true;
+}
+
+
+uint64_t Renderer::getRefreshInterval() const {
+	return impl->refreshInterval;
+}
+
+
+uint64_t Renderer::getTimeToNextRefresh() const {
+	return impl->timeToNextRefresh();
 }
 
 
@@ -1065,132 +2325,462 @@ bool Renderer::waitForDeviceIdle() {
 
 
 bool Renderer::beginFrame() {
-	return  impl->beginFrame();
+	CALL_STATS(BeginFrame);
+	PROFILE_ZONE("beginFrame");
+	bool result = impl->beginFrame();
+	// failed ones don't start a frame, nothing to replay
+	if (result) {
+		CAPTURE(BeginFrame);
+	}
+	return result;
 }
 
 
 void Renderer::presentFrame(RenderTargetHandle image) {
+	CALL_STATS(PresentFrame);
+	PROFILE_ZONE("presentFrame");
 	impl->presentFrame(image);
+	if (impl->capture && impl->capture->presentFrame(image)) {
+		impl->capture.reset();
+	}
+}
+
+
+void Renderer::addDamageRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	impl->damageRects.emplace_back(x, y, width, height);
+	CAPTURE(AddDamageRect, x, y, width, height);
+}
+
+
+void Renderer::beginAsyncCompute() {
+	impl->beginAsyncCompute();
+	CAPTURE(BeginAsyncCompute);
+}
+
+
+void Renderer::endAsyncCompute() {
+	impl->endAsyncCompute();
+	CAPTURE(EndAsyncCompute);
 }
 
 
 void Renderer::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+	CALL_STATS(BeginRenderPass);
 	impl->beginRenderPass(rpHandle, fbHandle);
+	CAPTURE(BeginRenderPass, rpHandle, fbHandle);
+}
+
+
+bool Renderer::beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+	CALL_STATS(BeginRenderPass);
+	// a replayed pass would leave its draws out of the capture
+	if (impl->capture) {
+		impl->invalidateStaticRenderPass(rpHandle);
+	}
+	bool record = impl->beginStaticRenderPass(rpHandle, fbHandle);
+	CAPTURE(BeginRenderPass, rpHandle, fbHandle);
+	return record;
+}
+
+
+void Renderer::invalidateStaticRenderPass(RenderPassHandle rpHandle) {
+	impl->invalidateStaticRenderPass(rpHandle);
 }
 
 
 void Renderer::endRenderPass() {
+	CALL_STATS(EndRenderPass);
 	impl->endRenderPass();
+	CAPTURE(EndRenderPass);
+}
+
+
+void Renderer::beginGPUTimer(const std::string &name) {
+	CALL_STATS(BeginGPUTimer);
+	impl->beginGPUTimer(name);
+	CAPTURE(BeginGPUTimer, name);
+}
+
+
+void Renderer::endGPUTimer() {
+	CALL_STATS(EndGPUTimer);
+	impl->endGPUTimer();
+	CAPTURE(EndGPUTimer);
+}
+
+
+void Renderer::pushDebugGroup(const char *name) {
+	CALL_STATS(PushDebugGroup);
+	impl->pushDebugGroup(name);
+	CAPTURE(PushDebugGroup, std::string(name));
+}
+
+
+void Renderer::popDebugGroup() {
+	CALL_STATS(PopDebugGroup);
+	impl->popDebugGroup();
+	CAPTURE(PopDebugGroup);
 }
 
 
 void Renderer::layoutTransition(RenderTargetHandle image, Layout src, Layout dest) {
+	CALL_STATS(LayoutTransition);
 	impl->layoutTransition(image, src, dest);
+	CAPTURE(LayoutTransition, image, src, dest);
 }
 
 
 void Renderer::bindPipeline(PipelineHandle pipeline) {
+	CALL_STATS(BindPipeline);
 	impl->bindPipeline(pipeline);
+	CAPTURE(BindPipeline, pipeline);
 }
 
 
 void Renderer::bindIndexBuffer(BufferHandle buffer, bool bit16) {
+	CALL_STATS(BindIndexBuffer);
 	impl->bindIndexBuffer(buffer, bit16);
+	CAPTURE(BindIndexBuffer, buffer, bit16);
 }
 
 
 void Renderer::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
+	CALL_STATS(BindVertexBuffer);
 	impl->bindVertexBuffer(binding, buffer);
+	CAPTURE(BindVertexBuffer, binding, buffer);
 }
 
 
 void Renderer::bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data) {
+	CALL_STATS(BindDescriptorSet);
+	PROFILE_ZONE("bindDescriptorSet");
 	impl->bindDescriptorSet(index, layout, data);
+	if (impl->capture) {
+		impl->capture->bindDescriptorSet(index, layout, data);
+	}
+}
+
+
+void Renderer::pushConstants(const void *data, unsigned int size) {
+	CALL_STATS(PushConstants);
+	impl->pushConstants(data, size);
+	CAPTURE(PushConstants, CaptureBlob(data, size));
 }
 
 
 void Renderer::setScissorRect(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	CALL_STATS(SetScissorRect);
 	impl->setScissorRect(x, y, width, height);
+	CAPTURE(SetScissorRect, x, y, width, height);
 }
 
 
 void Renderer::setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	CALL_STATS(SetViewport);
 	impl->setViewport(x, y, width, height);
+	CAPTURE(SetViewport, x, y, width, height);
+}
+
+
+void Renderer::updateBuffer(BufferHandle buffer, uint32_t offset, uint32_t size, const void *data) {
+	CALL_STATS(UpdateBuffer);
+	impl->updateBuffer(buffer, offset, size, data);
+	CAPTURE(UpdateBuffer, buffer, offset, CaptureBlob(data, size));
+}
+
+
+void Renderer::updateTexture(TextureHandle texture, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data) {
+	CALL_STATS(UpdateTexture);
+	impl->updateTexture(texture, level, x, y, width, height, size, data);
+	CAPTURE(UpdateTexture, texture, level, x, y, width, height, CaptureBlob(data, size));
 }
 
 
 void Renderer::blit(RenderTargetHandle source, RenderTargetHandle target) {
+	CALL_STATS(Blit);
 	impl->blit(source, target);
+	CAPTURE(Blit, source, target);
 }
 
 
 void Renderer::resolveMSAA(RenderTargetHandle source, RenderTargetHandle target) {
+	CALL_STATS(ResolveMSAA);
 	impl->resolveMSAA(source, target);
+	CAPTURE(ResolveMSAA, source, target);
+}
+
+
+void Renderer::readbackRenderTarget(RenderTargetHandle rt, ReadbackCallback callback) {
+	CALL_STATS(ReadbackRenderTarget);
+	// not captured, replay has nowhere to send the pixels
+	impl->readbackRenderTarget(rt, std::move(callback));
 }
 
 
 void Renderer::draw(unsigned int firstVertex, unsigned int vertexCount) {
+	CALL_STATS(Draw);
 	impl->draw(firstVertex, vertexCount);
+	CAPTURE(Draw, firstVertex, vertexCount);
+}
+
+
+void Renderer::drawInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+	CALL_STATS(Draw);
+	impl->drawInstanced(vertexCount, instanceCount);
+	CAPTURE(DrawInstanced, vertexCount, instanceCount);
 }
 
 
 void Renderer::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+	CALL_STATS(DrawIndexed);
 	impl->drawIndexedInstanced(vertexCount, instanceCount);
+	CAPTURE(DrawIndexedInstanced, vertexCount, instanceCount);
 }
 
 
 void Renderer::drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int minIndex, unsigned int maxIndex) {
+	CALL_STATS(DrawIndexed);
 	impl->drawIndexedOffset(vertexCount, firstIndex, minIndex, maxIndex);
+	CAPTURE(DrawIndexedOffset, vertexCount, firstIndex, minIndex, maxIndex);
+}
+
+
+void Renderer::drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex) {
+	CALL_STATS(DrawIndexed);
+	impl->drawIndexedVertexOffset(vertexCount, firstIndex, vertexOffset, minIndex, maxIndex);
+	CAPTURE(DrawIndexedVertexOffset, vertexCount, firstIndex, vertexOffset, minIndex, maxIndex);
+}
+
+
+void Renderer::drawIndirect(BufferHandle buffer, unsigned int drawCount) {
+	CALL_STATS(DrawIndirect);
+	impl->drawIndirect(buffer, drawCount);
+	CAPTURE(DrawIndirect, buffer, drawCount);
+}
+
+
+void Renderer::drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount) {
+	CALL_STATS(DrawIndirect);
+	impl->drawIndexedIndirect(buffer, drawCount);
+	CAPTURE(DrawIndexedIndirect, buffer, drawCount);
+}
+
+
+void Renderer::executeDrawList(const DrawList &list) {
+	CALL_STATS(ExecuteDrawList);
+	// captures have no draw list op, they get the individual calls
+	if (impl->capture || !impl->executeDrawList(list)) {
+		list.replay(*this, 0, list.size());
+	}
+}
+
+
+void Renderer::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+	CALL_STATS(Dispatch);
+	impl->dispatch(x, y, z);
+	CAPTURE(Dispatch, x, y, z);
+}
+
+
+void Renderer::dispatchIndirect(BufferHandle buffer) {
+	CALL_STATS(Dispatch);
+	impl->dispatchIndirect(buffer);
+	CAPTURE(DispatchIndirect, buffer);
+}
+
+
+void Renderer::computeBarrier() {
+	CALL_STATS(ComputeBarrier);
+	impl->computeBarrier();
+	CAPTURE(ComputeBarrier);
 }
 
 
-unsigned int RendererImpl::ringBufferAllocate(unsigned int size, unsigned int alignment) {
+unsigned int RendererImpl::ringBufferAllocate(unsigned int size, unsigned int alignment, unsigned int &page) {
+	assert(size != 0);
 	assert(alignment != 0);
 	assert(isPow2(alignment));
+	assert(alignment <= ringGranularity);
+
+	// start streamed writes on a line boundary so no line is written twice
+	if (size >= streamingCopyMinSize) {
+		alignment = std::max(alignment, static_cast<unsigned int>(streamingCopyAlign));
+	}
+
+	// large allocations go straight to the shared ring
+	if (size > ringChunkSize / 4) {
+		return ringBufferAllocateShared(size, page);
+	}
+
+	// small ones come from this thread's chunk without touching shared state
+	// chunks are granularity aligned so aligning inside the chunk is enough
+	auto &chunk = ringChunk;
+	const unsigned int add  = alignment - 1;
+	const unsigned int mask = ~add;
+	unsigned int beginPtr   = (chunk.ptr + add) & mask;
+
+	if (chunk.epoch != ringEpoch || beginPtr + size > chunk.end) {
+		unsigned int chunkBegin = ringBufferAllocateShared(ringChunkSize, chunk.page);
+		chunk.epoch = ringEpoch;
+		chunk.end   = chunkBegin + ringChunkSize;
+		beginPtr    = chunkBegin;
+	}
+
+	assert(beginPtr + size <= chunk.end);
+	chunk.ptr = beginPtr + size;
+	page      = chunk.page;
+
+	return beginPtr;
+}
+
+
+unsigned int RendererImpl::ringBufferAllocateShared(unsigned int size, unsigned int &page) {
+	assert(size < (1U << 31));
+	const uint64_t rounded = (size + ringGranularity - 1) & ~(ringGranularity - 1);
+
+	while (true) {
+		uint64_t old          = ringCursor.fetch_add(rounded);
+		unsigned int oldPage  = static_cast<unsigned int>(old >> 32);
+		unsigned int beginPtr = static_cast<unsigned int>(old & 0xFFFFFFFFU);
+
+		// the current page is never destroyed so its size can be read without the lock
+		if (oldPage != invalidRingPage && beginPtr + size <= ringPages[oldPage].size) {
+			page = oldPage;
+			return beginPtr;
+		}
+
+		// out of space, first thread to get here moves everyone to a new page
+		std::unique_lock<std::mutex> lock(ringPageMutex);
+		if (static_cast<unsigned int>(ringCursor.load() >> 32) == oldPage) {
+			switchRingPage(size);
+		}
+	}
+}
+
+
+void RendererImpl::switchRingPage(unsigned int size) {
+	if (currentRingPage != invalidRingPage) {
+		unsigned int oldPage = currentRingPage;
+		// past the end is only what didn't fit, the rest of the page was wasted anyway
+		ringFrameBytes += std::min(ringCursor.load() & 0xFFFFFFFFU, uint64_t(ringPages[oldPage].size));
+		currentRingPage = invalidRingPage;
+		if (ringPages[oldPage].users == 0) {
+			freeRingPage(oldPage);
+		}
+	}
+
+	auto it = std::find_if(freeRingPages.begin(), freeRingPages.end(), [this, size] (unsigned int idx) { return ringPages[idx].size >= size; });
+	if (it != freeRingPages.end()) {
+		currentRingPage = *it;
+		freeRingPages.erase(it);
+	} else {
+		if (ringPages.capacity() == 0) {
+			ringPages.reserve(maxRingPages);
+		}
 
-	if (size > ringBufSize) {
-		unsigned int newSize = nextPow2(size);
-		LOG("WARNING: out of ringbuffer space, reallocating to %u bytes\n", newSize);
-		recreateRingBuffer(newSize);
+		// reuse an empty slot if there is one
+		unsigned int idx = 0;
+		while (idx < ringPages.size() && ringPages[idx].size != 0) {
+			idx++;
+		}
+		if (idx == ringPages.size()) {
+			if (idx == maxRingPages) {
+				LOG("Out of ring buffer pages\n");
+				throw std::runtime_error("Out of ring buffer pages");
+			}
+			ringPages.emplace_back();
+		}
 
-		assert(ringBufPtr == 0);
+		unsigned int pageSize = std::max(ringPageSize, nextPow2(size));
+		LOG_DEBUG("Creating ring buffer page %u of %u bytes\n", idx, pageSize);
+		createRingPage(idx, pageSize);
+		assert(ringPages[idx].size == pageSize);
+		currentRingPage = idx;
 	}
 
-	// sub-allocate from persistent coherent buffer
-	// round current pointer up to necessary alignment
-	const unsigned int add   = alignment - 1;
-	const unsigned int mask  = ~add;
-	unsigned int alignedPtr  = (ringBufPtr + add) & mask;
-	assert(ringBufPtr <= alignedPtr);
-	// TODO: ring buffer size should be pow2, se should use add & mask here too
-	unsigned int beginPtr    =  alignedPtr % ringBufSize;
+	// the page can't be reused until this frame is done with it
+	auto &page = ringPages[currentRingPage];
+	page.users++;
+	frames.at(currentFrameIdx).ringPages.push_back(currentRingPage);
+
+	ringCursor.store(uint64_t(currentRingPage) << 32);
+}
+
 
-	if (beginPtr + size >= ringBufSize) {
-		// we went past the end and have to go back to beginning
-		// TODO: add and mask here too
-		ringBufPtr = (ringBufPtr / ringBufSize + 1) * ringBufSize;
-		assert((ringBufPtr & ~mask) == 0);
-		alignedPtr  = (ringBufPtr + add) & mask;
-		beginPtr    =  alignedPtr % ringBufSize;
-		assert(beginPtr + size < ringBufSize);
-		assert(beginPtr == 0);
+void RendererImpl::finishRingFrame() {
+	std::unique_lock<std::mutex> lock(ringPageMutex);
+
+	if (currentRingPage != invalidRingPage) {
+		ringFrameBytes += std::min(ringCursor.load() & 0xFFFFFFFFU, uint64_t(ringPages[currentRingPage].size));
+	}
+	ringPeakFrameBytes  = std::max(ringPeakFrameBytes,  ringFrameBytes);
+	ringWindowPeakBytes = std::max(ringWindowPeakBytes, ringFrameBytes);
+	ringWindowFrames++;
+
+	// a frame should fit in one page, grow as soon as one doesn't
+	// and shrink when a while of frames has used only a small part
+	unsigned int wantedPageSize = ringPageSize;
+	if (ringFrameBytes > ringPageSize && ringPageSize < maxRingPageSize) {
+		wantedPageSize = nextPow2(static_cast<unsigned int>(std::min(ringFrameBytes, uint64_t(maxRingPageSize))));
+	} else if (ringWindowFrames >= ringShrinkFrames) {
+		if (ringWindowPeakBytes < ringPageSize / 4 && ringPageSize / 2 >= minRingPageSize) {
+			wantedPageSize = ringPageSize / 2;
+		}
+		ringWindowPeakBytes = 0;
+		ringWindowFrames    = 0;
+	}
+	ringFrameBytes = 0;
+
+	if (wantedPageSize != ringPageSize) {
+		LOG_DEBUG("Ring buffer pages from %u to %u bytes\n", ringPageSize, wantedPageSize);
+		ringPageSize        = wantedPageSize;
+		ringWindowPeakBytes = 0;
+		ringWindowFrames    = 0;
+
+		// idle pages of the old size won't be used again
+		// ones still in use are destroyed by freeRingPage when their frames retire
+		for (unsigned int idx : freeRingPages) {
+			destroyRingPage(idx);
+		}
+		freeRingPages.clear();
 	}
-	ringBufPtr = alignedPtr + size;
 
-	// ran out of buffer space?
-	if (ringBufPtr >= lastSyncedRingBufPtr + ringBufSize) {
-		unsigned int newSize = ringBufSize * 2;
-		assert(size < newSize);
+	// the next frame starts on a fresh page so every page belongs to exactly one frame
+	// this one is released when the frame retires
+	currentRingPage = invalidRingPage;
+	ringCursor.store(uint64_t(invalidRingPage) << 32);
+	ringEpoch = nextRingEpoch.fetch_add(1);
+}
+
 
-		LOG("WARNING: out of ringbuffer space, reallocating to %u bytes\n", newSize);
-		recreateRingBuffer(newSize);
+void RendererImpl::freeRingPage(unsigned int idx) {
+	assert(idx != currentRingPage);
+	auto &page = ringPages[idx];
+	assert(page.size != 0);
+	assert(page.users == 0);
 
-		assert(ringBufPtr == 0);
-		beginPtr   = 0;
-		ringBufPtr = size;
+	// oversized pages were for a spike and extra standard pages beyond what the frames need are returned
+	if (page.size != ringPageSize || freeRingPages.size() >= frames.size()) {
+		destroyRingPage(idx);
+		assert(page.size == 0);
+	} else {
+		freeRingPages.push_back(idx);
 	}
+}
 
-	return beginPtr;
+
+void RendererImpl::releaseRingPages(Frame &frame) {
+	std::unique_lock<std::mutex> lock(ringPageMutex);
+
+	for (unsigned int idx : frame.ringPages) {
+		auto &page = ringPages[idx];
+		assert(page.users > 0);
+		page.users--;
+		if (page.users == 0 && idx != currentRingPage) {
+			freeRingPage(idx);
+		}
+	}
+	frame.ringPages.clear();
 }
 
 
@@ -25,7 +25,19 @@ THE SOFTWARE.
 #define RENDERERINTERNAL_H
 
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+
 #include "Renderer.h"
+#include "utils/JobSystem.h"
 #include "utils/Utils.h"
 
 
@@ -35,19 +47,119 @@ namespace renderer {
 BETTER_ENUM(ShaderKind, uint8_t
 	, Vertex
 	, Fragment
+	, Compute
 )
 
 
 template <class T>
 class ResourceContainer {
-	HashMap<unsigned int, T>            resources;
-	unsigned int                        next;
+	// handle is generation in the high bits, slot index in the low bits
+	// generation is never 0 so neither is a valid handle
+	static const unsigned int  indexBits      = 20;
+	static const uint32_t      indexMask      = (1U << indexBits) - 1;
+	static const uint32_t      generationMask = (1U << (32 - indexBits)) - 1;
+
+	// slots are allocated in chunks so references stay valid when we grow
+	static const unsigned int  chunkBits      = 8;
+	static const unsigned int  chunkSize      = 1U << chunkBits;
+	static const unsigned int  maxChunks      = (indexMask + 1) >> chunkBits;
+
+
+	struct Slot {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type  storage;
+		uint32_t                                                    generation;
+		bool                                                        alive;
+
+
+		Slot()
+		: generation(0)
+		, alive(false)
+		{
+		}
+
+		Slot(const Slot &)            = delete;
+		Slot &operator=(const Slot &) = delete;
+
+		Slot(Slot &&)                 = delete;
+		Slot &operator=(Slot &&)      = delete;
+
+		~Slot() {}
+
+		T &value() {
+			assert(alive);
+			return *reinterpret_cast<T *>(&storage);
+		}
+
+		const T &value() const {
+			assert(alive);
+			return *reinterpret_cast<const T *>(&storage);
+		}
+	};
+
+
+	typedef std::array<Slot, chunkSize> Chunk;
+
+
+	// resources can be created from any thread so add and remove take the mutex
+	// lookups don't, the chunk table has a fixed size so it never moves under them
+	// and a handle only reaches another thread through something which synchronizes
+	std::array<std::atomic<Chunk *>, maxChunks>  chunks;
+	std::mutex                                   mutex;
+	std::vector<uint32_t>                        freeList;
+	std::atomic<uint32_t>                        numSlots;
+
+
+	Slot &slotAt(uint32_t index) {
+		assert(index < numSlots.load(std::memory_order_relaxed));
+		return (*chunks[index >> chunkBits].load(std::memory_order_acquire))[index & (chunkSize - 1)];
+	}
+
+
+	const Slot &slotAt(uint32_t index) const {
+		assert(index < numSlots.load(std::memory_order_relaxed));
+		return (*chunks[index >> chunkBits].load(std::memory_order_acquire))[index & (chunkSize - 1)];
+	}
+
+
+	Slot &lookup(Handle<T> handle) {
+		assert(handle.handle != 0);
+
+		Slot &slot = slotAt(handle.handle & indexMask);
+		// catches stale handles
+		assert(slot.alive);
+		assert(slot.generation == (handle.handle >> indexBits));
+
+		return slot;
+	}
+
+
+	const Slot &lookup(Handle<T> handle) const {
+		assert(handle.handle != 0);
+
+		const Slot &slot = slotAt(handle.handle & indexMask);
+		// catches stale handles
+		assert(slot.alive);
+		assert(slot.generation == (handle.handle >> indexBits));
+
+		return slot;
+	}
+
+
+	// caller holds mutex
+	void destroy(Slot &slot, uint32_t index) {
+		slot.value().~T();
+		slot.alive = false;
+		freeList.push_back(index);
+	}
 
 
 public:
 	ResourceContainer()
-	: next(1)
+	: numSlots(0)
 	{
+		for (auto &c : chunks) {
+			c.store(nullptr, std::memory_order_relaxed);
+		}
 	}
 
 	ResourceContainer(const ResourceContainer<T> &)            = delete;
@@ -56,66 +168,184 @@ public:
 	ResourceContainer(ResourceContainer<T> &&)                 = delete;
 	ResourceContainer &operator=(ResourceContainer<T> &&)      = delete;
 
-	~ResourceContainer() {}
+	~ResourceContainer() {
+		const uint32_t n = numSlots.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < n; i++) {
+			Slot &slot = slotAt(i);
+			if (slot.alive) {
+				slot.value().~T();
+				slot.alive = false;
+			}
+		}
 
-	std::pair<T &, Handle<T> > add() {
-		unsigned int handle = next;
-		next++;
-		auto result = resources.emplace(handle, T());
-		assert(result.second);
-		return std::make_pair(std::ref(result.first->second), Handle<T>(handle));
+		for (auto &c : chunks) {
+			delete c.load(std::memory_order_relaxed);
+		}
 	}
 
+	std::pair<T &, Handle<T> > add() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		uint32_t index;
+		if (!freeList.empty()) {
+			index = freeList.back();
+			freeList.pop_back();
+		} else {
+			index = numSlots.load(std::memory_order_relaxed);
+			assert(index <= indexMask);
+			if ((index & (chunkSize - 1)) == 0) {
+				chunks[index >> chunkBits].store(new Chunk, std::memory_order_release);
+			}
+			numSlots.store(index + 1, std::memory_order_relaxed);
+		}
 
-	const T &get(Handle<T> handle) const {
-		assert(handle.handle != 0);
+		Slot &slot = slotAt(index);
+		assert(!slot.alive);
+		slot.generation = (slot.generation + 1) & generationMask;
+		if (slot.generation == 0) {
+			slot.generation = 1;
+		}
 
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
+		new (&slot.storage) T();
+		slot.alive = true;
 
-		return it->second;
+		return std::make_pair(std::ref(slot.value()), Handle<T>((slot.generation << indexBits) | index));
 	}
 
 
-	T &get(Handle<T> handle) {
-		assert(handle.handle != 0);
+	const T &get(Handle<T> handle) const {
+		return lookup(handle).value();
+	}
 
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
 
-		return it->second;
+	T &get(Handle<T> handle) {
+		return lookup(handle).value();
 	}
 
 
 	void remove(Handle<T> handle) {
-		assert(handle.handle != 0);
-
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
-		resources.erase(it);
+		std::lock_guard<std::mutex> lock(mutex);
+		destroy(lookup(handle), handle.handle & indexMask);
 	}
 
 
+	// f must not add to or remove from this container
 	template <typename F> void removeWith(Handle<T> handle, F &&f) {
-		assert(handle.handle != 0);
+		std::lock_guard<std::mutex> lock(mutex);
+		Slot &slot = lookup(handle);
+		f(slot.value());
+		destroy(slot, handle.handle & indexMask);
+	}
+
 
-		auto it = resources.find(handle.handle);
-		assert(it != resources.end());
-		f(it->second);
-		resources.erase(it);
+	// f may change the objects but not add or remove any
+	// objects added by other threads can be seen while they're still being filled in
+	template <typename F> void forEach(F &&f) {
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint32_t n = numSlots.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < n; i++) {
+			Slot &slot = slotAt(i);
+			if (slot.alive) {
+				f(slot.value());
+			}
+		}
 	}
 
 
 	template <typename F> void clearWith(F &&f) {
-		auto it = resources.begin();
-		while (it != resources.end()) {
-			f(it->second);
-			it = resources.erase(it);
+		std::lock_guard<std::mutex> lock(mutex);
+		const uint32_t n = numSlots.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < n; i++) {
+			Slot &slot = slotAt(i);
+			if (slot.alive) {
+				f(slot.value());
+				destroy(slot, i);
+			}
 		}
 	}
 };
 
 
+// raw handle values for handles which don't come from a ResourceContainer
+struct HandleAccess {
+	template <class T>
+	static typename HandleTraits<T>::Storage raw(Handle<T> handle) {
+		return handle.handle;
+	}
+
+	template <class T>
+	static Handle<T> make(typename HandleTraits<T>::Storage value) {
+		return Handle<T>(value);
+	}
+};
+
+
+// ephemeral buffers live until their frame retires so they don't need a Buffer object
+// the handle encodes ring buffer page, offset, size and type
+// layout from the top: 1 bit ephemeral flag, 6 bits page, 3 bits type, 29 bits offset, 25 bits size
+struct EphemeralBuffer {
+	static const unsigned int  sizeBits   = 25;
+	static const unsigned int  offsetBits = 29;
+	static const unsigned int  typeBits   = 3;
+	static const unsigned int  pageBits   = 6;
+	static const uint64_t      flag       = 1ULL << 63;
+
+	unsigned int  page;
+	unsigned int  offset;
+	unsigned int  size;
+	BufferType    type;
+
+
+	EphemeralBuffer(unsigned int page_, unsigned int offset_, unsigned int size_, BufferType type_)
+	: page(page_)
+	, offset(offset_)
+	, size(size_)
+	, type(type_)
+	{
+	}
+
+
+	explicit EphemeralBuffer(BufferHandle handle)
+	: page(0)
+	, offset(0)
+	, size(0)
+	, type(BufferType::Invalid)
+	{
+		uint64_t value = HandleAccess::raw(handle);
+		assert(value & flag);
+
+		size   = static_cast<unsigned int>(value & ((1ULL << sizeBits) - 1));
+		value >>= sizeBits;
+		offset = static_cast<unsigned int>(value & ((1ULL << offsetBits) - 1));
+		value >>= offsetBits;
+		type   = BufferType::_from_integral(static_cast<uint8_t>(value & ((1ULL << typeBits) - 1)));
+		value >>= typeBits;
+		page   = static_cast<unsigned int>(value & ((1ULL << pageBits) - 1));
+	}
+
+
+	static bool isEphemeral(BufferHandle handle) {
+		return (HandleAccess::raw(handle) & flag) != 0;
+	}
+
+
+	BufferHandle handle() const {
+		assert(size   <  (1U << sizeBits));
+		assert(offset <  (1U << offsetBits));
+		assert(type._to_integral() < (1U << typeBits));
+		assert(page   <  (1U << pageBits));
+
+		uint64_t value = flag;
+		value |= uint64_t(page)                <<  (typeBits + offsetBits + sizeBits);
+		value |= uint64_t(type._to_integral()) <<  (offsetBits + sizeBits);
+		value |= uint64_t(offset)              <<  sizeBits;
+		value |= uint64_t(size);
+
+		return HandleAccess::make<Buffer>(value);
+	}
+};
+
+
 struct FragmentShader;
 struct VertexShader;
 
@@ -125,14 +355,25 @@ typedef Handle<VertexShader>         VertexShaderHandle;
 
 
 bool isDepthFormat(Format format);
+bool isStencilFormat(Format format);
 bool issRGBFormat(Format format);
+std::string shaderMacrosString(const ShaderMacros &macros);
 
 
 struct FrameBase {
 	uint32_t                  lastFrameNum;
+	// RendererBase::now() when beginFrame returned
+	uint64_t                  beginTime;
+	// names of GPU timers recorded during this frame
+	std::vector<std::string>  timerNames;
+	// ring buffer pages this frame allocated from
+	std::vector<unsigned int> ringPages;
+	// transient CPU-side data of this frame, reset when the frame is reused
+	FrameArena                arena;
 
 	FrameBase()
 	: lastFrameNum(0)
+	, beginTime(0)
 	{
 	}
 
@@ -146,10 +387,75 @@ struct FrameBase {
 };
 
 
+// ephemeral data lives in a chain of fixed size pages
+// a page returns to the free list once every frame which used it has retired
+// backends derive their RingPage from this and add the actual buffer
+struct RingPageBase {
+	// 0 means unused slot
+	uint32_t                  size;
+	// number of outstanding frames using this page
+	uint32_t                  users;
+
+
+	RingPageBase()
+	: size(0)
+	, users(0)
+	{
+	}
+};
+
+
+// shader include file as last read from disk
+// compiles hold on to contents so it can be replaced while they run
+struct IncludeFile {
+	int64_t                                    timestamp;
+	std::shared_ptr<const MappedFile>          contents;
+
+
+	IncludeFile()
+	: timestamp(0)
+	{
+	}
+};
+
+
+// one compiled combination of shader file and macros, for hot reload
+struct ShaderVariant {
+	std::string           name;
+	ShaderMacros          macros;
+	ShaderKind            kind;
+	// the shader itself and everything it includes
+	HashSet<std::string>  files;
+
+
+	ShaderVariant(const std::string &name_, const ShaderMacros &macros_, ShaderKind kind_)
+	: name(name_)
+	, macros(macros_)
+	, kind(kind_)
+	{
+	}
+};
+
+
+class CaptureWriter;
+
+
+static const unsigned int invalidRingPage = ~0U;
+// upper bound so ringPages never reallocates while other threads read it
+// also limited by the page bits in EphemeralBuffer
+static const unsigned int maxRingPages    = 64;
+// ring page size adapts between RendererDesc::ephemeralRingBufSize and this
+static const unsigned int maxRingPageSize = 64 * 1048576;
+// frames of low ring buffer usage before the page size is halved
+static const unsigned int ringShrinkFrames = 600;
+
+
 struct RendererBase {
 	SwapchainDesc                                        swapchainDesc;
 	SwapchainDesc                                        wantedSwapchain;
 	bool                                                 swapchainDirty;
+	// RendererDesc::offscreen
+	bool                                                 offscreen;
 
 	uint32_t                                             currentFrameIdx;
 	uint32_t                                             lastSyncedFrame;
@@ -161,17 +467,126 @@ struct RendererBase {
 	bool                                                 skipShaderCache;
 	bool                                                 optimizeShaders;
 	bool                                                 validateShaders;
+	// OpLine and friends for debuggers, otherwise stripped to keep the blobs small
+	bool                                                 shaderDebugInfo;
+	ShaderOptimization                                   shaderOptimization;
+	HashMap<std::string, ShaderOptimization>             shaderOptimizationOverrides;
+	// reflect cached SPIR-V to check bindings again, debug or validate only
+	bool                                                 recheckCachedShaders;
 	unsigned int                                         frameNum;
+	// thread which created the renderer, everything but resource creation happens on it
+	std::thread::id                                      renderThread;
+
+	// nanoseconds beginFrame may block, 0 with FrameWait::Poll
+	uint64_t                                             frameWaitTimeout;
 
 	unsigned int                                         uboAlign;
 	unsigned int                                         ssboAlign;
 
-	unsigned int                                         ringBufSize;
-	unsigned int                                         ringBufPtr;
-	// we have synced with the GPU up to this ringbuffer index
-	unsigned int                                         lastSyncedRingBufPtr;
-
-	HashMap<std::string, std::vector<char> >             shaderSources;
+	// size of a standard ring buffer page, larger allocations get their own page
+	unsigned int                                         ringPageSize;
+	// threads grab chunks of this size and sub-allocate small buffers locally
+	unsigned int                                         ringChunkSize;
+	// current page index << 32 | offset in page, bumped with a single fetch-add
+	std::atomic<uint64_t>                                ringCursor;
+	// changes every frame, thread local chunks from an older epoch are stale
+	uint64_t                                             ringEpoch;
+	// protects page switching and the page bookkeeping below
+	std::mutex                                           ringPageMutex;
+	unsigned int                                         currentRingPage;
+	std::vector<unsigned int>                            freeRingPages;
+	// RendererDesc::ephemeralRingBufSize, ringPageSize adapts to usage but not below this
+	unsigned int                                         minRingPageSize;
+	// bytes of pages the current frame has filled so far
+	uint64_t                                             ringFrameBytes;
+	// most a frame has used, saved so the next run starts with pages that fit
+	uint64_t                                             ringPeakFrameBytes;
+	// most a frame has used in the last ringWindowFrames, for shrinking
+	uint64_t                                             ringWindowPeakBytes;
+	unsigned int                                         ringWindowFrames;
+
+	HashMap<std::string, std::shared_ptr<const MappedFile> > shaderSources;
+	std::mutex                                           shaderSourcesMutex;
+
+	// shared by all compile threads for the lifetime of the renderer
+	std::mutex                                           includeCacheMutex;
+	HashMap<std::string, IncludeFile>                    includeCache;
+
+	// SPIR-V keyed on hash of preprocessed source and macros
+	// loaded once at startup, written back on shutdown if changed
+	JobCounter                                           spirvCacheLoad;
+	std::mutex                                           spirvCacheMutex;
+	HashMap<uint64_t, std::vector<uint32_t> >            spirvCache;
+	bool                                                 spirvCacheDirty;
+
+	// background shader compilation and other work through runBackground
+	// RendererDesc::jobSystem or ownJobSystem
+	std::unique_ptr<JobSystem>                           ownJobSystem;
+	JobSystem                                           *jobSystem;
+	JobCounter                                           backgroundJobs;
+	// compileMutex protects compileStop and pendingShaders
+	std::mutex                                           compileMutex;
+	bool                                                 compileStop;
+	HashMap<std::string, std::shared_future<std::vector<uint32_t> > >  pendingShaders;
+
+	// shader hot reload
+	// shaderWatchMutex protects everything below it
+	bool                                                 shaderHotReload;
+	std::thread                                          shaderWatchThread;
+	std::mutex                                           shaderWatchMutex;
+	std::condition_variable                              shaderWatchCV;
+	bool                                                 shaderWatchStop;
+	// keyed by makeShaderName
+	HashMap<std::string, ShaderVariant>                  shaderVariants;
+	// timestamp when the file was last read
+	HashMap<std::string, int64_t>                        watchedFiles;
+	std::vector<std::string>                             reloadedShaders;
+	// recompiled in a batch where something else failed, reported with the next good one
+	std::vector<std::string>                             heldBackShaders;
+
+	// compile threads add to this, logged on shutdown
+	std::mutex                                           shaderStatsMutex;
+	ShaderStats                                          shaderStats;
+
+	// RendererDesc::captureFile, dropped once the stream is written
+	std::unique_ptr<CaptureWriter>                       capture;
+
+	// samplers and descriptor set layouts with equal descs are created once
+	// keyed by SamplerDesc::hashValue, dropped when the last user deletes it
+	struct SharedSampler {
+		SamplerHandle   handle;
+		unsigned int    refs;
+	};
+	// createSampler can be called from any thread
+	std::mutex                                           sharedSamplersMutex;
+	HashMap<uint64_t, SharedSampler>                     sharedSamplers;
+	// layouts are never deleted, there are only a handful so a vector is enough
+	std::vector<std::pair<std::vector<DescriptorLayout>, DSLayoutHandle> >  sharedDSLayouts;
+
+#ifdef RENDERER_CALL_STATS
+	// indexed by RendererCall, only touched from the rendering thread
+	std::array<CallStats, RendererCall::_size_constant>  callStats;
+#endif  // RENDERER_CALL_STATS
+
+	// results from the most recently synced frame
+	std::vector<GPUTiming>                               gpuTimings;
+	// set by the backend at creation
+	std::vector<std::string>                             performanceCounterNames;
+
+	// cleared by presentFrame, backends add frames as their timings arrive
+	std::vector<PresentTiming>                           presentTimings;
+	// nanoseconds, 0 if unknown
+	uint64_t                                             refreshInterval;
+	// most recent presentTime which came from the display, 0 if none
+	uint64_t                                             lastDisplayTime;
+	// (x, y, width, height) from addDamageRect, cleared by presentFrame
+	std::vector<glm::uvec4>                              damageRects;
+
+	// set by requestFrameReadback, cleared by the next presentFrame
+	bool                                                 readbackRequested;
+	// backends fill this when a readback frame syncs
+	bool                                                 readbackReady;
+	FrameReadback                                        readback;
 
 #ifndef NDEBUG
 	// debugging
@@ -180,19 +595,75 @@ struct RendererBase {
 	bool                                                 validPipeline;
 	bool                                                 pipelineDrawn;
 	bool                                                 scissorSet;
+	bool                                                 inGPUTimer;
+	unsigned int                                         debugGroupDepth;
 #endif //  NDEBUG
 
 	std::string                                          spirvCacheDir;
 
 
-	std::vector<char> loadSource(const std::string &name);
+	std::shared_ptr<const MappedFile> loadSource(const std::string &name);
+
+	std::shared_ptr<const MappedFile> loadInclude(const std::string &name);
+
+	void loadSPVCache();
 
-	std::string makeSPVCacheName(uint64_t hash);
+	void saveSPVCache();
 
-	bool loadCachedSPV(const std::string &name, const std::string &shaderName, std::vector<uint32_t> &spirv);
+	// ring.cache next to the SPIR-V cache, the frame high-water mark of the last run
+	void loadRingSize();
+
+	void saveRingSize();
+
+	bool loadCachedSPV(uint64_t key, std::vector<uint32_t> &spirv);
 
 	std::vector<uint32_t> compileSpirv(const std::string &name, const ShaderMacros &macros, ShaderKind kind);
 
+	// must only touch state which is safe to use from the compile threads
+	ShaderOptimization shaderOptimizationFor(const std::string &name) const;
+
+	std::vector<uint32_t> compileSpirvInternal(const std::string &name, const std::string &shaderName, const ShaderMacros &macros, ShaderKind kind);
+
+	void compileSpirvAsync(const std::string &name, const ShaderMacros &macros, ShaderKind kind);
+	// compileSpirv won't block on a background compile
+	bool isSpirvReady(const std::string &name, const ShaderMacros &macros);
+
+	// replace drops an earlier pending compile of the same variant, its result is stale
+	std::shared_future<std::vector<uint32_t> > queueCompile(const std::string &name, const std::string &shaderName, const ShaderMacros &macros, ShaderKind kind, bool replace);
+
+	// these two are called from the compile threads
+	void watchShader(const std::string &name, const std::string &shaderName, const ShaderMacros &macros, ShaderKind kind);
+
+	void watchShaderFile(const std::string &shaderName, const std::string &filename);
+
+	void shaderWatchThreadFunc();
+
+	void reloadShaders(const HashSet<std::string> &changed, const std::vector<std::pair<std::string, ShaderVariant> > &variants);
+
+	std::vector<std::string> takeReloadedShaders();
+
+	void addShaderStats(const ShaderVariantStats &stats);
+
+	void addPipelineStats(const PipelineStats &stats);
+
+	ShaderStats getShaderStats();
+
+	void logShaderStats();
+
+	void waitForShaders();
+
+	// on jobSystem, skipped once the renderer is being destroyed
+	void runBackground(std::function<void()> job);
+
+	// nanoseconds on a monotonic clock, same one the display timestamps use
+	static uint64_t now();
+
+	uint64_t timeToNextRefresh() const;
+
+	bool isRenderThread() const {
+		return std::this_thread::get_id() == renderThread;
+	}
+
 	explicit RendererBase(const RendererDesc &desc);
 
 
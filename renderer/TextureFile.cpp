@@ -0,0 +1,460 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#include <cassert>
+#include <cctype>
+#include <cstring>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "TextureFile.h"
+
+
+namespace renderer {
+
+
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+static const char ktx2Identifier[12] = { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+
+
+struct KTX2Header {
+	char      identifier[12];
+	uint32_t  vkFormat;
+	uint32_t  typeSize;
+	uint32_t  pixelWidth;
+	uint32_t  pixelHeight;
+	uint32_t  pixelDepth;
+	uint32_t  layerCount;
+	uint32_t  faceCount;
+	uint32_t  levelCount;
+	uint32_t  supercompressionScheme;
+	uint32_t  dfdByteOffset;
+	uint32_t  dfdByteLength;
+	uint32_t  kvdByteOffset;
+	uint32_t  kvdByteLength;
+	uint64_t  sgdByteOffset;
+	uint64_t  sgdByteLength;
+};
+
+
+static_assert(sizeof(KTX2Header) == 80, "KTX2Header has padding");
+
+
+struct KTX2Level {
+	uint64_t  byteOffset;
+	uint64_t  byteLength;
+	uint64_t  uncompressedByteLength;
+};
+
+
+// https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+struct DDSPixelFormat {
+	uint32_t  size;
+	uint32_t  flags;
+	uint32_t  fourCC;
+	uint32_t  rgbBitCount;
+	uint32_t  rBitMask;
+	uint32_t  gBitMask;
+	uint32_t  bBitMask;
+	uint32_t  aBitMask;
+};
+
+
+struct DDSHeader {
+	uint32_t        magic;
+	uint32_t        size;
+	uint32_t        flags;
+	uint32_t        height;
+	uint32_t        width;
+	uint32_t        pitchOrLinearSize;
+	uint32_t        depth;
+	uint32_t        mipMapCount;
+	uint32_t        reserved1[11];
+	DDSPixelFormat  pixelFormat;
+	uint32_t        caps;
+	uint32_t        caps2;
+	uint32_t        caps3;
+	uint32_t        caps4;
+	uint32_t        reserved2;
+};
+
+
+static_assert(sizeof(DDSHeader) == 128, "DDSHeader has padding");
+
+
+struct DDSHeaderDX10 {
+	uint32_t  dxgiFormat;
+	uint32_t  resourceDimension;
+	uint32_t  miscFlag;
+	uint32_t  arraySize;
+	uint32_t  miscFlags2;
+};
+
+
+static const uint32_t ddsMagic                  = 0x20534444;  // "DDS "
+static const uint32_t ddsFlagMipMapCount        = 0x20000;
+static const uint32_t ddsPixelFlagAlphaPixels   = 0x1;
+static const uint32_t ddsPixelFlagFourCC        = 0x4;
+static const uint32_t ddsPixelFlagRGB           = 0x40;
+static const uint32_t ddsPixelFlagLuminance     = 0x20000;
+static const uint32_t ddsDimensionTexture2D     = 3;
+
+
+static constexpr uint32_t fourCC(char a, char b, char c, char d) {
+	return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+
+static Format ktx2Format(uint32_t vkFormat) {
+	switch (vkFormat) {
+	case 9:    // VK_FORMAT_R8_UNORM
+		return Format::R8;
+
+	case 16:   // VK_FORMAT_R8G8_UNORM
+		return Format::RG8;
+
+	case 23:   // VK_FORMAT_R8G8B8_UNORM
+		return Format::RGB8;
+
+	case 37:   // VK_FORMAT_R8G8B8A8_UNORM
+		return Format::RGBA8;
+
+	case 43:   // VK_FORMAT_R8G8B8A8_SRGB
+		return Format::sRGBA8;
+
+	case 83:   // VK_FORMAT_R16G16_SFLOAT
+		return Format::RG16Float;
+
+	case 97:   // VK_FORMAT_R16G16B16A16_SFLOAT
+		return Format::RGBA16Float;
+
+	case 109:  // VK_FORMAT_R32G32B32A32_SFLOAT
+		return Format::RGBA32Float;
+
+	case 122:  // VK_FORMAT_B10G11R11_UFLOAT_PACK32
+		return Format::RG11B10Float;
+
+	case 133:  // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+		return Format::BC1RGBA;
+
+	case 134:  // VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+		return Format::sBC1RGBA;
+
+	case 137:  // VK_FORMAT_BC3_UNORM_BLOCK
+		return Format::BC3RGBA;
+
+	case 138:  // VK_FORMAT_BC3_SRGB_BLOCK
+		return Format::sBC3RGBA;
+
+	case 145:  // VK_FORMAT_BC7_UNORM_BLOCK
+		return Format::BC7RGBA;
+
+	case 146:  // VK_FORMAT_BC7_SRGB_BLOCK
+		return Format::sBC7RGBA;
+
+	case 147:  // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+		return Format::ETC2RGB8;
+
+	case 148:  // VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK
+		return Format::sETC2RGB8;
+
+	case 151:  // VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+		return Format::ETC2RGBA8;
+
+	case 152:  // VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK
+		return Format::sETC2RGBA8;
+
+	case 157:  // VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+		return Format::ASTC4x4;
+
+	case 158:  // VK_FORMAT_ASTC_4x4_SRGB_BLOCK
+		return Format::sASTC4x4;
+
+	default:
+		return Format::Invalid;
+	}
+}
+
+
+static Format dxgiFormat(uint32_t dxgi) {
+	switch (dxgi) {
+	case 2:   // DXGI_FORMAT_R32G32B32A32_FLOAT
+		return Format::RGBA32Float;
+
+	case 10:  // DXGI_FORMAT_R16G16B16A16_FLOAT
+		return Format::RGBA16Float;
+
+	case 26:  // DXGI_FORMAT_R11G11B10_FLOAT
+		return Format::RG11B10Float;
+
+	case 28:  // DXGI_FORMAT_R8G8B8A8_UNORM
+		return Format::RGBA8;
+
+	case 29:  // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+		return Format::sRGBA8;
+
+	case 34:  // DXGI_FORMAT_R16G16_FLOAT
+		return Format::RG16Float;
+
+	case 49:  // DXGI_FORMAT_R8G8_UNORM
+		return Format::RG8;
+
+	case 61:  // DXGI_FORMAT_R8_UNORM
+		return Format::R8;
+
+	case 71:  // DXGI_FORMAT_BC1_UNORM
+		return Format::BC1RGBA;
+
+	case 72:  // DXGI_FORMAT_BC1_UNORM_SRGB
+		return Format::sBC1RGBA;
+
+	case 77:  // DXGI_FORMAT_BC3_UNORM
+		return Format::BC3RGBA;
+
+	case 78:  // DXGI_FORMAT_BC3_UNORM_SRGB
+		return Format::sBC3RGBA;
+
+	case 98:  // DXGI_FORMAT_BC7_UNORM
+		return Format::BC7RGBA;
+
+	case 99:  // DXGI_FORMAT_BC7_UNORM_SRGB
+		return Format::sBC7RGBA;
+
+	default:
+		return Format::Invalid;
+	}
+}
+
+
+// pre-DX10 header, only the layouts which match one of our formats without swizzling
+static Format ddsLegacyFormat(const DDSPixelFormat &pf) {
+	if (pf.flags & ddsPixelFlagFourCC) {
+		switch (pf.fourCC) {
+		case fourCC('D', 'X', 'T', '1'):
+			return Format::BC1RGBA;
+
+		case fourCC('D', 'X', 'T', '5'):
+			return Format::BC3RGBA;
+
+		default:
+			return Format::Invalid;
+		}
+	}
+
+	if (pf.flags & ddsPixelFlagLuminance) {
+		if (pf.rgbBitCount == 8 && pf.rBitMask == 0xFF) {
+			return Format::R8;
+		}
+
+		if ((pf.flags & ddsPixelFlagAlphaPixels) && pf.rgbBitCount == 16 && pf.rBitMask == 0xFF && pf.aBitMask == 0xFF00) {
+			return Format::RG8;
+		}
+
+		return Format::Invalid;
+	}
+
+	if (pf.flags & ddsPixelFlagRGB) {
+		if (pf.rgbBitCount == 24 && pf.rBitMask == 0xFF && pf.gBitMask == 0xFF00 && pf.bBitMask == 0xFF0000) {
+			return Format::RGB8;
+		}
+
+		if (pf.rgbBitCount == 32 && pf.rBitMask == 0xFF && pf.gBitMask == 0xFF00 && pf.bBitMask == 0xFF0000 && ((pf.flags & ddsPixelFlagAlphaPixels) == 0 || pf.aBitMask == 0xFF000000)) {
+			return Format::RGBA8;
+		}
+	}
+
+	return Format::Invalid;
+}
+
+
+TextureFile::TextureFile(const std::string &filename)
+: file(filename)
+, width(0)
+, height(0)
+, numMips(0)
+, format(Format::Invalid)
+{
+	if (file.size() >= sizeof(ktx2Identifier) && memcmp(file.data(), ktx2Identifier, sizeof(ktx2Identifier)) == 0) {
+		parseKTX2(filename);
+	} else if (file.size() >= sizeof(ddsMagic) && memcmp(file.data(), &ddsMagic, sizeof(ddsMagic)) == 0) {
+		parseDDS(filename);
+	} else {
+		throw std::runtime_error("Not a KTX2 or DDS file: \"" + filename + "\"");
+	}
+
+	assert(format != +Format::Invalid);
+	assert(numMips > 0);
+}
+
+
+bool TextureFile::isTextureFile(const std::string &filename) {
+	auto dot = filename.rfind('.');
+	if (dot == std::string::npos) {
+		return false;
+	}
+
+	std::string ext = filename.substr(dot + 1);
+	for (auto &c : ext) {
+		c = static_cast<char>(tolower(c));
+	}
+
+	return (ext == "dds" || ext == "ktx2");
+}
+
+
+void TextureFile::parseKTX2(const std::string &filename) {
+	KTX2Header header;
+	if (file.size() < sizeof(header)) {
+		throw std::runtime_error("KTX2 file \"" + filename + "\" is truncated");
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	format = ktx2Format(header.vkFormat);
+	if (format == +Format::Invalid) {
+		throw std::runtime_error("KTX2 file \"" + filename + "\" has unsupported format " + std::to_string(header.vkFormat));
+	}
+
+	if (header.supercompressionScheme != 0) {
+		throw std::runtime_error("KTX2 file \"" + filename + "\" is supercompressed");
+	}
+
+	if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+		throw std::runtime_error("KTX2 file \"" + filename + "\" is not a 2D texture");
+	}
+
+	width   = header.pixelWidth;
+	height  = header.pixelHeight;
+	// 0 asks the loader to generate mips, we only use the base level then
+	numMips = std::max(header.levelCount, 1U);
+	if (width == 0 || height == 0 || width >= MAX_TEXTURE_SIZE || height >= MAX_TEXTURE_SIZE || numMips > MAX_TEXTURE_MIPLEVELS) {
+		throw std::runtime_error("KTX2 file \"" + filename + "\" has bad dimensions");
+	}
+
+	// level index follows the header, largest level first
+	if (file.size() < sizeof(header) + numMips * sizeof(KTX2Level)) {
+		throw std::runtime_error("KTX2 file \"" + filename + "\" is truncated");
+	}
+
+	unsigned int w = width, h = height;
+	for (unsigned int i = 0; i < numMips; i++) {
+		KTX2Level level;
+		memcpy(&level, file.data() + sizeof(header) + i * sizeof(KTX2Level), sizeof(level));
+
+		uint64_t size = formatDataSize(format, w, h);
+		if (level.byteLength != size) {
+			throw std::runtime_error("KTX2 file \"" + filename + "\" has bad level size");
+		}
+		if (level.byteOffset > file.size() || file.size() - level.byteOffset < size) {
+			throw std::runtime_error("KTX2 file \"" + filename + "\" is truncated");
+		}
+		if (size > std::numeric_limits<unsigned int>::max()) {
+			throw std::runtime_error("KTX2 file \"" + filename + "\" has a level too big to upload");
+		}
+
+		mips[i].data = file.data() + level.byteOffset;
+		mips[i].size = static_cast<unsigned int>(size);
+
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+	}
+}
+
+
+void TextureFile::parseDDS(const std::string &filename) {
+	DDSHeader header;
+	if (file.size() < sizeof(header)) {
+		throw std::runtime_error("DDS file \"" + filename + "\" is truncated");
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	size_t offset = sizeof(header);
+	if ((header.pixelFormat.flags & ddsPixelFlagFourCC) && header.pixelFormat.fourCC == fourCC('D', 'X', '1', '0')) {
+		DDSHeaderDX10 dx10;
+		if (file.size() < offset + sizeof(dx10)) {
+			throw std::runtime_error("DDS file \"" + filename + "\" is truncated");
+		}
+		memcpy(&dx10, file.data() + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+
+		if (dx10.resourceDimension != ddsDimensionTexture2D || dx10.arraySize > 1) {
+			throw std::runtime_error("DDS file \"" + filename + "\" is not a 2D texture");
+		}
+
+		format = dxgiFormat(dx10.dxgiFormat);
+		if (format == +Format::Invalid) {
+			throw std::runtime_error("DDS file \"" + filename + "\" has unsupported DXGI format " + std::to_string(dx10.dxgiFormat));
+		}
+	} else {
+		format = ddsLegacyFormat(header.pixelFormat);
+		if (format == +Format::Invalid) {
+			throw std::runtime_error("DDS file \"" + filename + "\" has unsupported pixel format");
+		}
+	}
+
+	width   = header.width;
+	height  = header.height;
+	numMips = (header.flags & ddsFlagMipMapCount) ? std::max(header.mipMapCount, 1U) : 1;
+	if (width == 0 || height == 0 || width >= MAX_TEXTURE_SIZE || height >= MAX_TEXTURE_SIZE || numMips > MAX_TEXTURE_MIPLEVELS) {
+		throw std::runtime_error("DDS file \"" + filename + "\" has bad dimensions");
+	}
+
+	// levels are stored back to back, largest first
+	unsigned int w = width, h = height;
+	for (unsigned int i = 0; i < numMips; i++) {
+		uint64_t size = formatDataSize(format, w, h);
+		if (file.size() - offset < size) {
+			throw std::runtime_error("DDS file \"" + filename + "\" is truncated");
+		}
+		if (size > std::numeric_limits<unsigned int>::max()) {
+			throw std::runtime_error("DDS file \"" + filename + "\" has a level too big to upload");
+		}
+
+		mips[i].data = file.data() + offset;
+		mips[i].size = static_cast<unsigned int>(size);
+		offset += size;
+
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+	}
+}
+
+
+TextureDesc &TextureFile::describe(TextureDesc &desc) const {
+	desc.width(width)
+	    .height(height)
+	    .format(format)
+	    .numMips(numMips);
+
+	for (unsigned int i = 0; i < numMips; i++) {
+		desc.mipLevelData(i, mips[i].data, mips[i].size);
+	}
+
+	return desc;
+}
+
+
+}  // namespace renderer
@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#ifndef TEXTUREFILE_H
+#define TEXTUREFILE_H
+
+
+#include "Renderer.h"
+#include "utils/Utils.h"
+
+
+namespace renderer {
+
+
+// texture with its whole mip chain from a KTX2 or DDS file
+// uploaded as is, nothing is decoded or converted
+// the mip data points into the mapped file
+class TextureFile {
+	struct MipLevel {
+		const char    *data;
+		unsigned int  size;
+
+		MipLevel()
+		: data(nullptr)
+		, size(0)
+		{
+		}
+	};
+
+	MappedFile                                   file;
+	unsigned int                                 width, height;
+	unsigned int                                 numMips;
+	Format                                       format;
+	std::array<MipLevel, MAX_TEXTURE_MIPLEVELS>  mips;
+
+
+	void parseKTX2(const std::string &filename);
+	void parseDDS(const std::string &filename);
+
+
+public:
+
+	// throws std::runtime_error on unknown or unsupported contents
+	explicit TextureFile(const std::string &filename);
+
+	TextureFile(const TextureFile &)                = delete;
+	TextureFile(TextureFile &&) noexcept            = default;
+
+	TextureFile &operator=(const TextureFile &)     = delete;
+	TextureFile &operator=(TextureFile &&) noexcept = default;
+
+	~TextureFile() {}
+
+	// by extension
+	static bool isTextureFile(const std::string &filename);
+
+	unsigned int getWidth() const {
+		return width;
+	}
+
+	unsigned int getHeight() const {
+		return height;
+	}
+
+	unsigned int getNumMips() const {
+		return numMips;
+	}
+
+	Format getFormat() const {
+		return format;
+	}
+
+	// size, format and all mip levels
+	// this must outlive the createTexture call
+	TextureDesc &describe(TextureDesc &desc) const;
+};
+
+
+}  // namespace renderer
+
+
+#endif  // TEXTUREFILE_H
@@ -27,11 +27,18 @@ THE SOFTWARE.
 #include <SDL_vulkan.h>
 
 #include "RendererInternal.h"
+#include "DrawList.h"
+#include "utils/ThreadPlacement.h"
 #include "utils/Utils.h"
 
+#include <algorithm>
+#include <exception>
+
 #include <boost/variant/apply_visitor.hpp>
 #include <boost/variant/static_visitor.hpp>
 
+#include <xxhash.h>
+
 
 namespace renderer {
 
@@ -67,6 +74,39 @@ struct ResourceHasher final : public boost::static_visitor<size_t> {
 };
 
 
+// what GPUTiming reports, results come in this order
+static const vk::QueryPipelineStatisticFlags statisticsFlags = vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+                                                             | vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+                                                             | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations
+                                                             | vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+
+
+static double performanceCounterValue(const vk::PerformanceCounterResultKHR &result, vk::PerformanceCounterStorageKHR storage) {
+	switch (storage) {
+	case vk::PerformanceCounterStorageKHR::eInt32:
+		return double(result.int32);
+
+	case vk::PerformanceCounterStorageKHR::eInt64:
+		return double(result.int64);
+
+	case vk::PerformanceCounterStorageKHR::eUint32:
+		return double(result.uint32);
+
+	case vk::PerformanceCounterStorageKHR::eUint64:
+		return double(result.uint64);
+
+	case vk::PerformanceCounterStorageKHR::eFloat32:
+		return double(result.float32);
+
+	case vk::PerformanceCounterStorageKHR::eFloat64:
+		return result.float64;
+	}
+
+	UNREACHABLE();
+	return 0.0;
+}
+
+
 template <typename T> void RendererImpl::debugNameObject(T handle, const std::string &name) {
 	if (debugMarkers) {
 		vk::DebugMarkerObjectNameInfoEXT markerName;
@@ -78,16 +118,45 @@ template <typename T> void RendererImpl::debugNameObject(T handle, const std::st
 }
 
 
-static const std::array<vk::DescriptorType, DescriptorType::_size()> descriptorTypes =
+// End, Empty and TextureTable have no Vulkan descriptor type
+static const std::array<vk::DescriptorType, DescriptorType::_size() - 3> descriptorTypes =
 { {
 	  vk::DescriptorType::eUniformBuffer
 	, vk::DescriptorType::eStorageBuffer
 	, vk::DescriptorType::eSampler
 	, vk::DescriptorType::eSampledImage
 	, vk::DescriptorType::eCombinedImageSampler
+	, vk::DescriptorType::eUniformBufferDynamic
+	, vk::DescriptorType::eStorageBufferDynamic
+	, vk::DescriptorType::eStorageImage
 } };
 
 
+// new sets a frame may allocate before any use is measured, and the fewest it's sized for later
+// a pool holds twice as many since cached sets from earlier frames can fill half of it
+static const unsigned int maxDescriptorSetsPerFrame = 256;
+static const unsigned int minDescriptorSetsPerFrame = 32;
+// frames between descriptor pool size checks
+static const unsigned int dsPoolResizeInterval      = 64;
+// maxSets of a static render pass's own descriptor pool
+static const unsigned int staticDescriptorSets      = 16;
+// maxSets of each pool a thread records draw list chunks with
+static const unsigned int recordDescriptorSets      = 64;
+// fewest draws worth recording in a secondary command buffer on another thread
+static const unsigned int drawListChunkSize         = 64;
+
+// uploads are suballocated from staging blocks of this size
+// larger resources get a dedicated block
+static const uint32_t stagingBlockSize   = 16 * 1024 * 1024;
+// satisfies buffer-image copy offset requirements for all formats we use
+static const uint32_t stagingAlign       = 256;
+// submit early when a batch grows past this, its staging blocks come back once the copies are done
+static const uint32_t maxUploadBatchSize = 64 * 1024 * 1024;
+// Static buffers up to maxArenaBufferSize are packed into shared buffers this big
+static const uint32_t bufferArenaSize    = 4 * 1024 * 1024;
+static const uint32_t maxArenaBufferSize = 64 * 1024;
+
+
 static vk::Format vulkanVertexFormat(VtxFormat format, uint8_t count) {
 	switch (format) {
 	case VtxFormat::Float:
@@ -147,6 +216,9 @@ static vk::Format vulkanFormat(Format format) {
 	case Format::RGBA32Float:
 		return vk::Format::eR32G32B32A32Sfloat;
 
+	case Format::RG11B10Float:
+		return vk::Format::eB10G11R11UfloatPack32;
+
 	case Format::Depth16:
 		return vk::Format::eD16Unorm;
 
@@ -162,6 +234,42 @@ static vk::Format vulkanFormat(Format format) {
 	case Format::Depth32Float:
 		return vk::Format::eD32Sfloat;
 
+	case Format::BC1RGBA:
+		return vk::Format::eBc1RgbaUnormBlock;
+
+	case Format::sBC1RGBA:
+		return vk::Format::eBc1RgbaSrgbBlock;
+
+	case Format::BC3RGBA:
+		return vk::Format::eBc3UnormBlock;
+
+	case Format::sBC3RGBA:
+		return vk::Format::eBc3SrgbBlock;
+
+	case Format::BC7RGBA:
+		return vk::Format::eBc7UnormBlock;
+
+	case Format::sBC7RGBA:
+		return vk::Format::eBc7SrgbBlock;
+
+	case Format::ETC2RGB8:
+		return vk::Format::eEtc2R8G8B8UnormBlock;
+
+	case Format::sETC2RGB8:
+		return vk::Format::eEtc2R8G8B8SrgbBlock;
+
+	case Format::ETC2RGBA8:
+		return vk::Format::eEtc2R8G8B8A8UnormBlock;
+
+	case Format::sETC2RGBA8:
+		return vk::Format::eEtc2R8G8B8A8SrgbBlock;
+
+	case Format::ASTC4x4:
+		return vk::Format::eAstc4x4UnormBlock;
+
+	case Format::sASTC4x4:
+		return vk::Format::eAstc4x4SrgbBlock;
+
 	}
 
 	UNREACHABLE();
@@ -192,6 +300,10 @@ vk::BufferUsageFlags bufferTypeUsage(BufferType type) {
 		flags |= vk::BufferUsageFlagBits::eVertexBuffer;
 		break;
 
+	case BufferType::Indirect:
+		flags |= vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer;
+		break;
+
 	case BufferType::Everything:
 		// not supposed to be called
 		assert(false);
@@ -203,6 +315,33 @@ vk::BufferUsageFlags bufferTypeUsage(BufferType type) {
 }
 
 
+// stages which read a buffer of this type
+static vk::PipelineStageFlags bufferTypeStages(BufferType type) {
+	switch (type) {
+	case BufferType::Invalid:
+		UNREACHABLE();
+		break;
+
+	case BufferType::Index:
+	case BufferType::Vertex:
+		return vk::PipelineStageFlagBits::eVertexInput;
+
+	case BufferType::Uniform:
+	case BufferType::Storage:
+		return vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+
+	case BufferType::Indirect:
+		return vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader;
+
+	case BufferType::Everything:
+		return vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+
+	}
+
+	return vk::PipelineStageFlags();
+}
+
+
 static VkBool32 VKAPI_PTR debugMessengerFunc(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT /* messageTypes */, const VkDebugUtilsMessengerCallbackDataEXT *callbackData, void * /* pUserData*/) {
 	LOG("error of severity \"%s\" %d \"%s\" \"%s\"\n", vk::to_string(vk::DebugUtilsMessageSeverityFlagBitsEXT(severity)).c_str() , callbackData->messageIdNumber, callbackData->pMessageIdName, callbackData->pMessage);
 	// TODO: log other parts of VkDebugUtilsMessengerCallbackDataEXT
@@ -233,61 +372,139 @@ static uint32_t makeVulkanVersion(const Version &v) {
 };
 
 
+// driver is allowed to reject mismatching cache data but not all of them do
+// so check the header ourselves
+static bool isPipelineCacheValid(const MappedFile &data, const vk::PhysicalDeviceProperties &props) {
+	const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	if (data.size() < headerSize) {
+		LOG("Pipeline cache too small (%u bytes)\n", static_cast<unsigned int>(data.size()));
+		return false;
+	}
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+
+	if (header[0] < headerSize) {
+		LOG("Bad pipeline cache header length %u\n", header[0]);
+		return false;
+	}
+
+	if (header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+		LOG("Bad pipeline cache header version %u\n", header[1]);
+		return false;
+	}
+
+	if (header[2] != props.vendorID || header[3] != props.deviceID) {
+		LOG("Pipeline cache vendor/device mismatch: 0x%x/0x%x, expected 0x%x/0x%x\n", header[2], header[3], props.vendorID, props.deviceID);
+		return false;
+	}
+
+	if (memcmp(data.data() + sizeof(header), props.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0) {
+		LOG("Pipeline cache UUID mismatch\n");
+		return false;
+	}
+
+	return true;
+}
+
+
 RendererImpl::RendererImpl(const RendererDesc &desc)
 : RendererBase(desc)
+, window(nullptr)
 , frameAcquired(false)
+, currentImageIdx(0)
 , physicalDeviceIndex(0)
 , graphicsQueueIndex(0)
 , transferQueueIndex(0)
+, currentPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+, currentPushConstantSize(0)
+, recordingStatic(false)
+, pendingComputeBarrier(false)
 , numUploads(0)
+, transferTimelineValue(0)
+, asyncComputeActive(false)
 , amdShaderInfo(false)
+, pipelineExecutableInfo(false)
 , debugMarkers(false)
+, debugLabels(false)
 , portabilitySubset(false)
-, ringBufferMem(nullptr)
-, persistentMapping(nullptr)
+, imageFormatList(false)
+, timestamps(false)
+, pipelineStatistics(false)
+, calibratedTimestamps(false)
+, calibratedMonotonic(false)
+, displayTiming(false)
+, incrementalPresent(false)
+, timelineSemaphores(false)
+, dynamicRendering(false)
+, extendedDynamicState(false)
+, graphicsPipelineLibrary(false)
+, directUploads(false)
+, defragmentBytesPerFrame(desc.defragmentBytesPerFrame)
+, defragmentPending(false)
+, timestampPeriod(1.0f)
+, timestampMask(0)
+, secondaryCmdBufs(desc.secondaryCommandBuffers)
+, swapchainTransform(vk::SurfaceTransformFlagBitsKHR::eIdentity)
+, destroyStop(false)
+, submitThreadActive(false)
+, submitEnqueued(0)
+, submitDequeued(0)
+, submitStop(false)
+, presentOutOfDate(false)
+, submitFailed(false)
+, dsCacheGeneration(0)
+, dsPoolSize(2 * maxDescriptorSetsPerFrame)
+, dsPeakSets(0)
+, dsPeakFrames(0)
 {
 	bool enableValidation = desc.debug;
 	bool enableMarkers    = desc.tracing;
 
 	// renderdoc crashes if SDL tries to init GL renderer so disable it
 	SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
-	SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO);
-
-	SDL_DisplayMode mode;
-	memset(&mode, 0, sizeof(mode));
-	int numDisplays = SDL_GetNumVideoDisplays();
-	LOG("Number of displays detected: %i\n", numDisplays);
-
-	for (int i = 0; i < numDisplays; i++) {
-		int retval = SDL_GetDesktopDisplayMode(i, &mode);
-		if (retval == 0) {
-			LOG("Desktop mode for display %d: %dx%d, refresh %d Hz\n", i, mode.w, mode.h, mode.refresh_rate);
-			currentRefreshRate = mode.refresh_rate;
-		} else {
-			LOG("Failed to get desktop display mode for display %d\n", i);
-		}
+	// offscreen has no window so it doesn't need a display either
+	SDL_Init(offscreen ? SDL_INIT_EVENTS : (SDL_INIT_EVENTS | SDL_INIT_VIDEO));
+
+	if (offscreen) {
+		LOG("Offscreen rendering at %ux%u\n", desc.swapchain.width, desc.swapchain.height);
+	} else {
+		SDL_DisplayMode mode;
+		memset(&mode, 0, sizeof(mode));
+		int numDisplays = SDL_GetNumVideoDisplays();
+		LOG("Number of displays detected: %i\n", numDisplays);
+
+		for (int i = 0; i < numDisplays; i++) {
+			int retval = SDL_GetDesktopDisplayMode(i, &mode);
+			if (retval == 0) {
+				LOG("Desktop mode for display %d: %dx%d, refresh %d Hz\n", i, mode.w, mode.h, mode.refresh_rate);
+				currentRefreshRate = mode.refresh_rate;
+			} else {
+				LOG("Failed to get desktop display mode for display %d\n", i);
+			}
 
-		int numModes = SDL_GetNumDisplayModes(i);
-		LOG("Number of display modes for display %i : %i\n", i, numModes);
+			int numModes = SDL_GetNumDisplayModes(i);
+			LOG("Number of display modes for display %i : %i\n", i, numModes);
 
-		for (int j = 0; j < numModes; j++) {
-			SDL_GetDisplayMode(i, j, &mode);
-			LOG("Display mode %i : width %i, height %i, BPP %i, refresh %u Hz\n", j, mode.w, mode.h, SDL_BITSPERPIXEL(mode.format), mode.refresh_rate);
-			maxRefreshRate = std::max(static_cast<unsigned int>(mode.refresh_rate), maxRefreshRate);
+			for (int j = 0; j < numModes; j++) {
+				SDL_GetDisplayMode(i, j, &mode);
+				LOG("Display mode %i : width %i, height %i, BPP %i, refresh %u Hz\n", j, mode.w, mode.h, SDL_BITSPERPIXEL(mode.format), mode.refresh_rate);
+				maxRefreshRate = std::max(static_cast<unsigned int>(mode.refresh_rate), maxRefreshRate);
+			}
 		}
-	}
 
-	int flags = SDL_WINDOW_RESIZABLE;
-	flags |= SDL_WINDOW_VULKAN;
-	if (desc.swapchain.fullscreen) {
-		flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
-	}
+		int flags = SDL_WINDOW_RESIZABLE;
+		flags |= SDL_WINDOW_VULKAN;
+		if (desc.swapchain.fullscreen) {
+			flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+		}
 
-	window = SDL_CreateWindow(desc.applicationName.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, desc.swapchain.width, desc.swapchain.height, flags);
+		window = SDL_CreateWindow(desc.applicationName.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, desc.swapchain.width, desc.swapchain.height, flags);
 
-	if (!window) {
-		LOG("SDL_CreateWindow failed: %s\n", SDL_GetError());
-		throw std::runtime_error("SDL_CreateWindow failed");
+		if (!window) {
+			LOG("SDL_CreateWindow failed: %s\n", SDL_GetError());
+			throw std::runtime_error("SDL_CreateWindow failed");
+		}
 	}
 
 	{
@@ -357,19 +574,22 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		}
 	}
 
+	// offscreen needs no surface extensions
 	unsigned int numExtensions = 0;
-	if (!SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, NULL)) {
+	if (!offscreen && !SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, NULL)) {
 		LOG("SDL_Vulkan_GetInstanceExtensions failed: %s\n", SDL_GetError());
 		throw std::runtime_error("SDL_Vulkan_GetInstanceExtensions failed");
 	}
 
 	std::vector<const char *> extensions(numExtensions, nullptr);
 
+	bool physicalDeviceProperties2 = false;
 	if (instanceExtensions.find(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) != instanceExtensions.end()) {
 		extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		physicalDeviceProperties2 = true;
 	}
 
-	if(!SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, &extensions[0])) {
+	if (!offscreen && !SDL_Vulkan_GetInstanceExtensions(window, &numExtensions, &extensions[0])) {
 		LOG("SDL_Vulkan_GetInstanceExtensions failed: %s\n", SDL_GetError());
 		throw std::runtime_error("SDL_Vulkan_GetInstanceExtensions failed");
 	}
@@ -414,13 +634,21 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		instanceCreateInfo.ppEnabledLayerNames  = &validationLayers[0];
 	}
 
+	// labels for pushDebugGroup
+	if (enableMarkers && instanceExtensions.find(VK_EXT_DEBUG_UTILS_EXTENSION_NAME) != instanceExtensions.end()) {
+		if (!newDebugExtension) {
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		}
+		debugLabels = true;
+	}
+
 	LOG("Active instance extensions:\n");
 	for (const auto ext : extensions) {
 		LOG(" %s\n", ext);
 	}
 
 	instanceCreateInfo.enabledExtensionCount    = static_cast<uint32_t>(extensions.size());
-	instanceCreateInfo.ppEnabledExtensionNames  = &extensions[0];
+	instanceCreateInfo.ppEnabledExtensionNames  = extensions.data();
 
 	instance = vk::createInstance(instanceCreateInfo);
 
@@ -430,7 +658,8 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 #else  // VK_HEADER_VERSION
 
-	auto getInstanceProc = reinterpret_cast<PFN_vkGetInstanceProcAddr>(SDL_Vulkan_GetVkGetInstanceProcAddr());
+	// SDL only loads the Vulkan library when it creates a window
+	auto getInstanceProc = offscreen ? vkGetInstanceProcAddr : reinterpret_cast<PFN_vkGetInstanceProcAddr>(SDL_Vulkan_GetVkGetInstanceProcAddr());
 	dispatcher.init(instance, getInstanceProc);
 
 #endif  // VK_HEADER_VERSION
@@ -451,7 +680,7 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		}
 	}
 
-	if(!SDL_Vulkan_CreateSurface(window,
+	if(!offscreen && !SDL_Vulkan_CreateSurface(window,
 								 (SDL_vulkanInstance) instance,
 								 (SDL_vulkanSurface *)&surface))
 	{
@@ -492,20 +721,29 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
 		LOG("  %u queue families\n", static_cast<unsigned int>(queueProps.size()));
 
-		bool canPresent = false;
-		for (uint32_t j = 0; j < queueProps.size(); j++) {
-			if (physicalDevice.getSurfaceSupportKHR(j, surface)) {
-				canPresent = true;
-				break;
+		if (!offscreen) {
+			bool canPresent = false;
+			for (uint32_t j = 0; j < queueProps.size(); j++) {
+				if (physicalDevice.getSurfaceSupportKHR(j, surface)) {
+					canPresent = true;
+					break;
+				}
 			}
+			LOG("  %s present to our surface\n", canPresent ? "can" : "can NOT");
 		}
-		LOG("  %s present to our surface\n", canPresent ? "can" : "can NOT");
 		LOG("\n");
 	}
 
 	assert(physicalDevicesProperties.size() == physicalDevices.size());
 
-	if (!desc.vulkanDeviceFilter.empty()) {
+	if (desc.vulkanDeviceIndex >= 0) {
+		if (static_cast<unsigned int>(desc.vulkanDeviceIndex) >= physicalDevices.size()) {
+			LOG("Vulkan device index %d out of range, %u devices\n", desc.vulkanDeviceIndex, static_cast<unsigned int>(physicalDevices.size()));
+			logFlush();
+			throw std::runtime_error("Vulkan device index out of range");
+		}
+		physicalDeviceIndex = static_cast<unsigned int>(desc.vulkanDeviceIndex);
+	} else if (!desc.vulkanDeviceFilter.empty()) {
 		LOG("Filtering vulkan device list for \"%s\"\n", desc.vulkanDeviceFilter.c_str());
 		bool found = false;
 		for (unsigned int i = 0; i < physicalDevicesProperties.size(); i++) {
@@ -524,9 +762,8 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	}
 
 	physicalDevice = physicalDevices.at(physicalDeviceIndex);
-	LOG("Using physical device %u \"%s\"\n", physicalDeviceIndex, deviceProperties.deviceName.data());
-
 	deviceProperties = physicalDevicesProperties.at(physicalDeviceIndex);
+	LOG("Using physical device %u \"%s\"\n", physicalDeviceIndex, deviceProperties.deviceName.data());
 
 	uboAlign  = static_cast<unsigned int>(deviceProperties.limits.minUniformBufferOffsetAlignment);
 	ssboAlign = static_cast<unsigned int>(deviceProperties.limits.minStorageBufferOffsetAlignment);
@@ -545,6 +782,31 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		LOG(" %u  size %lu  %s\n", i, static_cast<unsigned long>(memoryProperties.memoryHeaps[i].size), tempString.c_str());
 	}
 
+	// only when the largest device local heap is host visible
+	// a 256 MB BAR window is better left to the ringbuffer
+	if (desc.directUploads) {
+		uint32_t largestHeap = memoryProperties.memoryHeapCount;
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+			const auto &heap = memoryProperties.memoryHeaps[i];
+			if (!(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal)) {
+				continue;
+			}
+			if (largestHeap == memoryProperties.memoryHeapCount || heap.size > memoryProperties.memoryHeaps[largestHeap].size) {
+				largestHeap = i;
+			}
+		}
+
+		const vk::MemoryPropertyFlags wanted = vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			const auto &type = memoryProperties.memoryTypes[i];
+			if (type.heapIndex == largestHeap && (type.propertyFlags & wanted) == wanted) {
+				directUploads = true;
+				break;
+			}
+		}
+	}
+	LOG("Direct buffer uploads %s\n", directUploads ? "enabled" : "disabled");
+
 	std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
 	LOG("%u queue families\n", static_cast<unsigned int>(queueProps.size()));
 
@@ -558,7 +820,13 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		LOG("  Timestamp valid bits: %u\n", q.timestampValidBits);
 		LOG("  Image transfer granularity: (%u, %u, %u)\n", q.minImageTransferGranularity.width, q.minImageTransferGranularity.height, q.minImageTransferGranularity.depth);
 
-		if (physicalDevice.getSurfaceSupportKHR(i, surface)) {
+		// offscreen any graphics queue will do
+		if (offscreen) {
+			if ((q.queueFlags & vk::QueueFlagBits::eGraphics) && !graphicsQueueFound) {
+				graphicsQueueIndex = i;
+				graphicsQueueFound = true;
+			}
+		} else if (physicalDevice.getSurfaceSupportKHR(i, surface)) {
 			LOG("  Can present to our surface\n");
 			if (q.queueFlags & vk::QueueFlagBits::eGraphics) {
 				if (!graphicsQueueFound) {
@@ -578,12 +846,29 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 	LOG("Using queue %u for graphics\n", graphicsQueueIndex);
 
-	std::array<float, 1> queuePriorities = { { 0.0f } };
+	{
+		uint32_t validBits = queueProps.at(graphicsQueueIndex).timestampValidBits;
+		timestamps         = (validBits != 0) && (deviceProperties.limits.timestampPeriod > 0.0f);
+		timestampPeriod    = deviceProperties.limits.timestampPeriod;
+		timestampMask      = (validBits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << validBits) - 1);
+		LOG("GPU timestamps %s\n", timestamps ? "enabled" : "not supported");
+	}
+
+	std::array<float, 2> queuePriorities = { { 0.0f, 0.0f } };
+
+	// async compute uses a second queue of the graphics family
+	// so resources don't need queue family ownership transfers
+	bool asyncComputeQueue = desc.asyncCompute
+	                      && (queueProps[graphicsQueueIndex].queueFlags & vk::QueueFlagBits::eCompute)
+	                      && (queueProps[graphicsQueueIndex].queueCount >= 2);
+	if (desc.asyncCompute) {
+		LOG("Async compute %s\n", asyncComputeQueue ? "enabled" : "not supported, graphics queue family has only one queue");
+	}
 
 	std::array<vk::DeviceQueueCreateInfo, 2> queueCreateInfos;
 	unsigned int numQueues = 0;
 	queueCreateInfos[numQueues].queueFamilyIndex  = graphicsQueueIndex;
-	queueCreateInfos[numQueues].queueCount        = 1;
+	queueCreateInfos[numQueues].queueCount        = asyncComputeQueue ? 2 : 1;
 	queueCreateInfos[numQueues].pQueuePriorities  = &queuePriorities[0];
 	numQueues++;
 
@@ -643,7 +928,9 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		return false;
 	};
 
-	deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	if (!offscreen) {
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
 	bool dedicatedAllocation = true;
 	dedicatedAllocation = checkExt(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME) && dedicatedAllocation;
 	dedicatedAllocation = checkExt(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME)      && dedicatedAllocation;
@@ -651,8 +938,20 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		debugMarkers = checkExt(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
 	}
 
-	if (desc.tracing) {
-		// this disables pipeline caching on radv so only enable when tracing
+	if (desc.shaderStatistics && physicalDeviceProperties2
+	 && availableExtensions.find(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME) != availableExtensions.end())
+	{
+		auto featuresChain = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR>(dispatcher);
+		if (featuresChain.get<vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR>().pipelineExecutableInfo) {
+			pipelineExecutableInfo = checkExt(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME);
+		}
+	}
+	if (desc.shaderStatistics) {
+		LOG("Pipeline executable properties %s\n", pipelineExecutableInfo ? "enabled" : "not supported");
+	}
+
+	if (desc.tracing || (desc.shaderStatistics && !pipelineExecutableInfo)) {
+		// this disables pipeline caching on radv so only enable when asked for
 		amdShaderInfo = checkExt(VK_AMD_SHADER_INFO_EXTENSION_NAME);
 		if (amdShaderInfo) {
 			LOG("VK_AMD_shader_info found\n");
@@ -665,10 +964,222 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 	portabilitySubset = checkExt(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME);
 
-	vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDevicePortabilitySubsetFeaturesKHR> deviceCreateInfoChain;
+	// without it mutable format images may lose framebuffer compression
+	imageFormatList = checkExt(VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME);
+	LOG("Image format list %s\n", imageFormatList ? "enabled" : "not supported");
+
+	// VMA uses vkGetPhysicalDeviceMemoryProperties2KHR to query it
+	bool memoryBudget = physicalDeviceProperties2 && checkExt(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	LOG("Memory budget %s\n", memoryBudget ? "enabled" : "not supported");
+
+	displayTiming = !offscreen && checkExt(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+	LOG("Display timing %s\n", displayTiming ? "enabled" : "not supported");
+
+	incrementalPresent = !offscreen && checkExt(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+	LOG("Incremental present %s\n", incrementalPresent ? "enabled" : "not supported");
+
+	// places GPU timers on the CPU timeline in profiler traces
+	if (timestamps
+	 && availableExtensions.find(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) != availableExtensions.end())
+	{
+		bool deviceDomain = false;
+		for (auto domain : physicalDevice.getCalibrateableTimeDomainsEXT(dispatcher)) {
+			if (domain == vk::TimeDomainEXT::eDevice) {
+				deviceDomain = true;
+			}
+#ifdef __linux__
+			// steady_clock
+			if (domain == vk::TimeDomainEXT::eClockMonotonic) {
+				calibratedMonotonic = true;
+			}
+#endif  // __linux__
+		}
+
+		if (deviceDomain) {
+			calibratedTimestamps = checkExt(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+		}
+	}
+	LOG("Calibrated timestamps %s\n", calibratedTimestamps ? (calibratedMonotonic ? "enabled" : "enabled without host clock") : "not supported");
+
+	vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDevicePortabilitySubsetFeaturesKHR, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT, vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR, vk::PhysicalDeviceDynamicRenderingFeaturesKHR, vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT, vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT, vk::PhysicalDeviceMultiviewFeaturesKHR, vk::PhysicalDevicePerformanceQueryFeaturesKHR, vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR> deviceCreateInfoChain;
 	if (!portabilitySubset) {
 		deviceCreateInfoChain.unlink<vk::PhysicalDevicePortabilitySubsetFeaturesKHR>();
 	}
+	if (pipelineExecutableInfo) {
+		deviceCreateInfoChain.get<vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR>().pipelineExecutableInfo = true;
+	} else {
+		deviceCreateInfoChain.unlink<vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR>();
+	}
+
+	// texture table needs a runtime array of sampled images
+	// which can be updated while other parts of it are in use
+	if (physicalDeviceProperties2
+	 && availableExtensions.find(VK_KHR_MAINTENANCE3_EXTENSION_NAME) != availableExtensions.end()
+	 && availableExtensions.find(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) != availableExtensions.end())
+	{
+		auto featuresChain   = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>(dispatcher);
+		const auto &indexing = featuresChain.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+
+		auto propertiesChain = physicalDevice.getProperties2KHR<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>(dispatcher);
+		const auto &limits   = propertiesChain.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+
+		if (indexing.runtimeDescriptorArray
+		 && indexing.descriptorBindingPartiallyBound
+		 && indexing.descriptorBindingSampledImageUpdateAfterBind
+		 && indexing.descriptorBindingUpdateUnusedWhilePending
+		 && limits.maxDescriptorSetUpdateAfterBindSampledImages         >= MAX_TEXTURE_TABLE_SIZE
+		 && limits.maxPerStageDescriptorUpdateAfterBindSampledImages    >= MAX_TEXTURE_TABLE_SIZE)
+		{
+			checkExt(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+			checkExt(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+			auto &enabledIndexing = deviceCreateInfoChain.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+			enabledIndexing.runtimeDescriptorArray                        = true;
+			enabledIndexing.descriptorBindingPartiallyBound               = true;
+			enabledIndexing.descriptorBindingSampledImageUpdateAfterBind  = true;
+			enabledIndexing.descriptorBindingUpdateUnusedWhilePending     = true;
+			features.textureTable = true;
+		}
+	}
+	if (!features.textureTable) {
+		deviceCreateInfoChain.unlink<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+	}
+	LOG("Texture table %s\n", features.textureTable ? "supported" : "not supported");
+
+	// one counter per queue instead of a fence per frame and a semaphore per upload
+	if (physicalDeviceProperties2
+	 && availableExtensions.find(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) != availableExtensions.end())
+	{
+		auto featuresChain = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR>(dispatcher);
+		if (featuresChain.get<vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR>().timelineSemaphore) {
+			checkExt(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+			deviceCreateInfoChain.get<vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR>().timelineSemaphore = true;
+			timelineSemaphores = true;
+		}
+	}
+	if (!timelineSemaphores) {
+		deviceCreateInfoChain.unlink<vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR>();
+	}
+	LOG("Timeline semaphores %s\n", timelineSemaphores ? "enabled" : "not supported");
+
+	// draws broadcast to several layers of array rendertargets
+	bool multiview = false;
+	if (physicalDeviceProperties2
+	 && availableExtensions.find(VK_KHR_MULTIVIEW_EXTENSION_NAME) != availableExtensions.end())
+	{
+		auto featuresChain = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceMultiviewFeaturesKHR>(dispatcher);
+		if (featuresChain.get<vk::PhysicalDeviceMultiviewFeaturesKHR>().multiview) {
+			checkExt(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+			deviceCreateInfoChain.get<vk::PhysicalDeviceMultiviewFeaturesKHR>().multiview = true;
+
+			auto propertiesChain = physicalDevice.getProperties2KHR<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceMultiviewPropertiesKHR>(dispatcher);
+			features.maxMultiviewViews = propertiesChain.get<vk::PhysicalDeviceMultiviewPropertiesKHR>().maxMultiviewViewCount;
+			multiview = true;
+		}
+	}
+	if (!multiview) {
+		deviceCreateInfoChain.unlink<vk::PhysicalDeviceMultiviewFeaturesKHR>();
+	}
+	LOG("Multiview %s, max %u views\n", multiview ? "enabled" : "not supported", features.maxMultiviewViews);
+
+	// render passes without vk::RenderPass and vk::Framebuffer objects
+	// the extension and its dependencies are core in 1.3 but we only ask for 1.0
+	if (desc.dynamicRendering
+	 && physicalDeviceProperties2
+	 && availableExtensions.find(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)     != availableExtensions.end()
+	 && availableExtensions.find(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) != availableExtensions.end()
+	 && availableExtensions.find(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME)   != availableExtensions.end()
+	 && availableExtensions.find(VK_KHR_MULTIVIEW_EXTENSION_NAME)             != availableExtensions.end()
+	 && availableExtensions.find(VK_KHR_MAINTENANCE2_EXTENSION_NAME)          != availableExtensions.end())
+	{
+		auto featuresChain = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDynamicRenderingFeaturesKHR>(dispatcher);
+		if (featuresChain.get<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>().dynamicRendering) {
+			if (!multiview) {
+				checkExt(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+			}
+			checkExt(VK_KHR_MAINTENANCE2_EXTENSION_NAME);
+			checkExt(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+			checkExt(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+			checkExt(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+			deviceCreateInfoChain.get<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>().dynamicRendering = true;
+			dynamicRendering = true;
+		}
+	}
+	if (!dynamicRendering) {
+		deviceCreateInfoChain.unlink<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>();
+	}
+	LOG("Dynamic rendering %s\n", dynamicRendering ? "enabled" : (desc.dynamicRendering ? "not supported" : "disabled"));
+
+	// depth, stencil and cull state in the command buffer instead of the pipeline
+	// so pipelines which only differ in them can share one
+	if (physicalDeviceProperties2
+	 && availableExtensions.find(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) != availableExtensions.end())
+	{
+		auto featuresChain = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>(dispatcher);
+		if (featuresChain.get<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>().extendedDynamicState) {
+			checkExt(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+			deviceCreateInfoChain.get<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>().extendedDynamicState = true;
+			extendedDynamicState = true;
+		}
+	}
+	if (!extendedDynamicState) {
+		deviceCreateInfoChain.unlink<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>();
+	}
+	LOG("Extended dynamic state %s\n", extendedDynamicState ? "enabled" : "not supported");
+
+	// pipelines are fast linked from separately compiled parts
+	// without dynamic rendering every part would depend on the vk::RenderPass
+	if (dynamicRendering
+	 && availableExtensions.find(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)         != availableExtensions.end()
+	 && availableExtensions.find(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) != availableExtensions.end())
+	{
+		auto featuresChain   = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>(dispatcher);
+		auto propertiesChain = physicalDevice.getProperties2KHR<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>(dispatcher);
+		if (featuresChain.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary
+		 && propertiesChain.get<vk::PhysicalDeviceGraphicsPipelineLibraryPropertiesEXT>().graphicsPipelineLibraryFastLinking)
+		{
+			checkExt(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+			checkExt(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+			deviceCreateInfoChain.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary = true;
+			graphicsPipelineLibrary = true;
+		}
+	}
+	if (!graphicsPipelineLibrary) {
+		deviceCreateInfoChain.unlink<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+	}
+	LOG("Graphics pipeline library %s\n", graphicsPipelineLibrary ? "enabled" : "not supported");
+
+	// only queried, RelaxedPrecision doesn't need the extension or the feature enabled
+	if (physicalDeviceProperties2
+	 && availableExtensions.find(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME) != availableExtensions.end())
+	{
+		auto featuresChain = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR>(dispatcher);
+		features.halfPrecision = featuresChain.get<vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR>().shaderFloat16;
+	}
+	LOG("Half precision arithmetic %s\n", features.halfPrecision ? "supported" : "not supported");
+
+	// counters are sampled inside GPU timers so they need timestamps too
+	// the queries can't be inherited by secondary command buffers
+	if (!desc.performanceCounters.empty()) {
+		if (timestamps && !secondaryCmdBufs && physicalDeviceProperties2
+		 && availableExtensions.find(VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME) != availableExtensions.end())
+		{
+			auto featuresChain = physicalDevice.getFeatures2KHR<vk::PhysicalDeviceFeatures2, vk::PhysicalDevicePerformanceQueryFeaturesKHR>(dispatcher);
+			if (featuresChain.get<vk::PhysicalDevicePerformanceQueryFeaturesKHR>().performanceCounterQueryPools) {
+				selectPerformanceCounters(desc.performanceCounters);
+			}
+		}
+
+		if (!performanceCounterIndices.empty()) {
+			checkExt(VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME);
+			deviceCreateInfoChain.get<vk::PhysicalDevicePerformanceQueryFeaturesKHR>().performanceCounterQueryPools = true;
+		}
+		LOG("Performance counters %s\n", performanceCounterIndices.empty() ? "not supported" : "enabled");
+	}
+	if (performanceCounterIndices.empty()) {
+		deviceCreateInfoChain.unlink<vk::PhysicalDevicePerformanceQueryFeaturesKHR>();
+	}
+
 	auto &deviceCreateInfo = deviceCreateInfoChain.get<vk::DeviceCreateInfo>();
 
 	assert(numQueues <= queueCreateInfos.size());
@@ -676,6 +1187,20 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	deviceCreateInfo.pQueueCreateInfos        = queueCreateInfos.data();
 
 	vk::PhysicalDeviceFeatures enabledFeatures;
+	if (deviceFeatures.multiDrawIndirect) {
+		enabledFeatures.multiDrawIndirect = true;
+		features.multiDrawIndirect        = true;
+	}
+	LOG("Multi-draw indirect %s\n", features.multiDrawIndirect ? "supported" : "not supported");
+
+	// SPV_KHR_shader_ballot works with Vulkan 1.0 and SPIR-V 1.0, unlike the KHR subgroup ops
+	// its ballots are 64 bits so they need Int64 too
+	if (deviceFeatures.shaderInt64 && checkExt(VK_EXT_SHADER_SUBGROUP_BALLOT_EXTENSION_NAME)) {
+		enabledFeatures.shaderInt64 = true;
+		features.subgroupBallot     = true;
+	}
+	LOG("Subgroup ballot %s\n", features.subgroupBallot ? "supported" : "not supported");
+
 	if (desc.robustness) {
 		LOG("Robust buffer access requested\n");
 		if (deviceFeatures.robustBufferAccess) {
@@ -685,6 +1210,29 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 			LOG(" not supported\n");
 		}
 	}
+
+	// compressed texture formats are only reported as supported when their feature is enabled
+	enabledFeatures.textureCompressionBC       = deviceFeatures.textureCompressionBC;
+	enabledFeatures.textureCompressionETC2     = deviceFeatures.textureCompressionETC2;
+	enabledFeatures.textureCompressionASTC_LDR = deviceFeatures.textureCompressionASTC_LDR;
+	LOG("Texture compression:%s%s%s\n"
+	   , deviceFeatures.textureCompressionBC       ? " BC"   : ""
+	   , deviceFeatures.textureCompressionETC2     ? " ETC2" : ""
+	   , deviceFeatures.textureCompressionASTC_LDR ? " ASTC" : "");
+
+	// queries active across vkCmdExecuteCommands need inheritedQueries
+	if (desc.pipelineStatistics) {
+		if (timestamps && deviceFeatures.pipelineStatisticsQuery && (!secondaryCmdBufs || deviceFeatures.inheritedQueries)) {
+			enabledFeatures.pipelineStatisticsQuery = true;
+			enabledFeatures.inheritedQueries        = deviceFeatures.inheritedQueries;
+			pipelineStatistics                      = true;
+		}
+		LOG("Pipeline statistics %s\n", pipelineStatistics ? "enabled" : "not supported");
+	}
+
+	// replaying static contents is vkCmdExecuteCommands too
+	features.staticRenderPasses = performanceCounterIndices.empty() && (!pipelineStatistics || enabledFeatures.inheritedQueries);
+
 	deviceCreateInfo.pEnabledFeatures         = &enabledFeatures;
 
 	deviceCreateInfo.enabledExtensionCount    = static_cast<uint32_t>(deviceExtensions.size());
@@ -706,6 +1254,19 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 
 #endif  // VK_HEADER_VERSION
 
+	// performance queries can only be recorded while holding the lock
+	if (!performanceCounterIndices.empty()) {
+		vk::AcquireProfilingLockInfoKHR lockInfo;
+		lockInfo.timeout = UINT64_MAX;
+		vk::Result result = device.acquireProfilingLockKHR(&lockInfo, dispatcher);
+		if (result != vk::Result::eSuccess) {
+			LOG("Failed to acquire profiling lock: %s\n", vk::to_string(result).c_str());
+			performanceCounterIndices.clear();
+			performanceCounterStorage.clear();
+			performanceCounterNames.clear();
+		}
+	}
+
 	VmaAllocatorCreateInfo allocatorInfo = {};
 	allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_0;
 	allocatorInfo.physicalDevice   = physicalDevice;
@@ -713,15 +1274,25 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 	allocatorInfo.instance         = instance;
 	if (dedicatedAllocation) {
 		LOG("Dedicated allocations enabled\n");
-		allocatorInfo.flags      = VMA_ALLOCATOR_CREATE_KHR_DEDICATED_ALLOCATION_BIT;
+		allocatorInfo.flags     |= VMA_ALLOCATOR_CREATE_KHR_DEDICATED_ALLOCATION_BIT;
+	}
+	if (memoryBudget) {
+		allocatorInfo.flags     |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
 	}
 
 	vmaCreateAllocator(&allocatorInfo, &allocator);
+	for (auto &bytes : memoryKindBytes) {
+		bytes.store(0);
+	}
 
 	queue = device.getQueue(graphicsQueueIndex, 0);
 	transferQueue = device.getQueue(transferQueueIndex, 0);
+	if (asyncComputeQueue) {
+		computeQueue           = device.getQueue(graphicsQueueIndex, 1);
+		features.asyncCompute  = true;
+	}
 
-	{
+	if (!offscreen) {
 		auto surfacePresentModes_ = physicalDevice.getSurfacePresentModesKHR(surface);
 		surfacePresentModes.reserve(surfacePresentModes_.size());
 		LOG("%u present modes\n",   static_cast<uint32_t>(surfacePresentModes_.size()));
@@ -732,7 +1303,7 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		}
 	}
 
-	{
+	if (!offscreen) {
 		auto surfaceFormats_ = physicalDevice.getSurfaceFormatsKHR(surface);
 
 		LOG("%u surface formats\n", static_cast<uint32_t>(surfaceFormats_.size()));
@@ -761,163 +1332,669 @@ RendererImpl::RendererImpl(const RendererDesc &desc)
 		}
 	}
 	features.SSBOSupported  = true;
+	// other threads record into their own command pools
+	features.threadedResourceCreation = true;
+	// draw list chunks are executed from the primary between the pass's own secondaries
+	features.parallelRecording = secondaryCmdBufs && (jobSystem->numThreads() > 0);
+	// we only use the graphics queue so it must also do compute
+	features.computeShaders = static_cast<bool>(queueProps[graphicsQueueIndex].queueFlags & vk::QueueFlagBits::eCompute);
+
+	if (features.textureTable) {
+		vk::DescriptorSetLayoutBinding binding;
+		binding.binding         = 0;
+		binding.descriptorType  = vk::DescriptorType::eSampledImage;
+		binding.descriptorCount = MAX_TEXTURE_TABLE_SIZE;
+		binding.stageFlags      = vk::ShaderStageFlagBits::eAll;
+
+		// entries of deleted or not yet created textures stay stale
+		// shaders must only index live textures
+		vk::DescriptorBindingFlagsEXT bindingFlags = vk::DescriptorBindingFlagBitsEXT::ePartiallyBound
+		                                           | vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind
+		                                           | vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+
+		vk::StructureChain<vk::DescriptorSetLayoutCreateInfo, vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT> layoutInfoChain;
+		auto &layoutInfo         = layoutInfoChain.get<vk::DescriptorSetLayoutCreateInfo>();
+		layoutInfo.flags         = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT;
+		layoutInfo.bindingCount  = 1;
+		layoutInfo.pBindings     = &binding;
+		auto &flagsInfo          = layoutInfoChain.get<vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT>();
+		flagsInfo.bindingCount   = 1;
+		flagsInfo.pBindingFlags  = &bindingFlags;
+		textureTableLayout       = device.createDescriptorSetLayout(layoutInfo);
+
+		vk::DescriptorPoolSize poolSize;
+		poolSize.type            = vk::DescriptorType::eSampledImage;
+		poolSize.descriptorCount = MAX_TEXTURE_TABLE_SIZE;
+
+		vk::DescriptorPoolCreateInfo poolInfo;
+		poolInfo.flags           = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT;
+		poolInfo.maxSets         = 1;
+		poolInfo.poolSizeCount   = 1;
+		poolInfo.pPoolSizes      = &poolSize;
+		textureTablePool         = device.createDescriptorPool(poolInfo);
+
+		vk::DescriptorSetAllocateInfo dsInfo;
+		dsInfo.descriptorPool     = textureTablePool;
+		dsInfo.descriptorSetCount = 1;
+		dsInfo.pSetLayouts        = &textureTableLayout;
+		textureTable              = device.allocateDescriptorSets(dsInfo)[0];
+
+		// lowest indices are handed out first
+		freeTextureTableIndices.reserve(MAX_TEXTURE_TABLE_SIZE);
+		for (unsigned int i = MAX_TEXTURE_TABLE_SIZE; i > 0; i--) {
+			freeTextureTableIndices.push_back(i - 1);
+		}
+	}
 
 	if (!recreateSwapchain()) {
 		LOG("initial swapchain create failed\n");
 		throw std::runtime_error("initial swapchain create failed");
 	}
-	recreateRingBuffer(desc.ephemeralRingBufSize);
 
+	// command buffers are recycled instead of freed
 	vk::CommandPoolCreateInfo cp;
+	cp.flags            = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
 	cp.queueFamilyIndex = transferQueueIndex;
 	transferCmdPool = device.createCommandPool(cp);
 
+	cp.queueFamilyIndex = graphicsQueueIndex;
+	staticCmdPool   = device.createCommandPool(cp);
+
+	if (timelineSemaphores) {
+		vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfoKHR> semInfo;
+		semInfo.get<vk::SemaphoreTypeCreateInfoKHR>().semaphoreType = vk::SemaphoreTypeKHR::eTimeline;
+		semInfo.get<vk::SemaphoreTypeCreateInfoKHR>().initialValue  = 0;
+		graphicsTimeline = device.createSemaphore(semInfo.get<vk::SemaphoreCreateInfo>());
+		transferTimeline = device.createSemaphore(semInfo.get<vk::SemaphoreCreateInfo>());
+	}
+
 	vk::PipelineCacheCreateInfo cacheInfo;
-	std::vector<char> cacheData;
+	MappedFile cacheData;
 	std::string plCacheFile =  spirvCacheDir + "pipeline.cache";
 	if (!desc.skipShaderCache && fileExists(plCacheFile)) {
-		cacheData                 = readFile(plCacheFile);
-		cacheInfo.initialDataSize = cacheData.size();
-		cacheInfo.pInitialData    = cacheData.data();
+		cacheData                 = MappedFile(plCacheFile);
+		if (isPipelineCacheValid(cacheData, deviceProperties)) {
+			LOG("Loaded pipeline cache (%u bytes)\n", static_cast<unsigned int>(cacheData.size()));
+			cacheInfo.initialDataSize = cacheData.size();
+			cacheInfo.pInitialData    = cacheData.data();
+		} else {
+			LOG("Discarding stale pipeline cache \"%s\"\n", plCacheFile.c_str());
+		}
 	}
 
 	pipelineCache = device.createPipelineCache(cacheInfo);
-}
-
-
-void RendererImpl::recreateRingBuffer(unsigned int newSize) {
-	assert(newSize > 0);
-
-	// if buffer already exists, free it after it's no longer in use
-	if (ringBuffer) {
-		assert(ringBufSize       != 0);
-		assert(persistentMapping != nullptr);
-
-		// create a Buffer object which we can put into deleteResources
-		Buffer buffer;
-		buffer.buffer          = ringBuffer;
-		ringBuffer             = vk::Buffer();
-
-		buffer.ringBufferAlloc = false;
 
-		buffer.memory          = ringBufferMem;
-		ringBufferMem          = VK_NULL_HANDLE;
-		persistentMapping      = nullptr;
+	// last so a throwing constructor doesn't leave them running
+	destroyThread = std::thread(&RendererImpl::destroyThreadFunc, this);
 
-		buffer.size            = ringBufSize;
-		ringBufSize            = 0;
-
-		buffer.type            = BufferType::Everything;
-
-		buffer.offset          = ringBufPtr;
-		ringBufPtr             = 0;
+	if (desc.submitThread) {
+		LOG("Submitting and presenting frames on a separate thread\n");
+		submitThreadActive = true;
+		submitThread       = std::thread(&RendererImpl::submitThreadFunc, this);
+	}
+}
 
-		buffer.lastUsedFrame   = frameNum;
 
-		deleteResources.emplace_back(std::move(buffer));
-	}
+void RendererImpl::createRingPage(unsigned int idx, unsigned int size) {
+	assert(size > 0);
 
-	assert(!ringBuffer);
-	assert(ringBufSize       == 0);
-	assert(ringBufPtr        == 0);
-	assert(persistentMapping == nullptr);
-	ringBufSize = newSize;
+	auto &page = ringPages.at(idx);
+	assert(page.size == 0);
+	assert(!page.buffer);
+	assert(page.memory == nullptr);
 
-	// create ringbuffer
 	vk::BufferCreateInfo rbInfo;
-	rbInfo.size  = newSize;
+	rbInfo.size  = size;
 	rbInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferSrc;
-	ringBuffer   = device.createBuffer(rbInfo);
-
-	assert(ringBufferMem == nullptr);
+	page.buffer  = device.createBuffer(rbInfo);
 
 	VmaAllocationCreateInfo req = {};
-	req.flags          = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
+	req.flags          = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
 	req.usage          = VMA_MEMORY_USAGE_CPU_TO_GPU;
-	req.pUserData      = const_cast<char *>("Ringbuffer");
+	req.pUserData      = const_cast<char *>("Ringbuffer page");
 
 	VmaAllocationInfo  allocationInfo = {};
-	auto result = vmaAllocateMemoryForBuffer(allocator, ringBuffer, &req, &ringBufferMem, &allocationInfo);
+	auto result = vmaAllocateMemoryForBuffer(allocator, page.buffer, &req, &page.memory, &allocationInfo);
 
 	if (result != VK_SUCCESS) {
 		LOG("vmaAllocateMemoryForBuffer failed: %s\n", vk::to_string(vk::Result(result)).c_str());
 		throw std::runtime_error("vmaAllocateMemoryForBuffer failed");
 	}
 
-	LOG("ringbuffer memory type: %u\n",    allocationInfo.memoryType);
-	LOG("ringbuffer memory offset: %u\n",  static_cast<unsigned int>(allocationInfo.offset));
-	LOG("ringbuffer memory size: %u\n",    static_cast<unsigned int>(allocationInfo.size));
-	assert(ringBufferMem != nullptr);
-	assert(allocationInfo.offset == 0);
+	assert(page.memory != nullptr);
 	assert(allocationInfo.pMappedData != nullptr);
+	countMemory(MemoryKind::RingBuffer, page.memory, true);
 
-	device.bindBufferMemory(ringBuffer, allocationInfo.deviceMemory, allocationInfo.offset);
+	device.bindBufferMemory(page.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
 
-	persistentMapping = reinterpret_cast<char *>(allocationInfo.pMappedData);
-	assert(persistentMapping != nullptr);
+	page.mapping = reinterpret_cast<char *>(allocationInfo.pMappedData);
+	page.size    = size;
 }
 
 
-RendererImpl::~RendererImpl() {
-	assert(instance);
-	assert(device);
-	assert(surface);
-	assert(swapchain);
-	assert(ringBuffer);
-	assert(persistentMapping);
-	assert(transferCmdPool);
-	assert(pipelineCache);
+void RendererImpl::destroyRingPage(unsigned int idx) {
+	auto &page = ringPages.at(idx);
+	assert(page.size != 0);
+	assert(page.buffer);
+	assert(page.memory != nullptr);
+	assert(page.users == 0);
 
-	if (frameAcquired) {
-		LOG("warning: acquired but not presented frame while shutting down\n");
-		assert(frameAcquireSem);
-		freeSemaphore(frameAcquireSem);
-		frameAcquireSem = vk::Semaphore();
-	} else {
-		assert(!frameAcquireSem);
-	}
+	// only called once all frames using the page have retired
+	device.destroyBuffer(page.buffer);
+	countMemory(MemoryKind::RingBuffer, page.memory, false);
+	vmaFreeMemory(allocator, page.memory);
 
-	// save pipeline cache
-	auto cacheData = device.getPipelineCacheData(pipelineCache);
-	writeFile(spirvCacheDir + "pipeline.cache", cacheData.data(), cacheData.size());
-	device.destroyPipelineCache(pipelineCache);
-	pipelineCache = vk::PipelineCache();
+	page.buffer  = vk::Buffer();
+	page.memory  = VK_NULL_HANDLE;
+	page.mapping = nullptr;
+	page.size    = 0;
 
-	while (!waitForDeviceIdle()) {
-		// run event loop to avoid hangs
-		SDL_PumpEvents();
-		// TODO: wait?
-	}
+	// a new page could get the same vk::Buffer so cached descriptor sets can't be trusted
+	dsCacheGeneration++;
+}
 
-	for (unsigned int i = 0; i < frames.size(); i++) {
-		auto &f = frames.at(i);
-		assert(f.status == Frame::Status::Ready);
-		deleteFrameInternal(f);
-	}
-	frames.clear();
 
-	// must have been deleted by waitForDeviceIdle
-	assert(deleteResources.empty());
+void RendererImpl::arenaAllocate(uint32_t size, uint32_t alignment, uint32_t &arena, uint32_t &offset) {
+	assert(size > 0);
+	assert(size <= bufferArenaSize);
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
 
-	vmaFreeMemory(allocator, ringBufferMem);
-	ringBufferMem = nullptr;
-	persistentMapping = nullptr;
-	device.destroyBuffer(ringBuffer);
-	ringBuffer = vk::Buffer();
+	// first fit, arenas in order
+	unsigned int emptySlot = bufferArenas.size();
+	for (unsigned int i = 0; i < bufferArenas.size(); i++) {
+		auto &a = bufferArenas[i];
+		if (!a.buffer) {
+			emptySlot = std::min(emptySlot, i);
+			continue;
+		}
 
-	buffers.clearWith([this](Buffer &b) {
-		deleteBufferInternal(b);
-	} );
+		for (unsigned int r = 0; r < a.freeRanges.size(); r++) {
+			uint32_t rangeBegin = a.freeRanges[r].first;
+			uint32_t rangeEnd   = rangeBegin + a.freeRanges[r].second;
+			uint32_t begin      = (rangeBegin + alignment - 1) & ~(alignment - 1);
+			if (begin + size > rangeEnd) {
+				continue;
+			}
 
-	samplers.clearWith([this](Sampler &s) {
-		deleteSamplerInternal(s);
-	} );
+			// keep what's left on either side
+			a.freeRanges.erase(a.freeRanges.begin() + r);
+			if (begin + size < rangeEnd) {
+				a.freeRanges.emplace(a.freeRanges.begin() + r, begin + size, rangeEnd - begin - size);
+			}
+			if (rangeBegin < begin) {
+				a.freeRanges.emplace(a.freeRanges.begin() + r, rangeBegin, begin - rangeBegin);
+			}
 
-	pipelines.clearWith([this](Pipeline &p) {
-		deletePipelineInternal(p);
-	} );
+			a.used += size;
+			a.numBuffers++;
+			arena  = i;
+			offset = begin;
+			return;
+		}
+	}
 
-	framebuffers.clearWith([this](Framebuffer &fb) {
+	if (emptySlot == bufferArenas.size()) {
+		bufferArenas.emplace_back();
+	}
+	createBufferArena(emptySlot);
+
+	auto &a = bufferArenas[emptySlot];
+	assert(a.freeRanges.size() == 1);
+	assert(a.freeRanges[0].first == 0);
+	a.freeRanges[0].first  = size;
+	a.freeRanges[0].second = a.size - size;
+	a.used       = size;
+	a.numBuffers = 1;
+	arena  = emptySlot;
+	offset = 0;
+}
+
+
+void RendererImpl::arenaFree(uint32_t arena, uint32_t offset, uint32_t size) {
+	auto &a = bufferArenas.at(arena);
+	assert(a.buffer);
+	assert(a.numBuffers > 0);
+	assert(a.used >= size);
+	assert(offset + size <= a.size);
+
+	a.used -= size;
+	a.numBuffers--;
+	if (a.numBuffers == 0) {
+		// alignment padding is the only thing left
+		destroyBufferArena(arena);
+		return;
+	}
+
+	auto it = std::lower_bound(a.freeRanges.begin(), a.freeRanges.end(), std::make_pair(offset, size));
+	assert(it == a.freeRanges.end() || offset + size <= it->first);
+	it = a.freeRanges.emplace(it, offset, size);
+
+	// merge with the following range
+	auto next = it + 1;
+	if (next != a.freeRanges.end() && it->first + it->second == next->first) {
+		it->second += next->second;
+		it = a.freeRanges.erase(next) - 1;
+	}
+
+	// and the preceding one
+	if (it != a.freeRanges.begin()) {
+		auto prev = it - 1;
+		assert(prev->first + prev->second <= it->first);
+		if (prev->first + prev->second == it->first) {
+			prev->second += it->second;
+			a.freeRanges.erase(it);
+		}
+	}
+}
+
+
+void RendererImpl::createBufferArena(unsigned int idx) {
+	auto &a = bufferArenas.at(idx);
+	assert(!a.buffer);
+	assert(a.memory == nullptr);
+	assert(a.numBuffers == 0);
+
+	uint32_t families[2] = { graphicsQueueIndex, transferQueueIndex };
+
+	vk::BufferCreateInfo info;
+	info.size  = bufferArenaSize;
+	info.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst;
+	if (graphicsQueueIndex != transferQueueIndex) {
+		// many buffers share this so queue ownership can't be transferred per buffer
+		info.sharingMode           = vk::SharingMode::eConcurrent;
+		info.queueFamilyIndexCount = 2;
+		info.pQueueFamilyIndices   = families;
+	}
+	a.buffer   = device.createBuffer(info);
+
+	VmaAllocationCreateInfo req = {};
+	req.flags          = VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
+	req.usage          = VMA_MEMORY_USAGE_GPU_ONLY;
+	req.pUserData      = const_cast<char *>("Buffer arena");
+
+	VmaAllocationInfo  allocationInfo = {};
+	VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+	if (directUploads) {
+		VmaAllocationCreateInfo directReq = req;
+		directReq.flags        |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		directReq.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		result = vmaAllocateMemoryForBuffer(allocator, a.buffer, &directReq, &a.memory, &allocationInfo);
+	}
+	if (result != VK_SUCCESS) {
+		result = vmaAllocateMemoryForBuffer(allocator, a.buffer, &req, &a.memory, &allocationInfo);
+	}
+	if (result != VK_SUCCESS) {
+		LOG("vmaAllocateMemoryForBuffer failed: %s\n", vk::to_string(vk::Result(result)).c_str());
+		throw std::runtime_error("vmaAllocateMemoryForBuffer failed");
+	}
+
+	assert(a.memory != nullptr);
+	countMemory(MemoryKind::Buffer, a.memory, true);
+
+	device.bindBufferMemory(a.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
+	debugNameObject<vk::Buffer>(a.buffer, "buffer arena " + std::to_string(idx));
+
+	a.mapping = reinterpret_cast<char *>(allocationInfo.pMappedData);
+	a.size    = bufferArenaSize;
+	a.used    = 0;
+	a.freeRanges.clear();
+	a.freeRanges.emplace_back(0, bufferArenaSize);
+}
+
+
+void RendererImpl::destroyBufferArena(unsigned int idx) {
+	auto &a = bufferArenas.at(idx);
+	assert(a.buffer);
+	assert(a.memory != nullptr);
+	assert(a.numBuffers == 0);
+	assert(a.used == 0);
+
+	// the last buffer was only deleted once nothing in flight used it
+	device.destroyBuffer(a.buffer);
+	countMemory(MemoryKind::Buffer, a.memory, false);
+	vmaFreeMemory(allocator, a.memory);
+	defragmentPending = true;
+
+	a.buffer  = vk::Buffer();
+	a.memory  = VK_NULL_HANDLE;
+	a.mapping = nullptr;
+	a.size    = 0;
+	a.freeRanges.clear();
+
+	// a new arena could get the same vk::Buffer so cached descriptor sets can't be trusted
+	dsCacheGeneration++;
+}
+
+
+void RendererImpl::countMemory(MemoryKind kind, VmaAllocation memory, bool allocated) {
+	VmaAllocationInfo info = {};
+	vmaGetAllocationInfo(allocator, memory, &info);
+
+	auto &bytes = memoryKindBytes[kind._to_index()];
+	if (allocated) {
+		bytes.fetch_add(info.size, std::memory_order_relaxed);
+	} else {
+		assert(bytes.load(std::memory_order_relaxed) >= info.size);
+		bytes.fetch_sub(info.size, std::memory_order_relaxed);
+	}
+}
+
+
+void RendererImpl::defragmentMemory() {
+	assert(defragmentBytesPerFrame > 0);
+	assert(defragmentPending);
+
+	// only buffers, VMA can't move images with optimal tiling
+	// rendertargets have dedicated allocations and don't fragment anything anyway
+	// arenas aren't tracked per frame so they stay put
+	// buffers which haven't been used yet might have an upload pending
+	// or still be filled in by another thread, so check used first
+	std::vector<Buffer *>       moveable;
+	std::vector<VmaAllocation>  allocations;
+	buffers.forEach([&] (Buffer &b) {
+		if (b.used && b.arena == noBufferArena && b.lastUsedFrame < lastSyncedFrame) {
+			moveable.push_back(&b);
+			allocations.push_back(b.memory);
+		}
+	} );
+
+	if (allocations.empty()) {
+		defragmentPending = false;
+		return;
+	}
+
+	std::vector<VkBool32> changed(allocations.size(), VK_FALSE);
+
+	vk::CommandBuffer cmdBuf = allocateTransferCmdBuf();
+
+	// GPU copies only, CPU ones would stall on mapping device memory
+	VmaDefragmentationInfo2 info = {};
+	info.allocationCount         = static_cast<uint32_t>(allocations.size());
+	info.pAllocations            = allocations.data();
+	info.pAllocationsChanged     = changed.data();
+	info.maxCpuBytesToMove       = 0;
+	info.maxCpuAllocationsToMove = 0;
+	info.maxGpuBytesToMove       = defragmentBytesPerFrame;
+	info.maxGpuAllocationsToMove = UINT32_MAX;
+	info.commandBuffer           = cmdBuf;
+
+	VmaDefragmentationStats    stats   = {};
+	VmaDefragmentationContext  context = VK_NULL_HANDLE;
+	VkResult result = vmaDefragmentationBegin(allocator, &info, &stats, &context);
+	cmdBuf.end();
+
+	if (result == VK_NOT_READY) {
+		vk::SubmitInfo submit;
+		submit.commandBufferCount = 1;
+		submit.pCommandBuffers    = &cmdBuf;
+
+		// at most defragmentBytesPerFrame of copies so this doesn't take long
+		// waited on right away so it can't go through the submit thread
+		if (transferQueue == queue) {
+			waitSubmitThread();
+		}
+		vk::Fence fence = allocateFence();
+		transferQueue.submit({ submit }, fence);
+		vk::Result waitResult = device.waitForFences({ fence }, true, UINT64_MAX);
+		freeFence(fence);
+		if (waitResult != vk::Result::eSuccess) {
+			LOG("wait for defragmentation failed: %s\n", vk::to_string(waitResult).c_str());
+			logFlush();
+			throw std::runtime_error("wait for defragmentation failed");
+		}
+
+		result = vmaDefragmentationEnd(allocator, context);
+	}
+	freeTransferCmdBuf(cmdBuf);
+
+	if (result != VK_SUCCESS) {
+		LOG("defragmentation failed: %s\n", vk::to_string(vk::Result(result)).c_str());
+		defragmentPending = false;
+		return;
+	}
+
+	if (stats.allocationsMoved == 0) {
+		// done until something else is freed
+		defragmentPending = false;
+		return;
+	}
+
+	LOG_DEBUG("defragmentation moved %u buffers (%u bytes), freed %u blocks (%u bytes)\n"
+	         , stats.allocationsMoved, static_cast<unsigned int>(stats.bytesMoved)
+	         , stats.deviceMemoryBlocksFreed, static_cast<unsigned int>(stats.bytesFreed));
+
+	// contents have moved, the old vk::Buffers are bound to the wrong place
+	// handles stay the same so only the Buffer objects need fixing
+	for (unsigned int i = 0; i < moveable.size(); i++) {
+		if (!changed[i]) {
+			continue;
+		}
+
+		Buffer &b = *moveable[i];
+		device.destroyBuffer(b.buffer);
+
+		vk::BufferCreateInfo bufInfo;
+		bufInfo.size  = b.size;
+		bufInfo.usage = bufferTypeUsage(b.type) | vk::BufferUsageFlagBits::eTransferDst;
+		b.buffer      = device.createBuffer(bufInfo);
+
+		VmaAllocationInfo allocationInfo = {};
+		vmaGetAllocationInfo(allocator, b.memory, &allocationInfo);
+		device.bindBufferMemory(b.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
+	}
+
+	// a cached descriptor set could point to an old vk::Buffer
+	dsCacheGeneration++;
+
+	// and so could the commands recorded by static render passes
+	renderPasses.forEach([this] (RenderPass &rp) {
+		retireStaticContents(rp);
+	} );
+}
+
+
+static const char *deviceTypeName(vk::PhysicalDeviceType type) {
+	switch (type) {
+	case vk::PhysicalDeviceType::eDiscreteGpu:
+		return "discrete";
+
+	case vk::PhysicalDeviceType::eIntegratedGpu:
+		return "integrated";
+
+	case vk::PhysicalDeviceType::eVirtualGpu:
+		return "virtual";
+
+	case vk::PhysicalDeviceType::eCpu:
+		return "cpu";
+
+	case vk::PhysicalDeviceType::eOther:
+		return "other";
+
+	}
+
+	return "other";
+}
+
+
+std::vector<DeviceInfo> RendererImpl::listDevices() {
+	// devices are listed in the same order without any extensions or a surface
+	vk::ApplicationInfo appInfo;
+	appInfo.apiVersion = VK_MAKE_VERSION(1, 0, 24);
+
+	vk::InstanceCreateInfo instanceCreateInfo;
+	instanceCreateInfo.pApplicationInfo = &appInfo;
+
+	vk::Instance listInstance = vk::createInstance(instanceCreateInfo);
+
+	std::vector<DeviceInfo> devices;
+	std::vector<vk::PhysicalDevice> physicalDevices = listInstance.enumeratePhysicalDevices();
+	devices.reserve(physicalDevices.size());
+	for (unsigned int i = 0; i < physicalDevices.size(); i++) {
+		const auto props = physicalDevices[i].getProperties();
+
+		DeviceInfo d;
+		d.index               = i;
+		d.name                = props.deviceName.data();
+		d.type                = deviceTypeName(props.deviceType);
+		d.vendorID            = props.vendorID;
+		d.deviceID            = props.deviceID;
+		d.apiVersion.major    = VK_VERSION_MAJOR(props.apiVersion);
+		d.apiVersion.minor    = VK_VERSION_MINOR(props.apiVersion);
+		d.apiVersion.patch    = VK_VERSION_PATCH(props.apiVersion);
+		d.driverVersion.major = VK_VERSION_MAJOR(props.driverVersion);
+		d.driverVersion.minor = VK_VERSION_MINOR(props.driverVersion);
+		d.driverVersion.patch = VK_VERSION_PATCH(props.driverVersion);
+
+		const auto memProps = physicalDevices[i].getMemoryProperties();
+		for (uint32_t j = 0; j < memProps.memoryHeapCount; j++) {
+			if (memProps.memoryHeaps[j].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+				d.localMemory += memProps.memoryHeaps[j].size;
+			}
+		}
+
+		devices.push_back(std::move(d));
+	}
+
+	listInstance.destroy();
+
+	return devices;
+}
+
+
+RendererImpl::~RendererImpl() {
+	assert(instance);
+	assert(device);
+	assert(offscreen || surface);
+	assert(offscreen || swapchain);
+	assert(transferCmdPool);
+	assert(pipelineCache);
+
+	if (frameAcquired) {
+		LOG("warning: acquired but not presented frame while shutting down\n");
+		assert(frameAcquireSem);
+		freeSemaphore(frameAcquireSem);
+		frameAcquireSem = vk::Semaphore();
+	} else {
+		assert(!frameAcquireSem);
+	}
+
+	// save pipeline cache
+	auto cacheData = device.getPipelineCacheData(pipelineCache);
+	writeFile(spirvCacheDir + "pipeline.cache", cacheData.data(), cacheData.size());
+	device.destroyPipelineCache(pipelineCache);
+	pipelineCache = vk::PipelineCache();
+
+	// nothing is left to receive these
+	for (auto &r : pendingReadbacks) {
+		r.callback = ReadbackCallback();
+	}
+
+	stopSubmitThread();
+
+	while (!waitForDeviceIdle()) {
+		// run event loop to avoid hangs
+		SDL_PumpEvents();
+		// TODO: wait?
+	}
+
+	// finishes what's queued, the rest is destroyed here
+	{
+		std::unique_lock<std::mutex> lock(destroyMutex);
+		destroyStop = true;
+	}
+	destroyCV.notify_all();
+	destroyThread.join();
+	assert(destroyQueue.empty());
+
+	for (unsigned int i = 0; i < frames.size(); i++) {
+		auto &f = frames.at(i);
+		assert(f.status == Frame::Status::Ready);
+		deleteFrameInternal(f);
+	}
+	frames.clear();
+
+	// every frame has synced so these were all finished
+	assert(pendingReadbacks.empty());
+
+	// uploads which never became part of a frame
+	submitThreadUploads();
+	submitUploads();
+	if (!uploads.empty()) {
+		transferQueue.waitIdle();
+		for (auto &op : uploads) {
+			releaseUploadOp(op);
+		}
+		uploads.clear();
+	}
+
+	// a signaled semaphore doesn't mean the fence is visible yet
+	if (!submittedStaging.empty()) {
+		transferQueue.waitIdle();
+	}
+	recycleStaging();
+	assert(submittedStaging.empty());
+
+	// also frees their command buffers
+	for (auto &c : uploadContexts) {
+		assert(!c.second->op.cmdBuf);
+		device.destroyCommandPool(c.second->cmdPool);
+	}
+	uploadContexts.clear();
+
+	for (auto &c : recordContexts) {
+		for (auto &rf : c.second->frames) {
+			destroyRecordFrame(rf);
+		}
+	}
+	recordContexts.clear();
+
+	for (auto &block : freeStagingBlocks) {
+		destroyStagingBlock(block);
+	}
+	freeStagingBlocks.clear();
+
+	// must have been deleted by waitForDeviceIdle
+	assert(deleteResources.empty());
+	assert(retiredSwapchains.empty());
+	assert(retiredStaticContents.empty());
+
+	currentRingPage = invalidRingPage;
+	freeRingPages.clear();
+	for (unsigned int i = 0; i < ringPages.size(); i++) {
+		auto &page = ringPages[i];
+		if (page.size != 0) {
+			page.users = 0;
+			destroyRingPage(i);
+		}
+	}
+	ringPages.clear();
+
+	buffers.clearWith([this](Buffer &b) {
+		deleteBufferInternal(b);
+	} );
+
+	// emptied by deleting the buffers
+	for (const auto &arena : bufferArenas) {
+		assert(!arena.buffer);
+	}
+	bufferArenas.clear();
+
+	samplers.clearWith([this](Sampler &s) {
+		deleteSamplerInternal(s);
+	} );
+
+	pipelines.clearWith([this](Pipeline &p) {
+		deletePipelineInternal(p);
+	} );
+	assert(sharedPipelines.empty());
+	assert(pendingPipelineLinks.empty());
+
+	for (auto &library : pipelineLibraries) {
+		device.destroyPipeline(library.second);
+	}
+	pipelineLibraries.clear();
+
+	framebuffers.clearWith([this](Framebuffer &fb) {
 		deleteFramebufferInternal(fb);
 	} );
 
@@ -936,10 +2013,15 @@ RendererImpl::~RendererImpl() {
 	} );
 
 	dsLayouts.clearWith([this](DescriptorSetLayout &l) {
-		this->device.destroyDescriptorSetLayout(l.layout);
-		l.layout = vk::DescriptorSetLayout();
+		if (!l.textureTable) {
+			this->device.destroyDescriptorSetLayout(l.layout);
+		}
+		l.layout       = vk::DescriptorSetLayout();
+		l.textureTable = false;
 	} );
 
+	// swapchain rendertargets go too
+	swapchainRenderTargets.clear();
 	renderTargets.clearWith([this](RenderTarget &rt) {
 		deleteRenderTargetInternal(rt);
 	} );
@@ -948,12 +2030,26 @@ RendererImpl::~RendererImpl() {
 		deleteTextureInternal(tex);
 	} );
 
+	if (features.textureTable) {
+		// also frees textureTable
+		device.destroyDescriptorPool(textureTablePool);
+		textureTablePool = vk::DescriptorPool();
+		textureTable     = vk::DescriptorSet();
+
+		device.destroyDescriptorSetLayout(textureTableLayout);
+		textureTableLayout = vk::DescriptorSetLayout();
+		assert(freeTextureTableIndices.size() == MAX_TEXTURE_TABLE_SIZE);
+	}
+
+	swapchainImages.clear();
 	device.destroySwapchainKHR(swapchain);
 	swapchain = vk::SwapchainKHR();
 
 	instance.destroySurfaceKHR(surface);
 	surface = vk::SurfaceKHR();
 
+	destroyRetiredObjects(retiredObjects);
+
 	vmaDestroyAllocator(allocator);
 	allocator = VK_NULL_HANDLE;
 
@@ -961,9 +2057,42 @@ RendererImpl::~RendererImpl() {
 		device.destroySemaphore(sem);
 		sem = vk::Semaphore();
 	}
+	freeSemaphores.clear();
+
+	for (auto &fence : freeFences) {
+		device.destroyFence(fence);
+	}
+	freeFences.clear();
+
+	// signaled but never waited on so they can't go back to freeSemaphores
+	if (asyncGraphicsWaitSem) {
+		device.destroySemaphore(asyncGraphicsWaitSem);
+		asyncGraphicsWaitSem = vk::Semaphore();
+	}
+	if (asyncComputeWaitSem) {
+		device.destroySemaphore(asyncComputeWaitSem);
+		asyncComputeWaitSem = vk::Semaphore();
+	}
 
+	if (timelineSemaphores) {
+		device.destroySemaphore(graphicsTimeline);
+		graphicsTimeline = vk::Semaphore();
+		device.destroySemaphore(transferTimeline);
+		transferTimeline = vk::Semaphore();
+	}
+
+	// also frees freeTransferCmdBufs
 	device.destroyCommandPool(transferCmdPool);
 	transferCmdPool = vk::CommandPool();
+	freeTransferCmdBufs.clear();
+
+	// render passes freed their static contents above
+	device.destroyCommandPool(staticCmdPool);
+	staticCmdPool   = vk::CommandPool();
+
+	if (!performanceCounterIndices.empty()) {
+		device.releaseProfilingLockKHR(dispatcher);
+	}
 
 	device.destroy();
 	device = vk::Device();
@@ -981,7 +2110,10 @@ RendererImpl::~RendererImpl() {
 	instance.destroy();
 	instance = vk::Instance();
 
-	SDL_DestroyWindow(window);
+	if (window) {
+		SDL_DestroyWindow(window);
+		window = nullptr;
+	}
 
 	SDL_Quit();
 }
@@ -1002,36 +2134,112 @@ bool RendererImpl::isRenderTargetFormatSupported(Format format) const {
 }
 
 
-BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const void *contents) {
-	assert(type != +BufferType::Invalid);
-	assert(size != 0);
-	assert(contents != nullptr);
+bool RendererImpl::isTextureFormatSupported(Format format) const {
+	assert(!isDepthFormat(format));
 
-	vk::BufferCreateInfo info;
-	info.size  = size;
-	info.usage = bufferTypeUsage(type) | vk::BufferUsageFlagBits::eTransferDst;
+	vk::ImageUsageFlags flags(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+	vk::ImageFormatProperties prop;
+	auto result = physicalDevice.getImageFormatProperties(vulkanFormat(format), vk::ImageType::e2D, vk::ImageTiling::eOptimal, flags, vk::ImageCreateFlags(), &prop);
+
+	return (result == vk::Result::eSuccess);
+}
+
+
+BufferHandle RendererImpl::createBuffer(const BufferDesc &desc) {
+	assert(desc.type_ != +BufferType::Invalid);
+	assert(desc.size_ != 0);
+	assert(desc.contents_ != nullptr || desc.usage_ != +BufferUsage::Static);
+
+	const BufferType  type      = desc.type_;
+	const uint32_t    size      = desc.size_;
+	const void        *contents = desc.contents_;
 
 	auto result    = buffers.add();
 	Buffer &buffer = result.first;
-	buffer.buffer  = device.createBuffer(info);
+	buffer.size    = size;
+	buffer.type    = type;
+	buffer.usage   = desc.usage_;
+
+	// where contents can be written directly, null if they need staging
+	char          *mapping = nullptr;
+	VmaAllocation  memory  = VK_NULL_HANDLE;
+	if (desc.usage_ == +BufferUsage::Static && type != +BufferType::Everything && size <= maxArenaBufferSize) {
+		std::lock_guard<std::mutex> lock(resourceMutex);
+		arenaAllocate(size, bufferAlignment(type), buffer.arena, buffer.offset);
+		const auto &arena = bufferArenas[buffer.arena];
+		buffer.buffer = arena.buffer;
+		memory        = arena.memory;
+		if (arena.mapping) {
+			mapping = arena.mapping + buffer.offset;
+		}
+	} else {
+		vk::BufferCreateInfo info;
+		info.size  = size;
+		info.usage = bufferTypeUsage(type) | vk::BufferUsageFlagBits::eTransferDst;
+		buffer.buffer  = device.createBuffer(info);
+
+		VmaAllocationCreateInfo req = {};
+		req.usage          = VMA_MEMORY_USAGE_GPU_ONLY;
+		VmaAllocationInfo  allocationInfo = {};
+
+		VkResult allocResult = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+		if (desc.usage_ == +BufferUsage::Streaming) {
+			// the GPU reads it from wherever the host can write it directly
+			VmaAllocationCreateInfo streamingReq = {};
+			streamingReq.usage      = VMA_MEMORY_USAGE_CPU_TO_GPU;
+			streamingReq.flags      = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			allocResult = vmaAllocateMemoryForBuffer(allocator, buffer.buffer, &streamingReq, &buffer.memory, &allocationInfo);
+		} else if (directUploads) {
+			// falls back to staging when the host visible types are full
+			VmaAllocationCreateInfo directReq = req;
+			directReq.flags         = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			directReq.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			allocResult = vmaAllocateMemoryForBuffer(allocator, buffer.buffer, &directReq, &buffer.memory, &allocationInfo);
+		}
+		bool direct = (allocResult == VK_SUCCESS);
+		if (!direct) {
+			allocResult = vmaAllocateMemoryForBuffer(allocator, buffer.buffer, &req, &buffer.memory, &allocationInfo);
+		}
+		if (allocResult != VK_SUCCESS) {
+			LOG("vmaAllocateMemoryForBuffer failed: %s\n", vk::to_string(vk::Result(allocResult)).c_str());
+			throw std::runtime_error("vmaAllocateMemoryForBuffer failed");
+		}
+		LOG("buffer memory type: %u\n",    allocationInfo.memoryType);
+		LOG("buffer memory offset: %u\n",  static_cast<unsigned int>(allocationInfo.offset));
+		LOG("buffer memory size: %u\n",    static_cast<unsigned int>(allocationInfo.size));
+		assert(allocationInfo.size > 0);
+		assert(direct == (allocationInfo.pMappedData != nullptr));
+		device.bindBufferMemory(buffer.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
+		countMemory(MemoryKind::Buffer, buffer.memory, true);
+		// offset is within buffer.buffer, not within the memory allocation
+		// binding and descriptors add it to the start of the VkBuffer
+		buffer.offset = 0;
+		memory        = buffer.memory;
+		mapping       = reinterpret_cast<char *>(allocationInfo.pMappedData);
+
+		if (!desc.name_.empty()) {
+			debugNameObject<vk::Buffer>(buffer.buffer, desc.name_);
+		}
+	}
 
-	VmaAllocationCreateInfo req = {};
-	req.usage          = VMA_MEMORY_USAGE_GPU_ONLY;
-	VmaAllocationInfo  allocationInfo = {};
+	if (!contents) {
+		// undefined until updateBuffer
+		return result.second;
+	}
 
-	vmaAllocateMemoryForBuffer(allocator, buffer.buffer, &req, &buffer.memory, &allocationInfo);
-	LOG("buffer memory type: %u\n",    allocationInfo.memoryType);
-	LOG("buffer memory offset: %u\n",  static_cast<unsigned int>(allocationInfo.offset));
-	LOG("buffer memory size: %u\n",    static_cast<unsigned int>(allocationInfo.size));
-	assert(allocationInfo.size > 0);
-	assert(allocationInfo.pMappedData == nullptr);
-	device.bindBufferMemory(buffer.buffer, allocationInfo.deviceMemory, allocationInfo.offset);
-	buffer.offset = static_cast<uint32_t>(allocationInfo.offset);
-	buffer.size   = size;
-	buffer.type   = type;
+	if (mapping) {
+		// host writes are visible to everything submitted after this
+		// so no copy, semaphore or barrier is needed
+		memcpy(mapping, contents, size);
+		vmaFlushAllocation(allocator, memory, buffer.offset, size);
+
+		return result.second;
+	}
 
 	// copy contents to GPU memory
-	UploadOp op = allocateUploadOp(size);
+	std::unique_lock<std::mutex> uploadLock;
+	UploadOp &op = beginUpload(uploadLock);
+	StagingAllocation staging = allocateStaging(op, size);
 	switch (type) {
 	case BufferType::Invalid:
 		UNREACHABLE();
@@ -1040,31 +2248,42 @@ BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const vo
 	case BufferType::Index:
 	case BufferType::Vertex:
 	case BufferType::Everything:
-		op.semWaitMask = vk::PipelineStageFlagBits::eVertexInput;
+		op.semWaitMask |= vk::PipelineStageFlagBits::eVertexInput;
 		break;
 
 	case BufferType::Uniform:
 	case BufferType::Storage:
-		op.semWaitMask = vk::PipelineStageFlagBits::eVertexShader;
+		op.semWaitMask |= vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader;
+		break;
+
+	case BufferType::Indirect:
+		op.semWaitMask |= vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader;
 		break;
 
 	}
 
-	memcpy(static_cast<char *>(op.allocationInfo.pMappedData), contents, size);
-    vmaFlushAllocation(allocator, buffer.memory, 0, size);
+	// updateBuffer copies must not overtake this one
+	if (desc.usage_ != +BufferUsage::Static) {
+		op.semWaitMask |= vk::PipelineStageFlagBits::eTransfer;
+	}
+
+	memcpy(staging.ptr, contents, size);
+	vmaFlushAllocation(allocator, staging.memory, staging.offset, size);
 
-	// TODO: reuse command buffer for multiple copies
 	vk::BufferCopy copyRegion;
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
+	copyRegion.srcOffset = staging.offset;
+	copyRegion.dstOffset = buffer.offset;
 	copyRegion.size      = size;
 
-	op.cmdBuf.copyBuffer(op.stagingBuffer, buffer.buffer, 1, &copyRegion);
+	op.cmdBuf.copyBuffer(staging.buffer, buffer.buffer, 1, &copyRegion);
+
+	// arenas are shared by both queue families so they need no ownership transfer
+	bool transferOwnership = (transferQueueIndex != graphicsQueueIndex) && (buffer.arena == noBufferArena);
 
 	vk::BufferMemoryBarrier barrier;
 	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
 	barrier.dstAccessMask       = vk::AccessFlagBits::eMemoryRead;
-	if (transferQueueIndex != graphicsQueueIndex) {
+	if (transferOwnership) {
 		barrier.srcQueueFamilyIndex = transferQueueIndex;
 		barrier.dstQueueFamilyIndex = graphicsQueueIndex;
 	} else {
@@ -1072,16 +2291,17 @@ BufferHandle RendererImpl::createBuffer(BufferType type, uint32_t size, const vo
 		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	}
 	barrier.buffer              = buffer.buffer;
-	barrier.offset              = 0;
+	barrier.offset              = buffer.offset;
 	barrier.size                = size;
 
 	op.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), {}, { barrier }, {});
 
-	if (transferQueueIndex != graphicsQueueIndex) {
+	if (transferOwnership) {
 		op.bufferAcquireBarriers.push_back(barrier);
 	}
+	op.numCopies++;
 
-	submitUploadOp(std::move(op));
+	finishUpload(op);
 
 	return result.second;
 }
@@ -1093,40 +2313,94 @@ BufferHandle RendererImpl::createEphemeralBuffer(BufferType type, uint32_t size,
 	assert(contents != nullptr);
 
 	// TODO: separate ringbuffers based on type
-	unsigned int beginPtr = ringBufferAllocate(size, bufferAlignment(type));
+	unsigned int pageIdx  = 0;
+	unsigned int beginPtr = ringBufferAllocate(size, bufferAlignment(type), pageIdx);
 
-	memcpy(persistentMapping + beginPtr, contents, size);
+	const auto &page = ringPages[pageIdx];
+	streamingCopy(page.mapping + beginPtr, contents, size);
 
-	auto result    = buffers.add();
-	Buffer &buffer = result.first;
-	buffer.buffer          = ringBuffer;
-	buffer.ringBufferAlloc = true;
-	buffer.offset          = beginPtr;
-	buffer.size            = size;
-	buffer.type            = type;
+	return EphemeralBuffer(pageIdx, beginPtr, size, type).handle();
+}
 
-	frames.at(currentFrameIdx).ephemeralBuffers.push_back(result.second);
 
-	return result.second;
-}
+EphemeralAllocation RendererImpl::allocateEphemeral(BufferType type, uint32_t size) {
+	assert(type != +BufferType::Invalid);
+	assert(size != 0);
 
+	unsigned int pageIdx  = 0;
+	unsigned int beginPtr = ringBufferAllocate(size, bufferAlignment(type), pageIdx);
 
-static vk::ImageLayout vulkanLayout(Layout l) {
-	switch (l) {
-	case Layout::Undefined:
-		return vk::ImageLayout::eUndefined;
+	EphemeralAllocation result;
+	result.buffer   = EphemeralBuffer(pageIdx, beginPtr, size, type).handle();
+	result.contents = ringPages[pageIdx].mapping + beginPtr;
+	return result;
+}
 
-	case Layout::ShaderRead:
-		return vk::ImageLayout::eShaderReadOnlyOptimal;
 
-	case Layout::TransferSrc:
-		return vk::ImageLayout::eTransferSrcOptimal;
+ResolvedBuffer RendererImpl::resolveEphemeralBuffer(BufferHandle handle) const {
+	assert(EphemeralBuffer::isEphemeral(handle));
+	// recorded static contents would outlive it
+	assert(!recordingStatic);
+	EphemeralBuffer e(handle);
+	// ring buffer page, lives until the frame retires
+	const auto &page = ringPages.at(e.page);
+	assert(page.users > 0);
+	assert(page.buffer);
+	assert(e.offset + e.size <= page.size);
+	return ResolvedBuffer(page.buffer, e.offset, e.size, e.type);
+}
 
-	case Layout::TransferDst:
-		return vk::ImageLayout::eTransferDstOptimal;
 
-	case Layout::ColorAttachment:
-		return vk::ImageLayout::eColorAttachmentOptimal;
+ResolvedBuffer RendererImpl::resolveBuffer(BufferHandle handle) {
+	if (EphemeralBuffer::isEphemeral(handle)) {
+		return resolveEphemeralBuffer(handle);
+	}
+
+	// "normal" buffers begin from beginning of buffer, arena buffers from their offset
+	auto &b = buffers.get(handle);
+	assert(b.buffer);
+	assert(b.offset == 0 || b.arena != noBufferArena);
+	b.lastUsedFrame = frameNum;
+	b.used          = true;
+	return ResolvedBuffer(b.buffer, b.offset, b.size, b.type);
+}
+
+
+ResolvedBuffer RendererImpl::resolveBuffer(BufferHandle handle, std::vector<BufferHandle> &usedBuffers) const {
+	if (EphemeralBuffer::isEphemeral(handle)) {
+		return resolveEphemeralBuffer(handle);
+	}
+
+	const auto &b = buffers.get(handle);
+	assert(b.buffer);
+	assert(b.offset == 0 || b.arena != noBufferArena);
+	usedBuffers.push_back(handle);
+	return ResolvedBuffer(b.buffer, b.offset, b.size, b.type);
+}
+
+
+static vk::ImageLayout vulkanLayout(Layout l) {
+	switch (l) {
+	case Layout::Undefined:
+		return vk::ImageLayout::eUndefined;
+
+	case Layout::ShaderRead:
+		return vk::ImageLayout::eShaderReadOnlyOptimal;
+
+	case Layout::TransferSrc:
+		return vk::ImageLayout::eTransferSrcOptimal;
+
+	case Layout::TransferDst:
+		return vk::ImageLayout::eTransferDstOptimal;
+
+	case Layout::ColorAttachment:
+		return vk::ImageLayout::eColorAttachmentOptimal;
+
+	case Layout::General:
+		return vk::ImageLayout::eGeneral;
+
+	case Layout::Present:
+		return vk::ImageLayout::ePresentSrcKHR;
 	}
 
 	UNREACHABLE();
@@ -1139,7 +2413,7 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 	assert(desc.renderPass_);
 
 	auto &renderPass = renderPasses.get(desc.renderPass_);
-	assert(renderPass.renderPass);
+	assert(renderPass.renderPass || dynamicRendering);
 
 	std::vector<vk::ImageView> attachmentViews;
 	unsigned int width = 0, height = 0;
@@ -1162,6 +2436,7 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 
 		assert(colorRT.width  > 0);
 		assert(colorRT.height > 0);
+		assert(colorRT.layers >= renderPass.desc.views_);
 		assert(colorRT.imageView);
 		// TODO: make sure renderPass formats match actual framebuffer attachments
 		attachmentViews.push_back(colorRT.imageView);
@@ -1169,30 +2444,58 @@ FramebufferHandle RendererImpl::createFramebuffer(const FramebufferDesc &desc) {
 
 	if (desc.depthStencil_) {
 		const auto &depthRT = renderTargets.get(desc.depthStencil_);
+		if (width == 0) {
+			// depth only framebuffer
+			width  = depthRT.width;
+			height = depthRT.height;
+		}
 		assert(depthRT.width  == width);
 		assert(depthRT.height == height);
+		assert(depthRT.layers >= renderPass.desc.views_);
 		assert(depthRT.imageView);
 		attachmentViews.push_back(depthRT.imageView);
 	}
 
-	vk::FramebufferCreateInfo fbInfo;
+	// resolve attachments are last, same as in createRenderPass
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (!desc.resolves_[i]) {
+			assert(renderPass.desc.colorRTs_[i].resolveFormat == +Format::Invalid);
+			continue;
+		}
+		assert(desc.colors_[i]);
+		assert(renderPass.desc.colorRTs_[i].resolveFormat != +Format::Invalid);
+
+		const auto &resolveRT = renderTargets.get(desc.resolves_[i]);
+		assert(resolveRT.width  == width);
+		assert(resolveRT.height == height);
+		assert(resolveRT.layers >= renderPass.desc.views_);
+		assert(resolveRT.imageView);
+		attachmentViews.push_back(resolveRT.imageView);
+	}
 
-	fbInfo.renderPass       = renderPass.renderPass;
 	assert(!attachmentViews.empty());
-	fbInfo.attachmentCount  = static_cast<uint32_t>(attachmentViews.size());
-	fbInfo.pAttachments     = &attachmentViews[0];
-	fbInfo.width            = width;
-	fbInfo.height           = height;
-	fbInfo.layers           = 1;
+	assert(attachmentViews.size() == renderPass.numAttachments);
 
 	auto result     = framebuffers.add();
 	Framebuffer &fb = result.first;
 	fb.desc         = desc;
 	fb.width        = width;
 	fb.height       = height;
-	fb.framebuffer  = device.createFramebuffer(fbInfo);
 
-	debugNameObject<vk::Framebuffer>(fb.framebuffer, desc.name_);
+	if (!dynamicRendering) {
+		vk::FramebufferCreateInfo fbInfo;
+
+		fbInfo.renderPass       = renderPass.renderPass;
+		fbInfo.attachmentCount  = static_cast<uint32_t>(attachmentViews.size());
+		fbInfo.pAttachments     = &attachmentViews[0];
+		fbInfo.width            = width;
+		fbInfo.height           = height;
+		// multiview passes must have 1 here, the view mask picks the layers
+		fbInfo.layers           = 1;
+
+		fb.framebuffer  = device.createFramebuffer(fbInfo);
+		debugNameObject<vk::Framebuffer>(fb.framebuffer, desc.name_);
+	}
 
 	return result.second;
 }
@@ -1228,6 +2531,42 @@ static vk::SampleCountFlagBits sampleCountFlagsFromNum(unsigned int numSamples)
 }
 
 
+static void addFinalLayoutDependency(vk::SubpassDependency &d, Layout l) {
+	switch (l) {
+	case Layout::Undefined:
+	case Layout::TransferDst:
+		assert(false);
+		break;
+
+	case Layout::ShaderRead:
+		d.dstStageMask   |= vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+		d.dstAccessMask  |= vk::AccessFlagBits::eShaderRead;
+		break;
+
+	case Layout::TransferSrc:
+		d.dstStageMask   |= vk::PipelineStageFlagBits::eTransfer;
+		d.dstAccessMask  |= vk::AccessFlagBits::eTransferRead;
+		break;
+
+	case Layout::ColorAttachment:
+		d.dstStageMask   |= vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		d.dstAccessMask  |= vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+		break;
+
+	case Layout::General:
+		d.dstStageMask   |= vk::PipelineStageFlagBits::eComputeShader;
+		d.dstAccessMask  |= vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		break;
+
+	case Layout::Present:
+		// presentation waits on a semaphore, nothing else reads it
+		d.dstStageMask   |= vk::PipelineStageFlagBits::eBottomOfPipe;
+		break;
+
+	}
+}
+
+
 RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 	assert(!desc.name_.empty());
 
@@ -1287,7 +2626,9 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 			break;
 		}
 
-		attach.storeOp        = vk::AttachmentStoreOp::eStore;
+		// resolved and transient attachments aren't needed after the pass
+		// which saves writing them to memory on tilers
+		attach.storeOp        = colorRT.store ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
 		attach.stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
 		attach.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
 		attach.finalLayout    = vulkanLayout(colorRT.finalLayout);
@@ -1299,7 +2640,7 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 		colorAttachments.push_back(ref);
 	}
 	subpass.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size());
-	subpass.pColorAttachments    = &colorAttachments[0];
+	subpass.pColorAttachments    = colorAttachments.data();
 
 	bool hasDepthStencil = (desc.depthStencilFormat_ != +Format::Invalid);
 	vk::AttachmentReference depthAttachment;
@@ -1310,21 +2651,55 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 		uint32_t attachNum    = static_cast<uint32_t>(attachments.size());
 		attach.format         = vulkanFormat(desc.depthStencilFormat_);
 		attach.samples        = samples;
-		// TODO: these should be customizable via RenderPassDesc
-		attach.loadOp         = vk::AttachmentLoadOp::eDontCare;
-		if (desc.clearDepthAttachment) {
+		bool hasStencil       = isStencilFormat(desc.depthStencilFormat_);
+		bool clearDepth       = desc.clearDepthAttachment || (desc.depthStencilPassBegin_ == +PassBegin::Clear);
+		bool clearStencil     = hasStencil && (desc.stencilPassBegin_ == +PassBegin::Clear);
+		bool keepStencil      = hasStencil && (desc.stencilPassBegin_ == +PassBegin::Keep);
+		bool keepDepth        = (desc.depthStencilPassBegin_ == +PassBegin::Keep);
+
+		if (clearDepth) {
 			attach.loadOp     = vk::AttachmentLoadOp::eClear;
+		} else if (keepDepth) {
+			attach.loadOp     = vk::AttachmentLoadOp::eLoad;
+		} else {
+			attach.loadOp     = vk::AttachmentLoadOp::eDontCare;
+		}
+		attach.storeOp        = desc.storeDepth_ ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+
+		if (clearStencil) {
+			attach.stencilLoadOp  = vk::AttachmentLoadOp::eClear;
+		} else if (keepStencil) {
+			attach.stencilLoadOp  = vk::AttachmentLoadOp::eLoad;
+		} else {
+			attach.stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
+		}
+		if (hasStencil && desc.storeStencil_) {
+			attach.stencilStoreOp = vk::AttachmentStoreOp::eStore;
+		} else {
+			attach.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+		}
+
+		if (clearDepth || clearStencil) {
 			r.clearValueCount = attachNum + 1;
-            assert(attachNum < r.clearValues.size());
-			r.clearValues[attachNum].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
+			assert(attachNum < r.clearValues.size());
+			r.clearValues[attachNum].depthStencil = vk::ClearDepthStencilValue(desc.depthClearValue, desc.stencilClearValue);
+		}
+
+		// depth attachments are always left in ShaderRead at the end of a pass
+		// so that is what we load from
+		if (keepDepth || keepStencil) {
+			attach.initialLayout  = vk::ImageLayout::eShaderReadOnlyOptimal;
+		} else {
+			attach.initialLayout  = vk::ImageLayout::eUndefined;
 		}
-		attach.storeOp        = vk::AttachmentStoreOp::eStore;
-		// TODO: stencil
-		attach.stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
-		attach.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-		attach.initialLayout  = vk::ImageLayout::eUndefined;
 		// TODO: finalLayout should come from desc
-		attach.finalLayout    = vk::ImageLayout::eShaderReadOnlyOptimal;
+		// discarded depth might be transient which can't be in ShaderRead
+		// whatever uses it next doesn't load so the layout doesn't matter
+		if (desc.storeDepth_) {
+			attach.finalLayout    = vk::ImageLayout::eShaderReadOnlyOptimal;
+		} else {
+			attach.finalLayout    = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+		}
 		attachments.push_back(attach);
 
 		depthAttachment.attachment = attachNum;
@@ -1332,11 +2707,51 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 		subpass.pDepthStencilAttachment = &depthAttachment;
 	}
 
+	// resolve attachments go last so they don't move clear value indices
+	// one entry per color attachment, unused for those not resolved
+	std::vector<vk::AttachmentReference> resolveAttachments(colorAttachments.size());
+	bool hasResolve = false;
+	{
+		unsigned int colorIdx = 0;
+		for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+			const auto &colorRT = desc.colorRTs_[i];
+			if (colorRT.format == +Format::Invalid) {
+				continue;
+			}
+
+			auto &ref = resolveAttachments[colorIdx];
+			colorIdx++;
+			if (colorRT.resolveFormat == +Format::Invalid) {
+				ref.attachment = VK_ATTACHMENT_UNUSED;
+				ref.layout     = vk::ImageLayout::eUndefined;
+				continue;
+			}
+			assert(desc.numSamples_ > 1);
+
+			vk::AttachmentDescription attach;
+			attach.format         = vulkanFormat(colorRT.resolveFormat);
+			attach.samples        = vk::SampleCountFlagBits::e1;
+			attach.loadOp         = vk::AttachmentLoadOp::eDontCare;
+			attach.storeOp        = vk::AttachmentStoreOp::eStore;
+			attach.stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
+			attach.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+			attach.initialLayout  = vk::ImageLayout::eUndefined;
+			attach.finalLayout    = vulkanLayout(colorRT.resolveFinalLayout);
+
+			ref.attachment = static_cast<uint32_t>(attachments.size());
+			ref.layout     = vk::ImageLayout::eColorAttachmentOptimal;
+			attachments.push_back(attach);
+			hasResolve = true;
+		}
+	}
+	if (hasResolve) {
+		subpass.pResolveAttachments = &resolveAttachments[0];
+	}
+
 	info.attachmentCount = static_cast<uint32_t>(attachments.size());
 	info.pAttachments    = &attachments[0];
 
 	// no input attachments
-	// no resolved attachments (multisample TODO)
 	// no preserved attachments
 	info.subpassCount    = 1;
 	info.pSubpasses      = &subpass;
@@ -1387,27 +2802,9 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 				continue;
 			}
 
-			switch (desc.colorRTs_[i].finalLayout) {
-			case Layout::Undefined:
-			case Layout::TransferDst:
-				assert(false);
-				break;
-
-			case Layout::ShaderRead:
-				d.dstStageMask   |= vk::PipelineStageFlagBits::eFragmentShader;
-				d.dstAccessMask  |= vk::AccessFlagBits::eShaderRead;
-				break;
-
-			case Layout::TransferSrc:
-				d.dstStageMask   |= vk::PipelineStageFlagBits::eTransfer;
-				d.dstAccessMask  |= vk::AccessFlagBits::eTransferRead;
-				break;
-
-			case Layout::ColorAttachment:
-				d.dstStageMask   |= vk::PipelineStageFlagBits::eColorAttachmentOutput;
-				d.dstAccessMask  |= vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
-				break;
-
+			addFinalLayoutDependency(d, desc.colorRTs_[i].finalLayout);
+			if (desc.colorRTs_[i].resolveFormat != +Format::Invalid) {
+				addFinalLayoutDependency(d, desc.colorRTs_[i].resolveFinalLayout);
 			}
 		}
 
@@ -1417,20 +2814,55 @@ RenderPassHandle RendererImpl::createRenderPass(const RenderPassDesc &desc) {
 			d.srcStageMask   |= vk::PipelineStageFlagBits::eLateFragmentTests;
 			d.srcAccessMask  |= vk::AccessFlagBits::eDepthStencilAttachmentWrite;
 
-			d.dstStageMask   |= vk::PipelineStageFlagBits::eFragmentShader;
+			d.dstStageMask   |= vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
 			d.dstAccessMask  |= vk::AccessFlagBits::eShaderRead;
 		}
 	}
 	info.dependencyCount = 2;
 	info.pDependencies   = &dependencies[0];
 
-	r.renderPass  = device.createRenderPass(info);
+	// with dynamic rendering there is no vk::RenderPass
+	// beginRenderPass and endRenderPass do what it would from these
+	assert(attachments.size() <= r.attachments.size());
+	std::copy(attachments.begin(), attachments.end(), r.attachments.begin());
+	r.numAttachments = static_cast<unsigned int>(attachments.size());
+	r.dependencies   = dependencies;
+	for (unsigned int i = 0; i < numColorAttachments; i++) {
+		r.colorFormats[i] = attachments[i].format;
+	}
+	r.depthFormat    = vk::Format::eUndefined;
+	r.stencilFormat  = vk::Format::eUndefined;
+	if (hasDepthStencil) {
+		vk::Format f = vulkanFormat(desc.depthStencilFormat_);
+		r.depthFormat    = f;
+		if (isStencilFormat(desc.depthStencilFormat_)) {
+			r.stencilFormat  = f;
+		}
+	}
+
+	assert(desc.views_ <= features.maxMultiviewViews);
+	if (desc.views_ > 1) {
+		// views are all correlated, they're normally a stereo pair
+		r.viewMask = (1u << desc.views_) - 1;
+	}
+
+	if (!dynamicRendering) {
+		vk::RenderPassMultiviewCreateInfoKHR multiviewInfo;
+		if (r.viewMask != 0) {
+			multiviewInfo.subpassCount         = 1;
+			multiviewInfo.pViewMasks           = &r.viewMask;
+			multiviewInfo.correlationMaskCount = 1;
+			multiviewInfo.pCorrelationMasks    = &r.viewMask;
+			info.pNext                         = &multiviewInfo;
+		}
+
+		r.renderPass  = device.createRenderPass(info);
+		debugNameObject<vk::RenderPass>(r.renderPass, desc.name_);
+	}
 	r.numSamples  = desc.numSamples_;
 	r.numColorAttachments = numColorAttachments;
 	r.desc        = desc;
 
-	debugNameObject<vk::RenderPass>(r.renderPass, desc.name_);
-
 	return result.second;
 }
 
@@ -1459,16 +2891,139 @@ static vk::BlendFactor vulkanBlendFactor(BlendFunc b) {
 }
 
 
+static vk::CompareOp vulkanDepthFunc(DepthFunc f) {
+	switch (f) {
+	case DepthFunc::Less:
+		return vk::CompareOp::eLess;
+
+	case DepthFunc::Equal:
+		return vk::CompareOp::eEqual;
+
+	}
+
+	UNREACHABLE();
+	return vk::CompareOp::eLess;
+}
+
+
+static vk::CompareOp vulkanStencilFunc(StencilFunc f) {
+	switch (f) {
+	case StencilFunc::Always:
+		return vk::CompareOp::eAlways;
+
+	case StencilFunc::Equal:
+		return vk::CompareOp::eEqual;
+
+	case StencilFunc::NotEqual:
+		return vk::CompareOp::eNotEqual;
+
+	}
+
+	UNREACHABLE();
+	return vk::CompareOp::eAlways;
+}
+
+
+static vk::StencilOp vulkanStencilOp(StencilOp o) {
+	switch (o) {
+	case StencilOp::Keep:
+		return vk::StencilOp::eKeep;
+
+	case StencilOp::Zero:
+		return vk::StencilOp::eZero;
+
+	case StencilOp::Replace:
+		return vk::StencilOp::eReplace;
+
+	}
+
+	UNREACHABLE();
+	return vk::StencilOp::eKeep;
+}
+
+
+// entries must outlive the returned info, data points to values
+static vk::SpecializationInfo makeSpecializationInfo(const std::array<uint32_t, MAX_SPEC_CONSTANTS> &values, uint32_t mask, std::vector<vk::SpecializationMapEntry> &entries) {
+	entries.clear();
+	forEachSetBit(mask, [&] (uint32_t id, uint32_t /* mask */) {
+		vk::SpecializationMapEntry entry;
+		entry.constantID = id;
+		entry.offset     = id * sizeof(uint32_t);
+		entry.size       = sizeof(uint32_t);
+		entries.push_back(entry);
+	});
+
+	vk::SpecializationInfo info;
+	info.mapEntryCount = static_cast<uint32_t>(entries.size());
+	info.pMapEntries   = entries.data();
+	info.dataSize      = values.size() * sizeof(uint32_t);
+	info.pData         = values.data();
+
+	return info;
+}
+
+
 PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
+	PipelineDynamicState dynamicState;
+	dynamicState.cullMode   = desc.cullFaces_ ? vk::CullModeFlagBits::eBack : vk::CullModeFlagBits::eNone;
+	dynamicState.depthTest  = desc.depthTest_;
+	dynamicState.depthWrite = desc.depthWrite_;
+	dynamicState.depthCompareOp = vulkanDepthFunc(desc.depthFunc_);
+	if (desc.stencilTest_) {
+		dynamicState.stencilTest      = true;
+		dynamicState.stencilPassOp    = vulkanStencilOp(desc.stencilPassOp_);
+		dynamicState.stencilCompareOp = vulkanStencilFunc(desc.stencilFunc_);
+		dynamicState.stencilRef       = desc.stencilRef_;
+	}
+
+	// pipelines which only differ in dynamic state share one vk::Pipeline
+	uint64_t sharedKey = 0;
+	if (extendedDynamicState) {
+		PipelineDesc keyDesc(desc);
+		keyDesc.depthWrite_    = false;
+		keyDesc.depthTest_     = false;
+		keyDesc.depthFunc_     = DepthFunc::Less;
+		keyDesc.cullFaces_     = false;
+		keyDesc.stencilTest_   = false;
+		keyDesc.stencilFunc_   = StencilFunc::Always;
+		keyDesc.stencilPassOp_ = StencilOp::Keep;
+		keyDesc.stencilRef_    = 0;
+		keyDesc.name_.clear();
+		keyDesc.hash_          = 0;
+		sharedKey = keyDesc.hashValue();
+
+		auto it = sharedPipelines.find(sharedKey);
+		if (it != sharedPipelines.end()) {
+			it->second.refCount++;
+
+			auto id = pipelines.add();
+			Pipeline &p = id.first;
+			p.pipeline     = it->second.pipeline;
+			p.layout       = it->second.layout;
+			p.scissor      = desc.scissorTest_;
+			p.pushConstantSize = desc.pushConstantSize_;
+			p.sharedKey    = sharedKey;
+			p.dynamicState = dynamicState;
+
+			return id.second;
+		}
+	}
+
 	vk::GraphicsPipelineCreateInfo info;
 
 	ShaderMacros macros_(desc.shaderMacros_);
 	macros_.emplace("VULKAN_FLIP", "1");
 
+	PipelineStats pipelineStats;
+	pipelineStats.name   = desc.name_;
+	pipelineStats.macros = shaderMacrosString(desc.shaderMacros_);
+
+	uint64_t shaderStart = now();
 	auto vshaderHandle = createVertexShader(desc.vertexShaderName, macros_);
 	const auto &v = vertexShaders.get(vshaderHandle);
 	auto fshaderHandle = createFragmentShader(desc.fragmentShaderName, macros_);
 	const auto &f = fragmentShaders.get(fshaderHandle);
+	pipelineStats.shaderTime = now() - shaderStart;
 
 	std::array<vk::PipelineShaderStageCreateInfo, 2> stages;
 	stages[0].stage  = vk::ShaderStageFlagBits::eVertex;
@@ -1478,6 +3033,14 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 	stages[1].module = f.shaderModule;
 	stages[1].pName  = "main";
 
+	// ids a stage doesn't declare are ignored so both get all of them
+	std::vector<vk::SpecializationMapEntry> specEntries;
+	vk::SpecializationInfo specInfo = makeSpecializationInfo(desc.specConstants_, desc.specConstantMask, specEntries);
+	if (desc.specConstantMask != 0) {
+		stages[0].pSpecializationInfo = &specInfo;
+		stages[1].pSpecializationInfo = &specInfo;
+	}
+
 	info.stageCount = 2;
 	info.pStages = &stages[0];
 
@@ -1533,7 +3096,17 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 	info.pRasterizationState        = &raster;
 
 	const auto &renderPass = renderPasses.get(desc.renderPass_);
-	info.renderPass = renderPass.renderPass;
+	vk::PipelineRenderingCreateInfoKHR renderingInfo;
+	if (dynamicRendering) {
+		renderingInfo.colorAttachmentCount    = renderPass.numColorAttachments;
+		renderingInfo.pColorAttachmentFormats = &renderPass.colorFormats[0];
+		renderingInfo.depthAttachmentFormat   = renderPass.depthFormat;
+		renderingInfo.stencilAttachmentFormat = renderPass.stencilFormat;
+		renderingInfo.viewMask                = renderPass.viewMask;
+		info.pNext      = &renderingInfo;
+	} else {
+		info.renderPass = renderPass.renderPass;
+	}
 
 	vk::PipelineMultisampleStateCreateInfo multisample;
 	multisample.rasterizationSamples = sampleCountFlagsFromNum(desc.numSamples_);
@@ -1542,7 +3115,29 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 	vk::PipelineDepthStencilStateCreateInfo ds;
 	ds.depthTestEnable  = desc.depthTest_;
 	ds.depthWriteEnable = desc.depthWrite_;
-	ds.depthCompareOp   = vk::CompareOp::eLess;
+	ds.depthCompareOp   = vulkanDepthFunc(desc.depthFunc_);
+	if (extendedDynamicState) {
+		// everything else is set in bindPipeline
+		vk::StencilOpState so;
+		so.compareMask = 0xFF;
+		so.writeMask   = 0xFF;
+
+		ds.front             = so;
+		ds.back              = so;
+	} else if (desc.stencilTest_) {
+		vk::StencilOpState so;
+		so.failOp      = vk::StencilOp::eKeep;
+		so.passOp      = vulkanStencilOp(desc.stencilPassOp_);
+		so.depthFailOp = vk::StencilOp::eKeep;
+		so.compareOp   = vulkanStencilFunc(desc.stencilFunc_);
+		so.compareMask = 0xFF;
+		so.writeMask   = 0xFF;
+		so.reference   = desc.stencilRef_;
+
+		ds.stencilTestEnable = true;
+		ds.front             = so;
+		ds.back              = so;
+	}
 	info.pDepthStencilState = &ds;
 
 	std::vector<vk::PipelineColorBlendAttachmentState> colorBlendStates;
@@ -1562,7 +3157,7 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 	}
 	vk::PipelineColorBlendStateCreateInfo blendInfo;
 	blendInfo.attachmentCount = static_cast<uint32_t>(colorBlendStates.size());
-	blendInfo.pAttachments    = &colorBlendStates[0];
+	blendInfo.pAttachments    = colorBlendStates.data();
 	if (desc.blending_ && (desc.sourceBlend_ == +BlendFunc::Constant || desc.destinationBlend_ == +BlendFunc::Constant)) {
 		// TODO: get from desc
 		for (unsigned int i = 0; i < 4; i++) {
@@ -1574,6 +3169,15 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 
 	vk::PipelineDynamicStateCreateInfo dyn;
 	std::vector<vk::DynamicState> dynStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+	if (extendedDynamicState) {
+		dynStates.push_back(vk::DynamicState::eCullModeEXT);
+		dynStates.push_back(vk::DynamicState::eDepthTestEnableEXT);
+		dynStates.push_back(vk::DynamicState::eDepthWriteEnableEXT);
+		dynStates.push_back(vk::DynamicState::eDepthCompareOpEXT);
+		dynStates.push_back(vk::DynamicState::eStencilTestEnableEXT);
+		dynStates.push_back(vk::DynamicState::eStencilOpEXT);
+		dynStates.push_back(vk::DynamicState::eStencilReference);
+	}
 	dyn.dynamicStateCount = static_cast<uint32_t>(dynStates.size());
 	dyn.pDynamicStates    = &dynStates[0];
 	info.pDynamicState    = &dyn;
@@ -1586,35 +3190,324 @@ PipelineHandle RendererImpl::createPipeline(const PipelineDesc &desc) {
 		}
 	}
 
+	// one range visible to all stages so pushConstants doesn't need stage flags
+	vk::PushConstantRange pushRange;
+	pushRange.stageFlags = vk::ShaderStageFlagBits::eAll;
+	pushRange.offset     = 0;
+	pushRange.size       = desc.pushConstantSize_;
+
 	vk::PipelineLayoutCreateInfo layoutInfo;
 	layoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
 	layoutInfo.pSetLayouts    = &layouts[0];
+	if (desc.pushConstantSize_ > 0) {
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges    = &pushRange;
+	}
 
 	auto layout = device.createPipelineLayout(layoutInfo);
 	info.layout = layout;
+	if (pipelineExecutableInfo) {
+		info.flags |= vk::PipelineCreateFlagBits::eCaptureStatisticsKHR;
+	}
 
-	auto result = device.createGraphicsPipeline(pipelineCache, info);
-	// TODO: check success instead of implicitly using result.value
+	uint64_t driverStart = now();
+	vk::Pipeline pipeline;
+	if (graphicsPipelineLibrary) {
+		// each part is keyed on the state that goes into it
+		// so a new sample count or render pass only needs a new fragment output part
+		// the view mask must match in all the shader and output parts
+		auto hashLayout = [&desc, &renderPass] (uint64_t h) {
+			h = XXH64(&renderPass.viewMask, sizeof(renderPass.viewMask), h);
+			h = XXH64(&desc.descriptorSetLayouts[0], sizeof(desc.descriptorSetLayouts), h);
+			h = XXH64(&desc.pushConstantSize_, sizeof(desc.pushConstantSize_), h);
+			h = XXH64(&desc.specConstantMask, sizeof(desc.specConstantMask), h);
+			return XXH64(desc.specConstants_.data(), desc.specConstants_.size() * sizeof(uint32_t), h);
+		};
+
+		std::array<vk::Pipeline, 4> libraries;
+		{
+			uint64_t h = XXH64(&desc.vertexAttribMask, sizeof(desc.vertexAttribMask), 1);
+			forEachSetBit(desc.vertexAttribMask, [&h, &desc] (uint32_t bit, uint32_t /* mask */) {
+				const auto &attrDesc = desc.vertexAttribs.at(bit);
+				std::array<uint32_t, 4> a = { { static_cast<uint32_t>(attrDesc.bufBinding), static_cast<uint32_t>(attrDesc.format._to_integral()), static_cast<uint32_t>(attrDesc.count), static_cast<uint32_t>(attrDesc.offset) } };
+				h = XXH64(a.data(), sizeof(a), h);
+			});
+			h = XXH64(&desc.vertexBuffers[0].stride, sizeof(desc.vertexBuffers[0].stride), h);
+			libraries[0] = getPipelineLibrary(h, vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface, info);
+		}
 
-	debugNameObject<vk::Pipeline>(result.value, desc.name_);
+		{
+			uint64_t h = hashLayout(XXH64(&v.spirvHash, sizeof(v.spirvHash), 2));
+			if (!extendedDynamicState) {
+				h = XXH64(&raster.cullMode, sizeof(raster.cullMode), h);
+			}
+			libraries[1] = getPipelineLibrary(h, vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders, info);
+		}
+
+		{
+			uint64_t h = hashLayout(XXH64(&f.spirvHash, sizeof(f.spirvHash), 3));
+			if (!extendedDynamicState) {
+				std::array<uint32_t, 6> d = { { ds.depthTestEnable, ds.depthWriteEnable, ds.stencilTestEnable, uint32_t(ds.front.passOp), uint32_t(ds.front.compareOp), ds.front.reference } };
+				h = XXH64(d.data(), sizeof(d), h);
+			}
+			libraries[2] = getPipelineLibrary(h, vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader, info);
+		}
 
-	if (amdShaderInfo) {
-		vk::ShaderStatisticsInfoAMD stats;
-		size_t dataSize = sizeof(stats);
-		// TODO: other stages
+		{
+			uint64_t h = XXH64(&renderPass.colorFormats[0], renderPass.numColorAttachments * sizeof(vk::Format), 4);
+			std::array<uint32_t, 8> o = { { renderPass.numColorAttachments, uint32_t(renderPass.depthFormat), uint32_t(renderPass.stencilFormat), desc.numSamples_, renderPass.viewMask
+			                              , desc.blending_
+			                              , desc.blending_ ? static_cast<uint32_t>(desc.sourceBlend_._to_integral())      : 0U
+			                              , desc.blending_ ? static_cast<uint32_t>(desc.destinationBlend_._to_integral()) : 0U } };
+			h = XXH64(o.data(), sizeof(o), h);
+			libraries[3] = getPipelineLibrary(h, vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface, info);
+		}
+
+		vk::PipelineLibraryCreateInfoKHR libraryInfo;
+		libraryInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+		libraryInfo.pLibraries   = libraries.data();
+
+		vk::GraphicsPipelineCreateInfo linkInfo;
+		linkInfo.pNext  = &libraryInfo;
+		linkInfo.flags  = info.flags;
+		linkInfo.layout = layout;
+		pipeline = device.createGraphicsPipeline(pipelineCache, linkInfo).value;
+
+		// libraries live until the renderer is destroyed
+		// layout is only destroyed after cancelPipelineLink has waited for this
+		auto task = std::make_shared<std::packaged_task<vk::Pipeline()> >(
+			[this, libraries, layout] () {
+				vk::PipelineLibraryCreateInfoKHR optLibraryInfo;
+				optLibraryInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+				optLibraryInfo.pLibraries   = libraries.data();
+
+				vk::GraphicsPipelineCreateInfo optInfo;
+				optInfo.pNext  = &optLibraryInfo;
+				optInfo.flags  = vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT;
+				optInfo.layout = layout;
+				try {
+					return device.createGraphicsPipeline(pipelineCache, optInfo).value;
+				} catch (std::exception &e) {
+					LOG("Link time optimized pipeline failed: %s\n", e.what());
+					return vk::Pipeline();
+				}
+			}
+		);
 
-		device.getShaderInfoAMD(result.value, vk::ShaderStageFlagBits::eVertex, vk::ShaderInfoTypeAMD::eStatistics, &dataSize, &stats, dispatcher);
-		LOG("pipeline \"%s\" vertex SGPR %u VGPR %u\n", desc.name_.c_str(), stats.resourceUsage.numUsedSgprs, stats.resourceUsage.numUsedVgprs);
+		PendingPipelineLink link;
+		link.fastPipeline = pipeline;
+		link.name         = desc.name_;
+		link.optimized    = task->get_future().share();
+		pendingPipelineLinks.emplace_back(std::move(link));
 
-		device.getShaderInfoAMD(result.value, vk::ShaderStageFlagBits::eFragment, vk::ShaderInfoTypeAMD::eStatistics, &dataSize, &stats, dispatcher);
-		LOG("pipeline \"%s\" fragment SGPR %u VGPR %u\n", desc.name_.c_str(), stats.resourceUsage.numUsedSgprs, stats.resourceUsage.numUsedVgprs);
+		runBackground([task] () { (*task)(); });
+	} else {
+		// TODO: check success instead of implicitly using the value
+		pipeline = device.createGraphicsPipeline(pipelineCache, info).value;
+	}
+	pipelineStats.driverTime = now() - driverStart;
+	// of the fast linked pipeline with graphics pipeline library
+	getExecutableStats(pipeline, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, pipelineStats);
+	addPipelineStats(pipelineStats);
+
+	debugNameObject<vk::Pipeline>(pipeline, desc.name_);
+
+	if (extendedDynamicState) {
+		SharedPipeline shared;
+		shared.pipeline = pipeline;
+		shared.layout   = layout;
+		shared.refCount = 1;
+		sharedPipelines.emplace(sharedKey, shared);
 	}
 
 	auto id = pipelines.add();
 	Pipeline &p = id.first;
-	p.pipeline = result.value;
+	p.pipeline = pipeline;
 	p.layout   = layout;
 	p.scissor  = desc.scissorTest_;
+	p.pushConstantSize = desc.pushConstantSize_;
+	p.sharedKey    = sharedKey;
+	p.dynamicState = dynamicState;
+
+	return id.second;
+}
+
+
+vk::Pipeline RendererImpl::getPipelineLibrary(uint64_t key, vk::GraphicsPipelineLibraryFlagBitsEXT part, vk::GraphicsPipelineCreateInfo info) {
+	auto it = pipelineLibraries.find(key);
+	if (it != pipelineLibraries.end()) {
+		return it->second;
+	}
+
+	// state which doesn't belong to the part is ignored
+	// but the shader stages must match it
+	switch (part) {
+	case vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders:
+		assert(info.stageCount == 2);
+		info.stageCount = 1;
+		break;
+
+	case vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader:
+		assert(info.stageCount == 2);
+		info.stageCount = 1;
+		info.pStages    = info.pStages + 1;
+		break;
+
+	case vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface:
+	case vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface:
+		info.stageCount = 0;
+		info.pStages    = nullptr;
+		break;
+	}
+
+	// in front of the vk::PipelineRenderingCreateInfoKHR
+	vk::GraphicsPipelineLibraryCreateInfoEXT libraryInfo;
+	libraryInfo.pNext = const_cast<void *>(info.pNext);
+	libraryInfo.flags = part;
+	info.pNext        = &libraryInfo;
+	info.flags       |= vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT;
+
+	auto library = device.createGraphicsPipeline(pipelineCache, info).value;
+	pipelineLibraries.emplace(key, library);
+
+	return library;
+}
+
+
+void RendererImpl::finishPipelineLinks() {
+	auto it = pendingPipelineLinks.begin();
+	while (it != pendingPipelineLinks.end()) {
+		if (it->optimized.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++it;
+			continue;
+		}
+
+		vk::Pipeline fast      = it->fastPipeline;
+		vk::Pipeline optimized = it->optimized.get();
+		if (optimized) {
+			// several handles can have it with extended dynamic state
+			bool found = false;
+			pipelines.forEach([fast, optimized, &found] (Pipeline &p) {
+				if (p.pipeline == fast) {
+					p.pipeline = optimized;
+					found      = true;
+				}
+			} );
+			for (auto &shared : sharedPipelines) {
+				if (shared.second.pipeline == fast) {
+					shared.second.pipeline = optimized;
+					found                  = true;
+				}
+			}
+
+			if (found) {
+				debugNameObject<vk::Pipeline>(optimized, it->name);
+
+				// frames in flight might still use the fast linked one
+				// layout stays with the handle
+				Pipeline old;
+				old.pipeline = fast;
+				deleteResources.emplace_back(std::move(old));
+			} else {
+				// deleted but waiting for frames in flight, it still owns the fast one
+				device.destroyPipeline(optimized);
+			}
+		}
+
+		it = pendingPipelineLinks.erase(it);
+	}
+}
+
+
+void RendererImpl::cancelPipelineLink(vk::Pipeline fastPipeline) {
+	for (auto it = pendingPipelineLinks.begin(); it != pendingPipelineLinks.end(); it++) {
+		if (it->fastPipeline == fastPipeline) {
+			// it uses the pipeline layout, wait before that is destroyed
+			vk::Pipeline optimized = it->optimized.get();
+			device.destroyPipeline(optimized);
+			pendingPipelineLinks.erase(it);
+			return;
+		}
+	}
+}
+
+
+PipelineHandle RendererImpl::createComputePipeline(const ComputePipelineDesc &desc) {
+	assert(!desc.computeShaderName.empty());
+
+	ShaderMacros macros_(desc.shaderMacros_);
+	macros_.emplace("VULKAN_FLIP", "1");
+
+	PipelineStats pipelineStats;
+	pipelineStats.name   = desc.name_;
+	pipelineStats.macros = shaderMacrosString(desc.shaderMacros_);
+
+	std::string computeShaderName = desc.computeShaderName + ".comp";
+	uint64_t shaderStart = now();
+	std::vector<uint32_t> spirv = compileSpirv(computeShaderName, macros_, ShaderKind::Compute);
+	pipelineStats.shaderTime = now() - shaderStart;
+
+	vk::ShaderModuleCreateInfo moduleInfo;
+	moduleInfo.codeSize = spirv.size() * 4;
+	moduleInfo.pCode    = &spirv[0];
+	// only needed until the pipeline is created
+	vk::ShaderModule shaderModule = device.createShaderModule(moduleInfo);
+
+	std::vector<vk::DescriptorSetLayout> layouts;
+	for (unsigned int i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+		if (desc.descriptorSetLayouts[i]) {
+			const auto &layout = dsLayouts.get(desc.descriptorSetLayouts[i]);
+			layouts.push_back(layout.layout);
+		}
+	}
+
+	// one range visible to all stages so pushConstants doesn't need stage flags
+	vk::PushConstantRange pushRange;
+	pushRange.stageFlags = vk::ShaderStageFlagBits::eAll;
+	pushRange.offset     = 0;
+	pushRange.size       = desc.pushConstantSize_;
+
+	vk::PipelineLayoutCreateInfo layoutInfo;
+	layoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+	layoutInfo.pSetLayouts    = &layouts[0];
+	if (desc.pushConstantSize_ > 0) {
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges    = &pushRange;
+	}
+
+	auto layout = device.createPipelineLayout(layoutInfo);
+
+	std::vector<vk::SpecializationMapEntry> specEntries;
+	vk::SpecializationInfo specInfo = makeSpecializationInfo(desc.specConstants_, desc.specConstantMask, specEntries);
+
+	vk::ComputePipelineCreateInfo info;
+	info.stage.stage  = vk::ShaderStageFlagBits::eCompute;
+	info.stage.module = shaderModule;
+	info.stage.pName  = "main";
+	if (desc.specConstantMask != 0) {
+		info.stage.pSpecializationInfo = &specInfo;
+	}
+	info.layout       = layout;
+	if (pipelineExecutableInfo) {
+		info.flags    = vk::PipelineCreateFlagBits::eCaptureStatisticsKHR;
+	}
+
+	uint64_t driverStart = now();
+	auto result = device.createComputePipeline(pipelineCache, info);
+	// TODO: check success instead of implicitly using result.value
+	pipelineStats.driverTime = now() - driverStart;
+	getExecutableStats(result.value, vk::ShaderStageFlagBits::eCompute, pipelineStats);
+	addPipelineStats(pipelineStats);
+	device.destroyShaderModule(shaderModule);
+
+	debugNameObject<vk::Pipeline>(result.value, desc.name_);
+
+	auto id = pipelines.add();
+	Pipeline &p = id.first;
+	p.pipeline  = result.value;
+	p.layout    = layout;
+	p.bindPoint = vk::PipelineBindPoint::eCompute;
+	p.pushConstantSize = desc.pushConstantSize_;
 
 	return id.second;
 }
@@ -1631,31 +3524,53 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 
 	vk::Format format = vulkanFormat(desc.format_);
 	vk::ImageCreateInfo info;
+	// the driver can keep compression when it knows all the formats views will use
+	std::array<vk::Format, 2> viewFormats = { { format, vk::Format::eUndefined } };
+	vk::ImageFormatListCreateInfoKHR formatList;
 	if (desc.additionalViewFormat_ != +Format::Invalid) {
 		info.flags   = vk::ImageCreateFlagBits::eMutableFormat;
+		if (imageFormatList) {
+			viewFormats[1]               = vulkanFormat(desc.additionalViewFormat_);
+			formatList.viewFormatCount   = static_cast<uint32_t>(viewFormats.size());
+			formatList.pViewFormats      = viewFormats.data();
+			info.pNext                   = &formatList;
+		}
 	}
 	info.imageType   = vk::ImageType::e2D;
 	info.format      = format;
 	info.extent      = vk::Extent3D(desc.width_, desc.height_, 1);
 	info.mipLevels   = 1;
-	info.arrayLayers = 1;
+	info.arrayLayers = desc.layers_;
 	// FIXME: validate samples against format-specific limits
 	// validation layer says: vkCreateImage(): samples VK_SAMPLE_COUNT_16_BIT is not supported by format 0x0000000F. The Vulkan spec states: samples must be a bit value that is set in imageCreateSampleCounts (as defined in Image Creation Limits).
 	// (https://www.khronos.org/registry/vulkan/specs/1.1-extensions/html/vkspec.html#VUID-VkImageCreateInfo-samples-02258)
 	info.samples     = sampleCountFlagsFromNum(desc.numSamples_);
 	// TODO: usage should come from desc
-	vk::ImageUsageFlags flags(vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+	vk::ImageUsageFlags flags;
+	if (desc.transient_) {
+		// transient attachments can't have any other usage
+		assert(!desc.storage_);
+		flags = vk::ImageUsageFlagBits::eTransientAttachment;
+	} else {
+		flags = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+	}
 	if (isDepthFormat(desc.format_)) {
 		flags |= vk::ImageUsageFlagBits::eDepthStencilAttachment;
 	} else {
 		flags |= vk::ImageUsageFlagBits::eColorAttachment;
 	}
+	if (desc.storage_) {
+		assert(!isDepthFormat(desc.format_));
+		assert(desc.numSamples_ == 1);
+		flags |= vk::ImageUsageFlagBits::eStorage;
+	}
 	info.usage       = flags;
 
 	auto result = renderTargets.add();
 	RenderTarget &rt = result.first;
 	rt.width  = desc.width_;
 	rt.height = desc.height_;
+	rt.layers = desc.layers_;
 	rt.image = device.createImage(info);
 	rt.format = desc.format_;
 
@@ -1674,12 +3589,28 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 	req.pUserData      = const_cast<char *>(desc.name_.c_str());
 	VmaAllocationInfo  allocationInfo = {};
 
-	vmaAllocateMemoryForImage(allocator, rt.image, &req, &tex.memory, &allocationInfo);
+	VkResult allocResult = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+	if (desc.transient_) {
+		// desktop GPUs usually don't have lazily allocated memory
+		VmaAllocationCreateInfo lazyReq = req;
+		lazyReq.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+		allocResult = vmaAllocateMemoryForImage(allocator, rt.image, &lazyReq, &tex.memory, &allocationInfo);
+		if (allocResult == VK_SUCCESS) {
+			LOG("Rendertarget \"%s\" is lazily allocated\n", desc.name_.c_str());
+		}
+	}
+	if (allocResult != VK_SUCCESS) {
+		allocResult = vmaAllocateMemoryForImage(allocator, rt.image, &req, &tex.memory, &allocationInfo);
+	}
+	if (allocResult != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate rendertarget memory");
+	}
+	countMemory(MemoryKind::RenderTarget, tex.memory, true);
 	device.bindImageMemory(rt.image, allocationInfo.deviceMemory, allocationInfo.offset);
 
 	vk::ImageViewCreateInfo viewInfo;
 	viewInfo.image    = rt.image;
-	viewInfo.viewType = vk::ImageViewType::e2D;
+	viewInfo.viewType = (desc.layers_ > 1) ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
 	viewInfo.format   = format;
 	if (isDepthFormat(desc.format_)) {
 		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
@@ -1687,10 +3618,18 @@ RenderTargetHandle RendererImpl::createRenderTarget(const RenderTargetDesc &desc
 		viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
 	}
 	viewInfo.subresourceRange.levelCount = 1;
-	viewInfo.subresourceRange.layerCount = 1;
-	rt.imageView = device.createImageView(viewInfo);
-	tex.imageView    = rt.imageView;
-
+	viewInfo.subresourceRange.layerCount = desc.layers_;
+	tex.imageView    = device.createImageView(viewInfo);
+
+	if (isStencilFormat(desc.format_)) {
+		// attachment view needs both aspects, sampled view can only have one
+		vk::ImageViewCreateInfo attachmentViewInfo(viewInfo);
+		attachmentViewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+		rt.imageView = device.createImageView(attachmentViewInfo);
+	} else {
+		rt.imageView = tex.imageView;
+	}
+
 	debugNameObject<vk::ImageView>(tex.imageView, desc.name_);
 
 	// TODO: std::move ?
@@ -1737,6 +3676,10 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 
 	info.magFilter = vulkanFiltermode(desc.mag);
 	info.minFilter = vulkanFiltermode(desc.min);
+	if (desc.mipmaps) {
+		info.mipmapMode = (desc.mip == +FilterMode::Linear) ? vk::SamplerMipmapMode::eLinear : vk::SamplerMipmapMode::eNearest;
+		info.maxLod     = VK_LOD_CLAMP_NONE;
+	}
 
 	vk::SamplerAddressMode m = vk::SamplerAddressMode::eClampToEdge;
 	if (desc.wrapMode == +WrapMode::Wrap) {
@@ -1756,6 +3699,30 @@ SamplerHandle RendererImpl::createSampler(const SamplerDesc &desc) {
 }
 
 
+void RendererImpl::precompileShaders(const PipelineDesc &desc) {
+	assert(!desc.vertexShaderName.empty());
+	assert(!desc.fragmentShaderName.empty());
+
+	// must match createPipeline
+	ShaderMacros macros_(desc.shaderMacros_);
+	macros_.emplace("VULKAN_FLIP", "1");
+
+	compileSpirvAsync(desc.vertexShaderName   + ".vert", macros_, ShaderKind::Vertex);
+	compileSpirvAsync(desc.fragmentShaderName + ".frag", macros_, ShaderKind::Fragment);
+}
+
+
+void RendererImpl::precompileShaders(const ComputePipelineDesc &desc) {
+	assert(!desc.computeShaderName.empty());
+
+	// must match createComputePipeline
+	ShaderMacros macros_(desc.shaderMacros_);
+	macros_.emplace("VULKAN_FLIP", "1");
+
+	compileSpirvAsync(desc.computeShaderName + ".comp", macros_, ShaderKind::Compute);
+}
+
+
 VertexShaderHandle RendererImpl::createVertexShader(const std::string &name, const ShaderMacros &macros) {
 	std::string vertexShaderName   = name + ".vert";
 
@@ -1768,6 +3735,7 @@ VertexShaderHandle RendererImpl::createVertexShader(const std::string &name, con
 	info.codeSize = spirv.size() * 4;
 	info.pCode    = &spirv[0];
 	v.shaderModule = device.createShaderModule(info);
+	v.spirvHash    = XXH64(spirv.data(), spirv.size() * sizeof(uint32_t), 0);
 
 		// TODO: add macros to name
 	debugNameObject<vk::ShaderModule>(v.shaderModule, vertexShaderName);
@@ -1788,6 +3756,7 @@ FragmentShaderHandle RendererImpl::createFragmentShader(const std::string &name,
 	info.codeSize = spirv.size() * 4;
 	info.pCode    = &spirv[0];
 	f.shaderModule = device.createShaderModule(info);
+	f.spirvHash    = XXH64(spirv.data(), spirv.size() * sizeof(uint32_t), 0);
 
 		// TODO: add macros to name
 	debugNameObject<vk::ShaderModule>(f.shaderModule, fragmentShaderName);
@@ -1805,22 +3774,41 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 
 	vk::Format format = vulkanFormat(desc.format_);
 
+	unsigned int numMips = desc.numMips_;
+	if (desc.generateMips_) {
+		assert(desc.numMips_ == 1);
+		assert(!isCompressedFormat(desc.format_));
+
+		const vk::FormatFeatureFlags blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+		if ((physicalDevice.getFormatProperties(format).optimalTilingFeatures & blitFeatures) == blitFeatures) {
+			numMips = mipChainLength(desc.width_, desc.height_);
+		} else {
+			LOG("Can't blit format %s, no mips for texture \"%s\"\n", desc.format_._to_string(), desc.name_.c_str());
+		}
+	}
+	bool generateMips = (numMips > desc.numMips_);
+
 	vk::ImageCreateInfo info;
 	info.imageType   = vk::ImageType::e2D;
 	info.format      = format;
 	info.extent      = vk::Extent3D(desc.width_, desc.height_, 1);
-	info.mipLevels   = desc.numMips_;
+	info.mipLevels   = numMips;
 	info.arrayLayers = 1;
 
 	vk::ImageUsageFlags flags(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
+	if (generateMips) {
+		flags |= vk::ImageUsageFlagBits::eTransferSrc;
+	}
 	assert(!isDepthFormat(desc.format_));
 	info.usage       = flags;
 
 	auto result = textures.add();
 	Texture &tex = result.first;
-	tex.width  = desc.width_;
-	tex.height = desc.height_;
-	tex.image  = device.createImage(info);
+	tex.width   = desc.width_;
+	tex.height  = desc.height_;
+	tex.format  = desc.format_;
+	tex.numMips = numMips;
+	tex.image   = device.createImage(info);
 
 	VmaAllocationCreateInfo  req = {};
 	req.usage          = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -1829,9 +3817,10 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	VmaAllocationInfo  allocationInfo = {};
 
 	vmaAllocateMemoryForImage(allocator, tex.image, &req, &tex.memory, &allocationInfo);
-	LOG("texture image memory type: %u\n",   allocationInfo.memoryType);
-	LOG("texture image memory offset: %u\n", static_cast<unsigned int>(allocationInfo.offset));
-	LOG("texture image memory size: %u\n",   static_cast<unsigned int>(allocationInfo.size));
+	countMemory(MemoryKind::Texture, tex.memory, true);
+	LOG_DEBUG("texture image memory type: %u\n",   allocationInfo.memoryType);
+	LOG_DEBUG("texture image memory offset: %u\n", static_cast<unsigned int>(allocationInfo.offset));
+	LOG_DEBUG("texture image memory size: %u\n",   static_cast<unsigned int>(allocationInfo.size));
 	device.bindImageMemory(tex.image, allocationInfo.deviceMemory, allocationInfo.offset);
 
 	vk::ImageViewCreateInfo viewInfo;
@@ -1839,13 +3828,37 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	viewInfo.viewType = vk::ImageViewType::e2D;
 	viewInfo.format   = format;
 	viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-	viewInfo.subresourceRange.levelCount = desc.numMips_;
+	viewInfo.subresourceRange.levelCount = numMips;
 	viewInfo.subresourceRange.layerCount = 1;
 	tex.imageView = device.createImageView(viewInfo);
 
 	debugNameObject<vk::Image>(tex.image, desc.name_);
 	debugNameObject<vk::ImageView>(tex.imageView, desc.name_);
 
+	if (features.textureTable) {
+		std::lock_guard<std::mutex> lock(resourceMutex);
+		if (freeTextureTableIndices.empty()) {
+			LOG("Texture table is full\n");
+			throw std::runtime_error("Texture table is full");
+		}
+		tex.tableIndex = freeTextureTableIndices.back();
+		freeTextureTableIndices.pop_back();
+
+		// layout is what the upload below leaves it in
+		vk::DescriptorImageInfo imgInfo;
+		imgInfo.imageView       = tex.imageView;
+		imgInfo.imageLayout     = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+		vk::WriteDescriptorSet write;
+		write.dstSet            = textureTable;
+		write.dstBinding        = 0;
+		write.dstArrayElement   = tex.tableIndex;
+		write.descriptorCount   = 1;
+		write.descriptorType    = vk::DescriptorType::eSampledImage;
+		write.pImageInfo        = &imgInfo;
+		device.updateDescriptorSets(1, &write, 0, nullptr);
+	}
+
 	// TODO: reuse command buffer for multiple copies
 	unsigned int w = desc.width_, h = desc.height_;
 	unsigned int bufferSize = 0;
@@ -1853,12 +3866,12 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 	std::vector<vk::BufferImageCopy> regions;
 	regions.reserve(desc.numMips_);
 	for (unsigned int i = 0; i < desc.numMips_; i++) {
-		assert(desc.mipData_[i].data != nullptr);
-		assert(desc.mipData_[i].size != 0);
-		unsigned int size = desc.mipData_[i].size;
+		unsigned int size = desc.mipLevelSize(i);
+		assert(!isCompressedFormat(desc.format_) || size == formatDataSize(desc.format_, w, h));
 
 		vk::ImageSubresourceLayers layers;
 		layers.aspectMask = vk::ImageAspectFlagBits::eColor;
+		layers.mipLevel   = i;
 		layers.layerCount = 1;
 
 		vk::BufferImageCopy region;
@@ -1878,8 +3891,18 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 		h = std::max(h / 2, 1u);
 	}
 
-	UploadOp op = allocateUploadOp(bufferSize);
-	op.semWaitMask = vk::PipelineStageFlagBits::eFragmentShader;
+	std::unique_lock<std::mutex> uploadLock;
+	UploadOp *currentOp = &beginUpload(uploadLock);
+	// presentFrame skips this thread's op while the writer runs
+	// resources recorded before and already handed out can't wait for it
+	if (desc.mipWriter_ && currentOp->context && currentOp->numCopies > 0) {
+		closeThreadUpload(*currentOp);
+		uploadLock.unlock();
+		currentOp = &beginUpload(uploadLock);
+	}
+	UploadOp &op = *currentOp;
+	StagingAllocation staging = allocateStaging(op, bufferSize);
+	op.semWaitMask |= vk::PipelineStageFlagBits::eFragmentShader;
 
 	// transition to transfer destination
 	{
@@ -1904,48 +3927,141 @@ TextureHandle RendererImpl::createTexture(const TextureDesc &desc) {
 		// TODO: relax stage flag bits
 		op.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { barrier });
 
-		char *mappedPtr = static_cast<char *>(op.allocationInfo.pMappedData);
+		const bool writing = desc.mipWriter_ && op.context;
+		if (writing) {
+			op.context->writing.store(true);
+		}
 		for (unsigned int i = 0; i < desc.numMips_; i++) {
 			// copy contents to GPU memory
-			memcpy(mappedPtr + regions[i].bufferOffset, desc.mipData_[i].data, desc.mipData_[i].size);
+			desc.writeMipLevel(i, staging.ptr + regions[i].bufferOffset);
+			regions[i].bufferOffset += staging.offset;
+		}
+		if (writing) {
+			op.context->writing.store(false);
 		}
 
-		vmaFlushAllocation(allocator, op.memory, 0, bufferSize);
-
-		op.cmdBuf.copyBufferToImage(op.stagingBuffer, tex.image, vk::ImageLayout::eTransferDstOptimal, regions);
-
-		// transition to shader use
-		barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
-		barrier.dstAccessMask       = vk::AccessFlagBits::eMemoryRead;
-		barrier.oldLayout           = vk::ImageLayout::eTransferDstOptimal;
-		barrier.newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
-		if (transferQueueIndex != graphicsQueueIndex) {
-			barrier.srcQueueFamilyIndex = transferQueueIndex;
-			barrier.dstQueueFamilyIndex = graphicsQueueIndex;
+		vmaFlushAllocation(allocator, staging.memory, staging.offset, bufferSize);
+
+		op.cmdBuf.copyBufferToImage(staging.buffer, tex.image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+		if (generateMips) {
+			MipGeneration gen;
+			gen.image   = tex.image;
+			gen.width   = desc.width_;
+			gen.height  = desc.height_;
+			gen.numMips = numMips;
+
+			if (transferQueueIndex != graphicsQueueIndex) {
+				// release to the graphics queue as is, presentFrame blits after acquiring
+				barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+				barrier.dstAccessMask       = vk::AccessFlagBits();
+				barrier.oldLayout           = vk::ImageLayout::eTransferDstOptimal;
+				barrier.newLayout           = vk::ImageLayout::eTransferDstOptimal;
+				barrier.srcQueueFamilyIndex = transferQueueIndex;
+				barrier.dstQueueFamilyIndex = graphicsQueueIndex;
+				op.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags(), {}, {}, { barrier });
+
+				// the blits are transfers so the frame must wait for the upload before them
+				op.semWaitMask |= vk::PipelineStageFlagBits::eTransfer;
+				op.mipGenerations.push_back(gen);
+			} else {
+				recordMipGeneration(op.cmdBuf, gen, false);
+			}
 		} else {
-			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		}
+			// transition to shader use
+			barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+			barrier.dstAccessMask       = vk::AccessFlagBits::eMemoryRead;
+			barrier.oldLayout           = vk::ImageLayout::eTransferDstOptimal;
+			barrier.newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
+			if (transferQueueIndex != graphicsQueueIndex) {
+				barrier.srcQueueFamilyIndex = transferQueueIndex;
+				barrier.dstQueueFamilyIndex = graphicsQueueIndex;
+			} else {
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			}
 
-		op.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), {}, {}, { barrier });
+			op.cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), {}, {}, { barrier });
 
-		if (transferQueueIndex != graphicsQueueIndex) {
-			op.imageAcquireBarriers.push_back(barrier);
+			if (transferQueueIndex != graphicsQueueIndex) {
+				op.imageAcquireBarriers.push_back(barrier);
+			}
 		}
 	}
+	op.numCopies++;
 
-	submitUploadOp(std::move(op));
+	finishUpload(op);
 
 	return result.second;
 }
 
 
+static DescriptorKind descriptorKind(DescriptorType type) {
+	switch (type) {
+	case DescriptorType::UniformBuffer:
+	case DescriptorType::StorageBuffer:
+		return DescriptorKind::Buffer;
+
+	case DescriptorType::UniformBufferDynamic:
+	case DescriptorType::StorageBufferDynamic:
+		return DescriptorKind::DynamicBuffer;
+
+	case DescriptorType::Sampler:
+		return DescriptorKind::Sampler;
+
+	case DescriptorType::Texture:
+		return DescriptorKind::Texture;
+
+	case DescriptorType::CombinedSampler:
+		return DescriptorKind::CombinedSampler;
+
+	case DescriptorType::StorageImage:
+		return DescriptorKind::StorageImage;
+
+	case DescriptorType::End:
+	case DescriptorType::Empty:
+	case DescriptorType::TextureTable:
+		break;
+	}
+
+	UNREACHABLE();
+	return DescriptorKind::Count;
+}
+
+
 DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *layout) {
 	std::vector<vk::DescriptorSetLayoutBinding> bindings;
 
+	if (layout->type == +DescriptorType::TextureTable) {
+		assert(layout[1].type == +DescriptorType::End);
+		if (!features.textureTable) {
+			LOG("TextureTable descriptor used but not supported\n");
+			throw std::runtime_error("TextureTable descriptor used but not supported");
+		}
+
+		// all sets share the global table layout
+		auto result = dsLayouts.add();
+		DescriptorSetLayout &dsLayout = result.first;
+		dsLayout.layout       = textureTableLayout;
+		dsLayout.textureTable = true;
+		dsLayout.descriptors.push_back(*layout);
+
+		return result.second;
+	}
+
 	unsigned int i = 0;
 	std::vector<DescriptorLayout> descriptors;
 	while (layout->type != +DescriptorType::End) {
+		assert(layout->type != +DescriptorType::TextureTable);
+		descriptors.push_back(*layout);
+
+		if (layout->type == +DescriptorType::Empty) {
+			// keeps its binding number but isn't part of the Vulkan layout
+			layout++;
+			i++;
+			continue;
+		}
+
 		vk::DescriptorSetLayoutBinding b;
 
 		b.binding         = i;
@@ -1956,20 +4072,46 @@ DSLayoutHandle RendererImpl::createDescriptorSetLayout(const DescriptorLayout *l
 		b.stageFlags      = vk::ShaderStageFlagBits::eAll;
 
 		bindings.push_back(b);
-		descriptors.push_back(*layout);
 
 		layout++;
 		i++;
 	}
 	assert(layout->offset == 0);
+	assert(descriptors.size() <= MAX_DESCRIPTORS);
 
 	vk::DescriptorSetLayoutCreateInfo info;
 	info.bindingCount = static_cast<uint32_t>(bindings.size());
-	info.pBindings    = &bindings[0];
+	info.pBindings    = bindings.data();
 
 	auto result = dsLayouts.add();
 	DescriptorSetLayout &dsLayout = result.first;
 	dsLayout.layout = device.createDescriptorSetLayout(info);
+
+	// dynamic offsets are in binding order so each kind must keep it
+	unsigned int numSlots = 0;
+	for (unsigned int k = 0; k < static_cast<unsigned int>(DescriptorKind::Count); k++) {
+		dsLayout.kindStart[k] = static_cast<uint8_t>(numSlots);
+		for (unsigned int b = 0; b < descriptors.size(); b++) {
+			const auto &d = descriptors[b];
+			if (d.type == +DescriptorType::Empty || static_cast<unsigned int>(descriptorKind(d.type)) != k) {
+				continue;
+			}
+
+			auto &slot   = dsLayout.slots[numSlots];
+			slot.binding = b;
+			slot.offset  = d.offset;
+
+			auto &write           = dsLayout.writes[numSlots];
+			write.dstBinding      = b;
+			write.descriptorCount = 1;
+			write.descriptorType  = descriptorTypes[uint8_t(d.type) - 1];
+
+			numSlots++;
+		}
+	}
+	dsLayout.kindStart[static_cast<unsigned int>(DescriptorKind::Count)] = static_cast<uint8_t>(numSlots);
+	assert(numSlots == bindings.size());
+
 	dsLayout.descriptors = std::move(descriptors);
 
 	return result.second;
@@ -2001,7 +4143,27 @@ TextureHandle RendererImpl::getRenderTargetView(RenderTargetHandle handle, Forma
 }
 
 
+RenderTargetHandle RendererImpl::getSwapchainRenderTarget() const {
+	assert(inFrame);
+	assert(features.swapchainRenderTarget);
+
+	return swapchainRenderTargets.at(currentImageIdx);
+}
+
+
+unsigned int RendererImpl::getTextureTableIndex(TextureHandle handle) const {
+	assert(features.textureTable);
+
+	const auto &tex = textures.get(handle);
+	assert(!tex.renderTarget);
+	assert(tex.tableIndex < MAX_TEXTURE_TABLE_SIZE);
+
+	return tex.tableIndex;
+}
+
+
 void RendererImpl::deleteBuffer(BufferHandle handle) {
+	assert(!EphemeralBuffer::isEphemeral(handle));
 	buffers.removeWith(handle, [this](struct Buffer &b) {
 		// TODO: if b.lastUsedFrame has already been synced we could delete immediately
 		this->deleteResources.emplace_back(std::move(b));
@@ -2062,7 +4224,9 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 
 	if (swapchainDesc.fullscreen != desc.fullscreen) {
 		changed = true;
-		if (desc.fullscreen) {
+		if (offscreen) {
+			// nothing to show fullscreen
+		} else if (desc.fullscreen) {
 			// TODO: check return val?
 			SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
 			LOG("Fullscreen\n");
@@ -2080,6 +4244,18 @@ void RendererImpl::setSwapchainDesc(const SwapchainDesc &desc) {
 		changed = true;
 	}
 
+	if (swapchainDesc.framesInFlight != desc.framesInFlight) {
+		changed = true;
+	}
+
+	if (swapchainDesc.preTransform != desc.preTransform) {
+		changed = true;
+	}
+
+	if (swapchainDesc.incrementalPresent != desc.incrementalPresent) {
+		changed = true;
+	}
+
 	if (swapchainDesc.width     != desc.width) {
 		changed = true;
 	}
@@ -2148,6 +4324,7 @@ unsigned int RendererImpl::bufferAlignment(BufferType type) {
 		break;
 
 	case BufferType::Storage:
+	case BufferType::Indirect:
 		return ssboAlign;
 		break;
 
@@ -2170,6 +4347,10 @@ unsigned int RendererImpl::bufferAlignment(BufferType type) {
 
 
 glm::uvec2 RendererImpl::getDrawableSize() const {
+	if (offscreen) {
+		return glm::uvec2(wantedSwapchain.width, wantedSwapchain.height);
+	}
+
 	int w = -1, h = -1;
 	SDL_Vulkan_GetDrawableSize(window, &w, &h);
 	if (w <= 0 || h <= 0) {
@@ -2183,75 +4364,90 @@ glm::uvec2 RendererImpl::getDrawableSize() const {
 bool RendererImpl::recreateSwapchain() {
 	assert(swapchainDirty);
 
-	// check for idle, make caller deal if not
-	if (!waitForDeviceIdle()) {
-		return false;
-	}
+	// the old swapchain can't be replaced while a present to it is queued
+	waitSubmitThread();
 
-	surfaceCapabilities = physicalDevice.getSurfaceCapabilitiesKHR(surface);
-	LOG("image count min-max %u - %u\n", surfaceCapabilities.minImageCount, surfaceCapabilities.maxImageCount);
-	LOG("image extent min-max %ux%u - %ux%u\n", surfaceCapabilities.minImageExtent.width, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.width, surfaceCapabilities.maxImageExtent.height);
-	LOG("current image extent %ux%u\n", surfaceCapabilities.currentExtent.width, surfaceCapabilities.currentExtent.height);
-	LOG("supported surface transforms: %s\n", vk::to_string(surfaceCapabilities.supportedTransforms).c_str());
-	LOG("supported surface alpha composite flags: %s\n", vk::to_string(surfaceCapabilities.supportedCompositeAlpha).c_str());
-	LOG("supported surface usage flags: %s\n", vk::to_string(surfaceCapabilities.supportedUsageFlags).c_str());
+	// frames in flight can keep going, the old swapchain and its views
+	// are retired like deleted resources
 
-	int tempW = -1, tempH = -1;
-	SDL_Vulkan_GetDrawableSize(window, &tempW, &tempH);
-	if (tempW <= 0 || tempH <= 0) {
-		throw std::runtime_error("drawable size is negative");
-	}
+	unsigned int numImages = 0;
+	if (offscreen) {
+		// any size the device can render to, not limited by a display
+		if (wantedSwapchain.width == 0 || wantedSwapchain.height == 0) {
+			throw std::runtime_error("offscreen size is zero");
+		}
+		unsigned int maxSize = deviceProperties.limits.maxImageDimension2D;
+		if (wantedSwapchain.width > maxSize || wantedSwapchain.height > maxSize) {
+			LOG("Offscreen size %ux%u is over the device limit %u\n", wantedSwapchain.width, wantedSwapchain.height, maxSize);
+			throw std::runtime_error("offscreen size too large");
+		}
+		swapchainDesc.width  = wantedSwapchain.width;
+		swapchainDesc.height = wantedSwapchain.height;
 
-	// this is nasty but apparently surface might not have resized yet
-	// FIXME: find a better way
-	unsigned int w = std::max(surfaceCapabilities.minImageExtent.width,  std::min(static_cast<unsigned int>(tempW), surfaceCapabilities.maxImageExtent.width));
-	unsigned int h = std::max(surfaceCapabilities.minImageExtent.height, std::min(static_cast<unsigned int>(tempH), surfaceCapabilities.maxImageExtent.height));
+		numImages = std::max(wantedSwapchain.numFrames, 1U);
+	} else {
+		surfaceCapabilities = physicalDevice.getSurfaceCapabilitiesKHR(surface);
+		LOG("image count min-max %u - %u\n", surfaceCapabilities.minImageCount, surfaceCapabilities.maxImageCount);
+		LOG("image extent min-max %ux%u - %ux%u\n", surfaceCapabilities.minImageExtent.width, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.width, surfaceCapabilities.maxImageExtent.height);
+		LOG("current image extent %ux%u\n", surfaceCapabilities.currentExtent.width, surfaceCapabilities.currentExtent.height);
+		LOG("supported surface transforms: %s\n", vk::to_string(surfaceCapabilities.supportedTransforms).c_str());
+		LOG("supported surface alpha composite flags: %s\n", vk::to_string(surfaceCapabilities.supportedCompositeAlpha).c_str());
+		LOG("supported surface usage flags: %s\n", vk::to_string(surfaceCapabilities.supportedUsageFlags).c_str());
+
+		int tempW = -1, tempH = -1;
+		SDL_Vulkan_GetDrawableSize(window, &tempW, &tempH);
+		if (tempW <= 0 || tempH <= 0) {
+			throw std::runtime_error("drawable size is negative");
+		}
 
-	swapchainDesc.width  = w;
-	swapchainDesc.height = h;
+		// this is nasty but apparently surface might not have resized yet
+		// FIXME: find a better way
+		unsigned int w = std::max(surfaceCapabilities.minImageExtent.width,  std::min(static_cast<unsigned int>(tempW), surfaceCapabilities.maxImageExtent.width));
+		unsigned int h = std::max(surfaceCapabilities.minImageExtent.height, std::min(static_cast<unsigned int>(tempH), surfaceCapabilities.maxImageExtent.height));
 
-	unsigned int numImages = wantedSwapchain.numFrames;
-	numImages = std::max(numImages, surfaceCapabilities.minImageCount);
-	if (surfaceCapabilities.maxImageCount != 0) {
-		numImages = std::min(numImages, surfaceCapabilities.maxImageCount);
+		swapchainDesc.width  = w;
+		swapchainDesc.height = h;
+
+		numImages = std::max(wantedSwapchain.numFrames, surfaceCapabilities.minImageCount);
+		if (surfaceCapabilities.maxImageCount != 0) {
+			numImages = std::min(numImages, surfaceCapabilities.maxImageCount);
+		}
 	}
 
 	LOG("Want %u images, using %u images\n", wantedSwapchain.numFrames, numImages);
 
-	swapchainDesc.fullscreen = wantedSwapchain.fullscreen;
-	swapchainDesc.numFrames  = numImages;
-	swapchainDesc.vsync      = wantedSwapchain.vsync;
+	unsigned int numFrames = (wantedSwapchain.framesInFlight != 0) ? wantedSwapchain.framesInFlight : numImages;
+	LOG("%u frames in flight\n", numFrames);
+
+	swapchainDesc.fullscreen     = wantedSwapchain.fullscreen;
+	swapchainDesc.numFrames      = numImages;
+	swapchainDesc.framesInFlight = wantedSwapchain.framesInFlight;
+	swapchainDesc.vsync          = wantedSwapchain.vsync;
+	// what was asked for, presentFrame checks what's supported
+	swapchainDesc.preTransform       = wantedSwapchain.preTransform;
+	swapchainDesc.incrementalPresent = wantedSwapchain.incrementalPresent;
+
+	if (frames.size() != numFrames) {
+		// can't add or remove frames under the GPU
+		// check for idle, make caller deal if not
+		if (!waitForDeviceIdle()) {
+			return false;
+		}
 
-	if (frames.size() != numImages) {
-		if (numImages < frames.size()) {
+		if (numFrames < frames.size()) {
 			// decreasing, delete old and resize
-			for (unsigned int i = numImages; i < frames.size(); i++) {
+			for (unsigned int i = numFrames; i < frames.size(); i++) {
 				auto &f = frames.at(i);
 				assert(f.status == Frame::Status::Ready);
 
 				// delete contents of Frame
 				deleteFrameInternal(f);
 			}
-			frames.resize(numImages);
+			frames.resize(numFrames);
 		} else {
 			// increasing, resize and initialize new
 			unsigned int oldSize = static_cast<unsigned int>(frames.size());
-			frames.resize(numImages);
-
-			// descriptor pool
-			// TODO: these limits are arbitrary, find better ones
-			std::vector<vk::DescriptorPoolSize> poolSizes;
-			for (const auto t : descriptorTypes ) {
-				vk::DescriptorPoolSize s;
-				s.type            = t;
-				s.descriptorCount = 32;
-				poolSizes.push_back(s);
-			}
-
-			vk::DescriptorPoolCreateInfo dsInfo;
-			dsInfo.maxSets       = 256;
-			dsInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-			dsInfo.pPoolSizes    = &poolSizes[0];
+			frames.resize(numFrames);
 
 			vk::CommandPoolCreateInfo cp;
 			cp.queueFamilyIndex = graphicsQueueIndex;
@@ -2259,31 +4455,75 @@ bool RendererImpl::recreateSwapchain() {
 			for (unsigned int i = oldSize; i < frames.size(); i++) {
 				auto &f = frames.at(i);
 				assert(!f.fence);
-				f.fence = device.createFence(vk::FenceCreateInfo());
-
-				// we fill this in after we've created the swapchain
-				assert(!f.image);
+				f.fence = allocateFence();
 
-				assert(!f.dsPool);
-				f.dsPool = device.createDescriptorPool(dsInfo);
+				assert(f.dsPools.empty());
+				resetDescriptorPools(f);
 
 				assert(!f.commandPool);
 				f.commandPool = device.createCommandPool(cp);
 
 				assert(!f.commandBuffer);
-				assert(!f.presentCmdBuf);
 				assert(!f.barrierCmdBuf);
 				// create command buffer
-				vk::CommandBufferAllocateInfo info(f.commandPool, vk::CommandBufferLevel::ePrimary, 3);
+				vk::CommandBufferAllocateInfo info(f.commandPool, vk::CommandBufferLevel::ePrimary, 2);
 				auto bufs = device.allocateCommandBuffers(info);
-				assert(bufs.size() == 3);
+				assert(bufs.size() == 2);
 				f.commandBuffer = bufs.at(0);
-				f.presentCmdBuf = bufs.at(1);
-				f.barrierCmdBuf = bufs.at(2);
+				f.barrierCmdBuf = bufs.at(1);
+
+				assert(!f.computeCmdBuf);
+				assert(!f.postCmdBuf);
+				if (features.asyncCompute) {
+					info.commandBufferCount = 2;
+					bufs = device.allocateCommandBuffers(info);
+					assert(bufs.size() == 2);
+					f.computeCmdBuf = bufs.at(0);
+					f.postCmdBuf    = bufs.at(1);
+				}
+
+				assert(!f.timestampPool);
+				if (timestamps) {
+					vk::QueryPoolCreateInfo qp;
+					qp.queryType  = vk::QueryType::eTimestamp;
+					qp.queryCount = 2 * MAX_GPU_TIMERS;
+					f.timestampPool = device.createQueryPool(qp);
+				}
+
+				assert(!f.statisticsPool);
+				if (pipelineStatistics) {
+					vk::QueryPoolCreateInfo qp;
+					qp.queryType          = vk::QueryType::ePipelineStatistics;
+					qp.queryCount         = MAX_GPU_TIMERS;
+					qp.pipelineStatistics = statisticsFlags;
+					f.statisticsPool = device.createQueryPool(qp);
+				}
+
+				assert(!f.performancePool);
+				if (!performanceCounterIndices.empty()) {
+					vk::StructureChain<vk::QueryPoolCreateInfo, vk::QueryPoolPerformanceCreateInfoKHR> qpChain;
+					auto &qp = qpChain.get<vk::QueryPoolCreateInfo>();
+					qp.queryType  = vk::QueryType::ePerformanceQueryKHR;
+					qp.queryCount = MAX_GPU_TIMERS;
+					auto &perf = qpChain.get<vk::QueryPoolPerformanceCreateInfoKHR>();
+					perf.queueFamilyIndex  = graphicsQueueIndex;
+					perf.counterIndexCount = static_cast<uint32_t>(performanceCounterIndices.size());
+					perf.pCounterIndices   = performanceCounterIndices.data();
+					f.performancePool = device.createQueryPool(qp);
+				}
 			}
 		}
 	}
 
+	if (offscreen) {
+		// no swapchain images, the rendertarget given to presentFrame is the final image
+		features.sRGBFramebuffer       = true;
+		features.swapchainRenderTarget = false;
+		swapchainDirty = false;
+
+		return true;
+	}
+
 	vk::Extent2D imageExtent;
 	// TODO: check against min and max
 	imageExtent.width  = swapchainDesc.width;
@@ -2293,8 +4533,26 @@ bool RendererImpl::recreateSwapchain() {
 		LOG("warning: identity transform not supported\n");
 	}
 
-	if (surfaceCapabilities.currentTransform != vk::SurfaceTransformFlagBitsKHR::eIdentity) {
+	// presentFrame's blit can mirror the image but not rotate it by 90 degrees
+	swapchainTransform = vk::SurfaceTransformFlagBitsKHR::eIdentity;
+	switch (surfaceCapabilities.currentTransform) {
+	case vk::SurfaceTransformFlagBitsKHR::eIdentity:
+		break;
+
+	case vk::SurfaceTransformFlagBitsKHR::eRotate180:
+	case vk::SurfaceTransformFlagBitsKHR::eHorizontalMirror:
+	case vk::SurfaceTransformFlagBitsKHR::eHorizontalMirrorRotate180:
+		if (wantedSwapchain.preTransform) {
+			swapchainTransform = surfaceCapabilities.currentTransform;
+			LOG("Pre-transforming to %s\n", vk::to_string(swapchainTransform).c_str());
+			break;
+		}
 		LOG("warning: current transform is not identity\n");
+		break;
+
+	default:
+		LOG("warning: current transform %s is not identity and can't be pre-transformed\n", vk::to_string(surfaceCapabilities.currentTransform).c_str());
+		break;
 	}
 
 	if (!(surfaceCapabilities.supportedCompositeAlpha & vk::CompositeAlphaFlagBitsKHR::eOpaque)) {
@@ -2317,11 +4575,18 @@ bool RendererImpl::recreateSwapchain() {
 	LOG("Using present mode %s\n", vk::to_string(swapchainPresentMode).c_str());
 
 	// TODO: should fallback to Unorm and communicate back to demo
-	vk::Format surfaceFormat = vk::Format::eB8G8R8A8Srgb;
+	// RGBA matches Format::sRGBA8 so it can be rendered to directly
+	vk::Format surfaceFormat = vk::Format::eR8G8B8A8Srgb;
 	if (surfaceFormats.find(surfaceFormat) == surfaceFormats.end()) {
-		throw std::runtime_error("No sRGB format backbuffer support");
+		surfaceFormat = vk::Format::eB8G8R8A8Srgb;
+		if (surfaceFormats.find(surfaceFormat) == surfaceFormats.end()) {
+			throw std::runtime_error("No sRGB format backbuffer support");
+		}
 	}
-	features.sRGBFramebuffer = true;
+	features.sRGBFramebuffer       = true;
+	// rendering directly would skip the blit which does the pre-transform
+	features.swapchainRenderTarget = (surfaceFormat == vk::Format::eR8G8B8A8Srgb) && (swapchainTransform == vk::SurfaceTransformFlagBitsKHR::eIdentity);
+	LOG("Swapchain format %s, %s\n", vk::to_string(surfaceFormat).c_str(), features.swapchainRenderTarget ? "rendering directly" : "blitting at present");
 
 	vk::SwapchainCreateInfoKHR swapchainCreateInfo;
 	swapchainCreateInfo.flags                 = vk::SwapchainCreateFlagBitsKHR();
@@ -2331,14 +4596,15 @@ bool RendererImpl::recreateSwapchain() {
 	swapchainCreateInfo.imageColorSpace       = vk::ColorSpaceKHR::eSrgbNonlinear;
 	swapchainCreateInfo.imageExtent           = imageExtent;
 	swapchainCreateInfo.imageArrayLayers      = 1;
-	swapchainCreateInfo.imageUsage            = vk::ImageUsageFlagBits::eTransferDst;
+	// color attachment usage is always supported
+	swapchainCreateInfo.imageUsage            = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eColorAttachment;
 
 	// no concurrent access
 	swapchainCreateInfo.imageSharingMode      = vk::SharingMode::eExclusive;
 	swapchainCreateInfo.queueFamilyIndexCount = 0;
 	swapchainCreateInfo.pQueueFamilyIndices   = nullptr;
 
-	swapchainCreateInfo.preTransform          = vk::SurfaceTransformFlagBitsKHR::eIdentity;
+	swapchainCreateInfo.preTransform          = swapchainTransform;
 	swapchainCreateInfo.compositeAlpha        = vk::CompositeAlphaFlagBitsKHR::eOpaque;
 	swapchainCreateInfo.presentMode           = swapchainPresentMode;
 	swapchainCreateInfo.clipped               = true;
@@ -2346,18 +4612,51 @@ bool RendererImpl::recreateSwapchain() {
 
 	vk::SwapchainKHR newSwapchain = device.createSwapchainKHR(swapchainCreateInfo);
 
+	// views of the old images must go before the old swapchain
+	// handles get a new generation so stale framebuffers are never matched
+	deleteSwapchainRenderTargets();
+
 	if (swapchain) {
-		device.destroySwapchainKHR(swapchain);
+		// images already presented from it can still be in use
+		retiredSwapchains.emplace_back(frameNum, swapchain);
 	}
 	swapchain = newSwapchain;
 
-	std::vector<vk::Image> swapchainImages = device.getSwapchainImagesKHR(swapchain);
-	// TODO: implementation doesn't have to obey size, should resize here
-	assert(swapchainImages.size() == frames.size());
-	assert(swapchainImages.size() == numImages);
+	// implementation may give us more than we asked for
+	swapchainImages = device.getSwapchainImagesKHR(swapchain);
+	numImages       = static_cast<unsigned int>(swapchainImages.size());
+	swapchainDesc.numFrames = numImages;
+
+	if (features.swapchainRenderTarget) {
+		swapchainRenderTargets.reserve(numImages);
+		for (unsigned int i = 0; i < numImages; i++) {
+			auto result      = renderTargets.add();
+			RenderTarget &rt = result.first;
+			rt.width         = swapchainDesc.width;
+			rt.height        = swapchainDesc.height;
+			rt.layers        = 1;
+			rt.image         = swapchainImages.at(i);
+			rt.format        = Format::sRGBA8;
+
+			vk::ImageViewCreateInfo viewInfo;
+			viewInfo.image                       = rt.image;
+			viewInfo.viewType                    = vk::ImageViewType::e2D;
+			viewInfo.format                      = surfaceFormat;
+			viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.layerCount = 1;
+			rt.imageView = device.createImageView(viewInfo);
+
+			swapchainRenderTargets.push_back(result.second);
+		}
+	}
 
-	for (unsigned int i = 0; i < numImages; i++) {
-		frames.at(i).image = swapchainImages.at(i);
+	// present IDs of the old swapchain are never reported
+	pendingPresentTimes.clear();
+	lastDisplayTime = 0;
+	if (displayTiming) {
+		refreshInterval = device.getRefreshCycleDurationGOOGLE(swapchain, dispatcher).refreshDuration;
+		LOG("Refresh interval %f ms\n", double(refreshInterval) / 1000000.0);
 	}
 
 	swapchainDirty = false;
@@ -2366,21 +4665,110 @@ bool RendererImpl::recreateSwapchain() {
 }
 
 
+void RendererImpl::deleteSwapchainRenderTargets() {
+	for (auto handle : swapchainRenderTargets) {
+		renderTargets.removeWith(handle, [this](RenderTarget &rt) {
+			this->deleteResources.emplace_back(std::move(rt));
+		} );
+	}
+	swapchainRenderTargets.clear();
+}
+
+
+void RendererImpl::destroyRetiredSwapchains(uint32_t syncedFrame) {
+	while (!retiredSwapchains.empty() && retiredSwapchains.front().first <= syncedFrame) {
+		device.destroySwapchainKHR(retiredSwapchains.front().second);
+		retiredSwapchains.erase(retiredSwapchains.begin());
+	}
+}
+
+
+void RendererImpl::retireStaticContents(RenderPass &pass) {
+	if (!pass.staticContents.cmdBuf) {
+		return;
+	}
+
+	// frames in flight might still execute it
+	retiredStaticContents.emplace_back(frameNum, pass.staticContents);
+	pass.staticContents = StaticContents();
+}
+
+
+void RendererImpl::freeStaticContents(StaticContents &contents) {
+	assert(contents.cmdBuf);
+	assert(contents.dsPool);
+	device.freeCommandBuffers(staticCmdPool, { contents.cmdBuf });
+	device.destroyDescriptorPool(contents.dsPool);
+	contents = StaticContents();
+}
+
+
+void RendererImpl::destroyRetiredStaticContents(uint32_t syncedFrame) {
+	while (!retiredStaticContents.empty() && retiredStaticContents.front().first <= syncedFrame) {
+		freeStaticContents(retiredStaticContents.front().second);
+		retiredStaticContents.erase(retiredStaticContents.begin());
+	}
+}
+
+
 MemoryStats RendererImpl::getMemStats() const {
 	VmaStats vmaStats;
 	memset(&vmaStats, 0, sizeof(VmaStats));
 	vmaCalculateStats(allocator, &vmaStats);
 	MemoryStats stats;
-	stats.allocationCount    = vmaStats.total.allocationCount;
-	stats.subAllocationCount = vmaStats.total.unusedRangeCount;
+	// VMA allocations are our suballocations of the VkDeviceMemory blocks
+	stats.allocationCount    = vmaStats.total.blockCount;
+	stats.subAllocationCount = vmaStats.total.allocationCount;
 	stats.usedBytes          = vmaStats.total.usedBytes;
 	stats.unusedBytes        = vmaStats.total.unusedBytes;
+	stats.unusedRangeCount   = vmaStats.total.unusedRangeCount;
+	if (vmaStats.total.unusedRangeCount > 0) {
+		stats.largestUnusedRange = vmaStats.total.unusedRangeSizeMax;
+	}
+
+	std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+	vmaGetBudget(allocator, budgets.data());
+	const VkPhysicalDeviceMemoryProperties *memProps = nullptr;
+	vmaGetMemoryProperties(allocator, &memProps);
+	stats.heaps.resize(memProps->memoryHeapCount);
+	for (unsigned int i = 0; i < memProps->memoryHeapCount; i++) {
+		const auto &heapInfo = vmaStats.memoryHeap[i];
+		auto &heap = stats.heaps[i];
+		heap.size               = memProps->memoryHeaps[i].size;
+		heap.deviceLocal        = (memProps->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		heap.allocationCount    = heapInfo.blockCount;
+		heap.subAllocationCount = heapInfo.allocationCount;
+		heap.usedBytes          = heapInfo.usedBytes;
+		heap.unusedBytes        = heapInfo.unusedBytes;
+		heap.budgetBytes        = budgets[i].budget;
+		heap.budgetUsageBytes   = budgets[i].usage;
+
+		if (heap.deviceLocal) {
+			stats.budgetBytes      += budgets[i].budget;
+			stats.budgetUsageBytes += budgets[i].usage;
+		}
+	}
+
+	for (unsigned int i = 0; i < MemoryKind::_size_constant; i++) {
+		stats.kindBytes[i] = memoryKindBytes[i].load(std::memory_order_relaxed);
+	}
+
+	for (const auto &a : bufferArenas) {
+		if (a.buffer) {
+			stats.arenaBufferCount += a.numBuffers;
+			stats.arenaUsedBytes   += a.used;
+			stats.arenaUnusedBytes += a.size - a.used;
+		}
+	}
+
 	return stats;
 }
 
 
 bool RendererImpl::waitForDeviceIdle() {
 	std::vector<vk::Fence> fences;
+	unsigned int numPending = 0;
+	uint64_t     lastValue  = 0;
 
 	for (unsigned int i = 0; i < frames.size(); i++) {
 		auto &f = frames.at(i);
@@ -2389,15 +4777,30 @@ bool RendererImpl::waitForDeviceIdle() {
             break;
 
 		case Frame::Status::Pending:
-			fences.push_back(f.fence);
+			numPending++;
+			if (timelineSemaphores) {
+				lastValue = std::max(lastValue, uint64_t(f.lastFrameNum) + 1);
+			} else {
+				fences.push_back(f.fence);
+			}
 
 		case Frame::Status::Done:
 			break;
 		}
 	}
 
-	if (!fences.empty()) {
-		auto waitResult = device.waitForFences( fences, true, 0);
+	if (numPending > 0) {
+		vk::Result waitResult;
+		if (timelineSemaphores) {
+			// frames complete in order so the newest covers all of them
+			vk::SemaphoreWaitInfoKHR waitInfo;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores    = &graphicsTimeline;
+			waitInfo.pValues        = &lastValue;
+			waitResult = device.waitSemaphoresKHR(waitInfo, 0, dispatcher);
+		} else {
+			waitResult = device.waitForFences( fences, true, 0);
+		}
 		switch (waitResult) {
 		case vk::Result::eSuccess:
 			// nothing
@@ -2430,15 +4833,20 @@ bool RendererImpl::waitForDeviceIdle() {
 				break;
 			}
 		}
-		assert(count == fences.size());
+		assert(count == numPending);
 	}
 
+	// needs every queue to itself
+	waitSubmitThread();
 	device.waitIdle();
 
 	for (auto &r : deleteResources) {
 		this->deleteResourceInternal(const_cast<Resource &>(r));
 	}
 	deleteResources.clear();
+	flushRetiredObjects();
+	destroyRetiredSwapchains(UINT32_MAX);
+	destroyRetiredStaticContents(UINT32_MAX);
 
 	return true;
 }
@@ -2449,27 +4857,79 @@ bool RendererImpl::beginFrame() {
 	assert(!inFrame);
 #endif  // NDEBUG
 
-	if (frameAcquired) {
+	if (submitFailed.load()) {
+		throw std::runtime_error("submit thread failed");
+	}
+	if (presentOutOfDate.exchange(false)) {
+		swapchainDirty = true;
+	}
+
+	// don't recreate while holding an acquired image
+	if (!frameAcquired && swapchainDirty) {
+		assert(!frameAcquireSem);
+		// return false when recreateSwapchain fails and let caller deal with it
+		if (!recreateSwapchain()) {
+			assert(swapchainDirty);
+			return false;
+		}
+		assert(!swapchainDirty);
+	}
+
+	// frames are a ringbuffer independent of swapchain images
+	// if the frame we want to reuse is still pending on the GPU, wait for it
+	// if not done, return false and let caller deal with calling us again
+	// wait before acquiring so we don't sit on an image we can't use yet
+	currentFrameIdx        = frameNum % frames.size();
+	auto &frame            = frames.at(currentFrameIdx);
+
+	switch (frame.status) {
+	case Frame::Status::Ready:
+		break;
+
+	case Frame::Status::Pending:
+		if(!waitForFrame(currentFrameIdx)) {
+			return false;
+		}
+
+		assert(frame.status == Frame::Status::Done);
+		cleanupFrame(currentFrameIdx);
+
+		break;
+
+	case Frame::Status::Done:
+		break;
+	}
+
+	assert(frame.status == Frame::Status::Ready);
+
+	// between frames so nothing recorded yet can refer to the buffers which move
+	if (defragmentBytesPerFrame > 0 && defragmentPending) {
+		defragmentMemory();
+	}
+
+	if (!pendingPipelineLinks.empty()) {
+		finishPipelineLinks();
+	}
+
+	if (offscreen) {
+		// nothing to acquire
+		assert(!frameAcquireSem);
+	} else if (frameAcquired) {
 		assert(frameAcquireSem);
-		// nothing, continue to wait
+		// nothing, acquired during an earlier call
 	} else {
 		assert(!frameAcquireSem);
 
-		if (swapchainDirty) {
-			// return false when recreateSwapchain fails and let caller deal with it
-			if (!recreateSwapchain()) {
-				assert(swapchainDirty);
-				return false;
-			}
-			assert(!swapchainDirty);
-		}
+		// the image we'd get might only be released by the last present
+		// and acquire can't run at the same time as present anyway
+		waitSubmitThread();
 
 		// acquire next image
 		uint32_t imageIdx = 0xFFFFFFFFU;
 
 		frameAcquireSem = allocateSemaphore();
 
-		vk::Result result = device.acquireNextImageKHR(swapchain, 0, frameAcquireSem, vk::Fence(), &imageIdx);
+		vk::Result result = device.acquireNextImageKHR(swapchain, frameWaitTimeout, frameAcquireSem, vk::Fence(), &imageIdx);
 		switch (result) {
 		case vk::Result::eSuccess:
 			// nothing to do
@@ -2505,36 +4965,10 @@ bool RendererImpl::beginFrame() {
 
 		frameAcquired = true;
 
-		assert(imageIdx < frames.size());
-		currentFrameIdx        = imageIdx;
-	}
-
-	auto &frame            = frames.at(currentFrameIdx);
-
-	// frames are a ringbuffer
-	// if the frame we want to reuse is still pending on the GPU, wait for it
-	// if not done, return false and let caller deal with calling us again
-	// frameAcquired should make sure we don't acquire again
-	switch (frame.status) {
-	case Frame::Status::Ready:
-		break;
-
-	case Frame::Status::Pending:
-		if(!waitForFrame(currentFrameIdx)) {
-			return false;
-		}
-
-		assert(frame.status == Frame::Status::Done);
-		cleanupFrame(currentFrameIdx);
-
-		break;
-
-	case Frame::Status::Done:
-		break;
+		assert(imageIdx < swapchainImages.size());
+		currentImageIdx        = imageIdx;
 	}
 
-	assert(frame.status == Frame::Status::Ready);
-
 	frameAcquired = false;
 
 #ifndef NDEBUG
@@ -2543,19 +4977,58 @@ bool RendererImpl::beginFrame() {
 	validPipeline = false;
 	pipelineDrawn = true;
 #endif  // NDEBUG
-	device.resetFences( { frame.fence } );
 
+	// the fence is reset in presentFrame right before it's submitted again
 	assert(!frame.acquireSem);
 	frame.acquireSem       = frameAcquireSem;
 	frameAcquireSem        = vk::Semaphore();
 
 	assert(!frame.renderDoneSem);
-	frame.renderDoneSem    = allocateSemaphore();
+	if (!offscreen) {
+		frame.renderDoneSem    = allocateSemaphore();
+	}
 
 	// set command buffer to recording
 	currentCommandBuffer = frame.commandBuffer;
+	frame.usedSecondaryCmdBufs = 0;
 	currentCommandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
+	// size descriptor pools for the busiest frame of the last few
+	dsPeakSets       = std::max(dsPeakSets, frame.dsSetsUsed);
+	frame.dsSetsUsed = 0;
+	dsPeakFrames++;
+	if (dsPeakFrames == dsPoolResizeInterval) {
+		// room for one frame's sets and as many cached from earlier frames
+		unsigned int wanted = nextPow2(2 * std::max(minDescriptorSetsPerFrame, dsPeakSets));
+		// shrinking waits until it's far too big so the size doesn't flip back and forth
+		if (wanted > dsPoolSize || wanted * 4 <= dsPoolSize) {
+			LOG_DEBUG("Descriptor pool size %u -> %u sets\n", dsPoolSize, wanted);
+			dsPoolSize = wanted;
+		}
+		dsPeakSets   = 0;
+		dsPeakFrames = 0;
+	}
+
+	// frame is not in use by the GPU so we can flush its descriptor sets
+	// also flush when the pool fills up with sets which are no longer used
+	// or when it should be replaced with one of a different size
+	bool wrongSize = (frame.dsPools.size() != 1 || frame.dsPoolCapacity != dsPoolSize);
+	if (frame.dsCacheGeneration != dsCacheGeneration || frame.dsCache.size() > frame.dsPoolCapacity / 2 || wrongSize) {
+		resetDescriptorPools(frame);
+		frame.dsCacheGeneration = dsCacheGeneration;
+	}
+
+	frame.timerNames.clear();
+	if (frame.timestampPool) {
+		currentCommandBuffer.resetQueryPool(frame.timestampPool, 0, 2 * MAX_GPU_TIMERS);
+	}
+	if (frame.statisticsPool) {
+		currentCommandBuffer.resetQueryPool(frame.statisticsPool, 0, MAX_GPU_TIMERS);
+	}
+
+	collectPresentTimings();
+	frame.beginTime = now();
+
 	currentPipelineLayout = vk::PipelineLayout();
 
 	// mark buffers deleted during gap between frames to be deleted when this frame has synced
@@ -2576,157 +5049,367 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 	inFrame = false;
 #endif  // NDEBUG
 
-	const auto &rt = renderTargets.get(rtHandle);
-	unsigned int width  = rt.width;
-	unsigned int height = rt.height;
+	assert(!asyncComputeActive);
 
-	if (width != swapchainDesc.width || height != swapchainDesc.height) {
-		LOG("warning: rendertarget size mismatch at presentFrame, is (%ux%u) should be (%ux%u)\n", width, height, swapchainDesc.width, swapchainDesc.height);
-		width  = std::min(width,  swapchainDesc.width);
-		height = std::min(height, swapchainDesc.height);
-		swapchainDirty  = true;
+	auto &frame = frames.at(currentFrameIdx);
+	if (!timelineSemaphores) {
+		device.resetFences( { frame.fence } );
 	}
 
-	auto &frame = frames.at(currentFrameIdx);
-	device.resetFences( { frame.fence } );
+	// last pass rendered straight into the swapchain image, no blit needed
+	bool direct = features.swapchainRenderTarget && (rtHandle == swapchainRenderTargets.at(currentImageIdx));
 
-	currentCommandBuffer.end();
-	// TODO: this could be a baked buffer
-	frame.presentCmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	// swapchain image is only written by the blit below
+	// or by the frame's own commands when rendering directly
+	vk::PipelineStageFlags acquireWaitStage = vk::PipelineStageFlagBits::eTransfer;
 
-	vk::Image image        = frame.image;
-	vk::ImageLayout layout = vk::ImageLayout::eTransferDstOptimal;
+	if (direct) {
+		assert(renderTargets.get(rtHandle).currentLayout == +Layout::Present);
+		acquireWaitStage |= vk::PipelineStageFlagBits::eColorAttachmentOutput;
+	}
 
-	// transition image to transfer dst optimal
-	vk::ImageMemoryBarrier barrier;
-	barrier.srcAccessMask       = vk::AccessFlagBits();
-	barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
-	barrier.oldLayout           = vk::ImageLayout::eUndefined;
-	barrier.newLayout           = layout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image               = image;
-
-	vk::ImageSubresourceRange range;
-	range.aspectMask            = vk::ImageAspectFlagBits::eColor;
-	range.baseMipLevel          = 0;
-	range.levelCount            = VK_REMAINING_MIP_LEVELS;
-	range.baseArrayLayer        = 0;
-	range.layerCount            = VK_REMAINING_ARRAY_LAYERS;
-	barrier.subresourceRange    = range;
-
-	// TODO: add eComputeShader when implementing cs
-	// TODO: reduce wait mask
-	vk::PipelineStageFlags acquireWaitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-	frame.presentCmdBuf.pipelineBarrier(acquireWaitStage, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
-
-	vk::ImageBlit blit;
-	blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	blit.srcSubresource.layerCount = 1;
-	blit.srcOffsets[1u]            = vk::Offset3D(width, height, 1);
-	blit.dstSubresource            = blit.srcSubresource;
-	blit.dstOffsets[1u]            = blit.srcOffsets[1u];
-
-	// blit draw image to presentation image
-	frame.presentCmdBuf.blitImage(rt.image, vk::ImageLayout::eTransferSrcOptimal, image, layout, { blit }, vk::Filter::eNearest);
-
-	// transition to present
-	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
-	barrier.dstAccessMask       = vk::AccessFlags();
-	barrier.oldLayout           = layout;
-	barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
-	barrier.image               = image;
-	frame.presentCmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
-	frame.presentCmdBuf.end();
+	flushBarriers();
 
-	// submit command buffers
+	if (readbackRequested) {
+		readbackRequested = false;
+		if (direct) {
+			// the swapchain image isn't transfer src, render into a rendertarget to read back
+			LOG("readback not supported when rendering straight into the swapchain\n");
+		} else {
+			readbackRenderTarget(rtHandle, [this] (FrameReadback &r) {
+				std::swap(readback, r);
+				readbackReady = true;
+			});
+		}
+	}
+
+	if (offscreen) {
+		// nothing to blit to, the frame ends in rtHandle
+		assert(renderTargets.get(rtHandle).currentLayout == +Layout::TransferSrc);
+	} else if (!direct) {
+		const auto &rt = renderTargets.get(rtHandle);
+		unsigned int width  = rt.width;
+		unsigned int height = rt.height;
+
+		if (width != swapchainDesc.width || height != swapchainDesc.height) {
+			LOG_RATE_LIMITED("warning: rendertarget size mismatch at presentFrame, is (%ux%u) should be (%ux%u)\n", width, height, swapchainDesc.width, swapchainDesc.height);
+			width  = std::min(width,  swapchainDesc.width);
+			height = std::min(height, swapchainDesc.height);
+			swapchainDirty  = true;
+		}
+
+		// blit at the end of the frame's own command buffer
+		// the acquire wait only holds back transfers so earlier passes still run
+		vk::Image image        = swapchainImages.at(currentImageIdx);
+		vk::ImageLayout layout = vk::ImageLayout::eTransferDstOptimal;
+
+		// transition image to transfer dst optimal
+		vk::ImageMemoryBarrier barrier;
+		barrier.srcAccessMask       = vk::AccessFlagBits();
+		barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+		barrier.oldLayout           = vk::ImageLayout::eUndefined;
+		barrier.newLayout           = layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image               = image;
+
+		vk::ImageSubresourceRange range;
+		range.aspectMask            = vk::ImageAspectFlagBits::eColor;
+		range.baseMipLevel          = 0;
+		range.levelCount            = VK_REMAINING_MIP_LEVELS;
+		range.baseArrayLayer        = 0;
+		range.layerCount            = VK_REMAINING_ARRAY_LAYERS;
+		barrier.subresourceRange    = range;
+
+		currentCommandBuffer.pipelineBarrier(acquireWaitStage, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+
+		vk::ImageBlit blit;
+		blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[1u]            = vk::Offset3D(width, height, 1);
+		blit.dstSubresource            = blit.srcSubresource;
+		blit.dstOffsets[1u]            = blit.srcOffsets[1u];
+
+		// pre-transformed swapchain, flip here instead of in the compositor
+		bool flipX = (swapchainTransform == vk::SurfaceTransformFlagBitsKHR::eRotate180)
+		          || (swapchainTransform == vk::SurfaceTransformFlagBitsKHR::eHorizontalMirror);
+		bool flipY = (swapchainTransform == vk::SurfaceTransformFlagBitsKHR::eRotate180)
+		          || (swapchainTransform == vk::SurfaceTransformFlagBitsKHR::eHorizontalMirrorRotate180);
+		if (flipX) {
+			std::swap(blit.dstOffsets[0u].x, blit.dstOffsets[1u].x);
+		}
+		if (flipY) {
+			std::swap(blit.dstOffsets[0u].y, blit.dstOffsets[1u].y);
+		}
+
+		// blit draw image to presentation image
+		currentCommandBuffer.blitImage(rt.image, vk::ImageLayout::eTransferSrcOptimal, image, layout, { blit }, vk::Filter::eNearest);
+
+		// transition to present
+		barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask       = vk::AccessFlags();
+		barrier.oldLayout           = layout;
+		barrier.newLayout           = vk::ImageLayout::ePresentSrcKHR;
+		barrier.image               = image;
+		currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlagBits::eByRegion, {}, {}, { barrier });
+	}
+
+	currentCommandBuffer.end();
+
+	// submit command buffers
+	// everything goes in one VkSubmitInfo unless the frame used async compute
 	vk::SubmitInfo submit;
 
 	std::array<vk::CommandBuffer, 2> submitBuffers;
 
-	std::vector<vk::Semaphore>          uploadSemaphores;
-	std::vector<vk::PipelineStageFlags> semWaitMasks;
-	std::vector<vk::ImageMemoryBarrier> imageAcquireBarriers;
-	std::vector<vk::BufferMemoryBarrier> bufferAcquireBarriers;
+	// reused every frame to avoid allocating
+	submitWaitSemaphores.clear();
+	submitWaitMasks.clear();
+	submitWaitValues.clear();
+	submitImageBarriers.clear();
+	submitBufferBarriers.clear();
+	submitMipGenerations.clear();
+
+	submitThreadUploads();
+	submitUploads();
 	if (!uploads.empty()) {
-		LOG("%u uploads pending\n", static_cast<unsigned int>(uploads.size()));
+		LOG_DEBUG("%u uploads pending\n", static_cast<unsigned int>(uploads.size()));
 
 		// use semaphores to make sure draw doesn't proceed until uploads are ready
-		uploadSemaphores.reserve(uploads.size());
-		semWaitMasks.reserve(uploads.size());
+		// the transfer timeline needs only one wait for the newest upload
+		vk::PipelineStageFlags transferWaitMask;
+		uint64_t               transferWaitValue = 0;
 		for (auto &op : uploads) {
-			uploadSemaphores.push_back(op.semaphore);
-			semWaitMasks.push_back(op.semWaitMask);
-
-			imageAcquireBarriers.insert(imageAcquireBarriers.end()
-			                          , op.imageAcquireBarriers.begin()
-			                          , op.imageAcquireBarriers.end());
-			bufferAcquireBarriers.insert(bufferAcquireBarriers.end()
-			                           , op.bufferAcquireBarriers.begin()
-			                           , op.bufferAcquireBarriers.end());
-		}
-		LOG("Gathered %u image and %u buffer acquire barriers from %u upload ops\n"
-		   , static_cast<unsigned int >(imageAcquireBarriers.size())
-		   , static_cast<unsigned int >(bufferAcquireBarriers.size())
-		   , static_cast<unsigned int >(uploads.size()));
+			if (timelineSemaphores) {
+				transferWaitValue = std::max(transferWaitValue, op.timelineValue);
+				transferWaitMask |= op.semWaitMask;
+			} else {
+				submitWaitSemaphores.push_back(op.semaphore);
+				submitWaitMasks.push_back(op.semWaitMask);
+			}
 
-		submit.waitSemaphoreCount   = static_cast<uint32_t>(uploadSemaphores.size());
-		submit.pWaitSemaphores      = uploadSemaphores.data();
-		submit.pWaitDstStageMask    = semWaitMasks.data();
+			submitImageBarriers.insert(submitImageBarriers.end()
+			                         , op.imageAcquireBarriers.begin()
+			                         , op.imageAcquireBarriers.end());
+			submitBufferBarriers.insert(submitBufferBarriers.end()
+			                          , op.bufferAcquireBarriers.begin()
+			                          , op.bufferAcquireBarriers.end());
+			submitMipGenerations.insert(submitMipGenerations.end()
+			                          , op.mipGenerations.begin()
+			                          , op.mipGenerations.end());
+		}
+		if (timelineSemaphores) {
+			submitWaitSemaphores.push_back(transferTimeline);
+			submitWaitMasks.push_back(transferWaitMask);
+			submitWaitValues.resize(submitWaitSemaphores.size(), 0);
+			submitWaitValues.back() = transferWaitValue;
+		}
 
-		if (!imageAcquireBarriers.empty() || !bufferAcquireBarriers.empty()) {
-			LOG("submitting acquire barriers\n");
-			auto barrierCmdBuf = frame.barrierCmdBuf;
-			barrierCmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-			barrierCmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), {}, bufferAcquireBarriers, imageAcquireBarriers);
-			barrierCmdBuf.end();
+		LOG_DEBUG("Gathered %u image and %u buffer acquire barriers from %u upload ops\n"
+		   , static_cast<unsigned int >(submitImageBarriers.size())
+		   , static_cast<unsigned int >(submitBufferBarriers.size())
+		   , static_cast<unsigned int >(uploads.size()));
+	}
 
-			submitBuffers[0] = barrierCmdBuf;
-			submitBuffers[1] = currentCommandBuffer;
-			submit.commandBufferCount = 2;
-		} else {
-			submitBuffers[0]            = currentCommandBuffer;
-			submit.commandBufferCount   = 1;
+	// acquire barriers must come before the frame's commands which were recorded already
+	// so they get their own command buffer in the same submit
+	// mip generation of textures from the transfer queue too
+	// performance queries can't be reset in the command buffer which begins them
+	if (!submitImageBarriers.empty() || !submitBufferBarriers.empty() || !submitMipGenerations.empty() || frame.performancePool) {
+		LOG_DEBUG("submitting acquire barriers\n");
+		auto barrierCmdBuf = frame.barrierCmdBuf;
+		barrierCmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+		if (frame.performancePool) {
+			barrierCmdBuf.resetQueryPool(frame.performancePool, 0, MAX_GPU_TIMERS);
 		}
+		if (!submitImageBarriers.empty() || !submitBufferBarriers.empty()) {
+			barrierCmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), {}, submitBufferBarriers, submitImageBarriers);
+		}
+		for (const auto &gen : submitMipGenerations) {
+			recordMipGeneration(barrierCmdBuf, gen, true);
+		}
+		barrierCmdBuf.end();
 
-		submit.pCommandBuffers      = submitBuffers.data();
+		submitBuffers[0] = barrierCmdBuf;
+		submitBuffers[1] = frame.commandBuffer;
+		submit.commandBufferCount = 2;
 	} else {
-		submitBuffers[0]            = currentCommandBuffer;
-		submit.pCommandBuffers      = submitBuffers.data();
+		submitBuffers[0]            = frame.commandBuffer;
 		submit.commandBufferCount   = 1;
 	}
+	submit.pCommandBuffers      = submitBuffers.data();
+
+	// the last async compute frame may still be reading rendertargets
+	// only hold back the stages which write them so vertex work can overlap
+	if (asyncGraphicsWaitSem) {
+		submitWaitSemaphores.push_back(asyncGraphicsWaitSem);
+		submitWaitMasks.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput
+		                        | vk::PipelineStageFlagBits::eEarlyFragmentTests
+		                        | vk::PipelineStageFlagBits::eLateFragmentTests
+		                        | vk::PipelineStageFlagBits::eTransfer
+		                        | vk::PipelineStageFlagBits::eComputeShader);
+		frame.releasedSemaphores.push_back(asyncGraphicsWaitSem);
+		asyncGraphicsWaitSem = vk::Semaphore();
+	}
 
-	vk::SubmitInfo submit2;
-	submit2.waitSemaphoreCount   = 1;
-	submit2.pWaitSemaphores      = &frame.acquireSem;
-	submit2.pWaitDstStageMask    = &acquireWaitStage;
-	submit2.commandBufferCount   = 1;
-	submit2.pCommandBuffers      = &frame.presentCmdBuf;
-	submit2.signalSemaphoreCount = 1;
-	submit2.pSignalSemaphores    = &frame.renderDoneSem;
+	// every binary semaphore must be waited on before it can be reused
+	// a frame without async compute takes the compute wait itself
+	if (asyncComputeWaitSem && !frame.usedAsyncCompute) {
+		submitWaitSemaphores.push_back(asyncComputeWaitSem);
+		submitWaitMasks.push_back(vk::PipelineStageFlagBits::eAllCommands);
+		frame.releasedSemaphores.push_back(asyncComputeWaitSem);
+		asyncComputeWaitSem = vk::Semaphore();
+	}
 
-	queue.submit({ submit, submit2 }, frame.fence);
+	// signal the binary semaphore for present
+	// and with timelines also this frame's value instead of the fence
+	std::array<vk::Semaphore, 3> signalSemaphores;
+	std::array<uint64_t, 3>      signalValues     = { { 0, 0, 0 } };
+	uint32_t numSignalSemaphores = 0;
+	if (!offscreen) {
+		signalSemaphores[numSignalSemaphores] = frame.renderDoneSem;
+		numSignalSemaphores++;
+	}
+	if (timelineSemaphores) {
+		signalSemaphores[numSignalSemaphores] = graphicsTimeline;
+		signalValues[numSignalSemaphores]     = uint64_t(frameNum) + 1;
+		numSignalSemaphores++;
+	}
 
-	// present
-	vk::PresentInfoKHR presentInfo;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores    = &frame.renderDoneSem;
-	presentInfo.swapchainCount     = 1;
-	presentInfo.pSwapchains        = &swapchain;
-	presentInfo.pImageIndices      = &currentFrameIdx;
+	vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+
+	if (frame.usedAsyncCompute) {
+		// three submits: everything before beginAsyncCompute on the graphics queue,
+		// the async section on the compute queue and the rest on the graphics queue again
+		// the next frame's graphics submit only waits on the compute submit
+		// so it can start while this frame's compute is still running
+		vk::Semaphore asyncStartSem = allocateSemaphore();
+		vk::Semaphore asyncDoneSem  = allocateSemaphore();
+		frame.releasedSemaphores.push_back(asyncStartSem);
+		frame.releasedSemaphores.push_back(asyncDoneSem);
+
+		submit.waitSemaphoreCount   = static_cast<uint32_t>(submitWaitSemaphores.size());
+		submit.pWaitSemaphores      = submitWaitSemaphores.data();
+		submit.pWaitDstStageMask    = submitWaitMasks.data();
+		submit.signalSemaphoreCount = 1;
+		submit.pSignalSemaphores    = &asyncStartSem;
+
+		if (timelineSemaphores) {
+			// the transfer timeline wait is the only one needing a value
+			submitWaitValues.resize(submitWaitSemaphores.size(), 0);
+			timelineInfo.waitSemaphoreValueCount   = static_cast<uint32_t>(submitWaitValues.size());
+			timelineInfo.pWaitSemaphoreValues      = submitWaitValues.data();
+			submit.pNext                           = &timelineInfo;
+		}
 
-	auto presentResult = queue.presentKHR(&presentInfo);
-	if (presentResult == vk::Result::eSuccess) {
-		// nothing to do
-	} else if (presentResult == vk::Result::eErrorOutOfDateKHR) {
-		LOG("swapchain out of date during presentKHR, marking dirty\n");
-		// swapchain went out of date during present, mark it dirty
-		swapchainDirty = true;
-	} else {
-		LOG("presentKHR failed: %s\n", vk::to_string(presentResult).c_str());
-		throw std::runtime_error("presentKHR failed");
+		queueSubmit(queue, submit, vk::Fence());
+
+		// compute must not overwrite what the last async compute frame's graphics part still reads
+		std::array<vk::Semaphore, 2>          computeWaitSemaphores = { { asyncStartSem, asyncComputeWaitSem } };
+		std::array<vk::PipelineStageFlags, 2> computeWaitMasks      = { { vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands } };
+		if (asyncComputeWaitSem) {
+			frame.releasedSemaphores.push_back(asyncComputeWaitSem);
+			asyncComputeWaitSem = vk::Semaphore();
+		}
+
+		assert(!asyncGraphicsWaitSem);
+		asyncGraphicsWaitSem = allocateSemaphore();
+		std::array<vk::Semaphore, 2>          computeSignalSemaphores = { { asyncDoneSem, asyncGraphicsWaitSem } };
+
+		vk::SubmitInfo computeSubmit;
+		computeSubmit.waitSemaphoreCount   = computeWaitSemaphores[1] ? 2 : 1;
+		computeSubmit.pWaitSemaphores      = computeWaitSemaphores.data();
+		computeSubmit.pWaitDstStageMask    = computeWaitMasks.data();
+		computeSubmit.commandBufferCount   = 1;
+		computeSubmit.pCommandBuffers      = &frame.computeCmdBuf;
+		computeSubmit.signalSemaphoreCount = 2;
+		computeSubmit.pSignalSemaphores    = computeSignalSemaphores.data();
+
+		queueSubmit(computeQueue, computeSubmit, vk::Fence());
+
+		// rest of the frame and the blit, also tells the next async section when it can start
+		assert(!asyncComputeWaitSem);
+		asyncComputeWaitSem = allocateSemaphore();
+		signalSemaphores[numSignalSemaphores] = asyncComputeWaitSem;
+		numSignalSemaphores++;
+
+		submitWaitSemaphores.clear();
+		submitWaitMasks.clear();
+		submitWaitValues.clear();
+
+		submitWaitSemaphores.push_back(asyncDoneSem);
+		submitWaitMasks.push_back(vk::PipelineStageFlagBits::eAllCommands);
+
+		submit                      = vk::SubmitInfo();
+		submit.commandBufferCount   = 1;
+		submit.pCommandBuffers      = &frame.postCmdBuf;
+	}
+
+	// when rendering directly this also holds back color writes of earlier passes until the image is acquired
+	if (!offscreen) {
+		submitWaitSemaphores.push_back(frame.acquireSem);
+		submitWaitMasks.push_back(acquireWaitStage);
+	}
+
+	submit.waitSemaphoreCount   = static_cast<uint32_t>(submitWaitSemaphores.size());
+	submit.pWaitSemaphores      = submitWaitSemaphores.data();
+	submit.pWaitDstStageMask    = submitWaitMasks.data();
+
+	submit.signalSemaphoreCount = numSignalSemaphores;
+	submit.pSignalSemaphores    = signalSemaphores.data();
+
+	if (timelineSemaphores) {
+		submitWaitValues.resize(submitWaitSemaphores.size(), 0);
+		timelineInfo.waitSemaphoreValueCount   = static_cast<uint32_t>(submitWaitValues.size());
+		timelineInfo.pWaitSemaphoreValues      = submitWaitValues.data();
+		timelineInfo.signalSemaphoreValueCount = submit.signalSemaphoreCount;
+		timelineInfo.pSignalSemaphoreValues    = signalValues.data();
+		submit.pNext                           = &timelineInfo;
+	}
+
+	queueSubmit(queue, submit, timelineSemaphores ? vk::Fence() : frame.fence);
+
+	// present, offscreen frames are done once submitted
+	if (!offscreen) {
+		if (displayTiming) {
+			// no desired time, we only want to know when it was displayed
+			pendingPresentTimes.emplace_back(frameNum, frame.beginTime);
+		}
+
+		// rectangles are relative to the surface's current transform
+		// so they don't need to follow the pre-transform
+		presentRects.clear();
+		if (incrementalPresent && swapchainDesc.incrementalPresent) {
+			for (const auto &r : damageRects) {
+				unsigned int x = std::min(r.x, swapchainDesc.width);
+				unsigned int y = std::min(r.y, swapchainDesc.height);
+
+				vk::RectLayerKHR rect;
+				rect.offset = vk::Offset2D(static_cast<int32_t>(x), static_cast<int32_t>(y));
+				rect.extent = vk::Extent2D(std::min(r.z, swapchainDesc.width - x), std::min(r.w, swapchainDesc.height - y));
+				rect.layer  = 0;
+				presentRects.push_back(rect);
+			}
+		}
+
+		if (submitThreadActive) {
+			QueuedFrame &q   = queuedFrame();
+			q.present        = true;
+			q.imageIdx       = currentImageIdx;
+			q.renderDoneSem  = frame.renderDoneSem;
+			q.presentTime    = displayTiming;
+			q.presentID      = frameNum;
+			q.presentRects.assign(presentRects.begin(), presentRects.end());
+		} else if (!presentImage(currentImageIdx, frame.renderDoneSem, displayTiming, frameNum, presentRects)) {
+			swapchainDirty = true;
+		}
+	}
+	damageRects.clear();
+
+	if (submitThreadActive) {
+		pushQueuedFrame();
 	}
-	frame.usedRingBufPtr = ringBufPtr;
+
 	frame.status         = Frame::Status::Pending;
 	frame.lastFrameNum = frameNum;
 
@@ -2751,17 +5434,292 @@ void RendererImpl::presentFrame(RenderTargetHandle rtHandle) {
 		assert(frame.uploads.empty());
 		frame.uploads = std::move(uploads);
 	}
+
+	finishRingFrame();
+
+	presentTimings.clear();
+
 	frameNum++;
 }
 
 
+bool RendererImpl::presentImage(uint32_t imageIdx, vk::Semaphore waitSem, bool presentTime, uint32_t presentID, const std::vector<vk::RectLayerKHR> &rects) {
+	vk::PresentInfoKHR presentInfo;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores    = &waitSem;
+	presentInfo.swapchainCount     = 1;
+	presentInfo.pSwapchains        = &swapchain;
+	presentInfo.pImageIndices      = &imageIdx;
+
+	vk::PresentTimeGOOGLE       time;
+	vk::PresentTimesInfoGOOGLE  timesInfo;
+	if (presentTime) {
+		time.presentID           = presentID;
+		time.desiredPresentTime  = 0;
+		timesInfo.swapchainCount = 1;
+		timesInfo.pTimes         = &time;
+		presentInfo.pNext        = &timesInfo;
+	}
+
+	vk::PresentRegionKHR   presentRegion;
+	vk::PresentRegionsKHR  presentRegions;
+	if (!rects.empty()) {
+		presentRegion.rectangleCount  = static_cast<uint32_t>(rects.size());
+		presentRegion.pRectangles     = rects.data();
+		presentRegions.swapchainCount = 1;
+		presentRegions.pRegions       = &presentRegion;
+		presentRegions.pNext          = presentInfo.pNext;
+		presentInfo.pNext             = &presentRegions;
+	}
+
+	auto presentResult = queue.presentKHR(&presentInfo);
+	if (presentResult == vk::Result::eSuccess) {
+		return true;
+	} else if (presentResult == vk::Result::eErrorOutOfDateKHR) {
+		LOG("swapchain out of date during presentKHR, marking dirty\n");
+		return false;
+	} else {
+		LOG("presentKHR failed: %s\n", vk::to_string(presentResult).c_str());
+		throw std::runtime_error("presentKHR failed");
+	}
+}
+
+
+void RendererImpl::queueSubmit(vk::Queue q, const vk::SubmitInfo &submit, vk::Fence fence) {
+	// a separate transfer queue stays with the render thread
+	if (!submitThreadActive || (q != queue && q != computeQueue)) {
+		q.submit({ submit }, fence);
+		return;
+	}
+
+	QueuedFrame &frame = queuedFrame();
+	if (frame.numSubmits == frame.submits.size()) {
+		frame.submits.emplace_back();
+	}
+	QueuedSubmit &s = frame.submits[frame.numSubmits];
+	frame.numSubmits++;
+
+	s.queue = q;
+	s.waitSemaphores.assign(submit.pWaitSemaphores, submit.pWaitSemaphores + submit.waitSemaphoreCount);
+	s.waitMasks.assign(submit.pWaitDstStageMask, submit.pWaitDstStageMask + submit.waitSemaphoreCount);
+	s.commandBuffers.assign(submit.pCommandBuffers, submit.pCommandBuffers + submit.commandBufferCount);
+	s.signalSemaphores.assign(submit.pSignalSemaphores, submit.pSignalSemaphores + submit.signalSemaphoreCount);
+	s.fence = fence;
+
+	// the only thing we chain to submits
+	s.timeline = (submit.pNext != nullptr);
+	s.waitValues.clear();
+	s.signalValues.clear();
+	if (s.timeline) {
+		const auto *timelineInfo = static_cast<const vk::TimelineSemaphoreSubmitInfoKHR *>(submit.pNext);
+		assert(timelineInfo->sType == vk::StructureType::eTimelineSemaphoreSubmitInfoKHR);
+		s.waitValues.assign(timelineInfo->pWaitSemaphoreValues, timelineInfo->pWaitSemaphoreValues + timelineInfo->waitSemaphoreValueCount);
+		s.signalValues.assign(timelineInfo->pSignalSemaphoreValues, timelineInfo->pSignalSemaphoreValues + timelineInfo->signalSemaphoreValueCount);
+	}
+}
+
+
+QueuedFrame &RendererImpl::queuedFrame() {
+	assert(submitThreadActive);
+	assert(isRenderThread());
+
+	uint64_t enqueued = submitEnqueued.load(std::memory_order_relaxed);
+	if (enqueued - submitDequeued.load(std::memory_order_acquire) >= submitQueueSize) {
+		std::unique_lock<std::mutex> lock(submitMutex);
+		submitDoneCV.wait(lock, [this, enqueued] () { return enqueued - submitDequeued.load(std::memory_order_acquire) < submitQueueSize; });
+	}
+
+	return submitFrames[enqueued % submitQueueSize];
+}
+
+
+void RendererImpl::pushQueuedFrame() {
+	assert(submitThreadActive);
+
+	// release publishes the frame's contents with the index
+	submitEnqueued.fetch_add(1, std::memory_order_release);
+
+	// the lock only makes sure the submit thread is either sleeping or will see the new index
+	{
+		std::lock_guard<std::mutex> lock(submitMutex);
+	}
+	submitCV.notify_one();
+}
+
+
+void RendererImpl::waitSubmitThread() {
+	if (!submitThreadActive) {
+		return;
+	}
+
+	uint64_t enqueued = submitEnqueued.load(std::memory_order_relaxed);
+	if (submitDequeued.load(std::memory_order_acquire) != enqueued) {
+		std::unique_lock<std::mutex> lock(submitMutex);
+		submitDoneCV.wait(lock, [this, enqueued] () { return submitDequeued.load(std::memory_order_acquire) == enqueued; });
+	}
+}
+
+
+void RendererImpl::stopSubmitThread() {
+	if (!submitThreadActive) {
+		return;
+	}
+
+	// uploads submitted since the last presentFrame
+	QueuedFrame &frame = submitFrames[submitEnqueued.load(std::memory_order_relaxed) % submitQueueSize];
+	if (frame.numSubmits > 0) {
+		pushQueuedFrame();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(submitMutex);
+		submitStop = true;
+	}
+	submitCV.notify_one();
+	submitThread.join();
+
+	assert(submitDequeued.load() == submitEnqueued.load());
+	submitThreadActive = false;
+}
+
+
+// blocking in vkQueuePresentKHR under vsync or in vkQueueSubmit when the driver's queue is full
+// now stalls this thread instead of the render thread
+void RendererImpl::submitThreadFunc() {
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+	placeCurrentThread(CoreClass::Performance);
+
+	while (true) {
+		uint64_t dequeued = submitDequeued.load(std::memory_order_relaxed);
+		if (submitEnqueued.load(std::memory_order_acquire) == dequeued) {
+			std::unique_lock<std::mutex> lock(submitMutex);
+			submitCV.wait(lock, [this, dequeued] () { return submitStop || submitEnqueued.load(std::memory_order_acquire) != dequeued; });
+			if (submitEnqueued.load(std::memory_order_acquire) == dequeued) {
+				assert(submitStop);
+				return;
+			}
+		}
+
+		QueuedFrame &frame = submitFrames[dequeued % submitQueueSize];
+
+		// keeps going after a failure so the frames' fences still signal
+		// beginFrame throws once it sees submitFailed
+		try {
+			for (unsigned int i = 0; i < frame.numSubmits; i++) {
+				const QueuedSubmit &s = frame.submits[i];
+
+				vk::SubmitInfo submit;
+				submit.waitSemaphoreCount   = static_cast<uint32_t>(s.waitSemaphores.size());
+				submit.pWaitSemaphores      = s.waitSemaphores.data();
+				submit.pWaitDstStageMask    = s.waitMasks.data();
+				submit.commandBufferCount   = static_cast<uint32_t>(s.commandBuffers.size());
+				submit.pCommandBuffers      = s.commandBuffers.data();
+				submit.signalSemaphoreCount = static_cast<uint32_t>(s.signalSemaphores.size());
+				submit.pSignalSemaphores    = s.signalSemaphores.data();
+
+				vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+				if (s.timeline) {
+					timelineInfo.waitSemaphoreValueCount   = static_cast<uint32_t>(s.waitValues.size());
+					timelineInfo.pWaitSemaphoreValues      = s.waitValues.data();
+					timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(s.signalValues.size());
+					timelineInfo.pSignalSemaphoreValues    = s.signalValues.data();
+					submit.pNext                           = &timelineInfo;
+				}
+
+				s.queue.submit({ submit }, s.fence);
+			}
+
+			if (frame.present && !presentImage(frame.imageIdx, frame.renderDoneSem, frame.presentTime, frame.presentID, frame.presentRects)) {
+				presentOutOfDate.store(true);
+			}
+		} catch (std::exception &e) {
+			LOG("submit thread failed: %s\n", e.what());
+			logFlush();
+			submitFailed.store(true);
+		}
+
+		frame.numSubmits = 0;
+		frame.present    = false;
+
+		submitDequeued.store(dequeued + 1, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(submitMutex);
+		}
+		submitDoneCV.notify_all();
+	}
+}
+
+
+void RendererImpl::readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback) {
+	assert(handle);
+	assert(!inRenderPass);
+
+	flushBarriers();
+
+	const auto &rt = renderTargets.get(handle);
+	assert(rt.currentLayout == +Layout::TransferSrc);
+	assert(!isDepthFormat(rt.format));
+
+	PendingReadback r;
+	r.frameNum = frameNum;
+	r.width    = rt.width;
+	r.height   = rt.height;
+	r.format   = rt.format;
+	r.callback = std::move(callback);
+
+	vk::BufferCreateInfo bufInfo;
+	bufInfo.size      = uint32_t(rt.width * rt.height * formatSize(rt.format));
+	bufInfo.usage     = vk::BufferUsageFlagBits::eTransferDst;
+	r.buffer          = device.createBuffer(bufInfo);
+
+	VmaAllocationCreateInfo req = {};
+	req.usage         = VMA_MEMORY_USAGE_GPU_TO_CPU;
+	req.flags         = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	req.pUserData     = nullptr;
+	vmaAllocateMemoryForBuffer(allocator, r.buffer, &req, &r.memory, &r.allocationInfo);
+	assert(r.allocationInfo.pMappedData);
+	countMemory(MemoryKind::Staging, r.memory, true);
+	device.bindBufferMemory(r.buffer, r.allocationInfo.deviceMemory, r.allocationInfo.offset);
+
+	vk::BufferImageCopy region;
+	region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent                 = vk::Extent3D(rt.width, rt.height, 1);
+	currentCommandBuffer.copyImageToBuffer(rt.image, vk::ImageLayout::eTransferSrcOptimal, r.buffer, { region });
+
+	vk::BufferMemoryBarrier barrier;
+	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask       = vk::AccessFlagBits::eHostRead;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = r.buffer;
+	barrier.size                = VK_WHOLE_SIZE;
+	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), {}, { barrier }, {});
+
+	pendingReadbacks.emplace_back(std::move(r));
+}
+
+
 bool RendererImpl::waitForFrame(unsigned int frameIdx) {
 	assert(frameIdx < frames.size());
 
 	Frame &frame = frames.at(frameIdx);
 	assert(frame.status == Frame::Status::Pending);
 
-	auto waitResult = device.waitForFences({ frame.fence }, true, 0);
+	vk::Result waitResult = vk::Result::eSuccess;
+	if (timelineSemaphores) {
+		// frame N signals N + 1 so 0 is never waited on
+		uint64_t value = uint64_t(frame.lastFrameNum) + 1;
+		if (device.getSemaphoreCounterValueKHR(graphicsTimeline, dispatcher) < value) {
+			vk::SemaphoreWaitInfoKHR waitInfo;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores    = &graphicsTimeline;
+			waitInfo.pValues        = &value;
+			waitResult = device.waitSemaphoresKHR(waitInfo, frameWaitTimeout, dispatcher);
+		}
+	} else {
+		waitResult = device.waitForFences({ frame.fence }, true, frameWaitTimeout);
+	}
 	switch (waitResult) {
 	case vk::Result::eSuccess:
 		// nothing
@@ -2784,6 +5742,34 @@ bool RendererImpl::waitForFrame(unsigned int frameIdx) {
 }
 
 
+void RendererImpl::collectPresentTimings() {
+	if (!displayTiming || pendingPresentTimes.empty()) {
+		return;
+	}
+
+	// times are CLOCK_MONOTONIC which is also what steady_clock uses on Linux
+	auto pastTimings = device.getPastPresentationTimingGOOGLE(swapchain, dispatcher);
+	for (const auto &past : pastTimings) {
+		auto it = std::find_if(pendingPresentTimes.begin(), pendingPresentTimes.end()
+		                      , [&past] (const std::pair<uint32_t, uint64_t> &p) { return p.first == past.presentID; });
+		if (it == pendingPresentTimes.end()) {
+			continue;
+		}
+
+		presentTimings.emplace_back(it->first, it->second, past.actualPresentTime, true);
+		lastDisplayTime = std::max(lastDisplayTime, past.actualPresentTime);
+
+		// presents are reported in order so anything older was dropped
+		pendingPresentTimes.erase(pendingPresentTimes.begin(), it + 1);
+	}
+
+	// don't grow forever if the implementation never reports some presents
+	if (pendingPresentTimes.size() > 4 * frames.size()) {
+		pendingPresentTimes.erase(pendingPresentTimes.begin(), pendingPresentTimes.end() - frames.size());
+	}
+}
+
+
 void RendererImpl::cleanupFrame(unsigned int frameIdx) {
 	assert(frameIdx < frames.size());
 
@@ -2792,125 +5778,757 @@ void RendererImpl::cleanupFrame(unsigned int frameIdx) {
 
 	if (!frame.uploads.empty()) {
 		for (auto &op : frame.uploads) {
-			device.freeCommandBuffers(transferCmdPool, { op.cmdBuf } );
-			freeSemaphore(op.semaphore);
-
-			op.cmdBuf    = vk::CommandBuffer();
-			op.semaphore = vk::Semaphore();
-			op.semWaitMask = vk::PipelineStageFlags();
-
-			if (op.stagingBuffer) {
-				assert(op.memory);
-
-				device.destroyBuffer(op.stagingBuffer);
-				vmaFreeMemory(allocator, op.memory);
-
-				op.stagingBuffer = vk::Buffer();
-				op.memory        = VK_NULL_HANDLE;
-				op.coherent      = false;
-			} else {
-				assert(!op.memory);
-			}
+			releaseUploadOp(op);
 		}
 
 		assert(numUploads >= frame.uploads.size());
 		numUploads -= frame.uploads.size();
 		frame.uploads.clear();
 
+		// the frame waited for them so their staging blocks are free
+		recycleStaging();
+
 		// if all pending uploads are complete, reset the command pool
-		// TODO: should use multiple command pools
+		// this releases their memory in one go, they stay allocated for reuse
 		if (numUploads == 0) {
 			device.resetCommandPool(transferCmdPool, vk::CommandPoolResetFlags());
 		}
 	}
 
-	assert(frame.acquireSem);
-	freeSemaphore(frame.acquireSem);
-	frame.acquireSem = vk::Semaphore();
+	if (!offscreen) {
+		assert(frame.acquireSem);
+		freeSemaphore(frame.acquireSem);
+		frame.acquireSem = vk::Semaphore();
+
+		assert(frame.renderDoneSem);
+		freeSemaphore(frame.renderDoneSem);
+		frame.renderDoneSem = vk::Semaphore();
+	}
 
-	assert(frame.renderDoneSem);
-	freeSemaphore(frame.renderDoneSem);
-	frame.renderDoneSem = vk::Semaphore();
+	for (auto sem : frame.releasedSemaphores) {
+		freeSemaphore(sem);
+	}
+	frame.releasedSemaphores.clear();
+	frame.usedAsyncCompute = false;
 
 	frame.status         = Frame::Status::Ready;
 	lastSyncedFrame      = std::max(lastSyncedFrame, frame.lastFrameNum);
-	lastSyncedRingBufPtr = std::max(lastSyncedRingBufPtr, frame.usedRingBufPtr);
+	releaseRingPages(frame);
+	frame.arena.reset();
+
+	for (auto it = pendingReadbacks.begin(); it != pendingReadbacks.end(); ) {
+		if (it->frameNum > lastSyncedFrame) {
+			++it;
+			continue;
+		}
+
+		size_t size     = size_t(it->width) * it->height * formatSize(it->format);
+		FrameReadback result;
+		result.frameNum = it->frameNum;
+		result.width    = it->width;
+		result.height   = it->height;
+		result.format   = it->format;
+		result.pixels.resize(size);
+
+		vmaInvalidateAllocation(allocator, it->memory, 0, size);
+		memcpy(result.pixels.data(), it->allocationInfo.pMappedData, size);
+
+		device.destroyBuffer(it->buffer);
+		countMemory(MemoryKind::Staging, it->memory, false);
+		vmaFreeMemory(allocator, it->memory);
+
+		// callback might add more readbacks
+		ReadbackCallback callback = std::move(it->callback);
+		it = pendingReadbacks.erase(it);
+		if (callback) {
+			callback(result);
+		}
+	}
+
+	if (!frame.timerNames.empty()) {
+		assert(frame.timestampPool);
+		unsigned int numTimers = std::min(static_cast<unsigned int>(frame.timerNames.size()), static_cast<unsigned int>(MAX_GPU_TIMERS));
+		std::array<uint64_t, 2 * MAX_GPU_TIMERS> results;
+		auto result = device.getQueryPoolResults(frame.timestampPool, 0, 2 * numTimers, 2 * numTimers * sizeof(uint64_t), &results[0], sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+		if (result == vk::Result::eSuccess) {
+			// calibrated every frame so clock drift doesn't accumulate
+			uint64_t gpuNow  = 0;
+			uint64_t hostNow = 0;
+			bool calibrated  = calibrateTimestamps(gpuNow, hostNow);
+
+			gpuTimings.clear();
+			gpuTimings.reserve(numTimers);
+			for (unsigned int i = 0; i < numTimers; i++) {
+				uint64_t ticks = ((results[2 * i + 1] - results[2 * i]) & timestampMask);
+				GPUTiming t;
+				t.name        = std::move(frame.timerNames[i]);
+				t.nanoseconds = static_cast<uint64_t>(double(ticks) * timestampPeriod);
+				if (calibrated) {
+					// the frame is finished so its timers are before gpuNow
+					uint64_t age  = ((gpuNow - results[2 * i]) & timestampMask);
+					t.start       = hostNow - static_cast<uint64_t>(double(age) * timestampPeriod);
+				}
+				gpuTimings.emplace_back(std::move(t));
+			}
+		} else {
+			LOG_RATE_LIMITED("GPU timestamps of frame %u not available: %s\n", frameIdx, vk::to_string(result).c_str());
+		}
+		if (frame.statisticsPool && result == vk::Result::eSuccess) {
+			// in flag bit order, see statisticsFlags
+			std::array<uint64_t, 4 * MAX_GPU_TIMERS> stats;
+			result = device.getQueryPoolResults(frame.statisticsPool, 0, numTimers, numTimers * 4 * sizeof(uint64_t), &stats[0], 4 * sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+			if (result == vk::Result::eSuccess) {
+				for (unsigned int i = 0; i < numTimers; i++) {
+					GPUTiming &t = gpuTimings[i];
+					t.hasStatistics       = true;
+					t.vertexInvocations   = stats[4 * i + 0];
+					t.clippingPrimitives  = stats[4 * i + 1];
+					t.fragmentInvocations = stats[4 * i + 2];
+					t.computeInvocations  = stats[4 * i + 3];
+				}
+			} else {
+				LOG_RATE_LIMITED("Pipeline statistics of frame %u not available: %s\n", frameIdx, vk::to_string(result).c_str());
+			}
+		}
+		if (frame.performanceTimers && gpuTimings.size() == numTimers) {
+			std::vector<vk::PerformanceCounterResultKHR> counters(performanceCounterIndices.size());
+			for (unsigned int i = 0; i < numTimers; i++) {
+				if (!(frame.performanceTimers & (1u << i))) {
+					continue;
+				}
+
+				result = device.getQueryPoolResults(frame.performancePool, i, 1, counters.size() * sizeof(vk::PerformanceCounterResultKHR), counters.data(), counters.size() * sizeof(vk::PerformanceCounterResultKHR), vk::QueryResultFlags());
+				if (result != vk::Result::eSuccess) {
+					LOG_RATE_LIMITED("Performance counters of frame %u not available: %s\n", frameIdx, vk::to_string(result).c_str());
+					break;
+				}
+
+				GPUTiming &t = gpuTimings[i];
+				t.counters.reserve(counters.size());
+				for (unsigned int j = 0; j < counters.size(); j++) {
+					t.counters.push_back(performanceCounterValue(counters[j], performanceCounterStorage[j]));
+				}
+			}
+		}
+		frame.performanceTimers = 0;
+		frame.timerNames.clear();
+	}
 
 	// reset per-frame pools
+	// descriptor pool is reset in beginFrame when the cache needs flushing
 	device.resetCommandPool(frame.commandPool, vk::CommandPoolResetFlags());
-	device.resetDescriptorPool(frame.dsPool);
+	{
+		std::lock_guard<std::mutex> contextsLock(recordContextsMutex);
+		for (auto &c : recordContexts) {
+			if (frameIdx < c.second->frames.size()) {
+				resetRecordFrame(c.second->frames[frameIdx]);
+			}
+		}
+	}
 
 	for (auto &r : frame.deleteResources) {
 		this->deleteResourceInternal(const_cast<Resource &>(r));
 	}
 	frame.deleteResources.clear();
+	flushRetiredObjects();
 
-	for (auto handle : frame.ephemeralBuffers) {
-		Buffer &buffer = buffers.get(handle);
-		assert(buffer.size   >  0);
-
-		buffer.buffer          = vk::Buffer();
-		buffer.ringBufferAlloc = false;
-		buffer.memory          = 0;
-		buffer.size            = 0;
-		buffer.offset          = 0;
-		buffer.lastUsedFrame   = 0;
-
-		buffers.remove(handle);
-	}
-	frame.ephemeralBuffers.clear();
+	destroyRetiredSwapchains(lastSyncedFrame);
+	destroyRetiredStaticContents(lastSyncedFrame);
 }
 
 
-UploadOp RendererImpl::allocateUploadOp(uint32_t size) {
-	UploadOp op;
-
-	// TODO: have a free list of semaphores instead of creating new ones all the time
-	op.semaphore = allocateSemaphore();
+void RendererImpl::selectPerformanceCounters(const std::vector<std::string> &requested) {
+	uint32_t count = 0;
+	vk::Result result = physicalDevice.enumerateQueueFamilyPerformanceQueryCountersKHR(graphicsQueueIndex, &count, nullptr, nullptr, dispatcher);
+	if (result != vk::Result::eSuccess || count == 0) {
+		return;
+	}
 
-	vk::CommandBufferAllocateInfo cmdInfo(transferCmdPool, vk::CommandBufferLevel::ePrimary, 1);
-	op.cmdBuf = device.allocateCommandBuffers(cmdInfo)[0];
-	op.cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	std::vector<vk::PerformanceCounterKHR>            counters(count);
+	std::vector<vk::PerformanceCounterDescriptionKHR> descriptions(count);
+	result = physicalDevice.enumerateQueueFamilyPerformanceQueryCountersKHR(graphicsQueueIndex, &count, counters.data(), descriptions.data(), dispatcher);
+	if (result != vk::Result::eSuccess && result != vk::Result::eIncomplete) {
+		return;
+	}
+	counters.resize(count);
+	descriptions.resize(count);
 
-	// TODO: move staging buffer, memory and command buffer allocation to allocateUploadOp
-	vk::BufferCreateInfo bufInfo;
-	bufInfo.size      = size;
-	bufInfo.usage     = vk::BufferUsageFlagBits::eTransferSrc;
-	op.stagingBuffer  = device.createBuffer(bufInfo);
+	LOG("%u performance counters\n", count);
+	for (unsigned int i = 0; i < count; i++) {
+		LOG(" %s\t%s\t%s\n", descriptions[i].name.data(), descriptions[i].category.data(), vk::to_string(counters[i].unit).c_str());
+	}
 
-	VmaAllocationCreateInfo req = {};
-	req.usage         = VMA_MEMORY_USAGE_CPU_ONLY;
-	req.flags         = VMA_ALLOCATION_CREATE_MAPPED_BIT;
-	req.pUserData     = nullptr;
-	vmaAllocateMemoryForBuffer(allocator, op.stagingBuffer, &req, &op.memory, &op.allocationInfo);
-	assert(op.allocationInfo.pMappedData);
-	device.bindBufferMemory(op.stagingBuffer, op.allocationInfo.deviceMemory, op.allocationInfo.offset);
+	for (const auto &name : requested) {
+		bool found = false;
+		for (unsigned int i = 0; i < count; i++) {
+			if (name != descriptions[i].name.data()) {
+				continue;
+			}
+			found = true;
 
-	numUploads++;
+			// GPU timers are inside a command buffer
+			if (counters[i].scope == vk::PerformanceCounterScopeKHR::eCommandBuffer) {
+				LOG("Performance counter \"%s\" is command buffer scoped, skipped\n", name.c_str());
+				break;
+			}
 
-	assert(op.allocationInfo.memoryType < memoryProperties.memoryTypeCount);
-	op.coherent = !!(memoryProperties.memoryTypes[op.allocationInfo.memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+			performanceCounterIndices.push_back(i);
+			performanceCounterStorage.push_back(counters[i].storage);
+			performanceCounterNames.push_back(name);
+
+			// the frame is submitted once so everything has to fit in one pass
+			vk::QueryPoolPerformanceCreateInfoKHR info;
+			info.queueFamilyIndex  = graphicsQueueIndex;
+			info.counterIndexCount = static_cast<uint32_t>(performanceCounterIndices.size());
+			info.pCounterIndices   = performanceCounterIndices.data();
+			uint32_t passes = 0;
+			physicalDevice.getQueueFamilyPerformanceQueryPassesKHR(&info, &passes, dispatcher);
+			if (passes > 1) {
+				LOG("Performance counter \"%s\" needs another pass, skipped\n", name.c_str());
+				performanceCounterIndices.pop_back();
+				performanceCounterStorage.pop_back();
+				performanceCounterNames.pop_back();
+			}
+			break;
+		}
 
-	return op;
+		if (!found) {
+			LOG("Performance counter \"%s\" not found\n", name.c_str());
+		}
+	}
 }
 
 
-void RendererImpl::submitUploadOp(UploadOp &&op) {
+void RendererImpl::getExecutableStats(vk::Pipeline pipeline, vk::ShaderStageFlags amdStages, PipelineStats &stats) {
+	if (pipelineExecutableInfo) {
+		vk::PipelineInfoKHR pipelineInfo;
+		pipelineInfo.pipeline = pipeline;
+		auto executables = device.getPipelineExecutablePropertiesKHR(pipelineInfo, dispatcher);
+
+		for (uint32_t i = 0; i < executables.size(); i++) {
+			ShaderExecutableStats e;
+			e.name = executables[i].name.data();
+
+			vk::PipelineExecutableInfoKHR executableInfo;
+			executableInfo.pipeline        = pipeline;
+			executableInfo.executableIndex = i;
+			for (const auto &stat : device.getPipelineExecutableStatisticsKHR(executableInfo, dispatcher)) {
+				double value = 0.0;
+				switch (stat.format) {
+				case vk::PipelineExecutableStatisticFormatKHR::eBool32:
+					value = stat.value.b32 ? 1.0 : 0.0;
+					break;
+
+				case vk::PipelineExecutableStatisticFormatKHR::eInt64:
+					value = double(stat.value.i64);
+					break;
+
+				case vk::PipelineExecutableStatisticFormatKHR::eUint64:
+					value = double(stat.value.u64);
+					break;
+
+				case vk::PipelineExecutableStatisticFormatKHR::eFloat64:
+					value = stat.value.f64;
+					break;
+				}
+				e.statistics.emplace_back(stat.name.data(), value);
+			}
+
+			stats.executables.emplace_back(std::move(e));
+		}
+	} else if (amdShaderInfo) {
+		for (auto stage : { vk::ShaderStageFlagBits::eVertex, vk::ShaderStageFlagBits::eFragment, vk::ShaderStageFlagBits::eCompute }) {
+			if (!(amdStages & stage)) {
+				continue;
+			}
+
+			vk::ShaderStatisticsInfoAMD info;
+			size_t dataSize = sizeof(info);
+			vk::Result result = device.getShaderInfoAMD(pipeline, stage, vk::ShaderInfoTypeAMD::eStatistics, &dataSize, &info, dispatcher);
+			if (result != vk::Result::eSuccess) {
+				continue;
+			}
+
+			ShaderExecutableStats e;
+			e.name = vk::to_string(stage);
+			e.statistics.emplace_back("SGPRs",       double(info.resourceUsage.numUsedSgprs));
+			e.statistics.emplace_back("VGPRs",       double(info.resourceUsage.numUsedVgprs));
+			e.statistics.emplace_back("LDS bytes",   double(info.resourceUsage.ldsUsageSizeInBytes));
+			e.statistics.emplace_back("Scratch bytes", double(info.resourceUsage.scratchMemUsageInBytes));
+			stats.executables.emplace_back(std::move(e));
+		}
+	}
+
+	for (const auto &e : stats.executables) {
+		std::string line;
+		for (const auto &stat : e.statistics) {
+			line += " " + stat.first + " " + std::to_string(static_cast<int64_t>(stat.second));
+		}
+		LOG("pipeline \"%s\" [%s] %s:%s\n", stats.name.c_str(), stats.macros.c_str(), e.name.c_str(), line.c_str());
+	}
+}
+
+
+bool RendererImpl::calibrateTimestamps(uint64_t &gpuTicks, uint64_t &hostTime) {
+	if (!calibratedTimestamps) {
+		return false;
+	}
+
+	std::array<vk::CalibratedTimestampInfoEXT, 2> infos;
+	infos[0].timeDomain = vk::TimeDomainEXT::eDevice;
+	infos[1].timeDomain = vk::TimeDomainEXT::eClockMonotonic;
+	uint32_t count      = calibratedMonotonic ? 2 : 1;
+
+	std::array<uint64_t, 2> values   = { { 0, 0 } };
+	uint64_t                maxDeviation = 0;
+	uint64_t before = now();
+	auto result = device.getCalibratedTimestampsEXT(count, infos.data(), values.data(), &maxDeviation, dispatcher);
+	uint64_t after  = now();
+	if (result != vk::Result::eSuccess) {
+		LOG_RATE_LIMITED("vkGetCalibratedTimestampsEXT failed: %s\n", vk::to_string(result).c_str());
+		return false;
+	}
+
+	gpuTicks = values[0];
+	// without a host domain the error is at most half the call
+	hostTime = calibratedMonotonic ? values[1] : (before + (after - before) / 2);
+
+	return true;
+}
+
+
+UploadOp &RendererImpl::beginUpload(std::unique_lock<std::mutex> &lock) {
+	if (isRenderThread()) {
+		UploadOp &op = currentUpload;
+		if (op.cmdBuf) {
+			return op;
+		}
+
+		if (!timelineSemaphores) {
+			op.semaphore = allocateSemaphore();
+		}
+
+		op.cmdBuf = allocateTransferCmdBuf();
+
+		numUploads++;
+
+		return op;
+	}
+
+	UploadContext *ctx = nullptr;
+	{
+		std::lock_guard<std::mutex> contextsLock(uploadContextsMutex);
+		const auto id = std::this_thread::get_id();
+		auto it = std::find_if(uploadContexts.begin(), uploadContexts.end(), [id] (const auto &c) { return c.first == id; });
+		if (it != uploadContexts.end()) {
+			ctx = it->second.get();
+		} else {
+			auto newCtx = std::make_unique<UploadContext>();
+
+			vk::CommandPoolCreateInfo cp;
+			cp.flags            = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+			cp.queueFamilyIndex = transferQueueIndex;
+			newCtx->cmdPool     = device.createCommandPool(cp);
+
+			ctx = newCtx.get();
+			uploadContexts.emplace_back(id, std::move(newCtx));
+		}
+	}
+
+	lock = std::unique_lock<std::mutex>(ctx->mutex);
+
+	// semaphore and numUploads are done by submitThreadUploads on the rendering thread
+	UploadOp &op = ctx->op;
+	if (!op.cmdBuf) {
+		op.context = ctx;
+		if (!ctx->freeCmdBufs.empty()) {
+			op.cmdBuf = ctx->freeCmdBufs.back();
+			ctx->freeCmdBufs.pop_back();
+		} else {
+			vk::CommandBufferAllocateInfo cmdInfo(ctx->cmdPool, vk::CommandBufferLevel::ePrimary, 1);
+			op.cmdBuf = device.allocateCommandBuffers(cmdInfo)[0];
+		}
+
+		op.cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	}
+
+	return op;
+}
+
+
+vk::CommandBuffer RendererImpl::allocateTransferCmdBuf() {
+	vk::CommandBuffer cmdBuf;
+	if (!freeTransferCmdBufs.empty()) {
+		cmdBuf = freeTransferCmdBufs.back();
+		freeTransferCmdBufs.pop_back();
+	} else {
+		vk::CommandBufferAllocateInfo cmdInfo(transferCmdPool, vk::CommandBufferLevel::ePrimary, 1);
+		cmdBuf = device.allocateCommandBuffers(cmdInfo)[0];
+	}
+
+	cmdBuf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+	return cmdBuf;
+}
+
+
+void RendererImpl::freeTransferCmdBuf(vk::CommandBuffer cmdBuf) {
+	assert(cmdBuf);
+	freeTransferCmdBufs.push_back(cmdBuf);
+}
+
+
+StagingAllocation RendererImpl::allocateStaging(UploadOp &op, uint32_t size) {
+	assert(size > 0);
+	assert(op.cmdBuf);
+
+	uint32_t offset = 0;
+	if (!op.stagingBlocks.empty()) {
+		const auto &block = op.stagingBlocks.back();
+		offset = (block.used + stagingAlign - 1) & ~(stagingAlign - 1);
+	}
+
+	if (op.stagingBlocks.empty() || offset + size > op.stagingBlocks.back().size) {
+		offset = 0;
+
+		std::unique_lock<std::mutex> lock(stagingMutex);
+		auto fits = [size] (const StagingBlock &b) { return b.size >= size; };
+		auto it = std::find_if(freeStagingBlocks.begin(), freeStagingBlocks.end(), fits);
+		if (it == freeStagingBlocks.end() && !submittedStaging.empty()) {
+			// uploads submitted early might be done already, don't wait for their frame
+			recycleStagingBlocks();
+			it = std::find_if(freeStagingBlocks.begin(), freeStagingBlocks.end(), fits);
+		}
+		if (it != freeStagingBlocks.end()) {
+			op.stagingBlocks.emplace_back(std::move(*it));
+			freeStagingBlocks.erase(it);
+		} else {
+			lock.unlock();
+
+			StagingBlock block;
+			block.size        = std::max(size, stagingBlockSize);
+
+			vk::BufferCreateInfo bufInfo;
+			bufInfo.size      = block.size;
+			bufInfo.usage     = vk::BufferUsageFlagBits::eTransferSrc;
+			block.buffer      = device.createBuffer(bufInfo);
+
+			// decoders writing through mipLevelWriter read back earlier rows
+			VmaAllocationCreateInfo req = {};
+			req.usage         = VMA_MEMORY_USAGE_CPU_ONLY;
+			req.flags         = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			req.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			req.pUserData     = nullptr;
+			vmaAllocateMemoryForBuffer(allocator, block.buffer, &req, &block.memory, &block.allocationInfo);
+			assert(block.allocationInfo.pMappedData);
+			countMemory(MemoryKind::Staging, block.memory, true);
+			device.bindBufferMemory(block.buffer, block.allocationInfo.deviceMemory, block.allocationInfo.offset);
+			LOG_DEBUG("Created staging block of %u bytes\n", block.size);
+
+			op.stagingBlocks.emplace_back(std::move(block));
+		}
+	}
+
+	auto &block = op.stagingBlocks.back();
+	assert(offset + size <= block.size);
+	block.used      = offset + size;
+	op.stagingSize += size;
+
+	StagingAllocation result;
+	result.buffer   = block.buffer;
+	result.memory   = block.memory;
+	result.offset   = offset;
+	result.ptr      = static_cast<char *>(block.allocationInfo.pMappedData) + offset;
+
+	return result;
+}
+
+
+void RendererImpl::finishUpload(UploadOp &op) {
+	if (op.stagingSize < maxUploadBatchSize) {
+		return;
+	}
+
+	if (!op.context) {
+		submitUploads();
+		return;
+	}
+
+	closeThreadUpload(op);
+}
+
+
+void RendererImpl::closeThreadUpload(UploadOp &op) {
+	assert(op.context);
+	assert(op.cmdBuf);
+
+	// caller still holds the context's lock
+	// queue submission is left to the rendering thread
+	op.cmdBuf.end();
+
+	std::lock_guard<std::mutex> lock(closedUploadsMutex);
+	closedUploads.emplace_back(std::move(op));
+}
+
+
+void RendererImpl::submitUploads() {
+	UploadOp &op = currentUpload;
+	if (!op.cmdBuf) {
+		return;
+	}
+
 	op.cmdBuf.end();
+	submitUpload(op);
+}
+
+
+void RendererImpl::submitThreadUploads() {
+	assert(isRenderThread());
+
+	std::vector<UploadOp> ops;
+	{
+		std::lock_guard<std::mutex> lock(closedUploadsMutex);
+		ops = std::move(closedUploads);
+		closedUploads.clear();
+	}
+
+	{
+		std::lock_guard<std::mutex> contextsLock(uploadContextsMutex);
+		for (auto &c : uploadContexts) {
+			UploadContext &ctx = *c.second;
+			// a mipLevelWriter can take a while, don't wait for it
+			if (ctx.writing.load()) {
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(ctx.mutex);
+			if (ctx.op.cmdBuf) {
+				ctx.op.cmdBuf.end();
+				ops.emplace_back(std::move(ctx.op));
+			}
+		}
+	}
+
+	for (auto &op : ops) {
+		if (!timelineSemaphores) {
+			op.semaphore = allocateSemaphore();
+		}
+		numUploads++;
+
+		submitUpload(op);
+	}
+}
+
+
+void RendererImpl::submitUpload(UploadOp &op) {
+	assert(op.cmdBuf);
+	LOG_DEBUG("Submitting %u copies (%u bytes) in one upload\n", op.numCopies, op.stagingSize);
 
 	vk::SubmitInfo submit;
 	submit.waitSemaphoreCount   = 0;
 	submit.commandBufferCount   = 1;
 	submit.pCommandBuffers      = &op.cmdBuf;
 	submit.signalSemaphoreCount = 1;
-	submit.pSignalSemaphores    = &op.semaphore;
 
-	transferQueue.submit({ submit }, vk::Fence());
+	vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+	if (timelineSemaphores) {
+		transferTimelineValue++;
+		op.timelineValue = transferTimelineValue;
+
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues    = &op.timelineValue;
+		submit.pNext                = &timelineInfo;
+		submit.pSignalSemaphores    = &transferTimeline;
+	} else {
+		submit.pSignalSemaphores    = &op.semaphore;
+	}
+
+	// lets allocateStaging see when the copies are done
+	vk::Fence fence;
+	if (!timelineSemaphores) {
+		fence = allocateFence();
+	}
+
+	queueSubmit(transferQueue, submit, fence);
+
+	{
+		SubmittedStaging staging;
+		staging.timelineValue = op.timelineValue;
+		staging.fence         = fence;
+		staging.blocks        = std::move(op.stagingBlocks);
+		op.stagingBlocks.clear();
+
+		std::lock_guard<std::mutex> lock(stagingMutex);
+		submittedStaging.emplace_back(std::move(staging));
+	}
 
 	uploads.emplace_back(std::move(op));
 }
 
 
+void RendererImpl::recordMipGeneration(vk::CommandBuffer cmdBuf, const MipGeneration &gen, bool acquire) {
+	assert(gen.numMips > 1);
+
+	vk::ImageMemoryBarrier barrier;
+	barrier.srcQueueFamilyIndex                  = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex                  = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image                                = gen.image;
+	barrier.subresourceRange.aspectMask          = vk::ImageAspectFlagBits::eColor;
+	barrier.subresourceRange.levelCount          = 1;
+	barrier.subresourceRange.layerCount          = 1;
+
+	if (acquire) {
+		// matches the release in createTexture
+		barrier.srcAccessMask                    = vk::AccessFlagBits();
+		barrier.dstAccessMask                    = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+		barrier.oldLayout                        = vk::ImageLayout::eTransferDstOptimal;
+		barrier.newLayout                        = vk::ImageLayout::eTransferDstOptimal;
+		barrier.srcQueueFamilyIndex              = transferQueueIndex;
+		barrier.dstQueueFamilyIndex              = graphicsQueueIndex;
+		barrier.subresourceRange.baseMipLevel    = 0;
+		barrier.subresourceRange.levelCount      = VK_REMAINING_MIP_LEVELS;
+		cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { barrier });
+
+		barrier.srcQueueFamilyIndex              = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex              = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.levelCount      = 1;
+	}
+
+	int32_t w = static_cast<int32_t>(gen.width), h = static_cast<int32_t>(gen.height);
+	for (unsigned int i = 1; i < gen.numMips; i++) {
+		// previous level becomes the blit source
+		barrier.srcAccessMask                    = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask                    = vk::AccessFlagBits::eTransferRead;
+		barrier.oldLayout                        = vk::ImageLayout::eTransferDstOptimal;
+		barrier.newLayout                        = vk::ImageLayout::eTransferSrcOptimal;
+		barrier.subresourceRange.baseMipLevel    = i - 1;
+		cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { barrier });
+
+		int32_t nextW = std::max(w / 2, 1), nextH = std::max(h / 2, 1);
+
+		vk::ImageBlit blit;
+		blit.srcSubresource.aspectMask     = vk::ImageAspectFlagBits::eColor;
+		blit.srcSubresource.mipLevel       = i - 1;
+		blit.srcSubresource.layerCount     = 1;
+		blit.srcOffsets[1]                 = vk::Offset3D(w, h, 1);
+		blit.dstSubresource.aspectMask     = vk::ImageAspectFlagBits::eColor;
+		blit.dstSubresource.mipLevel       = i;
+		blit.dstSubresource.layerCount     = 1;
+		blit.dstOffsets[1]                 = vk::Offset3D(nextW, nextH, 1);
+		cmdBuf.blitImage(gen.image, vk::ImageLayout::eTransferSrcOptimal, gen.image, vk::ImageLayout::eTransferDstOptimal, { blit }, vk::Filter::eLinear);
+
+		// previous level is done
+		barrier.srcAccessMask                    = vk::AccessFlagBits::eTransferRead;
+		barrier.dstAccessMask                    = vk::AccessFlagBits::eShaderRead;
+		barrier.oldLayout                        = vk::ImageLayout::eTransferSrcOptimal;
+		barrier.newLayout                        = vk::ImageLayout::eShaderReadOnlyOptimal;
+		cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), {}, {}, { barrier });
+
+		w = nextW;
+		h = nextH;
+	}
+
+	// last level was only written
+	barrier.srcAccessMask                        = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask                        = vk::AccessFlagBits::eShaderRead;
+	barrier.oldLayout                            = vk::ImageLayout::eTransferDstOptimal;
+	barrier.newLayout                            = vk::ImageLayout::eShaderReadOnlyOptimal;
+	barrier.subresourceRange.baseMipLevel        = gen.numMips - 1;
+	cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), {}, {}, { barrier });
+}
+
+
+void RendererImpl::releaseUploadOp(UploadOp &op) {
+	if (op.context) {
+		std::lock_guard<std::mutex> lock(op.context->mutex);
+		op.context->freeCmdBufs.push_back(op.cmdBuf);
+	} else {
+		freeTransferCmdBuf(op.cmdBuf);
+	}
+	if (op.semaphore) {
+		freeSemaphore(op.semaphore);
+	}
+
+	op.cmdBuf      = vk::CommandBuffer();
+	op.context     = nullptr;
+	op.semaphore   = vk::Semaphore();
+	op.timelineValue = 0;
+	op.semWaitMask = vk::PipelineStageFlags();
+	op.stagingSize = 0;
+	op.numCopies   = 0;
+	op.imageAcquireBarriers.clear();
+	op.bufferAcquireBarriers.clear();
+	op.mipGenerations.clear();
+
+	// submitUpload gave them to submittedStaging
+	assert(op.stagingBlocks.empty());
+}
+
+
+void RendererImpl::recycleStagingBlocks() {
+	uint64_t transferDone = 0;
+	if (timelineSemaphores && !submittedStaging.empty()) {
+		transferDone = device.getSemaphoreCounterValueKHR(transferTimeline, dispatcher);
+	}
+
+	// checked in submit order, later ones are unlikely to be done if this one isn't
+	auto it = submittedStaging.begin();
+	for ( ; it != submittedStaging.end(); it++) {
+		if (timelineSemaphores) {
+			if (transferDone < it->timelineValue) {
+				break;
+			}
+		} else {
+			if (device.getFenceStatus(it->fence) != vk::Result::eSuccess) {
+				break;
+			}
+			finishedStagingFences.push_back(it->fence);
+		}
+
+		for (auto &block : it->blocks) {
+			releaseStagingBlock(block);
+		}
+	}
+	submittedStaging.erase(submittedStaging.begin(), it);
+}
+
+
+void RendererImpl::releaseStagingBlock(StagingBlock &block) {
+	// keep the standard size blocks for reuse, oversized ones were for a single large resource
+	if (block.size == stagingBlockSize) {
+		block.used = 0;
+		freeStagingBlocks.emplace_back(std::move(block));
+	} else {
+		destroyStagingBlock(block);
+	}
+}
+
+
+void RendererImpl::recycleStaging() {
+	std::lock_guard<std::mutex> lock(stagingMutex);
+	recycleStagingBlocks();
+
+	for (auto fence : finishedStagingFences) {
+		freeFence(fence);
+	}
+	finishedStagingFences.clear();
+}
+
+
+void RendererImpl::destroyStagingBlock(StagingBlock &block) {
+	assert(block.buffer);
+	assert(block.memory);
+
+	device.destroyBuffer(block.buffer);
+	countMemory(MemoryKind::Staging, block.memory, false);
+	vmaFreeMemory(allocator, block.memory);
+
+	block.buffer = vk::Buffer();
+	block.memory = VK_NULL_HANDLE;
+	block.size   = 0;
+	block.used   = 0;
+}
+
+
 vk::Semaphore RendererImpl::allocateSemaphore() {
 	if (!freeSemaphores.empty()) {
 		auto ret = freeSemaphores.back();
@@ -2929,26 +6547,55 @@ void RendererImpl::freeSemaphore(vk::Semaphore sem) {
 }
 
 
+vk::Fence RendererImpl::allocateFence() {
+	if (!freeFences.empty()) {
+		auto ret = freeFences.back();
+		freeFences.pop_back();
+		return ret;
+	}
+
+	return device.createFence(vk::FenceCreateInfo());
+}
+
+
+void RendererImpl::freeFence(vk::Fence fence) {
+	assert(fence);
+
+	device.resetFences( { fence } );
+	freeFences.push_back(fence);
+}
+
+
 void RendererImpl::deleteBufferInternal(Buffer &b) {
-	assert(!b.ringBufferAlloc);
 	assert(b.lastUsedFrame <= lastSyncedFrame);
-	this->device.destroyBuffer(b.buffer);
-	assert(b.memory != nullptr);
-	vmaFreeMemory(this->allocator, b.memory);
+	if (b.arena != noBufferArena) {
+		assert(b.memory == nullptr);
+		std::lock_guard<std::mutex> lock(resourceMutex);
+		arenaFree(b.arena, b.offset, b.size);
+	} else {
+		retiredObjects.buffers.push_back(b.buffer);
+		assert(b.memory != nullptr);
+		countMemory(MemoryKind::Buffer, b.memory, false);
+		retiredObjects.allocations.push_back(b.memory);
+		// leaves a hole for defragmentMemory to close
+		defragmentPending = true;
+	}
 	assert(b.type   != +BufferType::Invalid);
 
 	b.buffer          = vk::Buffer();
-	b.ringBufferAlloc = false;
 	b.memory          = 0;
+	b.arena           = noBufferArena;
 	b.size            = 0;
 	b.offset          = 0;
 	b.lastUsedFrame   = 0;
+	b.used            = false;
 	b.type            = BufferType::Invalid;
+	b.usage           = BufferUsage::Static;
 }
 
 
 void RendererImpl::deleteFramebufferInternal(Framebuffer &fb) {
-	device.destroyFramebuffer(fb.framebuffer);
+	retiredObjects.framebuffers.push_back(fb.framebuffer);
 	fb.framebuffer = vk::Framebuffer();
 	fb.width       = 0;
 	fb.height      = 0;
@@ -2956,18 +6603,51 @@ void RendererImpl::deleteFramebufferInternal(Framebuffer &fb) {
 
 
 void RendererImpl::deletePipelineInternal(Pipeline &p) {
-	device.destroyPipelineLayout(p.layout);
+	if (p.sharedKey != 0) {
+		auto it = sharedPipelines.find(p.sharedKey);
+		assert(it != sharedPipelines.end());
+		assert(it->second.refCount > 0);
+		it->second.refCount--;
+		if (it->second.refCount != 0) {
+			p.layout   = vk::PipelineLayout();
+			p.pipeline = vk::Pipeline();
+			p.sharedKey = 0;
+			return;
+		}
+		// finishPipelineLinks might have replaced it after this was deleted
+		if (p.pipeline != it->second.pipeline) {
+			assert(p.layout == it->second.layout);
+			p.pipeline = it->second.pipeline;
+		}
+		sharedPipelines.erase(it);
+		p.sharedKey = 0;
+	}
+
+	if (!pendingPipelineLinks.empty()) {
+		cancelPipelineLink(p.pipeline);
+	}
+
+	retiredObjects.pipelineLayouts.push_back(p.layout);
 	p.layout = vk::PipelineLayout();
-	device.destroyPipeline(p.pipeline);
+	retiredObjects.pipelines.push_back(p.pipeline);
 	p.pipeline = vk::Pipeline();
 }
 
 
 void RendererImpl::deleteRenderTargetInternal(RenderTarget &rt) {
-	assert(rt.texture);
+	if (!rt.texture) {
+		// swapchain image, only the view is ours
+		// destroyed right away so it's gone before destroyRetiredSwapchains destroys the image
+		assert(rt.imageView);
+		this->device.destroyImageView(rt.imageView);
+		rt.imageView = vk::ImageView();
+		rt.image     = vk::Image();
+		return;
+	}
+
 	auto &tex = this->textures.get(rt.texture);
 	assert(tex.image == rt.image);
-	assert(tex.imageView == rt.imageView);
+	assert((tex.imageView == rt.imageView) != isStencilFormat(rt.format));
 
 	if (rt.additionalView) {
 		auto &view = this->textures.get(rt.additionalView);
@@ -2976,7 +6656,7 @@ void RendererImpl::deleteRenderTargetInternal(RenderTarget &rt) {
 		assert(view.imageView);
 		assert(view.renderTarget);
 
-		this->device.destroyImageView(view.imageView);
+		retiredObjects.imageViews.push_back(view.imageView);
 
 		view.image        = vk::Image();
 		view.imageView    = vk::ImageView();
@@ -2986,118 +6666,620 @@ void RendererImpl::deleteRenderTargetInternal(RenderTarget &rt) {
 		rt.additionalView = TextureHandle();
 	}
 
+	if (tex.imageView != rt.imageView) {
+		retiredObjects.imageViews.push_back(tex.imageView);
+	}
+
 	tex.image        = vk::Image();
 	tex.imageView    = vk::ImageView();
 	tex.renderTarget = false;
 
 	assert(tex.memory != nullptr);
-	vmaFreeMemory(this->allocator, tex.memory);
+	countMemory(MemoryKind::RenderTarget, tex.memory, false);
+	retiredObjects.allocations.push_back(tex.memory);
 	tex.memory = nullptr;
 
-	this->textures.remove(rt.texture);
-	rt.texture = TextureHandle();
+	this->textures.remove(rt.texture);
+	rt.texture = TextureHandle();
+
+	retiredObjects.imageViews.push_back(rt.imageView);
+	retiredObjects.images.push_back(rt.image);
+	rt.imageView = vk::ImageView();
+	rt.image     = vk::Image();
+}
+
+
+void RendererImpl::deleteRenderPassInternal(RenderPass &rp) {
+	if (rp.staticContents.cmdBuf) {
+		freeStaticContents(rp.staticContents);
+	}
+	retiredObjects.renderPasses.push_back(rp.renderPass);
+	rp.renderPass = vk::RenderPass();
+	rp.clearValueCount = 0;
+	rp.numSamples      = 0;
+	rp.numColorAttachments = 0;
+	rp.numAttachments  = 0;
+}
+
+
+void RendererImpl::deleteSamplerInternal(Sampler &s) {
+	assert(s.sampler);
+	retiredObjects.samplers.push_back(s.sampler);
+	s.sampler = vk::Sampler();
+}
+
+
+void RendererImpl::deleteTextureInternal(Texture &tex) {
+	assert(!tex.renderTarget);
+	retiredObjects.imageViews.push_back(tex.imageView);
+	retiredObjects.images.push_back(tex.image);
+	tex.imageView = vk::ImageView();
+	tex.image     = vk::Image();
+	assert(tex.memory != nullptr);
+	countMemory(MemoryKind::Texture, tex.memory, false);
+	retiredObjects.allocations.push_back(tex.memory);
+	tex.memory = nullptr;
+
+	// entry keeps pointing to the destroyed view until the index is reused
+	// which is fine since it's partially bound
+	if (tex.tableIndex != MAX_TEXTURE_TABLE_SIZE) {
+		std::lock_guard<std::mutex> lock(resourceMutex);
+		freeTextureTableIndices.push_back(tex.tableIndex);
+		tex.tableIndex = MAX_TEXTURE_TABLE_SIZE;
+	}
+}
+
+
+void RendererImpl::deleteResourceInternal(Resource &r) {
+	boost::apply_visitor(ResourceDeleter(this), r);
+
+	// a new object could reuse the handle so cached descriptor sets can't be trusted
+	dsCacheGeneration++;
+}
+
+
+void RendererImpl::flushRetiredObjects() {
+	if (retiredObjects.empty()) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(destroyMutex);
+		destroyQueue.emplace_back(std::move(retiredObjects));
+	}
+	destroyCV.notify_one();
+
+	retiredObjects = RetiredObjects();
+}
+
+
+// views before their images and pipelines before their layouts
+void RendererImpl::destroyRetiredObjects(RetiredObjects &objects) {
+	for (auto fb : objects.framebuffers) {
+		device.destroyFramebuffer(fb);
+	}
+	objects.framebuffers.clear();
+
+	for (auto pipeline : objects.pipelines) {
+		device.destroyPipeline(pipeline);
+	}
+	objects.pipelines.clear();
+
+	for (auto layout : objects.pipelineLayouts) {
+		device.destroyPipelineLayout(layout);
+	}
+	objects.pipelineLayouts.clear();
+
+	for (auto rp : objects.renderPasses) {
+		device.destroyRenderPass(rp);
+	}
+	objects.renderPasses.clear();
+
+	for (auto sampler : objects.samplers) {
+		device.destroySampler(sampler);
+	}
+	objects.samplers.clear();
+
+	for (auto view : objects.imageViews) {
+		device.destroyImageView(view);
+	}
+	objects.imageViews.clear();
+
+	for (auto image : objects.images) {
+		device.destroyImage(image);
+	}
+	objects.images.clear();
+
+	for (auto buffer : objects.buffers) {
+		device.destroyBuffer(buffer);
+	}
+	objects.buffers.clear();
+
+	// VMA is internally synchronized
+	for (auto memory : objects.allocations) {
+		vmaFreeMemory(allocator, memory);
+	}
+	objects.allocations.clear();
+}
+
+
+// the render thread has no references left to these so nothing else needs synchronizing
+void RendererImpl::destroyThreadFunc() {
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+	placeCurrentThread(CoreClass::Efficiency);
+
+	std::unique_lock<std::mutex> lock(destroyMutex);
+	while (true) {
+		destroyCV.wait(lock, [this] () { return destroyStop || !destroyQueue.empty(); });
+		if (destroyQueue.empty()) {
+			assert(destroyStop);
+			return;
+		}
+
+		std::vector<RetiredObjects> batches = std::move(destroyQueue);
+		destroyQueue.clear();
+
+		lock.unlock();
+		for (auto &objects : batches) {
+			destroyRetiredObjects(objects);
+		}
+		lock.lock();
+	}
+}
+
+
+void RendererImpl::deleteFrameInternal(Frame &f) {
+	assert(f.status == Frame::Status::Ready);
+	assert(f.fence);
+	freeFence(f.fence);
+	f.fence = vk::Fence();
+
+	assert(!f.dsPools.empty());
+	for (auto pool : f.dsPools) {
+		device.destroyDescriptorPool(pool);
+	}
+	f.dsPools.clear();
+	f.dsPoolIdx      = 0;
+	f.dsPoolCapacity = 0;
+	f.dsCache.clear();
+
+	assert(f.commandBuffer);
+	assert(f.barrierCmdBuf);
+	device.freeCommandBuffers(f.commandPool, { f.commandBuffer, f.barrierCmdBuf });
+	f.commandBuffer = vk::CommandBuffer();
+	f.barrierCmdBuf = vk::CommandBuffer();
+
+	if (f.computeCmdBuf) {
+		assert(f.postCmdBuf);
+		device.freeCommandBuffers(f.commandPool, { f.computeCmdBuf, f.postCmdBuf });
+		f.computeCmdBuf = vk::CommandBuffer();
+		f.postCmdBuf    = vk::CommandBuffer();
+	}
+
+	if (!f.secondaryCmdBufs.empty()) {
+		device.freeCommandBuffers(f.commandPool, f.secondaryCmdBufs);
+		f.secondaryCmdBufs.clear();
+	}
+	f.usedSecondaryCmdBufs = 0;
+
+	assert(!f.acquireSem);
+	assert(!f.renderDoneSem);
+	assert(f.releasedSemaphores.empty());
+
+	if (f.timestampPool) {
+		device.destroyQueryPool(f.timestampPool);
+		f.timestampPool = vk::QueryPool();
+	}
+
+	if (f.statisticsPool) {
+		device.destroyQueryPool(f.statisticsPool);
+		f.statisticsPool = vk::QueryPool();
+	}
+
+	if (f.performancePool) {
+		device.destroyQueryPool(f.performancePool);
+		f.performancePool = vk::QueryPool();
+		f.performanceTimers = 0;
+	}
+
+	assert(f.commandPool);
+	device.destroyCommandPool(f.commandPool);
+	f.commandPool = vk::CommandPool();
+
+	assert(f.deleteResources.empty());
+}
+
+
+vk::DescriptorPool RendererImpl::createDescriptorPool(unsigned int maxSets) {
+	// as many of each type as sets, running out of one just chains another pool
+	std::vector<vk::DescriptorPoolSize> poolSizes;
+	for (const auto t : descriptorTypes ) {
+		vk::DescriptorPoolSize ps;
+		ps.type            = t;
+		ps.descriptorCount = maxSets;
+		poolSizes.push_back(ps);
+	}
+
+	vk::DescriptorPoolCreateInfo dsInfo;
+	dsInfo.maxSets       = maxSets;
+	dsInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	dsInfo.pPoolSizes    = &poolSizes[0];
+
+	return device.createDescriptorPool(dsInfo);
+}
+
+
+vk::DescriptorSet RendererImpl::allocateDescriptorSet(Frame &frame, vk::DescriptorSetLayout layout) {
+	assert(!frame.dsPools.empty());
+
+	vk::DescriptorSetAllocateInfo dsInfo;
+	dsInfo.descriptorSetCount  = 1;
+	dsInfo.pSetLayouts         = &layout;
+
+	bool newPool = false;
+	while (true) {
+		assert(frame.dsPoolIdx < frame.dsPools.size());
+		dsInfo.descriptorPool = frame.dsPools[frame.dsPoolIdx];
+
+		vk::DescriptorSet ds;
+		auto result = device.allocateDescriptorSets(&dsInfo, &ds);
+		if (result == vk::Result::eSuccess) {
+			return ds;
+		}
+
+		// an empty pool should always have room for one set
+		if (newPool || (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)) {
+			LOG("Failed to allocate descriptor set: %s\n", vk::to_string(result).c_str());
+			throw std::runtime_error("Failed to allocate descriptor set");
+		}
+
+		frame.dsPoolIdx++;
+		if (frame.dsPoolIdx == frame.dsPools.size()) {
+			LOG_DEBUG("Descriptor pool full after %u sets, adding another\n", static_cast<unsigned int>(frame.dsCache.size()));
+			frame.dsPools.push_back(createDescriptorPool(dsPoolSize));
+			frame.dsPoolCapacity += dsPoolSize;
+			newPool = true;
+
+			// don't wait for the next size check, beginFrame replaces the chain with one pool this big
+			dsPoolSize = std::max(dsPoolSize, nextPow2(frame.dsPoolCapacity));
+		}
+	}
+}
+
+
+void RendererImpl::resetDescriptorPools(Frame &frame) {
+	if (frame.dsPools.size() == 1 && frame.dsPoolCapacity == dsPoolSize) {
+		device.resetDescriptorPool(frame.dsPools[0]);
+	} else {
+		for (auto pool : frame.dsPools) {
+			device.destroyDescriptorPool(pool);
+		}
+		frame.dsPools.clear();
+
+		frame.dsPools.push_back(createDescriptorPool(dsPoolSize));
+		frame.dsPoolCapacity = dsPoolSize;
+	}
+
+	frame.dsPoolIdx = 0;
+	frame.dsCache.clear();
+}
+
+
+void RendererImpl::beginAsyncCompute() {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+#endif  // NDEBUG
+	assert(features.asyncCompute);
+	assert(!asyncComputeActive);
+
+	auto &frame = frames.at(currentFrameIdx);
+	// presentFrame splits the frame into three submits so only one section per frame
+	assert(!frame.usedAsyncCompute);
+	frame.usedAsyncCompute = true;
+	asyncComputeActive     = true;
+
+	flushBarriers();
+	currentCommandBuffer.end();
+
+	currentCommandBuffer = frame.computeCmdBuf;
+	currentCommandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	currentPipelineLayout = vk::PipelineLayout();
+}
+
+
+void RendererImpl::endAsyncCompute() {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+#endif  // NDEBUG
+	assert(asyncComputeActive);
+	asyncComputeActive = false;
+
+	auto &frame = frames.at(currentFrameIdx);
+	assert(frame.usedAsyncCompute);
+
+	flushBarriers();
+	currentCommandBuffer.end();
+
+	currentCommandBuffer = frame.postCmdBuf;
+	currentCommandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+	currentPipelineLayout = vk::PipelineLayout();
+}
+
+
+void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	inRenderPass  = true;
+	validPipeline = false;
+#endif  // NDEBUG
+	assert(!asyncComputeActive);
+
+	const auto &pass = renderPasses.get(rpHandle);
+	const auto &fb   = framebuffers.get(fbHandle);
+	assert(fb.width  > 0);
+	assert(fb.height > 0);
+
+	startRenderPass(pass, fb, secondaryCmdBufs);
+
+	if (secondaryCmdBufs) {
+		auto cmdBuf = nextSecondaryCmdBuf(frames.at(currentFrameIdx));
+		beginSecondary(cmdBuf, vk::CommandBufferUsageFlagBits::eOneTimeSubmit, pass, &fb);
+	}
+
+	currentPipelineLayout = vk::PipelineLayout();
+	currentRenderPass  = rpHandle;
+	currentFramebuffer = fbHandle;
+}
+
+
+bool RendererImpl::beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
+	if (!features.staticRenderPasses) {
+		beginRenderPass(rpHandle, fbHandle);
+		return true;
+	}
+
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	inRenderPass  = true;
+	validPipeline = false;
+#endif  // NDEBUG
+	assert(!asyncComputeActive);
+
+	auto &pass     = renderPasses.get(rpHandle);
+	const auto &fb = framebuffers.get(fbHandle);
+	assert(fb.width  > 0);
+	assert(fb.height > 0);
+
+	startRenderPass(pass, fb, true);
+
+	currentPipelineLayout = vk::PipelineLayout();
+	currentRenderPass  = rpHandle;
+	currentFramebuffer = fbHandle;
+
+	if (pass.staticContents.cmdBuf) {
+		currentCommandBuffer.executeCommands(1, &pass.staticContents.cmdBuf);
+		return false;
+	}
+
+	vk::CommandBufferAllocateInfo allocInfo(staticCmdPool, vk::CommandBufferLevel::eSecondary, 1);
+	auto bufs = device.allocateCommandBuffers(allocInfo);
+	assert(bufs.size() == 1);
+	pass.staticContents.cmdBuf = bufs.at(0);
+	pass.staticContents.dsPool = createDescriptorPool(staticDescriptorSets);
+
+	// frames in flight replay it at the same time, each into its own framebuffer
+	beginSecondary(pass.staticContents.cmdBuf, vk::CommandBufferUsageFlagBits::eSimultaneousUse, pass, nullptr);
+	recordingStatic = true;
+
+	return true;
+}
+
+
+void RendererImpl::invalidateStaticRenderPass(RenderPassHandle rpHandle) {
+	assert(!recordingStatic || currentRenderPass != rpHandle);
+	retireStaticContents(renderPasses.get(rpHandle));
+}
+
+
+void RendererImpl::startRenderPass(const RenderPass &pass, const Framebuffer &fb, bool secondary) {
+	if (dynamicRendering) {
+		beginRendering(pass, fb, secondary);
+		return;
+	}
+
+	assert(pass.renderPass);
+	assert(fb.framebuffer);
+	// clear image
+
+	vk::RenderPassBeginInfo info;
+	info.renderPass                = pass.renderPass;
+	info.framebuffer               = fb.framebuffer;
+	info.renderArea.extent.width   = fb.width;
+	info.renderArea.extent.height  = fb.height;
+	info.clearValueCount           = pass.clearValueCount;
+	info.pClearValues              = &pass.clearValues[0];
+
+	flushBarriers();
 
-	this->device.destroyImageView(rt.imageView);
-	this->device.destroyImage(rt.image);
-	rt.imageView = vk::ImageView();
-	rt.image     = vk::Image();
+	currentCommandBuffer.beginRenderPass(info, secondary ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
 }
 
 
-void RendererImpl::deleteRenderPassInternal(RenderPass &rp) {
-	this->device.destroyRenderPass(rp.renderPass);
-	rp.renderPass = vk::RenderPass();
-	rp.clearValueCount = 0;
-	rp.numSamples      = 0;
-	rp.numColorAttachments = 0;
+vk::CommandBuffer RendererImpl::nextSecondaryCmdBuf(Frame &frame) {
+	if (frame.usedSecondaryCmdBufs == frame.secondaryCmdBufs.size()) {
+		vk::CommandBufferAllocateInfo allocInfo(frame.commandPool, vk::CommandBufferLevel::eSecondary, 1);
+		auto bufs = device.allocateCommandBuffers(allocInfo);
+		assert(bufs.size() == 1);
+		frame.secondaryCmdBufs.push_back(bufs.at(0));
+	}
+	auto cmdBuf = frame.secondaryCmdBufs.at(frame.usedSecondaryCmdBufs);
+	frame.usedSecondaryCmdBufs++;
+
+	return cmdBuf;
 }
 
 
-void RendererImpl::deleteSamplerInternal(Sampler &s) {
-	assert(s.sampler);
-	this->device.destroySampler(s.sampler);
-	s.sampler = vk::Sampler();
+void RendererImpl::beginSecondary(vk::CommandBuffer cmdBuf, vk::CommandBufferUsageFlags usage, const RenderPass &pass, const Framebuffer *fb) {
+	beginSecondaryCmdBuf(cmdBuf, usage, pass, fb);
+
+	primaryCommandBuffer = currentCommandBuffer;
+	currentCommandBuffer = cmdBuf;
 }
 
 
-void RendererImpl::deleteTextureInternal(Texture &tex) {
-	assert(!tex.renderTarget);
-	this->device.destroyImageView(tex.imageView);
-	this->device.destroyImage(tex.image);
-	tex.imageView = vk::ImageView();
-	tex.image     = vk::Image();
-	assert(tex.memory != nullptr);
-	vmaFreeMemory(this->allocator, tex.memory);
-	tex.memory = nullptr;
-}
+void RendererImpl::beginSecondaryCmdBuf(vk::CommandBuffer cmdBuf, vk::CommandBufferUsageFlags usage, const RenderPass &pass, const Framebuffer *fb) const {
+	vk::CommandBufferInheritanceRenderingInfoKHR renderingInheritInfo;
+	vk::CommandBufferInheritanceInfo inheritInfo;
+	if (dynamicRendering) {
+		renderingInheritInfo.colorAttachmentCount    = pass.numColorAttachments;
+		renderingInheritInfo.pColorAttachmentFormats = &pass.colorFormats[0];
+		renderingInheritInfo.depthAttachmentFormat   = pass.depthFormat;
+		renderingInheritInfo.stencilAttachmentFormat = pass.stencilFormat;
+		renderingInheritInfo.viewMask                = pass.viewMask;
+		renderingInheritInfo.rasterizationSamples    = sampleCountFlagsFromNum(pass.numSamples);
 
+		// no render pass or framebuffer to inherit
+		inheritInfo.pNext       = &renderingInheritInfo;
+	} else {
+		inheritInfo.renderPass  = pass.renderPass;
+		inheritInfo.subpass     = 0;
+		if (fb) {
+			inheritInfo.framebuffer = fb->framebuffer;
+		}
+	}
+	if (pipelineStatistics) {
+		inheritInfo.pipelineStatistics = statisticsFlags;
+	}
 
-void RendererImpl::deleteResourceInternal(Resource &r) {
-	boost::apply_visitor(ResourceDeleter(this), r);
+	vk::CommandBufferBeginInfo beginInfo(usage | vk::CommandBufferUsageFlagBits::eRenderPassContinue);
+	beginInfo.pInheritanceInfo = &inheritInfo;
+	cmdBuf.begin(beginInfo);
 }
 
 
-void RendererImpl::deleteFrameInternal(Frame &f) {
-	assert(f.status == Frame::Status::Ready);
-	assert(f.fence);
-	device.destroyFence(f.fence);
-	f.fence = vk::Fence();
-
-	// owned by swapchain, don't delete
-	f.image = vk::Image();
+void RendererImpl::renderingBarriers(const RenderPass &pass, const Framebuffer &fb, bool begin) {
+	// same order as attachments in createRenderPass and createFramebuffer
+	std::array<vk::Image, 2 * MAX_COLOR_RENDERTARGETS + 1> images;
+	unsigned int numImages = 0;
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (fb.desc.colors_[i]) {
+			images[numImages++] = renderTargets.get(fb.desc.colors_[i]).image;
+		}
+	}
+	bool hasDepthStencil = bool(fb.desc.depthStencil_);
+	if (hasDepthStencil) {
+		images[numImages++] = renderTargets.get(fb.desc.depthStencil_).image;
+	}
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (fb.desc.resolves_[i]) {
+			images[numImages++] = renderTargets.get(fb.desc.resolves_[i]).image;
+		}
+	}
+	assert(numImages == pass.numAttachments);
 
-	assert(f.dsPool);
-	device.destroyDescriptorPool(f.dsPool);
-	f.dsPool = vk::DescriptorPool();
+	std::array<vk::ImageMemoryBarrier, 2 * MAX_COLOR_RENDERTARGETS + 1> barriers;
+	for (unsigned int i = 0; i < numImages; i++) {
+		const auto &attach = pass.attachments[i];
+		bool isDepth = hasDepthStencil && (i == pass.numColorAttachments);
+
+		vk::ImageLayout attachLayout;
+		vk::ImageAspectFlags aspect;
+		if (isDepth) {
+			attachLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+			aspect       = vk::ImageAspectFlagBits::eDepth;
+			if (pass.stencilFormat != vk::Format::eUndefined) {
+				aspect  |= vk::ImageAspectFlagBits::eStencil;
+			}
+		} else {
+			attachLayout = vk::ImageLayout::eColorAttachmentOptimal;
+			aspect       = vk::ImageAspectFlagBits::eColor;
+		}
 
-	assert(f.commandBuffer);
-	assert(f.presentCmdBuf);
-	assert(f.barrierCmdBuf);
-	device.freeCommandBuffers(f.commandPool, { f.commandBuffer, f.presentCmdBuf, f.barrierCmdBuf });
-	f.commandBuffer = vk::CommandBuffer();
-	f.presentCmdBuf = vk::CommandBuffer();
-	f.barrierCmdBuf = vk::CommandBuffer();
+		const auto &d = pass.dependencies[begin ? 0 : 1];
+		auto &b = barriers[i];
+		b.srcAccessMask               = d.srcAccessMask;
+		b.dstAccessMask               = d.dstAccessMask;
+		b.oldLayout                   = begin ? attach.initialLayout : attachLayout;
+		b.newLayout                   = begin ? attachLayout : attach.finalLayout;
+		b.image                       = images[i];
+		b.subresourceRange.aspectMask = aspect;
+		b.subresourceRange.levelCount = 1;
+		b.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+	}
 
-	assert(!f.acquireSem);
-	assert(!f.renderDoneSem);
+	const auto &d = pass.dependencies[begin ? 0 : 1];
+	currentCommandBuffer.pipelineBarrier(d.srcStageMask, d.dstStageMask, vk::DependencyFlags(), {}, {}, vk::ArrayProxy<const vk::ImageMemoryBarrier>(numImages, &barriers[0]));
+}
 
-	assert(f.commandPool);
-	device.destroyCommandPool(f.commandPool);
-	f.commandPool = vk::CommandPool();
 
-	assert(f.deleteResources.empty());
-}
+void RendererImpl::beginRendering(const RenderPass &pass, const Framebuffer &fb, bool secondary) {
+	flushBarriers();
 
+	// what vk::RenderPass would do at the start
+	renderingBarriers(pass, fb, true);
 
-void RendererImpl::beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle) {
-#ifndef NDEBUG
-	assert(inFrame);
-	assert(!inRenderPass);
-	inRenderPass  = true;
-	validPipeline = false;
-#endif  // NDEBUG
+	std::array<vk::RenderingAttachmentInfoKHR, MAX_COLOR_RENDERTARGETS> colorAttachments;
+	unsigned int attachNum = 0;
+	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
+		if (!fb.desc.colors_[i]) {
+			continue;
+		}
 
-	const auto &pass = renderPasses.get(rpHandle);
-	assert(pass.renderPass);
-	const auto &fb   = framebuffers.get(fbHandle);
-	assert(fb.framebuffer);
-	assert(fb.width  > 0);
-	assert(fb.height > 0);
-	// clear image
+		const auto &attach = pass.attachments[attachNum];
+		auto &a = colorAttachments[attachNum];
+		a.imageView   = renderTargets.get(fb.desc.colors_[i]).imageView;
+		a.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
+		a.loadOp      = attach.loadOp;
+		a.storeOp     = attach.storeOp;
+		if (attach.loadOp == vk::AttachmentLoadOp::eClear) {
+			a.clearValue  = pass.clearValues[attachNum];
+		}
+		if (fb.desc.resolves_[i]) {
+			a.resolveMode        = vk::ResolveModeFlagBits::eAverage;
+			a.resolveImageView   = renderTargets.get(fb.desc.resolves_[i]).imageView;
+			a.resolveImageLayout = vk::ImageLayout::eColorAttachmentOptimal;
+		}
+		attachNum++;
+	}
+	assert(attachNum == pass.numColorAttachments);
 
-	vk::RenderPassBeginInfo info;
-	info.renderPass                = pass.renderPass;
-	info.framebuffer               = fb.framebuffer;
+	vk::RenderingInfoKHR info;
 	info.renderArea.extent.width   = fb.width;
 	info.renderArea.extent.height  = fb.height;
-	info.clearValueCount           = pass.clearValueCount;
-	info.pClearValues              = &pass.clearValues[0];
-
-	currentCommandBuffer.beginRenderPass(info, vk::SubpassContents::eInline);
+	info.layerCount                = 1;
+	info.viewMask                  = pass.viewMask;
+	info.colorAttachmentCount      = pass.numColorAttachments;
+	info.pColorAttachments         = &colorAttachments[0];
+
+	// one image but separate load and store ops for depth and stencil
+	vk::RenderingAttachmentInfoKHR depthAttachment, stencilAttachment;
+	if (fb.desc.depthStencil_) {
+		const auto &attach = pass.attachments[attachNum];
+		vk::ImageView view = renderTargets.get(fb.desc.depthStencil_).imageView;
+
+		depthAttachment.imageView     = view;
+		depthAttachment.imageLayout   = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+		depthAttachment.loadOp        = attach.loadOp;
+		depthAttachment.storeOp       = attach.storeOp;
+		depthAttachment.clearValue    = pass.clearValues[attachNum];
+		info.pDepthAttachment         = &depthAttachment;
+
+		if (pass.stencilFormat != vk::Format::eUndefined) {
+			stencilAttachment             = depthAttachment;
+			stencilAttachment.loadOp      = attach.stencilLoadOp;
+			stencilAttachment.storeOp     = attach.stencilStoreOp;
+			info.pStencilAttachment       = &stencilAttachment;
+		}
+	}
 
-	currentPipelineLayout = vk::PipelineLayout();
-	currentRenderPass  = rpHandle;
-	currentFramebuffer = fbHandle;
+	if (secondary) {
+		info.flags = vk::RenderingFlagBitsKHR::eContentsSecondaryCommandBuffers;
+	}
+	currentCommandBuffer.beginRenderingKHR(info, dispatcher);
 }
 
 
@@ -3108,17 +7290,41 @@ void RendererImpl::endRenderPass() {
 	inRenderPass = false;
 #endif  // NDEBUG
 
-	currentCommandBuffer.endRenderPass();
+	// recording a secondary command buffer, a replayed one was already executed
+	if (primaryCommandBuffer) {
+		assert(secondaryCmdBufs || recordingStatic);
+		currentCommandBuffer.end();
+		primaryCommandBuffer.executeCommands(1, &currentCommandBuffer);
+		currentCommandBuffer = primaryCommandBuffer;
+		primaryCommandBuffer = vk::CommandBuffer();
+		recordingStatic      = false;
+	}
+
+	// state bound in a secondary command buffer doesn't carry over
+	currentPipelineLayout = vk::PipelineLayout();
 
 	const auto &pass = renderPasses.get(currentRenderPass);
 	const auto &fb = framebuffers.get(currentFramebuffer);
 
+	if (dynamicRendering) {
+		currentCommandBuffer.endRenderingKHR(dispatcher);
+		// what vk::RenderPass would do at the end
+		renderingBarriers(pass, fb, false);
+	} else {
+		currentCommandBuffer.endRenderPass();
+	}
+
 	// TODO: track depthstencil layout too
 	for (unsigned int i = 0; i < MAX_COLOR_RENDERTARGETS; i++) {
 		if (fb.desc.colors_[i]) {
 			auto &rt = renderTargets.get(fb.desc.colors_[i]);
 			rt.currentLayout = pass.desc.colorRTs_[i].finalLayout;
 		}
+
+		if (fb.desc.resolves_[i]) {
+			auto &rt = renderTargets.get(fb.desc.resolves_[i]);
+			rt.currentLayout = pass.desc.colorRTs_[i].resolveFinalLayout;
+		}
 	}
 
 	currentRenderPass = RenderPassHandle();
@@ -3126,6 +7332,205 @@ void RendererImpl::endRenderPass() {
 }
 
 
+void RendererImpl::beginGPUTimer(const std::string &name) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(!inGPUTimer);
+	inGPUTimer = true;
+#endif  // NDEBUG
+
+	auto &frame = frames.at(currentFrameIdx);
+	if (!frame.timestampPool) {
+		return;
+	}
+
+	// timers past the end of the pool are not recorded
+	uint32_t query = static_cast<uint32_t>(2 * frame.timerNames.size());
+	frame.timerNames.push_back(name);
+	if (query >= 2 * MAX_GPU_TIMERS) {
+		return;
+	}
+	currentCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.timestampPool, query);
+
+	if (frame.statisticsPool) {
+		currentCommandBuffer.beginQuery(frame.statisticsPool, query / 2, vk::QueryControlFlags());
+	}
+
+	// performance queries must end in the command buffer they began in
+	// and async compute timers are too short to be worth the bookkeeping
+	if (frame.performancePool && !asyncComputeActive) {
+		currentCommandBuffer.beginQuery(frame.performancePool, query / 2, vk::QueryControlFlags());
+		frame.performanceTimers |= 1u << (query / 2);
+	}
+}
+
+
+void RendererImpl::endGPUTimer() {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(inGPUTimer);
+	inGPUTimer = false;
+#endif  // NDEBUG
+
+	auto &frame = frames.at(currentFrameIdx);
+	if (!frame.timestampPool) {
+		return;
+	}
+
+	assert(!frame.timerNames.empty());
+	uint32_t query = static_cast<uint32_t>(2 * frame.timerNames.size() - 1);
+	if (query >= 2 * MAX_GPU_TIMERS) {
+		return;
+	}
+	currentCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, frame.timestampPool, query);
+
+	if (frame.statisticsPool) {
+		currentCommandBuffer.endQuery(frame.statisticsPool, query / 2);
+	}
+
+	if (frame.performanceTimers & (1u << (query / 2))) {
+		currentCommandBuffer.endQuery(frame.performancePool, query / 2);
+	}
+}
+
+
+void RendererImpl::pushDebugGroup(const char *name) {
+#ifndef NDEBUG
+	assert(inFrame);
+	debugGroupDepth++;
+#endif  // NDEBUG
+
+	if (debugLabels) {
+		vk::DebugUtilsLabelEXT label;
+		label.pLabelName = name;
+		currentCommandBuffer.beginDebugUtilsLabelEXT(label, dispatcher);
+	} else if (debugMarkers) {
+		vk::DebugMarkerMarkerInfoEXT marker;
+		marker.pMarkerName = name;
+		currentCommandBuffer.debugMarkerBeginEXT(marker, dispatcher);
+	}
+}
+
+
+void RendererImpl::popDebugGroup() {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(debugGroupDepth > 0);
+	debugGroupDepth--;
+#endif  // NDEBUG
+
+	if (debugLabels) {
+		currentCommandBuffer.endDebugUtilsLabelEXT(dispatcher);
+	} else if (debugMarkers) {
+		currentCommandBuffer.debugMarkerEndEXT(dispatcher);
+	}
+}
+
+
+// stages and accesses which must finish before leaving this layout
+static void layoutSrcUsage(Layout l, bool computeShaders, vk::PipelineStageFlags &stages, vk::AccessFlags &access) {
+	switch (l) {
+	case Layout::Undefined:
+		// contents are discarded but we don't know what used the image last
+		// so wait for all of it
+		stages = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eTransfer;
+		access = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eTransferWrite;
+		if (computeShaders) {
+			stages |= vk::PipelineStageFlagBits::eComputeShader;
+			access |= vk::AccessFlagBits::eShaderWrite;
+		}
+		return;
+
+	case Layout::ShaderRead:
+		// reads only need an execution dependency
+		stages = vk::PipelineStageFlagBits::eFragmentShader;
+		access = vk::AccessFlags();
+		if (computeShaders) {
+			stages |= vk::PipelineStageFlagBits::eComputeShader;
+		}
+		return;
+
+	case Layout::TransferSrc:
+		stages = vk::PipelineStageFlagBits::eTransfer;
+		access = vk::AccessFlags();
+		return;
+
+	case Layout::TransferDst:
+		stages = vk::PipelineStageFlagBits::eTransfer;
+		access = vk::AccessFlagBits::eTransferWrite;
+		return;
+
+	case Layout::ColorAttachment:
+		stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		access = vk::AccessFlagBits::eColorAttachmentWrite;
+		return;
+
+	case Layout::General:
+		// written by compute shaders
+		stages = vk::PipelineStageFlagBits::eComputeShader;
+		access = vk::AccessFlagBits::eShaderWrite;
+		return;
+
+	case Layout::Present:
+		// the acquire semaphore orders us after the presentation engine
+		stages = vk::PipelineStageFlagBits::eTopOfPipe;
+		access = vk::AccessFlags();
+		return;
+
+	}
+
+	UNREACHABLE();
+}
+
+
+// stages and accesses which must wait until the image is in this layout
+static void layoutDstUsage(Layout l, bool computeShaders, vk::PipelineStageFlags &stages, vk::AccessFlags &access) {
+	switch (l) {
+	case Layout::Undefined:
+		UNREACHABLE();
+		return;
+
+	case Layout::ShaderRead:
+		stages = vk::PipelineStageFlagBits::eFragmentShader;
+		access = vk::AccessFlagBits::eShaderRead;
+		if (computeShaders) {
+			stages |= vk::PipelineStageFlagBits::eComputeShader;
+		}
+		return;
+
+	case Layout::TransferSrc:
+		stages = vk::PipelineStageFlagBits::eTransfer;
+		access = vk::AccessFlagBits::eTransferRead;
+		return;
+
+	case Layout::TransferDst:
+		stages = vk::PipelineStageFlagBits::eTransfer;
+		access = vk::AccessFlagBits::eTransferWrite;
+		return;
+
+	case Layout::ColorAttachment:
+		stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		access = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+		return;
+
+	case Layout::General:
+		stages = vk::PipelineStageFlagBits::eComputeShader;
+		access = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		return;
+
+	case Layout::Present:
+		stages = vk::PipelineStageFlagBits::eBottomOfPipe;
+		access = vk::AccessFlags();
+		return;
+
+	}
+
+	UNREACHABLE();
+}
+
+
 void RendererImpl::layoutTransition(RenderTargetHandle image, Layout src, Layout dest) {
 	assert(image);
 	assert(dest != +Layout::Undefined);
@@ -3135,26 +7540,53 @@ void RendererImpl::layoutTransition(RenderTargetHandle image, Layout src, Layout
 	assert(src == +Layout::Undefined || rt.currentLayout == src);
 	rt.currentLayout = dest;
 
+	vk::PipelineStageFlags srcStages, dstStages;
 	vk::ImageMemoryBarrier b;
-	// TODO: should allow user to specify access flags
-	b.srcAccessMask               = vk::AccessFlagBits::eColorAttachmentWrite;
-	b.dstAccessMask               = vk::AccessFlagBits::eMemoryRead;
+	layoutSrcUsage(src,  features.computeShaders, srcStages, b.srcAccessMask);
+	layoutDstUsage(dest, features.computeShaders, dstStages, b.dstAccessMask);
 	b.oldLayout                   = vulkanLayout(src);
 	b.newLayout                   = vulkanLayout(dest);
 	b.image                       = rt.image;
 	b.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
 	b.subresourceRange.levelCount = 1;
-	b.subresourceRange.layerCount = 1;
+	b.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+	// recorded by flushBarriers so consecutive transitions share one barrier
+	pendingImageBarriers.push_back(b);
+	pendingSrcStages |= srcStages;
+	pendingDstStages |= dstStages;
+}
+
+
+void RendererImpl::flushBarriers() {
+	if (pendingImageBarriers.empty() && !pendingComputeBarrier) {
+		return;
+	}
 
-	// TODO: should allow user to specify stage masks
-	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { b });
+	ArenaVector<vk::MemoryBarrier> memoryBarriers(ArenaAllocator<vk::MemoryBarrier>(frames.at(currentFrameIdx).arena));
+	if (pendingComputeBarrier) {
+		vk::MemoryBarrier b;
+		b.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		b.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead;
+		memoryBarriers.push_back(b);
+	}
+
+	currentCommandBuffer.pipelineBarrier(pendingSrcStages, pendingDstStages, vk::DependencyFlags(), memoryBarriers, {}, pendingImageBarriers);
+
+	pendingImageBarriers.clear();
+	pendingSrcStages      = vk::PipelineStageFlags();
+	pendingDstStages      = vk::PipelineStageFlags();
+	pendingComputeBarrier = false;
 }
 
 
 void RendererImpl::bindPipeline(PipelineHandle pipeline) {
+	const auto &p = pipelines.get(pipeline);
+
 #ifndef NDEBUG
 	assert(inFrame);
-	assert(inRenderPass);
+	// compute pipelines are bound outside renderpasses
+	assert(inRenderPass == (p.bindPoint == vk::PipelineBindPoint::eGraphics));
 	assert(pipelineDrawn);
 	pipelineDrawn = false;
 	validPipeline = true;
@@ -3163,9 +7595,34 @@ void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 
 	// TODO: make sure current renderpass matches the one in pipeline
 
-	const auto &p = pipelines.get(pipeline);
-	currentCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, p.pipeline);
-	currentPipelineLayout = p.layout;
+	currentCommandBuffer.bindPipeline(p.bindPoint, p.pipeline);
+	currentPipelineLayout    = p.layout;
+	currentPipelineBindPoint = p.bindPoint;
+	currentPushConstantSize  = p.pushConstantSize;
+
+	if (p.bindPoint == vk::PipelineBindPoint::eCompute) {
+		return;
+	}
+
+	setPipelineDynamicState(currentCommandBuffer, p);
+#ifndef NDEBUG
+	scissorSet = !p.scissor;
+#endif  // NDEBUG
+}
+
+
+void RendererImpl::setPipelineDynamicState(vk::CommandBuffer cmdBuf, const Pipeline &p) const {
+	if (extendedDynamicState) {
+		const auto &d = p.dynamicState;
+		cmdBuf.setCullModeEXT(d.cullMode, dispatcher);
+		cmdBuf.setDepthTestEnableEXT(d.depthTest, dispatcher);
+		cmdBuf.setDepthWriteEnableEXT(d.depthWrite, dispatcher);
+		cmdBuf.setDepthCompareOpEXT(d.depthCompareOp, dispatcher);
+		cmdBuf.setStencilTestEnableEXT(d.stencilTest, dispatcher);
+		// dynamic state must be set before drawing even if stencil test is off
+		cmdBuf.setStencilOpEXT(vk::StencilFaceFlagBits::eFrontAndBack, vk::StencilOp::eKeep, d.stencilPassOp, vk::StencilOp::eKeep, d.stencilCompareOp, dispatcher);
+		cmdBuf.setStencilReference(vk::StencilFaceFlagBits::eFrontAndBack, d.stencilRef);
+	}
 
 	if (!p.scissor) {
 		// Vulkan always requires a scissor rect
@@ -3178,10 +7635,7 @@ void RendererImpl::bindPipeline(PipelineHandle pipeline) {
 		rect.extent.width  = static_cast<uint32_t>(currentViewport.width);
 		rect.extent.height = static_cast<uint32_t>(currentViewport.height);
 
-		currentCommandBuffer.setScissor(0, 1, &rect);
-#ifndef NDEBUG
-		scissorSet = true;
-#endif  // NDEBUG
+		cmdBuf.setScissor(0, 1, &rect);
 	}
 }
 
@@ -3190,16 +7644,9 @@ void RendererImpl::bindIndexBuffer(BufferHandle buffer, bool bit16) {
 	assert(inFrame);
 	assert(validPipeline);
 
-	auto &b = buffers.get(buffer);
-	b.lastUsedFrame = frameNum;
+	auto b = resolveBuffer(buffer);
 	assert(b.type == +BufferType::Index);
-	// "normal" buffers begin from beginning of buffer
-	vk::DeviceSize offset = 0;
-	if (b.ringBufferAlloc) {
-		// but ephemeral buffers use the ringbuffer and an offset
-		offset = b.offset;
-	}
-	currentCommandBuffer.bindIndexBuffer(b.buffer, offset, bit16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+	currentCommandBuffer.bindIndexBuffer(b.buffer, b.offset, bit16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
 }
 
 
@@ -3207,142 +7654,202 @@ void RendererImpl::bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
 	assert(inFrame);
 	assert(validPipeline);
 
-	auto &b = buffers.get(buffer);
-	b.lastUsedFrame = frameNum;
+	auto b = resolveBuffer(buffer);
 	assert(b.type == +BufferType::Vertex);
-	// "normal" buffers begin from beginning of buffer
-	vk::DeviceSize offset = 0;
-	if (b.ringBufferAlloc) {
-		// but ephemeral buffers use the ringbuffer and an offset
-		offset = b.offset;
-	}
+	vk::DeviceSize offset = b.offset;
 	currentCommandBuffer.bindVertexBuffers(binding, 1, &b.buffer, &offset);
 }
 
 
-void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layoutHandle, const void *data_) {
-	assert(inFrame);
-	assert(validPipeline);
+void RendererImpl::writeDescriptorSet(vk::DescriptorSet ds, const DescriptorSetLayout &layout, const DSCacheKey &key) {
+	// only dstSet and the info pointers differ between sets of a layout
+	std::array<vk::WriteDescriptorSet, MAX_DESCRIPTORS> writes = layout.writes;
+	unsigned int numWrites       = layout.numSlots();
+	unsigned int numBufferWrites = layout.numBufferSlots();
+	for (unsigned int i = 0; i < numBufferWrites; i++) {
+		writes[i].dstSet      = ds;
+		writes[i].pBufferInfo = &key.buffers[writes[i].dstBinding];
+	}
+	for (unsigned int i = numBufferWrites; i < numWrites; i++) {
+		writes[i].dstSet      = ds;
+		writes[i].pImageInfo  = &key.images[writes[i].dstBinding];
+	}
 
-	const DescriptorSetLayout &layout = dsLayouts.get(layoutHandle);
+	device.updateDescriptorSets(numWrites, &writes[0], 0, nullptr);
+}
 
-	vk::DescriptorSetAllocateInfo dsInfo;
-	dsInfo.descriptorPool      = frames.at(currentFrameIdx).dsPool;
-	dsInfo.descriptorSetCount  = 1;
-	dsInfo.pSetLayouts         = &layout.layout;
 
-	vk::DescriptorSet ds = device.allocateDescriptorSets(dsInfo)[0];
+unsigned int RendererImpl::fillDSCacheKey(const DescriptorSetLayout &layout, const char *data, DSCacheKey &key, std::array<uint32_t, MAX_DESCRIPTORS> &dynamicOffsets, std::vector<BufferHandle> *usedBuffers) {
+	auto resolve = [this, usedBuffers] (BufferHandle handle) {
+		return usedBuffers ? resolveBuffer(handle, *usedBuffers) : resolveBuffer(handle);
+	};
 
-	std::vector<vk::WriteDescriptorSet>   writes;
-	std::vector<vk::DescriptorBufferInfo> bufferWrites;
-	std::vector<vk::DescriptorImageInfo>  imageWrites;
+	key.layout = layout.layout;
+	key.count  = static_cast<unsigned int>(layout.descriptors.size());
+	assert(key.count <= MAX_DESCRIPTORS);
 
-	unsigned int numWrites = static_cast<unsigned int>(layout.descriptors.size());
-	writes.reserve(numWrites);
-	bufferWrites.reserve(numWrites);
-	imageWrites.reserve(numWrites);
+	unsigned int numDynamicOffsets = 0;
 
-	const char *data = reinterpret_cast<const char *>(data_);
-	unsigned int index = 0;
-	for (const auto &l : layout.descriptors) {
-		vk::WriteDescriptorSet write;
-		write.dstSet          = ds;
-		write.dstBinding      = index;
-		write.descriptorCount = 1;
-		// TODO: move to a helper function
-		write.descriptorType  = descriptorTypes[uint8_t(l.type) - 1];
-
-		switch (l.type) {
-		case DescriptorType::End:
-			// can't happen because createDesciptorSetLayout doesn't let it
-			UNREACHABLE();
-			break;
+	// Empty descriptors are skipped, their key entries stay default so they still compare equal
+	for (unsigned int i = layout.kindBegin(DescriptorKind::Buffer); i < layout.kindEnd(DescriptorKind::Buffer); i++) {
+		const auto &slot = layout.slots[i];
+		// this is part of the struct, we know it's correctly aligned and right type
+		auto buffer = resolve(*reinterpret_cast<const BufferHandle *>(data + slot.offset));
+		assert(buffer.size > 0);
+#ifndef NDEBUG
+		auto type = layout.descriptors[slot.binding].type;
+		assert((buffer.type == +BufferType::Uniform && type == +DescriptorType::UniformBuffer)
+		    || (buffer.type == +BufferType::Storage && type == +DescriptorType::StorageBuffer)
+		    || (buffer.type == +BufferType::Indirect && type == +DescriptorType::StorageBuffer));
+#endif  // NDEBUG
+
+		auto &bufWrite  = key.buffers[slot.binding];
+		bufWrite.buffer = buffer.buffer;
+		bufWrite.offset = buffer.offset;
+		bufWrite.range  = buffer.size;
+	}
+
+	// dynamic offsets are in binding order which is the same as ours
+	for (unsigned int i = layout.kindBegin(DescriptorKind::DynamicBuffer); i < layout.kindEnd(DescriptorKind::DynamicBuffer); i++) {
+		const auto &slot = layout.slots[i];
+		auto buffer = resolve(*reinterpret_cast<const BufferHandle *>(data + slot.offset));
+		assert(buffer.size > 0);
+#ifndef NDEBUG
+		auto type = layout.descriptors[slot.binding].type;
+		assert((buffer.type == +BufferType::Uniform && type == +DescriptorType::UniformBufferDynamic)
+		    || (buffer.type == +BufferType::Storage && type == +DescriptorType::StorageBufferDynamic));
+#endif  // NDEBUG
 
-		case DescriptorType::UniformBuffer:
-		case DescriptorType::StorageBuffer: {
-			// this is part of the struct, we know it's correctly aligned and right type
-			BufferHandle handle = *reinterpret_cast<const BufferHandle *>(data + l.offset);
-			Buffer &buffer = buffers.get(handle);
-			assert(buffer.size > 0);
-			buffer.lastUsedFrame = frameNum;
-			assert((buffer.type == +BufferType::Uniform && l.type == +DescriptorType::UniformBuffer)
-			    || (buffer.type == +BufferType::Storage && l.type == +DescriptorType::StorageBuffer));
+		// the set only refers to the whole buffer so it can be reused
+		// for every ring buffer allocation of the same size
+		auto &bufWrite  = key.buffers[slot.binding];
+		bufWrite.buffer = buffer.buffer;
+		bufWrite.offset = 0;
+		bufWrite.range  = buffer.size;
 
-			vk::DescriptorBufferInfo  bufWrite;
-			bufWrite.buffer = buffer.buffer;
-			bufWrite.offset = buffer.offset;
-			bufWrite.range  = buffer.size;
+		dynamicOffsets[numDynamicOffsets] = buffer.offset;
+		numDynamicOffsets++;
+	}
+
+	for (unsigned int i = layout.kindBegin(DescriptorKind::Sampler); i < layout.kindEnd(DescriptorKind::Sampler); i++) {
+		const auto &slot = layout.slots[i];
+		const auto &sampler = samplers.get(*reinterpret_cast<const SamplerHandle *>(data + slot.offset));
+		assert(sampler.sampler);
+
+		key.images[slot.binding].sampler = sampler.sampler;
+	}
 
-			// we trust that reserve() above makes sure this doesn't reallocate the storage
-			bufferWrites.push_back(bufWrite);
+	for (unsigned int i = layout.kindBegin(DescriptorKind::Texture); i < layout.kindEnd(DescriptorKind::Texture); i++) {
+		const auto &slot = layout.slots[i];
+		const auto &tex = textures.get(*reinterpret_cast<const TextureHandle *>(data + slot.offset));
+		assert(tex.image);
+		assert(tex.imageView);
 
-			write.pBufferInfo = &bufferWrites.back();
+		auto &imgWrite       = key.images[slot.binding];
+		imgWrite.imageView   = tex.imageView;
+		imgWrite.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	}
 
-			writes.push_back(write);
-		} break;
+	for (unsigned int i = layout.kindBegin(DescriptorKind::CombinedSampler); i < layout.kindEnd(DescriptorKind::CombinedSampler); i++) {
+		const auto &slot = layout.slots[i];
+		const CSampler &combined = *reinterpret_cast<const CSampler *>(data + slot.offset);
 
-		case DescriptorType::Sampler: {
-			const auto &sampler = samplers.get(*reinterpret_cast<const SamplerHandle *>(data + l.offset));
-			assert(sampler.sampler);
+		const Texture &tex = textures.get(combined.tex);
+		assert(tex.image);
+		assert(tex.imageView);
+		const Sampler &s   = samplers.get(combined.sampler);
+		assert(s.sampler);
 
-			vk::DescriptorImageInfo imgWrite;
-			imgWrite.sampler = sampler.sampler;
+		auto &imgWrite        = key.images[slot.binding];
+		imgWrite.sampler      = s.sampler;
+		imgWrite.imageView    = tex.imageView;
+		imgWrite.imageLayout  = vk::ImageLayout::eShaderReadOnlyOptimal;
+	}
 
-			// we trust that reserve() above makes sure this doesn't reallocate the storage
-			imageWrites.push_back(imgWrite);
+	for (unsigned int i = layout.kindBegin(DescriptorKind::StorageImage); i < layout.kindEnd(DescriptorKind::StorageImage); i++) {
+		const auto &slot = layout.slots[i];
+		const auto &tex = textures.get(*reinterpret_cast<const TextureHandle *>(data + slot.offset));
+		assert(tex.image);
+		assert(tex.imageView);
+		assert(tex.renderTarget);
 
-			write.pImageInfo = &imageWrites.back();
+		auto &imgWrite       = key.images[slot.binding];
+		imgWrite.imageView   = tex.imageView;
+		imgWrite.imageLayout = vk::ImageLayout::eGeneral;
+	}
 
-			writes.push_back(write);
-		} break;
+	return numDynamicOffsets;
+}
 
-		case DescriptorType::Texture: {
-			TextureHandle texHandle = *reinterpret_cast<const TextureHandle *>(data + l.offset);
-			const auto &tex = textures.get(texHandle);
-			assert(tex.image);
-			assert(tex.imageView);
 
-			vk::DescriptorImageInfo imgWrite;
-			imgWrite.imageView   = tex.imageView;
-			imgWrite.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+void RendererImpl::bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layoutHandle, const void *data) {
+	assert(inFrame);
+	assert(validPipeline);
 
-			// we trust that reserve() above makes sure this doesn't reallocate the storage
-			imageWrites.push_back(imgWrite);
+	const DescriptorSetLayout &layout = dsLayouts.get(layoutHandle);
 
-			write.pImageInfo = &imageWrites.back();
+	if (layout.textureTable) {
+		// never changes after creation, no need to go through the cache
+		currentCommandBuffer.bindDescriptorSets(currentPipelineBindPoint, currentPipelineLayout, dsIndex, 1, &textureTable, 0, nullptr);
+		return;
+	}
 
-			writes.push_back(write);
-		} break;
+	DSCacheKey key;
+	std::array<uint32_t, MAX_DESCRIPTORS> dynamicOffsets;
+	unsigned int numDynamicOffsets = fillDSCacheKey(layout, reinterpret_cast<const char *>(data), key, dynamicOffsets, nullptr);
 
-		case DescriptorType::CombinedSampler: {
-			const CSampler &combined = *reinterpret_cast<const CSampler *>(data + l.offset);
+	auto &frame = frames.at(currentFrameIdx);
+	vk::DescriptorSet ds;
+	auto it = recordingStatic ? frame.dsCache.end() : frame.dsCache.find(key);
+	if (it != frame.dsCache.end()) {
+		ds = it->second.ds;
+		if (it->second.lastUsed != frameNum) {
+			it->second.lastUsed = frameNum;
+			frame.dsSetsUsed++;
+		}
+	} else if (recordingStatic) {
+		// lives as long as the recorded commands
+		vk::DescriptorSetAllocateInfo dsInfo;
+		dsInfo.descriptorPool      = renderPasses.get(currentRenderPass).staticContents.dsPool;
+		dsInfo.descriptorSetCount  = 1;
+		dsInfo.pSetLayouts         = &layout.layout;
+
+		auto result = device.allocateDescriptorSets(&dsInfo, &ds);
+		if (result != vk::Result::eSuccess) {
+			LOG("Failed to allocate static render pass descriptor set: %s\n", vk::to_string(result).c_str());
+			throw std::runtime_error("Failed to allocate static render pass descriptor set");
+		}
 
-			const Texture &tex = textures.get(combined.tex);
-			assert(tex.image);
-			assert(tex.imageView);
-			const Sampler &s   = samplers.get(combined.sampler);
-			assert(s.sampler);
+		writeDescriptorSet(ds, layout, key);
+	} else {
+		ds = allocateDescriptorSet(frame, layout.layout);
 
-			vk::DescriptorImageInfo  imgWrite;
-			imgWrite.sampler      = s.sampler;
-			imgWrite.imageView    = tex.imageView;
-			imgWrite.imageLayout  = vk::ImageLayout::eShaderReadOnlyOptimal;
+		writeDescriptorSet(ds, layout, key);
+		frame.dsCache.emplace(std::move(key), CachedDescriptorSet{ ds, frameNum });
+		frame.dsSetsUsed++;
+	}
 
-			// we trust that reserve() above makes sure this doesn't reallocate the storage
-			imageWrites.push_back(imgWrite);
+	currentCommandBuffer.bindDescriptorSets(currentPipelineBindPoint, currentPipelineLayout, dsIndex, 1, &ds, numDynamicOffsets, &dynamicOffsets[0]);
+}
 
-			write.pImageInfo = &imageWrites.back();
 
-			writes.push_back(write);
-		} break;
+void RendererImpl::pushConstants(const void *data, unsigned int size) {
+	assert(inFrame);
+	assert(validPipeline);
+	assert(data != nullptr);
+	assert(size > 0);
+	assert(size == currentPushConstantSize);
 
-		}
+	currentCommandBuffer.pushConstants(currentPipelineLayout, vk::ShaderStageFlagBits::eAll, 0, size, data);
+}
 
-		index++;
-	}
 
-	device.updateDescriptorSets(writes, {});
-	currentCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, currentPipelineLayout, dsIndex, { ds }, {});
+// use VK_KHR_maintenance1 negative viewport to flip it
+// so we don't need flip in shader
+static vk::Viewport flipViewport(vk::Viewport v) {
+	v.y      += v.height;
+	v.height =  -v.height;
+	return v;
 }
 
 
@@ -3356,12 +7863,7 @@ void RendererImpl::setViewport(unsigned int x, unsigned int y, unsigned int widt
 	currentViewport.height   = static_cast<float>(height);
 	currentViewport.maxDepth = 1.0f;
 
-	// use VK_KHR_maintenance1 negative viewport to flip it
-	// so we don't need flip in shader
-	vk::Viewport realViewport =  currentViewport;
-	realViewport.y            += realViewport.height;
-	realViewport.height       =  -realViewport.height;
-
+	vk::Viewport realViewport = flipViewport(currentViewport);
 	currentCommandBuffer.setViewport(0, 1, &realViewport);
 }
 
@@ -3382,6 +7884,144 @@ void RendererImpl::setScissorRect(unsigned int x, unsigned int y, unsigned int w
 }
 
 
+void RendererImpl::updateBuffer(BufferHandle handle, uint32_t offset, uint32_t size, const void *data) {
+	assert(handle);
+	assert(!EphemeralBuffer::isEphemeral(handle));
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(size != 0);
+	assert(data != nullptr);
+	assert((offset % 4) == 0 && (size % 4) == 0);
+
+	auto &buffer = buffers.get(handle);
+	assert(buffer.buffer);
+	assert(buffer.usage != +BufferUsage::Static);
+	assert(offset + size <= buffer.size);
+
+	// lastUsedFrame == lastSyncedFrame is also true before anything has synced
+	// so treat it as still in flight
+	bool inFlight = buffer.used && buffer.lastUsedFrame >= lastSyncedFrame;
+	if (!inFlight) {
+		VmaAllocationInfo allocationInfo = {};
+		vmaGetAllocationInfo(allocator, buffer.memory, &allocationInfo);
+		if (allocationInfo.pMappedData) {
+			// nothing reads it anymore and later submits see host writes
+			memcpy(reinterpret_cast<char *>(allocationInfo.pMappedData) + offset, data, size);
+			vmaFlushAllocation(allocator, buffer.memory, offset, size);
+			return;
+		}
+	}
+
+	// copy from the ring buffer within the frame's command buffer
+	// barriers order it after earlier reads and before later ones
+	assert(!asyncComputeActive);
+	flushBarriers();
+
+	unsigned int pageIdx  = 0;
+	unsigned int beginPtr = ringBufferAllocate(size, 4, pageIdx);
+	const auto &page = ringPages[pageIdx];
+	streamingCopy(page.mapping + beginPtr, data, size);
+
+	vk::PipelineStageFlags readStages = bufferTypeStages(buffer.type);
+
+	vk::BufferMemoryBarrier barrier;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = buffer.buffer;
+	barrier.offset              = buffer.offset + offset;
+	barrier.size                = size;
+
+	// after earlier reads and earlier updates of the same buffer
+	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	currentCommandBuffer.pipelineBarrier(readStages | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, { barrier }, {});
+
+	vk::BufferCopy copyRegion;
+	copyRegion.srcOffset = beginPtr;
+	copyRegion.dstOffset = buffer.offset + offset;
+	copyRegion.size      = size;
+	currentCommandBuffer.copyBuffer(page.buffer, buffer.buffer, 1, &copyRegion);
+
+	barrier.dstAccessMask       = vk::AccessFlagBits::eMemoryRead;
+	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, readStages, vk::DependencyFlags(), {}, { barrier }, {});
+
+	// the copy counts as a use so a direct write can't overtake it
+	buffer.lastUsedFrame = frameNum;
+	buffer.used          = true;
+}
+
+
+void RendererImpl::updateTexture(TextureHandle handle, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data) {
+	assert(handle);
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(width > 0 && height > 0);
+	assert(data != nullptr);
+
+	const auto &tex = textures.get(handle);
+	assert(tex.image);
+	assert(!tex.renderTarget);
+	assert(level < tex.numMips);
+	assert(x + width  <= std::max(tex.width  >> level, 1U));
+	assert(y + height <= std::max(tex.height >> level, 1U));
+	assert(size == formatDataSize(tex.format, width, height));
+
+	// same as updateBuffer, the frame's command buffer copies from the ring buffer
+	assert(!asyncComputeActive);
+	flushBarriers();
+
+	// offset must be a multiple of 4 and of the texel or block size
+	// RGB8 makes that 12 which ringBufferAllocate can't align to, round up inside a larger allocation
+	const uint32_t texelSize = formatSize(tex.format);
+	uint32_t align = texelSize;
+	while (align % 4 != 0) {
+		align += texelSize;
+	}
+	unsigned int pageIdx  = 0;
+	unsigned int beginPtr = ringBufferAllocate(size + align - 4, 4, pageIdx);
+	beginPtr = (beginPtr + align - 1) / align * align;
+	const auto &page = ringPages[pageIdx];
+	streamingCopy(page.mapping + beginPtr, data, size);
+
+	// textures can be sampled from any stage
+	const vk::PipelineStageFlags readStages = vk::PipelineStageFlagBits::eVertexShader
+	                                        | vk::PipelineStageFlagBits::eFragmentShader
+	                                        | vk::PipelineStageFlagBits::eComputeShader;
+
+	// only this level leaves ShaderReadOnly, the others can still be sampled
+	vk::ImageMemoryBarrier barrier;
+	barrier.srcAccessMask       = vk::AccessFlags();
+	barrier.dstAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	barrier.oldLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
+	barrier.newLayout           = vk::ImageLayout::eTransferDstOptimal;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image               = tex.image;
+	barrier.subresourceRange.aspectMask     = vk::ImageAspectFlagBits::eColor;
+	barrier.subresourceRange.baseMipLevel   = level;
+	barrier.subresourceRange.levelCount     = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount     = 1;
+	currentCommandBuffer.pipelineBarrier(readStages | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), {}, {}, { barrier });
+
+	vk::BufferImageCopy region;
+	region.bufferOffset                    = beginPtr;
+	// leave row length and image height 0 for tight packing
+	region.imageSubresource.aspectMask     = vk::ImageAspectFlagBits::eColor;
+	region.imageSubresource.mipLevel       = level;
+	region.imageSubresource.layerCount     = 1;
+	region.imageOffset                     = vk::Offset3D(static_cast<int32_t>(x), static_cast<int32_t>(y), 0);
+	region.imageExtent                     = vk::Extent3D(width, height, 1);
+	currentCommandBuffer.copyBufferToImage(page.buffer, tex.image, vk::ImageLayout::eTransferDstOptimal, { region });
+
+	barrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask       = vk::AccessFlagBits::eShaderRead;
+	barrier.oldLayout           = vk::ImageLayout::eTransferDstOptimal;
+	barrier.newLayout           = vk::ImageLayout::eShaderReadOnlyOptimal;
+	currentCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, readStages, vk::DependencyFlags(), {}, {}, { barrier });
+}
+
+
 void RendererImpl::blit(RenderTargetHandle source, RenderTargetHandle target) {
 	assert(source);
 	assert(target);
@@ -3402,21 +8042,23 @@ void RendererImpl::blit(RenderTargetHandle source, RenderTargetHandle target) {
 
 	assert(srcRT.width       == destRT.width);
 	assert(srcRT.height      == destRT.height);
+	assert(srcRT.layers      == destRT.layers);
 
 	// TODO: check they're both color targets
 	// or implement depth blit
 
 	vk::ImageBlit b;
 	b.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	b.srcSubresource.layerCount = 1;
+	b.srcSubresource.layerCount = srcRT.layers;
 	b.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	b.dstSubresource.layerCount = 1;
+	b.dstSubresource.layerCount = destRT.layers;
 	b.srcOffsets[1u].x          = srcRT.width;
 	b.srcOffsets[1u].y          = srcRT.height;
 	b.srcOffsets[1u].z          = 1;
 	b.dstOffsets[1u].x          = srcRT.width;
 	b.dstOffsets[1u].y          = srcRT.height;
 	b.dstOffsets[1u].z          = 1;
+	flushBarriers();
 	currentCommandBuffer.blitImage(srcRT.image, vk::ImageLayout::eTransferSrcOptimal, destRT.image, vk::ImageLayout::eTransferDstOptimal, { b }, vk::Filter::eNearest );
 }
 
@@ -3442,15 +8084,17 @@ void RendererImpl::resolveMSAA(RenderTargetHandle source, RenderTargetHandle tar
 
 	assert(srcRT.width       == destRT.width);
 	assert(srcRT.height      == destRT.height);
+	assert(srcRT.layers      == destRT.layers);
 
 	vk::ImageResolve r;
 	r.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	r.srcSubresource.layerCount = 1;
+	r.srcSubresource.layerCount = srcRT.layers;
 	r.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	r.dstSubresource.layerCount = 1;
+	r.dstSubresource.layerCount = destRT.layers;
 	r.extent.width              = srcRT.width;
 	r.extent.height             = srcRT.height;
 	r.extent.depth              = 1;
+	flushBarriers();
 	currentCommandBuffer.resolveImage(srcRT.image, vk::ImageLayout::eTransferSrcOptimal, destRT.image, vk::ImageLayout::eTransferDstOptimal, { r } );
 }
 
@@ -3467,6 +8111,19 @@ void RendererImpl::draw(unsigned int firstVertex, unsigned int vertexCount) {
 }
 
 
+void RendererImpl::drawInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	assert(instanceCount > 0);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	currentCommandBuffer.draw(vertexCount, instanceCount, 0, 0);
+}
+
+
 void RendererImpl::drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
 #ifndef NDEBUG
 	assert(inRenderPass);
@@ -3492,6 +8149,476 @@ void RendererImpl::drawIndexedOffset(unsigned int vertexCount, unsigned int firs
 }
 
 
+void RendererImpl::drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int /* minIndex */, unsigned int /* maxIndex */) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(vertexCount > 0);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	currentCommandBuffer.drawIndexed(vertexCount, 1, firstIndex, static_cast<int32_t>(vertexOffset), 0);
+}
+
+
+void RendererImpl::drawIndirect(BufferHandle buffer, unsigned int drawCount) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(drawCount > 0);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	auto b = resolveBuffer(buffer);
+	assert(b.type == +BufferType::Indirect);
+	assert(b.size >= drawCount * sizeof(DrawIndirectArgs));
+	vk::DeviceSize offset = b.offset;
+
+	if (features.multiDrawIndirect) {
+		assert(drawCount <= deviceProperties.limits.maxDrawIndirectCount);
+		currentCommandBuffer.drawIndirect(b.buffer, offset, drawCount, sizeof(DrawIndirectArgs));
+	} else {
+		for (unsigned int i = 0; i < drawCount; i++) {
+			currentCommandBuffer.drawIndirect(b.buffer, offset + i * sizeof(DrawIndirectArgs), 1, sizeof(DrawIndirectArgs));
+		}
+	}
+}
+
+
+void RendererImpl::drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount) {
+#ifndef NDEBUG
+	assert(inRenderPass);
+	assert(validPipeline);
+	assert(drawCount > 0);
+	pipelineDrawn = true;
+#endif //  NDEBUG
+
+	auto b = resolveBuffer(buffer);
+	assert(b.type == +BufferType::Indirect);
+	assert(b.size >= drawCount * sizeof(DrawIndexedIndirectArgs));
+	vk::DeviceSize offset = b.offset;
+
+	if (features.multiDrawIndirect) {
+		assert(drawCount <= deviceProperties.limits.maxDrawIndirectCount);
+		currentCommandBuffer.drawIndexedIndirect(b.buffer, offset, drawCount, sizeof(DrawIndexedIndirectArgs));
+	} else {
+		for (unsigned int i = 0; i < drawCount; i++) {
+			currentCommandBuffer.drawIndexedIndirect(b.buffer, offset + i * sizeof(DrawIndexedIndirectArgs), 1, sizeof(DrawIndexedIndirectArgs));
+		}
+	}
+}
+
+
+// the recording functions above for one draw list chunk on a job system thread
+// commands go to the chunk's own command buffer and descriptor sets to the thread's pools
+// RendererImpl's recording state is only read, it doesn't change while chunks are recorded
+class DrawListRecorder {
+	RendererImpl        &r;
+	RecordFrame         &rf;
+	vk::CommandBuffer   cmdBuf;
+	vk::PipelineLayout  pipelineLayout;
+	uint32_t            pushConstantSize;
+
+
+	vk::DescriptorSet allocateDescriptorSet(vk::DescriptorSetLayout layout) {
+		assert(!rf.dsPools.empty());
+
+		vk::DescriptorSetAllocateInfo dsInfo;
+		dsInfo.descriptorSetCount  = 1;
+		dsInfo.pSetLayouts         = &layout;
+
+		bool newPool = false;
+		while (true) {
+			assert(rf.dsPoolIdx < rf.dsPools.size());
+			dsInfo.descriptorPool = rf.dsPools[rf.dsPoolIdx];
+
+			vk::DescriptorSet ds;
+			auto result = r.device.allocateDescriptorSets(&dsInfo, &ds);
+			if (result == vk::Result::eSuccess) {
+				return ds;
+			}
+
+			// an empty pool should always have room for one set
+			if (newPool || (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)) {
+				LOG("Failed to allocate draw list descriptor set: %s\n", vk::to_string(result).c_str());
+				throw std::runtime_error("Failed to allocate draw list descriptor set");
+			}
+
+			rf.dsPoolIdx++;
+			if (rf.dsPoolIdx == rf.dsPools.size()) {
+				rf.dsPools.push_back(r.createDescriptorPool(recordDescriptorSets));
+				newPool = true;
+			}
+		}
+	}
+
+
+public:
+
+	DrawListRecorder(RendererImpl &r_, RecordFrame &rf_, vk::CommandBuffer cmdBuf_)
+	: r(r_)
+	, rf(rf_)
+	, cmdBuf(cmdBuf_)
+	, pushConstantSize(0)
+	{
+	}
+
+	DrawListRecorder(const DrawListRecorder &)            = delete;
+	DrawListRecorder(DrawListRecorder &&)                 = delete;
+
+	DrawListRecorder &operator=(const DrawListRecorder &) = delete;
+	DrawListRecorder &operator=(DrawListRecorder &&)      = delete;
+
+	~DrawListRecorder() {}
+
+	void bindPipeline(PipelineHandle pipeline) {
+		const auto &p = r.pipelines.get(pipeline);
+		assert(p.bindPoint == vk::PipelineBindPoint::eGraphics);
+
+		cmdBuf.bindPipeline(p.bindPoint, p.pipeline);
+		pipelineLayout   = p.layout;
+		pushConstantSize = p.pushConstantSize;
+
+		r.setPipelineDynamicState(cmdBuf, p);
+	}
+
+	void bindIndexBuffer(BufferHandle buffer, bool bit16) {
+		assert(pipelineLayout);
+
+		auto b = r.resolveBuffer(buffer, rf.usedBuffers);
+		assert(b.type == +BufferType::Index);
+		cmdBuf.bindIndexBuffer(b.buffer, b.offset, bit16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+	}
+
+	void bindVertexBuffer(unsigned int binding, BufferHandle buffer) {
+		assert(pipelineLayout);
+
+		auto b = r.resolveBuffer(buffer, rf.usedBuffers);
+		assert(b.type == +BufferType::Vertex);
+		vk::DeviceSize offset = b.offset;
+		cmdBuf.bindVertexBuffers(binding, 1, &b.buffer, &offset);
+	}
+
+	void bindDescriptorSet(unsigned int dsIndex, DSLayoutHandle layoutHandle, const void *data) {
+		assert(pipelineLayout);
+
+		const DescriptorSetLayout &layout = r.dsLayouts.get(layoutHandle);
+
+		if (layout.textureTable) {
+			cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, dsIndex, 1, &r.textureTable, 0, nullptr);
+			return;
+		}
+
+		DSCacheKey key;
+		std::array<uint32_t, MAX_DESCRIPTORS> dynamicOffsets;
+		unsigned int numDynamicOffsets = r.fillDSCacheKey(layout, reinterpret_cast<const char *>(data), key, dynamicOffsets, &rf.usedBuffers);
+
+		vk::DescriptorSet ds;
+		auto it = rf.dsCache.find(key);
+		if (it != rf.dsCache.end()) {
+			ds = it->second;
+		} else {
+			ds = allocateDescriptorSet(layout.layout);
+
+			r.writeDescriptorSet(ds, layout, key);
+			rf.dsCache.emplace(std::move(key), ds);
+		}
+
+		cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, dsIndex, 1, &ds, numDynamicOffsets, &dynamicOffsets[0]);
+	}
+
+	void pushConstants(const void *data, unsigned int size) {
+		assert(pipelineLayout);
+		assert(size == pushConstantSize);
+
+		cmdBuf.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eAll, 0, size, data);
+	}
+
+	void draw(unsigned int firstVertex, unsigned int vertexCount) {
+		assert(vertexCount > 0);
+		cmdBuf.draw(vertexCount, 1, firstVertex, 0);
+	}
+
+	void drawInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+		assert(vertexCount > 0);
+		assert(instanceCount > 0);
+		cmdBuf.draw(vertexCount, instanceCount, 0, 0);
+	}
+
+	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount) {
+		assert(vertexCount > 0);
+		assert(instanceCount > 0);
+		cmdBuf.drawIndexed(vertexCount, instanceCount, 0, 0, 0);
+	}
+
+	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int /* minIndex */, unsigned int /* maxIndex */) {
+		assert(vertexCount > 0);
+		cmdBuf.drawIndexed(vertexCount, 1, firstIndex, 0, 0);
+	}
+
+	void drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int /* minIndex */, unsigned int /* maxIndex */) {
+		assert(vertexCount > 0);
+		cmdBuf.drawIndexed(vertexCount, 1, firstIndex, static_cast<int32_t>(vertexOffset), 0);
+	}
+
+	void drawIndirect(BufferHandle buffer, unsigned int drawCount) {
+		assert(drawCount > 0);
+
+		auto b = r.resolveBuffer(buffer, rf.usedBuffers);
+		assert(b.type == +BufferType::Indirect);
+		assert(b.size >= drawCount * sizeof(DrawIndirectArgs));
+		vk::DeviceSize offset = b.offset;
+
+		if (r.features.multiDrawIndirect) {
+			cmdBuf.drawIndirect(b.buffer, offset, drawCount, sizeof(DrawIndirectArgs));
+		} else {
+			for (unsigned int i = 0; i < drawCount; i++) {
+				cmdBuf.drawIndirect(b.buffer, offset + i * sizeof(DrawIndirectArgs), 1, sizeof(DrawIndirectArgs));
+			}
+		}
+	}
+
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount) {
+		assert(drawCount > 0);
+
+		auto b = r.resolveBuffer(buffer, rf.usedBuffers);
+		assert(b.type == +BufferType::Indirect);
+		assert(b.size >= drawCount * sizeof(DrawIndexedIndirectArgs));
+		vk::DeviceSize offset = b.offset;
+
+		if (r.features.multiDrawIndirect) {
+			cmdBuf.drawIndexedIndirect(b.buffer, offset, drawCount, sizeof(DrawIndexedIndirectArgs));
+		} else {
+			for (unsigned int i = 0; i < drawCount; i++) {
+				cmdBuf.drawIndexedIndirect(b.buffer, offset + i * sizeof(DrawIndexedIndirectArgs), 1, sizeof(DrawIndexedIndirectArgs));
+			}
+		}
+	}
+};
+
+
+RecordFrame &RendererImpl::recordFrame() {
+	std::lock_guard<std::mutex> contextsLock(recordContextsMutex);
+
+	const auto id = std::this_thread::get_id();
+	auto it = std::find_if(recordContexts.begin(), recordContexts.end(), [id] (const auto &c) { return c.first == id; });
+	if (it == recordContexts.end()) {
+		recordContexts.emplace_back(id, std::make_unique<RecordContext>());
+		it = recordContexts.end() - 1;
+	}
+
+	auto &ctx = *it->second;
+	if (ctx.frames.size() < frames.size()) {
+		ctx.frames.resize(frames.size());
+	}
+
+	auto &rf = ctx.frames.at(currentFrameIdx);
+	if (!rf.cmdPool) {
+		vk::CommandPoolCreateInfo cp;
+		cp.queueFamilyIndex = graphicsQueueIndex;
+		rf.cmdPool          = device.createCommandPool(cp);
+
+		rf.dsPools.push_back(createDescriptorPool(recordDescriptorSets));
+	}
+
+	return rf;
+}
+
+
+void RendererImpl::resetRecordFrame(RecordFrame &rf) {
+	if (!rf.cmdPool) {
+		return;
+	}
+
+	device.resetCommandPool(rf.cmdPool, vk::CommandPoolResetFlags());
+	rf.usedCmdBufs = 0;
+
+	for (auto pool : rf.dsPools) {
+		device.resetDescriptorPool(pool);
+	}
+	rf.dsPoolIdx = 0;
+	rf.dsCache.clear();
+	assert(rf.usedBuffers.empty());
+}
+
+
+void RendererImpl::destroyRecordFrame(RecordFrame &rf) {
+	if (!rf.cmdPool) {
+		return;
+	}
+
+	// also frees the command buffers
+	device.destroyCommandPool(rf.cmdPool);
+	rf.cmdPool = vk::CommandPool();
+	rf.cmdBufs.clear();
+	rf.usedCmdBufs = 0;
+
+	for (auto pool : rf.dsPools) {
+		device.destroyDescriptorPool(pool);
+	}
+	rf.dsPools.clear();
+	rf.dsPoolIdx = 0;
+	rf.dsCache.clear();
+}
+
+
+vk::CommandBuffer RendererImpl::recordDrawListChunk(const DrawList &list, unsigned int begin, unsigned int end) {
+	auto &rf = recordFrame();
+	if (rf.usedCmdBufs == rf.cmdBufs.size()) {
+		vk::CommandBufferAllocateInfo allocInfo(rf.cmdPool, vk::CommandBufferLevel::eSecondary, 1);
+		auto bufs = device.allocateCommandBuffers(allocInfo);
+		assert(bufs.size() == 1);
+		rf.cmdBufs.push_back(bufs.at(0));
+	}
+	auto cmdBuf = rf.cmdBufs.at(rf.usedCmdBufs);
+	rf.usedCmdBufs++;
+
+	beginSecondaryCmdBuf(cmdBuf, vk::CommandBufferUsageFlagBits::eOneTimeSubmit, renderPasses.get(currentRenderPass), &framebuffers.get(currentFramebuffer));
+
+	// dynamic state isn't inherited from the primary
+	vk::Viewport viewport = flipViewport(currentViewport);
+	cmdBuf.setViewport(0, 1, &viewport);
+
+	DrawListRecorder recorder(*this, rf, cmdBuf);
+	list.replay(recorder, begin, end);
+
+	cmdBuf.end();
+
+	return cmdBuf;
+}
+
+
+bool RendererImpl::executeDrawList(const DrawList &list) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(inRenderPass);
+#endif  // NDEBUG
+
+	// static contents are one secondary command buffer which can't execute others
+	if (!features.parallelRecording || recordingStatic) {
+		return false;
+	}
+	assert(primaryCommandBuffer);
+	assert(currentViewport.width > 0.0f);
+
+	unsigned int size      = list.size();
+	unsigned int numChunks = std::min((size + drawListChunkSize - 1) / drawListChunkSize, jobSystem->numThreads() + 1);
+	if (numChunks < 2) {
+		return false;
+	}
+	unsigned int chunkSize = (size + numChunks - 1) / numChunks;
+
+	drawListCmdBufs.assign(numChunks, vk::CommandBuffer());
+	// jobs must not throw, the first exception is rethrown here instead
+	std::mutex          errorMutex;
+	std::exception_ptr  error;
+	jobSystem->parallelFor(numChunks, 1, [&] (unsigned int first, unsigned int last) {
+		for (unsigned int c = first; c < last; c++) {
+			try {
+				unsigned int begin = std::min(size, c * chunkSize);
+				unsigned int end   = std::min(size, begin + chunkSize);
+				drawListCmdBufs[c] = recordDrawListChunk(list, begin, end);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+	});
+
+	// the chunks couldn't write to the buffers
+	{
+		std::lock_guard<std::mutex> contextsLock(recordContextsMutex);
+		for (auto &c : recordContexts) {
+			if (currentFrameIdx < c.second->frames.size()) {
+				auto &usedBuffers = c.second->frames[currentFrameIdx].usedBuffers;
+				for (auto handle : usedBuffers) {
+					auto &b = buffers.get(handle);
+					b.lastUsedFrame = frameNum;
+					b.used          = true;
+				}
+				usedBuffers.clear();
+			}
+		}
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	// commands before the list stay in the pass's current secondary
+	// and the ones after it go in a new one so submission order is kept
+	currentCommandBuffer.end();
+	primaryCommandBuffer.executeCommands(1, &currentCommandBuffer);
+	primaryCommandBuffer.executeCommands(numChunks, &drawListCmdBufs[0]);
+
+	currentCommandBuffer = primaryCommandBuffer;
+	primaryCommandBuffer = vk::CommandBuffer();
+	auto cmdBuf = nextSecondaryCmdBuf(frames.at(currentFrameIdx));
+	beginSecondary(cmdBuf, vk::CommandBufferUsageFlagBits::eOneTimeSubmit, renderPasses.get(currentRenderPass), &framebuffers.get(currentFramebuffer));
+
+	vk::Viewport viewport = flipViewport(currentViewport);
+	currentCommandBuffer.setViewport(0, 1, &viewport);
+
+	// state bound in a secondary command buffer doesn't carry over
+	currentPipelineLayout = vk::PipelineLayout();
+#ifndef NDEBUG
+	validPipeline = false;
+	pipelineDrawn = true;
+	scissorSet    = false;
+#endif  // NDEBUG
+
+	return true;
+}
+
+
+void RendererImpl::dispatch(unsigned int x, unsigned int y, unsigned int z) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(validPipeline);
+	assert(x > 0);
+	assert(y > 0);
+	assert(z > 0);
+	pipelineDrawn = true;
+#endif  // NDEBUG
+	assert(currentPipelineBindPoint == vk::PipelineBindPoint::eCompute);
+
+	flushBarriers();
+	currentCommandBuffer.dispatch(x, y, z);
+}
+
+
+void RendererImpl::dispatchIndirect(BufferHandle buffer) {
+#ifndef NDEBUG
+	assert(inFrame);
+	assert(!inRenderPass);
+	assert(validPipeline);
+	pipelineDrawn = true;
+#endif  // NDEBUG
+	assert(currentPipelineBindPoint == vk::PipelineBindPoint::eCompute);
+
+	auto b = resolveBuffer(buffer);
+	assert(b.type == +BufferType::Indirect);
+	flushBarriers();
+	currentCommandBuffer.dispatchIndirect(b.buffer, b.offset);
+}
+
+
+void RendererImpl::computeBarrier() {
+	assert(inFrame);
+	assert(!inRenderPass);
+
+	// memory barrier itself is recorded by flushBarriers
+	// eDrawIndirect and eVertexShader in source so indirect arguments
+	// and vertex shader inputs can be overwritten after use
+	pendingComputeBarrier  = true;
+	pendingSrcStages      |= vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader;
+	pendingDstStages      |= vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+}
+
+
 } // namespace renderer
 
 
@@ -93,45 +93,58 @@ namespace std {
 namespace renderer {
 
 
+static const uint32_t noBufferArena = 0xFFFFFFFFU;
+
+
 struct Buffer {
-	bool           ringBufferAlloc;
 	uint32_t       size;
 	uint32_t       offset;
 	vk::Buffer     buffer;
+	// null if suballocated from a BufferArena
 	VmaAllocation  memory;
+	uint32_t       arena;
 	uint32_t       lastUsedFrame;
+	// lastUsedFrame is only meaningful after a frame has used it
+	bool           used;
 	BufferType     type;
+	BufferUsage    usage;
 
 
 	Buffer() noexcept
-	: ringBufferAlloc(false)
-	, size(0)
+	: size(0)
 	, offset(0)
 	, memory(nullptr)
+	, arena(noBufferArena)
 	, lastUsedFrame(0)
+	, used(false)
 	, type(BufferType::Invalid)
+	, usage(BufferUsage::Static)
 	{}
 
 	Buffer(const Buffer &)            = delete;
 	Buffer &operator=(const Buffer &) = delete;
 
 	Buffer(Buffer &&other) noexcept
-	: ringBufferAlloc(other.ringBufferAlloc)
-	, size(other.size)
+	: size(other.size)
 	, offset(other.offset)
 	, buffer(other.buffer)
 	, memory(other.memory)
+	, arena(other.arena)
 	, lastUsedFrame(other.lastUsedFrame)
+	, used(other.used)
 	, type(other.type)
+	, usage(other.usage)
 	{
 
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = vk::Buffer();
 		other.memory          = 0;
+		other.arena           = noBufferArena;
 		other.lastUsedFrame   = 0;
+		other.used            = false;
 		other.type            = BufferType::Invalid;
+		other.usage           = BufferUsage::Static;
 	}
 
 	Buffer &operator=(Buffer &&other) noexcept {
@@ -142,28 +155,31 @@ struct Buffer {
 		assert(!buffer);
 		assert(!memory);
 
-		ringBufferAlloc       = other.ringBufferAlloc;
 		size                  = other.size;
 		offset                = other.offset;
 		buffer                = other.buffer;
 		memory                = other.memory;
+		arena                 = other.arena;
 		lastUsedFrame         = other.lastUsedFrame;
+		used                  = other.used;
 		type                  = other.type;
+		usage                 = other.usage;
 
-		other.ringBufferAlloc = false;
 		other.size            = 0;
 		other.offset          = 0;
 		other.buffer          = vk::Buffer();
 		other.memory          = 0;
+		other.arena           = noBufferArena;
 		other.lastUsedFrame   = 0;
+		other.used            = false;
 		other.type            = BufferType::Invalid;
+		other.usage           = BufferUsage::Static;
 		assert(type == +BufferType::Invalid);
 
 		return *this;
 	}
 
 	~Buffer() {
-		assert(!ringBufferAlloc);
 		assert(size   == 0);
 		assert(offset == 0);
 		assert(!buffer);
@@ -180,12 +196,80 @@ struct Buffer {
 };
 
 
+// what a BufferHandle refers to, either a Buffer or an ephemeral ring buffer range
+struct ResolvedBuffer {
+	vk::Buffer     buffer;
+	uint32_t       offset;
+	uint32_t       size;
+	BufferType     type;
+
+
+	ResolvedBuffer(vk::Buffer buffer_, uint32_t offset_, uint32_t size_, BufferType type_)
+	: buffer(buffer_)
+	, offset(offset_)
+	, size(size_)
+	, type(type_)
+	{
+	}
+};
+
+
+// how bindDescriptorSet gets the Vulkan objects of a descriptor
+// buffer kinds come first so their writes are at the start of DescriptorSetLayout::writes
+enum class DescriptorKind : uint8_t {
+	  Buffer
+	, DynamicBuffer
+	, Sampler
+	, Texture
+	, CombinedSampler
+	, StorageImage
+	, Count
+};
+
+
+struct DescriptorSlot {
+	uint32_t  binding;
+	// of the handle in the descriptor set struct
+	uint32_t  offset;
+};
+
+
 struct DescriptorSetLayout {
 	std::vector<DescriptorLayout>  descriptors;
 	vk::DescriptorSetLayout        layout;
+	// layout is the renderer's textureTableLayout, not owned
+	bool                           textureTable;
+
+	// built once by createDescriptorSetLayout so binding needs no switch per descriptor
+	// descriptors except Empty grouped by kind, in binding order within a kind
+	std::array<DescriptorSlot, MAX_DESCRIPTORS>                         slots;
+	std::array<uint8_t, static_cast<size_t>(DescriptorKind::Count) + 1>  kindStart;
+	// one per slot, everything but dstSet and the info pointer filled in
+	std::array<vk::WriteDescriptorSet, MAX_DESCRIPTORS>                 writes;
+
+
+	DescriptorSetLayout() noexcept
+	: textureTable(false)
+	{
+		kindStart.fill(0);
+	}
+
+	unsigned int kindBegin(DescriptorKind k) const {
+		return kindStart[static_cast<size_t>(k)];
+	}
+
+	unsigned int kindEnd(DescriptorKind k) const {
+		return kindStart[static_cast<size_t>(k) + 1];
+	}
 
+	unsigned int numSlots() const {
+		return kindStart[static_cast<size_t>(DescriptorKind::Count)];
+	}
 
-	DescriptorSetLayout() noexcept {}
+	// the rest are images
+	unsigned int numBufferSlots() const {
+		return kindEnd(DescriptorKind::DynamicBuffer);
+	}
 
 	DescriptorSetLayout(const DescriptorSetLayout &)            = delete;
 	DescriptorSetLayout &operator=(const DescriptorSetLayout &) = delete;
@@ -193,8 +277,14 @@ struct DescriptorSetLayout {
 	DescriptorSetLayout(DescriptorSetLayout &&other) noexcept
 	: descriptors(std::move(other.descriptors))
 	, layout(other.layout)
+	, textureTable(other.textureTable)
+	, slots(other.slots)
+	, kindStart(other.kindStart)
+	, writes(other.writes)
 	{
-		other.layout = vk::DescriptorSetLayout();
+		other.layout       = vk::DescriptorSetLayout();
+		other.textureTable = false;
+		other.kindStart.fill(0);
 		assert(descriptors.empty());
 	}
 
@@ -208,8 +298,16 @@ struct DescriptorSetLayout {
 		descriptors  = std::move(other.descriptors);
 		assert(descriptors.empty());
 
-		layout       = other.layout;
-		other.layout = vk::DescriptorSetLayout();
+		layout             = other.layout;
+		other.layout       = vk::DescriptorSetLayout();
+
+		textureTable       = other.textureTable;
+		other.textureTable = false;
+
+		slots              = other.slots;
+		kindStart          = other.kindStart;
+		other.kindStart.fill(0);
+		writes             = other.writes;
 
 		return *this;
 	}
@@ -222,17 +320,24 @@ struct DescriptorSetLayout {
 
 struct FragmentShader {
 	vk::ShaderModule shaderModule;
+	// same as VertexShader::spirvHash
+	uint64_t         spirvHash;
 
 
-	FragmentShader() noexcept {}
+	FragmentShader() noexcept
+	: spirvHash(0)
+	{
+	}
 
 	FragmentShader(const FragmentShader &)            = delete;
 	FragmentShader &operator=(const FragmentShader &) = delete;
 
 	FragmentShader(FragmentShader &&other) noexcept
 	: shaderModule(other.shaderModule)
+	, spirvHash(other.spirvHash)
 	{
 		other.shaderModule = vk::ShaderModule();
+		other.spirvHash    = 0;
 	}
 
 	FragmentShader &operator=(FragmentShader &&other) noexcept {
@@ -242,7 +347,9 @@ struct FragmentShader {
 
 		assert(!shaderModule);
 		shaderModule       = other.shaderModule;
+		spirvHash          = other.spirvHash;
 		other.shaderModule = vk::ShaderModule();
+		other.spirvHash    = 0;
 
 		return *this;
 	}
@@ -255,6 +362,7 @@ struct FragmentShader {
 
 struct Framebuffer {
 	unsigned int     width, height;
+	// null with dynamic rendering, beginRenderPass uses the rendertargets in desc
 	vk::Framebuffer  framebuffer;
 	FramebufferDesc  desc;
 	// TODO: store info about attachments to allow tracking layout
@@ -313,14 +421,63 @@ struct Framebuffer {
 };
 
 
+// fixed function state set in bindPipeline with VK_EXT_extended_dynamic_state
+struct PipelineDynamicState {
+	vk::CullModeFlags     cullMode;
+	bool                  depthTest;
+	bool                  depthWrite;
+	vk::CompareOp         depthCompareOp;
+	bool                  stencilTest;
+	vk::StencilOp         stencilPassOp;
+	vk::CompareOp         stencilCompareOp;
+	uint32_t              stencilRef;
+
+
+	PipelineDynamicState() noexcept
+	: depthTest(false)
+	, depthWrite(false)
+	, depthCompareOp(vk::CompareOp::eLess)
+	, stencilTest(false)
+	, stencilPassOp(vk::StencilOp::eKeep)
+	, stencilCompareOp(vk::CompareOp::eAlways)
+	, stencilRef(0)
+	{}
+};
+
+
+// vk::Pipeline and layout shared by Pipelines which only differ in dynamic state
+struct SharedPipeline {
+	vk::Pipeline          pipeline;
+	vk::PipelineLayout    layout;
+	unsigned int          refCount;
+};
+
+
+// link time optimized version of a fast linked pipeline, compiled on a shader compile thread
+struct PendingPipelineLink {
+	vk::Pipeline                         fastPipeline;
+	std::string                          name;
+	// null if it failed
+	std::shared_future<vk::Pipeline>     optimized;
+};
+
+
 struct Pipeline {
-	vk::Pipeline       pipeline;
-	vk::PipelineLayout layout;
-	bool               scissor;
+	vk::Pipeline          pipeline;
+	vk::PipelineLayout    layout;
+	vk::PipelineBindPoint bindPoint;
+	bool                  scissor;
+	uint32_t              pushConstantSize;
+	// key in sharedPipelines, 0 if pipeline and layout are owned
+	uint64_t              sharedKey;
+	PipelineDynamicState  dynamicState;
 
 
 	Pipeline() noexcept
-	: scissor(false)
+	: bindPoint(vk::PipelineBindPoint::eGraphics)
+	, scissor(false)
+	, pushConstantSize(0)
+	, sharedKey(0)
 	{}
 
 	Pipeline(const Pipeline &)            = delete;
@@ -329,11 +486,18 @@ struct Pipeline {
 	Pipeline(Pipeline &&other) noexcept
 	: pipeline(other.pipeline)
 	, layout(other.layout)
+	, bindPoint(other.bindPoint)
 	, scissor(other.scissor)
+	, pushConstantSize(other.pushConstantSize)
+	, sharedKey(other.sharedKey)
+	, dynamicState(other.dynamicState)
 	{
-		other.pipeline = vk::Pipeline();
-		other.layout   = vk::PipelineLayout();
-		other.scissor  = false;
+		other.pipeline  = vk::Pipeline();
+		other.layout    = vk::PipelineLayout();
+		other.bindPoint = vk::PipelineBindPoint::eGraphics;
+		other.scissor   = false;
+		other.pushConstantSize = 0;
+		other.sharedKey = 0;
 	}
 
 	Pipeline &operator=(Pipeline &&other) noexcept {
@@ -344,13 +508,20 @@ struct Pipeline {
 		assert(!pipeline);
 		assert(!layout);
 
-		pipeline       = other.pipeline;
-		layout         = other.layout;
-		scissor        = other.scissor;
-
-		other.pipeline = vk::Pipeline();
-		other.layout   = vk::PipelineLayout();
-		other.scissor  = false;
+		pipeline        = other.pipeline;
+		layout          = other.layout;
+		bindPoint       = other.bindPoint;
+		scissor         = other.scissor;
+		pushConstantSize = other.pushConstantSize;
+		sharedKey       = other.sharedKey;
+		dynamicState    = other.dynamicState;
+
+		other.pipeline  = vk::Pipeline();
+		other.layout    = vk::PipelineLayout();
+		other.bindPoint = vk::PipelineBindPoint::eGraphics;
+		other.scissor   = false;
+		other.pushConstantSize = 0;
+		other.sharedKey = 0;
 
 		return *this;
 	}
@@ -372,7 +543,17 @@ struct Pipeline {
 };
 
 
+// commands of a pass started with beginStaticRenderPass
+// kept across frames and replayed until invalidated
+struct StaticContents {
+	vk::CommandBuffer   cmdBuf;
+	// sets bound while recording, the per-frame pools are reset too often
+	vk::DescriptorPool  dsPool;
+};
+
+
 struct RenderPass {
+	// null with dynamic rendering
 	vk::RenderPass renderPass;
 	unsigned int                   clearValueCount;
 	std::array<vk::ClearValue, MAX_COLOR_RENDERTARGETS + 1>  clearValues;
@@ -380,11 +561,28 @@ struct RenderPass {
 	unsigned int                   numColorAttachments;
 	RenderPassDesc                 desc;
 
+	// what vk::RenderPass would do, beginRenderPass and endRenderPass do it themselves with dynamic rendering
+	// colors, depth and resolves in the same order as in the vk::RenderPass
+	std::array<vk::AttachmentDescription, 2 * MAX_COLOR_RENDERTARGETS + 1>  attachments;
+	unsigned int                   numAttachments;
+	// external dependencies before and after
+	std::array<vk::SubpassDependency, 2>                     dependencies;
+	// for pipelines and secondary command buffers
+	std::array<vk::Format, MAX_COLOR_RENDERTARGETS>          colorFormats;
+	vk::Format                     depthFormat;
+	vk::Format                     stencilFormat;
+	// 0 unless multiview
+	uint32_t                       viewMask;
+	// null until the first beginStaticRenderPass records them
+	StaticContents                 staticContents;
+
 
 	RenderPass() noexcept
 	: clearValueCount(0)
 	, numSamples(0)
 	, numColorAttachments(0)
+	, numAttachments(0)
+	, viewMask(0)
 	{
 	}
 
@@ -397,15 +595,25 @@ struct RenderPass {
 	, numSamples(other.numSamples)
 	, numColorAttachments(other.numColorAttachments)
 	, desc(other.desc)
+	, attachments(other.attachments)
+	, numAttachments(other.numAttachments)
+	, dependencies(other.dependencies)
+	, colorFormats(other.colorFormats)
+	, depthFormat(other.depthFormat)
+	, stencilFormat(other.stencilFormat)
+	, viewMask(other.viewMask)
+	, staticContents(other.staticContents)
 	{
 		for (unsigned int i = 0; i < other.clearValueCount; i++) {
 			clearValues[i] = other.clearValues[i];
 		}
 
 		other.renderPass = vk::RenderPass();
+		other.staticContents  = StaticContents();
 		other.clearValueCount = 0;
 		other.numSamples      = 0;
 		other.numColorAttachments = 0;
+		other.numAttachments  = 0;
 	}
 
 	RenderPass &operator=(RenderPass &&other) noexcept {
@@ -414,30 +622,43 @@ struct RenderPass {
 		}
 
 		assert(!renderPass);
+		assert(!staticContents.cmdBuf);
 
 		renderPass       = other.renderPass;
 		clearValueCount  = other.clearValueCount;
 		numSamples       = other.numSamples;
 		desc             = other.desc;
 		numColorAttachments = other.numColorAttachments;
+		attachments      = other.attachments;
+		numAttachments   = other.numAttachments;
+		dependencies     = other.dependencies;
+		colorFormats     = other.colorFormats;
+		depthFormat      = other.depthFormat;
+		stencilFormat    = other.stencilFormat;
+		viewMask         = other.viewMask;
+		staticContents   = other.staticContents;
 
 		for (unsigned int i = 0; i < other.clearValueCount; i++) {
 			clearValues[i] = other.clearValues[i];
 		}
 
 		other.renderPass = vk::RenderPass();
+		other.staticContents  = StaticContents();
 		other.clearValueCount = 0;
 		other.numSamples      = 0;
 		other.numColorAttachments = 0;
+		other.numAttachments  = 0;
 
 		return *this;
 	}
 
 	~RenderPass() {
 		assert(!renderPass);
+		assert(!staticContents.cmdBuf);
 		assert(clearValueCount == 0);
 		assert(numSamples == 0);
 		assert(numColorAttachments == 0);
+		assert(numAttachments == 0);
 	}
 
 	bool operator==(const RenderPass &other) const {
@@ -453,6 +674,7 @@ struct RenderPass {
 struct RenderTarget{
 	// TODO: add numSamples
 	unsigned int         width, height;
+	unsigned int         layers;
 	Layout               currentLayout;
 	TextureHandle        texture;
 	TextureHandle        additionalView;
@@ -464,6 +686,7 @@ struct RenderTarget{
 	RenderTarget() noexcept
 	: width(0)
 	, height(0)
+	, layers(0)
 	, currentLayout(Layout::Undefined)
 	, format(Format::Invalid)
 	{}
@@ -474,6 +697,7 @@ struct RenderTarget{
 	RenderTarget(RenderTarget &&other) noexcept
 	: width(other.width)
 	, height(other.height)
+	, layers(other.layers)
 	, currentLayout(other.currentLayout)
 	, texture(other.texture)
 	, additionalView(other.additionalView)
@@ -483,6 +707,7 @@ struct RenderTarget{
 	{
 		other.width         = 0;
 		other.height        = 0;
+		other.layers        = 0;
 		other.currentLayout = Layout::Undefined;
 		other.texture       = TextureHandle();
 		other.additionalView = TextureHandle();
@@ -501,6 +726,7 @@ struct RenderTarget{
 
 		width               = other.width;
 		height              = other.height;
+		layers              = other.layers;
 		currentLayout       = other.currentLayout;
 		texture             = other.texture;
 		additionalView      = other.additionalView;
@@ -510,6 +736,7 @@ struct RenderTarget{
 
 		other.width         = 0;
 		other.height        = 0;
+		other.layers        = 0;
 		other.currentLayout = Layout::Undefined;
 		other.texture       = TextureHandle();
 		other.additionalView = TextureHandle();
@@ -581,17 +808,25 @@ struct Sampler {
 
 struct Texture {
 	unsigned int         width, height;
+	// only for createTexture textures, updateTexture needs them
+	Format               format;
+	unsigned int         numMips;
 	bool                 renderTarget;
 	vk::Image            image;
 	vk::ImageView        imageView;
 	VmaAllocation        memory;
+	// MAX_TEXTURE_TABLE_SIZE if not in the texture table
+	unsigned int         tableIndex;
 
 
 	Texture() noexcept
 	: width(0)
 	, height(0)
+	, format(Format::Invalid)
+	, numMips(0)
 	, renderTarget(false)
 	, memory(nullptr)
+	, tableIndex(MAX_TEXTURE_TABLE_SIZE)
 	{
 	}
 
@@ -602,17 +837,23 @@ struct Texture {
 	Texture(Texture &&other) noexcept
 	: width(other.width)
 	, height(other.height)
+	, format(other.format)
+	, numMips(other.numMips)
 	, renderTarget(other.renderTarget)
 	, image(other.image)
 	, imageView(other.imageView)
 	, memory(other.memory)
+	, tableIndex(other.tableIndex)
 	{
 		other.width        = 0;
 		other.height       = 0;
+		other.format       = Format::Invalid;
+		other.numMips      = 0;
 		other.image        = vk::Image();
 		other.imageView    = vk::ImageView();
 		other.memory       = 0;
 		other.renderTarget = false;
+		other.tableIndex   = MAX_TEXTURE_TABLE_SIZE;
 	}
 
 	Texture &operator=(Texture &&other) noexcept {
@@ -622,17 +863,23 @@ struct Texture {
 
 		width              = other.width;
 		height             = other.height;
+		format             = other.format;
+		numMips            = other.numMips;
 		renderTarget       = other.renderTarget;
 		image              = other.image;
 		imageView          = other.imageView;
 		memory             = other.memory;
+		tableIndex         = other.tableIndex;
 
 		other.width        = 0;
 		other.height       = 0;
+		other.format       = Format::Invalid;
+		other.numMips      = 0;
 		other.renderTarget = false;
 		other.image        = vk::Image();
 		other.imageView    = vk::ImageView();
 		other.memory       = 0;
+		other.tableIndex   = MAX_TEXTURE_TABLE_SIZE;
 
 		return *this;
 	}
@@ -640,6 +887,7 @@ struct Texture {
 	~Texture() {
 		assert(!image);
 		assert(!imageView);
+		assert(tableIndex == MAX_TEXTURE_TABLE_SIZE);
 	}
 
 	bool operator==(const Texture &other) const {
@@ -654,9 +902,12 @@ struct Texture {
 
 struct VertexShader {
 	vk::ShaderModule shaderModule;
+	// of the SPIR-V, pipeline library keys use it since modules aren't shared
+	uint64_t         spirvHash;
 
 
 	VertexShader() noexcept
+	: spirvHash(0)
 	{
 	}
 
@@ -665,8 +916,10 @@ struct VertexShader {
 
 	VertexShader(VertexShader &&other) noexcept
 	: shaderModule(other.shaderModule)
+	, spirvHash(other.spirvHash)
 	{
 		other.shaderModule = vk::ShaderModule();
+		other.spirvHash    = 0;
 	}
 
 	VertexShader &operator=(VertexShader &&other) noexcept {
@@ -677,7 +930,9 @@ struct VertexShader {
 		assert(!shaderModule);
 
 		shaderModule       = other.shaderModule;
+		spirvHash          = other.spirvHash;
 		other.shaderModule = vk::ShaderModule();
+		other.spirvHash    = 0;
 
 		return *this;
 	}
@@ -688,6 +943,62 @@ struct VertexShader {
 };
 
 
+// descriptor set contents, used to find identical descriptor sets
+struct DSCacheKey {
+	vk::DescriptorSetLayout                                layout;
+	unsigned int                                           count;
+	std::array<vk::DescriptorBufferInfo, MAX_DESCRIPTORS>  buffers;
+	std::array<vk::DescriptorImageInfo,  MAX_DESCRIPTORS>  images;
+
+
+	DSCacheKey() noexcept
+	: count(0)
+	{
+	}
+
+	~DSCacheKey() {}
+
+	DSCacheKey(const DSCacheKey &)                = default;
+	DSCacheKey(DSCacheKey &&) noexcept            = default;
+
+	DSCacheKey &operator=(const DSCacheKey &)     = default;
+	DSCacheKey &operator=(DSCacheKey &&) noexcept = default;
+
+	bool operator==(const DSCacheKey &other) const {
+		if (layout != other.layout || count != other.count) {
+			return false;
+		}
+
+		for (unsigned int i = 0; i < count; i++) {
+			if (buffers[i] != other.buffers[i] || images[i] != other.images[i]) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	size_t getHash() const {
+		size_t h = VK_HASH(VkDescriptorSetLayout(layout));
+		for (unsigned int i = 0; i < count; i++) {
+			h = hashCombine(h, VK_HASH(VkBuffer(buffers[i].buffer)));
+			h = hashCombine(h, std::hash<uint64_t>()(buffers[i].offset));
+			h = hashCombine(h, std::hash<uint64_t>()(buffers[i].range));
+			h = hashCombine(h, VK_HASH(VkSampler(images[i].sampler)));
+			h = hashCombine(h, VK_HASH(VkImageView(images[i].imageView)));
+		}
+		return h;
+	}
+};
+
+
+struct CachedDescriptorSet {
+	vk::DescriptorSet  ds;
+	// frameNum of the last bind, counts each set once per frame
+	unsigned int       lastUsed;
+};
+
+
 typedef boost::variant<Buffer, Framebuffer, Pipeline, RenderPass, RenderTarget, Sampler, Texture> Resource;
 
 
@@ -700,38 +1011,190 @@ namespace std {
 		size_t operator()(const renderer::Resource &r) const;
 	};
 
+	template <> struct hash<renderer::DSCacheKey> {
+		size_t operator()(const renderer::DSCacheKey &k) const {
+			return k.getHash();
+		}
+	};
+
 }  // namespace std
 
 
 namespace renderer {
 
 
+struct RingPage : public RingPageBase {
+	vk::Buffer              buffer;
+	VmaAllocation           memory;
+	char                    *mapping;
+
+
+	RingPage()
+	: memory(VK_NULL_HANDLE)
+	, mapping(nullptr)
+	{
+	}
+};
+
+
+// small Static buffers are suballocated from these
+// so each one doesn't need its own VkBuffer and memory allocation
+struct BufferArena {
+	vk::Buffer              buffer;
+	VmaAllocation           memory;
+	// only with directUploads
+	char                    *mapping;
+	uint32_t                size;
+	uint32_t                used;
+	uint32_t                numBuffers;
+	// (offset, size) sorted by offset, adjacent ranges are merged
+	std::vector<std::pair<uint32_t, uint32_t> >  freeRanges;
+
+
+	BufferArena()
+	: memory(VK_NULL_HANDLE)
+	, mapping(nullptr)
+	, size(0)
+	, used(0)
+	, numBuffers(0)
+	{
+	}
+};
+
+
+struct StagingBlock {
+	vk::Buffer              buffer;
+	VmaAllocation           memory;
+	VmaAllocationInfo       allocationInfo;
+	uint32_t                size;
+	uint32_t                used;
+
+
+	StagingBlock() noexcept
+	: memory(VK_NULL_HANDLE)
+	, size(0)
+	, used(0)
+	{
+		allocationInfo = {};
+	}
+
+	~StagingBlock() noexcept {
+		assert(!buffer);
+		assert(!memory);
+	}
+
+
+	StagingBlock(const StagingBlock &)            = delete;
+	StagingBlock &operator=(const StagingBlock &) = delete;
+
+
+	StagingBlock(StagingBlock &&other) noexcept
+	: buffer(other.buffer)
+	, memory(other.memory)
+	, allocationInfo(other.allocationInfo)
+	, size(other.size)
+	, used(other.used)
+	{
+		other.buffer         = vk::Buffer();
+		other.memory         = VK_NULL_HANDLE;
+		other.allocationInfo = {};
+		other.size           = 0;
+		other.used           = 0;
+	}
+
+
+	StagingBlock &operator=(StagingBlock &&other) noexcept {
+		if (this == &other) {
+			return *this;
+		}
+
+		assert(!buffer);
+		assert(!memory);
+
+		buffer               = other.buffer;
+		other.buffer         = vk::Buffer();
+
+		memory               = other.memory;
+		other.memory         = VK_NULL_HANDLE;
+
+		allocationInfo       = other.allocationInfo;
+		other.allocationInfo = {};
+
+		size                 = other.size;
+		other.size           = 0;
+
+		used                 = other.used;
+		other.used           = 0;
+
+		return *this;
+	}
+};
+
+
+// a suballocation from a staging block
+struct StagingAllocation {
+	vk::Buffer              buffer;
+	VmaAllocation           memory;
+	uint32_t                offset;
+	char                    *ptr;
+};
+
+
+// staging blocks of a submitted upload, reusable once its copies are done
+// that's when transferTimeline reaches timelineValue, or fence signals without timeline semaphores
+struct SubmittedStaging {
+	uint64_t                   timelineValue;
+	vk::Fence                  fence;
+	std::vector<StagingBlock>  blocks;
+};
+
+
+// texture whose level 0 was uploaded and the rest of the chain is blitted from it
+// all levels are in eTransferDstOptimal until then
+// blits need a graphics queue, so with a separate transfer queue this waits for presentFrame
+struct MipGeneration {
+	vk::Image               image;
+	unsigned int            width, height;
+	unsigned int            numMips;
+};
+
+
+struct UploadContext;
+
+
+// all copies recorded between two submits
+// one command buffer and one semaphore regardless of how many resources it uploads
+// with timeline semaphores the semaphore is replaced by a value of transferTimeline
 struct UploadOp {
+	// recording thread's context, null on the rendering thread
+	UploadContext          *context;
 	vk::CommandBuffer       cmdBuf;
 	vk::Semaphore           semaphore;
+	uint64_t                timelineValue;
 	vk::PipelineStageFlags  semWaitMask;
-	vk::Buffer              stagingBuffer;
-	VmaAllocation           memory;
-	VmaAllocationInfo       allocationInfo;
-	std::vector<vk::ImageMemoryBarrier> imageAcquireBarriers;
+	std::vector<StagingBlock>            stagingBlocks;
+	std::vector<vk::ImageMemoryBarrier>  imageAcquireBarriers;
 	std::vector<vk::BufferMemoryBarrier> bufferAcquireBarriers;
-	bool                    coherent;
+	std::vector<MipGeneration>           mipGenerations;
+	uint32_t                stagingSize;
+	unsigned int            numCopies;
 
 
 	UploadOp() noexcept
-	: memory(VK_NULL_HANDLE)
-	, coherent(false)
+	: context(nullptr)
+	, timelineValue(0)
+	, stagingSize(0)
+	, numCopies(0)
 	{
-		allocationInfo = {};
 	}
 
 	~UploadOp() noexcept {
 		assert(!cmdBuf);
 		assert(!semaphore);
 		assert(!semWaitMask);
-		assert(!stagingBuffer);
-		assert(!memory);
-		assert(!coherent);
+		assert(stagingBlocks.empty());
+		assert(stagingSize == 0);
+		assert(numCopies == 0);
 	}
 
 
@@ -740,24 +1203,29 @@ struct UploadOp {
 
 
 	UploadOp(UploadOp &&other) noexcept
-	: cmdBuf(other.cmdBuf)
+	: context(other.context)
+	, cmdBuf(other.cmdBuf)
 	, semaphore(other.semaphore)
+	, timelineValue(other.timelineValue)
 	, semWaitMask(other.semWaitMask)
-	, stagingBuffer(other.stagingBuffer)
-	, memory(other.memory)
-	, allocationInfo(other.allocationInfo)
+	, stagingBlocks(std::move(other.stagingBlocks))
 	, imageAcquireBarriers(std::move(other.imageAcquireBarriers))
 	, bufferAcquireBarriers(std::move(other.bufferAcquireBarriers))
-	, coherent(other.coherent)
+	, mipGenerations(std::move(other.mipGenerations))
+	, stagingSize(other.stagingSize)
+	, numCopies(other.numCopies)
 	{
+		other.context       = nullptr;
 		other.cmdBuf        = vk::CommandBuffer();
 		other.semaphore     = vk::Semaphore();
+		other.timelineValue = 0;
 		other.semWaitMask   = vk::PipelineStageFlags();
-		other.stagingBuffer = vk::Buffer();
-		other.memory        = VK_NULL_HANDLE;
+		assert(other.stagingBlocks.empty());
 		assert(other.imageAcquireBarriers.empty());
 		assert(other.bufferAcquireBarriers.empty());
-		other.coherent      = false;
+		assert(other.mipGenerations.empty());
+		other.stagingSize   = 0;
+		other.numCopies     = 0;
 	}
 
 
@@ -769,11 +1237,15 @@ struct UploadOp {
 		assert(!cmdBuf);
 		assert(!semaphore);
 		assert(!semWaitMask);
-		assert(!stagingBuffer);
-		assert(!memory);
+		assert(stagingBlocks.empty());
 		assert(imageAcquireBarriers.empty());
 		assert(bufferAcquireBarriers.empty());
-		assert(!coherent);
+		assert(mipGenerations.empty());
+		assert(stagingSize == 0);
+		assert(numCopies == 0);
+
+		context             = other.context;
+		other.context       = nullptr;
 
 		cmdBuf              = other.cmdBuf;
 		other.cmdBuf        = vk::CommandBuffer();
@@ -781,14 +1253,14 @@ struct UploadOp {
 		semaphore           = other.semaphore;
 		other.semaphore     = vk::Semaphore();
 
+		timelineValue       = other.timelineValue;
+		other.timelineValue = 0;
+
 		semWaitMask         = other.semWaitMask;
 		other.semWaitMask   = vk::PipelineStageFlags();
 
-		stagingBuffer       = other.stagingBuffer;
-		other.stagingBuffer = vk::Buffer();
-
-		memory              = other.memory;
-		other.memory        = VK_NULL_HANDLE;
+		stagingBlocks       = std::move(other.stagingBlocks);
+		assert(other.stagingBlocks.empty());
 
 		imageAcquireBarriers     = std::move(other.imageAcquireBarriers);
 		assert(other.imageAcquireBarriers.empty());
@@ -796,16 +1268,123 @@ struct UploadOp {
 		bufferAcquireBarriers     = std::move(other.bufferAcquireBarriers);
 		assert(other.bufferAcquireBarriers.empty());
 
-		coherent            = other.coherent;
-		other.coherent      = false;
+		mipGenerations      = std::move(other.mipGenerations);
+		assert(other.mipGenerations.empty());
+
+		stagingSize         = other.stagingSize;
+		other.stagingSize   = 0;
 
-		allocationInfo      = other.allocationInfo;
+		numCopies           = other.numCopies;
+		other.numCopies     = 0;
 
 		return *this;
 	}
 };
 
 
+// createBuffer and createTexture on threads other than the rendering thread record here
+// command pools can't be used by two threads at once so each thread has its own
+// presentFrame ends and submits what was recorded since the last frame
+struct UploadContext {
+	// set while a mipLevelWriter runs, op then only holds that texture
+	// so presentFrame can leave it for the next frame instead of waiting
+	std::atomic<bool>               writing;
+	// protects everything below
+	std::mutex                      mutex;
+	vk::CommandPool                 cmdPool;
+	std::vector<vk::CommandBuffer>  freeCmdBufs;
+	UploadOp                        op;
+
+
+	UploadContext()
+	: writing(false)
+	{
+	}
+};
+
+
+// draw list chunks one thread recorded for one frame
+// command and descriptor pools can't be used by two threads at once so each thread has its own
+// cleanupFrame resets them once the frame has synced
+struct RecordFrame {
+	vk::CommandPool                         cmdPool;
+	std::vector<vk::CommandBuffer>          cmdBufs;
+	unsigned int                            usedCmdBufs;
+	// another pool is chained on when one runs out
+	std::vector<vk::DescriptorPool>         dsPools;
+	unsigned int                            dsPoolIdx;
+	// sets written this frame, unlike Frame::dsCache not kept across frames
+	HashMap<DSCacheKey, vk::DescriptorSet>  dsCache;
+	// resolved by the chunks, executeDrawList marks them used and clears this
+	std::vector<BufferHandle>               usedBuffers;
+
+
+	RecordFrame()
+	: usedCmdBufs(0)
+	, dsPoolIdx(0)
+	{
+	}
+};
+
+
+// executeDrawList pools of one thread, indexed like RendererImpl::frames
+struct RecordContext {
+	std::vector<RecordFrame>  frames;
+};
+
+
+// copy of one vkQueueSubmit for the submit thread
+// the vectors keep their memory from frame to frame
+struct QueuedSubmit {
+	vk::Queue                            queue;
+	std::vector<vk::Semaphore>           waitSemaphores;
+	std::vector<vk::PipelineStageFlags>  waitMasks;
+	std::vector<vk::CommandBuffer>       commandBuffers;
+	std::vector<vk::Semaphore>           signalSemaphores;
+	// only with timeline
+	bool                                 timeline;
+	std::vector<uint64_t>                waitValues;
+	std::vector<uint64_t>                signalValues;
+	vk::Fence                            fence;
+
+
+	QueuedSubmit()
+	: timeline(false)
+	{
+	}
+};
+
+
+// everything presentFrame submits for one frame and its present, in submission order
+struct QueuedFrame {
+	// only the first numSubmits are in use
+	std::vector<QueuedSubmit>      submits;
+	unsigned int                   numSubmits;
+	bool                           present;
+	uint32_t                       imageIdx;
+	vk::Semaphore                  renderDoneSem;
+	// VK_GOOGLE_display_timing presentID, only if presentTime
+	bool                           presentTime;
+	uint32_t                       presentID;
+	// VK_KHR_incremental_present rectangles, none to present the whole image
+	std::vector<vk::RectLayerKHR>  presentRects;
+
+
+	QueuedFrame()
+	: numSubmits(0)
+	, present(false)
+	, imageIdx(0)
+	, presentTime(false)
+	, presentID(0)
+	{
+	}
+};
+
+
+// frames presentFrame can queue up for the submit thread before it has to wait
+static const unsigned int submitQueueSize = 4;
+
+
 struct Frame : public FrameBase {
 	enum class Status : uint8_t {
 		  Ready
@@ -814,17 +1393,40 @@ struct Frame : public FrameBase {
 	};
 
 	Status                        status;
-	unsigned int                  usedRingBufPtr;
-	std::vector<BufferHandle>     ephemeralBuffers;
 	vk::Fence                     fence;
-	vk::Image                     image;
-	vk::DescriptorPool            dsPool;
+	// descriptor sets come from dsPools[dsPoolIdx], another pool is chained on when it runs out
+	// beginFrame replaces a chain with a single pool of RendererImpl::dsPoolSize
+	std::vector<vk::DescriptorPool> dsPools;
+	unsigned int                  dsPoolIdx;
+	// maxSets of all dsPools together
+	unsigned int                  dsPoolCapacity;
+	// distinct descriptor sets bound during the frame
+	unsigned int                  dsSetsUsed;
+	// descriptor sets allocated from dsPools, kept until dsCacheGeneration changes
+	HashMap<DSCacheKey, CachedDescriptorSet> dsCache;
+	unsigned int                  dsCacheGeneration;
 	vk::CommandPool               commandPool;
 	vk::CommandBuffer             commandBuffer;
-	vk::CommandBuffer             presentCmdBuf;
 	vk::CommandBuffer             barrierCmdBuf;
+	// only if features.asyncCompute
+	// async compute section and the graphics commands after it
+	vk::CommandBuffer             computeCmdBuf;
+	vk::CommandBuffer             postCmdBuf;
+	bool                          usedAsyncCompute;
+	// one per render pass, allocated when first needed
+	std::vector<vk::CommandBuffer> secondaryCmdBufs;
+	unsigned int                  usedSecondaryCmdBufs;
 	vk::Semaphore                 acquireSem;
 	vk::Semaphore                 renderDoneSem;
+	vk::QueryPool                 timestampPool;
+	// one query per GPU timer, only with pipelineStatistics
+	vk::QueryPool                 statisticsPool;
+	// one query per GPU timer, only with performance counters
+	vk::QueryPool                 performancePool;
+	// bit per GPU timer which began a performance query
+	uint32_t                      performanceTimers;
+	// waited on by this frame's submits, freed when it has synced
+	std::vector<vk::Semaphore>    releasedSemaphores;
 
 	std::vector<Resource>         deleteResources;
 	std::vector<UploadOp>         uploads;
@@ -832,20 +1434,31 @@ struct Frame : public FrameBase {
 
 	Frame()
 	: status(Status::Ready)
-	, usedRingBufPtr(0)
+	, dsPoolIdx(0)
+	, dsPoolCapacity(0)
+	, dsSetsUsed(0)
+	, dsCacheGeneration(0)
+	, usedAsyncCompute(false)
+	, usedSecondaryCmdBufs(0)
+	, performanceTimers(0)
 	{}
 
 	~Frame() {
-		assert(ephemeralBuffers.empty());
 		assert(!fence);
-		assert(!image);
-		assert(!dsPool);
+		assert(dsPools.empty());
+		assert(dsCache.empty());
 		assert(!commandPool);
 		assert(!commandBuffer);
-		assert(!presentCmdBuf);
 		assert(!barrierCmdBuf);
+		assert(!computeCmdBuf);
+		assert(!postCmdBuf);
+		assert(secondaryCmdBufs.empty());
 		assert(!acquireSem);
 		assert(!renderDoneSem);
+		assert(!timestampPool);
+		assert(!statisticsPool);
+		assert(!performancePool);
+		assert(releasedSemaphores.empty());
 		assert(status == Status::Ready);
 		assert(deleteResources.empty());
 		assert(uploads.empty());
@@ -857,49 +1470,80 @@ struct Frame : public FrameBase {
 	Frame(Frame &&other) noexcept
 	: FrameBase(std::move(other))
 	, status(other.status)
-	, usedRingBufPtr(other.usedRingBufPtr)
-	, ephemeralBuffers(std::move(other.ephemeralBuffers))
 	, fence(other.fence)
-	, image(other.image)
-	, dsPool(other.dsPool)
+	, dsPools(std::move(other.dsPools))
+	, dsPoolIdx(other.dsPoolIdx)
+	, dsPoolCapacity(other.dsPoolCapacity)
+	, dsSetsUsed(other.dsSetsUsed)
+	, dsCache(std::move(other.dsCache))
+	, dsCacheGeneration(other.dsCacheGeneration)
 	, commandPool(other.commandPool)
 	, commandBuffer(other.commandBuffer)
-	, presentCmdBuf(other.presentCmdBuf)
 	, barrierCmdBuf(other.barrierCmdBuf)
+	, computeCmdBuf(other.computeCmdBuf)
+	, postCmdBuf(other.postCmdBuf)
+	, usedAsyncCompute(other.usedAsyncCompute)
+	, secondaryCmdBufs(std::move(other.secondaryCmdBufs))
+	, usedSecondaryCmdBufs(other.usedSecondaryCmdBufs)
 	, acquireSem(other.acquireSem)
 	, renderDoneSem(other.renderDoneSem)
+	, timestampPool(other.timestampPool)
+	, statisticsPool(other.statisticsPool)
+	, performancePool(other.performancePool)
+	, performanceTimers(other.performanceTimers)
+	, releasedSemaphores(std::move(other.releasedSemaphores))
 	, deleteResources(std::move(other.deleteResources))
 	, uploads(std::move(other.uploads))
 	{
-		other.image            = vk::Image();
 		other.fence            = vk::Fence();
-		other.dsPool           = vk::DescriptorPool();
+		other.dsPools.clear();
+		other.dsPoolIdx        = 0;
+		other.dsPoolCapacity   = 0;
+		other.dsSetsUsed       = 0;
+		other.dsCache.clear();
+		other.dsCacheGeneration = 0;
 		other.commandPool      = vk::CommandPool();
 		other.commandBuffer    = vk::CommandBuffer();
-		other.presentCmdBuf    = vk::CommandBuffer();
 		other.barrierCmdBuf    = vk::CommandBuffer();
+		other.computeCmdBuf    = vk::CommandBuffer();
+		other.postCmdBuf       = vk::CommandBuffer();
+		other.usedAsyncCompute = false;
+		other.secondaryCmdBufs.clear();
+		other.usedSecondaryCmdBufs = 0;
 		other.acquireSem       = vk::Semaphore();
 		other.renderDoneSem    = vk::Semaphore();
+		other.timestampPool    = vk::QueryPool();
+		other.statisticsPool   = vk::QueryPool();
+		other.performancePool  = vk::QueryPool();
+		other.performanceTimers = 0;
+		other.releasedSemaphores.clear();
 		other.status           = Status::Ready;
 		other.lastFrameNum     = 0;
-		other.usedRingBufPtr   = 0;
 		assert(other.deleteResources.empty());
 		assert(other.uploads.empty());
 	}
 
 	Frame &operator=(Frame &&other) noexcept
 	{
-		assert(!image);
-		image                = other.image;
-		other.image          = vk::Image();
-
 		assert(!fence);
 		fence                = other.fence;
 		other.fence          = vk::Fence();
 
-		assert(!dsPool);
-		dsPool               = other.dsPool;
-		other.dsPool         = vk::DescriptorPool();
+		assert(dsPools.empty());
+		dsPools              = std::move(other.dsPools);
+		other.dsPools.clear();
+		dsPoolIdx            = other.dsPoolIdx;
+		other.dsPoolIdx      = 0;
+		dsPoolCapacity       = other.dsPoolCapacity;
+		other.dsPoolCapacity = 0;
+		dsSetsUsed           = other.dsSetsUsed;
+		other.dsSetsUsed     = 0;
+
+		assert(dsCache.empty());
+		dsCache              = std::move(other.dsCache);
+		other.dsCache.clear();
+		dsCacheGeneration    = other.dsCacheGeneration;
+		other.dsCacheGeneration = 0;
 
 		assert(!commandPool);
 		commandPool          = other.commandPool;
@@ -909,14 +1553,27 @@ struct Frame : public FrameBase {
 		commandBuffer        = other.commandBuffer;
 		other.commandBuffer  = vk::CommandBuffer();
 
-		assert(!presentCmdBuf);
-		presentCmdBuf        = other.presentCmdBuf;
-		other.presentCmdBuf  = vk::CommandBuffer();
-
 		assert(!barrierCmdBuf);
 		barrierCmdBuf        = other.barrierCmdBuf;
 		other.barrierCmdBuf  = vk::CommandBuffer();
 
+		assert(!computeCmdBuf);
+		computeCmdBuf        = other.computeCmdBuf;
+		other.computeCmdBuf  = vk::CommandBuffer();
+
+		assert(!postCmdBuf);
+		postCmdBuf           = other.postCmdBuf;
+		other.postCmdBuf     = vk::CommandBuffer();
+
+		usedAsyncCompute     = other.usedAsyncCompute;
+		other.usedAsyncCompute = false;
+
+		assert(secondaryCmdBufs.empty());
+		secondaryCmdBufs     = std::move(other.secondaryCmdBufs);
+		other.secondaryCmdBufs.clear();
+		usedSecondaryCmdBufs = other.usedSecondaryCmdBufs;
+		other.usedSecondaryCmdBufs = 0;
+
 		assert(!acquireSem);
 		acquireSem           = other.acquireSem;
 		other.acquireSem     = vk::Semaphore();
@@ -925,18 +1582,37 @@ struct Frame : public FrameBase {
 		renderDoneSem        = other.renderDoneSem;
 		other.renderDoneSem  = vk::Semaphore();
 
-		assert(ephemeralBuffers.empty());
-		ephemeralBuffers = std::move(other.ephemeralBuffers);
-		assert(other.ephemeralBuffers.empty());
+		assert(!timestampPool);
+		timestampPool        = other.timestampPool;
+		other.timestampPool  = vk::QueryPool();
+
+		assert(!statisticsPool);
+		statisticsPool       = other.statisticsPool;
+		other.statisticsPool = vk::QueryPool();
+
+		assert(!performancePool);
+		performancePool      = other.performancePool;
+		other.performancePool = vk::QueryPool();
+		performanceTimers    = other.performanceTimers;
+		other.performanceTimers = 0;
+
+		assert(releasedSemaphores.empty());
+		releasedSemaphores   = std::move(other.releasedSemaphores);
+		other.releasedSemaphores.clear();
 
 		status               = other.status;
 		other.status         = Status::Ready;
 
 		lastFrameNum         = other.lastFrameNum;
+		beginTime            = other.beginTime;
+		timerNames           = std::move(other.timerNames);
 		other.lastFrameNum   = 0;
 
-		usedRingBufPtr       = other.usedRingBufPtr;
-		other.usedRingBufPtr = 0;
+		assert(ringPages.empty());
+		ringPages            = std::move(other.ringPages);
+		assert(other.ringPages.empty());
+
+		arena                = std::move(other.arena);
 
 		deleteResources = std::move(other.deleteResources);
 		assert(other.deleteResources.empty());
@@ -950,19 +1626,79 @@ struct Frame : public FrameBase {
 };
 
 
+// copy of a rendertarget, read once its frame has synced
+struct PendingReadback {
+	uint32_t                frameNum;
+	vk::Buffer              buffer;
+	VmaAllocation           memory;
+	VmaAllocationInfo       allocationInfo;
+	unsigned int            width, height;
+	Format                  format;
+	ReadbackCallback        callback;
+
+
+	PendingReadback() noexcept
+	: frameNum(0)
+	, memory(VK_NULL_HANDLE)
+	, width(0)
+	, height(0)
+	, format(Format::Invalid)
+	{
+		memset(&allocationInfo, 0, sizeof(VmaAllocationInfo));
+	}
+};
+
+
+// Vulkan objects of deleted resources
+// bookkeeping is done on the render thread, destroyThread only destroys these
+struct RetiredObjects {
+	std::vector<vk::Framebuffer>     framebuffers;
+	std::vector<vk::Pipeline>        pipelines;
+	std::vector<vk::PipelineLayout>  pipelineLayouts;
+	std::vector<vk::RenderPass>      renderPasses;
+	std::vector<vk::Sampler>         samplers;
+	std::vector<vk::ImageView>       imageViews;
+	std::vector<vk::Image>           images;
+	std::vector<vk::Buffer>          buffers;
+	std::vector<VmaAllocation>       allocations;
+
+
+	bool empty() const {
+		return framebuffers.empty()
+		    && pipelines.empty()
+		    && pipelineLayouts.empty()
+		    && renderPasses.empty()
+		    && samplers.empty()
+		    && imageViews.empty()
+		    && images.empty()
+		    && buffers.empty()
+		    && allocations.empty();
+	}
+};
+
+
 struct RendererImpl : public RendererBase {
 	SDL_Window                              *window;
 
 	bool                                    frameAcquired;
 	vk::Semaphore                           frameAcquireSem;
+	// swapchain image of the frame being recorded, not related to currentFrameIdx
+	uint32_t                                currentImageIdx;
 
 	std::vector<Frame>                      frames;
+	std::vector<PendingReadback>            pendingReadbacks;
 
 	ResourceContainer<Buffer>               buffers;
 	ResourceContainer<DescriptorSetLayout>  dsLayouts;
 	ResourceContainer<FragmentShader>       fragmentShaders;
 	ResourceContainer<Framebuffer>          framebuffers;
 	ResourceContainer<Pipeline>             pipelines;
+	// keyed by PipelineDesc::hashValue with the dynamic state and name reset
+	HashMap<uint64_t, SharedPipeline>       sharedPipelines;
+	// vertex input, pre-rasterization, fragment shader and fragment output parts
+	// keyed by hash of the state in each, kept until the renderer is destroyed
+	HashMap<uint64_t, vk::Pipeline>         pipelineLibraries;
+	std::vector<PendingPipelineLink>        pendingPipelineLinks;
 	ResourceContainer<RenderPass>           renderPasses;
 	ResourceContainer<RenderTarget>         renderTargets;
 	ResourceContainer<Sampler>              samplers;
@@ -990,46 +1726,282 @@ struct RendererImpl : public RendererBase {
 	vk::PipelineCache                       pipelineCache;
 	vk::Queue                               queue;
 	vk::Queue                               transferQueue;
+	// second queue of the graphics family, only if features.asyncCompute
+	vk::Queue                               computeQueue;
 
 	vk::CommandBuffer                       currentCommandBuffer;
+	// frame's command buffer while currentCommandBuffer is a secondary one
+	vk::CommandBuffer                       primaryCommandBuffer;
 	vk::PipelineLayout                      currentPipelineLayout;
+	vk::PipelineBindPoint                   currentPipelineBindPoint;
+	uint32_t                                currentPushConstantSize;
 	vk::Viewport                            currentViewport;
 	RenderPassHandle                        currentRenderPass;
 	FramebufferHandle                       currentFramebuffer;
+	// currentCommandBuffer is the static contents of currentRenderPass
+	bool                                    recordingStatic;
+
+	// layout transitions and compute barriers waiting to be recorded
+	// as one pipelineBarrier before the next command which needs them
+	std::vector<vk::ImageMemoryBarrier>     pendingImageBarriers;
+	vk::PipelineStageFlags                  pendingSrcStages;
+	vk::PipelineStageFlags                  pendingDstStages;
+	bool                                    pendingComputeBarrier;
 
 	VmaAllocator                            allocator;
 
 	vk::CommandPool                         transferCmdPool;
+	// static render pass contents outlive frames so they can't come from frame command pools
+	vk::CommandPool                         staticCmdPool;
+	// (frameNum, contents) of invalidated static render passes, freed once that frame has synced
+	std::vector<std::pair<uint32_t, StaticContents> >  retiredStaticContents;
+	// executed command buffers from transferCmdPool, begin resets them
+	std::vector<vk::CommandBuffer>          freeTransferCmdBufs;
+	// copies recorded but not yet submitted
+	UploadOp                                currentUpload;
+	// submitted but not yet part of a frame
 	std::vector<UploadOp>                   uploads;
 	size_t                                  numUploads;
+	// shared with other threads' uploads
+	std::mutex                              stagingMutex;
+	std::vector<StagingBlock>               freeStagingBlocks;
+	// in submit order, the upload op keeps the rest until its frame is done
+	std::vector<SubmittedStaging>           submittedStaging;
+	// of finished submittedStaging, freeFences is rendering thread only so cleanupFrame returns them
+	std::vector<vk::Fence>                  finishedStagingFences;
+	// one per recording thread, there are only a few so they're searched linearly
+	// contexts live until the renderer is destroyed
+	std::mutex                              uploadContextsMutex;
+	std::vector<std::pair<std::thread::id, std::unique_ptr<UploadContext> > >  uploadContexts;
+	// threads which have recorded draw list chunks, same lookup and lifetime as uploadContexts
+	std::mutex                              recordContextsMutex;
+	std::vector<std::pair<std::thread::id, std::unique_ptr<RecordContext> > >  recordContexts;
+	// of the draw list being executed, in submit order
+	std::vector<vk::CommandBuffer>          drawListCmdBufs;
+	// ended by their thread when they got too big, submitted by presentFrame
+	std::mutex                              closedUploadsMutex;
+	std::vector<UploadOp>                   closedUploads;
 
 	std::vector<vk::Semaphore>              freeSemaphores;
+	// unsignaled
+	std::vector<vk::Fence>                  freeFences;
+
+	// presentFrame's submit info, kept to reuse their memory
+	std::vector<vk::Semaphore>              submitWaitSemaphores;
+	std::vector<vk::PipelineStageFlags>     submitWaitMasks;
+	std::vector<uint64_t>                   submitWaitValues;
+	std::vector<vk::ImageMemoryBarrier>     submitImageBarriers;
+	std::vector<vk::BufferMemoryBarrier>    submitBufferBarriers;
+	std::vector<MipGeneration>              submitMipGenerations;
+
+	// only if timelineSemaphores
+	// frame N signals N + 1 on graphicsTimeline so its fence isn't used
+	vk::Semaphore                           graphicsTimeline;
+	// each upload signals the next value after transferTimelineValue
+	vk::Semaphore                           transferTimeline;
+	uint64_t                                transferTimelineValue;
+
+	// between beginAsyncCompute and endAsyncCompute
+	bool                                    asyncComputeActive;
+	// signaled by the last async compute frame, waited on by the next frame
+	// graphics waits for compute to be done with the rendertargets it reads
+	// compute waits for graphics to be done with what compute writes
+	vk::Semaphore                           asyncGraphicsWaitSem;
+	vk::Semaphore                           asyncComputeWaitSem;
 
 	bool                                    amdShaderInfo;
+	// VK_KHR_pipeline_executable_properties statistics, only with RendererDesc::shaderStatistics
+	bool                                    pipelineExecutableInfo;
 	bool                                    debugMarkers;
+	// VK_EXT_debug_utils command buffer labels, preferred over debug marker regions
+	bool                                    debugLabels;
 	bool                                    portabilitySubset;
-
-	vk::Buffer                              ringBuffer;
-	VmaAllocation                           ringBufferMem;
-	char                                    *persistentMapping;
+	// VK_KHR_image_format_list, rendertargets with an additional view format list both formats
+	bool                                    imageFormatList;
+	bool                                    timestamps;
+	// RendererDesc::pipelineStatistics and the device supports it
+	bool                                    pipelineStatistics;
+	// VK_KHR_performance_query counters which fit in a single pass
+	// the profiling lock is held for the lifetime of the device when not empty
+	std::vector<uint32_t>                   performanceCounterIndices;
+	std::vector<vk::PerformanceCounterStorageKHR>  performanceCounterStorage;
+	// VK_EXT_calibrated_timestamps, GPU timings get start times on our clock
+	bool                                    calibratedTimestamps;
+	// host domain is CLOCK_MONOTONIC, otherwise the device timestamp is bracketed with now()
+	bool                                    calibratedMonotonic;
+	bool                                    displayTiming;
+	bool                                    incrementalPresent;
+	bool                                    timelineSemaphores;
+	// VK_KHR_dynamic_rendering, no vk::RenderPass or vk::Framebuffer objects
+	bool                                    dynamicRendering;
+	// VK_EXT_extended_dynamic_state, depth, stencil and cull state are set in bindPipeline
+	bool                                    extendedDynamicState;
+	// VK_EXT_graphics_pipeline_library with fast linking, needs dynamicRendering
+	bool                                    graphicsPipelineLibrary;
+	// most of the device local memory is also host visible (UMA or resizable BAR)
+	// so createBuffer writes contents directly instead of through staging
+	bool                                    directUploads;
+	// from RendererDesc, 0 if disabled
+	uint32_t                                defragmentBytesPerFrame;
+	// memory was freed since the last defragmentation pass which moved nothing
+	bool                                    defragmentPending;
+	// nanoseconds per timestamp tick
+	float                                   timestampPeriod;
+	uint64_t                                timestampMask;
+	bool                                    secondaryCmdBufs;
+
+	// (presentID, beginTime) of presents not yet reported by display timing
+	std::vector<std::pair<uint32_t, uint64_t> > pendingPresentTimes;
+	// identity unless SwapchainDesc::preTransform and the surface is mirrored or upside down
+	vk::SurfaceTransformFlagBitsKHR         swapchainTransform;
+	// damageRects for presentKHR, kept to reuse memory
+	std::vector<vk::RectLayerKHR>           presentRects;
+	// owned by the swapchain
+	std::vector<vk::Image>                  swapchainImages;
+	// (frameNum, swapchain) replaced by recreateSwapchain
+	// destroyed once that frame has synced, after the views of their images
+	std::vector<std::pair<uint32_t, vk::SwapchainKHR> >  retiredSwapchains;
+	// one per swapchain image if features.swapchainRenderTarget
+	std::vector<RenderTargetHandle>         swapchainRenderTargets;
+
+	std::vector<RingPage>                   ringPages;
+	// resource creation on other threads takes this for bufferArenas
+	// and freeTextureTableIndices and the texture table writes
+	std::mutex                              resourceMutex;
+	// destroyed arenas leave an empty slot so Buffer::arena stays valid
+	std::vector<BufferArena>                bufferArenas;
+
+	// used bytes by MemoryKind, ring pages are created from several threads
+	std::array<std::atomic<uint64_t>, MemoryKind::_size_constant>  memoryKindBytes;
+
+	// one update-after-bind set holding every createTexture texture
+	vk::DescriptorSetLayout                 textureTableLayout;
+	vk::DescriptorPool                      textureTablePool;
+	vk::DescriptorSet                       textureTable;
+	std::vector<unsigned int>               freeTextureTableIndices;
 
 	std::vector<Resource>                   deleteResources;
 
+	// filled by the delete*Internal functions, handed to destroyThread by flushRetiredObjects
+	RetiredObjects                          retiredObjects;
+	// low priority, destroyMutex protects destroyQueue and destroyStop
+	std::thread                             destroyThread;
+	std::mutex                              destroyMutex;
+	std::condition_variable                 destroyCV;
+	std::vector<RetiredObjects>             destroyQueue;
+	bool                                    destroyStop;
+
+	// RendererDesc::submitThread, queue and computeQueue submits and present happen on submitThread
+	// the render thread may only use them or the swapchain when waitSubmitThread has emptied the queue
+	// single producer single consumer ring, the render thread fills
+	// submitFrames[submitEnqueued % submitQueueSize] and publishes it by incrementing submitEnqueued
+	bool                                    submitThreadActive;
+	std::thread                             submitThread;
+	std::array<QueuedFrame, submitQueueSize>  submitFrames;
+	std::atomic<uint64_t>                   submitEnqueued;
+	std::atomic<uint64_t>                   submitDequeued;
+	// only for sleeping when the ring is empty or full, submitMutex protects submitStop
+	std::mutex                              submitMutex;
+	std::condition_variable                 submitCV;
+	std::condition_variable                 submitDoneCV;
+	bool                                    submitStop;
+	// set by submitThread, picked up by beginFrame
+	std::atomic<bool>                       presentOutOfDate;
+	std::atomic<bool>                       submitFailed;
+
+	// incremented whenever a resource is destroyed
+	// frames with an older generation flush their descriptor set cache
+	unsigned int                            dsCacheGeneration;
+	// maxSets of a frame's descriptor pool, follows the peak dsSetsUsed
+	unsigned int                            dsPoolSize;
+	unsigned int                            dsPeakSets;
+	unsigned int                            dsPeakFrames;
+
 
 	unsigned int bufferAlignment(BufferType type);
+	ResolvedBuffer resolveBuffer(BufferHandle handle);
+	// for other threads, the rendering thread marks usedBuffers as used by this frame afterwards
+	ResolvedBuffer resolveBuffer(BufferHandle handle, std::vector<BufferHandle> &usedBuffers) const;
+	ResolvedBuffer resolveEphemeralBuffer(BufferHandle handle) const;
 
 	bool recreateSwapchain() WARN_UNUSED_RESULT;
-	void recreateRingBuffer(unsigned int newSize);
-	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignPower);
+	// deferred like deleteRenderTarget, frames in flight may still use them
+	void deleteSwapchainRenderTargets();
+	// swapchains retired at or before this frame
+	void destroyRetiredSwapchains(uint32_t syncedFrame);
+	void retireStaticContents(RenderPass &pass);
+	void freeStaticContents(StaticContents &contents);
+	void destroyRetiredStaticContents(uint32_t syncedFrame);
+
+	// current GPU timestamp and now() at the same moment
+	bool calibrateTimestamps(uint64_t &gpuTicks, uint64_t &hostTime);
+
+	// fills performanceCounterIndices, performanceCounterStorage and performanceCounterNames
+	void selectPerformanceCounters(const std::vector<std::string> &requested);
+
+	// amdStages are only used with VK_AMD_shader_info which can't enumerate them
+	void getExecutableStats(vk::Pipeline pipeline, vk::ShaderStageFlags amdStages, PipelineStats &stats);
+
+	void createRingPage(unsigned int idx, unsigned int size);
+	void destroyRingPage(unsigned int idx);
+	unsigned int ringBufferAllocate(unsigned int size, unsigned int alignment, unsigned int &page);
+	unsigned int ringBufferAllocateShared(unsigned int size, unsigned int &page);
+	void switchRingPage(unsigned int size);
+	void finishRingFrame();
+	void freeRingPage(unsigned int idx);
+	void releaseRingPages(Frame &frame);
+
+	void arenaAllocate(uint32_t size, uint32_t alignment, uint32_t &arena, uint32_t &offset);
+	void arenaFree(uint32_t arena, uint32_t offset, uint32_t size);
+	void createBufferArena(unsigned int idx);
+	void destroyBufferArena(unsigned int idx);
+	// adds or removes the allocation's size in memoryKindBytes
+	void countMemory(MemoryKind kind, VmaAllocation memory, bool allocated);
+	// moves buffers not used by frames in flight, waits for the copies
+	void defragmentMemory();
+
+	// create if not in pipelineLibraries, info has the state for all parts
+	vk::Pipeline getPipelineLibrary(uint64_t key, vk::GraphicsPipelineLibraryFlagBitsEXT part, vk::GraphicsPipelineCreateInfo info);
+	// swap finished link time optimized pipelines in place of the fast linked ones
+	void finishPipelineLinks();
+	// before destroying a fast linked pipeline, waits for its optimized version
+	void cancelPipelineLink(vk::Pipeline fastPipeline);
 
 	bool waitForFrame(unsigned int frameIdx) WARN_UNUSED_RESULT;
+	void collectPresentTimings();
 	void cleanupFrame(unsigned int frameIdx);
 
-	UploadOp allocateUploadOp(uint32_t size);
-	void submitUploadOp(UploadOp &&op);
+	// recording a one time submit command buffer
+	vk::CommandBuffer allocateTransferCmdBuf();
+	// after it has executed
+	void freeTransferCmdBuf(vk::CommandBuffer cmdBuf);
+	// the calling thread's op, on other threads lock holds its context until recording is done
+	UploadOp &beginUpload(std::unique_lock<std::mutex> &lock);
+	StagingAllocation allocateStaging(UploadOp &op, uint32_t size);
+	// submits op once it has enough in it
+	void finishUpload(UploadOp &op);
+	// ends another thread's op and queues it for submitThreadUploads
+	void closeThreadUpload(UploadOp &op);
+	void submitUploads();
+	void submitUpload(UploadOp &op);
+	// rendering thread only, moves other threads' uploads to uploads
+	void submitThreadUploads();
+	void releaseUploadOp(UploadOp &op);
+	// caller holds stagingMutex, moves blocks of finished uploads to freeStagingBlocks
+	void recycleStagingBlocks();
+	// caller holds stagingMutex
+	void releaseStagingBlock(StagingBlock &block);
+	// rendering thread only, also returns their fences
+	void recycleStaging();
+	// with acquire also takes the image from the transfer queue family first
+	void recordMipGeneration(vk::CommandBuffer cmdBuf, const MipGeneration &gen, bool acquire);
+	void destroyStagingBlock(StagingBlock &block);
 
 	vk::Semaphore allocateSemaphore();
 	void freeSemaphore(vk::Semaphore sem);
+	vk::Fence allocateFence();
+	// resets it, must not be pending
+	void freeFence(vk::Fence fence);
 
 	void deleteBufferInternal(Buffer &b);
 	void deleteFramebufferInternal(Framebuffer &fb);
@@ -1040,11 +2012,47 @@ struct RendererImpl : public RendererBase {
 	void deleteSamplerInternal(Sampler &s);
 	void deleteTextureInternal(Texture &tex);
 	void deleteFrameInternal(Frame &f);
+	void flushRetiredObjects();
+	void destroyRetiredObjects(RetiredObjects &objects);
+	void destroyThreadFunc();
+
+	// submits now or adds to the frame being queued for submitThread
+	void queueSubmit(vk::Queue q, const vk::SubmitInfo &submit, vk::Fence fence);
+	// waits for room in the ring if it's full
+	QueuedFrame &queuedFrame();
+	void pushQueuedFrame();
+	// returns once submitThread has done everything pushed so far
+	void waitSubmitThread();
+	// pushes what's left and joins submitThread, everything is submitted directly afterwards
+	void stopSubmitThread();
+	void submitThreadFunc();
+	// false if the swapchain is out of date, throws on other errors
+	bool presentImage(uint32_t imageIdx, vk::Semaphore waitSem, bool presentTime, uint32_t presentID, const std::vector<vk::RectLayerKHR> &rects);
+
+	vk::DescriptorPool createDescriptorPool(unsigned int maxSets);
+	// chains another pool onto the frame's if the current one is full
+	vk::DescriptorSet allocateDescriptorSet(Frame &frame, vk::DescriptorSetLayout layout);
+	// fills a freshly allocated set with the resources of key
+	void writeDescriptorSet(vk::DescriptorSet ds, const DescriptorSetLayout &layout, const DSCacheKey &key);
+	void resetDescriptorPools(Frame &frame);
+	// fills key with what data refers to, returns the number of dynamic offsets
+	// buffers are resolved with usedBuffers unless it's null
+	unsigned int fillDSCacheKey(const DescriptorSetLayout &layout, const char *data, DSCacheKey &key, std::array<uint32_t, MAX_DESCRIPTORS> &dynamicOffsets, std::vector<BufferHandle> *usedBuffers);
+
+	// calling thread's pools for the current frame
+	RecordFrame &recordFrame();
+	void resetRecordFrame(RecordFrame &rf);
+	void destroyRecordFrame(RecordFrame &rf);
+	// records draws [begin, end) of list into a secondary command buffer continuing the current pass
+	// called on job system threads, reads but doesn't change the recording state
+	vk::CommandBuffer recordDrawListChunk(const DrawList &list, unsigned int begin, unsigned int end);
 
 	explicit RendererImpl(const RendererDesc &desc);
 
 	~RendererImpl();
 
+	static std::vector<DeviceInfo> listDevices();
+
 
 	struct ResourceDeleter final : public boost::static_visitor<> {
 		RendererImpl *r;
@@ -1095,7 +2103,23 @@ struct RendererImpl : public RendererBase {
 
 	template <typename T> void debugNameObject(T h, const std::string &name);
 
+	void flushBarriers();
+	void renderingBarriers(const RenderPass &pass, const Framebuffer &fb, bool begin);
+	void beginRendering(const RenderPass &pass, const Framebuffer &fb, bool secondary);
+	// begins the pass on currentCommandBuffer, either inline or filled by secondary command buffers
+	void startRenderPass(const RenderPass &pass, const Framebuffer &fb, bool secondary);
+	// begins cmdBuf continuing pass and makes it currentCommandBuffer
+	// without fb it can be executed inside any compatible framebuffer
+	void beginSecondary(vk::CommandBuffer cmdBuf, vk::CommandBufferUsageFlags usage, const RenderPass &pass, const Framebuffer *fb);
+	// extended dynamic state of p and the default scissor rect if it doesn't use one
+	void setPipelineDynamicState(vk::CommandBuffer cmdBuf, const Pipeline &p) const;
+	// only begins cmdBuf, safe on any thread
+	void beginSecondaryCmdBuf(vk::CommandBuffer cmdBuf, vk::CommandBufferUsageFlags usage, const RenderPass &pass, const Framebuffer *fb) const;
+	// next of the frame's secondaryCmdBufs, allocated when first needed
+	vk::CommandBuffer nextSecondaryCmdBuf(Frame &frame);
+
 	bool isRenderTargetFormatSupported(Format format) const;
+	bool isTextureFormatSupported(Format format) const;
 
 	RenderTargetHandle   createRenderTarget(const RenderTargetDesc &desc);
 	VertexShaderHandle   createVertexShader(const std::string &name, const ShaderMacros &macros);
@@ -1103,14 +2127,20 @@ struct RendererImpl : public RendererBase {
 	FramebufferHandle    createFramebuffer(const FramebufferDesc &desc);
 	RenderPassHandle     createRenderPass(const RenderPassDesc &desc);
 	PipelineHandle       createPipeline(const PipelineDesc &desc);
-	BufferHandle         createBuffer(BufferType type, uint32_t size, const void *contents);
+	PipelineHandle       createComputePipeline(const ComputePipelineDesc &desc);
+	void                 precompileShaders(const PipelineDesc &desc);
+	void                 precompileShaders(const ComputePipelineDesc &desc);
+	BufferHandle         createBuffer(const BufferDesc &desc);
 	BufferHandle         createEphemeralBuffer(BufferType type, uint32_t size, const void *contents);
+	EphemeralAllocation  allocateEphemeral(BufferType type, uint32_t size);
 	SamplerHandle        createSampler(const SamplerDesc &desc);
 	TextureHandle        createTexture(const TextureDesc &desc);
 
 	DSLayoutHandle       createDescriptorSetLayout(const DescriptorLayout *layout);
 
 	TextureHandle        getRenderTargetView(RenderTargetHandle handle, Format f);
+	RenderTargetHandle   getSwapchainRenderTarget() const;
+	unsigned int         getTextureTableIndex(TextureHandle handle) const;
 
 	void deleteBuffer(BufferHandle handle);
 	void deleteFramebuffer(FramebufferHandle fbo);
@@ -1130,9 +2160,20 @@ struct RendererImpl : public RendererBase {
 	bool beginFrame();
 	void presentFrame(RenderTargetHandle image);
 
+	void beginAsyncCompute();
+	void endAsyncCompute();
+
 	void beginRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	bool beginStaticRenderPass(RenderPassHandle rpHandle, FramebufferHandle fbHandle);
+	void invalidateStaticRenderPass(RenderPassHandle rpHandle);
 	void endRenderPass();
 
+	void beginGPUTimer(const std::string &name);
+	void endGPUTimer();
+
+	void pushDebugGroup(const char *name);
+	void popDebugGroup();
+
 	void layoutTransition(RenderTargetHandle image, Layout src, Layout dest);
 
 	void setViewport(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
@@ -1143,13 +2184,27 @@ struct RendererImpl : public RendererBase {
 	void bindVertexBuffer(unsigned int binding, BufferHandle buffer);
 
 	void bindDescriptorSet(unsigned int index, DSLayoutHandle layout, const void *data);
+	void pushConstants(const void *data, unsigned int size);
 
+	void updateBuffer(BufferHandle buffer, uint32_t offset, uint32_t size, const void *data);
+	void updateTexture(TextureHandle texture, unsigned int level, unsigned int x, unsigned int y, unsigned int width, unsigned int height, uint32_t size, const void *data);
 	void blit(RenderTargetHandle source, RenderTargetHandle target);
+	void readbackRenderTarget(RenderTargetHandle handle, ReadbackCallback callback);
 	void resolveMSAA(RenderTargetHandle source, RenderTargetHandle target);
 
 	void draw(unsigned int firstVertex, unsigned int vertexCount);
+	void drawInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedInstanced(unsigned int vertexCount, unsigned int instanceCount);
 	void drawIndexedOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndexedVertexOffset(unsigned int vertexCount, unsigned int firstIndex, unsigned int vertexOffset, unsigned int minIndex, unsigned int maxIndex);
+	void drawIndirect(BufferHandle buffer, unsigned int drawCount);
+	void drawIndexedIndirect(BufferHandle buffer, unsigned int drawCount);
+	// false if Renderer should replay it call by call
+	bool executeDrawList(const DrawList &list);
+
+	void dispatch(unsigned int x, unsigned int y, unsigned int z);
+	void dispatchIndirect(BufferHandle buffer);
+	void computeBarrier();
 };
 
 
@@ -4,9 +4,12 @@ d              := $(dir)
 
 
 FILES:= \
+	Capture.cpp \
+	DrawList.cpp \
 	NullRenderer.cpp \
 	OpenGLRenderer.cpp \
 	RendererCommon.cpp \
+	TextureFile.cpp \
 	VulkanMemoryAllocator.cpp \
 	VulkanRenderer.cpp \
 	# empty line
@@ -25,6 +28,18 @@ else ifeq ($(RENDERER),null)
 
 CFLAGS+=-DRENDERER_NULL
 
+# needs the null renderer's internals so only exists in null builds
+rendererBench_MODULES:=renderer utils
+rendererBench_SRC:=$(dir)/rendererBench.cpp
+
+shaderTest_MODULES:=renderer utils
+shaderTest_SRC:=$(dir)/shaderTest.cpp
+
+PROGRAMS+= \
+	rendererBench \
+	shaderTest \
+	# empty line
+
 else ifeq ($(RENDERER),vulkan)
 
 DEPENDS_renderer+=vulkan
@@ -37,6 +52,13 @@ $(error "Unknown render")
 endif  # RENDERER
 
 
+ifeq ($(CALL_STATS),y)
+
+CFLAGS+=-DRENDERER_CALL_STATS
+
+endif  # CALL_STATS
+
+
 SRC_$(d):=$(addprefix $(d)/,$(FILES))
 
 
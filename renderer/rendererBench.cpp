@@ -0,0 +1,336 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// renderer bookkeeping which runs every frame, timed on the null renderer so no GPU is involved
+// run from the source directory, the SPIR-V cache part compiles blit.vert
+
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <boost/variant/variant.hpp>
+#include <boost/variant/apply_visitor.hpp>
+#include <boost/variant/static_visitor.hpp>
+
+#include <pcg_random.hpp>
+
+#include "renderer/RendererInternal.h"
+#include "renderer/RenderGraph.h"
+
+
+using namespace renderer;
+
+
+enum class BenchRT : uint32_t {
+	  Invalid
+	, Color
+};
+
+
+enum class BenchRP : uint32_t {
+	  Invalid
+	, Final
+};
+
+
+static const char *to_string(BenchRT rt) {
+	return (rt == BenchRT::Color) ? "Color" : "Invalid";
+}
+
+
+static const char *to_string(BenchRP rp) {
+	return (rp == BenchRP::Final) ? "Final" : "Invalid";
+}
+
+
+namespace std {
+
+	template <> struct hash<BenchRT> {
+		size_t operator()(const BenchRT &k) const {
+			return hash<uint32_t>()(static_cast<uint32_t>(k));
+		}
+	};
+
+	template <> struct hash<BenchRP> {
+		size_t operator()(const BenchRP &k) const {
+			return hash<uint32_t>()(static_cast<uint32_t>(k));
+		}
+	};
+
+	template <> struct hash<std::pair<BenchRT, Format> > {
+		size_t operator()(const std::pair<BenchRT, Format> &k) const {
+			return hashCombine(hash<BenchRT>()(k.first), hash<uint32_t>()(k.second._to_integral()));
+		}
+	};
+
+}  // namespace std
+
+
+namespace renderer {
+
+	template <> struct Default<BenchRT> {
+		static constexpr BenchRT  value = BenchRT::Invalid;
+	};
+
+	template <> struct Default<BenchRP> {
+		static constexpr BenchRP  value = BenchRP::Invalid;
+	};
+
+}  // namespace renderer
+
+
+typedef RenderGraph<BenchRT, BenchRP> BenchRenderGraph;
+
+
+// keep the optimizer from throwing the results away
+static volatile uint64_t sink;
+
+
+static uint64_t nanoseconds() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+static void report(const char *name, uint64_t start, unsigned int count) {
+	printf("%-32s %8.1f ns\n", name, double(nanoseconds() - start) / double(count));
+}
+
+
+// about what the demo allocates per frame, mostly small uniform buffers
+static void benchRingBuffer(RendererImpl &impl) {
+	const unsigned int frames   = 2000;
+	const unsigned int perFrame = 256;
+
+	uint64_t sum = 0;
+	uint64_t start = nanoseconds();
+	for (unsigned int f = 0; f < frames; f++) {
+		for (unsigned int i = 0; i < perFrame; i++) {
+			unsigned int page = 0;
+			sum += impl.ringBufferAllocate(64 + (i % 4) * 64, 256, page);
+			sum += page;
+		}
+		impl.finishRingFrame();
+		impl.releaseRingPages(impl.frames.at(impl.currentFrameIdx));
+	}
+	report("ringBufferAllocate", start, frames * perFrame);
+
+	sink = sink + sum;
+}
+
+
+struct BenchResource {
+	uint64_t     a;
+	uint32_t     b;
+	std::string  name;
+};
+
+
+static void benchResourceContainer(pcg32 &rng) {
+	const unsigned int repeats = 200;
+	const unsigned int count   = 1024;
+
+	ResourceContainer<BenchResource> container;
+	std::vector<Handle<BenchResource> > handles;
+	handles.reserve(count);
+
+	uint64_t sum = 0;
+	uint64_t addTime = 0, getTime = 0, removeTime = 0;
+	for (unsigned int r = 0; r < repeats; r++) {
+		uint64_t start = nanoseconds();
+		for (unsigned int i = 0; i < count; i++) {
+			auto result = container.add();
+			result.first.a = i;
+			result.first.b = r;
+			handles.push_back(result.second);
+		}
+		uint64_t mid = nanoseconds();
+		addTime += mid - start;
+
+		// random order like the demo looking up handles it stored
+		for (unsigned int i = 0; i < count; i++) {
+			sum += container.get(handles[rng(count)]).a;
+		}
+		uint64_t end = nanoseconds();
+		getTime += end - mid;
+
+		// removing in a different order than adding exercises the free list
+		for (unsigned int i = count; i > 0; i--) {
+			std::swap(handles[i - 1], handles[rng(i)]);
+		}
+		start = nanoseconds();
+		for (const auto &h : handles) {
+			container.remove(h);
+		}
+		removeTime += nanoseconds() - start;
+		handles.clear();
+	}
+
+	printf("%-32s %8.1f ns\n", "ResourceContainer::add",    double(addTime)    / (double(repeats) * count));
+	printf("%-32s %8.1f ns\n", "ResourceContainer::get",    double(getTime)    / (double(repeats) * count));
+	printf("%-32s %8.1f ns\n", "ResourceContainer::remove", double(removeTime) / (double(repeats) * count));
+
+	sink = sink + sum;
+}
+
+
+static PipelineDesc benchPipelineDesc() {
+	ShaderMacros macros;
+	macros.emplace("SMAA_PRESET_HIGH", "1");
+	macros.emplace("EDGEMETHOD",       "0");
+
+	PipelineDesc desc;
+	desc.vertexShader("blit")
+	    .fragmentShader("blit")
+	    .shaderMacros(macros)
+	    .pushConstantSize(64)
+	    .name("blit");
+
+	return desc;
+}
+
+
+static void benchPipelineDesc(pcg32 &rng) {
+	const unsigned int repeats = 200000;
+
+	PipelineDesc a = benchPipelineDesc();
+	PipelineDesc b = benchPipelineDesc();
+
+	uint64_t sum = 0;
+	uint64_t start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		sum += (a == b) ? 1 : 0;
+	}
+	report("PipelineDesc::operator==", start, repeats);
+
+	// changing the renderpass clears the cached hash like RenderGraph::createPipeline does
+	start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		a.renderPass(HandleAccess::make<RenderPass>(1 + rng(4)));
+		sum += a.hashValue();
+	}
+	report("PipelineDesc::hashValue", start, repeats);
+
+	sink = sink + sum;
+}
+
+
+static void benchRenderGraph(Renderer &renderer) {
+	const unsigned int repeats = 200000;
+
+	BenchRenderGraph graph;
+	graph.reset(renderer);
+
+	RenderTargetDesc rtDesc;
+	rtDesc.name("color")
+	      .format(Format::sRGBA8)
+	      .width(640)
+	      .height(480);
+	graph.renderTarget(BenchRT::Color, rtDesc);
+
+	BenchRenderGraph::PassDesc passDesc;
+	passDesc.color(0, BenchRT::Color, PassBegin::Clear)
+	        .name("Final");
+	graph.renderPass(BenchRP::Final, passDesc, [] (BenchRP, BenchRenderGraph::PassResources &) { });
+
+	graph.presentRenderTarget(BenchRT::Color);
+	graph.build(renderer);
+
+	// first one creates the pipeline, the rest are lookups
+	PipelineDesc desc = benchPipelineDesc();
+	uint64_t sum = HandleAccess::raw(graph.createPipeline(renderer, BenchRP::Final, desc));
+
+	uint64_t start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		sum += HandleAccess::raw(graph.createPipeline(renderer, BenchRP::Final, desc));
+	}
+	report("RenderGraph::createPipeline", start, repeats);
+
+	sink = sink + sum;
+}
+
+
+static void benchSPIRVCache(RendererImpl &impl) {
+	const unsigned int repeats = 1000;
+
+	// first compile fills the cache if it didn't have this variant yet
+	ShaderMacros macros;
+	uint64_t sum = impl.compileSpirv("blit.vert", macros, ShaderKind::Vertex).size();
+
+	uint64_t start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		sum += impl.compileSpirv("blit.vert", macros, ShaderKind::Vertex).size();
+	}
+	report("compileSpirv cache hit", start, repeats);
+
+	// parsing logs a line every time so keep the count low
+	impl.saveSPVCache();
+	const unsigned int loads = 10;
+	start = nanoseconds();
+	for (unsigned int r = 0; r < loads; r++) {
+		{
+			std::unique_lock<std::mutex> lock(impl.spirvCacheMutex);
+			impl.spirvCache.clear();
+		}
+		impl.loadSPVCache();
+		sum += impl.spirvCache.size();
+	}
+	report("loadSPVCache", start, loads);
+
+	sink = sink + sum;
+}
+
+
+int main(int /* argc */, char * /* argv */ []) {
+	pcg32 rng(12345);
+
+	RendererDesc desc;
+	desc.offscreen        = true;
+	desc.swapchain.width  = 640;
+	desc.swapchain.height = 480;
+
+	printf("nanoseconds per operation\n");
+
+	try {
+		{
+			RendererImpl impl(desc);
+			benchRingBuffer(impl);
+			benchSPIRVCache(impl);
+		}
+
+		benchResourceContainer(rng);
+		benchPipelineDesc(rng);
+
+		Renderer renderer = Renderer::createRenderer(desc);
+		benchRenderGraph(renderer);
+	} catch (std::exception &e) {
+		printf("%s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// compiles every variant of the shaders which are only built on demand,
+// a broken one otherwise shows up only when that option is picked in the demo
+// run from the source directory so it finds the shaders
+
+
+#include <cstdio>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "renderer/RendererInternal.h"
+
+
+using namespace renderer;
+
+
+struct ShaderTest {
+	std::string  name;
+	ShaderMacros macros;
+	ShaderKind   kind;
+
+
+	ShaderTest(const std::string &name_, const ShaderMacros &macros_, ShaderKind kind_)
+	: name(name_)
+	, macros(macros_)
+	, kind(kind_)
+	{
+	}
+};
+
+
+static std::string describe(const ShaderTest &t) {
+	std::string str = t.name;
+	for (const auto &macro : t.macros) {
+		str += " ";
+		str += macro.first;
+		str += "=";
+		str += macro.second;
+	}
+
+	return str;
+}
+
+
+static const char *smaaPresets[] = { "LOW", "MEDIUM", "HIGH", "ULTRA", "CUSTOM" };
+
+
+static std::vector<ShaderTest> smaaComputeTests() {
+	std::vector<ShaderTest> tests;
+
+	for (const char *preset : smaaPresets) {
+		ShaderMacros quality;
+		quality.emplace(std::string("SMAA_PRESET_") + preset, "1");
+
+		for (unsigned int half = 0; half < 2; half++) {
+			ShaderMacros macros = quality;
+			if (half) {
+				macros.emplace("SMAA_HALF_PRECISION", "1");
+			}
+
+			// edge method 0 color, 1 luma, 2 depth
+			for (unsigned int method = 0; method < 3; method++) {
+				for (unsigned int predication = 0; predication < 2; predication++) {
+					// depth edges never use predication
+					if (method == 2 && predication) {
+						continue;
+					}
+
+					ShaderMacros edgeMacros = macros;
+					if (method != 0) {
+						edgeMacros.emplace("EDGEMETHOD", std::to_string(method));
+					}
+					if (method == 1) {
+						edgeMacros.emplace("SMAA_LUMA_IN_ALPHA", "1");
+					}
+					if (predication) {
+						edgeMacros.emplace("SMAA_PREDICATION", "1");
+					}
+					tests.emplace_back("smaaEdge.comp", edgeMacros, ShaderKind::Compute);
+				}
+			}
+
+			tests.emplace_back("smaaBlendWeight.comp", macros, ShaderKind::Compute);
+
+			ShaderMacros subgroupMacros = macros;
+			subgroupMacros.emplace("SMAA_SUBGROUP_SEARCH", "1");
+			tests.emplace_back("smaaBlendWeight.comp", subgroupMacros, ShaderKind::Compute);
+		}
+	}
+
+	ShaderMacros none;
+	tests.emplace_back("smaaTileReset.comp", none, ShaderKind::Compute);
+	tests.emplace_back("smaaNeighbor.comp",  none, ShaderKind::Compute);
+
+	ShaderMacros half;
+	half.emplace("SMAA_HALF_PRECISION", "1");
+	tests.emplace_back("smaaNeighbor.comp",  half, ShaderKind::Compute);
+
+	return tests;
+}
+
+
+// the three variants of imagePipelineDesc
+static std::vector<ShaderTest> imageTests() {
+	std::vector<ShaderTest> tests;
+
+	for (const char *variant : { "", "TEXTURE_TABLE", "TILED_IMAGE" }) {
+		ShaderMacros macros;
+		if (variant[0] != '\0') {
+			macros.emplace(variant, "1");
+		}
+		tests.emplace_back("image.vert", macros, ShaderKind::Vertex);
+		tests.emplace_back("image.frag", macros, ShaderKind::Fragment);
+	}
+
+	return tests;
+}
+
+
+// cube pipelines of a scene file, firstInstance comes in a push constant
+static std::vector<ShaderTest> sceneMeshTests() {
+	std::vector<ShaderTest> tests;
+
+	for (const char *variant : { "", "VELOCITY", "DEPTH_ONLY" }) {
+		ShaderMacros macros;
+		macros.emplace("SCENE_MESH", "1");
+		if (variant[0] != '\0') {
+			macros.emplace(variant, "1");
+		}
+		tests.emplace_back("cube.vert", macros, ShaderKind::Vertex);
+		tests.emplace_back("cube.frag", macros, ShaderKind::Fragment);
+	}
+
+	return tests;
+}
+
+
+int main(int /* argc */, char * /* argv */ []) {
+	RendererDesc desc;
+	desc.skipShaderCache  = true;
+	desc.swapchain.width  = 640;
+	desc.swapchain.height = 480;
+
+	std::vector<ShaderTest> tests = smaaComputeTests();
+	for (auto &t : imageTests()) {
+		tests.push_back(std::move(t));
+	}
+	for (auto &t : sceneMeshTests()) {
+		tests.push_back(std::move(t));
+	}
+
+	unsigned int failed = 0;
+	try {
+		RendererImpl impl(desc);
+
+		for (const auto &t : tests) {
+			std::string shaderName = describe(t);
+			try {
+				impl.compileSpirv(t.name, t.macros, t.kind);
+			} catch (std::exception &e) {
+				printf("FAIL %s: %s\n", shaderName.c_str(), e.what());
+				failed++;
+				continue;
+			}
+			printf("ok   %s\n", shaderName.c_str());
+		}
+	} catch (std::exception &e) {
+		printf("%s\n", e.what());
+		return 1;
+	}
+
+	printf("%u of %u shaders failed\n", failed, static_cast<unsigned int>(tests.size()));
+
+	return (failed == 0) ? 0 : 1;
+}
@@ -30,26 +30,37 @@ layout(set = 0, binding = 0, std140) uniform Globals
 #endif  // __cplusplus
 {
 	vec4 screenSize;
+	// SMAA edges and weights targets, smaller than screenSize at reduced resolution
+	vec4 smaaScreenSize;
+	// xy: part of the rendertargets covered by passes before the upscale
+	vec4 renderScale;
 	mat4 viewProj;
 	mat4 prevViewProj;
+	// clip space of this frame to the previous one, for velocity from depth
+	mat4 reprojection;
 	mat4 guiOrtho;
 
 };
 
 
-#ifdef __cplusplus
+#if defined(__cplusplus) || defined(TEXTURE_TABLE) || defined(IMAGE_SCENE) || defined(SCENE_MESH)
 
+// a stage can only have one push_constant block
+// and texture table, image and scene mesh shaders use theirs for something else
 struct SMAAUBO
 
 #else  // __cplusplus
 
-layout(set = 1, binding = 0, std140) uniform SMAAUBO
+// small enough for push constants, the pipeline must declare them
+layout(push_constant) uniform SMAAUBO
 
 #endif  // __cplusplus
 {
 	SMAAParameters  smaaParameters;
 
 	vec4 subsampleIndices;
+	// second subsample of SMAA S2X, whose passes do both at once
+	vec4 subsampleIndices2;
 
 	float predicationThreshold;
 	float predicationScale;
@@ -58,15 +69,216 @@ layout(set = 1, binding = 0, std140) uniform SMAAUBO
 };
 
 
-#ifdef SMAA_PRESET_CUSTOM
+// SMAA_PRESET_CUSTOM takes its parameters as specialization constants with these ids
+// so the driver sees them as constants without a SPIR-V variant per value
+#define SMAA_SPEC_THRESHOLD               0
+#define SMAA_SPEC_DEPTH_THRESHOLD         1
+#define SMAA_SPEC_MAX_SEARCH_STEPS        2
+#define SMAA_SPEC_MAX_SEARCH_STEPS_DIAG   3
+#define SMAA_SPEC_CORNER_ROUNDING         4
+
+
+#if !defined(__cplusplus) && defined(SMAA_PRESET_CUSTOM)
+
+// defaults are the high preset
+layout(constant_id = SMAA_SPEC_THRESHOLD)             const float smaaThreshold          = 0.1;
+layout(constant_id = SMAA_SPEC_DEPTH_THRESHOLD)       const float smaaDepthThreshold     = 0.01;
+layout(constant_id = SMAA_SPEC_MAX_SEARCH_STEPS)      const uint  smaaMaxSearchSteps     = 16;
+layout(constant_id = SMAA_SPEC_MAX_SEARCH_STEPS_DIAG) const uint  smaaMaxSearchStepsDiag = 8;
+layout(constant_id = SMAA_SPEC_CORNER_ROUNDING)       const uint  smaaCornerRounding     = 25;
+
+#define SMAA_THRESHOLD                 smaaThreshold
+#define SMAA_DEPTH_THRESHOLD           smaaDepthThreshold
+#define SMAA_MAX_SEARCH_STEPS          smaaMaxSearchSteps
+#define SMAA_MAX_SEARCH_STEPS_DIAG     smaaMaxSearchStepsDiag
+#define SMAA_CORNER_ROUNDING           smaaCornerRounding
+
+#endif  // !__cplusplus && SMAA_PRESET_CUSTOM
+
+
+// compute SMAA works on square tiles of this many pixels per side
+#define SMAA_COMPUTE_TILE_SIZE 8
+
+// tile list header size in uints
+// the header doubles as indirect dispatch arguments for the blend weight pass
+#define SMAA_TILE_LIST_HEADER  4
+
+
+#if !defined(__cplusplus) && defined(SMAA_TILE_LIST)
+
+// tiles containing edges, packed as x | (y << 16)
+layout(set = 1, binding = 5, std430) buffer SMAATileList {
+	uint  dispatchX;
+	uint  dispatchY;
+	uint  dispatchZ;
+	uint  pad;
+
+	uint  tiles[];
+};
+
+#endif  // !__cplusplus && SMAA_TILE_LIST
+
+// vertices of the quad neighborhood blending draws per tile
+#define SMAA_TILE_VERTICES     6
+
+
+#if !defined(__cplusplus) && defined(SMAA_TILE_DRAW)
+
+// DrawIndirectArgs for neighborhood blending, one instance per tile in the list
+layout(set = 1, binding = 6, std430) buffer SMAATileDraw {
+	uint  tileVertexCount;
+	uint  tileInstanceCount;
+	uint  tileFirstVertex;
+	uint  tileFirstInstance;
+};
+
+#endif  // !__cplusplus && SMAA_TILE_DRAW
+
+
+// in-place neighborhood blending stores each tile of the list in this many uints
+// colors of its pixels followed by a mask of the ones with blend weights
+#define SMAA_BLEND_MASK_WORDS  ((SMAA_COMPUTE_TILE_SIZE * SMAA_COMPUTE_TILE_SIZE + 31) / 32)
+#define SMAA_BLEND_TILE_UINTS  (SMAA_COMPUTE_TILE_SIZE * SMAA_COMPUTE_TILE_SIZE + SMAA_BLEND_MASK_WORDS)
+
+
+#if !defined(__cplusplus) && defined(SMAA_BLEND_COLORS)
+
+// sRGB 8:8:8:8 blended colors, indexed by position in the tile list
+layout(set = 1, binding = 7, std430) buffer SMAABlendColors {
+	uint  blendColors[];
+};
+
+#endif  // !__cplusplus && SMAA_BLEND_COLORS
+
+
+#ifdef __cplusplus
+
+struct CubeCullUBO
+
+#else  // __cplusplus
+
+layout(set = 1, binding = 0, std140) uniform CubeCullUBO
+
+#endif  // __cplusplus
+{
+	vec4   frustumPlanes[6];
+
+	uint   numCubes;
+	float  cubeRadius;
+	// cubes further than this in view space are drawn as impostors
+	float  lodDistance;
+	float  pad0;
+};
+
+
+// cubes per cull pass workgroup
+#define CUBE_CULL_GROUP_SIZE 64
+
+
+#if !defined(__cplusplus) && defined(CUBE_CULL)
+
+// indirect draw arguments of the scene pass
+// instanceCount is the number of visible cubes
+layout(set = 1, binding = 3, std430) buffer CubeDrawArgs {
+	uint  indexCount;
+	uint  instanceCount;
+	uint  firstIndex;
+	int   vertexOffset;
+	uint  firstInstance;
+};
+
+// indirect draw arguments of the impostor draw, not indexed
+layout(set = 1, binding = 5, std430) buffer CubeImpostorArgs {
+	uint  impostorVertexCount;
+	uint  impostorInstanceCount;
+	uint  impostorFirstVertex;
+	uint  impostorFirstInstance;
+};
+
+#endif  // !__cplusplus && CUBE_CULL
+
+
+#if defined(__cplusplus) || defined(CUBE_ANIMATE)
+
+#ifdef __cplusplus
+
+struct CubeAnimateUBO
+
+#else  // __cplusplus
+
+// same binding as CubeCullUBO, only declared in the animation pass
+layout(set = 1, binding = 0, std140) uniform CubeAnimateUBO
+
+#endif  // __cplusplus
+{
+	uint   numAnimatedCubes;
+	// seconds, poses at both are written so the scene pass can compute velocity
+	float  animationTime;
+	float  prevAnimationTime;
+	float  pad2;
+};
+
+#endif  // __cplusplus || CUBE_ANIMATE
+
+
+// cubes per animation pass workgroup
+#define CUBE_ANIMATE_GROUP_SIZE 64
+
+
+// tiled images are split into pages this many pixels square
+// which are streamed into a cache shared by all of them
+#define IMAGE_PAGE_SIZE         128
+// enough for 2^22 pixels on a side, the last level is a single page
+#define TILED_IMAGE_MAX_LEVELS  16
+// page table entry of a page which is not in the cache
+#define IMAGE_PAGE_MISSING      0xFFFFFFFFu
+
+
+#if defined(__cplusplus) || defined(IMAGE_SCENE)
+
+#ifdef __cplusplus
+
+struct ImageConstants
+
+#else  // __cplusplus
+
+layout(push_constant) uniform ImageConstants
+
+#endif  // __cplusplus
+{
+	// xy: texcoord scale, zw: offset, zoom and pan of the image scene
+	vec4   imageTransform;
+	// texture table index of a whole image
+	uint   textureIndex;
+	uint   pad3;
+	uint   pad4;
+	uint   pad5;
+};
+
+#endif  // __cplusplus || IMAGE_SCENE
+
 
-#define SMAA_THRESHOLD                 smaaParameters.threshold
-#define SMAA_DEPTH_THRESHOLD           smaaParameters.depthThreshold
-#define SMAA_MAX_SEARCH_STEPS          smaaParameters.maxSearchSteps
-#define SMAA_MAX_SEARCH_STEPS_DIAG     smaaParameters.maxSearchStepsDiag
-#define SMAA_CORNER_ROUNDING           smaaParameters.cornerRounding
+#if defined(__cplusplus) || defined(TILED_IMAGE)
 
-#endif  // SMAA_PRESET_CUSTOM
+#ifdef __cplusplus
+
+struct TiledImageUBO
+
+#else  // __cplusplus
+
+layout(set = 1, binding = 0, std140) uniform TiledImageUBO
+
+#endif  // __cplusplus
+{
+	// x: first page table entry, y: pages per row, zw: size in pixels
+	uvec4  imageLevels[TILED_IMAGE_MAX_LEVELS];
+	uint   numImageLevels;
+	uint   pad6;
+	uint   pad7;
+	uint   pad8;
+};
+
+#endif  // __cplusplus || TILED_IMAGE
 
 
 struct Cube {
@@ -76,3 +288,69 @@ struct Cube {
 	vec3   color;
 	float  pad1;
 };
+
+
+// compact cube positions are 16-bit fixed point with this many steps per unit
+#define COMPACT_CUBE_POSITION_SCALE  64.0
+
+
+// Cube in a third of the space for the cube grid, see packCube
+struct CompactCube {
+	// smallest three quaternion components as 10-bit unorm of [-1/sqrt(2), 1/sqrt(2)]
+	// index of the largest one in the top 2 bits, it's made positive
+	uint   rotation;
+	// signed fixed point x in the low half, y in the high half
+	uint   positionXY;
+	// z in the low half, low 16 bits of order in the high half
+	uint   positionZOrder;
+	// sRGB 8:8:8 color, bits 16-23 of order in the top 8 bits
+	uint   colorOrder;
+};
+
+
+#if !defined(__cplusplus) && defined(COMPACT_CUBES)
+
+vec4 unpackCubeRotation(uint p)
+{
+	vec3  abc = (vec3(uvec3(p, p >> 10, p >> 20) & 0x3FFu) * (2.0 / 1023.0) - 1.0) * 0.70710678;
+	float d   = sqrt(max(0.0, 1.0 - dot(abc, abc)));
+
+	uint largest = p >> 30;
+	if (largest == 0u) {
+		return vec4(d, abc);
+	} else if (largest == 1u) {
+		return vec4(abc.x, d, abc.yz);
+	} else if (largest == 2u) {
+		return vec4(abc.xy, d, abc.z);
+	} else {
+		return vec4(abc, d);
+	}
+}
+
+
+Cube unpackCube(CompactCube c)
+{
+	Cube cube;
+	cube.rotation = unpackCubeRotation(c.rotation);
+	cube.position = vec3(bitfieldExtract(int(c.positionXY), 0, 16), bitfieldExtract(int(c.positionXY), 16, 16), bitfieldExtract(int(c.positionZOrder), 0, 16)) * (1.0 / COMPACT_CUBE_POSITION_SCALE);
+	cube.order    = (c.positionZOrder >> 16) | ((c.colorOrder >> 24) << 16);
+
+	// the sRGB curve spends the 8 bits where they're visible
+	vec3 srgb  = unpackUnorm4x8(c.colorOrder).xyz;
+	cube.color = mix(srgb * (1.0 / 12.92), pow((srgb + 0.055) * (1.0 / 1.055), vec3(2.4)), greaterThan(srgb, vec3(0.04045)));
+	cube.pad1  = 0.0;
+
+	return cube;
+}
+
+
+// the cube shaders declare their array as CubeData cubes[]
+#define CubeData         CompactCube
+#define loadCube(i)      unpackCube(cubes[i])
+
+#elif !defined(__cplusplus)
+
+#define CubeData         Cube
+#define loadCube(i)      cubes[i]
+
+#endif  // !__cplusplus && COMPACT_CUBES
@@ -422,6 +422,25 @@
 #define SMAA_PREDICATION 0
 #endif
 
+/**
+ * Luma edge detection normally computes luma from rgb on every tap. If the
+ * scene already writes luma to alpha (as FXAA expects) set this to read it
+ * from there instead.
+ */
+#ifndef SMAA_LUMA_IN_ALPHA
+#define SMAA_LUMA_IN_ALPHA 0
+#endif
+
+/**
+ * With this set 'colorTex' of color/luma edge detection and neighborhood
+ * blending is a multisampled texture, and those functions take the index of
+ * the sample to process right after it. This lets S2X read the subsamples
+ * directly instead of separating them first. GLSL only.
+ */
+#ifndef SMAA_MS_COLOR
+#define SMAA_MS_COLOR 0
+#endif
+
 /**
  * Threshold to be used in the additional predication buffer. 
  *
@@ -492,6 +511,14 @@
 #define SMAA_INCLUDE_PS 1
 #endif
 
+/**
+ * Compute shaders can't discard, they have to return "no edge" from the edge
+ * detection functions instead.
+ */
+#ifndef SMAA_DISCARD
+#define SMAA_DISCARD discard
+#endif
+
 //-----------------------------------------------------------------------------
 // Texture Access Defines
 
@@ -582,11 +609,13 @@ SamplerState PointSampler { Filter = MIN_MAG_MIP_POINT; AddressU = Clamp; Addres
 #if defined(SMAA_GLSL_4)
 #define mad(a, b, c) fma(a, b, c)
 #define SMAAGather(tex, coord) textureGather(tex, coord)
+#define SMAAGatherAlpha(tex, coord) textureGather(tex, coord, 3)
 #else
 #define mad(a, b, c) (a * b + c)
 #endif
 #define SMAATexture2DMS2(tex) sampler2DMS tex
 #define SMAALoad(tex, pos, sample) texelFetch(tex, pos, sample)
+#define SMAATextureSizeMS(tex) textureSize(tex)
 #define float2 vec2
 #define float3 vec3
 #define float4 vec4
@@ -596,6 +625,14 @@ SamplerState PointSampler { Filter = MIN_MAG_MIP_POINT; AddressU = Clamp; Addres
 #define bool2 bvec2
 #define bool3 bvec3
 #define bool4 bvec4
+#if SMAA_HALF_PRECISION
+// Vulkan GLSL turns this into RelaxedPrecision, texcoords and search
+// distances don't use it since they need more than 11 bits of mantissa
+#define SMAA_HALF mediump
+#endif
+#endif
+#ifndef SMAA_HALF
+#define SMAA_HALF
 #endif
 
 #if !defined(SMAA_HLSL_3) && !defined(SMAA_HLSL_4) && !defined(SMAA_HLSL_4_1) && !defined(SMAA_GLSL_3) && !defined(SMAA_GLSL_4) && !defined(SMAA_CUSTOM_SL)
@@ -646,6 +683,32 @@ float3 SMAAGatherNeighbours(float2 texcoord,
     #endif
 }
 
+#ifdef SMAAGatherAlpha
+/**
+ * Gathers the alpha of the current pixel, and the left and top neighbors.
+ */
+float3 SMAAGatherAlphaNeighbours(float2 texcoord,
+                                 SMAATexture2D(tex)) {
+    #if SMAA_FLIP_Y
+    return SMAAGatherAlpha(tex, texcoord + SMAA_RT_METRICS.xy * float2(-0.5,  0.5)).zwy;
+    #else  // SMAA_FLIP_Y
+    return SMAAGatherAlpha(tex, texcoord + SMAA_RT_METRICS.xy * float2(-0.5, -0.5)).grb;
+    #endif  // SMAA_FLIP_Y
+}
+
+/**
+ * Gathers the alpha of the right and bottom neighbors.
+ */
+float2 SMAAGatherAlphaRightBottom(float2 texcoord,
+                                  SMAATexture2D(tex)) {
+    #if SMAA_FLIP_Y
+    return SMAAGatherAlpha(tex, texcoord + SMAA_RT_METRICS.xy * float2(0.5, -0.5)).yw;
+    #else  // SMAA_FLIP_Y
+    return SMAAGatherAlpha(tex, texcoord + SMAA_RT_METRICS.xy * float2(0.5,  0.5)).zx;
+    #endif  // SMAA_FLIP_Y
+}
+#endif  // SMAAGatherAlpha
+
 /**
  * Adjusts the threshold by means of predication.
  */
@@ -660,6 +723,37 @@ float2 SMAACalculatePredicatedThreshold(float2 texcoord,
 
 #endif  // SMAA_INCLUDE_PS
 
+#if SMAA_MS_COLOR
+/**
+ * Point and bilinear reads of one sample of a multisampled texture,
+ * texcoords are clamped to the edge like the samplers do.
+ */
+float4 SMAALoadPoint(SMAATexture2DMS2(tex), float2 coord, int sampleIndex) {
+    int2 size = SMAATextureSizeMS(tex);
+    int2 pos  = clamp(int2(coord * float2(size)), int2(0, 0), size - 1);
+    return SMAALoad(tex, pos, sampleIndex);
+}
+
+float4 SMAALoadLinear(SMAATexture2DMS2(tex), float2 coord, int sampleIndex) {
+    int2 size = SMAATextureSizeMS(tex);
+    float2 pos = coord * float2(size) - 0.5;
+    float2 f = pos - floor(pos);
+    int2 p0 = clamp(int2(floor(pos)), int2(0, 0), size - 1);
+    int2 p1 = clamp(int2(floor(pos)) + int2(1, 1), int2(0, 0), size - 1);
+    float4 top    = lerp(SMAALoad(tex, p0, sampleIndex), SMAALoad(tex, int2(p1.x, p0.y), sampleIndex), f.x);
+    float4 bottom = lerp(SMAALoad(tex, int2(p0.x, p1.y), sampleIndex), SMAALoad(tex, p1, sampleIndex), f.x);
+    return lerp(top, bottom, f.y);
+}
+
+#define SMAAColorTexture2D(tex) SMAATexture2DMS2(tex), int sampleIndex
+#define SMAAColorPoint(tex, coord) SMAALoadPoint(tex, coord, sampleIndex)
+#define SMAAColorLevelZero(tex, coord) SMAALoadLinear(tex, coord, sampleIndex)
+#else  // SMAA_MS_COLOR
+#define SMAAColorTexture2D(tex) SMAATexture2D(tex)
+#define SMAAColorPoint(tex, coord) SMAASamplePoint(tex, coord)
+#define SMAAColorLevelZero(tex, coord) SMAASampleLevelZero(tex, coord)
+#endif  // SMAA_MS_COLOR
+
 /**
  * Conditional move:
  */
@@ -727,54 +821,74 @@ void SMAANeighborhoodBlendingVS(float2 texcoord,
  */
 float2 SMAALumaEdgeDetectionPS(float2 texcoord,
                                float4 offset[3],
-                               SMAATexture2D(colorTex)
+                               SMAAColorTexture2D(colorTex)
                                #if SMAA_PREDICATION
                                , SMAATexture2D(predicationTex)
                                #endif
                                ) {
     // Calculate the threshold:
     #if SMAA_PREDICATION
-    float2 threshold = SMAACalculatePredicatedThreshold(texcoord, offset, SMAATexturePass2D(predicationTex));
+    SMAA_HALF float2 threshold = SMAACalculatePredicatedThreshold(texcoord, offset, SMAATexturePass2D(predicationTex));
     #else
-    float2 threshold = float2(SMAA_THRESHOLD, SMAA_THRESHOLD);
+    SMAA_HALF float2 threshold = float2(SMAA_THRESHOLD, SMAA_THRESHOLD);
     #endif
 
     // Calculate lumas:
-    float3 weights = float3(0.2126, 0.7152, 0.0722);
-    float L = dot(SMAASamplePoint(colorTex, texcoord).rgb, weights);
+    #if SMAA_LUMA_IN_ALPHA
+    #define SMAALumaPoint(tex, coord) SMAAColorPoint(tex, coord).a
+    #else
+    SMAA_HALF float3 weights = float3(0.2126, 0.7152, 0.0722);
+    #define SMAALumaPoint(tex, coord) dot(SMAAColorPoint(tex, coord).rgb, weights)
+    #endif
+    #if SMAA_LUMA_IN_ALPHA && defined(SMAAGatherAlpha) && !SMAA_MS_COLOR
+    SMAA_HALF float3 lumas = SMAAGatherAlphaNeighbours(texcoord, SMAATexturePass2D(colorTex));
+    SMAA_HALF float L     = lumas.x;
+    SMAA_HALF float Lleft = lumas.y;
+    SMAA_HALF float Ltop  = lumas.z;
+    #else
+    SMAA_HALF float L = SMAALumaPoint(colorTex, texcoord);
 
-    float Lleft = dot(SMAASamplePoint(colorTex, offset[0].xy).rgb, weights);
-    float Ltop  = dot(SMAASamplePoint(colorTex, offset[0].zw).rgb, weights);
+    SMAA_HALF float Lleft = SMAALumaPoint(colorTex, offset[0].xy);
+    SMAA_HALF float Ltop  = SMAALumaPoint(colorTex, offset[0].zw);
+    #endif
 
     // We do the usual threshold:
-    float4 delta;
+    SMAA_HALF float4 delta;
     delta.xy = abs(L - float2(Lleft, Ltop));
-    float2 edges = step(threshold, delta.xy);
+    SMAA_HALF float2 edges = step(threshold, delta.xy);
 
     // Then discard if there is no edge:
     if (dot(edges, float2(1.0, 1.0)) == 0.0)
-        discard;
+        SMAA_DISCARD;
 
     // Calculate right and bottom deltas:
-    float Lright = dot(SMAASamplePoint(colorTex, offset[1].xy).rgb, weights);
-    float Lbottom  = dot(SMAASamplePoint(colorTex, offset[1].zw).rgb, weights);
+    #if SMAA_LUMA_IN_ALPHA && defined(SMAAGatherAlpha) && !SMAA_MS_COLOR
+    SMAA_HALF float2 lumasRB = SMAAGatherAlphaRightBottom(texcoord, SMAATexturePass2D(colorTex));
+    SMAA_HALF float Lright  = lumasRB.x;
+    SMAA_HALF float Lbottom = lumasRB.y;
+    #else
+    SMAA_HALF float Lright = SMAALumaPoint(colorTex, offset[1].xy);
+    SMAA_HALF float Lbottom  = SMAALumaPoint(colorTex, offset[1].zw);
+    #endif
     delta.zw = abs(L - float2(Lright, Lbottom));
 
     // Calculate the maximum delta in the direct neighborhood:
-    float2 maxDelta = max(delta.xy, delta.zw);
+    SMAA_HALF float2 maxDelta = max(delta.xy, delta.zw);
 
     // Calculate left-left and top-top deltas:
-    float Lleftleft = dot(SMAASamplePoint(colorTex, offset[2].xy).rgb, weights);
-    float Ltoptop = dot(SMAASamplePoint(colorTex, offset[2].zw).rgb, weights);
+    SMAA_HALF float Lleftleft = SMAALumaPoint(colorTex, offset[2].xy);
+    SMAA_HALF float Ltoptop = SMAALumaPoint(colorTex, offset[2].zw);
     delta.zw = abs(float2(Lleft, Ltop) - float2(Lleftleft, Ltoptop));
 
     // Calculate the final maximum delta:
     maxDelta = max(maxDelta.xy, delta.zw);
-    float finalDelta = max(maxDelta.x, maxDelta.y);
+    SMAA_HALF float finalDelta = max(maxDelta.x, maxDelta.y);
 
     // Local contrast adaptation:
     edges.xy *= step(finalDelta, SMAA_LOCAL_CONTRAST_ADAPTATION_FACTOR * delta.xy);
 
+    #undef SMAALumaPoint
+
     return edges;
 }
 
@@ -786,61 +900,61 @@ float2 SMAALumaEdgeDetectionPS(float2 texcoord,
  */
 float2 SMAAColorEdgeDetectionPS(float2 texcoord,
                                 float4 offset[3],
-                                SMAATexture2D(colorTex)
+                                SMAAColorTexture2D(colorTex)
                                 #if SMAA_PREDICATION
                                 , SMAATexture2D(predicationTex)
                                 #endif
                                 ) {
     // Calculate the threshold:
     #if SMAA_PREDICATION
-    float2 threshold = SMAACalculatePredicatedThreshold(texcoord, offset, predicationTex);
+    SMAA_HALF float2 threshold = SMAACalculatePredicatedThreshold(texcoord, offset, predicationTex);
     #else
-    float2 threshold = float2(SMAA_THRESHOLD, SMAA_THRESHOLD);
+    SMAA_HALF float2 threshold = float2(SMAA_THRESHOLD, SMAA_THRESHOLD);
     #endif
 
     // Calculate color deltas:
-    float4 delta;
-    float3 C = SMAASamplePoint(colorTex, texcoord).rgb;
+    SMAA_HALF float4 delta;
+    SMAA_HALF float3 C = SMAAColorPoint(colorTex, texcoord).rgb;
 
-    float3 Cleft = SMAASamplePoint(colorTex, offset[0].xy).rgb;
-    float3 t = abs(C - Cleft);
+    SMAA_HALF float3 Cleft = SMAAColorPoint(colorTex, offset[0].xy).rgb;
+    SMAA_HALF float3 t = abs(C - Cleft);
     delta.x = max(max(t.r, t.g), t.b);
 
-    float3 Ctop  = SMAASamplePoint(colorTex, offset[0].zw).rgb;
+    SMAA_HALF float3 Ctop  = SMAAColorPoint(colorTex, offset[0].zw).rgb;
     t = abs(C - Ctop);
     delta.y = max(max(t.r, t.g), t.b);
 
     // We do the usual threshold:
-    float2 edges = step(threshold, delta.xy);
+    SMAA_HALF float2 edges = step(threshold, delta.xy);
 
     // Then discard if there is no edge:
     if (dot(edges, float2(1.0, 1.0)) == 0.0)
-        discard;
+        SMAA_DISCARD;
 
     // Calculate right and bottom deltas:
-    float3 Cright = SMAASamplePoint(colorTex, offset[1].xy).rgb;
+    SMAA_HALF float3 Cright = SMAAColorPoint(colorTex, offset[1].xy).rgb;
     t = abs(C - Cright);
     delta.z = max(max(t.r, t.g), t.b);
 
-    float3 Cbottom  = SMAASamplePoint(colorTex, offset[1].zw).rgb;
+    SMAA_HALF float3 Cbottom  = SMAAColorPoint(colorTex, offset[1].zw).rgb;
     t = abs(C - Cbottom);
     delta.w = max(max(t.r, t.g), t.b);
 
     // Calculate the maximum delta in the direct neighborhood:
-    float2 maxDelta = max(delta.xy, delta.zw);
+    SMAA_HALF float2 maxDelta = max(delta.xy, delta.zw);
 
     // Calculate left-left and top-top deltas:
-    float3 Cleftleft  = SMAASamplePoint(colorTex, offset[2].xy).rgb;
+    SMAA_HALF float3 Cleftleft  = SMAAColorPoint(colorTex, offset[2].xy).rgb;
     t = abs(C - Cleftleft);
     delta.z = max(max(t.r, t.g), t.b);
 
-    float3 Ctoptop = SMAASamplePoint(colorTex, offset[2].zw).rgb;
+    SMAA_HALF float3 Ctoptop = SMAAColorPoint(colorTex, offset[2].zw).rgb;
     t = abs(C - Ctoptop);
     delta.w = max(max(t.r, t.g), t.b);
 
     // Calculate the final maximum delta:
     maxDelta = max(maxDelta.xy, delta.zw);
-    float finalDelta = max(maxDelta.x, maxDelta.y);
+    SMAA_HALF float finalDelta = max(maxDelta.x, maxDelta.y);
 
     // Local contrast adaptation:
     edges.xy *= step(finalDelta, SMAA_LOCAL_CONTRAST_ADAPTATION_FACTOR * delta.xy);
@@ -859,7 +973,7 @@ float2 SMAADepthEdgeDetectionPS(float2 texcoord,
     float2 edges = step(SMAA_DEPTH_THRESHOLD, delta);
 
     if (dot(edges, float2(1.0, 1.0)) == 0.0)
-        discard;
+        SMAA_DISCARD;
 
     return edges;
 }
@@ -1031,6 +1145,12 @@ float2 SMAACalculateDiagWeights(SMAATexture2D(edgesTex), SMAATexture2D(areaTex),
 //-----------------------------------------------------------------------------
 // Horizontal/Vertical Search Functions
 
+#ifndef SMAASampleSearchEdges
+// the edge fetches of the horizontal and vertical searches, a compute shader
+// can override this to serve them from shared memory
+#define SMAASampleSearchEdges(tex, coord) SMAASampleLevelZero(tex, coord)
+#endif
+
 /**
  * This allows to determine how much length should we add in the last step
  * of the searches. It takes the bilinearly interpolated edge (see 
@@ -1074,7 +1194,7 @@ float SMAASearchXLeft(SMAATexture2D(edgesTex), SMAATexture2D(searchTex), float2
     while (texcoord.x > end && 
            e.g > 0.8281 && // Is there some edge not activated?
            e.r == 0.0) { // Or is there a crossing edge that breaks the line?
-        e = SMAASampleLevelZero(edgesTex, texcoord).rg;
+        e = SMAASampleSearchEdges(edgesTex, texcoord).rg;
         texcoord = mad(-float2(2.0, 0.0), SMAA_RT_METRICS.xy, texcoord);
     }
 
@@ -1099,7 +1219,7 @@ float SMAASearchXRight(SMAATexture2D(edgesTex), SMAATexture2D(searchTex), float2
     while (texcoord.x < end && 
            e.g > 0.8281 && // Is there some edge not activated?
            e.r == 0.0) { // Or is there a crossing edge that breaks the line?
-        e = SMAASampleLevelZero(edgesTex, texcoord).rg;
+        e = SMAASampleSearchEdges(edgesTex, texcoord).rg;
         texcoord = mad(float2(2.0, 0.0), SMAA_RT_METRICS.xy, texcoord);
     }
     float offset = mad(-(255.0 / 127.0), SMAASearchLength(SMAATexturePass2D(searchTex), e, 0.5), 3.25);
@@ -1111,7 +1231,7 @@ float SMAASearchYUp(SMAATexture2D(edgesTex), SMAATexture2D(searchTex), float2 te
     while (API_V_BELOW(texcoord.y, end) && 
            e.r > 0.8281 && // Is there some edge not activated?
            e.g == 0.0) { // Or is there a crossing edge that breaks the line?
-        e = SMAASampleLevelZero(edgesTex, texcoord).rg;
+        e = SMAASampleSearchEdges(edgesTex, texcoord).rg;
         texcoord = mad(-float2(0.0, API_V_DIR(2.0)), SMAA_RT_METRICS.xy, texcoord);
     }
     float offset = mad(-(255.0 / 127.0), SMAASearchLength(SMAATexturePass2D(searchTex), e.gr, 0.0), 3.25);
@@ -1123,7 +1243,7 @@ float SMAASearchYDown(SMAATexture2D(edgesTex), SMAATexture2D(searchTex), float2
     while (API_V_ABOVE(texcoord.y, end) && 
            e.r > 0.8281 && // Is there some edge not activated?
            e.g == 0.0) { // Or is there a crossing edge that breaks the line?
-        e = SMAASampleLevelZero(edgesTex, texcoord).rg;
+        e = SMAASampleSearchEdges(edgesTex, texcoord).rg;
         texcoord = mad(float2(0.0, API_V_DIR(2.0)), SMAA_RT_METRICS.xy, texcoord);
     }
     float offset = mad(-(255.0 / 127.0), SMAASearchLength(SMAATexturePass2D(searchTex), e.gr, 0.5), 3.25);
@@ -1197,9 +1317,9 @@ float4 SMAABlendingWeightCalculationPS(float2 texcoord,
                                        SMAATexture2D(areaTex),
                                        SMAATexture2D(searchTex),
                                        float4 subsampleIndices) { // Just pass zero for SMAA 1x, see @SUBSAMPLE_INDICES.
-    float4 weights = float4(0.0, 0.0, 0.0, 0.0);
+    SMAA_HALF float4 weights = float4(0.0, 0.0, 0.0, 0.0);
 
-    float2 e = SMAASample(edgesTex, texcoord).rg;
+    SMAA_HALF float2 e = SMAASample(edgesTex, texcoord).rg;
 
     SMAA_BRANCH
     if (e.g > 0.0) { // Edge at north
@@ -1225,7 +1345,7 @@ float4 SMAABlendingWeightCalculationPS(float2 texcoord,
         // Now fetch the left crossing edges, two at a time using bilinear
         // filtering. Sampling at -0.25 (see @CROSSING_OFFSET) enables to
         // discern what value each edge has:
-        float e1 = SMAASampleLevelZero(edgesTex, coords.xy).r;
+        SMAA_HALF float e1 = SMAASampleLevelZero(edgesTex, coords.xy).r;
 
         // Find the distance to the right:
         coords.z = SMAASearchXRight(SMAATexturePass2D(edgesTex), SMAATexturePass2D(searchTex), offset[0].zw, offset[2].y);
@@ -1240,7 +1360,7 @@ float4 SMAABlendingWeightCalculationPS(float2 texcoord,
         float2 sqrt_d = sqrt(d);
 
         // Fetch the right crossing edges:
-        float e2 = SMAASampleLevelZeroOffset(edgesTex, coords.zy, int2(1, 0)).r;
+        SMAA_HALF float e2 = SMAASampleLevelZeroOffset(edgesTex, coords.zy, int2(1, 0)).r;
 
         // Ok, we know how this pattern looks like, now it is time for getting
         // the actual area:
@@ -1267,7 +1387,7 @@ float4 SMAABlendingWeightCalculationPS(float2 texcoord,
         d.x = coords.y;
 
         // Fetch the top crossing edges:
-        float e1 = SMAASampleLevelZero(edgesTex, coords.xy).g;
+        SMAA_HALF float e1 = SMAASampleLevelZero(edgesTex, coords.xy).g;
 
         // Find the distance to the bottom:
         coords.z = SMAASearchYDown(SMAATexturePass2D(edgesTex), SMAATexturePass2D(searchTex), offset[1].zw, offset[2].w);
@@ -1281,7 +1401,7 @@ float4 SMAABlendingWeightCalculationPS(float2 texcoord,
         float2 sqrt_d = sqrt(d);
 
         // Fetch the bottom crossing edges:
-        float e2 = SMAASampleLevelZeroOffset(edgesTex, coords.xz, int2(0, API_V_DIR(1))).g;
+        SMAA_HALF float e2 = SMAASampleLevelZeroOffset(edgesTex, coords.xz, int2(0, API_V_DIR(1))).g;
 
         // Get the area for this direction:
         weights.ba = SMAAArea(SMAATexturePass2D(areaTex), sqrt_d, e1, e2, subsampleIndices.x);
@@ -1299,14 +1419,14 @@ float4 SMAABlendingWeightCalculationPS(float2 texcoord,
 
 float4 SMAANeighborhoodBlendingPS(float2 texcoord,
                                   float4 offset,
-                                  SMAATexture2D(colorTex),
+                                  SMAAColorTexture2D(colorTex),
                                   SMAATexture2D(blendTex)
                                   #if SMAA_REPROJECTION
                                   , SMAATexture2D(velocityTex)
                                   #endif
                                   ) {
     // Fetch the blending weights for current pixel:
-    float4 a;
+    SMAA_HALF float4 a;
     a.x = SMAASample(blendTex, offset.xy).a; // Right
     a.y = SMAASample(blendTex, offset.zw).g; // Top
     a.wz = SMAASample(blendTex, texcoord).xz; // Bottom / Left
@@ -1314,7 +1434,7 @@ float4 SMAANeighborhoodBlendingPS(float2 texcoord,
     // Is there any blending weight with a value greater than 0.0?
     SMAA_BRANCH
     if (dot(a, float4(1.0, 1.0, 1.0, 1.0)) < 1e-5) {
-        float4 color = SMAASampleLevelZero(colorTex, texcoord);
+        SMAA_HALF float4 color = SMAAColorLevelZero(colorTex, texcoord);
 
         #if SMAA_REPROJECTION
         float2 velocity = SMAA_DECODE_VELOCITY(SMAASampleLevelZero(velocityTex, texcoord));
@@ -1329,7 +1449,7 @@ float4 SMAANeighborhoodBlendingPS(float2 texcoord,
 
         // Calculate the blending offsets:
         float4 blendingOffset = float4(0.0, API_V_DIR(a.y), 0.0, API_V_DIR(a.w));
-        float2 blendingWeight = a.yw;
+        SMAA_HALF float2 blendingWeight = a.yw;
         SMAAMovc(bool4(h, h, h, h), blendingOffset, float4(a.x, 0.0, a.z, 0.0));
         SMAAMovc(bool2(h, h), blendingWeight, a.xz);
         blendingWeight /= dot(blendingWeight, float2(1.0, 1.0));
@@ -1339,8 +1459,8 @@ float4 SMAANeighborhoodBlendingPS(float2 texcoord,
 
         // We exploit bilinear filtering to mix current pixel with the chosen
         // neighbor:
-        float4 color = blendingWeight.x * SMAASampleLevelZero(colorTex, blendingCoord.xy);
-        color += blendingWeight.y * SMAASampleLevelZero(colorTex, blendingCoord.zw);
+        SMAA_HALF float4 color = blendingWeight.x * SMAAColorLevelZero(colorTex, blendingCoord.xy);
+        color += blendingWeight.y * SMAAColorLevelZero(colorTex, blendingCoord.zw);
 
         #if SMAA_REPROJECTION
         // Antialias velocity for proper reprojection in a later stage:
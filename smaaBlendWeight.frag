@@ -25,7 +25,7 @@ THE SOFTWARE.
 
 #include "shaderDefines.h"
 
-#define SMAA_RT_METRICS screenSize
+#define SMAA_RT_METRICS smaaScreenSize
 #define SMAA_GLSL_4 1
 
 #define SMAA_INCLUDE_PS 1
@@ -45,6 +45,14 @@ layout(set = 1, binding = 1) uniform sampler2D edgesTex;
 layout(set = 1, binding = 2) uniform sampler2D areaTex;
 layout(set = 1, binding = 3) uniform sampler2D searchTex;
 
+#if SMAA_S2X
+
+layout(set = 1, binding = 4) uniform sampler2D edgesTex2;
+
+layout (location = 1) out vec4 outColor2;
+
+#endif  // SMAA_S2X
+
 layout (location = 0) in vec2 texcoord;
 layout (location = 1) in vec2 pixcoord;
 layout (location = 2) in vec4 offset0;
@@ -58,4 +66,10 @@ void main(void)
     offsets[1] = offset1;
     offsets[2] = offset2;
     outColor = SMAABlendingWeightCalculationPS(texcoord, pixcoord, offsets, edgesTex, areaTex, searchTex, subsampleIndices);
+
+#if SMAA_S2X
+
+    outColor2 = SMAABlendingWeightCalculationPS(texcoord, pixcoord, offsets, edgesTex2, areaTex, searchTex, subsampleIndices2);
+
+#endif  // SMAA_S2X
 }
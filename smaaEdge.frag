@@ -25,7 +25,7 @@ THE SOFTWARE.
 
 #include "shaderDefines.h"
 
-#define SMAA_RT_METRICS screenSize
+#define SMAA_RT_METRICS smaaScreenSize
 #define SMAA_GLSL_4 1
 
 #define SMAA_INCLUDE_PS 1
@@ -44,17 +44,37 @@ THE SOFTWARE.
 #define SMAA_PREDICATION_SCALE      predicationScale
 #define SMAA_PREDICATION_STRENGTH   predicationStrength
 
+#if SMAA_S2X
+// detect both subsamples and only discard if neither has edges
+#define SMAA_DISCARD return float2(0.0, 0.0)
+// subsamples are read straight from the multisampled scene color
+#define SMAA_MS_COLOR 1
+#define SAMPLE_INDEX(s) , s
+#else  // SMAA_S2X
+#define SAMPLE_INDEX(s)
+#endif  // SMAA_S2X
+
 
 #include "smaa.h"
 
 
 layout (location = 0) out vec4 outColor;
 
+#if SMAA_S2X
+
+layout (location = 1) out vec4 outColor2;
+
+#endif  // SMAA_S2X
+
 
 #if EDGEMETHOD == 2
 
 layout(set = 1, binding = 1) uniform sampler2D depthTex;
 
+#elif SMAA_S2X
+
+layout(set = 1, binding = 1) uniform sampler2DMS colorTex;
+
 #else  // EDGEMETHOD
 
 layout(set = 1, binding = 1) uniform sampler2D colorTex;
@@ -75,22 +95,15 @@ layout (location = 2) in vec4 offset1;
 layout (location = 3) in vec4 offset2;
 
 
-void main(void)
-{
-    vec4 offsets[3];
-    offsets[0] = offset0;
-    offsets[1] = offset1;
-    offsets[2] = offset2;
-
 #if EDGEMETHOD == 0
 
 #if SMAA_PREDICATION
 
-	outColor = vec4(SMAAColorEdgeDetectionPS(texcoord, offsets, colorTex, predicationTex), 0.0, 0.0);
+#define detectEdges(tex, s) SMAAColorEdgeDetectionPS(texcoord, offsets, tex SAMPLE_INDEX(s), predicationTex)
 
 #else  // SMAA_PREDICATION
 
-	outColor = vec4(SMAAColorEdgeDetectionPS(texcoord, offsets, colorTex), 0.0, 0.0);
+#define detectEdges(tex, s) SMAAColorEdgeDetectionPS(texcoord, offsets, tex SAMPLE_INDEX(s))
 
 #endif  // SMAA_PREDICATION
 
@@ -98,17 +111,17 @@ void main(void)
 
 #if SMAA_PREDICATION
 
-    outColor = vec4(SMAALumaEdgeDetectionPS(texcoord, offsets, colorTex, predicationTex), 0.0, 0.0);
+#define detectEdges(tex, s) SMAALumaEdgeDetectionPS(texcoord, offsets, tex SAMPLE_INDEX(s), predicationTex)
 
 #else  // SMAA_PREDICATION
 
-    outColor = vec4(SMAALumaEdgeDetectionPS(texcoord, offsets, colorTex), 0.0, 0.0);
+#define detectEdges(tex, s) SMAALumaEdgeDetectionPS(texcoord, offsets, tex SAMPLE_INDEX(s))
 
 #endif  // SMAA_PREDICATION
 
 #elif EDGEMETHOD == 2
 
-    outColor = vec4(SMAADepthEdgeDetectionPS(texcoord, offsets, depthTex), 0.0, 0.0);
+#define detectEdges(tex, s) SMAADepthEdgeDetectionPS(texcoord, offsets, tex)
 
 #else
 
@@ -116,4 +129,46 @@ void main(void)
 
 #endif
 
+
+void main(void)
+{
+    vec4 offsets[3];
+    offsets[0] = offset0;
+    offsets[1] = offset1;
+    offsets[2] = offset2;
+
+#if EDGEMETHOD == 2
+
+    vec2 edges  = detectEdges(depthTex, 0);
+
+#if SMAA_S2X
+
+    // both subsamples have the same depth
+    vec2 edges2 = edges;
+
+#endif  // SMAA_S2X
+
+#else  // EDGEMETHOD
+
+    vec2 edges  = detectEdges(colorTex, 0);
+
+#if SMAA_S2X
+
+    vec2 edges2 = detectEdges(colorTex, 1);
+
+#endif  // SMAA_S2X
+
+#endif  // EDGEMETHOD
+
+#if SMAA_S2X
+
+    if (dot(edges + edges2, vec2(1.0, 1.0)) == 0.0) {
+        discard;
+    }
+
+    outColor2 = vec4(edges2, 0.0, 0.0);
+
+#endif  // SMAA_S2X
+
+    outColor  = vec4(edges, 0.0, 0.0);
 }
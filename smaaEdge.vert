@@ -25,7 +25,7 @@ THE SOFTWARE.
 
 #include "shaderDefines.h"
 
-#define SMAA_RT_METRICS screenSize
+#define SMAA_RT_METRICS smaaScreenSize
 #define SMAA_GLSL_4 1
 
 #define SMAA_INCLUDE_PS 0
@@ -53,6 +53,7 @@ void main(void)
 #ifndef VULKAN_FLIP
     texcoord = flipTexCoord(texcoord);
 #endif  // VULKAN_FLIP
+    texcoord *= renderScale.xy;
 
     vec4 offsets[3];
     offsets[0] = vec4(0.0, 0.0, 0.0, 0.0);
@@ -35,19 +35,66 @@ THE SOFTWARE.
 #define SMAA_FLIP_Y 0
 #endif
 
+#if SMAA_S2X
+// subsamples are read straight from the multisampled scene color
+#define SMAA_MS_COLOR 1
+#endif  // SMAA_S2X
+
 
 #include "smaa.h"
+#include "utils.h"
 
 
 layout (location = 0) out vec4 outColor;
 
+#if SMAA_IN_PLACE
+
+// the compute blend already did the work, this only copies the pixels it changed
+readonly restrict layout(std430, set = 1, binding = 7) buffer SMAABlendColors {
+    uint  blendColors[];
+};
+
+layout (location = 2) flat in uint tileIndex;
+
+#elif SMAA_S2X
+
+layout(set = 1, binding = 1) uniform sampler2DMS colorTex;
+layout(set = 1, binding = 2) uniform sampler2D blendTex;
+layout(set = 1, binding = 3) uniform sampler2D blendTex2;
+
+#else  // SMAA_S2X
+
 layout(set = 1, binding = 1) uniform sampler2D colorTex;
 layout(set = 1, binding = 2) uniform sampler2D blendTex;
 
+#endif  // SMAA_S2X
+
 layout (location = 0) in vec2 texcoord;
 layout (location = 1) in vec4 offset;
 
 void main(void)
 {
+#if SMAA_IN_PLACE
+
+    ivec2 local = ivec2(texcoord * screenSize.zw) % SMAA_COMPUTE_TILE_SIZE;
+    uint i      = uint(local.y * SMAA_COMPUTE_TILE_SIZE + local.x);
+    uint base   = tileIndex * SMAA_BLEND_TILE_UINTS;
+    if ((blendColors[base + SMAA_COMPUTE_TILE_SIZE * SMAA_COMPUTE_TILE_SIZE + i / 32] & (1u << (i % 32))) == 0) {
+        discard;
+    }
+
+    // the rendertarget encodes back to the same sRGB value
+    vec4 color = unpackUnorm4x8(blendColors[base + i]);
+    outColor   = vec4(sRGB2linear(color.rgb), color.a);
+
+#elif SMAA_S2X
+
+    // resolve both subsamples
+    outColor = 0.5 * (SMAANeighborhoodBlendingPS(texcoord, offset, colorTex, 0, blendTex) + SMAANeighborhoodBlendingPS(texcoord, offset, colorTex, 1, blendTex2));
+
+#else  // SMAA_S2X
+
     outColor = SMAANeighborhoodBlendingPS(texcoord, offset, colorTex, blendTex);
+
+#endif  // SMAA_S2X
 }
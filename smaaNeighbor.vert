@@ -43,13 +43,62 @@ THE SOFTWARE.
 layout (location = 0) out vec2 texcoord;
 layout (location = 1) out vec4 offset;
 
+#if SMAA_IN_PLACE
+// which tile's colors the fragment shader copies
+layout (location = 2) flat out uint tileIndex;
+#endif  // SMAA_IN_PLACE
+
+
+#if SMAA_TILES
+
+// the compute edge pass's tile list, only tiles with edges are drawn
+// the rest of the output was copied from the input beforehand
+readonly restrict layout(std430, set = 1, binding = 5) buffer SMAATileList {
+    uint  dispatchX;
+    uint  dispatchY;
+    uint  dispatchZ;
+    uint  pad;
+
+    uint  tiles[];
+};
+
+
+const ivec2 tileCorners[SMAA_TILE_VERTICES] = ivec2[](
+      ivec2(0, 0), ivec2(1, 0), ivec2(0, 1)
+    , ivec2(0, 1), ivec2(1, 0), ivec2(1, 1)
+);
+
+#endif  // SMAA_TILES
+
+
 void main(void)
 {
+#if SMAA_TILES
+
+    uint tile   = tiles[gl_InstanceIndex];
+#if SMAA_IN_PLACE
+    tileIndex   = uint(gl_InstanceIndex);
+#endif  // SMAA_IN_PLACE
+    ivec2 pixel = (ivec2(tile & 0xFFFF, tile >> 16) + tileCorners[gl_VertexIndex]) * SMAA_COMPUTE_TILE_SIZE;
+
+    // tiles are in pixels of the scaled viewport, same as the edge pass
+    texcoord = vec2(pixel) * screenSize.xy;
+    vec2 t   = texcoord / renderScale.xy;
+#ifndef VULKAN_FLIP
+    t = flipTexCoord(t);
+#endif  // VULKAN_FLIP
+    vec2 pos = t * vec2(2.0, -2.0) + vec2(-1.0, 1.0);
+
+#else  // SMAA_TILES
+
     vec2 pos = triangleVertex(gl_VertexIndex, texcoord);
 
 #ifndef VULKAN_FLIP
     texcoord = flipTexCoord(texcoord);
 #endif  // VULKAN_FLIP
+    texcoord *= renderScale.xy;
+
+#endif  // SMAA_TILES
 
     offset = vec4(0.0, 0.0, 0.0, 0.0);
     SMAANeighborhoodBlendingVS(texcoord, offset);
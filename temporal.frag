@@ -24,6 +24,7 @@ THE SOFTWARE.
 #version 450 core
 
 #include "shaderDefines.h"
+#include "utils.h"
 
 #define SMAA_RT_METRICS screenSize
 #define SMAA_GLSL_4 1
@@ -53,9 +54,30 @@ layout (location = 0) out vec4 outColor;
 
 void main(void)
 {
+#if TEMPORAL_CLAMP
+
+	// SMAAResolvePS with the history clamped to the current neighbourhood
+	vec4 current  = textureLod(currentTex, texcoord, 0.0);
+#if SMAA_REPROJECTION
+	vec2 velocity = -textureLod(velocityTex, texcoord, 0.0).rg;
+	vec4 previous = textureLod(previousTex, texcoord + velocity, 0.0);
+	float delta   = abs(current.a * current.a - previous.a * previous.a) / 5.0;
+	float weight  = 0.5 * clamp(1.0 - sqrt(delta) * reprojWeigthScale, 0.0, 1.0);
+#else  // SMAA_REPROJECTION
+	vec4 previous = textureLod(previousTex, texcoord, 0.0);
+	float weight  = 0.5;
+#endif  // SMAA_REPROJECTION
+
+	previous.rgb  = clampHistory(currentTex, texcoord, screenSize.xy, current.rgb, previous.rgb);
+	outColor      = mix(current, previous, weight);
+
+#else  // TEMPORAL_CLAMP
+
 #if SMAA_REPROJECTION
 	outColor = SMAAResolvePS(texcoord, currentTex, previousTex, velocityTex);
 #else  // SMAA_REPROJECTION
 	outColor = SMAAResolvePS(texcoord, currentTex, previousTex);
 #endif  // SMAA_REPROJECTION
+
+#endif  // TEMPORAL_CLAMP
 }
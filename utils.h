@@ -59,3 +59,44 @@ vec3 sRGB2linear(vec3 v) {
     return vec3(sRGB2linear(v.x), sRGB2linear(v.y), sRGB2linear(v.z));
 }
 
+
+float linear2sRGB(float v) {
+    if (v <= 0.0031308) {
+        return v * 12.92;
+    } else {
+        return 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+    }
+}
+
+
+vec3 linear2sRGB(vec3 v) {
+    return vec3(linear2sRGB(v.x), linear2sRGB(v.y), linear2sRGB(v.z));
+}
+
+
+
+// limit history color to the range of the current pixel and its neighbours
+// so disocclusions and changed pixels don't ghost
+// alpha is left alone, SMAA reprojection keeps velocity length there
+vec3 clampHistory(sampler2D currentTex, vec2 texcoord, vec2 pixelSize, vec3 current, vec3 previous) {
+    vec3 minColor = current;
+    vec3 maxColor = current;
+
+    vec3 c = textureLod(currentTex, texcoord + vec2(-pixelSize.x, 0.0), 0.0).rgb;
+    minColor = min(minColor, c);
+    maxColor = max(maxColor, c);
+
+    c = textureLod(currentTex, texcoord + vec2( pixelSize.x, 0.0), 0.0).rgb;
+    minColor = min(minColor, c);
+    maxColor = max(maxColor, c);
+
+    c = textureLod(currentTex, texcoord + vec2(0.0, -pixelSize.y), 0.0).rgb;
+    minColor = min(minColor, c);
+    maxColor = max(maxColor, c);
+
+    c = textureLod(currentTex, texcoord + vec2(0.0,  pixelSize.y), 0.0).rgb;
+    minColor = min(minColor, c);
+    maxColor = max(maxColor, c);
+
+    return clamp(previous, minColor, maxColor);
+}
@@ -0,0 +1,205 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+static const size_t minArenaBlockSize = 64 * 1024;
+
+
+// bump allocator for data which lives until the end of a frame
+// freeing is a no-op, reset releases everything at once
+// containers using it must be destroyed before reset
+class FrameArena {
+	struct Block {
+		std::unique_ptr<char[]>  data;
+		size_t                   size;
+	};
+
+	std::vector<Block>  blocks;
+	// used bytes of blocks.back()
+	size_t              used;
+	// total of all blocks, reset merges them into one this big
+	size_t              capacity;
+
+
+	void grow(size_t minSize) {
+		size_t size = std::max(std::max(minSize, capacity), minArenaBlockSize);
+		Block b;
+		b.data.reset(new char[size]);
+		b.size = size;
+		blocks.emplace_back(std::move(b));
+		capacity += size;
+		used      = 0;
+	}
+
+
+public:
+
+	FrameArena()
+	: used(0)
+	, capacity(0)
+	{
+	}
+
+	FrameArena(const FrameArena &)                = delete;
+	FrameArena &operator=(const FrameArena &)     = delete;
+
+	FrameArena(FrameArena &&other) noexcept
+	: blocks(std::move(other.blocks))
+	, used(other.used)
+	, capacity(other.capacity)
+	{
+		other.used     = 0;
+		other.capacity = 0;
+	}
+
+	FrameArena &operator=(FrameArena &&other) noexcept {
+		if (this == &other) {
+			return *this;
+		}
+
+		blocks         = std::move(other.blocks);
+		used           = other.used;
+		capacity       = other.capacity;
+
+		other.used     = 0;
+		other.capacity = 0;
+
+		return *this;
+	}
+
+	~FrameArena() {}
+
+	void *allocate(size_t size, size_t alignment) {
+		assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+		if (!blocks.empty()) {
+			const Block &b = blocks.back();
+			uintptr_t base  = reinterpret_cast<uintptr_t>(b.data.get());
+			size_t aligned  = ((base + used + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+			if (aligned + size <= b.size) {
+				used = aligned + size;
+				return b.data.get() + aligned;
+			}
+		}
+
+		// new[] is aligned for any fundamental type
+		assert(alignment <= alignof(std::max_align_t));
+		grow(size);
+		used = size;
+		return blocks.back().data.get();
+	}
+
+	// after a frame which needed more than one block
+	// replace them with a single one so the next frame doesn't allocate
+	void reset() {
+		if (blocks.size() > 1) {
+			size_t total = capacity;
+			blocks.clear();
+			capacity = 0;
+			grow(total);
+		}
+		used = 0;
+	}
+
+	size_t getCapacity() const {
+		return capacity;
+	}
+};
+
+
+// std allocator on top of a FrameArena
+// without an arena falls back to the heap so containers can be default constructed
+template <typename T>
+class ArenaAllocator {
+	FrameArena  *arena;
+
+	template <typename U> friend class ArenaAllocator;
+
+
+public:
+
+	typedef T         value_type;
+
+	typedef std::true_type  propagate_on_container_copy_assignment;
+	typedef std::true_type  propagate_on_container_move_assignment;
+	typedef std::true_type  propagate_on_container_swap;
+
+
+	ArenaAllocator() noexcept
+	: arena(nullptr)
+	{
+	}
+
+	explicit ArenaAllocator(FrameArena &arena_) noexcept
+	: arena(&arena_)
+	{
+	}
+
+	template <typename U> ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+	: arena(other.arena)
+	{
+	}
+
+	T *allocate(size_t n) {
+		if (arena) {
+			return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+		} else {
+			return static_cast<T *>(::operator new(n * sizeof(T)));
+		}
+	}
+
+	void deallocate(T *p, size_t /* n */) noexcept {
+		if (!arena) {
+			::operator delete(p);
+		}
+	}
+
+	template <typename U> bool operator==(const ArenaAllocator<U> &other) const noexcept {
+		return arena == other.arena;
+	}
+
+	template <typename U> bool operator!=(const ArenaAllocator<U> &other) const noexcept {
+		return arena != other.arena;
+	}
+};
+
+
+template <typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+
+#endif  // ARENA_H
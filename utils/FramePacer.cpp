@@ -0,0 +1,201 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cassert>
+#include <cstdint>
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif  // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+
+// Windows 10 1803 and later, older SDKs and mingw don't have it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif  // CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+
+#else  // _WIN32
+
+#include <cerrno>
+#include <ctime>
+
+#endif  // _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "FramePacer.h"
+
+
+// mingw fuckery...
+#if defined(__GNUC__) && defined(_WIN32)
+
+#include <mingw.thread.h>
+
+#endif  // defined(__GNUC__) && defined(_WIN32)
+
+
+// how late OS timers are assumed to wake up before anything is measured
+#ifdef _WIN32
+static const uint64_t initialSpinMargin = 2000000;
+// without high resolution timers waits are rounded up to the 15.6 ms tick
+static const uint64_t coarseSpinMargin  = 16000000;
+#else  // _WIN32
+static const uint64_t initialSpinMargin = 200000;
+#endif  // _WIN32
+
+static const uint64_t minSpinMargin     = 20000;
+static const uint64_t maxSpinMargin     = 20000000;
+
+
+FramePacer::FramePacer()
+#ifdef _WIN32
+: timer(nullptr)
+, highResolution(false)
+, spinMargin(initialSpinMargin)
+#else  // _WIN32
+: spinMargin(initialSpinMargin)
+#endif  // _WIN32
+{
+#ifdef _WIN32
+	timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (timer) {
+		highResolution = true;
+	} else {
+		timer      = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+		spinMargin = coarseSpinMargin;
+	}
+#endif  // _WIN32
+}
+
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+	if (timer) {
+		CloseHandle(timer);
+		timer = nullptr;
+	}
+#endif  // _WIN32
+}
+
+
+uint64_t FramePacer::now() {
+#ifdef _WIN32
+
+	static const uint64_t freq = [] () {
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		return uint64_t(f.QuadPart);
+	} ();
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	uint64_t c = uint64_t(counter.QuadPart);
+	// split so the multiplication doesn't overflow
+	return (c / freq) * 1000000000ULL + (c % freq) * 1000000000ULL / freq;
+
+#else  // _WIN32
+
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+
+#endif  // _WIN32
+}
+
+
+void FramePacer::sleep(uint64_t nanoseconds) {
+	sleepUntil(now() + nanoseconds);
+}
+
+
+void FramePacer::sleepUntil(uint64_t deadline) {
+	uint64_t start = now();
+	if (deadline > start + spinMargin) {
+		uint64_t target = deadline - spinMargin;
+
+#ifdef _WIN32
+
+		// negative is relative, in 100 ns units
+		LARGE_INTEGER due;
+		due.QuadPart = -static_cast<LONGLONG>((target - start) / 100);
+		if (timer && SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+			WaitForSingleObject(timer, INFINITE);
+		} else {
+			std::this_thread::sleep_for(std::chrono::nanoseconds(target - start));
+		}
+
+#elif defined(__linux__)
+
+		// absolute so being interrupted by signals doesn't add up
+		timespec ts;
+		ts.tv_sec  = time_t(target / 1000000000ULL);
+		ts.tv_nsec = long(target % 1000000000ULL);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+		}
+
+#else  // _WIN32
+
+		std::this_thread::sleep_for(std::chrono::nanoseconds(target - start));
+
+#endif  // _WIN32
+
+		uint64_t woke = now();
+		uint64_t late = (woke > target) ? (woke - target) : 0;
+		if (late > spinMargin) {
+			// might have missed the deadline, grow quickly but not all the way
+			// since a single preemption would make every frame spin for long
+			spinMargin = std::min(spinMargin + (late - spinMargin) / 4, maxSpinMargin);
+		} else {
+			// otherwise approach twice the lateness to keep spinning short
+			uint64_t goal = std::max(2 * late, minSpinMargin);
+			if (spinMargin > goal) {
+				spinMargin -= (spinMargin - goal) / 8;
+			}
+		}
+	}
+
+	while (now() < deadline) {
+		std::this_thread::yield();
+	}
+}
+
+
+const char *FramePacer::getTimerName() const {
+#ifdef _WIN32
+	if (!timer) {
+		return "sleep_for";
+	}
+	return highResolution ? "high resolution waitable timer" : "waitable timer";
+#elif defined(__linux__)
+	return "clock_nanosleep";
+#else  // _WIN32
+	return "sleep_for";
+#endif  // _WIN32
+}
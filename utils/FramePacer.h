@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+
+#include <cstdint>
+
+
+// sleeps for precise intervals
+// the OS timer sleeps until just before the deadline and the rest is spun
+// how early to wake up adapts to how late the OS timer has been
+class FramePacer {
+#ifdef _WIN32
+	// waitable timer HANDLE, high resolution when the OS has them
+	void      *timer;
+	bool      highResolution;
+#endif  // _WIN32
+
+	// nanoseconds before the deadline the OS timer is set to
+	uint64_t  spinMargin;
+
+
+	void sleepUntil(uint64_t deadline);
+
+
+public:
+
+	FramePacer();
+
+	FramePacer(const FramePacer &)            = delete;
+	FramePacer(FramePacer &&)                 = delete;
+
+	FramePacer &operator=(const FramePacer &) = delete;
+	FramePacer &operator=(FramePacer &&)      = delete;
+
+	~FramePacer();
+
+	// nanoseconds from a monotonic clock, only meaningful as differences
+	static uint64_t now();
+
+	// returns once nanoseconds have passed
+	void sleep(uint64_t nanoseconds);
+
+	uint64_t getSpinMargin() const {
+		return spinMargin;
+	}
+
+	// name of the OS timer for logging
+	const char *getTimerName() const;
+};
+
+
+#endif  // FRAMEPACER_H
@@ -2,16 +2,834 @@
 #define HASH_H
 
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "Arena.h"
+
+
+static inline size_t hashCombine(size_t seed, size_t value) {
+	return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+
+namespace hashdetail {
+
+
+// open addressing with one control byte per slot, probed 16 at a time
+// a full slot's control byte holds 7 bits of its hash so most
+// non-matching slots are rejected without touching the slot itself
+typedef int8_t ctrl_t;
+
+static const ctrl_t  ctrlEmpty    = -128;
+static const ctrl_t  ctrlDeleted  = -2;
+// marks the end of the control bytes for iterators
+static const ctrl_t  ctrlSentinel = -1;
+
+static const size_t  groupWidth   = 16;
+// after the sentinel the first groupWidth - 1 control bytes are repeated
+// so a group load starting near the end doesn't have to wrap around
+static const size_t  numClonedBytes = groupWidth - 1;
+
+
+// std::hash of integers is the identity in common standard libraries
+// mix it so both the probe start and the 7 bit tag get good bits
+static inline size_t mixHash(size_t h) {
+	uint64_t x = uint64_t(h);
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return size_t(x);
+}
+
+
+static inline size_t h1(size_t hash) {
+	return hash >> 7;
+}
+
+
+static inline ctrl_t h2(size_t hash) {
+	return ctrl_t(hash & 0x7F);
+}
+
+
+static inline unsigned int lowestBit(uint32_t mask) {
+	assert(mask != 0);
+#ifdef _MSC_VER
+	unsigned long idx = 0;
+	_BitScanForward(&idx, mask);
+	return static_cast<unsigned int>(idx);
+#else  // _MSC_VER
+	return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif  // _MSC_VER
+}
+
+
+class Group {
+#ifdef HASH_SSE2
+
+	__m128i ctrl;
+
+
+public:
+
+	explicit Group(const ctrl_t *pos)
+	: ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos)))
+	{
+	}
+
+	uint32_t match(ctrl_t tag) const {
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl)));
+	}
+
+	uint32_t matchEmpty() const {
+		return match(ctrlEmpty);
+	}
+
+	uint32_t matchEmptyOrDeleted() const {
+		// full is >= 0 and the sentinel is -1, only empty and deleted are smaller
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(ctrlSentinel), ctrl)));
+	}
+
+#else  // HASH_SSE2
+
+	const ctrl_t *ctrl;
+
+
+public:
+
+	explicit Group(const ctrl_t *pos)
+	: ctrl(pos)
+	{
+	}
+
+	uint32_t match(ctrl_t tag) const {
+		uint32_t mask = 0;
+		for (unsigned int i = 0; i < groupWidth; i++) {
+			mask |= uint32_t(ctrl[i] == tag) << i;
+		}
+		return mask;
+	}
+
+	uint32_t matchEmpty() const {
+		return match(ctrlEmpty);
+	}
+
+	uint32_t matchEmptyOrDeleted() const {
+		uint32_t mask = 0;
+		for (unsigned int i = 0; i < groupWidth; i++) {
+			mask |= uint32_t(ctrl[i] < ctrlSentinel) << i;
+		}
+		return mask;
+	}
+
+#endif  // HASH_SSE2
+};
+
+
+// control bytes of a table with no allocation
+// a sentinel so iteration ends immediately and empties so lookups fail
+static inline ctrl_t *emptyGroup() {
+	alignas(16) static const ctrl_t group[groupWidth] = {
+		  ctrlSentinel, ctrlEmpty, ctrlEmpty, ctrlEmpty
+		, ctrlEmpty,    ctrlEmpty, ctrlEmpty, ctrlEmpty
+		, ctrlEmpty,    ctrlEmpty, ctrlEmpty, ctrlEmpty
+		, ctrlEmpty,    ctrlEmpty, ctrlEmpty, ctrlEmpty
+	};
+	// never written to, only the iterator type wants it mutable
+	return const_cast<ctrl_t *>(group);
+}
+
+
+// capacity is always 2^n - 1 so it doubles as the probe mask
+// one in eight slots is left empty so probing always ends
+static inline size_t maxLoad(size_t capacity) {
+	if (capacity < groupWidth) {
+		return (capacity > 0) ? capacity - 1 : 0;
+	}
+	return capacity - capacity / 8;
+}
+
+
+template <typename K, typename V>
+struct MapPolicy {
+	typedef std::pair<const K, V>  value_type;
+
+
+	static const K &key(const value_type &v) {
+		return v.first;
+	}
+
+	template <typename KArg>
+	static void constructKey(value_type *slot, KArg &&k) {
+		new (slot) value_type(std::piecewise_construct, std::forward_as_tuple(std::forward<KArg>(k)), std::forward_as_tuple());
+	}
+
+	// the key is const only to users, moving it avoids copying strings on rehash
+	static void construct(value_type *slot, value_type &&v) {
+		new (slot) value_type(std::move(const_cast<K &>(v.first)), std::move(v.second));
+	}
+
+	static void construct(value_type *slot, const value_type &v) {
+		new (slot) value_type(v);
+	}
+};
+
+
+template <typename K>
+struct SetPolicy {
+	typedef K  value_type;
+
+
+	static const K &key(const value_type &v) {
+		return v;
+	}
+
+	template <typename KArg>
+	static void constructKey(value_type *slot, KArg &&k) {
+		new (slot) value_type(std::forward<KArg>(k));
+	}
+
+	template <typename V>
+	static void construct(value_type *slot, V &&v) {
+		new (slot) value_type(std::forward<V>(v));
+	}
+};
+
+
+// like std::unordered_map/set except that inserting can move existing
+// elements, references and iterators are invalidated like with std::vector
+// erasing doesn't move anything so erase-while-iterating works as usual
+template <typename K, typename Policy, typename Hash, typename Eq>
+class FlatHashTable {
+public:
+
+	typedef K                                  key_type;
+	typedef typename Policy::value_type        value_type;
+	typedef size_t                             size_type;
+	typedef ptrdiff_t                          difference_type;
+	typedef Hash                               hasher;
+	typedef Eq                                 key_equal;
+	typedef value_type                        &reference;
+	typedef const value_type                  &const_reference;
+
+
+private:
+
+	template <bool Const>
+	class Iterator {
+		typedef typename Policy::value_type                                  Slot;
+		typedef typename std::conditional<Const, const Slot, Slot>::type     Value;
+
+		ctrl_t  *ctrl;
+		Value   *slot;
+
+
+		void skipEmptyOrDeleted() {
+			while (*ctrl < ctrlSentinel) {
+				ctrl++;
+				slot++;
+			}
+		}
+
+		Iterator(ctrl_t *ctrl_, Value *slot_)
+		: ctrl(ctrl_)
+		, slot(slot_)
+		{
+		}
+
+		friend class FlatHashTable;
+		friend class Iterator<!Const>;
+
+
+	public:
+
+		typedef std::forward_iterator_tag   iterator_category;
+		// sets only hand out const elements like std::unordered_set
+		typedef typename std::conditional<std::is_same<Slot, K>::value, const Slot, Value>::type  Element;
+		typedef Slot                        value_type;
+		typedef ptrdiff_t                   difference_type;
+		typedef Element                     *pointer;
+		typedef Element                     &reference;
+
+
+		Iterator()
+		: ctrl(nullptr)
+		, slot(nullptr)
+		{
+		}
+
+		// iterator to const_iterator
+		template <bool C, typename = typename std::enable_if<Const && !C>::type>
+		Iterator(const Iterator<C> &other)
+		: ctrl(other.ctrl)
+		, slot(other.slot)
+		{
+		}
+
+		reference operator*() const {
+			assert(*ctrl >= 0);
+			return *slot;
+		}
+
+		pointer operator->() const {
+			assert(*ctrl >= 0);
+			return slot;
+		}
+
+		Iterator &operator++() {
+			assert(*ctrl >= 0);
+			ctrl++;
+			slot++;
+			skipEmptyOrDeleted();
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			Iterator temp = *this;
+			++*this;
+			return temp;
+		}
+
+		template <bool C>
+		bool operator==(const Iterator<C> &other) const {
+			return ctrl == other.ctrl;
+		}
+
+		template <bool C>
+		bool operator!=(const Iterator<C> &other) const {
+			return ctrl != other.ctrl;
+		}
+	};
+
+
+public:
+
+	typedef Iterator<false>  iterator;
+	typedef Iterator<true>   const_iterator;
+
+
+private:
+
+	ctrl_t       *ctrl;
+	value_type   *slots;
+	size_t        capacity;
+	size_t        numElements;
+	// inserts left before a rehash, deleted slots count as used
+	size_t        growthLeft;
+	Hash          hashFunc;
+	Eq            eqFunc;
+
+
+	size_t hashOf(const K &k) const {
+		return mixHash(hashFunc(k));
+	}
+
+	void setCtrl(size_t i, ctrl_t c) {
+		assert(i < capacity);
+		ctrl[i] = c;
+		ctrl[((i - numClonedBytes) & capacity) + (numClonedBytes & capacity)] = c;
+	}
+
+	// slots first so they get operator new's alignment, control bytes after
+	static size_t ctrlOffset(size_t cap) {
+		return cap * sizeof(value_type);
+	}
+
+	void allocate(size_t cap) {
+		assert(((cap + 1) & cap) == 0);
+		assert(alignof(value_type) <= alignof(std::max_align_t));
+		char *mem  = static_cast<char *>(::operator new(ctrlOffset(cap) + cap + 1 + numClonedBytes));
+		slots      = reinterpret_cast<value_type *>(mem);
+		ctrl       = reinterpret_cast<ctrl_t *>(mem + ctrlOffset(cap));
+		capacity   = cap;
+		resetCtrl();
+	}
+
+	void resetCtrl() {
+		memset(ctrl, ctrlEmpty, capacity + 1 + numClonedBytes);
+		ctrl[capacity] = ctrlSentinel;
+		growthLeft     = maxLoad(capacity) - numElements;
+	}
+
+	void deallocate() {
+		if (capacity != 0) {
+			::operator delete(slots);
+		}
+		ctrl       = emptyGroup();
+		slots      = nullptr;
+		capacity   = 0;
+		growthLeft = 0;
+	}
+
+	void destroyAll() {
+		if (!std::is_trivially_destructible<value_type>::value) {
+			for (size_t i = 0; i < capacity; i++) {
+				if (ctrl[i] >= 0) {
+					slots[i].~value_type();
+				}
+			}
+		}
+	}
+
+	// probe for key, returns capacity if not found
+	size_t findIndex(const K &k, size_t hash) const {
+		size_t offset = h1(hash) & capacity;
+		size_t step   = 0;
+		ctrl_t tag    = h2(hash);
+		while (true) {
+			Group g(ctrl + offset);
+			uint32_t mask = g.match(tag);
+			while (mask) {
+				size_t i = (offset + lowestBit(mask)) & capacity;
+				if (eqFunc(Policy::key(slots[i]), k)) {
+					return i;
+				}
+				mask &= mask - 1;
+			}
+			if (g.matchEmpty()) {
+				return capacity;
+			}
+			step   += groupWidth;
+			assert(step <= capacity + groupWidth);
+			offset  = (offset + step) & capacity;
+		}
+	}
+
+	size_t findFirstNonFull(size_t hash) const {
+		size_t offset = h1(hash) & capacity;
+		size_t step   = 0;
+		while (true) {
+			uint32_t mask = Group(ctrl + offset).matchEmptyOrDeleted();
+			if (mask) {
+				return (offset + lowestBit(mask)) & capacity;
+			}
+			step   += groupWidth;
+			assert(step <= capacity + groupWidth);
+			offset  = (offset + step) & capacity;
+		}
+	}
+
+	void resize(size_t newCapacity) {
+		ctrl_t     *oldCtrl     = ctrl;
+		value_type *oldSlots    = slots;
+		size_t      oldCapacity = capacity;
+
+		allocate(newCapacity);
+		for (size_t i = 0; i < oldCapacity; i++) {
+			if (oldCtrl[i] >= 0) {
+				size_t hash = hashOf(Policy::key(oldSlots[i]));
+				size_t dst  = findFirstNonFull(hash);
+				setCtrl(dst, h2(hash));
+				Policy::construct(slots + dst, std::move(oldSlots[i]));
+				oldSlots[i].~value_type();
+			}
+		}
+
+		if (oldCapacity != 0) {
+			::operator delete(oldSlots);
+		}
+	}
+
+	// make room for one more element, returns the slot for it
+	size_t prepareInsert(size_t hash) {
+		size_t target = findFirstNonFull(hash);
+		if (growthLeft == 0 && ctrl[target] != ctrlDeleted) {
+			if (capacity == 0) {
+				resize(7);
+			} else if (numElements <= maxLoad(capacity) / 2) {
+				// mostly tombstones, clean up without growing
+				resize(capacity);
+			} else {
+				resize(capacity * 2 + 1);
+			}
+			target = findFirstNonFull(hash);
+		}
+		return target;
+	}
+
+	// after the element has been constructed in the slot
+	void commitInsert(size_t i, size_t hash) {
+		if (ctrl[i] == ctrlEmpty) {
+			assert(growthLeft > 0);
+			growthLeft--;
+		}
+		setCtrl(i, h2(hash));
+		numElements++;
+	}
+
+	iterator iteratorAt(size_t i) {
+		return iterator(ctrl + i, slots + i);
+	}
+
+	const_iterator iteratorAt(size_t i) const {
+		return const_iterator(ctrl + i, slots + i);
+	}
+
+	template <typename V>
+	std::pair<iterator, bool> insertValue(V &&v) {
+		const K &k  = Policy::key(v);
+		size_t hash = hashOf(k);
+		size_t i    = findIndex(k, hash);
+		if (i != capacity) {
+			return std::make_pair(iteratorAt(i), false);
+		}
+
+		i = prepareInsert(hash);
+		Policy::construct(slots + i, std::forward<V>(v));
+		commitInsert(i, hash);
+		return std::make_pair(iteratorAt(i), true);
+	}
+
+	template <typename KArg>
+	size_t findOrInsertKey(KArg &&k) {
+		size_t hash = hashOf(k);
+		size_t i    = findIndex(k, hash);
+		if (i != capacity) {
+			return i;
+		}
+
+		i = prepareInsert(hash);
+		Policy::constructKey(slots + i, std::forward<KArg>(k));
+		commitInsert(i, hash);
+		return i;
+	}
+
+
+public:
+
+	FlatHashTable()
+	: ctrl(emptyGroup())
+	, slots(nullptr)
+	, capacity(0)
+	, numElements(0)
+	, growthLeft(0)
+	{
+	}
+
+	FlatHashTable(std::initializer_list<value_type> init)
+	: FlatHashTable()
+	{
+		insert(init);
+	}
+
+	FlatHashTable(const FlatHashTable &other)
+	: FlatHashTable()
+	{
+		reserve(other.size());
+		for (const auto &v : other) {
+			size_t hash = hashOf(Policy::key(v));
+			size_t i    = prepareInsert(hash);
+			new (slots + i) value_type(v);
+			commitInsert(i, hash);
+		}
+	}
+
+	FlatHashTable(FlatHashTable &&other) noexcept
+	: ctrl(other.ctrl)
+	, slots(other.slots)
+	, capacity(other.capacity)
+	, numElements(other.numElements)
+	, growthLeft(other.growthLeft)
+	, hashFunc(std::move(other.hashFunc))
+	, eqFunc(std::move(other.eqFunc))
+	{
+		other.ctrl        = emptyGroup();
+		other.slots       = nullptr;
+		other.capacity    = 0;
+		other.numElements = 0;
+		other.growthLeft  = 0;
+	}
+
+	FlatHashTable &operator=(const FlatHashTable &other) {
+		if (this != &other) {
+			FlatHashTable temp(other);
+			swap(temp);
+		}
+		return *this;
+	}
+
+	FlatHashTable &operator=(FlatHashTable &&other) noexcept {
+		if (this != &other) {
+			destroyAll();
+			deallocate();
+			numElements = 0;
+			swap(other);
+		}
+		return *this;
+	}
+
+	FlatHashTable &operator=(std::initializer_list<value_type> init) {
+		clear();
+		insert(init);
+		return *this;
+	}
+
+	~FlatHashTable() {
+		destroyAll();
+		deallocate();
+	}
+
+	void swap(FlatHashTable &other) noexcept {
+		std::swap(ctrl,        other.ctrl);
+		std::swap(slots,       other.slots);
+		std::swap(capacity,    other.capacity);
+		std::swap(numElements, other.numElements);
+		std::swap(growthLeft,  other.growthLeft);
+		std::swap(hashFunc,    other.hashFunc);
+		std::swap(eqFunc,      other.eqFunc);
+	}
+
+	iterator begin() {
+		iterator it(ctrl, slots);
+		it.skipEmptyOrDeleted();
+		return it;
+	}
+
+	iterator end() {
+		return iteratorAt(capacity);
+	}
+
+	const_iterator begin() const {
+		const_iterator it(ctrl, slots);
+		it.skipEmptyOrDeleted();
+		return it;
+	}
+
+	const_iterator end() const {
+		return iteratorAt(capacity);
+	}
+
+	const_iterator cbegin() const {
+		return begin();
+	}
+
+	const_iterator cend() const {
+		return end();
+	}
+
+	bool empty() const {
+		return numElements == 0;
+	}
+
+	size_t size() const {
+		return numElements;
+	}
+
+	// keeps the allocation
+	void clear() {
+		destroyAll();
+		numElements = 0;
+		if (capacity != 0) {
+			resetCtrl();
+		}
+	}
+
+	void reserve(size_t count) {
+		if (count <= numElements + growthLeft) {
+			return;
+		}
+
+		size_t newCapacity = 7;
+		while (maxLoad(newCapacity) < count) {
+			newCapacity = newCapacity * 2 + 1;
+		}
+		resize(newCapacity);
+	}
+
+	iterator find(const K &k) {
+		return iteratorAt(findIndex(k, hashOf(k)));
+	}
+
+	const_iterator find(const K &k) const {
+		return iteratorAt(findIndex(k, hashOf(k)));
+	}
+
+	size_t count(const K &k) const {
+		return (findIndex(k, hashOf(k)) != capacity) ? 1 : 0;
+	}
+
+	std::pair<iterator, bool> insert(const value_type &v) {
+		return insertValue(v);
+	}
+
+	std::pair<iterator, bool> insert(value_type &&v) {
+		return insertValue(std::move(v));
+	}
+
+	template <typename It>
+	void insert(It first, It last) {
+		for (; first != last; ++first) {
+			insert(*first);
+		}
+	}
+
+	void insert(std::initializer_list<value_type> init) {
+		insert(init.begin(), init.end());
+	}
+
+	template <typename... Args>
+	std::pair<iterator, bool> emplace(Args &&... args) {
+		// need the key before knowing where the element goes
+		return insertValue(value_type(std::forward<Args>(args)...));
+	}
+
+	iterator erase(const_iterator pos) {
+		assert(pos.ctrl >= ctrl && pos.ctrl < ctrl + capacity);
+		assert(*pos.ctrl >= 0);
+
+		size_t i = static_cast<size_t>(pos.ctrl - ctrl);
+		slots[i].~value_type();
+		setCtrl(i, ctrlDeleted);
+		numElements--;
+
+		iterator next = iteratorAt(i);
+		next.skipEmptyOrDeleted();
+		return next;
+	}
+
+	iterator erase(iterator pos) {
+		return erase(const_iterator(pos));
+	}
+
+	size_t erase(const K &k) {
+		size_t i = findIndex(k, hashOf(k));
+		if (i == capacity) {
+			return 0;
+		}
+		erase(const_iterator(iteratorAt(i)));
+		return 1;
+	}
+
+	bool operator==(const FlatHashTable &other) const {
+		if (numElements != other.numElements) {
+			return false;
+		}
+		for (const auto &v : *this) {
+			auto it = other.find(Policy::key(v));
+			if (it == other.end() || !(*it == v)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool operator!=(const FlatHashTable &other) const {
+		return !(*this == other);
+	}
+
+
+protected:
+
+	template <typename KArg>
+	value_type &findOrInsert(KArg &&k) {
+		// inserting can reallocate slots
+		size_t i = findOrInsertKey(std::forward<KArg>(k));
+		return slots[i];
+	}
+};
+
+
+}  // namespace hashdetail
+
+
+// SwissTable style, see hashdetail::FlatHashTable for the differences to std
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K> >
+class FlatHashMap : public hashdetail::FlatHashTable<K, hashdetail::MapPolicy<K, V>, Hash, Eq> {
+	typedef hashdetail::FlatHashTable<K, hashdetail::MapPolicy<K, V>, Hash, Eq>  Base;
+
+
+public:
+
+	typedef V  mapped_type;
+
+
+	using Base::Base;
+	using Base::operator=;
+
+	V &operator[](const K &k) {
+		return this->findOrInsert(k).second;
+	}
+
+	V &operator[](K &&k) {
+		return this->findOrInsert(std::move(k)).second;
+	}
+
+	V &at(const K &k) {
+		auto it = this->find(k);
+		if (it == this->end()) {
+			throw std::out_of_range("FlatHashMap::at");
+		}
+		return it->second;
+	}
+
+	const V &at(const K &k) const {
+		auto it = this->find(k);
+		if (it == this->end()) {
+			throw std::out_of_range("FlatHashMap::at");
+		}
+		return it->second;
+	}
+
+	// pair-like arguments, for example insert(std::make_pair(k, v))
+	template <typename P, typename = typename std::enable_if<std::is_constructible<typename Base::value_type, P &&>::value>::type>
+	std::pair<typename Base::iterator, bool> insert(P &&p) {
+		return this->emplace(std::forward<P>(p));
+	}
+
+	using Base::insert;
+};
+
+
+template <typename K, typename Hash = std::hash<K>, typename Eq = std::equal_to<K> >
+class FlatHashSet : public hashdetail::FlatHashTable<K, hashdetail::SetPolicy<K>, Hash, Eq> {
+	typedef hashdetail::FlatHashTable<K, hashdetail::SetPolicy<K>, Hash, Eq>  Base;
+
+
+public:
+
+	using Base::Base;
+	using Base::operator=;
+};
+
+
+template <typename K, typename V>
+	using HashMap = FlatHashMap<K, V>;
+
+
+template <typename T>
+	using HashSet = FlatHashSet<T>;
 
 
+// per-frame containers, see FrameArena
 template <typename K, typename V>
-	using HashMap = std::unordered_map<K, V>;
+	using ArenaHashMap = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, ArenaAllocator<std::pair<const K, V> > >;
 
 
 template <typename T>
-	using HashSet = std::unordered_set<T>;
+	using ArenaHashSet = std::unordered_set<T, std::hash<T>, std::equal_to<T>, ArenaAllocator<T> >;
 
 
 
@@ -0,0 +1,329 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+
+#include <cassert>
+
+#include <algorithm>
+
+#include "utils/JobSystem.h"
+#include "utils/Profiler.h"
+#include "utils/ThreadPlacement.h"
+
+
+// which worker the current thread is, if any
+static thread_local JobSystem   *currentSystem = nullptr;
+static thread_local unsigned int currentWorker = 0;
+
+
+JobSystem::JobSystem(unsigned int numThreads_, unsigned int numBackgroundThreads_)
+: queued(0)
+, stop(false)
+, backgroundStop(false)
+{
+	if (numThreads_ == 0) {
+		// leave one core for the main thread
+		numThreads_ = std::max(2U, numCores(CoreClass::Performance)) - 1;
+	}
+
+	if (numBackgroundThreads_ == 0 && isHybridCPU()) {
+		numBackgroundThreads_ = numCores(CoreClass::Efficiency);
+	}
+
+	workers.reserve(numThreads_ + 1);
+	for (unsigned int i = 0; i < numThreads_ + 1; i++) {
+		workers.emplace_back(std::make_unique<Worker>());
+	}
+
+	threads.reserve(numThreads_);
+	for (unsigned int i = 0; i < numThreads_; i++) {
+		threads.emplace_back(&JobSystem::threadFunc, this, i);
+	}
+
+	backgroundThreads.reserve(numBackgroundThreads_);
+	for (unsigned int i = 0; i < numBackgroundThreads_; i++) {
+		backgroundThreads.emplace_back(&JobSystem::backgroundThreadFunc, this, i);
+	}
+}
+
+
+JobSystem::~JobSystem() {
+	// background jobs can queue continuations on the workers so they stop first
+	{
+		std::unique_lock<std::mutex> lock(backgroundMutex);
+		backgroundStop = true;
+	}
+	backgroundCV.notify_all();
+
+	for (auto &t : backgroundThreads) {
+		t.join();
+	}
+	backgroundThreads.clear();
+
+	{
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	sleepCV.notify_all();
+
+	for (auto &t : threads) {
+		t.join();
+	}
+	threads.clear();
+
+	assert(queued.load() == 0);
+
+	// queued by the last worker jobs, nothing left to run them
+	while (!backgroundJobs.empty()) {
+		Job job = std::move(backgroundJobs.front());
+		backgroundJobs.pop_front();
+		job();
+	}
+}
+
+
+void JobSystem::threadFunc(unsigned int index) {
+	currentSystem = this;
+	currentWorker = index;
+	profilerSetThreadName("worker " + std::to_string(index));
+	placeCurrentThread(CoreClass::Performance);
+
+	while (true) {
+		if (tryRun(index)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCV.wait(lock, [this] () { return stop || queued.load() != 0; });
+		// queued jobs are finished before stopping
+		if (stop && queued.load() == 0) {
+			return;
+		}
+	}
+}
+
+
+void JobSystem::backgroundThreadFunc(unsigned int index) {
+	// not a worker, anything these run goes to the extra deque
+	profilerSetThreadName("background " + std::to_string(index));
+	placeCurrentThread(CoreClass::Efficiency);
+
+	std::unique_lock<std::mutex> lock(backgroundMutex);
+	while (true) {
+		backgroundCV.wait(lock, [this] () { return backgroundStop || !backgroundJobs.empty(); });
+		// queued jobs are finished before stopping
+		if (backgroundJobs.empty()) {
+			assert(backgroundStop);
+			return;
+		}
+
+		Job job = std::move(backgroundJobs.front());
+		backgroundJobs.pop_front();
+
+		lock.unlock();
+		job();
+		lock.lock();
+	}
+}
+
+
+void JobSystem::push(Job &&job) {
+	// from outside the workers goes to the extra deque
+	unsigned int index = (currentSystem == this) ? currentWorker : static_cast<unsigned int>(workers.size() - 1);
+	{
+		auto &w = *workers[index];
+		std::unique_lock<std::mutex> lock(w.mutex);
+		w.jobs.emplace_back(std::move(job));
+		queued.fetch_add(1);
+	}
+
+	// lock so the wakeup can't happen between a sleeper's check and wait
+	{
+		std::unique_lock<std::mutex> lock(sleepMutex);
+	}
+	sleepCV.notify_one();
+}
+
+
+bool JobSystem::tryRun(unsigned int index) {
+	Job job;
+
+	{
+		// newest first, its data is most likely still in cache
+		auto &w = *workers[index];
+		std::unique_lock<std::mutex> lock(w.mutex);
+		if (!w.jobs.empty()) {
+			job = std::move(w.jobs.back());
+			w.jobs.pop_back();
+			queued.fetch_sub(1);
+		}
+	}
+
+	for (unsigned int i = 1; !job && i < workers.size(); i++) {
+		// oldest first, likely the biggest piece of work left
+		auto &w = *workers[(index + i) % workers.size()];
+		std::unique_lock<std::mutex> lock(w.mutex);
+		if (!w.jobs.empty()) {
+			job = std::move(w.jobs.front());
+			w.jobs.pop_front();
+			queued.fetch_sub(1);
+		}
+	}
+
+	if (!job) {
+		return false;
+	}
+
+	job();
+	return true;
+}
+
+
+void JobSystem::finish(JobCounter *counter) {
+	if (!counter) {
+		return;
+	}
+
+	std::vector<Job> continuations;
+	{
+		// wait locks this too so the counter isn't destroyed while we hold it
+		std::unique_lock<std::mutex> lock(counter->mutex);
+		if (counter->pending.fetch_sub(1) != 1) {
+			return;
+		}
+		std::swap(continuations, counter->continuations);
+	}
+
+	for (auto &c : continuations) {
+		push(std::move(c));
+	}
+
+	// threads in wait might be sleeping on it
+	{
+		std::unique_lock<std::mutex> lock(sleepMutex);
+	}
+	sleepCV.notify_all();
+}
+
+
+void JobSystem::run(JobCounter *counter, Job job) {
+	assert(job);
+
+	if (counter) {
+		counter->pending.fetch_add(1);
+	}
+
+	push([this, counter, job] () {
+		job();
+		finish(counter);
+	} );
+}
+
+
+void JobSystem::runBackground(JobCounter *counter, Job job) {
+	assert(job);
+
+	if (backgroundThreads.empty()) {
+		run(counter, std::move(job));
+		return;
+	}
+
+	if (counter) {
+		counter->pending.fetch_add(1);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(backgroundMutex);
+		backgroundJobs.emplace_back([this, counter, job] () {
+			job();
+			finish(counter);
+		} );
+	}
+	backgroundCV.notify_one();
+}
+
+
+void JobSystem::then(JobCounter &dependency, JobCounter *counter, Job job) {
+	assert(job);
+
+	if (counter) {
+		counter->pending.fetch_add(1);
+	}
+
+	Job wrapped = [this, counter, job] () {
+		job();
+		finish(counter);
+	};
+
+	{
+		std::unique_lock<std::mutex> lock(dependency.mutex);
+		if (dependency.pending.load() != 0) {
+			dependency.continuations.emplace_back(std::move(wrapped));
+			return;
+		}
+	}
+
+	push(std::move(wrapped));
+}
+
+
+void JobSystem::wait(JobCounter &counter) {
+	unsigned int index = (currentSystem == this) ? currentWorker : static_cast<unsigned int>(workers.size() - 1);
+
+	while (!counter.done()) {
+		if (tryRun(index)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCV.wait(lock, [this, &counter] () { return queued.load() != 0 || counter.done(); });
+	}
+
+	// the last finish might still be holding it
+	std::unique_lock<std::mutex> lock(counter.mutex);
+}
+
+
+void JobSystem::parallelFor(unsigned int count, unsigned int minSliceSize, const std::function<void(unsigned int, unsigned int)> &fn) {
+	assert(minSliceSize > 0);
+
+	unsigned int numSlices = numThreads() + 1;
+	numSlices              = std::min(numSlices, (count + minSliceSize - 1) / minSliceSize);
+	if (numSlices <= 1) {
+		fn(0, count);
+		return;
+	}
+
+	const unsigned int sliceSize = (count + numSlices - 1) / numSlices;
+	JobCounter counter;
+	for (unsigned int begin = sliceSize; begin < count; begin += sliceSize) {
+		unsigned int end = std::min(count, begin + sliceSize);
+		run(&counter, [&fn, begin, end] () {
+			fn(begin, end);
+		} );
+	}
+
+	fn(0, sliceSize);
+
+	wait(counter);
+}
@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+typedef std::function<void()>  Job;
+
+
+// number of unfinished jobs started with it
+// jobs added with JobSystem::then run when it drops to zero
+class JobCounter {
+	std::atomic<unsigned int>  pending;
+	// protects continuations
+	std::mutex                 mutex;
+	std::vector<Job>           continuations;
+
+	friend class JobSystem;
+
+
+public:
+
+	JobCounter()
+	: pending(0)
+	{
+	}
+
+	JobCounter(const JobCounter &)                = delete;
+	JobCounter &operator=(const JobCounter &)     = delete;
+	JobCounter(JobCounter &&)                     = delete;
+	JobCounter &operator=(JobCounter &&)          = delete;
+
+	~JobCounter() {}
+
+	bool done() const {
+		return pending.load() == 0;
+	}
+};
+
+
+// fixed number of worker threads, each with its own deque
+// a worker takes its newest job first and steals the oldest from others when out of work
+// jobs must not throw, use std::packaged_task to get exceptions to the caller
+// on hybrid CPUs workers are placed on performance cores and background jobs
+// get their own threads on efficiency cores so they can't delay per-frame work
+class JobSystem {
+	struct Worker {
+		// protects jobs, only held for a push or a pop
+		std::mutex        mutex;
+		std::deque<Job>   jobs;
+	};
+
+	std::vector<std::thread>               threads;
+	// one per thread plus one for jobs added from outside the workers
+	std::vector<std::unique_ptr<Worker> >  workers;
+
+	// jobs in all deques, sleepers wake up when it becomes non-zero
+	std::atomic<unsigned int>              queued;
+	// protects stop, sleepers also wait on it for counters
+	std::mutex                             sleepMutex;
+	std::condition_variable                sleepCV;
+	bool                                   stop;
+
+	// runBackground jobs in order, empty if they share the workers
+	std::vector<std::thread>               backgroundThreads;
+	// protects backgroundJobs and backgroundStop
+	std::mutex                             backgroundMutex;
+	std::condition_variable                backgroundCV;
+	std::deque<Job>                        backgroundJobs;
+	bool                                   backgroundStop;
+
+
+	void threadFunc(unsigned int index);
+	void backgroundThreadFunc(unsigned int index);
+	void push(Job &&job);
+	// own deque from the back, others from the front
+	bool tryRun(unsigned int index);
+	void finish(JobCounter *counter);
+
+
+public:
+
+	// numThreads 0 for one less than the number of performance cores
+	// numBackgroundThreads 0 for one per efficiency core, none if the CPU isn't hybrid
+	explicit JobSystem(unsigned int numThreads = 0, unsigned int numBackgroundThreads = 0);
+
+	JobSystem(const JobSystem &)                = delete;
+	JobSystem &operator=(const JobSystem &)     = delete;
+	JobSystem(JobSystem &&)                     = delete;
+	JobSystem &operator=(JobSystem &&)          = delete;
+
+	// waits for queued jobs to finish
+	~JobSystem();
+
+	unsigned int numThreads() const {
+		return static_cast<unsigned int>(threads.size());
+	}
+
+	unsigned int numBackgroundThreads() const {
+		return static_cast<unsigned int>(backgroundThreads.size());
+	}
+
+	// counter can be null
+	void run(JobCounter *counter, Job job);
+
+	// for work nobody waits on within a frame like shader compilation and image decoding
+	// wait doesn't run these so the calling thread doesn't get stuck in a long one
+	void runBackground(JobCounter *counter, Job job);
+
+	// runs job once dependency has no pending jobs, immediately if it already has none
+	void then(JobCounter &dependency, JobCounter *counter, Job job);
+
+	// runs other jobs on the calling thread until counter is done
+	void wait(JobCounter &counter);
+
+	// splits [0, count) into slices of at least minSliceSize
+	// and runs fn(begin, end) for them, one on the calling thread
+	void parallelFor(unsigned int count, unsigned int minSliceSize, const std::function<void(unsigned int, unsigned int)> &fn);
+};
+
+
+#endif  // JOBSYSTEM_H
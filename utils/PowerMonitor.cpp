@@ -0,0 +1,336 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <dirent.h>
+#endif  // __linux__
+
+#include "utils/PowerMonitor.h"
+#include "utils/Utils.h"
+
+
+// sysfs reads take tens of microseconds, don't do them every frame
+static const uint64_t powerSampleInterval = 50 * 1000000ULL;
+
+
+static uint64_t nanoseconds() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+static bool readValue(const std::string &path, uint64_t &value) {
+	FILE *f = fopen(path.c_str(), "r");
+	if (!f) {
+		return false;
+	}
+
+	bool ok = (fscanf(f, "%" SCNu64, &value) == 1);
+	fclose(f);
+	return ok;
+}
+
+
+#ifdef __linux__
+
+
+static std::vector<std::string> listDirectory(const std::string &path, const char *prefix) {
+	std::vector<std::string> result;
+
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		return result;
+	}
+
+	size_t prefixLength = strlen(prefix);
+	while (struct dirent *entry = readdir(dir)) {
+		if (strncmp(entry->d_name, prefix, prefixLength) == 0) {
+			result.emplace_back(entry->d_name);
+		}
+	}
+	closedir(dir);
+
+	return result;
+}
+
+
+#endif  // __linux__
+
+
+PowerMonitor::PowerMonitor()
+: gpuClockScale(1.0)
+, gpuTemperatureCritical(0.0f)
+, throttleCountStart(0)
+, lastSampleTime(0)
+, gpuPowerEnergy(0.0)
+, gpuClockTotal(0.0)
+, gpuClockSamples(0)
+, active(false)
+{
+	gpuCounter.range = 0;
+	gpuCounter.last  = 0;
+	gpuCounter.total = 0;
+
+#ifdef __linux__
+
+	// only packages, intel-rapl:0:0 and such are included in them
+	// newer kernels only let root read energy_uj
+	for (const auto &name : listDirectory("/sys/class/powercap", "intel-rapl:")) {
+		if (name.find(':', strlen("intel-rapl:")) != std::string::npos) {
+			continue;
+		}
+
+		std::string dir = "/sys/class/powercap/" + name + "/";
+		EnergyCounter c;
+		c.path  = dir + "energy_uj";
+		c.total = 0;
+		if (readValue(c.path, c.last) && readValue(dir + "max_energy_range_uj", c.range)) {
+			LOG("CPU energy from %s\n", c.path.c_str());
+			cpuCounters.push_back(c);
+		} else {
+			LOG("CPU energy counter %s not readable\n", c.path.c_str());
+		}
+	}
+
+	// the first card with a power sensor, not necessarily the one the renderer uses
+	uint64_t value = 0;
+	for (const auto &card : listDirectory("/sys/class/drm", "card")) {
+		// connectors like card0-DP-1
+		if (card.find('-') != std::string::npos) {
+			continue;
+		}
+
+		std::string device = "/sys/class/drm/" + card + "/device/";
+		for (const auto &hwmon : listDirectory(device + "hwmon", "hwmon")) {
+			std::string dir = device + "hwmon/" + hwmon + "/";
+			if (readValue(dir + "energy1_input", value)) {
+				gpuEnergyPath = dir + "energy1_input";
+			} else if (readValue(dir + "power1_average", value)) {
+				gpuPowerPath  = dir + "power1_average";
+			}
+
+			if (readValue(dir + "freq1_input", value)) {
+				gpuClockPath  = dir + "freq1_input";
+				gpuClockScale = 1.0e-6;
+			}
+
+			if (readValue(dir + "temp1_input", value)) {
+				gpuTemperaturePath = dir + "temp1_input";
+				if (readValue(dir + "temp1_crit", value)) {
+					gpuTemperatureCritical = float(value) / 1000.0f;
+				}
+			}
+		}
+
+		// i915 has no clock in hwmon
+		if (gpuClockPath.empty() && readValue("/sys/class/drm/" + card + "/gt_act_freq_mhz", value)) {
+			gpuClockPath  = "/sys/class/drm/" + card + "/gt_act_freq_mhz";
+			gpuClockScale = 1.0;
+		}
+
+		if (!gpuEnergyPath.empty() || !gpuPowerPath.empty()) {
+			LOG("GPU power from %s\n", gpuEnergyPath.empty() ? gpuPowerPath.c_str() : gpuEnergyPath.c_str());
+			if (!gpuClockPath.empty()) {
+				LOG("GPU clock from %s\n", gpuClockPath.c_str());
+			}
+			if (!gpuTemperaturePath.empty()) {
+				LOG("GPU temperature from %s, critical %.1f C\n", gpuTemperaturePath.c_str(), gpuTemperatureCritical);
+			}
+			break;
+		}
+
+		gpuClockPath.clear();
+		gpuTemperaturePath.clear();
+		gpuTemperatureCritical = 0.0f;
+	}
+	gpuCounter.path = gpuEnergyPath;
+
+	// Intel only
+	for (const auto &cpu : listDirectory("/sys/devices/system/cpu", "cpu")) {
+		std::string dir = "/sys/devices/system/cpu/" + cpu + "/thermal_throttle/";
+		for (const char *counter : { "core_throttle_count", "package_throttle_count" }) {
+			if (readValue(dir + counter, value)) {
+				throttleCountPaths.push_back(dir + counter);
+			}
+		}
+	}
+
+#endif  // __linux__
+
+	if (!available()) {
+		LOG("No power or clock sensors found\n");
+	}
+}
+
+
+PowerMonitor::~PowerMonitor() {
+}
+
+
+bool PowerMonitor::available() const {
+	return !cpuCounters.empty() || !gpuEnergyPath.empty() || !gpuPowerPath.empty() || !gpuClockPath.empty() || !gpuTemperaturePath.empty();
+}
+
+
+void PowerMonitor::begin() {
+	report          = PowerReport();
+	gpuPowerEnergy  = 0.0;
+	gpuClockTotal   = 0.0;
+	gpuClockSamples = 0;
+
+	for (auto &c : cpuCounters) {
+		readValue(c.path, c.last);
+		c.total = 0;
+	}
+	if (!gpuCounter.path.empty()) {
+		readValue(gpuCounter.path, gpuCounter.last);
+		gpuCounter.total = 0;
+	}
+	throttleCountStart = throttleCount();
+
+	lastSampleTime  = nanoseconds();
+	active          = true;
+}
+
+
+void PowerMonitor::sample() {
+	if (!active) {
+		return;
+	}
+
+	uint64_t time = nanoseconds();
+	if (time - lastSampleTime < powerSampleInterval) {
+		return;
+	}
+
+	takeSample(time);
+}
+
+
+PowerReport PowerMonitor::end() {
+	if (!active) {
+		return PowerReport();
+	}
+
+	takeSample(nanoseconds());
+	active = false;
+
+	if (!cpuCounters.empty()) {
+		uint64_t total = 0;
+		for (const auto &c : cpuCounters) {
+			total += c.total;
+		}
+		report.cpuEnergy = double(total) * 1.0e-6;
+	}
+
+	if (!gpuEnergyPath.empty()) {
+		report.gpuEnergy = double(gpuCounter.total) * 1.0e-6;
+	} else if (!gpuPowerPath.empty()) {
+		report.gpuEnergy = gpuPowerEnergy;
+	}
+
+	if (gpuClockSamples > 0) {
+		report.gpuClockAverage = float(gpuClockTotal / gpuClockSamples);
+	}
+
+	if (throttleCount() > throttleCountStart) {
+		report.throttled = true;
+	}
+
+	return report;
+}
+
+
+void PowerMonitor::takeSample(uint64_t time) {
+	double seconds = double(time - lastSampleTime) * 1.0e-9;
+	lastSampleTime = time;
+
+	for (auto &c : cpuCounters) {
+		sampleCounter(c);
+	}
+
+	uint64_t value = 0;
+	if (!gpuEnergyPath.empty()) {
+		sampleCounter(gpuCounter);
+	} else if (!gpuPowerPath.empty() && readValue(gpuPowerPath, value)) {
+		// microwatts, averaged by the driver over roughly the sample interval
+		gpuPowerEnergy += double(value) * 1.0e-6 * seconds;
+	}
+
+	if (!gpuClockPath.empty() && readValue(gpuClockPath, value)) {
+		float mhz = float(double(value) * gpuClockScale);
+		if (gpuClockSamples == 0) {
+			report.gpuClockMin = mhz;
+			report.gpuClockMax = mhz;
+		} else {
+			report.gpuClockMin = std::min(report.gpuClockMin, mhz);
+			report.gpuClockMax = std::max(report.gpuClockMax, mhz);
+		}
+		gpuClockTotal += mhz;
+		gpuClockSamples++;
+	}
+
+	if (!gpuTemperaturePath.empty() && readValue(gpuTemperaturePath, value)) {
+		float celsius = float(value) / 1000.0f;
+		report.gpuTemperatureMax = std::max(report.gpuTemperatureMax, celsius);
+		if (gpuTemperatureCritical > 0.0f && celsius >= gpuTemperatureCritical) {
+			report.throttled = true;
+		}
+	}
+
+	report.samples++;
+}
+
+
+void PowerMonitor::sampleCounter(EnergyCounter &counter) {
+	uint64_t value = 0;
+	if (!readValue(counter.path, value)) {
+		return;
+	}
+
+	if (value >= counter.last) {
+		counter.total += value - counter.last;
+	} else if (counter.range > 0) {
+		counter.total += (counter.range - counter.last) + value;
+	}
+	counter.last = value;
+}
+
+
+uint64_t PowerMonitor::throttleCount() const {
+	uint64_t total = 0;
+	for (const auto &path : throttleCountPaths) {
+		uint64_t value = 0;
+		if (readValue(path, value)) {
+			total += value;
+		}
+	}
+	return total;
+}
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef POWERMONITOR_H
+#define POWERMONITOR_H
+
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+
+// what happened during one measurement window
+struct PowerReport {
+	// joules, negative when there is no source
+	double        cpuEnergy;
+	double        gpuEnergy;
+	// MHz, 0 when unknown
+	float         gpuClockAverage;
+	float         gpuClockMin;
+	float         gpuClockMax;
+	// degrees Celsius, 0 when unknown
+	float         gpuTemperatureMax;
+	// GPU reached its critical temperature or the CPU thermal throttle counters went up
+	bool          throttled;
+	unsigned int  samples;
+
+
+	PowerReport()
+	: cpuEnergy(-1.0)
+	, gpuEnergy(-1.0)
+	, gpuClockAverage(0.0f)
+	, gpuClockMin(0.0f)
+	, gpuClockMax(0.0f)
+	, gpuTemperatureMax(0.0f)
+	, throttled(false)
+	, samples(0)
+	{
+	}
+};
+
+
+// energy, clocks and temperatures from Linux sysfs
+// CPU package energy from RAPL powercap, GPU from the first DRM card with a power sensor
+// vendor libraries like NVML are not used so NVIDIA GPUs report nothing
+// other platforms report nothing
+class PowerMonitor {
+	struct EnergyCounter {
+		std::string  path;
+		// microjoules where the counter wraps
+		uint64_t     range;
+		uint64_t     last;
+		// microjoules since begin, including wraps
+		uint64_t     total;
+	};
+
+	std::vector<EnergyCounter>  cpuCounters;
+
+	// sysfs files, empty when missing
+	std::string                 gpuEnergyPath;
+	std::string                 gpuPowerPath;
+	std::string                 gpuClockPath;
+	// Hz in amdgpu hwmon, MHz in i915
+	double                      gpuClockScale;
+	std::string                 gpuTemperaturePath;
+	float                       gpuTemperatureCritical;
+	EnergyCounter               gpuCounter;
+
+	std::vector<std::string>    throttleCountPaths;
+	uint64_t                    throttleCountStart;
+
+	// steady_clock nanoseconds
+	uint64_t                    lastSampleTime;
+	// integrated from average power without an energy counter
+	double                      gpuPowerEnergy;
+	double                      gpuClockTotal;
+	unsigned int                gpuClockSamples;
+	PowerReport                 report;
+	bool                        active;
+
+
+	void takeSample(uint64_t time);
+	void sampleCounter(EnergyCounter &counter);
+	uint64_t throttleCount() const;
+
+
+public:
+
+	// finds the sources and logs them
+	PowerMonitor();
+
+	PowerMonitor(const PowerMonitor &)                = delete;
+	PowerMonitor(PowerMonitor &&) noexcept            = delete;
+
+	PowerMonitor &operator=(const PowerMonitor &)     = delete;
+	PowerMonitor &operator=(PowerMonitor &&) noexcept = delete;
+
+	~PowerMonitor();
+
+	bool available() const;
+
+	// starts a measurement window, discards the previous one
+	void begin();
+
+	// call often during the window, at least every few seconds so average power stays accurate
+	// cheap when called more often than samples are taken
+	void sample();
+
+	PowerReport end();
+};
+
+
+#endif  // POWERMONITOR_H
@@ -0,0 +1,268 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifdef CPU_PROFILER
+
+
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "utils/Profiler.h"
+#include "utils/Utils.h"
+
+
+// zones per thread, older ones are overwritten
+static const unsigned int profilerBufferSize = 65536;
+// a few dozen timers per frame
+static const unsigned int profilerGPUBufferSize = 16384;
+
+
+std::atomic<bool> profilerActive(false);
+
+
+namespace {
+
+
+struct ProfileEvent {
+	const char  *name;
+	uint64_t     begin;
+	uint64_t     end;
+};
+
+
+struct ThreadBuffer {
+	// only contended while a trace is written
+	std::mutex                 mutex;
+	std::vector<ProfileEvent>  events;
+	// where the next event goes, also the oldest one once wrapped
+	unsigned int               next;
+	bool                       wrapped;
+	unsigned int               threadId;
+	std::string                name;
+
+
+	explicit ThreadBuffer(unsigned int threadId_)
+	: next(0)
+	, wrapped(false)
+	, threadId(threadId_)
+	{
+		events.resize(profilerBufferSize);
+	}
+};
+
+
+// buffers outlive their threads so zones of finished threads still get written
+std::mutex                                  buffersMutex;
+std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+thread_local ThreadBuffer                   *threadBuffer = nullptr;
+
+
+struct GPUEvent {
+	// assigned in place so names of the same length don't allocate again
+	std::string  name;
+	uint64_t     begin;
+	uint64_t     end;
+};
+
+
+std::mutex             gpuMutex;
+std::vector<GPUEvent>  gpuEvents;
+unsigned int           gpuNext    = 0;
+bool                   gpuWrapped = false;
+
+
+ThreadBuffer &getThreadBuffer() {
+	if (!threadBuffer) {
+		std::unique_lock<std::mutex> lock(buffersMutex);
+		buffers.emplace_back(new ThreadBuffer(static_cast<unsigned int>(buffers.size())));
+		threadBuffer = buffers.back().get();
+	}
+
+	return *threadBuffer;
+}
+
+
+void appendEscaped(std::string &out, const std::string &s) {
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			out.push_back('\\');
+		}
+		out.push_back(c);
+	}
+}
+
+
+}  // namespace
+
+
+uint64_t profilerTimestamp() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+void profilerRecord(const char *name, uint64_t begin, uint64_t end) {
+	ThreadBuffer &b = getThreadBuffer();
+
+	std::unique_lock<std::mutex> lock(b.mutex);
+	ProfileEvent &e = b.events[b.next];
+	e.name  = name;
+	e.begin = begin;
+	e.end   = end;
+	b.next++;
+	if (b.next == profilerBufferSize) {
+		b.next    = 0;
+		b.wrapped = true;
+	}
+}
+
+
+void profilerRecordGPU(const std::string &name, uint64_t begin, uint64_t end) {
+	if (!profilerActive.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(gpuMutex);
+	if (gpuEvents.empty()) {
+		gpuEvents.resize(profilerGPUBufferSize);
+	}
+
+	GPUEvent &e = gpuEvents[gpuNext];
+	e.name  = name;
+	e.begin = begin;
+	e.end   = end;
+	gpuNext++;
+	if (gpuNext == profilerGPUBufferSize) {
+		gpuNext    = 0;
+		gpuWrapped = true;
+	}
+}
+
+
+void profilerSetEnabled(bool enabled) {
+	profilerActive.store(enabled, std::memory_order_relaxed);
+}
+
+
+void profilerSetThreadName(const std::string &name) {
+	ThreadBuffer &b = getThreadBuffer();
+
+	std::unique_lock<std::mutex> lock(b.mutex);
+	b.name = name;
+}
+
+
+void profilerWriteChromeTrace(const std::string &filename) {
+	// copy everything out first so recording threads aren't held up by formatting
+	struct ThreadEvents {
+		unsigned int               threadId;
+		std::string                name;
+		std::vector<ProfileEvent>  events;
+	};
+	std::vector<ThreadEvents> threads;
+	uint64_t origin = UINT64_MAX;
+
+	{
+		std::unique_lock<std::mutex> buffersLock(buffersMutex);
+		threads.reserve(buffers.size());
+		for (const auto &ptr : buffers) {
+			ThreadBuffer &b = *ptr;
+			std::unique_lock<std::mutex> lock(b.mutex);
+
+			ThreadEvents t;
+			t.threadId = b.threadId;
+			t.name     = b.name.empty() ? ("thread " + std::to_string(b.threadId)) : b.name;
+			if (b.wrapped) {
+				t.events.assign(b.events.begin() + b.next, b.events.end());
+			}
+			t.events.insert(t.events.end(), b.events.begin(), b.events.begin() + b.next);
+			if (!t.events.empty()) {
+				origin = std::min(origin, t.events.front().begin);
+			}
+			threads.emplace_back(std::move(t));
+		}
+	}
+
+	std::vector<GPUEvent> gpu;
+	{
+		std::unique_lock<std::mutex> lock(gpuMutex);
+		if (gpuWrapped) {
+			gpu.assign(gpuEvents.begin() + gpuNext, gpuEvents.end());
+		}
+		gpu.insert(gpu.end(), gpuEvents.begin(), gpuEvents.begin() + gpuNext);
+	}
+	// GPU work can start before the oldest remaining CPU zone
+	for (const auto &e : gpu) {
+		origin = std::min(origin, e.begin);
+	}
+
+	// timestamps are microseconds relative to the oldest zone
+	std::string out;
+	out += "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	char buf[256];
+	bool first = true;
+	for (const auto &t : threads) {
+		if (t.events.empty()) {
+			continue;
+		}
+
+		snprintf(buf, sizeof(buf), "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"", first ? "" : ",\n", t.threadId);
+		out += buf;
+		appendEscaped(out, t.name);
+		out += "\"}}";
+		first = false;
+
+		for (const auto &e : t.events) {
+			out += ",\n{\"name\": \"";
+			appendEscaped(out, e.name);
+			snprintf(buf, sizeof(buf), "\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", t.threadId, double(e.begin - origin) / 1000.0, double(e.end - e.begin) / 1000.0);
+			out += buf;
+		}
+	}
+	if (!gpu.empty()) {
+		// after all the threads
+		unsigned int gpuId = static_cast<unsigned int>(threads.size());
+		snprintf(buf, sizeof(buf), "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"GPU\"}}", first ? "" : ",\n", gpuId);
+		out += buf;
+
+		for (const auto &e : gpu) {
+			out += ",\n{\"name\": \"";
+			appendEscaped(out, e.name);
+			snprintf(buf, sizeof(buf), "\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", gpuId, double(e.begin - origin) / 1000.0, double(e.end - e.begin) / 1000.0);
+			out += buf;
+		}
+	}
+	out += "\n]}\n";
+
+	writeFile(filename, out.data(), out.size());
+	LOG("Wrote CPU trace with %u threads to \"%s\"\n", static_cast<unsigned int>(threads.size()), filename.c_str());
+}
+
+
+#endif  // CPU_PROFILER
@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+
+#include <string>
+
+
+// scoped CPU zones recorded into per thread ring buffers
+// only compiled in with CPU_PROFILER, and then only recorded while enabled
+// zone names must be string literals or otherwise live until the trace is written
+
+#ifdef CPU_PROFILER
+
+
+#include <atomic>
+#include <cstdint>
+
+
+extern std::atomic<bool> profilerActive;
+
+
+uint64_t profilerTimestamp();
+
+void profilerRecord(const char *name, uint64_t begin, uint64_t end);
+
+
+class ProfileZone {
+	const char  *name;
+	// 0 when not recording
+	uint64_t     begin;
+
+
+public:
+
+	explicit ProfileZone(const char *name_)
+	: name(name_)
+	, begin(profilerActive.load(std::memory_order_relaxed) ? profilerTimestamp() : 0)
+	{
+	}
+
+	ProfileZone(const ProfileZone &)                = delete;
+	ProfileZone(ProfileZone &&) noexcept            = delete;
+
+	ProfileZone &operator=(const ProfileZone &)     = delete;
+	ProfileZone &operator=(ProfileZone &&) noexcept = delete;
+
+	~ProfileZone() {
+		if (begin != 0) {
+			profilerRecord(name, begin, profilerTimestamp());
+		}
+	}
+};
+
+
+#define PROFILE_CONCAT2(a, b) a ## b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name)    ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+
+void profilerSetEnabled(bool enabled);
+
+// shown instead of the thread number in the trace
+void profilerSetThreadName(const std::string &name);
+
+// GPU timer from the renderer, shown on its own track
+// begin and end must be on the zone clock, which RendererBase::now() also uses
+void profilerRecordGPU(const std::string &name, uint64_t begin, uint64_t end);
+
+// Chrome trace event JSON, also opened by Perfetto
+// recording continues, the ring buffers keep only the newest zones of each thread
+// throws std::runtime_error if the file can't be written
+void profilerWriteChromeTrace(const std::string &filename);
+
+
+#else  // CPU_PROFILER
+
+
+#define PROFILE_ZONE(name)  ((void) 0)
+
+
+static inline void profilerSetEnabled(bool /* enabled */) {
+}
+
+
+static inline void profilerSetThreadName(const std::string & /* name */) {
+}
+
+
+static inline void profilerRecordGPU(const std::string & /* name */, uint64_t /* begin */, uint64_t /* end */) {
+}
+
+
+static inline void profilerWriteChromeTrace(const std::string & /* filename */) {
+}
+
+
+#endif  // CPU_PROFILER
+
+
+#endif  // PROFILER_H
@@ -0,0 +1,304 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif  // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+
+#elif defined(__linux__)
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#endif  // _WIN32
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "utils/ThreadPlacement.h"
+#include "utils/Utils.h"
+
+
+namespace {
+
+
+struct CPUTopology {
+	// Linux logical processor numbers or Windows CPU set ids
+	std::vector<unsigned long>  performance;
+	std::vector<unsigned long>  efficiency;
+	// where the classes came from
+	const char                  *source;
+
+
+	CPUTopology()
+	: source(nullptr)
+	{
+	}
+
+	bool hybrid() const {
+		return !performance.empty() && !efficiency.empty();
+	}
+
+	const std::vector<unsigned long> &cores(CoreClass coreClass) const {
+		return (coreClass == CoreClass::Performance) ? performance : efficiency;
+	}
+};
+
+
+}  // namespace
+
+
+#ifdef _WIN32
+
+
+static void detectTopology(CPUTopology &topology) {
+	ULONG length = 0;
+	GetSystemCpuSetInformation(nullptr, 0, &length, GetCurrentProcess(), 0);
+	if (length == 0) {
+		return;
+	}
+
+	std::vector<uint8_t> buffer(length);
+	if (!GetSystemCpuSetInformation(reinterpret_cast<SYSTEM_CPU_SET_INFORMATION *>(buffer.data()), length, &length, GetCurrentProcess(), 0)) {
+		return;
+	}
+
+	// higher is faster, all zero on CPUs which aren't hybrid
+	BYTE maxClass = 0;
+	for (ULONG offset = 0; offset < length; ) {
+		const auto *info = reinterpret_cast<const SYSTEM_CPU_SET_INFORMATION *>(buffer.data() + offset);
+		if (info->Type == CpuSetInformation) {
+			maxClass = std::max(maxClass, info->CpuSet.EfficiencyClass);
+		}
+		offset += info->Size;
+	}
+
+	for (ULONG offset = 0; offset < length; ) {
+		const auto *info = reinterpret_cast<const SYSTEM_CPU_SET_INFORMATION *>(buffer.data() + offset);
+		if (info->Type == CpuSetInformation) {
+			if (info->CpuSet.EfficiencyClass == maxClass) {
+				topology.performance.push_back(info->CpuSet.Id);
+			} else {
+				topology.efficiency.push_back(info->CpuSet.Id);
+			}
+		}
+		offset += info->Size;
+	}
+
+	topology.source = "CPU set efficiency class";
+}
+
+
+#elif defined(__linux__)
+
+
+static bool readValue(const std::string &path, uint64_t &value) {
+	FILE *f = fopen(path.c_str(), "r");
+	if (!f) {
+		return false;
+	}
+
+	bool ok = (fscanf(f, "%" SCNu64, &value) == 1);
+	fclose(f);
+	return ok;
+}
+
+
+// sysfs CPU list like "0-15,20"
+static std::vector<unsigned long> readCPUList(const std::string &path) {
+	std::vector<unsigned long> result;
+
+	FILE *f = fopen(path.c_str(), "r");
+	if (!f) {
+		return result;
+	}
+
+	unsigned long first = 0;
+	while (fscanf(f, "%lu", &first) == 1) {
+		unsigned long last = first;
+		int c = fgetc(f);
+		if (c == '-') {
+			if (fscanf(f, "%lu", &last) != 1) {
+				break;
+			}
+			c = fgetc(f);
+		}
+
+		for (unsigned long i = first; i <= last; i++) {
+			result.push_back(i);
+		}
+
+		if (c != ',') {
+			break;
+		}
+	}
+	fclose(f);
+
+	return result;
+}
+
+
+static void detectTopology(CPUTopology &topology) {
+	// Intel hybrid CPUs have a separate PMU for each kind of core
+	topology.performance = readCPUList("/sys/devices/cpu_core/cpus");
+	topology.efficiency  = readCPUList("/sys/devices/cpu_atom/cpus");
+	if (topology.hybrid()) {
+		topology.source = "cpu_core and cpu_atom PMUs";
+		return;
+	}
+	topology.performance.clear();
+	topology.efficiency.clear();
+
+	long numCPUs = sysconf(_SC_NPROCESSORS_CONF);
+	if (numCPUs <= 0) {
+		return;
+	}
+
+	// ARM kernels publish the scheduler's idea of relative speed, elsewhere use maximum clock
+	for (const char *file : { "cpu_capacity", "cpufreq/cpuinfo_max_freq" }) {
+		std::vector<uint64_t> values(numCPUs, 0);
+		bool ok = true;
+		for (long i = 0; ok && i < numCPUs; i++) {
+			ok = readValue("/sys/devices/system/cpu/cpu" + std::to_string(i) + "/" + file, values[i]);
+		}
+
+		uint64_t maxValue = *std::max_element(values.begin(), values.end());
+		if (!ok || maxValue == 0) {
+			continue;
+		}
+
+		// Turbo Boost Max favored cores clock a bit above the other P-cores
+		// and mid cores of three cluster ARM CPUs are nearly as fast as big ones
+		// so only count cores well below the fastest as efficiency cores
+		for (long i = 0; i < numCPUs; i++) {
+			if (values[i] * 5 >= maxValue * 4) {
+				topology.performance.push_back(i);
+			} else {
+				topology.efficiency.push_back(i);
+			}
+		}
+		topology.source = file;
+		return;
+	}
+}
+
+
+#else  // _WIN32
+
+
+static void detectTopology(CPUTopology & /* topology */) {
+}
+
+
+#endif  // _WIN32
+
+
+static const CPUTopology &getTopology() {
+	static const CPUTopology topology = [] () {
+		CPUTopology t;
+		detectTopology(t);
+		return t;
+	} ();
+
+	return topology;
+}
+
+
+bool isHybridCPU() {
+	return getTopology().hybrid();
+}
+
+
+unsigned int numCores(CoreClass coreClass) {
+	const auto &topology = getTopology();
+	if (!topology.hybrid()) {
+		return std::max(1U, std::thread::hardware_concurrency());
+	}
+
+	return static_cast<unsigned int>(topology.cores(coreClass).size());
+}
+
+
+void placeCurrentThread(CoreClass coreClass) {
+	const auto &topology = getTopology();
+	if (!topology.hybrid()) {
+		return;
+	}
+
+	const auto &cores = topology.cores(coreClass);
+
+#ifdef _WIN32
+
+	// unlike affinity masks CPU sets work across processor groups
+	// and the OS can still use other cores when these are parked
+	std::vector<ULONG> ids(cores.begin(), cores.end());
+	if (!SetThreadSelectedCpuSets(GetCurrentThread(), ids.data(), static_cast<ULONG>(ids.size()))) {
+		LOG_DEBUG("SetThreadSelectedCpuSets failed: %u\n", static_cast<unsigned int>(GetLastError()));
+	}
+
+#elif defined(__linux__)
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (unsigned long cpu : cores) {
+		if (cpu < CPU_SETSIZE) {
+			CPU_SET(cpu, &set);
+		}
+	}
+
+	// fails if a cpuset or the user's taskset excludes all of them
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err != 0) {
+		LOG_DEBUG("pthread_setaffinity_np failed: %d\n", err);
+	}
+
+#else  // _WIN32
+
+	(void) cores;
+
+#endif  // _WIN32
+}
+
+
+std::string describeCPUTopology() {
+	const auto &topology = getTopology();
+	if (!topology.hybrid()) {
+		return "not hybrid, " + std::to_string(numCores(CoreClass::Performance)) + " logical processors";
+	}
+
+	return "hybrid, " + std::to_string(topology.performance.size()) + " performance and "
+	     + std::to_string(topology.efficiency.size()) + " efficiency logical processors from "
+	     + topology.source;
+}
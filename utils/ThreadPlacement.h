@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#ifndef THREADPLACEMENT_H
+#define THREADPLACEMENT_H
+
+
+#include <cstdint>
+
+#include <string>
+
+
+// hybrid CPUs have fast cores (Intel P-cores, ARM big) and slow ones (E-cores, LITTLE)
+// left to itself the scheduler can move the render thread onto a slow core
+// while background work keeps the fast ones busy
+enum class CoreClass : uint8_t {
+	  Performance  // render, submit and present threads and per-frame jobs
+	, Efficiency   // shader compilation, image decoding, object destruction
+};
+
+
+// true if the CPU has both kinds of cores
+// topology is detected on first use
+bool isHybridCPU();
+
+// logical processors of the class, all of them if the CPU isn't hybrid
+unsigned int numCores(CoreClass coreClass);
+
+// restricts the calling thread to cores of the class
+// does nothing on CPUs which aren't hybrid or when the OS refuses
+void placeCurrentThread(CoreClass coreClass);
+
+// for logging
+std::string describeCPUTopology();
+
+
+#endif  // THREADPLACEMENT_H
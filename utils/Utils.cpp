@@ -23,17 +23,61 @@ THE SOFTWARE.
 
 #include <cassert>
 #include <cerrno>
+#include <cstdarg>
+#include <cstdio>
 #include <cstring>
 
 #include <sys/stat.h>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif  // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+
+#else  // _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#endif  // _WIN32
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <utility>
 
 #include "Utils.h"
 
 #include <SDL.h>
 
 
+// mingw fuckery...
+#if defined(__GNUC__) && defined(_WIN32)
+
+#include <mingw.condition_variable.h>
+#include <mingw.mutex.h>
+#include <mingw.thread.h>
+
+#endif  // defined(__GNUC__) && defined(_WIN32)
+
+
 struct FILEDeleter {
 	void operator()(FILE *f) { fclose(f); }
 };
@@ -41,6 +85,94 @@ struct FILEDeleter {
 
 static FILE *logFile;
 
+
+// lock-free MPSC queue of formatted messages
+// producers format on their own thread, the writer thread does the file I/O
+// bounded ring with per-slot sequence numbers
+struct LogSlot {
+	std::atomic<size_t>  sequence;
+	unsigned int         length;
+	char                 text[logMessageSize];
+};
+
+
+static std::unique_ptr<LogSlot[]>  logSlots;
+static std::atomic<size_t>         logEnqueuePos;
+// only touched with logConsumerMutex held
+static size_t                      logDequeuePos;
+
+// whoever drains the queue holds this, the writer thread or a flushing producer
+static std::mutex                  logConsumerMutex;
+
+// false before logInit, after logShutdown or if the log file couldn't be opened
+static std::atomic<bool>           logAsync;
+static std::thread                 logThread;
+static std::mutex                  logThreadMutex;
+static std::condition_variable     logThreadCV;
+static bool                        logThreadQuit;
+
+
+static bool logEnqueue(const char *text, unsigned int length) {
+	assert(length < logMessageSize);
+
+	size_t pos = logEnqueuePos.load(std::memory_order_relaxed);
+	LogSlot *slot;
+	while (true) {
+		slot = &logSlots[pos & (logQueueSize - 1)];
+		size_t seq = slot->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (diff == 0) {
+			if (logEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// full
+			return false;
+		} else {
+			pos = logEnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	memcpy(slot->text, text, length);
+	slot->length = length;
+	slot->sequence.store(pos + 1, std::memory_order_release);
+
+	return true;
+}
+
+
+// logConsumerMutex must be held
+// writes everything enqueued before the call
+// waits for producers which have claimed a slot but not filled it yet
+static void logDrain() {
+	size_t end = logEnqueuePos.load(std::memory_order_acquire);
+	while (logDequeuePos != end) {
+		LogSlot &slot = logSlots[logDequeuePos & (logQueueSize - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != logDequeuePos + 1) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		fwrite(slot.text, 1, slot.length, logFile);
+		slot.sequence.store(logDequeuePos + logQueueSize, std::memory_order_release);
+		logDequeuePos++;
+	}
+}
+
+
+static void logThreadFunc() {
+	std::unique_lock<std::mutex> lock(logThreadMutex);
+	while (!logThreadQuit) {
+		// producers don't signal, a short poll keeps logWrite free of syscalls
+		logThreadCV.wait_for(lock, std::chrono::milliseconds(logWriteInterval));
+
+		std::unique_lock<std::mutex> consumerLock(logConsumerMutex);
+		logDrain();
+		fflush(logFile);
+	}
+}
+
+
 void logInit() {
 	assert(!logFile);
 
@@ -49,26 +181,92 @@ void logInit() {
 	SDL_free(logFilePath);
 	logFileName += "logfile.txt";
 	logFile = fopen(logFileName.c_str(), "wb");
+	if (!logFile) {
+		return;
+	}
+
+	logSlots.reset(new LogSlot[logQueueSize]);
+	for (size_t i = 0; i < logQueueSize; i++) {
+		logSlots[i].sequence.store(i, std::memory_order_relaxed);
+		logSlots[i].length = 0;
+	}
+	logEnqueuePos.store(0, std::memory_order_relaxed);
+	logDequeuePos = 0;
+
+	logThreadQuit = false;
+	logThread     = std::thread(logThreadFunc);
+	logAsync.store(true, std::memory_order_release);
 }
 
 
 void logWrite(const char* message, ...) {
 	va_list argp;
 	va_start(argp, message);
-	
-	if (logFile) {
-		vfprintf(logFile, message, argp);
-	} else {
-		// Write to console if opening log file failed
-		vprintf(message, argp);
+
+	if (!logAsync.load(std::memory_order_acquire)) {
+		if (logFile) {
+			vfprintf(logFile, message, argp);
+		} else {
+			// Write to console if opening log file failed
+			vprintf(message, argp);
+		}
+		va_end(argp);
+		return;
 	}
 
+	char buffer[logMessageSize];
+	int length = vsnprintf(buffer, sizeof(buffer), message, argp);
 	va_end(argp);
+
+	if (length < 0) {
+		return;
+	}
+
+	if (static_cast<unsigned int>(length) < logMessageSize) {
+		if (logEnqueue(buffer, static_cast<unsigned int>(length))) {
+			return;
+		}
+
+		// queue full, drain it ourselves and try again
+		std::unique_lock<std::mutex> lock(logConsumerMutex);
+		logDrain();
+		if (logEnqueue(buffer, static_cast<unsigned int>(length))) {
+			return;
+		}
+	}
+
+	// too long for a slot (shader info logs and such)
+	// write directly after everything already queued to keep the order
+	std::vector<char> longBuffer(length + 1);
+	va_start(argp, message);
+	vsnprintf(&longBuffer[0], longBuffer.size(), message, argp);
+	va_end(argp);
+
+	std::unique_lock<std::mutex> lock(logConsumerMutex);
+	logDrain();
+	fwrite(&longBuffer[0], 1, length, logFile);
 }
 
 
 void logShutdown() {
-	assert(logFile);
+	if (!logFile) {
+		return;
+	}
+
+	logAsync.store(false, std::memory_order_release);
+
+	{
+		std::unique_lock<std::mutex> lock(logThreadMutex);
+		logThreadQuit = true;
+	}
+	logThreadCV.notify_one();
+	logThread.join();
+
+	{
+		std::unique_lock<std::mutex> lock(logConsumerMutex);
+		logDrain();
+	}
+	logSlots.reset();
 
 	fflush(logFile);
 	fclose(logFile);
@@ -77,12 +275,40 @@ void logShutdown() {
 
 
 void logFlush() {
-	assert(logFile);
+	if (!logFile) {
+		fflush(stdout);
+		return;
+	}
 
+	std::unique_lock<std::mutex> lock(logConsumerMutex);
+	logDrain();
 	fflush(logFile);
 }
 
 
+bool LogRateLimit::allow() {
+	uint64_t now   = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	uint64_t start = windowStart.load(std::memory_order_relaxed);
+
+	if (now - start >= logRateLimitWindow && windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+		// this thread opened a new window
+		unsigned int numSuppressed = suppressed.exchange(0, std::memory_order_relaxed);
+		count.store(1, std::memory_order_relaxed);
+		if (numSuppressed != 0) {
+			logWrite("(%u similar messages suppressed)\n", numSuppressed);
+		}
+		return true;
+	}
+
+	if (count.fetch_add(1, std::memory_order_relaxed) < logRateLimitCount) {
+		return true;
+	}
+
+	suppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+
 std::vector<char> readTextFile(std::string filename) {
 	std::unique_ptr<FILE, FILEDeleter> file(fopen(filename.c_str(), "rb"));
 
@@ -165,6 +391,249 @@ void writeFile(const std::string &filename, const void *contents, size_t size) {
 }
 
 
+void streamingCopy(void *dst_, const void *src_, size_t size) {
+	if (size < streamingCopyMinSize) {
+		memcpy(dst_, src_, size);
+		return;
+	}
+
+	char       *dst = reinterpret_cast<char *>(dst_);
+	const char *src = reinterpret_cast<const char *>(src_);
+
+	// partial line before the first aligned one
+	size_t head = (streamingCopyAlign - (reinterpret_cast<uintptr_t>(dst) & (streamingCopyAlign - 1))) & (streamingCopyAlign - 1);
+	memcpy(dst, src, head);
+	dst  += head;
+	src  += head;
+	size -= head;
+
+	size_t lines = size / streamingCopyAlign;
+
+#if defined(__AVX__)
+
+	for (size_t i = 0; i < lines; i++) {
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 32));
+		_mm256_stream_si256(reinterpret_cast<__m256i *>(dst),      a);
+		_mm256_stream_si256(reinterpret_cast<__m256i *>(dst + 32), b);
+		dst += streamingCopyAlign;
+		src += streamingCopyAlign;
+	}
+	// non-temporal stores are weakly ordered, make them visible before the GPU is told
+	_mm_sfence();
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+	for (size_t i = 0; i < lines; i++) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 48));
+		_mm_stream_si128(reinterpret_cast<__m128i *>(dst),      a);
+		_mm_stream_si128(reinterpret_cast<__m128i *>(dst + 16), b);
+		_mm_stream_si128(reinterpret_cast<__m128i *>(dst + 32), c);
+		_mm_stream_si128(reinterpret_cast<__m128i *>(dst + 48), d);
+		dst += streamingCopyAlign;
+		src += streamingCopyAlign;
+	}
+	_mm_sfence();
+
+#elif defined(__ARM_NEON)
+
+	// no non-temporal store intrinsic, but writing each line in one go
+	// lets the write-combine buffer drain full lines
+	for (size_t i = 0; i < lines; i++) {
+		uint8x16_t a = vld1q_u8(reinterpret_cast<const uint8_t *>(src));
+		uint8x16_t b = vld1q_u8(reinterpret_cast<const uint8_t *>(src + 16));
+		uint8x16_t c = vld1q_u8(reinterpret_cast<const uint8_t *>(src + 32));
+		uint8x16_t d = vld1q_u8(reinterpret_cast<const uint8_t *>(src + 48));
+		vst1q_u8(reinterpret_cast<uint8_t *>(dst),      a);
+		vst1q_u8(reinterpret_cast<uint8_t *>(dst + 16), b);
+		vst1q_u8(reinterpret_cast<uint8_t *>(dst + 32), c);
+		vst1q_u8(reinterpret_cast<uint8_t *>(dst + 48), d);
+		dst += streamingCopyAlign;
+		src += streamingCopyAlign;
+	}
+
+#else
+
+	memcpy(dst, src, lines * streamingCopyAlign);
+	dst += lines * streamingCopyAlign;
+	src += lines * streamingCopyAlign;
+
+#endif
+
+	memcpy(dst, src, size - lines * streamingCopyAlign);
+}
+
+
+MappedFile::MappedFile()
+: data_(nullptr)
+, size_(0)
+#ifdef _WIN32
+, file(nullptr)
+, mapping(nullptr)
+#endif  // _WIN32
+{
+}
+
+
+#ifdef _WIN32
+
+
+MappedFile::MappedFile(const std::string &filename)
+: MappedFile()
+{
+	HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (f == INVALID_HANDLE_VALUE) {
+		// TODO: better exception
+		throw std::runtime_error("file not found " + filename);
+	}
+	file = f;
+
+	LARGE_INTEGER filesize;
+	if (!GetFileSizeEx(f, &filesize)) {
+		close();
+		// TODO: better exception
+		throw std::runtime_error("GetFileSizeEx failed for \"" + filename + "\"");
+	}
+
+	// can't map an empty file
+	if (filesize.QuadPart == 0) {
+		return;
+	}
+
+	mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		close();
+		// TODO: better exception
+		throw std::runtime_error("CreateFileMapping failed for \"" + filename + "\"");
+	}
+
+	data_ = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data_) {
+		close();
+		// TODO: better exception
+		throw std::runtime_error("MapViewOfFile failed for \"" + filename + "\"");
+	}
+	size_ = static_cast<size_t>(filesize.QuadPart);
+}
+
+
+void MappedFile::close() {
+	if (data_) {
+		UnmapViewOfFile(data_);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+
+	data_   = nullptr;
+	size_   = 0;
+	mapping = nullptr;
+	file    = nullptr;
+}
+
+
+#else  // _WIN32
+
+
+MappedFile::MappedFile(const std::string &filename)
+: MappedFile()
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		// TODO: better exception
+		throw std::runtime_error("file not found " + filename);
+	}
+
+	struct stat statbuf;
+	memset(&statbuf, 0, sizeof(struct stat));
+	int retval = fstat(fd, &statbuf);
+	if (retval < 0) {
+		std::string msg = "fstat failed for \"" + filename + "\": " + strerror(errno);
+		::close(fd);
+		// TODO: better exception
+		throw std::runtime_error(msg);
+	}
+
+	// can't map an empty file
+	if (statbuf.st_size == 0) {
+		::close(fd);
+		return;
+	}
+
+	size_t filesize = static_cast<size_t>(statbuf.st_size);
+	void *ptr = mmap(nullptr, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	::close(fd);
+	if (ptr == MAP_FAILED) {
+		// TODO: better exception
+		std::string msg = "mmap failed for \"" + filename + "\": " + strerror(errno);
+		throw std::runtime_error(msg);
+	}
+
+	data_ = static_cast<const char *>(ptr);
+	size_ = filesize;
+}
+
+
+void MappedFile::close() {
+	if (data_) {
+		munmap(const_cast<char *>(data_), size_);
+	}
+
+	data_ = nullptr;
+	size_ = 0;
+}
+
+
+#endif  // _WIN32
+
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+: data_(other.data_)
+, size_(other.size_)
+#ifdef _WIN32
+, file(other.file)
+, mapping(other.mapping)
+#endif  // _WIN32
+{
+	other.data_   = nullptr;
+	other.size_   = 0;
+#ifdef _WIN32
+	other.file    = nullptr;
+	other.mapping = nullptr;
+#endif  // _WIN32
+}
+
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+	if (this == &other) {
+		return *this;
+	}
+
+	close();
+
+	std::swap(data_,   other.data_);
+	std::swap(size_,   other.size_);
+#ifdef _WIN32
+	std::swap(file,    other.file);
+	std::swap(mapping, other.mapping);
+#endif  // _WIN32
+
+	return *this;
+}
+
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+
 bool fileExists(const std::string &filename) {
 	std::unique_ptr<FILE, FILEDeleter> file(fopen(filename.c_str(), "rb"));
 
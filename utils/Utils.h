@@ -27,6 +27,7 @@ THE SOFTWARE.
 
 #include <cinttypes>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -89,11 +90,79 @@ THE SOFTWARE.
 	}
 
 
+// compile-time log level, LOG_DEBUG compiles out above LOG_LEVEL_DEBUG
+#define LOG_LEVEL_DEBUG  0
+#define LOG_LEVEL_INFO   1
+
+#ifndef LOG_LEVEL
+
+#ifdef NDEBUG
+#define LOG_LEVEL LOG_LEVEL_INFO
+#else  // NDEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif  // NDEBUG
+
+#endif  // LOG_LEVEL
+
+
 #define LOG(msg, ...) logWrite(msg, ##__VA_ARGS__)
 
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(msg, ...) logWrite(msg, ##__VA_ARGS__)
+#else  // LOG_LEVEL
+// keeps the format checked and the arguments used
+#define LOG_DEBUG(msg, ...) do { if (false) { logWrite(msg, ##__VA_ARGS__); } } while (false)
+#endif  // LOG_LEVEL
+
+// for messages which can repeat every frame
+// at most logRateLimitCount per call site every logRateLimitWindow ms
+#define LOG_RATE_LIMITED(msg, ...) \
+	do { \
+		static LogRateLimit logRateLimit_; \
+		if (logRateLimit_.allow()) { \
+			logWrite(msg, ##__VA_ARGS__); \
+		} \
+	} while (false)
+
+
+// messages longer than this bypass the queue and are written synchronously
+static const unsigned int logMessageSize     = 256;
+// must be a power of two
+static const unsigned int logQueueSize       = 1024;
+// ms between writer thread wakeups
+static const unsigned int logWriteInterval   = 10;
+static const unsigned int logRateLimitCount  = 5;
+static const unsigned int logRateLimitWindow = 1000;
+
+
+class LogRateLimit {
+	std::atomic<uint64_t>      windowStart;
+	std::atomic<unsigned int>  count;
+	std::atomic<unsigned int>  suppressed;
+
+
+public:
+
+	constexpr LogRateLimit()
+	: windowStart(0)
+	, count(0)
+	, suppressed(0)
+	{
+	}
+
+	LogRateLimit(const LogRateLimit &)            = delete;
+	LogRateLimit &operator=(const LogRateLimit &) = delete;
+
+	// false if this call site is over its limit
+	bool allow();
+};
+
+
+// logInit starts a writer thread, until then and after logShutdown LOG is synchronous
 void logInit();
 void logWrite(const char* message, ...) PRINTF(1, 2);
 void logShutdown();
+// writes out everything queued so far
 void logFlush();
 
 std::vector<char> readTextFile(std::string filename);
@@ -102,6 +171,68 @@ void writeFile(const std::string &filename, const void *contents, size_t size);
 bool fileExists(const std::string &filename);
 int64_t getFileTimestamp(const std::string &filename);
 
+
+// copies below this go through memcpy, the data is likely still in cache when the GPU reads it
+static const size_t streamingCopyMinSize = 4096;
+// streamingCopy writes whole lines of this size, allocations it targets should start on one
+static const size_t streamingCopyAlign   = 64;
+
+// memcpy for uncached write-combined destinations like mapped ring buffers
+// large copies use non-temporal stores which don't read the destination lines first
+void streamingCopy(void *dst, const void *src, size_t size);
+
+
+// read-only view of a whole file, mmap / MapViewOfFile
+// the contents must not be used after the MappedFile is destroyed
+// a file truncated by another process while mapped faults on access
+class MappedFile {
+	const char  *data_;
+	size_t      size_;
+#ifdef _WIN32
+	void        *file;
+	void        *mapping;
+#endif  // _WIN32
+
+
+	void close();
+
+
+public:
+
+	MappedFile();
+
+	// throws std::runtime_error like readFile
+	explicit MappedFile(const std::string &filename);
+
+	MappedFile(const MappedFile &)            = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+
+	~MappedFile();
+
+	const char *data() const {
+		return data_;
+	}
+
+	size_t size() const {
+		return size_;
+	}
+
+	bool empty() const {
+		return size_ == 0;
+	}
+
+	const char *begin() const {
+		return data_;
+	}
+
+	const char *end() const {
+		return data_ + size_;
+	}
+};
+
 // From https://graphics.stanford.edu/~seander/bithacks.html#DetermineIfPowerOf2
 static inline bool isPow2(unsigned int value) {
 	return (value & (value - 1)) == 0;
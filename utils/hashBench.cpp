@@ -0,0 +1,202 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// compares HashMap to std::unordered_map on the key types and sizes the demo uses
+
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <pcg_random.hpp>
+
+#include "utils/Hash.h"
+
+
+// render graph rendertarget and format, like PassResources
+typedef std::pair<uint32_t, uint32_t> RTFormat;
+
+
+namespace std {
+
+	template <> struct hash<RTFormat> {
+		size_t operator()(const RTFormat &k) const {
+			return hashCombine(hash<uint32_t>()(k.first), hash<uint32_t>()(k.second));
+		}
+	};
+
+}  // namespace std
+
+
+// keep the optimizer from throwing the results away
+static volatile uint64_t sink;
+
+
+static const unsigned int repeats = 2000;
+
+
+static uint64_t nanoseconds() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+struct Timings {
+	double insert;
+	double hit;
+	double miss;
+	double iterate;
+};
+
+
+template <typename Map, typename K>
+static Timings measure(const std::vector<K> &keys, const std::vector<K> &missing) {
+	Timings t;
+	uint64_t sum = 0;
+
+	uint64_t start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		Map m;
+		for (unsigned int i = 0; i < keys.size(); i++) {
+			m.emplace(keys[i], i);
+		}
+		sum += m.size();
+	}
+	t.insert = double(nanoseconds() - start) / (double(repeats) * keys.size());
+
+	Map m;
+	for (unsigned int i = 0; i < keys.size(); i++) {
+		m.emplace(keys[i], i);
+	}
+
+	start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		for (const auto &k : keys) {
+			sum += m.find(k)->second;
+		}
+	}
+	t.hit = double(nanoseconds() - start) / (double(repeats) * keys.size());
+
+	start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		for (const auto &k : missing) {
+			sum += (m.find(k) == m.end()) ? 1 : 0;
+		}
+	}
+	t.miss = double(nanoseconds() - start) / (double(repeats) * missing.size());
+
+	start = nanoseconds();
+	for (unsigned int r = 0; r < repeats; r++) {
+		for (const auto &p : m) {
+			sum += p.second;
+		}
+	}
+	t.iterate = double(nanoseconds() - start) / (double(repeats) * keys.size());
+
+	sink = sink + sum;
+	return t;
+}
+
+
+template <typename K>
+static void compare(const char *name, const std::vector<K> &keys, const std::vector<K> &missing) {
+	Timings s = measure<std::unordered_map<K, unsigned int> >(keys, missing);
+	Timings f = measure<HashMap<K, unsigned int> >(keys, missing);
+
+	printf("%-24s %5u  insert %6.1f / %6.1f  hit %6.1f / %6.1f  miss %6.1f / %6.1f  iterate %6.1f / %6.1f\n"
+	      , name, static_cast<unsigned int>(keys.size())
+	      , s.insert, f.insert, s.hit, f.hit, s.miss, f.miss, s.iterate, f.iterate);
+}
+
+
+static std::string randomName(pcg32 &rng, const char *prefix) {
+	std::string s(prefix);
+	unsigned int len = 4 + rng(12);
+	for (unsigned int i = 0; i < len; i++) {
+		s.push_back(static_cast<char>('a' + rng(26)));
+	}
+	return s;
+}
+
+
+int main(int /* argc */, char * /* argv */ []) {
+	pcg32 rng(12345);
+
+	printf("nanoseconds per operation, std::unordered_map / HashMap\n");
+
+	{
+		// Rendertargets and RenderPasses enums
+		std::vector<uint32_t> keys, missing;
+		for (uint32_t i = 0; i < 16; i++) {
+			keys.push_back(i);
+			missing.push_back(i + 16);
+		}
+		compare("render graph enum", keys, missing);
+	}
+
+	{
+		// PassResources, a few formats per rendertarget
+		std::vector<RTFormat> keys, missing;
+		for (uint32_t i = 0; i < 16; i++) {
+			keys.emplace_back(i, 0);
+			keys.emplace_back(i, 10 + (i % 3));
+			missing.emplace_back(i, 20);
+		}
+		compare("rendertarget + format", keys, missing);
+	}
+
+	for (unsigned int n : { 64, 2048 }) {
+		// pipeline desc hashes and SPIR-V cache keys
+		std::vector<uint64_t> keys, missing;
+		for (unsigned int i = 0; i < n; i++) {
+			keys.push_back((uint64_t(rng()) << 32) | rng());
+			missing.push_back((uint64_t(rng()) << 32) | rng());
+		}
+		compare("64-bit hash", keys, missing);
+	}
+
+	{
+		// ShaderMacros
+		std::vector<std::string> keys, missing;
+		for (unsigned int i = 0; i < 8; i++) {
+			keys.push_back(randomName(rng, "SMAA_"));
+			missing.push_back(randomName(rng, "FXAA_"));
+		}
+		compare("shader macro name", keys, missing);
+	}
+
+	{
+		// shaderSources and includeCache
+		std::vector<std::string> keys, missing;
+		for (unsigned int i = 0; i < 48; i++) {
+			keys.push_back(randomName(rng, "shaders/") + ".frag");
+			missing.push_back(randomName(rng, "shaders/") + ".vert");
+		}
+		compare("shader file name", keys, missing);
+	}
+
+	return 0;
+}
@@ -4,6 +4,11 @@ d              := $(dir)
 
 
 FILES:= \
+	FramePacer.cpp \
+	JobSystem.cpp \
+	PowerMonitor.cpp \
+	Profiler.cpp \
+	ThreadPlacement.cpp \
 	Utils.cpp \
 	# empty line
 
@@ -12,6 +17,22 @@ utils_MODULES:=
 utils_SRC:=$(foreach f, $(FILES), $(dir)/$(f))
 
 
+hashBench_MODULES:=
+hashBench_SRC:=$(dir)/hashBench.cpp
+
+
+PROGRAMS+= \
+	hashBench \
+	# empty line
+
+
+ifeq ($(CPU_PROFILER),y)
+
+CFLAGS+=-DCPU_PROFILER
+
+endif  # CPU_PROFILER
+
+
 SRC_$(d):=$(addprefix $(d)/,$(FILES))
 
 
@@ -0,0 +1,69 @@
+/*
+Copyright (c) 2015-2021 Alternative Games Ltd / Turo Lamminen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#version 450 core
+
+#include "shaderDefines.h"
+#include "utils.h"
+
+
+// camera motion only, the scene is treated as static
+// reprojects each pixel's depth to the previous frame's clip space
+
+#if DEPTH_MS
+
+layout(set = 1, binding = 1) uniform texture2DMS depthTex;
+
+#else  // DEPTH_MS
+
+layout(set = 1, binding = 1) uniform texture2D depthTex;
+
+#endif  // DEPTH_MS
+
+
+layout (location = 0) in vec2 texcoord;
+layout (location = 0) out vec2 outVelocity;
+
+
+void main(void)
+{
+#if DEPTH_MS
+    // first sample, the velocity of a resolved target would be an average anyway
+    float depth = texelFetch(sampler2DMS(depthTex, nearestSampler), ivec2(gl_FragCoord.xy), 0).x;
+#else  // DEPTH_MS
+    float depth = texelFetch(sampler2D(depthTex, nearestSampler), ivec2(gl_FragCoord.xy), 0).x;
+#endif  // DEPTH_MS
+
+    // back to the scene's clip space, inverse of temporal.vert
+    vec2 t = texcoord / renderScale.xy;
+#ifndef VULKAN_FLIP
+    t = flipTexCoord(t);
+#endif  // VULKAN_FLIP
+    vec2 curr = t * vec2(2.0, -2.0) + vec2(-1.0, 1.0);
+
+    vec4 prevClip = reprojection * vec4(curr, depth, 1.0);
+    vec2 prev     = prevClip.xy / prevClip.w;
+
+    // same scale as cube.frag
+    outVelocity   = (curr - prev) * vec2(0.5, -0.5) * renderScale.xy;
+}